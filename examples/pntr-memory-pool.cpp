@@ -15,26 +15,22 @@ class Object
 : public pntr::IntruderAlloc< // Object class contains IntruderAlloc.
     Object,
     pntr::ThreadUnsafe, // Thread safety is disabled and not required for the single-threaded example.
-    std::uint64_t,      // Control block size defined by this type.
-                        // It doesn't make sense to use a smaller type here as it would be padded to
-                        // the size of a pointer, because the allocator saves a pointer.
-    32u,                // 32 bits for the usage counter, internally using a separate 'std::uint32_t'.
-    32u,                // 32 bits for the weak counter, internally using a separate 'std::uint32_t'.
+    std::uint32_t,      // Control block size defined by this type.
+    16u,                // 16 bits for the usage counter.
+    8u,                 // 8 bits for the weak counter.
     0u, 0u, 0u,         // No bits for position, size, or alignment as no inheritance is used.
-    // Using the 'pntr' allocator that uses a 'std::pmr::memory_resource'.
-    // We could also use 'std::pmr::polymorphic_allocator', but as every allocator which requires type
-    // information for deallocation it would require to store an additonal pointer in the control block.
+    // Using the 'pntr' allocator that uses a registered 'std::pmr::memory_resource'.
+    // It is restored from an index in the remaining 8 user bits, so the control block doesn't
+    // need to save a pointer like 'AllocatorMemoryResource' or 'std::pmr::polymorphic_allocator'.
     // No need for static support as only the base class is used.
-    pntr::AllocatorMemoryResource<pntr::NoStaticSupport>>
+    pntr::AllocatorMemoryResourceIndex<pntr::NoStaticSupport>>
 {
 public:
   std::uint32_t m_lifetime{};
 };
 
-// The resulting class size is the size of the control data, plus the size of one pointer
-// for the allocator to save the memory resource, plus the size of a pointer for the lifetime
-// variable, which includes padding for the alignment of the control block.
-static_assert(sizeof(Object) == sizeof(std::uint64_t) + 2u * sizeof(void *));
+// The resulting class size is the size of the control data plus the size of the lifetime variable.
+static_assert(sizeof(Object) == 2u * sizeof(std::uint32_t));
 
 
 inline std::uint32_t
@@ -72,7 +68,7 @@ main()
         }
         if (!object_ptr && --create == 0u)
         {
-          // Create an object with the given allocator and save it in the control block for deallocation.
+          // Create an object with the given allocator and save its index in the control block for deallocation.
           object_ptr = pntr::allocate_shared<Object>(Object::PntrAllocator(&resource));
           if (object_ptr)
           {
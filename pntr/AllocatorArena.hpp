@@ -0,0 +1,636 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/ControlDataSharded.hpp>
+#include <pntr/SharedPtr.hpp>
+#include <pntr/detail/CurrentScope.hpp>
+#include <pntr/detail/NumaPolicy.hpp>
+
+#if defined(__linux__)
+
+  #include <algorithm>
+  #include <cerrno>
+  #include <cstddef>
+  #include <cstdint>
+  #include <iterator>
+  #include <mutex>
+  #include <new>
+  #include <system_error>
+  #include <utility>
+
+  #include <sys/mman.h>
+
+PNTR_NAMESPACE_BEGIN
+
+
+class ArenaPool;
+
+namespace detail
+{
+  // The layout of an arena. The first chunk holds the header, all others are dedicated to one size
+  // class each. Arenas are aligned to their size, so the header of a block's arena can be found
+  // by masking its address.
+  struct ArenaLayout
+  {
+    // 32 MiB, a multiple of the 2 MiB huge page size.
+    static constexpr unsigned s_arena_bits = 25u;
+    static constexpr std::size_t s_arena_size = std::size_t{1u} << s_arena_bits;
+    static constexpr unsigned s_chunk_bits = 16u;
+    static constexpr std::size_t s_chunk_size = std::size_t{1u} << s_chunk_bits;
+    static constexpr std::size_t s_chunk_count = s_arena_size >> s_chunk_bits;
+    static constexpr std::size_t s_chunk_header = 64u;
+    static constexpr unsigned s_unit_bits = 4u;
+    static constexpr std::size_t s_min_block = std::size_t{1u} << s_unit_bits;
+    // The largest class is an eighth of a chunk, so the chunk header wastes at most one block.
+    static constexpr unsigned s_class_count = s_chunk_bits - 2u - s_unit_bits;
+    static constexpr std::size_t s_max_block = s_min_block << (s_class_count - 1u);
+    static constexpr std::size_t s_max_alignment = s_chunk_header;
+    static constexpr std::size_t s_page_size = 4096u;
+    // The number of caches, which are selected by the thread, and their blocks per size class.
+    static constexpr std::size_t s_cache_count = 16u;
+    static constexpr unsigned s_cache_blocks = 16u;
+    static constexpr unsigned s_cache_refill = 8u;
+
+    static_assert((s_chunk_size - s_chunk_header) / s_max_block >= 4u);
+  };
+
+  struct ArenaBlock
+  {
+    ArenaBlock * m_next;
+  };
+
+  struct ArenaChunk
+  {
+    unsigned m_class;
+  };
+
+  // The state of an arena, which is only accessed while the mutex of its pool is locked.
+  struct ArenaHeader
+  {
+    ArenaPool * m_pool;
+    ArenaHeader * m_next;
+    std::size_t m_live;
+    std::size_t m_next_chunk;
+    bool m_resident;
+    ArenaBlock * m_free[ArenaLayout::s_class_count];
+    std::byte * m_bump[ArenaLayout::s_class_count];
+    std::byte * m_bump_end[ArenaLayout::s_class_count];
+  };
+
+  // Free blocks which are allocated and deallocated without locking the pool. Each thread uses one
+  // of the caches of a pool, so threads rarely contend for the same mutex.
+  struct alignas(64) ArenaCache
+  {
+    std::mutex m_mutex;
+    ArenaBlock * m_free[ArenaLayout::s_class_count] = {};
+    unsigned m_count[ArenaLayout::s_class_count] = {};
+  };
+
+  static_assert(sizeof(ArenaHeader) <= ArenaLayout::s_chunk_size);
+  static_assert(sizeof(ArenaChunk) <= ArenaLayout::s_chunk_header);
+
+
+  // Allocate and deallocate blocks in an arena, like 'SharedMemoryHeap', but without atomics.
+  // Chunks are carved lazily, so the pages of an arena are only touched when they are used.
+  class ArenaHeap
+  {
+    using Layout = ArenaLayout;
+
+  public:
+    // Return the size class for the given size and alignment, or 's_class_count' if unsupported.
+    static unsigned
+    size_class(std::size_t const p_size, std::size_t const p_alignment) noexcept
+    {
+      if (p_alignment > Layout::s_max_alignment)
+      {
+        return Layout::s_class_count;
+      }
+      std::size_t const size = std::max({p_size, p_alignment, Layout::s_min_block});
+      unsigned const bits = detail::bit_width(size - 1u);
+      return (bits - Layout::s_unit_bits < Layout::s_class_count ? bits - Layout::s_unit_bits : Layout::s_class_count);
+    }
+
+    static ArenaHeader &
+    arena_of(void const * const p_pointer) noexcept
+    {
+      auto const address = reinterpret_cast<std::uintptr_t>(p_pointer) & ~(Layout::s_arena_size - 1u);
+      return *std::launder(reinterpret_cast<ArenaHeader *>(address));
+    }
+
+    static void
+    reset(ArenaHeader & p_arena) noexcept
+    {
+      p_arena.m_next_chunk = 1u;
+      std::fill(std::begin(p_arena.m_free), std::end(p_arena.m_free), nullptr);
+      std::fill(std::begin(p_arena.m_bump), std::end(p_arena.m_bump), nullptr);
+      std::fill(std::begin(p_arena.m_bump_end), std::end(p_arena.m_bump_end), nullptr);
+    }
+
+    static bool
+    can_allocate(ArenaHeader const & p_arena, unsigned const p_class) noexcept
+    {
+      return (p_arena.m_free[p_class] != nullptr || p_arena.m_bump[p_class] != p_arena.m_bump_end[p_class]
+              || p_arena.m_next_chunk < Layout::s_chunk_count);
+    }
+
+    static void *
+    allocate(ArenaHeader & p_arena, unsigned const p_class) noexcept
+    {
+      std::size_t const block_size = Layout::s_min_block << p_class;
+      void * block = nullptr;
+      if (ArenaBlock * const free = p_arena.m_free[p_class]; free != nullptr)
+      {
+        p_arena.m_free[p_class] = free->m_next;
+        block = free;
+      }
+      else
+      {
+        if (p_arena.m_bump[p_class] == p_arena.m_bump_end[p_class])
+        {
+          if (p_arena.m_next_chunk == Layout::s_chunk_count)
+          {
+            return nullptr;
+          }
+          std::byte * const chunk =
+            reinterpret_cast<std::byte *>(&p_arena) + (p_arena.m_next_chunk++ << Layout::s_chunk_bits);
+          new (chunk) ArenaChunk{p_class};
+          // Only complete blocks are carved, so the largest class has seven blocks per chunk.
+          std::size_t const blocks = (Layout::s_chunk_size - Layout::s_chunk_header) / block_size;
+          p_arena.m_bump[p_class] = chunk + Layout::s_chunk_header;
+          p_arena.m_bump_end[p_class] = p_arena.m_bump[p_class] + blocks * block_size;
+        }
+        block = p_arena.m_bump[p_class];
+        p_arena.m_bump[p_class] += block_size;
+      }
+      ++p_arena.m_live;
+      return block;
+    }
+
+    // Return the size class of the chunk which contains the block.
+    static unsigned
+    class_of(void const * const p_pointer) noexcept
+    {
+      auto const address = reinterpret_cast<std::uintptr_t>(p_pointer) & ~(Layout::s_chunk_size - 1u);
+      return std::launder(reinterpret_cast<ArenaChunk const *>(address))->m_class;
+    }
+
+    // Return true if the arena is empty afterwards.
+    static bool
+    deallocate(ArenaHeader & p_arena, void * const p_pointer) noexcept
+    {
+      unsigned const size_class = class_of(p_pointer);
+      p_arena.m_free[size_class] = new (p_pointer) ArenaBlock{p_arena.m_free[size_class]};
+      PNTR_ASSERT(p_arena.m_live > 0u);
+      return (--p_arena.m_live == 0u);
+    }
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                           ArenaPool                                            //
+//                                                                                                //
+//               A pool of large arenas backed by huge pages, for 'AllocatorArena'                //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Large populations of small objects allocated with 'std::malloc' are spread over many pages,
+//  which causes many TLB misses on random access and one page fault per page on first touch.
+//  'ArenaPool' reserves arenas of 32 MiB with anonymous 'mmap' and advises the kernel to back them
+//  with transparent huge pages using 'MADV_HUGEPAGE', which is ignored if unsupported.
+//
+//  Each arena is divided into chunks of 64 KiB, each dedicated to one power of two size class
+//  from 16 bytes to 8 KiB, like 'SharedMemorySegment'. The largest class is limited to an eighth of
+//  a chunk, so the chunk header wastes little space.
+//
+//  Each thread allocates from and deallocates into one of the pool's caches of free blocks, which
+//  are selected by the thread, so threads rarely contend for the same mutex. A cache refills and
+//  flushes a few blocks at a time under the mutex of the pool, so objects can be released by any
+//  thread. Cached blocks keep their arena resident until they are reused or 'trim' returns them.
+//
+//  The options can request a number of arenas to be mapped by the constructor as a warm-up, and to
+//  prefault all pages of mapped arenas with 'MADV_POPULATE_WRITE', or by touching them on older
+//  kernels. The pages of an arena whose blocks have all been deallocated are returned to the
+//  operating system with 'MADV_DONTNEED', except for the number of empty arenas to retain. The
+//  address space stays reserved for later allocations until the pool is destroyed.
+//
+//  The pages of the arenas can be bound to a preferred NUMA node, see 'NumaPool'.
+//
+//  The pool must outlive all of its objects. Functions which call the operating system throw
+//  'std::system_error' on failure, except for the allocation which returns nullptr.
+//
+
+class ArenaPool
+{
+  using Layout = detail::ArenaLayout;
+  using Heap = detail::ArenaHeap;
+
+public:
+  struct Options
+  {
+    // The number of arenas mapped by the constructor.
+    std::size_t m_arenas = 0u;
+    // The number of empty arenas whose pages are not returned to the operating system.
+    std::size_t m_retain = 1u;
+    // The NUMA node preferred for the pages of the arenas, or -1 for the default policy.
+    int m_node = -1;
+    bool m_huge_pages = true;
+    bool m_prefault = false;
+  };
+
+  ArenaPool()
+  : ArenaPool(Options{})
+  {}
+
+  explicit ArenaPool(Options const & p_options)
+  : m_options(p_options)
+  {
+    reserve(p_options.m_arenas);
+  }
+
+  ~ArenaPool() noexcept
+  {
+    PNTR_TRY_LOG_ERROR(live_count() != 0u, "Destroying an arena pool with live blocks");
+    if (Scope::current() == this)
+    {
+      Scope::current() = nullptr;
+    }
+    for (detail::ArenaHeader * arena = m_arenas; arena != nullptr;)
+    {
+      detail::ArenaHeader * const next = arena->m_next;
+      ::munmap(arena, Layout::s_arena_size);
+      arena = next;
+    }
+  }
+
+  ArenaPool(ArenaPool const &) = delete;
+  ArenaPool & operator=(ArenaPool const &) = delete;
+
+  // Map arenas until the pool has at least the given number.
+  void
+  reserve(std::size_t const p_arenas)
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    while (m_arena_count < p_arenas)
+    {
+      if (map_arena() == nullptr)
+      {
+        throw std::system_error(errno, std::generic_category(), "mmap");
+      }
+    }
+  }
+
+  // Allocate a block, or return nullptr if no arena can be mapped or the request is too big.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    unsigned const size_class = Heap::size_class(p_size, p_alignment);
+    if (size_class >= Layout::s_class_count)
+    {
+      return nullptr;
+    }
+    detail::ArenaCache & cache = own_cache();
+    std::lock_guard<std::mutex> const lock(cache.m_mutex);
+    if (cache.m_free[size_class] == nullptr && !refill(cache, size_class))
+    {
+      return nullptr;
+    }
+    detail::ArenaBlock * const block = cache.m_free[size_class];
+    cache.m_free[size_class] = block->m_next;
+    --cache.m_count[size_class];
+    return block;
+  }
+
+  // Deallocate a block allocated by any pool.
+  static void
+  deallocate(void * const p_pointer) noexcept
+  {
+    ArenaPool & pool = pool_of(p_pointer);
+    unsigned const size_class = Heap::class_of(p_pointer);
+    detail::ArenaCache & cache = pool.own_cache();
+    std::lock_guard<std::mutex> const lock(cache.m_mutex);
+    cache.m_free[size_class] = new (p_pointer) detail::ArenaBlock{cache.m_free[size_class]};
+    if (++cache.m_count[size_class] > Layout::s_cache_blocks)
+    {
+      pool.flush(cache, size_class, Layout::s_cache_blocks / 2u);
+    }
+  }
+
+  // Return the cached blocks of all threads to their arenas, so the pages of empty arenas can be
+  // returned to the operating system.
+  void
+  trim() noexcept
+  {
+    for (detail::ArenaCache & cache : m_caches)
+    {
+      std::lock_guard<std::mutex> const lock(cache.m_mutex);
+      for (unsigned size_class = 0u; size_class < Layout::s_class_count; ++size_class)
+      {
+        flush(cache, size_class, 0u);
+      }
+    }
+  }
+
+  // Make the pool current for the allocations of 'AllocatorArena' in the lifetime of the scope,
+  // for example of objects which aren't created by 'make_shared', like coroutine frames.
+  using Scope = detail::CurrentScope<ArenaPool>;
+
+  // Create a shared object in this pool. The type has to use 'AllocatorArena'.
+  template<class t_shared, typename... t_args>
+  SharedPtr<t_shared>
+  make_shared(t_args &&... p_args)
+  {
+    Scope const scope(*this);
+    return pntr::make_shared<t_shared>(std::forward<t_args>(p_args)...);
+  }
+
+  // Return the preferred NUMA node, or -1.
+  int
+  node() const noexcept
+  {
+    return m_options.m_node;
+  }
+
+  // Return the pool of the arena that contains the given block.
+  static ArenaPool &
+  pool_of(void const * const p_pointer) noexcept
+  {
+    return *Heap::arena_of(p_pointer).m_pool;
+  }
+
+  // Return the number of mapped arenas.
+  std::size_t
+  arena_count() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    return m_arena_count;
+  }
+
+  // Return the number of arenas whose pages have not been returned to the operating system.
+  std::size_t
+  resident_count() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    std::size_t count = 0u;
+    for (detail::ArenaHeader const * arena = m_arenas; arena != nullptr; arena = arena->m_next)
+    {
+      count += (arena->m_resident ? 1u : 0u);
+    }
+    return count;
+  }
+
+  // Return the number of allocated blocks, which don't include the cached blocks. The count is
+  // only exact if no other thread allocates or deallocates concurrently.
+  std::size_t
+  live_count() const noexcept
+  {
+    std::size_t cached = 0u;
+    for (detail::ArenaCache & cache : m_caches)
+    {
+      std::lock_guard<std::mutex> const lock(cache.m_mutex);
+      for (unsigned const count : cache.m_count)
+      {
+        cached += count;
+      }
+    }
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    std::size_t count = 0u;
+    for (detail::ArenaHeader const * arena = m_arenas; arena != nullptr; arena = arena->m_next)
+    {
+      count += arena->m_live;
+    }
+    return (count > cached ? count - cached : 0u);
+  }
+
+private:
+  detail::ArenaCache &
+  own_cache() noexcept
+  {
+    return m_caches[detail::thread_slot() % Layout::s_cache_count];
+  }
+
+  // Move a few blocks of the size class from the arenas to the locked cache. Return false if no
+  // block could be allocated.
+  bool
+  refill(detail::ArenaCache & p_cache, unsigned const p_class) noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    for (unsigned i = 0u; i < Layout::s_cache_refill; ++i)
+    {
+      if (m_current == nullptr || !Heap::can_allocate(*m_current, p_class))
+      {
+        m_current = find_arena(p_class);
+        if (m_current == nullptr)
+        {
+          break;
+        }
+      }
+      if (m_current->m_live == 0u)
+      {
+        if (m_current->m_resident)
+        {
+          --m_empty;
+        }
+        m_current->m_resident = true;
+      }
+      p_cache.m_free[p_class] = new (Heap::allocate(*m_current, p_class)) detail::ArenaBlock{p_cache.m_free[p_class]};
+      ++p_cache.m_count[p_class];
+    }
+    return (p_cache.m_free[p_class] != nullptr);
+  }
+
+  // Return the blocks of the size class from the locked cache to their arenas, except for the
+  // given number of blocks.
+  void
+  flush(detail::ArenaCache & p_cache, unsigned const p_class, unsigned const p_keep) noexcept
+  {
+    if (p_cache.m_count[p_class] <= p_keep)
+    {
+      return;
+    }
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    while (p_cache.m_count[p_class] > p_keep)
+    {
+      detail::ArenaBlock * const block = p_cache.m_free[p_class];
+      p_cache.m_free[p_class] = block->m_next;
+      --p_cache.m_count[p_class];
+      detail::ArenaHeader & arena = Heap::arena_of(block);
+      if (Heap::deallocate(arena, block))
+      {
+        retire(arena);
+      }
+    }
+  }
+
+  // Prefer arenas with live blocks, so empty arenas can be returned to the operating system.
+  detail::ArenaHeader *
+  find_arena(unsigned const p_class) noexcept
+  {
+    detail::ArenaHeader * empty = nullptr;
+    for (detail::ArenaHeader * arena = m_arenas; arena != nullptr; arena = arena->m_next)
+    {
+      if (arena->m_live != 0u)
+      {
+        if (Heap::can_allocate(*arena, p_class))
+        {
+          return arena;
+        }
+      }
+      else if (empty == nullptr || (arena->m_resident && !empty->m_resident))
+      {
+        empty = arena;
+      }
+    }
+    return (empty != nullptr ? empty : map_arena());
+  }
+
+  // Map an arena aligned to its size, or return nullptr on failure.
+  detail::ArenaHeader *
+  map_arena() noexcept
+  {
+    void * const mapping = ::mmap(nullptr, 2u * Layout::s_arena_size, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+      return nullptr;
+    }
+    auto * const begin = static_cast<std::byte *>(mapping);
+    auto const address = reinterpret_cast<std::uintptr_t>(mapping);
+    std::size_t const head = ((address + Layout::s_arena_size - 1u) & ~(Layout::s_arena_size - 1u)) - address;
+    std::byte * const base = begin + head;
+    if (head != 0u)
+    {
+      ::munmap(begin, head);
+    }
+    ::munmap(base + Layout::s_arena_size, Layout::s_arena_size - head);
+
+    if (m_options.m_node >= 0)
+    {
+      detail::NumaPolicy::bind(base, Layout::s_arena_size, static_cast<unsigned>(m_options.m_node));
+    }
+  #ifdef MADV_HUGEPAGE
+    if (m_options.m_huge_pages)
+    {
+      ::madvise(base, Layout::s_arena_size, MADV_HUGEPAGE);
+    }
+  #endif
+    if (m_options.m_prefault)
+    {
+      prefault(base, Layout::s_arena_size);
+    }
+
+    auto * const arena = new (base) detail::ArenaHeader{};
+    arena->m_pool = this;
+    arena->m_next = m_arenas;
+    arena->m_resident = true;
+    Heap::reset(*arena);
+    m_arenas = arena;
+    ++m_arena_count;
+    ++m_empty;
+    return arena;
+  }
+
+  // Reset an arena whose blocks have all been deallocated, and return its pages to the operating
+  // system unless enough empty arenas are retained.
+  void
+  retire(detail::ArenaHeader & p_arena) noexcept
+  {
+    Heap::reset(p_arena);
+    if (m_empty < m_options.m_retain)
+    {
+      ++m_empty;
+      return;
+    }
+    ::madvise(reinterpret_cast<std::byte *>(&p_arena) + Layout::s_chunk_size,
+              Layout::s_arena_size - Layout::s_chunk_size, MADV_DONTNEED);
+    p_arena.m_resident = false;
+  }
+
+  static void
+  prefault(std::byte * const p_base, std::size_t const p_size) noexcept
+  {
+  #ifdef MADV_POPULATE_WRITE
+    if (::madvise(p_base, p_size, MADV_POPULATE_WRITE) == 0)
+    {
+      return;
+    }
+  #endif
+    for (std::size_t offset = 0u; offset < p_size; offset += Layout::s_page_size)
+    {
+      static_cast<std::byte volatile *>(p_base)[offset] = std::byte{};
+    }
+  }
+
+  Options const m_options;
+  mutable detail::ArenaCache m_caches[Layout::s_cache_count];
+  mutable std::mutex m_mutex;
+  detail::ArenaHeader * m_arenas = nullptr;
+  detail::ArenaHeader * m_current = nullptr;
+  std::size_t m_arena_count = 0u;
+  // The number of resident arenas without live blocks.
+  std::size_t m_empty = 0u;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         AllocatorArena                                         //
+//                                                                                                //
+//                   An allocator for 'ControlAlloc' which uses an 'ArenaPool'                    //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'AllocatorArena' is an empty class. It allocates from the pool which calls
+//  'ArenaPool::make_shared', or whose 'ArenaPool::Scope' is active, and deallocates into the pool
+//  of the arena that contains the pointer.
+//  It doesn't need any offset bits if the shared base is at the front of the created class, see
+//  'AllocatorMalloc'.
+//
+
+template<class t_static_support = NoStaticSupport>
+class AllocatorArena
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //      The type definitions and member functions required by 'ControlAlloc' start here       //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // See 'AllocatorMalloc'.
+  using SupportsStatic = t_static_support;
+
+  // 'ControlAlloc' identifies the type of this allocator with this type definition.
+  using PointerDeallocate = void;
+
+  // Allocate a memory block in the current pool.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    ArenaPool * const pool = ArenaPool::Scope::current();
+    PNTR_TRY_LOG_ERROR(pool == nullptr, "No current arena pool");
+    return (pool != nullptr ? pool->allocate(p_size, p_alignment) : nullptr);
+  }
+
+  // Deallocate a memory block into the pool of its arena.
+  void
+  deallocate(void * const p_pointer) noexcept
+  {
+    ArenaPool::deallocate(p_pointer);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //       The type definitions and member functions required by 'ControlAlloc' end here        //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+};
+
+
+PNTR_NAMESPACE_END
+
+#endif
@@ -29,7 +29,8 @@ PNTR_NAMESPACE_BEGIN
 //
 //  The template parameter can be configured with 'StaticSupport' to enable the proper destruction
 //  of non-polymorphic classes. In this case the control block will store an additonal pointer to
-//  save type information.
+//  save type information. With 'StaticSupportIndex' it stores a type index in 8 user bits of the
+//  control data instead, see 'detail::TypeRegistry'.
 //
 //  The Microsoft Standard Library does not support 'std::aligned_alloc', see
 //  https://en.cppreference.com/w/cpp/memory/c/aligned_alloc
@@ -54,7 +55,7 @@ public:
   // 'SupportsStatic' has to be either 'StaticSupport' or 'NoStaticSupport'. The former will
   // request 'ControlAlloc' to store type information in an additonal pointer in the control
   // block that supports the correct object destruction and deallocation from shared pointers
-  // to non-polymorphic base classes.
+  // to non-polymorphic base classes. 'StaticSupportIndex' stores a type index in the user bits.
   using SupportsStatic = t_static_support;
 
   // 'ControlAlloc' identifies the type of this allocator with this type definition.
@@ -0,0 +1,216 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/detail/Immortal.hpp>
+
+#include <version>
+#ifdef __cpp_lib_memory_resource
+  #include <atomic>
+  #include <cstddef>
+  #include <memory_resource>
+  #include <mutex>
+  #include <stdexcept>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                     MemoryResourceRegistry                                     //
+//                                                                                                //
+//           A global table of memory resources, which are identified by a small index            //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The index zero is reserved for the default resource, as returned by
+//  'std::pmr::get_default_resource' when the registry is used first. Registering a resource twice
+//  returns the same index. The registry is 'detail::immortal', so the destructors of static
+//  objects can still use it.
+//
+//  A resource must not be removed while there are still objects allocated from it, and its index
+//  must not be used anymore afterwards. Looking up a resource doesn't lock the registry.
+//
+
+class MemoryResourceRegistry
+{
+public:
+  static constexpr std::size_t s_capacity = 256u;
+
+  // Register the resource and return its index. Throws 'std::length_error' if the registry is full.
+  static std::size_t
+  add(std::pmr::memory_resource * const p_resource)
+  {
+    PNTR_ASSERT(p_resource != nullptr);
+    MemoryResourceRegistry & registry = instance();
+    std::lock_guard<std::mutex> const lock(registry.m_mutex);
+    std::size_t free = s_capacity;
+    for (std::size_t index = 0u; index < s_capacity; ++index)
+    {
+      std::pmr::memory_resource * const resource = registry.m_resources[index].load(std::memory_order_relaxed);
+      if (resource == p_resource)
+      {
+        return index;
+      }
+      if (resource == nullptr && free == s_capacity)
+      {
+        free = index;
+      }
+    }
+    if (free == s_capacity)
+    {
+      throw std::length_error("The memory resource registry is full");
+    }
+    registry.m_resources[free].store(p_resource, std::memory_order_release);
+    return free;
+  }
+
+  // Unregister the resource with the given index, except for the default resource.
+  static void
+  remove(std::size_t const p_index) noexcept
+  {
+    PNTR_ASSERT(p_index < s_capacity);
+    if (p_index != 0u)
+    {
+      MemoryResourceRegistry & registry = instance();
+      std::lock_guard<std::mutex> const lock(registry.m_mutex);
+      registry.m_resources[p_index].store(nullptr, std::memory_order_release);
+    }
+  }
+
+  // Return the resource with the given index, or nullptr.
+  static std::pmr::memory_resource *
+  get(std::size_t const p_index) noexcept
+  {
+    PNTR_ASSERT(p_index < s_capacity);
+    return instance().m_resources[p_index].load(std::memory_order_acquire);
+  }
+
+private:
+  MemoryResourceRegistry() noexcept
+  {
+    m_resources[0].store(std::pmr::get_default_resource(), std::memory_order_relaxed);
+  }
+
+  static MemoryResourceRegistry &
+  instance() noexcept
+  {
+    return detail::immortal<MemoryResourceRegistry>();
+  }
+
+  friend MemoryResourceRegistry & detail::immortal<MemoryResourceRegistry>() noexcept;
+
+  std::mutex m_mutex;
+  std::atomic<std::pmr::memory_resource *> m_resources[s_capacity] = {};
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                  AllocatorMemoryResourceIndex                                  //
+//                                                                                                //
+//     An allocator for 'ControlAlloc' which stores the index of a registered memory resource     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'AllocatorMemoryResource' stores a pointer to its memory resource in every control block,
+//  which usually requires a 64 bit control value and adds the size of a pointer. Applications with
+//  only a few resources can use 'AllocatorMemoryResourceIndex' instead, which registers the resource
+//  in the 'MemoryResourceRegistry'. 'ControlAlloc' stores its index in the user bits of the control
+//  data instead of the allocator, so the control block can be as small as a 32 bit control value.
+//
+//  The control data requires at least 8 user bits, which are not available to the user anymore.
+//  A static assertion ensures that enough bits are available. Like 'AllocatorMemoryResource',
+//  it requires bits for the size and alignment of derived classes, see there.
+//
+
+template<class t_static_support = NoStaticSupport>
+class AllocatorMemoryResourceIndex
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //      The type definitions and member functions required by 'ControlAlloc' start here       //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // See 'AllocatorMemoryResource'.
+  using SupportsStatic = t_static_support;
+
+  // 'ControlAlloc' identifies the type of this allocator with this type definition.
+  using TypeInfoDeallocate = void;
+
+  // 'ControlAlloc' stores the index in the user bits of the control data.
+  using UserIndex = void;
+
+  // Return the maximum index.
+  static constexpr std::size_t
+  get_max_index() noexcept
+  {
+    return MemoryResourceRegistry::s_capacity - 1u;
+  }
+
+  // Restore the allocator from its index.
+  static AllocatorMemoryResourceIndex
+  from_index(std::size_t const p_index) noexcept
+  {
+    AllocatorMemoryResourceIndex allocator;
+    allocator.m_index = static_cast<unsigned char>(p_index);
+    return allocator;
+  }
+
+  // Return the index of the resource.
+  std::size_t
+  index() const noexcept
+  {
+    return m_index;
+  }
+
+  // Allocate a memory block.
+  void *
+  allocate(std::size_t p_size, std::size_t p_alignment) noexcept
+  {
+    return resource()->allocate(p_size, p_alignment);
+  }
+
+  // Deallocate a memory block.
+  void
+  deallocate(void * p_pointer, std::size_t p_size, std::size_t p_alignment) noexcept
+  {
+    resource()->deallocate(p_pointer, p_size, p_alignment);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //       The type definitions and member functions required by 'ControlAlloc' end here        //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // Use the default resource.
+  AllocatorMemoryResourceIndex() noexcept = default;
+
+  // Register the resource if required. Throws 'std::length_error' if the registry is full.
+  AllocatorMemoryResourceIndex(std::pmr::memory_resource * const p_resource)
+  : m_index(static_cast<unsigned char>(MemoryResourceRegistry::add(p_resource)))
+  {}
+
+  std::pmr::memory_resource *
+  resource() const noexcept
+  {
+    std::pmr::memory_resource * const resource = MemoryResourceRegistry::get(m_index);
+    PNTR_ASSERT(resource != nullptr);
+    return resource;
+  }
+
+private:
+  static_assert(MemoryResourceRegistry::s_capacity <= 256u);
+
+  unsigned char m_index = 0u;
+};
+
+
+PNTR_NAMESPACE_END
+
+#endif // __cpp_lib_memory_resource
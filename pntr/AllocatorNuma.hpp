@@ -0,0 +1,195 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/AllocatorArena.hpp>
+#include <pntr/detail/CurrentScope.hpp>
+#include <pntr/detail/NumaPolicy.hpp>
+
+#if defined(__linux__)
+
+  #include <cstddef>
+  #include <memory>
+  #include <utility>
+  #include <vector>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                            NumaPool                                            //
+//                                                                                                //
+//                     An 'ArenaPool' for each NUMA node, for 'AllocatorNuma'                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Objects which are allocated on one NUMA node and whose counters are modified from another one
+//  cause coherence traffic between the sockets. 'NumaPool' creates an 'ArenaPool' for each node,
+//  whose arenas prefer that node using 'mbind'. Objects are allocated in the pool of the node
+//  which runs the calling thread, and deallocated into the pool of the arena that contains them,
+//  which is the pool of the node that owns the memory.
+//
+//  The nodes are determined with 'get_mempolicy' and 'getcpu'. On machines with a single node, or
+//  kernels without NUMA support, there is only the pool of node zero.
+//
+//  The node count is fixed when the pool is created. The pool must outlive all of its objects.
+//
+
+class NumaPool
+{
+public:
+  // The statistics of the pool of one node.
+  struct NodeStatistics
+  {
+    std::size_t m_arenas;
+    std::size_t m_resident;
+    std::size_t m_live;
+  };
+
+  NumaPool()
+  : NumaPool(ArenaPool::Options{})
+  {}
+
+  // The options are used for the pools of all nodes, except for 'm_node', which is set to their node
+  // on machines with more than one node.
+  explicit NumaPool(ArenaPool::Options const & p_options)
+  {
+    std::size_t const node_count = detail::NumaPolicy::node_count();
+    m_pools.reserve(node_count);
+    for (std::size_t node = 0u; node < node_count; ++node)
+    {
+      ArenaPool::Options options = p_options;
+      options.m_node = (node_count > 1u ? static_cast<int>(node) : -1);
+      m_pools.push_back(std::make_unique<ArenaPool>(options));
+    }
+  }
+
+  ~NumaPool() noexcept
+  {
+    if (Scope::current() == this)
+    {
+      Scope::current() = nullptr;
+    }
+  }
+
+  NumaPool(NumaPool const &) = delete;
+  NumaPool & operator=(NumaPool const &) = delete;
+
+  // Return the number of nodes.
+  std::size_t
+  node_count() const noexcept
+  {
+    return m_pools.size();
+  }
+
+  // Return the node of the calling thread.
+  std::size_t
+  current_node() const noexcept
+  {
+    return detail::NumaPolicy::current_node() % m_pools.size();
+  }
+
+  ArenaPool &
+  node_pool(std::size_t const p_node) noexcept
+  {
+    return *m_pools[p_node];
+  }
+
+  // Return the node of the pool which owns the given block.
+  std::size_t
+  node_of(void const * const p_pointer) const noexcept
+  {
+    ArenaPool const & pool = ArenaPool::pool_of(p_pointer);
+    return (pool.node() >= 0 ? static_cast<std::size_t>(pool.node()) : 0u);
+  }
+
+  NodeStatistics
+  statistics(std::size_t const p_node) const noexcept
+  {
+    ArenaPool const & pool = *m_pools[p_node];
+    return NodeStatistics{pool.arena_count(), pool.resident_count(), pool.live_count()};
+  }
+
+  // Allocate a block on the node of the calling thread.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    return m_pools[current_node()]->allocate(p_size, p_alignment);
+  }
+
+  // Make the pool current for the allocations of 'AllocatorNuma' in the lifetime of the scope.
+  using Scope = detail::CurrentScope<NumaPool>;
+
+  // Create a shared object on the node of the calling thread. The type has to use 'AllocatorNuma'.
+  template<class t_shared, typename... t_args>
+  SharedPtr<t_shared>
+  make_shared(t_args &&... p_args)
+  {
+    Scope const scope(*this);
+    return pntr::make_shared<t_shared>(std::forward<t_args>(p_args)...);
+  }
+
+private:
+  std::vector<std::unique_ptr<ArenaPool>> m_pools;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         AllocatorNuma                                          //
+//                                                                                                //
+//                    An allocator for 'ControlAlloc' which uses a 'NumaPool'                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'AllocatorNuma' is an empty class. It allocates from the pool which calls
+//  'NumaPool::make_shared' on the node of the calling thread, and deallocates into the pool of the
+//  node that owns the pointer, see 'AllocatorArena'.
+//
+
+template<class t_static_support = NoStaticSupport>
+class AllocatorNuma
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //      The type definitions and member functions required by 'ControlAlloc' start here       //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // See 'AllocatorMalloc'.
+  using SupportsStatic = t_static_support;
+
+  // 'ControlAlloc' identifies the type of this allocator with this type definition.
+  using PointerDeallocate = void;
+
+  // Allocate a memory block on the node of the calling thread in the current pool.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    NumaPool * const pool = NumaPool::Scope::current();
+    PNTR_TRY_LOG_ERROR(pool == nullptr, "No current NUMA pool");
+    return (pool != nullptr ? pool->allocate(p_size, p_alignment) : nullptr);
+  }
+
+  // Deallocate a memory block into the pool of the node that owns it.
+  void
+  deallocate(void * const p_pointer) noexcept
+  {
+    ArenaPool::deallocate(p_pointer);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //       The type definitions and member functions required by 'ControlAlloc' end here        //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+};
+
+
+PNTR_NAMESPACE_END
+
+#endif
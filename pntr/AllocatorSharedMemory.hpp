@@ -0,0 +1,592 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/OffsetPtr.hpp>
+#include <pntr/SharedPtr.hpp>
+#include <pntr/detail/CurrentScope.hpp>
+
+#if defined(__linux__)
+
+  #include <algorithm>
+  #include <atomic>
+  #include <cerrno>
+  #include <cstddef>
+  #include <cstdint>
+  #include <limits>
+  #include <mutex>
+  #include <new>
+  #include <system_error>
+  #include <utility>
+
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The layout of a shared memory segment. The first chunk holds the header, all others are
+  // dedicated to one size class each. Offsets are stored in units of the minimum block size.
+  struct SharedMemoryLayout
+  {
+    static constexpr std::uint64_t s_magic = 0x706E74722D73686Du; // "pntr-shm"
+    // Version 2 limits the size classes to 8 KiB.
+    static constexpr std::uint32_t s_version = 2u;
+    static constexpr unsigned s_chunk_bits = 16u;
+    static constexpr std::size_t s_chunk_size = std::size_t{1u} << s_chunk_bits;
+    static constexpr std::size_t s_chunk_header = 64u;
+    static constexpr unsigned s_unit_bits = 4u;
+    static constexpr std::size_t s_min_block = std::size_t{1u} << s_unit_bits;
+    // The largest class is an eighth of a chunk, so the chunk header wastes at most one block.
+    static constexpr unsigned s_class_count = s_chunk_bits - 2u - s_unit_bits;
+    static constexpr std::size_t s_max_block = s_min_block << (s_class_count - 1u);
+    static constexpr std::size_t s_max_alignment = s_chunk_header;
+
+    // 'OffsetSharedPtr' is a single 'OffsetPtr', regardless of the type.
+    static constexpr std::size_t s_root_size = sizeof(std::ptrdiff_t);
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+    static_assert((s_chunk_size - s_chunk_header) / s_max_block >= 4u);
+  };
+
+  struct SharedMemoryHeader
+  {
+    std::uint64_t m_magic;
+    std::uint32_t m_version;
+    std::uint32_t m_chunk_bits;
+    std::uint64_t m_size;
+    std::atomic<std::uint64_t> m_next_chunk;
+    // Tagged freelist heads: the upper 32 bits count the modifications to prevent ABA problems,
+    // the lower 32 bits are the offset of the first free block in units.
+    std::atomic<std::uint64_t> m_free[SharedMemoryLayout::s_class_count];
+    alignas(std::max_align_t) std::byte m_root[SharedMemoryLayout::s_root_size];
+  };
+
+  struct SharedMemoryChunk
+  {
+    std::uint32_t m_class;
+  };
+
+  static_assert(sizeof(SharedMemoryHeader) <= SharedMemoryLayout::s_chunk_size);
+  static_assert(sizeof(SharedMemoryChunk) <= SharedMemoryLayout::s_chunk_header);
+
+
+  // The segments mapped by the current process, to find the segment of a deallocated pointer.
+  class SharedMemoryRegistry
+  {
+  public:
+    static constexpr std::size_t s_capacity = 64u;
+
+    static bool
+    add(std::byte * const p_base, std::size_t const p_size) noexcept
+    {
+      std::lock_guard<std::mutex> const lock(instance().m_mutex);
+      for (Entry & entry: instance().m_entries)
+      {
+        if (entry.m_base.load(std::memory_order_relaxed) == nullptr)
+        {
+          entry.m_size.store(p_size, std::memory_order_relaxed);
+          entry.m_base.store(p_base, std::memory_order_release);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static void
+    remove(std::byte * const p_base) noexcept
+    {
+      std::lock_guard<std::mutex> const lock(instance().m_mutex);
+      for (Entry & entry: instance().m_entries)
+      {
+        if (entry.m_base.load(std::memory_order_relaxed) == p_base)
+        {
+          entry.m_base.store(nullptr, std::memory_order_release);
+        }
+      }
+    }
+
+    // Return the base address of the segment that contains the given pointer, or nullptr.
+    static std::byte *
+    find(void const * const p_pointer) noexcept
+    {
+      auto const address = reinterpret_cast<std::uintptr_t>(p_pointer);
+      for (Entry const & entry: instance().m_entries)
+      {
+        std::byte * const base = entry.m_base.load(std::memory_order_acquire);
+        if (base != nullptr && address >= reinterpret_cast<std::uintptr_t>(base)
+            && address - reinterpret_cast<std::uintptr_t>(base) < entry.m_size.load(std::memory_order_relaxed))
+        {
+          return base;
+        }
+      }
+      return nullptr;
+    }
+
+  private:
+    struct Entry
+    {
+      std::atomic<std::byte *> m_base{nullptr};
+      std::atomic<std::size_t> m_size{0u};
+    };
+
+    static SharedMemoryRegistry &
+    instance() noexcept
+    {
+      static SharedMemoryRegistry s_instance;
+      return s_instance;
+    }
+
+    std::mutex m_mutex;
+    Entry m_entries[s_capacity];
+  };
+
+
+  // Allocate and deallocate blocks in a mapped segment. All shared state is modified with single
+  // compare-and-swap operations, so a process which crashes at any point can't block others. At
+  // worst it leaks the blocks it was allocating.
+  class SharedMemoryHeap
+  {
+    using Layout = SharedMemoryLayout;
+
+  public:
+    // Return the size class for the given size and alignment, or 's_class_count' if unsupported.
+    static unsigned
+    size_class(std::size_t const p_size, std::size_t const p_alignment) noexcept
+    {
+      if (p_alignment > Layout::s_max_alignment)
+      {
+        return Layout::s_class_count;
+      }
+      std::size_t const size = std::max({p_size, p_alignment, Layout::s_min_block});
+      unsigned const bits = detail::bit_width(size - 1u);
+      return (bits - Layout::s_unit_bits < Layout::s_class_count ? bits - Layout::s_unit_bits : Layout::s_class_count);
+    }
+
+    static void *
+    allocate(std::byte * const p_base, std::size_t const p_size, std::size_t const p_alignment) noexcept
+    {
+      unsigned const size_class = SharedMemoryHeap::size_class(p_size, p_alignment);
+      if (size_class >= Layout::s_class_count)
+      {
+        return nullptr;
+      }
+      SharedMemoryHeader & header = *std::launder(reinterpret_cast<SharedMemoryHeader *>(p_base));
+      std::uint32_t unit = pop(p_base, header.m_free[size_class]);
+      if (unit == 0u)
+      {
+        unit = carve(p_base, header, size_class);
+      }
+      return (unit == 0u ? nullptr : p_base + (std::size_t{unit} << Layout::s_unit_bits));
+    }
+
+    static void
+    deallocate(std::byte * const p_base, void * const p_pointer) noexcept
+    {
+      std::size_t const offset = static_cast<std::size_t>(static_cast<std::byte *>(p_pointer) - p_base);
+      auto const & chunk =
+        *std::launder(reinterpret_cast<SharedMemoryChunk const *>(p_base + (offset & ~(Layout::s_chunk_size - 1u))));
+      SharedMemoryHeader & header = *std::launder(reinterpret_cast<SharedMemoryHeader *>(p_base));
+      auto const unit = static_cast<std::uint32_t>(offset >> Layout::s_unit_bits);
+      push(p_base, header.m_free[chunk.m_class], unit, unit);
+    }
+
+  private:
+    static std::atomic<std::uint32_t> &
+    link(std::byte * const p_base, std::uint32_t const p_unit) noexcept
+    {
+      std::byte * const address = p_base + (std::size_t{p_unit} << Layout::s_unit_bits);
+      return *std::launder(reinterpret_cast<std::atomic<std::uint32_t> *>(address));
+    }
+
+    static std::uint64_t
+    tagged(std::uint64_t const p_head, std::uint32_t const p_unit) noexcept
+    {
+      return (((p_head >> 32u) + 1u) << 32u) | p_unit;
+    }
+
+    static std::uint32_t
+    pop(std::byte * const p_base, std::atomic<std::uint64_t> & p_head) noexcept
+    {
+      std::uint64_t head = p_head.load(std::memory_order_acquire);
+      while (static_cast<std::uint32_t>(head) != 0u)
+      {
+        // The link might be overwritten concurrently, but then the tag of the head has changed.
+        std::uint32_t const next = link(p_base, static_cast<std::uint32_t>(head)).load(std::memory_order_relaxed);
+        if (p_head.compare_exchange_weak(head, tagged(head, next), std::memory_order_acquire,
+                                         std::memory_order_acquire))
+        {
+          return static_cast<std::uint32_t>(head);
+        }
+      }
+      return 0u;
+    }
+
+    // Push a chain of linked blocks.
+    static void
+    push(std::byte * const p_base, std::atomic<std::uint64_t> & p_head, std::uint32_t const p_first,
+         std::uint32_t const p_last) noexcept
+    {
+      std::uint64_t head = p_head.load(std::memory_order_relaxed);
+      do
+      {
+        link(p_base, p_last).store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+      }
+      while (!p_head.compare_exchange_weak(head, tagged(head, p_first), std::memory_order_release,
+                                           std::memory_order_relaxed));
+    }
+
+    // Dedicate a new chunk to the size class, push all but its first block onto the freelist,
+    // and return the first one.
+    static std::uint32_t
+    carve(std::byte * const p_base, SharedMemoryHeader & p_header, unsigned const p_class) noexcept
+    {
+      std::uint64_t const offset = p_header.m_next_chunk.fetch_add(Layout::s_chunk_size, std::memory_order_relaxed);
+      if (offset + Layout::s_chunk_size > p_header.m_size)
+      {
+        return 0u;
+      }
+      new (p_base + offset) SharedMemoryChunk{p_class};
+      std::size_t const block_units = std::size_t{1u} << p_class;
+      auto const first = static_cast<std::uint32_t>((offset + Layout::s_chunk_header) >> Layout::s_unit_bits);
+      auto const end = static_cast<std::uint32_t>((offset + Layout::s_chunk_size) >> Layout::s_unit_bits);
+      std::uint32_t last = first;
+      for (std::uint32_t unit = first + block_units; unit + block_units <= end; unit += block_units)
+      {
+        new (p_base + (std::size_t{last} << Layout::s_unit_bits)) std::atomic<std::uint32_t>(unit);
+        last = unit;
+      }
+      if (last != first)
+      {
+        std::uint32_t const second = first + static_cast<std::uint32_t>(block_units);
+        new (p_base + (std::size_t{last} << Layout::s_unit_bits)) std::atomic<std::uint32_t>(0u);
+        push(p_base, p_header.m_free[p_class], second, last);
+      }
+      return first;
+    }
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                      SharedMemorySegment                                       //
+//                                                                                                //
+//                  A memory segment which can be mapped by several processes                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  A segment is either an anonymous file created with 'memfd_create', whose file descriptor can be
+//  inherited or passed to other processes, or a named POSIX shared memory object created with
+//  'shm_open'. Each process maps the segment at an arbitrary address, so objects in the segment
+//  have to use 'OffsetPtr' and 'OffsetSharedPtr' instead of raw pointers. Objects with virtual
+//  functions are only supported if all processes are forked from the same parent.
+//
+//  The segment is divided into chunks of 64 KiB, each dedicated to one power of two size class
+//  from 16 bytes to 8 KiB, so at least seven blocks fit next to the chunk header. The freelists of
+//  the size classes are lock-free stacks in the segment header, so a crashed process can't leave
+//  them locked.
+//
+//  The root slot is an 'OffsetSharedPtr' in the segment header, which can be used to publish
+//  objects to other processes. Accessing it concurrently requires external synchronization.
+//
+//  Functions which call the operating system throw 'std::system_error' on failure.
+//
+
+class SharedMemorySegment
+{
+  using Layout = detail::SharedMemoryLayout;
+
+public:
+  // Create an anonymous segment using 'memfd_create'.
+  static SharedMemorySegment
+  create(std::size_t const p_size)
+  {
+    return SharedMemorySegment(check(::memfd_create("pntr", MFD_CLOEXEC), "memfd_create"), p_size);
+  }
+
+  // Create a named segment using 'shm_open'. The name has to start with a slash.
+  static SharedMemorySegment
+  create(char const * const p_name, std::size_t const p_size)
+  {
+    return SharedMemorySegment(check(::shm_open(p_name, O_RDWR | O_CREAT | O_EXCL, 0600), "shm_open"), p_size);
+  }
+
+  // Map an existing segment from a file descriptor, which is duplicated.
+  static SharedMemorySegment
+  open(int const p_file_descriptor)
+  {
+    return SharedMemorySegment(check(::dup(p_file_descriptor), "dup"), 0u);
+  }
+
+  // Map an existing named segment.
+  static SharedMemorySegment
+  open(char const * const p_name)
+  {
+    return SharedMemorySegment(check(::shm_open(p_name, O_RDWR, 0), "shm_open"), 0u);
+  }
+
+  // Remove the name of a named segment. It will be released after it has been unmapped everywhere.
+  static void
+  unlink(char const * const p_name)
+  {
+    check(::shm_unlink(p_name), "shm_unlink");
+  }
+
+  SharedMemorySegment(SharedMemorySegment && p_other) noexcept
+  : m_base(std::exchange(p_other.m_base, nullptr))
+  , m_size(std::exchange(p_other.m_size, 0u))
+  , m_file_descriptor(std::exchange(p_other.m_file_descriptor, -1))
+  {}
+
+  // The objects in the segment must not be accessed by this process after it has been unmapped.
+  ~SharedMemorySegment() noexcept
+  {
+    if (m_base != nullptr)
+    {
+      if (Scope::current() == this)
+      {
+        Scope::current() = nullptr;
+      }
+      detail::SharedMemoryRegistry::remove(m_base);
+      ::munmap(m_base, m_size);
+    }
+    if (m_file_descriptor >= 0)
+    {
+      ::close(m_file_descriptor);
+    }
+  }
+
+  SharedMemorySegment(SharedMemorySegment const &) = delete;
+  SharedMemorySegment & operator=(SharedMemorySegment const &) = delete;
+  SharedMemorySegment & operator=(SharedMemorySegment &&) = delete;
+
+  int
+  file_descriptor() const noexcept
+  {
+    return m_file_descriptor;
+  }
+
+  void *
+  base() const noexcept
+  {
+    return m_base;
+  }
+
+  std::size_t
+  size() const noexcept
+  {
+    return m_size;
+  }
+
+  // Return the number of bytes of all chunks in use, including the header.
+  std::size_t
+  used_size() const noexcept
+  {
+    auto const used = static_cast<std::size_t>(header().m_next_chunk.load(std::memory_order_relaxed));
+    return (used < m_size ? used : m_size);
+  }
+
+  bool
+  contains(void const * const p_pointer) const noexcept
+  {
+    auto const address = reinterpret_cast<std::uintptr_t>(p_pointer);
+    auto const base = reinterpret_cast<std::uintptr_t>(m_base);
+    return (address >= base && address - base < m_size);
+  }
+
+  // Allocate a block, or return nullptr if the segment is full or the request is too big.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    return detail::SharedMemoryHeap::allocate(m_base, p_size, p_alignment);
+  }
+
+  // Make the segment current for the allocations of 'AllocatorSharedMemory' in the lifetime of the
+  // scope.
+  using Scope = detail::CurrentScope<SharedMemorySegment>;
+
+  // Create a shared object in this segment. The type has to use 'AllocatorSharedMemory'.
+  template<class t_shared, typename... t_args>
+  SharedPtr<t_shared>
+  make_shared(t_args &&... p_args)
+  {
+    Scope const scope(*this);
+    return pntr::make_shared<t_shared>(std::forward<t_args>(p_args)...);
+  }
+
+  // Return the root slot of the segment.
+  template<class t_shared>
+  OffsetSharedPtr<t_shared> &
+  root() noexcept
+  {
+    static_assert(sizeof(OffsetSharedPtr<t_shared>) == Layout::s_root_size);
+    return *std::launder(reinterpret_cast<OffsetSharedPtr<t_shared> *>(&header().m_root));
+  }
+
+private:
+  SharedMemorySegment(int const p_file_descriptor, std::size_t const p_size)
+  : m_file_descriptor(p_file_descriptor)
+  {
+    bool const create = (p_size != 0u);
+    if (create)
+    {
+      m_size = (p_size + Layout::s_chunk_size - 1u) & ~(Layout::s_chunk_size - 1u);
+      if (m_size > (std::size_t{std::numeric_limits<std::uint32_t>::max()} << Layout::s_unit_bits))
+      {
+        ::close(m_file_descriptor);
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "segment too big");
+      }
+      verify(::ftruncate(m_file_descriptor, static_cast<off_t>(m_size)), "ftruncate");
+    }
+    else
+    {
+      struct stat status{};
+      verify(::fstat(m_file_descriptor, &status), "fstat");
+      m_size = static_cast<std::size_t>(status.st_size);
+    }
+    void * const base = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file_descriptor, 0);
+    if (base == MAP_FAILED)
+    {
+      fail("mmap");
+    }
+    m_base = static_cast<std::byte *>(base);
+    if (create)
+    {
+      auto * const header = new (m_base) detail::SharedMemoryHeader{};
+      header->m_magic = Layout::s_magic;
+      header->m_version = Layout::s_version;
+      header->m_chunk_bits = Layout::s_chunk_bits;
+      header->m_size = m_size;
+      header->m_next_chunk.store(Layout::s_chunk_size, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+    else if (m_size < Layout::s_chunk_size || header().m_magic != Layout::s_magic
+             || header().m_version != Layout::s_version || header().m_chunk_bits != Layout::s_chunk_bits
+             || header().m_size != m_size)
+    {
+      ::munmap(m_base, m_size);
+      m_base = nullptr;
+      ::close(std::exchange(m_file_descriptor, -1));
+      throw std::system_error(std::make_error_code(std::errc::invalid_argument), "invalid shared memory segment");
+    }
+    if (!detail::SharedMemoryRegistry::add(m_base, m_size))
+    {
+      ::munmap(m_base, m_size);
+      m_base = nullptr;
+      ::close(std::exchange(m_file_descriptor, -1));
+      throw std::system_error(std::make_error_code(std::errc::too_many_files_open), "too many mapped segments");
+    }
+  }
+
+  detail::SharedMemoryHeader &
+  header() const noexcept
+  {
+    return *std::launder(reinterpret_cast<detail::SharedMemoryHeader *>(m_base));
+  }
+
+  [[noreturn]] void
+  fail(char const * const p_what)
+  {
+    int const error = errno;
+    ::close(std::exchange(m_file_descriptor, -1));
+    throw std::system_error(error, std::generic_category(), p_what);
+  }
+
+  void
+  verify(int const p_result, char const * const p_what)
+  {
+    if (p_result < 0)
+    {
+      fail(p_what);
+    }
+  }
+
+  static int
+  check(int const p_result, char const * const p_what)
+  {
+    if (p_result < 0)
+    {
+      throw std::system_error(errno, std::generic_category(), p_what);
+    }
+    return p_result;
+  }
+
+  std::byte * m_base{};
+  std::size_t m_size{};
+  int m_file_descriptor{-1};
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                     AllocatorSharedMemory                                      //
+//                                                                                                //
+//               An allocator for 'ControlAlloc' which uses a 'SharedMemorySegment'               //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'AllocatorSharedMemory' is an empty class, so the control block doesn't store any process
+//  specific addresses. It allocates from the segment which calls 'SharedMemorySegment::make_shared'
+//  and deallocates into the segment that contains the pointer. So the last process which releases
+//  an object returns its memory to the segment.
+//
+//  The control data must use a 'CounterThreadSafe' counter, because the usage counter is modified
+//  concurrently by all processes. It doesn't need any offset bits if the shared base is at the
+//  front of the created class, see 'AllocatorMalloc'.
+//
+
+class AllocatorSharedMemory
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //      The type definitions and member functions required by 'ControlAlloc' start here       //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // Static support would store a process specific function pointer.
+  using SupportsStatic = NoStaticSupport;
+
+  // 'ControlAlloc' identifies the type of this allocator with this type definition.
+  using PointerDeallocate = void;
+
+  // Allocate a memory block in the current segment.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    SharedMemorySegment * const segment = SharedMemorySegment::Scope::current();
+    PNTR_TRY_LOG_ERROR(segment == nullptr, "No current shared memory segment");
+    return (segment != nullptr ? segment->allocate(p_size, p_alignment) : nullptr);
+  }
+
+  // Deallocate a memory block into the segment that contains it.
+  void
+  deallocate(void * const p_pointer) noexcept
+  {
+    std::byte * const base = detail::SharedMemoryRegistry::find(p_pointer);
+    PNTR_TRY_LOG_ERROR(base == nullptr, "Pointer is not in a mapped shared memory segment");
+    if (base != nullptr)
+    {
+      detail::SharedMemoryHeap::deallocate(base, p_pointer);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //       The type definitions and member functions required by 'ControlAlloc' end here        //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+};
+
+
+PNTR_NAMESPACE_END
+
+#endif
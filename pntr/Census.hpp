@@ -0,0 +1,296 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/detail/Immortal.hpp>
+#include <pntr/detail/PntrTypeTraits.hpp>
+#include <pntr/detail/ShardedMap.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The layout of a type which is counted by the 'Census'.
+  struct CensusType
+  {
+    char const * m_name;
+    std::size_t m_size;
+    std::size_t m_control_size;
+    std::size_t m_padding;
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                             Census                                             //
+//                                                                                                //
+//                A registry of live objects with their per-type memory footprint                 //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Objects of classes derived from 'CensusMember' are registered by the address of their shared
+//  base during their lifetime. 'Census::collect' returns the number of objects of each type, with
+//  their bytes, the bytes of their control blocks, and the padding which follows the control data,
+//  as reported by 'check_intruder_efficiency'.
+//
+//  Objects of a 'ControlAlloc' with weak references are destroyed when the last 'SharedPtr' is
+//  released, but their memory is kept until the last 'WeakPtr' is released. These objects are
+//  listed as pinned until their memory is deallocated, if the shared base is a 'CensusMember'.
+//
+//  The registry is a 'detail::ShardedMap', so threads which create and destroy different objects
+//  rarely contend for the same mutex. It is 'detail::immortal', so the destructors of static
+//  objects can still use it.
+//
+
+class Census
+{
+public:
+  // The statistics of one type.
+  struct TypeStatistics
+  {
+    char const * m_name;
+    std::size_t m_size;
+    std::size_t m_count;
+    std::size_t m_bytes;
+    std::size_t m_control_bytes;
+    std::size_t m_padding_bytes;
+    std::size_t m_pinned_count;
+    std::size_t m_pinned_bytes;
+  };
+
+  // Return the statistics of all types with live or pinned objects, ordered by their bytes.
+  static std::vector<TypeStatistics>
+  collect()
+  {
+    std::unordered_map<detail::CensusType const *, TypeStatistics> types;
+    for (auto & shard : instance().m_entries)
+    {
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      for (auto const & [address, entry] : shard.m_map)
+      {
+        detail::CensusType const & type = *entry.m_type;
+        TypeStatistics & statistics =
+          types.try_emplace(&type, TypeStatistics{type.m_name, type.m_size, 0u, 0u, 0u, 0u, 0u, 0u}).first->second;
+        if (entry.m_pinned)
+        {
+          ++statistics.m_pinned_count;
+          statistics.m_pinned_bytes += type.m_size;
+        }
+        else
+        {
+          ++statistics.m_count;
+          statistics.m_bytes += type.m_size;
+          statistics.m_control_bytes += type.m_control_size;
+          statistics.m_padding_bytes += type.m_padding;
+        }
+      }
+    }
+    std::vector<TypeStatistics> result;
+    result.reserve(types.size());
+    for (auto const & type : types)
+    {
+      result.push_back(type.second);
+    }
+    std::sort(result.begin(), result.end(),
+              [](TypeStatistics const & p_a, TypeStatistics const & p_b) noexcept
+              { return (p_a.m_bytes + p_a.m_pinned_bytes > p_b.m_bytes + p_b.m_pinned_bytes); });
+    return result;
+  }
+
+  // Write a table of the statistics to the given stream.
+  template<class t_char, class t_traits>
+  static void
+  write(std::basic_ostream<t_char, t_traits> & p_ostream)
+  {
+    for (TypeStatistics const & statistics : collect())
+    {
+      p_ostream << statistics.m_name << ": " << statistics.m_count << " objects of " << statistics.m_size
+                << " bytes, " << statistics.m_bytes << " bytes, " << statistics.m_control_bytes
+                << " control bytes, " << statistics.m_padding_bytes << " padding bytes";
+      if (statistics.m_pinned_count != 0u)
+      {
+        p_ostream << ", " << statistics.m_pinned_count << " pinned by weak pointers with "
+                  << statistics.m_pinned_bytes << " bytes";
+      }
+      p_ostream << std::endl;
+    }
+  }
+
+  // Return the number of live objects.
+  static std::size_t
+  live_count()
+  {
+    std::size_t count = 0u;
+    for (auto & shard : instance().m_entries)
+    {
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      for (auto const & entry : shard.m_map)
+      {
+        count += (entry.second.m_pinned ? 0u : 1u);
+      }
+    }
+    return count;
+  }
+
+private:
+  template<class t_shared>
+  friend class CensusMember;
+
+  template<class t_shared_base>
+  friend void detail::census_deallocate(void const * p_address) noexcept;
+
+  struct Entry
+  {
+    detail::CensusType const * m_type;
+    bool m_pinned;
+  };
+
+  static Census &
+  instance() noexcept
+  {
+    return detail::immortal<Census>();
+  }
+
+  static void
+  add(void const * const p_address, detail::CensusType const & p_type) noexcept
+  {
+    auto & shard = instance().m_entries.shard(p_address);
+    std::lock_guard<std::mutex> const lock(shard.m_mutex);
+    try
+    {
+      shard.m_map.insert_or_assign(p_address, Entry{&p_type, false});
+    }
+    catch (...) // The object is not counted
+    {}
+  }
+
+  // Remove a destroyed object, or keep it as pinned if its memory is kept by weak references.
+  static void
+  remove(void const * const p_address, bool const p_pinned) noexcept
+  {
+    Census & census = instance();
+    auto & shard = census.m_entries.shard(p_address);
+    std::lock_guard<std::mutex> const lock(shard.m_mutex);
+    auto const found = shard.m_map.find(p_address);
+    if (found != shard.m_map.end())
+    {
+      if (p_pinned)
+      {
+        found->second.m_pinned = true;
+        census.m_pinned.fetch_add(1u, std::memory_order_relaxed);
+      }
+      else
+      {
+        shard.m_map.erase(found);
+      }
+    }
+  }
+
+  // Remove a pinned object whose memory is deallocated.
+  static void
+  deallocate(void const * const p_address) noexcept
+  {
+    Census & census = instance();
+    if (census.m_pinned.load(std::memory_order_relaxed) == 0u)
+    {
+      return;
+    }
+    auto & shard = census.m_entries.shard(p_address);
+    std::lock_guard<std::mutex> const lock(shard.m_mutex);
+    auto const found = shard.m_map.find(p_address);
+    if (found != shard.m_map.end() && found->second.m_pinned)
+    {
+      shard.m_map.erase(found);
+      census.m_pinned.fetch_sub(1u, std::memory_order_relaxed);
+    }
+  }
+
+  detail::ShardedMap<Entry> m_entries;
+  std::atomic<std::size_t> m_pinned{0u};
+};
+
+
+namespace detail
+{
+  template<class t_shared_base>
+  void
+  census_deallocate(void const * const p_address) noexcept
+  {
+    Census::deallocate(p_address);
+  }
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                          CensusMember                                          //
+//                                                                                                //
+//                    An opt-in base class which registers objects in 'Census'                    //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The class 't_shared' has to derive from 'CensusMember<t_shared>' after its 'Intruder' base, so
+//  the control block is still alive when 'CensusMember' is destroyed. Objects are counted as
+//  't_shared', so classes of a hierarchy which should be counted separately need their own
+//  'CensusMember' base. Objects which are not managed by shared pointers are counted as well.
+//
+
+template<class t_shared>
+class CensusMember: public detail::CensusTag
+{
+protected:
+  CensusMember() noexcept
+  {
+    Census::add(address(), s_type);
+  }
+
+  CensusMember(CensusMember const &) noexcept
+  : CensusMember()
+  {}
+
+  CensusMember &
+  operator=(CensusMember const &) noexcept
+  {
+    return *this;
+  }
+
+  ~CensusMember() noexcept
+  {
+    bool pinned = false;
+    using Control = typename t_shared::PntrControlType;
+    if constexpr (t_shared::PntrSupportsWeak::value && std::is_same_v<detail::WeakControlType<Control>, Control>
+                  && detail::is_census_member<typename t_shared::PntrSharedBase>)
+    {
+      // The weak count includes one reference for the object, which is released after its destruction.
+      pinned = (static_cast<t_shared const *>(this)->pntr_weak_count() > 1u);
+    }
+    Census::remove(address(), pinned);
+  }
+
+private:
+  void const *
+  address() const noexcept
+  {
+    return static_cast<typename t_shared::PntrSharedBase const *>(static_cast<t_shared const *>(this));
+  }
+
+  inline static detail::CensusType const s_type{typeid(t_shared).name(), sizeof(t_shared),
+                                                sizeof(typename t_shared::PntrControlType),
+                                                detail::control_padding<t_shared>()};
+};
+
+
+PNTR_NAMESPACE_END
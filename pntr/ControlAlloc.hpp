@@ -134,6 +134,14 @@ public:
     return m_adapter.m_data.use_count();
   }
 
+  // Return the address of the word which holds the usage count, if the control data has one.
+  template<class UsageData = t_data, typename = decltype(UsageData::get_usage_mask())>
+  UsageValueType const *
+  usage_word() const noexcept
+  {
+    return m_adapter.m_data.usage_word();
+  }
+
   // Return the weak count.
   template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
   WeakValueType
@@ -149,6 +157,13 @@ public:
     m_adapter.m_data.add_ref();
   }
 
+  // Increment the usage counter by the given number of references at once.
+  void
+  add_ref(UsageValueType const p_count) noexcept
+  {
+    m_adapter.m_data.add_ref(p_count);
+  }
+
   // Increment the weak counter.
   template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
   void
@@ -176,6 +191,14 @@ public:
     return m_adapter.m_data.release();
   }
 
+  // Decrement the usage counter by the given number of references at once, and return true if it
+  // reaches zero or was invalid.
+  bool
+  release(UsageValueType const p_count) noexcept
+  {
+    return m_adapter.m_data.release(p_count);
+  }
+
   // Decrement the weak counter and return true if it reaches or was zero.
   template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
   bool
@@ -184,25 +207,51 @@ public:
     return m_adapter.m_data.weak_release();
   }
 
-  // Return maximum user value.
+  // Return maximum user value. The user bits are reserved for allocators and types with an index,
+  // and the lowest 3 user bits of cycle collected types for 'CycleCollector'.
   static constexpr DataValueType
   get_max_user() noexcept
   {
-    return t_data::get_max_user();
+    return (s_user_index ? DataValueType{} : static_cast<DataValueType>(t_data::get_max_user() & ~cycle_mask()));
   }
 
   // Return the user value.
   DataValueType
   get_user() const noexcept
   {
-    return m_adapter.m_data.get_user();
+    return (s_user_index ? DataValueType{} : static_cast<DataValueType>(m_adapter.m_data.get_user() & ~cycle_mask()));
   }
 
   // Try to set the user value and return true on success.
   bool
   try_set_user(DataValueType const p_user) noexcept
   {
-    return m_adapter.m_data.try_set_user(p_user);
+    if constexpr (s_user_index)
+    {
+      return (p_user == DataValueType{});
+    }
+    else if constexpr (cycle_mask() != 0u)
+    {
+      return m_adapter.m_data.try_set_user(p_user, get_max_user());
+    }
+    else
+    {
+      return m_adapter.m_data.try_set_user(p_user);
+    }
+  }
+
+  // Return the user bits reserved for 'CycleCollector'.
+  DataValueType
+  get_cycle_bits() const noexcept
+  {
+    return static_cast<DataValueType>(m_adapter.m_data.get_user() & cycle_mask());
+  }
+
+  // Set the user bits reserved for 'CycleCollector' and keep the other user bits.
+  void
+  set_cycle_bits(DataValueType const p_bits) noexcept
+  {
+    m_adapter.m_data.try_set_user(p_bits, cycle_mask());
   }
 
   // Delete (non-weak) or destroy (weak) the object. Called when 'pntr_release' returns true.
@@ -241,6 +290,9 @@ public:
   ////////////////////////////////////////////////////////////////////////////////////////////////
 
 private:
+  static constexpr bool s_user_index =
+    (detail::HasUserIndex<t_allocator>::value || detail::SupportsStaticIndex<t_allocator>::value);
+
   using AllocAdapter =
     std::conditional_t<detail::HasPointerDeallocate<t_allocator>::value,
                        detail::AllocAdaptPointer<t_shared_base, t_data, t_allocator>,
@@ -248,6 +300,23 @@ private:
                                           detail::AllocAdaptTypeInfo<t_shared_base, t_data, t_allocator>,
                                           detail::AllocAdaptTyped<t_shared_base, t_data, t_allocator>>>;
 
+  // The lowest 3 user bits of cycle collected types are reserved. Evaluated on use, when the
+  // shared base class is complete.
+  static constexpr DataValueType
+  cycle_mask() noexcept
+  {
+    if constexpr (detail::is_cycle_collected<t_shared_base>)
+    {
+      static_assert(!s_user_index, "Cycle collection and the allocator index both use the user bits");
+      static_assert(t_data::get_max_user() >= 7u, "The cycle collector requires 3 user bits");
+      return DataValueType{7u};
+    }
+    else
+    {
+      return DataValueType{};
+    }
+  }
+
   AllocAdapter m_adapter;
 
   ControlAlloc(ControlAlloc const &) = delete;
@@ -0,0 +1,323 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/common.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <limits>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Return an index that is distinct for each thread, assigned in the order of the first call.
+  inline std::size_t
+  thread_slot() noexcept
+  {
+    static std::atomic<std::size_t> s_next{0u};
+    static thread_local std::size_t const s_slot = s_next.fetch_add(1u, std::memory_order_relaxed);
+    return s_slot;
+  }
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                       ControlDataSharded                                       //
+//                                                                                                //
+//          The data storage for a control block with a usage counter sharded by threads          //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  A data class for 'ControlNew', see 'IntruderNewSharded'. It is meant for a few objects that are
+//  copied by many threads concurrently, like global configurations or registries, as it occupies
+//  one cache line for each of the 't_shards' sub-counters and one for the central counter.
+//
+//  The usage count is the sum of the central counter and all sub-counters. A thread increments
+//  the sub-counter of its own slot, so threads that copy and release the same object don't share
+//  a cache line. A release decrements a non-zero sub-counter, preferably the own one, or otherwise
+//  the central counter while it is above one. As the central counter never drops below one while
+//  the object is alive, these releases can't be the last ones.
+//
+//  Only a release that finds all counters at their minimum might be the last one, which is
+//  detected in two phases. The first phase reads all sub-counters, and the second one verifies
+//  that they haven't changed and sets the central counter to zero if it hasn't changed either.
+//  Each counter is stored with a version number that changes on every update, which makes both
+//  phases an atomic snapshot of the usage count.
+//
+//  It supports neither weak pointers nor a user value.
+//
+
+template<std::size_t t_shards = 64u>
+class ControlDataSharded
+{
+public:
+  using UsageValueType = std::uint32_t;
+  using WeakValueType = void;
+  using DataValueType = std::uint8_t;
+
+  explicit ControlDataSharded(DataValueType const p_user_init) noexcept
+  : m_central{make_word(0u, s_uncontrolled)}
+  {
+    PNTR_ASSERT(p_user_init == 0u);
+    for (Slot & shard: m_shards)
+    {
+      shard.m_word.store(0u, std::memory_order_relaxed);
+    }
+  }
+
+  // Return true if this is not controlled (yet).
+  bool
+  is_uncontrolled() const noexcept
+  {
+    return (count(m_central.m_word.load(std::memory_order_relaxed)) == s_uncontrolled);
+  }
+
+  // Return true if this is controlled and not expired (yet).
+  bool
+  is_alive() const noexcept
+  {
+    return (count(m_central.m_word.load(std::memory_order_relaxed)) > s_expired);
+  }
+
+  // Return maximum usage count value.
+  static constexpr UsageValueType
+  get_max_usage_count() noexcept
+  {
+    return static_cast<UsageValueType>(s_usage_max);
+  }
+
+  // Return the usage count, which is only exact if no other thread changes it concurrently.
+  UsageValueType
+  use_count() const noexcept
+  {
+    std::int32_t const central = count(m_central.m_word.load(std::memory_order_relaxed));
+    if (central <= s_expired)
+    {
+      return 0u;
+    }
+    UsageValueType sum = static_cast<UsageValueType>(central);
+    for (Slot const & shard: m_shards)
+    {
+      sum += static_cast<UsageValueType>(count(shard.m_word.load(std::memory_order_relaxed)));
+    }
+    return sum;
+  }
+
+  // Increment the sub-counter of the current thread.
+  void
+  add_ref() noexcept
+  {
+    [[maybe_unused]] std::uint64_t const previous =
+      own_shard().m_word.fetch_add(s_version_one + 1u, std::memory_order_relaxed);
+    PNTR_ASSERT(count(previous) >= 0 && count(previous) < s_usage_max);
+  }
+
+  // Increment the sub-counter of the current thread by the given number of references at once.
+  void
+  add_ref(UsageValueType const p_count) noexcept
+  {
+    [[maybe_unused]] std::uint64_t const previous =
+      own_shard().m_word.fetch_add(s_version_one + p_count, std::memory_order_relaxed);
+    PNTR_ASSERT(count(previous) >= 0
+                && static_cast<UsageValueType>(count(previous)) + p_count <= get_max_usage_count());
+  }
+
+  // Decrement the usage count and return true if it reaches zero or was invalid.
+  bool
+  release() noexcept
+  {
+    std::size_t const own = detail::thread_slot();
+    for (;;)
+    {
+      for (std::size_t i = 0u; i < t_shards; ++i)
+      {
+        if (try_decrement(m_shards[(own + i) % t_shards].m_word))
+        {
+          return false;
+        }
+      }
+      std::uint64_t central = m_central.m_word.load(std::memory_order_acquire);
+      if (count(central) <= s_expired)
+      {
+        PNTR_ASSERT(count(central) == s_uncontrolled);
+        return true;
+      }
+      if (count(central) > 1)
+      {
+        if (m_central.m_word.compare_exchange_weak(central, make_word(central, count(central) - 1),
+                                                   std::memory_order_release, std::memory_order_relaxed))
+        {
+          return false;
+        }
+        continue;
+      }
+      if (is_last(central))
+      {
+        return true;
+      }
+    }
+  }
+
+  // Decrement the usage count by the given number of references, and return true if it reaches
+  // zero or was invalid. Only the last decrement can reach zero, the others find a counter above it.
+  bool
+  release(UsageValueType const p_count) noexcept
+  {
+    PNTR_ASSERT(p_count >= 1u);
+    for (UsageValueType i = 1u; i < p_count; ++i)
+    {
+      [[maybe_unused]] bool const last = release();
+      PNTR_ASSERT(!last);
+    }
+    return release();
+  }
+
+  // If the usage counter is
+  // - uncontrolled: Initialize it with its first reference and return ControlStatus::e_acquired
+  // - zero or max:  Return ControlStatus::e_invalid
+  // - otherwise:    Increment it and return ControlStatus::e_shared
+  ControlStatus
+  try_control() noexcept
+  {
+    std::uint64_t central = m_central.m_word.load(std::memory_order_relaxed);
+    while (count(central) == s_uncontrolled
+           && !m_central.m_word.compare_exchange_weak(central, make_word(central, 1), std::memory_order_relaxed))
+    {}
+    if (count(central) == s_uncontrolled)
+    {
+      return ControlStatus::e_acquired;
+    }
+    return (try_add_ref() ? ControlStatus::e_shared : ControlStatus::e_invalid);
+  }
+
+  // Increment the central counter if it is not zero or max, and return true if it was incremented.
+  bool
+  try_add_ref() noexcept
+  {
+    std::uint64_t central = m_central.m_word.load(std::memory_order_relaxed);
+    while (count(central) > s_expired && count(central) < s_usage_max
+           && !m_central.m_word.compare_exchange_weak(central, make_word(central, count(central) + 1),
+                                                      std::memory_order_relaxed))
+    {}
+    return (count(central) > s_expired && count(central) < s_usage_max);
+  }
+
+  // Re-initialize the usage counter of an expired object. Return true if it is or was uncontrolled.
+  bool
+  try_revive() noexcept
+  {
+    std::uint64_t central = m_central.m_word.load(std::memory_order_relaxed);
+    while (count(central) == s_expired
+           && !m_central.m_word.compare_exchange_weak(central, make_word(central, s_uncontrolled),
+                                                      std::memory_order_relaxed))
+    {}
+    return (count(central) == s_expired || count(central) == s_uncontrolled);
+  }
+
+  // Return maximum user value.
+  static constexpr DataValueType
+  get_max_user() noexcept
+  {
+    return 0u;
+  }
+
+  // Return the user value.
+  DataValueType
+  get_user() const noexcept
+  {
+    return 0u;
+  }
+
+  // Try to set the user value and return true on success.
+  bool
+  try_set_user(DataValueType const p_user) noexcept
+  {
+    return (p_user == 0u);
+  }
+
+private:
+  // Each counter is a 32 bit count in the lower half and a version number in the upper half.
+  struct alignas(64) Slot
+  {
+    std::atomic<std::uint64_t> m_word;
+  };
+
+  static constexpr std::uint64_t s_count_mask = 0xFFFFFFFFu;
+  static constexpr std::uint64_t s_version_one = std::uint64_t{1u} << 32u;
+  static constexpr std::int32_t s_uncontrolled = -1;
+  static constexpr std::int32_t s_expired = 0;
+  static constexpr std::int32_t s_usage_max = std::numeric_limits<std::int32_t>::max();
+
+  static std::int32_t
+  count(std::uint64_t const p_word) noexcept
+  {
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(p_word & s_count_mask));
+  }
+
+  // Return the next version of the given word with the given count.
+  static std::uint64_t
+  make_word(std::uint64_t const p_word, std::int32_t const p_count) noexcept
+  {
+    return (((p_word & ~s_count_mask) + s_version_one) | static_cast<std::uint32_t>(p_count));
+  }
+
+  Slot &
+  own_shard() noexcept
+  {
+    return m_shards[detail::thread_slot() % t_shards];
+  }
+
+  // Decrement the given sub-counter if it is not zero, and return true if it was decremented.
+  static bool
+  try_decrement(std::atomic<std::uint64_t> & p_word) noexcept
+  {
+    std::uint64_t word = p_word.load(std::memory_order_relaxed);
+    while (count(word) > 0)
+    {
+      if (p_word.compare_exchange_weak(word, make_word(word, count(word) - 1), std::memory_order_release,
+                                       std::memory_order_relaxed))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Return true if the given central word with a count of one is the last reference, which also
+  // expires it. Return false if any counter has changed, or a sub-counter is not zero.
+  bool
+  is_last(std::uint64_t p_central) noexcept
+  {
+    std::uint64_t words[t_shards];
+    for (std::size_t i = 0u; i < t_shards; ++i)
+    {
+      words[i] = m_shards[i].m_word.load(std::memory_order_acquire);
+      if (count(words[i]) != 0)
+      {
+        return false;
+      }
+    }
+    for (std::size_t i = 0u; i < t_shards; ++i)
+    {
+      if (m_shards[i].m_word.load(std::memory_order_acquire) != words[i])
+      {
+        return false;
+      }
+    }
+    return m_central.m_word.compare_exchange_strong(p_central, make_word(p_central, s_expired),
+                                                    std::memory_order_acq_rel, std::memory_order_relaxed);
+  }
+
+  Slot m_central;
+  Slot m_shards[t_shards];
+
+  static_assert(t_shards > 0u);
+};
+
+
+PNTR_NAMESPACE_END
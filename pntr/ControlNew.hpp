@@ -4,6 +4,7 @@
 
 #include <pntr/detail/ControlDeleter.hpp>
 #include <pntr/detail/PntrTypeTraits.hpp>
+#include <pntr/detail/WeakSideTable.hpp>
 
 PNTR_NAMESPACE_BEGIN
 
@@ -23,8 +24,18 @@ PNTR_NAMESPACE_BEGIN
 //  Requires that the data class type specified as template argument provides the type definitions
 //  and member functions as implemented by and documented in the class 'ControlData'.
 //
+//  If 't_supports_weak' is 'std::true_type', the first weak reference to an object allocates a side
+//  block, which is referenced by all 'WeakPtr' instances and outlives the object. The highest user
+//  bit of the data class records that the object has a side block, whose address is stored in a
+//  global table instead of the object. So objects without weak references don't require additional
+//  memory or atomic operations. But every 'WeakPtr' created from a 'SharedPtr' or 'weak_from_this'
+//  locks the mutex of one shard of the table and looks up the side block, as do the weak count and
+//  the destruction of objects with weak references. Copying an existing 'WeakPtr' is the cheap path,
+//  which only increments the weak count of the side block. The flag is updated with a single
+//  compare-and-swap which keeps the other user bits.
+//
 
-template<class t_shared_base, class t_data, typename t_deleter>
+template<class t_shared_base, class t_data, typename t_deleter, class t_supports_weak = std::false_type>
 class ControlNew
 {
 public:
@@ -39,14 +50,24 @@ public:
   using Deleter = t_deleter;
   using Allocator = void;
   using UsageValueType = typename t_data::UsageValueType;
-  using WeakValueType = typename t_data::WeakValueType;
   using DataValueType = typename t_data::DataValueType;
-  using SupportsWeak = std::false_type;
+  using SupportsWeak = t_supports_weak;
+  using WeakControl = std::conditional_t<SupportsWeak::value, detail::WeakSideBlock<ControlNew>, ControlNew>;
+  using WeakValueType = std::conditional_t<SupportsWeak::value, std::uint32_t, typename t_data::WeakValueType>;
 
   explicit ControlNew(DataValueType const p_user_init) noexcept
   : m_control_deleter(p_user_init)
   {}
 
+  ~ControlNew() noexcept
+  {
+    if constexpr (SupportsWeak::value)
+    {
+      // Only required if an object with weak references is destroyed without being controlled.
+      expire_weak();
+    }
+  }
+
   // Allocate storage for a new instance of the specified type, call its constructor
   // using the forwarded arguments, and return a pointer to it on success.
   template<class t_shared, class t_nothrow, typename... t_args>
@@ -109,7 +130,7 @@ public:
       case ControlStatus::e_invalid:
         return nullptr;
       case ControlStatus::e_acquired:
-        m_control_deleter.deleter() = std::forward<t_forward>(p_deleter);
+        m_control_deleter.set_deleter(std::forward<t_forward>(p_deleter));
         break;
       case ControlStatus::e_shared:
         break;
@@ -150,6 +171,54 @@ public:
     return m_control_deleter.m_data.use_count();
   }
 
+  // Return the weak count, which includes one reference for a living object.
+  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
+  WeakValueType
+  weak_count() const noexcept
+  {
+    if (has_weak_control())
+    {
+      auto & shard = detail::WeakSideTable::instance().shard(this);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      auto const found = shard.m_map.find(this);
+      if (found != shard.m_map.end())
+      {
+        return static_cast<WeakControl *>(found->second)->weak_count();
+      }
+    }
+    return (m_control_deleter.m_data.is_alive() ? 1u : 0u);
+  }
+
+  // Return the side block of the object, which is allocated by the first call.
+  // Return nullptr if the allocation fails.
+  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
+  WeakControl *
+  weak_control() noexcept
+  {
+    // The flag is only set and cleared while the shard is locked.
+    auto & shard = detail::WeakSideTable::instance().shard(this);
+    std::lock_guard<std::mutex> const lock(shard.m_mutex);
+    if (has_weak_control())
+    {
+      return static_cast<WeakControl *>(shard.m_map.at(this));
+    }
+    WeakControl * const block = new (std::nothrow) WeakControl(*this);
+    if (block != nullptr)
+    {
+      try
+      {
+        shard.m_map.emplace(this, block);
+      }
+      catch (...)
+      {
+        delete block;
+        return nullptr;
+      }
+      m_control_deleter.m_data.try_set_user(s_weak_flag, s_weak_flag);
+    }
+    return block;
+  }
+
   // Increment the usage counter.
   void
   add_ref() noexcept
@@ -157,6 +226,13 @@ public:
     m_control_deleter.m_data.add_ref();
   }
 
+  // Increment the usage counter by the given number of references at once.
+  void
+  add_ref(UsageValueType const p_count) noexcept
+  {
+    m_control_deleter.m_data.add_ref(p_count);
+  }
+
   // Decrement the usage counter and return true if it reaches zero or was invalid.
   bool
   release() noexcept
@@ -164,25 +240,49 @@ public:
     return m_control_deleter.m_data.release();
   }
 
-  // Return maximum user value.
+  // Decrement the usage counter by the given number of references at once, and return true if it
+  // reaches zero or was invalid.
+  bool
+  release(UsageValueType const p_count) noexcept
+  {
+    return m_control_deleter.m_data.release(p_count);
+  }
+
+  // Return maximum user value. The user bits are reserved for deleters with an index.
   static constexpr DataValueType
   get_max_user() noexcept
   {
-    return t_data::get_max_user();
+    return (s_user_index ? DataValueType{} : static_cast<DataValueType>(t_data::get_max_user() & ~s_weak_flag));
   }
 
   // Return the user value.
   DataValueType
   get_user() const noexcept
   {
-    return m_control_deleter.m_data.get_user();
+    return (s_user_index ? DataValueType{}
+                         : static_cast<DataValueType>(m_control_deleter.m_data.get_user() & ~s_weak_flag));
   }
 
   // Try to set the user value and return true on success.
   bool
   try_set_user(DataValueType const p_user) noexcept
   {
-    return m_control_deleter.m_data.try_set_user(p_user);
+    if constexpr (s_user_index)
+    {
+      return (p_user == DataValueType{});
+    }
+    else if constexpr (SupportsWeak::value)
+    {
+      if (p_user > get_max_user())
+      {
+        return false;
+      }
+      return m_control_deleter.m_data.try_set_user(p_user, get_max_user());
+    }
+    else
+    {
+      return m_control_deleter.m_data.try_set_user(p_user);
+    }
   }
 
   // Delete (non-weak) or destroy (weak) the object. Called when 'pntr_release' returns true.
@@ -192,6 +292,10 @@ public:
   dispose(ControlNew & p_control, t_shared & p_shared) noexcept
   {
     PNTR_TRY_LOG_WARNING(p_control.m_control_deleter.m_data.is_alive(), "disposing object which is still alive");
+    if constexpr (SupportsWeak::value)
+    {
+      p_control.expire_weak();
+    }
     ControlDeleter::destroy(p_control.m_control_deleter, &p_shared);
     return nullptr;
   }
@@ -210,7 +314,50 @@ public:
   ////////////////////////////////////////////////////////////////////////////////////////////////
 
 private:
-  using ControlDeleter = detail::ControlDeleter<t_shared_base, t_data, t_deleter, detail::is_empty_base<t_deleter>>;
+  // Deleters with an index are stored in the user bits, see 'DeleterIndexed'.
+  static constexpr bool s_user_index = detail::HasUserIndex<t_deleter>::value;
+
+  using ControlDeleter =
+    std::conditional_t<s_user_index, detail::ControlDeleterIndexed<t_shared_base, t_data, t_deleter>,
+                       detail::ControlDeleter<t_shared_base, t_data, t_deleter, detail::is_empty_base<t_deleter>>>;
+
+  // The highest user bit records that a side block has been allocated.
+  static constexpr DataValueType s_weak_flag =
+    (SupportsWeak::value ? static_cast<DataValueType>(t_data::get_max_user() - (t_data::get_max_user() >> 1u)) : 0u);
+
+  static_assert(!SupportsWeak::value || s_weak_flag != 0u, "Weak references require at least one user bit");
+  static_assert(!SupportsWeak::value || !s_user_index, "Weak references and the deleter index both use the user bits");
+
+  bool
+  has_weak_control() const noexcept
+  {
+    return ((m_control_deleter.m_data.get_user() & s_weak_flag) != 0u);
+  }
+
+  // Detach the side block before the object is destroyed, and deallocate it if there are no weak
+  // references left.
+  void
+  expire_weak() noexcept
+  {
+    if (!has_weak_control())
+    {
+      return;
+    }
+    WeakControl * block = nullptr;
+    {
+      auto & shard = detail::WeakSideTable::instance().shard(this);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      auto const found = shard.m_map.find(this);
+      block = static_cast<WeakControl *>(found->second);
+      shard.m_map.erase(found);
+      m_control_deleter.m_data.try_set_user(DataValueType{}, s_weak_flag);
+    }
+    block->expire();
+    if (block->weak_release())
+    {
+      WeakControl::deallocate(block);
+    }
+  }
 
   ControlDeleter m_control_deleter;
 
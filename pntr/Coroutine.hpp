@@ -0,0 +1,162 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/AllocatorMalloc.hpp>
+#include <pntr/ControlData.hpp>
+#include <pntr/ControlNew.hpp>
+#include <pntr/CounterThreadSafe.hpp>
+#include <pntr/CounterThreadUnsafe.hpp>
+#include <pntr/Intruder.hpp>
+#include <pntr/SharedPtr.hpp>
+#include <pntr/detail/AllocAdaptPointer.hpp>
+#include <pntr/detail/AllocAdaptTypeInfo.hpp>
+
+#if defined(__cpp_impl_coroutine)
+  #include <coroutine>
+  #include <cstddef>
+  #include <cstdint>
+  #include <new>
+  #include <type_traits>
+  #include <utility>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        DeleterCoroutine                                        //
+//                                                                                                //
+//               A deleter for 'ControlNew' which destroys the frame of a coroutine               //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The promise of a coroutine lives in its frame, whose layout is defined by the compiler. So the
+//  promise can't be deleted like other objects, but the frame has to be destroyed by its handle,
+//  which destroys the promise and the local variables, and deallocates the frame with the
+//  'operator delete' of the promise type.
+//
+
+template<class t_promise>
+struct DeleterCoroutine
+{
+  void
+  operator()(t_promise * p_promise) const noexcept
+  {
+    using Promise = std::remove_const_t<t_promise>;
+    std::coroutine_handle<Promise>::from_promise(const_cast<Promise &>(*p_promise)).destroy();
+  }
+};
+
+
+namespace detail
+{
+  // Like 'IntruderNewWeak', but the frame is destroyed by its coroutine handle.
+  template<class t_promise, class t_thread_safety>
+  using CoroutineControl =
+    ControlNew<t_promise,
+               std::conditional_t<t_thread_safety::value, ControlData<CounterThreadSafe, std::uint32_t, 31u>,
+                                  ControlData<CounterThreadUnsafe, std::uint32_t, 31u>>,
+               DeleterCoroutine<t_promise>, std::true_type>;
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        CoroutinePromise                                        //
+//                                                                                                //
+//                  A promise base whose coroutine frame is owned by 'SharedPtr'                  //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The promise type 't_promise' of a coroutine derives from 'CoroutinePromise<t_promise>', which
+//  embeds the control block in the promise and therefore in the coroutine frame. The result of
+//  'get_return_object' is a 'SharedPtr' to the promise, a handle of the size of a single pointer,
+//  from which the return type of the coroutine is constructed. When the last 'SharedPtr' releases
+//  the promise, the frame is destroyed with 'DeleterCoroutine'. 'WeakPtr' references a side block,
+//  like 'IntruderNewWeak', so a scheduler can hold weak references to suspended coroutines and
+//  skip the cancelled ones, whose 'lock' returns an empty pointer.
+//
+//  The frame is allocated with the allocator 't_allocator', which is default constructed for each
+//  allocation, for example 'AllocatorArena' to reuse the frames of a size class from the pool of
+//  an active 'ArenaPool::Scope'. All allocators for 'ControlAlloc' which deallocate by pointer or
+//  by size and alignment are supported. A failed allocation throws 'std::bad_alloc'.
+//
+//  'final_suspend' always suspends, so the frame is destroyed by the last owner, also after the
+//  coroutine has completed. 'handle' returns the coroutine handle to resume the coroutine. The
+//  derived promise has to provide 'initial_suspend', 'unhandled_exception', and 'return_void' or
+//  'return_value', like any other promise type. 'initial_suspend' has to return
+//  'std::suspend_always': if the coroutine started eagerly and 'unhandled_exception' rethrew, the
+//  compiler would destroy the frame, and then the returned 'SharedPtr' a second time. The last
+//  owner must not release the frame while the coroutine is running, as only suspended coroutines
+//  can be destroyed. The coroutines require C++20.
+//
+
+template<class t_promise, class t_allocator = AllocatorMalloc<NoStaticSupport>, class t_thread_safety = std::true_type>
+class CoroutinePromise: public Intruder<detail::CoroutineControl<t_promise, t_thread_safety>>
+{
+public:
+  static void *
+  operator new(std::size_t const p_size)
+  {
+    void * const frame = t_allocator().allocate(p_size, s_frame_alignment);
+    if (frame == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    return frame;
+  }
+
+  static void
+  operator delete(void * const p_frame, [[maybe_unused]] std::size_t const p_size) noexcept
+  {
+    t_allocator allocator;
+    if constexpr (detail::HasTypeInfoDeallocate<t_allocator>::value)
+    {
+      allocator.deallocate(p_frame, p_size, s_frame_alignment);
+    }
+    else
+    {
+#ifdef _WIN32
+      allocator.deallocate(p_frame, false);
+#else
+      allocator.deallocate(p_frame);
+#endif
+    }
+  }
+
+  SharedPtr<t_promise>
+  get_return_object() noexcept
+  {
+    static_assert(std::is_same_v<decltype(std::declval<t_promise &>().initial_suspend()), std::suspend_always>,
+                  "The coroutine has to suspend initially, so the frame is only destroyed by its last owner");
+    // Takes control of the promise, which is the shared base.
+    return this->shared_from_this();
+  }
+
+  std::suspend_always
+  final_suspend() const noexcept
+  {
+    return {};
+  }
+
+  std::coroutine_handle<t_promise>
+  handle() noexcept
+  {
+    return std::coroutine_handle<t_promise>::from_promise(static_cast<t_promise &>(*this));
+  }
+
+private:
+  // Frames are allocated with the alignment of the global 'operator new' without alignment.
+  static constexpr std::size_t s_frame_alignment = alignof(std::max_align_t);
+
+  static_assert(detail::HasPointerDeallocate<t_allocator>::value || detail::HasTypeInfoDeallocate<t_allocator>::value,
+                "The frame allocator has to deallocate by pointer or by size and alignment");
+};
+
+
+PNTR_NAMESPACE_END
+
+#endif
@@ -0,0 +1,201 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/CounterThreadSafe.hpp>
+#include <pntr/SharedPtr.hpp>
+
+#include <cstddef>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        CounterDeferred                                         //
+//                                                                                                //
+//               An atomic reference counter whose releases are buffered per thread               //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Selected as the 't_counter' template parameter of 'ControlData', see 'IntruderNewDeferred'.
+//  Each thread logs the releases of its 'SharedPtr' objects in a small local buffer instead of
+//  decrementing the atomic counter. Copying a 'SharedPtr' cancels a logged release of the same
+//  object, so a copy followed by a destruction doesn't touch the shared counter at all. The
+//  remaining releases are applied with 'flush_deferred()', when the buffer is full, or when the
+//  thread exits. All logged releases of an object are applied with a single decrement, and only
+//  then the object is destroyed if its count reaches zero.
+//
+//  Increments that don't cancel a logged release are applied immediately, so the counter is never
+//  lower than the number of owners and other threads can safely share the object. In turn,
+//  'use_count()' includes the releases that are still pending, and released objects live until
+//  the log of the releasing thread is flushed.
+//
+
+template<typename t_value>
+class CounterDeferred: public CounterThreadSafe<t_value>
+{
+public:
+  using Deferred = std::true_type;
+
+  explicit CounterDeferred(t_value const p_init_value) noexcept
+  : CounterThreadSafe<t_value>(p_init_value)
+  {}
+};
+
+
+namespace detail
+{
+  class DeferredLog
+  {
+  public:
+    static constexpr std::size_t s_capacity = 16u;
+
+    // Return the log of the current thread.
+    static DeferredLog &
+    local() noexcept
+    {
+      static thread_local DeferredLog s_local;
+      return s_local;
+    }
+
+    // Return true if the log of the current thread has been destroyed at thread exit.
+    static bool &
+    exited() noexcept
+    {
+      static thread_local bool s_exited = false;
+      return s_exited;
+    }
+
+    // Log the release of the given object. Return false if it has to be released immediately.
+    template<class t_shared>
+    bool
+    release(t_shared * const p_shared) noexcept
+    {
+      void * const key = key_of(p_shared);
+      for (std::size_t i = 0u; i < m_size; ++i)
+      {
+        if (m_entries[i].m_key == key)
+        {
+          ++m_entries[i].m_count;
+          return true;
+        }
+      }
+      if (m_size == s_capacity)
+      {
+        if (m_flushing)
+        {
+          // Releases while flushing a full log are applied immediately to bound the recursion.
+          return false;
+        }
+        flush();
+      }
+      m_entries[m_size++] = Entry{key, const_cast<std::remove_const_t<t_shared> *>(p_shared),
+                                  &SharedPtr<std::remove_const_t<t_shared>>::release_deferred, 1u};
+      return true;
+    }
+
+    // Cancel a logged release of the given object and return true, or return false if none is logged.
+    template<class t_shared>
+    bool
+    cancel(t_shared * const p_shared) noexcept
+    {
+      void * const key = key_of(p_shared);
+      for (std::size_t i = 0u; i < m_size; ++i)
+      {
+        if (m_entries[i].m_key == key)
+        {
+          if (--m_entries[i].m_count == 0u)
+          {
+            m_entries[i] = m_entries[--m_size];
+          }
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Apply all logged releases, including those logged by destructors while flushing.
+    void
+    flush() noexcept
+    {
+      if (m_flushing)
+      {
+        return;
+      }
+      m_flushing = true;
+      while (m_size > 0u)
+      {
+        Entry const entry = m_entries[--m_size];
+        entry.m_release(entry.m_object, entry.m_count);
+      }
+      m_flushing = false;
+    }
+
+    // Return the number of logged entries.
+    std::size_t
+    pending() const noexcept
+    {
+      return m_size;
+    }
+
+  private:
+    struct Entry
+    {
+      void * m_key;
+      void * m_object;
+      void (*m_release)(void *, std::size_t) noexcept;
+      std::size_t m_count;
+    };
+
+    DeferredLog() noexcept = default;
+
+    ~DeferredLog()
+    {
+      flush();
+      exited() = true;
+    }
+
+    // Pointers to different classes of the same object are logged with the address of its base.
+    template<class t_shared>
+    static void *
+    key_of(t_shared * const p_shared) noexcept
+    {
+      return const_cast<std::remove_const_t<BaseType<t_shared>> *>(static_cast<BaseType<t_shared> *>(p_shared));
+    }
+
+    Entry m_entries[s_capacity];
+    std::size_t m_size = 0u;
+    bool m_flushing = false;
+  };
+
+
+  template<class t_shared>
+  bool
+  deferred_release(t_shared * const p_shared) noexcept
+  {
+    return (!DeferredLog::exited() && DeferredLog::local().release(p_shared));
+  }
+
+  template<class t_shared>
+  bool
+  deferred_cancel(t_shared * const p_shared) noexcept
+  {
+    return (!DeferredLog::exited() && DeferredLog::local().cancel(p_shared));
+  }
+} // namespace detail
+
+
+// Apply the deferred releases of the current thread, see 'CounterDeferred'.
+inline void
+flush_deferred() noexcept
+{
+  if (!detail::DeferredLog::exited())
+  {
+    detail::DeferredLog::local().flush();
+  }
+}
+
+
+PNTR_NAMESPACE_END
@@ -0,0 +1,56 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/CounterThreadSafe.hpp>
+#include <pntr/CounterThreadUnsafe.hpp>
+
+#include <type_traits>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                          CounterSpill                                          //
+//                                                                                                //
+//             Reference counters which spill their excess count into a global table              //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Selected as the 't_counter' template parameter of 'ControlData', see 'IntruderAllocSpill'.
+//  A usage or weak counter with a few bits normally limits the number of shared or weak pointers
+//  to an object. When a spill counter reaches its maximum, further references are counted in a
+//  global table keyed by the address of the control data, and released from there first.
+//
+//  The counters stay small for the common case, and only the rare objects with many references
+//  pay for a locked table lookup when they are copied or released. 'use_count()' and
+//  'weak_count()' include the spilled counts, limited to the maximum of their value types.
+//
+
+template<typename t_value>
+class CounterSpillThreadSafe: public CounterThreadSafe<t_value>
+{
+public:
+  using Spill = std::true_type;
+
+  explicit CounterSpillThreadSafe(t_value const p_init_value) noexcept
+  : CounterThreadSafe<t_value>(p_init_value)
+  {}
+};
+
+
+template<typename t_value>
+class CounterSpillThreadUnsafe: public CounterThreadUnsafe<t_value>
+{
+public:
+  using Spill = std::true_type;
+
+  explicit CounterSpillThreadUnsafe(t_value const p_init_value) noexcept
+  : CounterThreadUnsafe<t_value>(p_init_value)
+  {}
+};
+
+
+PNTR_NAMESPACE_END
@@ -0,0 +1,502 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/SharedPtr.hpp>
+
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         CycleCollector                                         //
+//                                                                                                //
+//            An incremental trial deletion collector for cycles of shared objects                //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  A shared base class takes part in cycle collection by providing the member function template
+//  'template<class t_visitor> void pntr_visit_children(t_visitor && p_visit)', which calls
+//  'p_visit' with each 'SharedPtr' member of the object as non-constant reference. Objects of
+//  all other types are acyclic, and their shared pointers don't pay anything at all.
+//
+//  The collector uses the lowest 3 bits of the user value of the control block for a buffered
+//  flag and the color of the synchronous algorithm by Bacon and Rajan, so the control block
+//  needs at least 3 user bits, see 'IntruderCycle'. 'ControlAlloc' reserves these bits: the user
+//  value excludes them, and setting it keeps them.
+//
+//  When a 'SharedPtr' to a collected object is destroyed and the object has other owners, it is
+//  a possible root of a garbage cycle. Unless it is buffered already, the reference is moved to
+//  the buffer of the collector instead of being released. So buffered objects stay alive until
+//  they have been processed by 'collect'.
+//
+//  'collect' processes the buffered roots in batches. It marks the objects reachable from the
+//  roots with trial counts in a side table, without modifying the usage counters, and finally
+//  releases the garbage cycles. The trial counts are only valid as long as the graph isn't
+//  modified, so a batch can't be resumed later. Instead, a batch whose traversal exceeds the
+//  remaining budget is abandoned: its side table is dropped, and its roots are buffered again at
+//  the end, so each pause stays bounded by the budget. A subgraph which is larger than the budget
+//  is only collected by a call with a larger budget, at the latest when the thread exits.
+//  Traversal stops at objects which are buffered for later batches, which usually keeps the
+//  batches small.
+//
+//  Each thread has its own collector, which isn't thread-safe. So the objects of a graph must
+//  only be released and collected by one thread at a time. The collector of a thread collects
+//  all remaining roots when the thread exits.
+//
+
+class CycleCollector
+{
+public:
+  // Return the collector of the current thread.
+  static CycleCollector &
+  local() noexcept
+  {
+    static thread_local CycleCollector s_collector;
+    return s_collector;
+  }
+
+  CycleCollector(CycleCollector const &) = delete;
+  CycleCollector & operator=(CycleCollector const &) = delete;
+
+  // Process batches of buffered roots until the number of visited objects reaches the budget.
+  // A batch which would exceed the remaining budget is abandoned, and its roots are buffered
+  // again at the end. Return the number of released objects.
+  std::size_t
+  collect(std::size_t const p_budget = std::numeric_limits<std::size_t>::max())
+  {
+    std::size_t released = 0u;
+    std::size_t work = 0u;
+    while (!m_roots.empty() && work < p_budget)
+    {
+      m_batch.clear();
+      while (!m_roots.empty() && work + m_batch.size() < p_budget)
+      {
+        Node const root = m_roots.front();
+        m_roots.pop_front();
+        if (root.m_ops->m_use_count(root.m_object) == 1u)
+        {
+          // Only the buffer owns the root.
+          root.set_bits(s_black);
+          root.m_ops->m_release(root.m_object);
+          ++released;
+          ++work;
+        }
+        else
+        {
+          root.set_bits(s_buffered | s_purple);
+          m_batch.push_back(root);
+        }
+      }
+      if (!mark_gray(p_budget - work))
+      {
+        abandon();
+        break;
+      }
+      scan();
+      released += collect_white();
+      work += m_visited.size();
+      m_visited.clear();
+      m_index.clear();
+    }
+    return released;
+  }
+
+  // Return the number of buffered roots.
+  std::size_t
+  pending() const noexcept
+  {
+    return m_roots.size();
+  }
+
+private:
+  static constexpr unsigned s_black = 0u;
+  static constexpr unsigned s_gray = 1u;
+  static constexpr unsigned s_white = 2u;
+  static constexpr unsigned s_purple = 3u;
+  static constexpr unsigned s_color_mask = 3u;
+  static constexpr unsigned s_buffered = 4u;
+  static constexpr unsigned s_bits_mask = 7u;
+
+  struct Node;
+
+  using VisitCallback = void (*)(CycleCollector &, Node const &);
+
+  // The functions for a type of objects.
+  struct Ops
+  {
+    std::size_t (*m_use_count)(void *) noexcept;
+    unsigned (*m_get_bits)(void *) noexcept;
+    void (*m_set_bits)(void *, unsigned) noexcept;
+    void (*m_visit)(void *, CycleCollector &, VisitCallback);
+    void (*m_clear)(void *);
+    void (*m_add_ref)(void *) noexcept;
+    void (*m_release)(void *) noexcept;
+  };
+
+  struct Node
+  {
+    void * m_object;
+    Ops const * m_ops;
+
+    unsigned
+    get_bits() const noexcept
+    {
+      return m_ops->m_get_bits(m_object);
+    }
+
+    void
+    set_bits(unsigned const p_bits) const noexcept
+    {
+      m_ops->m_set_bits(m_object, p_bits);
+    }
+  };
+
+  // A visited object and its trial count.
+  struct Entry
+  {
+    Node m_node;
+    std::size_t m_count;
+  };
+
+  template<class t_base>
+  struct TypeOps
+  {
+    static std::size_t
+    use_count(void * const p_object) noexcept
+    {
+      return static_cast<std::size_t>(static_cast<t_base *>(p_object)->pntr_use_count());
+    }
+
+    static unsigned
+    get_bits(void * const p_object) noexcept
+    {
+      return static_cast<unsigned>(static_cast<t_base *>(p_object)->pntr_get_cycle_bits());
+    }
+
+    static void
+    set_bits(void * const p_object, unsigned const p_bits) noexcept
+    {
+      using User = typename t_base::PntrDataValueType;
+      static_cast<t_base *>(p_object)->pntr_set_cycle_bits(static_cast<User>(p_bits));
+    }
+
+    static void
+    visit(void * const p_object, CycleCollector & p_collector, VisitCallback const p_callback)
+    {
+      static_cast<t_base *>(p_object)->pntr_visit_children(Visitor{p_collector, p_callback});
+    }
+
+    static void
+    clear(void * const p_object)
+    {
+      static_cast<t_base *>(p_object)->pntr_visit_children(Clear{});
+    }
+
+    static void
+    add_ref(void * const p_object) noexcept
+    {
+      SharedPtr<t_base>(static_cast<t_base *>(p_object), true).detach();
+    }
+
+    static void
+    release(void * const p_object) noexcept
+    {
+      SharedPtr<t_base>(static_cast<t_base *>(p_object), false);
+    }
+
+    static constexpr Ops s_ops{&use_count, &get_bits, &set_bits, &visit, &clear, &add_ref, &release};
+  };
+
+  // Pass the collected children to the callback.
+  struct Visitor
+  {
+    CycleCollector & m_collector;
+    VisitCallback m_callback;
+
+    template<class t_shared>
+    void
+    operator()(SharedPtr<t_shared> & p_child) const
+    {
+      if constexpr (detail::is_cycle_collected<t_shared>)
+      {
+        if (p_child)
+        {
+          m_callback(m_collector, node(p_child.get()));
+        }
+      }
+    }
+  };
+
+  // Release all children.
+  struct Clear
+  {
+    template<class t_shared>
+    void
+    operator()(SharedPtr<t_shared> & p_child) const noexcept
+    {
+      p_child.reset();
+    }
+  };
+
+  CycleCollector() noexcept = default;
+
+  // The remaining roots are leaked if they can't be collected.
+  ~CycleCollector()
+  {
+    try
+    {
+      collect();
+    }
+    catch (...)
+    {
+      PNTR_LOG_ERROR("Can't collect the remaining roots at thread exit");
+    }
+    exited() = true;
+  }
+
+  // Return true if the collector of the current thread has been destroyed.
+  static bool &
+  exited() noexcept
+  {
+    static thread_local bool s_exited = false;
+    return s_exited;
+  }
+
+  template<class t_shared>
+  static Node
+  node(t_shared * const p_shared) noexcept
+  {
+    using Base = std::remove_const_t<detail::BaseType<t_shared>>;
+    return Node{const_cast<Base *>(static_cast<detail::BaseType<t_shared> *>(p_shared)), &TypeOps<Base>::s_ops};
+  }
+
+  // Move the reference to the buffer if the object is a possible root of a garbage cycle.
+  template<class t_base>
+  bool
+  buffer(t_base * const p_base) noexcept
+  {
+    Node const root = node(p_base);
+    unsigned const bits = root.get_bits();
+    if (m_releasing || (bits & s_buffered) != 0u || (bits & s_color_mask) == s_white || p_base->pntr_use_count() <= 1u)
+    {
+      return false;
+    }
+    try
+    {
+      m_roots.push_back(root);
+    }
+    catch (...)
+    {
+      return false;
+    }
+    root.set_bits(bits | s_buffered);
+    return true;
+  }
+
+  std::size_t
+  add(Node const & p_node)
+  {
+    // The reference of the buffer to a root of the batch is not an internal reference.
+    unsigned const bits = p_node.get_bits();
+    std::size_t const count = p_node.m_ops->m_use_count(p_node.m_object) - ((bits & s_buffered) != 0u ? 1u : 0u);
+    std::size_t const index = m_visited.size();
+    m_visited.push_back(Entry{p_node, count});
+    m_index.emplace(p_node.m_object, index);
+    p_node.set_bits((bits & ~s_color_mask) | s_gray);
+    return index;
+  }
+
+  // Return the index of a visited object, or 'm_visited.size()' if it was skipped.
+  std::size_t
+  find(Node const & p_node) const
+  {
+    auto const found = m_index.find(p_node.m_object);
+    return (found == m_index.end() ? m_visited.size() : found->second);
+  }
+
+  // Subtract the internal references of all objects reachable from the roots of the batch from
+  // their trial counts. Objects which are buffered for a later batch are alive, so they and their
+  // children are skipped, and their cycles are found later. Return false as soon as more objects
+  // than the limit have been visited.
+  bool
+  mark_gray(std::size_t const p_limit)
+  {
+    for (Node const & root: m_batch)
+    {
+      if ((root.get_bits() & s_color_mask) != s_purple)
+      {
+        continue;
+      }
+      m_stack.push_back(add(root));
+      while (!m_stack.empty())
+      {
+        if (m_visited.size() > p_limit)
+        {
+          m_stack.clear();
+          return false;
+        }
+        Node const node = m_visited[m_stack.back()].m_node;
+        m_stack.pop_back();
+        node.m_ops->m_visit(node.m_object, *this, [](CycleCollector & p_self, Node const & p_child) {
+          std::size_t child = p_self.find(p_child);
+          if (child == p_self.m_visited.size())
+          {
+            unsigned const bits = p_child.get_bits();
+            if ((bits & s_buffered) != 0u && (bits & s_color_mask) != s_purple)
+            {
+              return;
+            }
+            child = p_self.add(p_child);
+            p_self.m_stack.push_back(child);
+          }
+          --p_self.m_visited[child].m_count;
+        });
+      }
+    }
+    return true;
+  }
+
+  // Drop the trial counts of an abandoned batch, reset the colors of the visited objects, and
+  // buffer the roots of the batch again. The usage counters haven't been modified.
+  void
+  abandon()
+  {
+    for (Entry const & entry: m_visited)
+    {
+      entry.m_node.set_bits(entry.m_node.get_bits() & s_buffered);
+    }
+    for (Node const & root: m_batch)
+    {
+      root.set_bits(s_buffered);
+      m_roots.push_back(root);
+    }
+    m_visited.clear();
+    m_index.clear();
+  }
+
+  // Color the objects white if they are only referenced by garbage, and black otherwise.
+  void
+  scan()
+  {
+    for (Node const & root: m_batch)
+    {
+      m_stack.push_back(find(root));
+    }
+    while (!m_stack.empty())
+    {
+      Entry const & entry = m_visited[m_stack.back()];
+      m_stack.pop_back();
+      if ((entry.m_node.get_bits() & s_color_mask) != s_gray)
+      {
+        continue;
+      }
+      if (entry.m_count > 0u)
+      {
+        scan_black(entry.m_node);
+        continue;
+      }
+      entry.m_node.set_bits((entry.m_node.get_bits() & ~s_color_mask) | s_white);
+      entry.m_node.m_ops->m_visit(entry.m_node.m_object, *this, [](CycleCollector & p_self, Node const & p_child) {
+        std::size_t const child = p_self.find(p_child);
+        if (child != p_self.m_visited.size())
+        {
+          p_self.m_stack.push_back(child);
+        }
+      });
+    }
+  }
+
+  // Restore the trial counts of all objects reachable from a live object.
+  void
+  scan_black(Node const & p_node)
+  {
+    p_node.set_bits(p_node.get_bits() & ~s_color_mask);
+    m_black.push_back(p_node);
+    while (!m_black.empty())
+    {
+      Node const node = m_black.back();
+      m_black.pop_back();
+      node.m_ops->m_visit(node.m_object, *this, [](CycleCollector & p_self, Node const & p_child) {
+        std::size_t const child = p_self.find(p_child);
+        if (child == p_self.m_visited.size())
+        {
+          return;
+        }
+        ++p_self.m_visited[child].m_count;
+        unsigned const bits = p_child.get_bits();
+        if ((bits & s_color_mask) != s_black)
+        {
+          p_child.set_bits(bits & ~s_color_mask);
+          p_self.m_black.push_back(p_child);
+        }
+      });
+    }
+  }
+
+  // Release the white objects and the buffered references to the roots of the batch.
+  std::size_t
+  collect_white()
+  {
+    m_garbage.clear();
+    for (Entry const & entry: m_visited)
+    {
+      if ((entry.m_node.get_bits() & s_color_mask) == s_white)
+      {
+        entry.m_node.m_ops->m_add_ref(entry.m_node.m_object);
+        m_garbage.push_back(entry.m_node);
+      }
+    }
+    // The live roots aren't buffered again, and the white color prevents buffering the garbage
+    // while its children are released.
+    m_releasing = true;
+    for (Node const & root: m_batch)
+    {
+      root.set_bits(root.get_bits() & s_color_mask);
+      root.m_ops->m_release(root.m_object);
+    }
+    m_releasing = false;
+    for (Node const & node: m_garbage)
+    {
+      node.m_ops->m_clear(node.m_object);
+    }
+    for (Node const & node: m_garbage)
+    {
+      node.m_ops->m_release(node.m_object);
+    }
+    return m_garbage.size();
+  }
+
+  std::deque<Node> m_roots;
+  std::vector<Node> m_batch;
+  std::vector<Entry> m_visited;
+  std::unordered_map<void *, std::size_t> m_index;
+  std::vector<std::size_t> m_stack;
+  std::vector<Node> m_black;
+  std::vector<Node> m_garbage;
+  bool m_releasing{};
+
+  template<class t_shared>
+  friend bool detail::cycle_buffer(t_shared * p_shared) noexcept;
+};
+
+
+namespace detail
+{
+  template<class t_shared>
+  bool
+  cycle_buffer(t_shared * const p_shared) noexcept
+  {
+    return (!CycleCollector::exited() && CycleCollector::local().buffer(p_shared));
+  }
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
@@ -3,6 +3,7 @@
 #pragma once
 
 #include <pntr/detail/PntrTypeTraits.hpp>
+#include <pntr/detail/TypeRegistry.hpp>
 
 PNTR_NAMESPACE_BEGIN
 
@@ -94,4 +95,92 @@ private:
 };
 
 
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         DeleterIndexed                                         //
+//                                                                                                //
+//        A deleter for 'ControlNew' which saves the shared object type as a small index          //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Like 'Deleter', but the function that casts the shared object pointer to the original type is
+//  registered in a 'detail::TypeRegistry' of its class hierarchy. 'ControlNew' stores its index in
+//  the user bits of the control data instead of the deleter, so the control block doesn't grow by
+//  the size of a pointer. Each hierarchy can register up to 255 types.
+//
+//  The control data requires at least 8 user bits, which are not available to the user anymore.
+//  A static assertion ensures that enough bits are available.
+//
+
+template<typename t_shared>
+struct DeleterIndexed
+{
+  using SharedBase = std::remove_const_t<detail::BaseType<t_shared>>;
+
+  // 'ControlNew' stores the index in the user bits of the control data.
+  using UserIndex = void;
+
+  // Return the maximum index.
+  static constexpr std::size_t
+  get_max_index() noexcept
+  {
+    return Registry::s_capacity - 1u;
+  }
+
+  // Restore the deleter from its index.
+  static DeleterIndexed
+  from_index(std::size_t const p_index) noexcept
+  {
+    DeleterIndexed deleter;
+    deleter.m_index = static_cast<unsigned char>(p_index);
+    return deleter;
+  }
+
+  // Return the index of the delete function.
+  std::size_t
+  index() const noexcept
+  {
+    return m_index;
+  }
+
+  DeleterIndexed() noexcept
+  : m_index(static_cast<unsigned char>(Registry::template index<&delete_shared>()))
+  {}
+
+  template<typename t_other,
+           typename = std::enable_if_t<std::is_convertible_v<std::remove_const_t<t_other> *, t_shared *>>>
+  DeleterIndexed(DeleterIndexed<t_other> const & p_other) noexcept
+  : m_index(p_other.m_index)
+  {}
+
+  void
+  operator()(t_shared * p_shared) const noexcept
+  {
+    static_assert(sizeof(t_shared) != 0u, "incomplete type");
+    DeleteFunction const function = Registry::get(m_index);
+    PNTR_TRY_LOG_ERROR(function == nullptr, "Invalid type index");
+    if (function != nullptr)
+    {
+      function(p_shared);
+    }
+  }
+
+private:
+  static void
+  delete_shared(SharedBase const * p_base) noexcept
+  {
+    delete detail::static_or_dynamic_cast<std::add_const_t<t_shared>>(p_base);
+  }
+
+  using DeleteFunction = void (*)(SharedBase const *) noexcept;
+  using Registry = detail::TypeRegistry<DeleteFunction>;
+
+  unsigned char m_index;
+
+  template<typename t_other>
+  friend struct DeleterIndexed;
+};
+
+
 PNTR_NAMESPACE_END
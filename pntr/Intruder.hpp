@@ -2,7 +2,7 @@
 
 #pragma once
 
-#include <pntr/common.hpp>
+#include <pntr/detail/PntrTypeTraits.hpp>
 
 PNTR_NAMESPACE_BEGIN
 
@@ -103,11 +103,26 @@ private:
   // Try to increment the usage counter and return a pointer to the shared object on success.
   template<class t_shared>
   static t_shared *
-  pntr_try_get_shared(PntrControlType & p_control) noexcept
+  pntr_try_get_shared(detail::WeakControlType<t_control> & p_control) noexcept
   {
     return p_control.template try_get_shared<t_shared>();
   }
 
+  // Return the instance referenced by 'WeakPtr', which is the control block unless it provides a
+  // separate side block. Return nullptr if the side block can't be allocated.
+  detail::WeakControlType<t_control> *
+  pntr_get_weak_control() const noexcept
+  {
+    if constexpr (std::is_same_v<detail::WeakControlType<t_control>, t_control>)
+    {
+      return &control();
+    }
+    else
+    {
+      return control().weak_control();
+    }
+  }
+
   // Return an owner-based pointer for ordering in associative containers.
   // All 'SharedPtr' and 'WeakPtr' who own the same object should return the same pointer.
   // Types which support 'WeakPtr' have to return the address of the control class instance.
@@ -149,6 +164,13 @@ private:
     control().add_ref();
   }
 
+  // Increment the usage counter by the given number of references at once.
+  void
+  pntr_add_ref(PntrUsageValueType const p_count) const noexcept
+  {
+    control().add_ref(p_count);
+  }
+
   // Decrement the usage counter and return true if it reaches zero or was invalid.
   bool
   pntr_release() const noexcept
@@ -156,6 +178,14 @@ private:
     return control().release();
   }
 
+  // Decrement the usage counter by the given number of references at once, and return true if it
+  // reaches zero or was invalid.
+  bool
+  pntr_release(PntrUsageValueType const p_count) const noexcept
+  {
+    return control().release(p_count);
+  }
+
   // Delete (non-weak) or destroy (weak) the object. Called when 'pntr_release' returns true.
   // Return a pointer to the control block if it should be deallocated.
   template<class t_shared>
@@ -169,6 +199,13 @@ private:
   static void
   pntr_deallocate(PntrControlType * p_control) noexcept
   {
+    if constexpr (detail::is_census_member<PntrSharedBase>)
+    {
+      if (p_control != nullptr)
+      {
+        detail::census_deallocate<PntrSharedBase>(get_shared_base(*p_control));
+      }
+    }
     t_control::deallocate(p_control);
   }
 
@@ -252,14 +289,16 @@ public:
   WeakPtr<PntrSharedBase>
   weak_from_this() noexcept
   {
-    return WeakPtr<PntrSharedBase>(control());
+    auto * const weak_control = pntr_get_weak_control();
+    return (weak_control != nullptr ? WeakPtr<PntrSharedBase>(*weak_control) : WeakPtr<PntrSharedBase>());
   }
 
   template<typename t_weak = PntrSupportsWeak, typename = std::enable_if_t<t_weak::value>>
   WeakPtr<PntrSharedBase const>
   weak_from_this() const noexcept
   {
-    return WeakPtr<PntrSharedBase const>(control());
+    auto * const weak_control = pntr_get_weak_control();
+    return (weak_control != nullptr ? WeakPtr<PntrSharedBase const>(*weak_control) : WeakPtr<PntrSharedBase const>());
   }
 
   // Re-initialize the usage counter of an expired object. Should only be used if an object was
@@ -339,8 +378,23 @@ private:
     return *std::launder(reinterpret_cast<t_control *>(&m_control_storage));
   }
 
+  // Return the user bits reserved for 'CycleCollector', see 'ControlAlloc'.
+  PntrDataValueType
+  pntr_get_cycle_bits() const noexcept
+  {
+    return control().get_cycle_bits();
+  }
+
+  // Set the user bits reserved for 'CycleCollector', see 'ControlAlloc'.
+  void
+  pntr_set_cycle_bits(PntrDataValueType const p_bits) const noexcept
+  {
+    control().set_cycle_bits(p_bits);
+  }
+
   alignas(t_control) mutable std::byte m_control_storage[sizeof(t_control)];
 
+  friend class CycleCollector;
   template<class t_shared>
   friend class SharedPtr;
   template<class t_shared>
@@ -0,0 +1,250 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/SharedPtr.hpp>
+
+#include <new>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The non-atomic count shared by the copies of a 'LocalSharedPtr'.
+  struct LocalCount
+  {
+    std::size_t m_count;
+    void (*m_destroy)(LocalCount *) noexcept;
+  };
+
+  // Owns the single reference of all copies of a 'LocalSharedPtr'.
+  template<class t_shared>
+  struct LocalCountShared: LocalCount
+  {
+    explicit LocalCountShared(SharedPtr<t_shared> && p_shared) noexcept
+    : LocalCount{1u, &destroy}
+    , m_shared(std::move(p_shared))
+    {}
+
+    static void
+    destroy(LocalCount * const p_count) noexcept
+    {
+      delete static_cast<LocalCountShared *>(p_count);
+    }
+
+    SharedPtr<t_shared> m_shared;
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         LocalSharedPtr                                         //
+//                                                                                                //
+//        A shared pointer for one thread, whose copies share a single counted reference          //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'LocalSharedPtr' is constructed explicitly from a 'SharedPtr', which allocates a regular
+//  counter that holds the only reference to the object. Copies of the 'LocalSharedPtr' increment
+//  that counter instead of the usage counter of the object, which is released when the last copy
+//  is destroyed. So copying costs the same as with a thread-unsafe counter, even if the object
+//  uses a thread-safe one. The 'LocalSharedPtr' is empty if the counter can't be allocated.
+//
+//  The counter is shared by the copies of one 'LocalSharedPtr' only. Each construction from a
+//  'SharedPtr' allocates a new counter with its own reference, even if the same thread already
+//  holds a 'LocalSharedPtr' to the object. So a thread should construct it once and copy it.
+//
+//  A 'LocalSharedPtr' and its copies must not be used by more than one thread. To pass the object
+//  to another thread, convert it back explicitly to a 'SharedPtr' with 'get_shared()'.
+//
+
+template<class t_shared>
+class LocalSharedPtr
+{
+public:
+  using element_type = t_shared;
+
+  constexpr LocalSharedPtr() noexcept
+  : m_shared(nullptr)
+  , m_count(nullptr)
+  {}
+
+  constexpr LocalSharedPtr(std::nullptr_t) noexcept
+  : LocalSharedPtr()
+  {}
+
+  // Take the reference of the given 'SharedPtr' with a new counter. Release it, and construct an
+  // empty pointer, if the counter can't be allocated.
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other *, t_shared *>>>
+  explicit LocalSharedPtr(SharedPtr<t_other> p_shared) noexcept
+  : m_shared(p_shared.get())
+  , m_count(m_shared != nullptr ? new (std::nothrow) detail::LocalCountShared<t_other>(std::move(p_shared)) : nullptr)
+  {
+    if (m_count == nullptr)
+    {
+      m_shared = nullptr;
+    }
+  }
+
+  LocalSharedPtr(LocalSharedPtr const & p_other) noexcept
+  : m_shared(p_other.m_shared)
+  , m_count(p_other.m_count)
+  {
+    add_ref();
+  }
+
+  LocalSharedPtr(LocalSharedPtr && p_other) noexcept
+  : m_shared(p_other.m_shared)
+  , m_count(p_other.m_count)
+  {
+    p_other.m_shared = nullptr;
+    p_other.m_count = nullptr;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other *, t_shared *>>>
+  LocalSharedPtr(LocalSharedPtr<t_other> const & p_other) noexcept
+  : m_shared(p_other.m_shared)
+  , m_count(p_other.m_count)
+  {
+    add_ref();
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other *, t_shared *>>>
+  LocalSharedPtr(LocalSharedPtr<t_other> && p_other) noexcept
+  : m_shared(p_other.m_shared)
+  , m_count(p_other.m_count)
+  {
+    p_other.m_shared = nullptr;
+    p_other.m_count = nullptr;
+  }
+
+  ~LocalSharedPtr() noexcept
+  {
+    if (m_count != nullptr && --m_count->m_count == 0u)
+    {
+      m_count->m_destroy(m_count);
+    }
+  }
+
+  LocalSharedPtr &
+  operator=(LocalSharedPtr const & p_other) noexcept
+  {
+    LocalSharedPtr(p_other).swap(*this);
+    return *this;
+  }
+
+  LocalSharedPtr &
+  operator=(LocalSharedPtr && p_other) noexcept
+  {
+    LocalSharedPtr(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other *, t_shared *>>>
+  LocalSharedPtr &
+  operator=(LocalSharedPtr<t_other> const & p_other) noexcept
+  {
+    LocalSharedPtr(p_other).swap(*this);
+    return *this;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other *, t_shared *>>>
+  LocalSharedPtr &
+  operator=(LocalSharedPtr<t_other> && p_other) noexcept
+  {
+    LocalSharedPtr(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  // Return a 'SharedPtr' which shares the ownership and can be passed to another thread.
+  SharedPtr<t_shared>
+  get_shared() const noexcept
+  {
+    return SharedPtr<t_shared>(m_shared, true);
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return m_shared != nullptr;
+  }
+
+  t_shared *
+  get() const noexcept
+  {
+    return m_shared;
+  }
+
+  t_shared &
+  operator*() const noexcept
+  {
+    PNTR_ASSERT(m_shared != nullptr);
+    return *m_shared;
+  }
+
+  t_shared *
+  operator->() const noexcept
+  {
+    PNTR_ASSERT(m_shared != nullptr);
+    return m_shared;
+  }
+
+  // Return the number of 'LocalSharedPtr' objects sharing the counter.
+  std::size_t
+  local_use_count() const noexcept
+  {
+    return m_count != nullptr ? m_count->m_count : 0u;
+  }
+
+  typename t_shared::PntrUsageValueType
+  use_count() const noexcept
+  {
+    return m_shared != nullptr ? m_shared->pntr_use_count() : typename t_shared::PntrUsageValueType{};
+  }
+
+  void
+  reset() noexcept
+  {
+    LocalSharedPtr().swap(*this);
+  }
+
+  void
+  swap(LocalSharedPtr & p_other) noexcept
+  {
+    std::swap(m_shared, p_other.m_shared);
+    std::swap(m_count, p_other.m_count);
+  }
+
+private:
+  void
+  add_ref() const noexcept
+  {
+    if (m_count != nullptr)
+    {
+      ++m_count->m_count;
+    }
+  }
+
+  t_shared * m_shared;
+  detail::LocalCount * m_count;
+
+  template<class t_other>
+  friend class LocalSharedPtr;
+};
+
+
+// clang-format off
+
+template<class L, class R> inline bool operator==(LocalSharedPtr<L> const & l, LocalSharedPtr<R> const & r) noexcept { return l.get() == r.get(); }
+template<class L, class R> inline bool operator!=(LocalSharedPtr<L> const & l, LocalSharedPtr<R> const & r) noexcept { return l.get() != r.get(); }
+template<class L> inline bool operator==(LocalSharedPtr<L> const & l, std::nullptr_t) noexcept { return !l; }
+template<class R> inline bool operator==(std::nullptr_t, LocalSharedPtr<R> const & r) noexcept { return !r; }
+template<class L> inline bool operator!=(LocalSharedPtr<L> const & l, std::nullptr_t) noexcept { return static_cast<bool>(l); }
+template<class R> inline bool operator!=(std::nullptr_t, LocalSharedPtr<R> const & r) noexcept { return static_cast<bool>(r); }
+
+// clang-format on
+
+
+PNTR_NAMESPACE_END
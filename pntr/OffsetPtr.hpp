@@ -0,0 +1,200 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/SharedPtr.hpp>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                           OffsetPtr                                            //
+//                                                                                                //
+//           A raw pointer that stores the distance to its target relative to its own address     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'OffsetPtr' remains valid if the memory block that contains both the pointer and its target is
+//  mapped at a different address, for example by another process sharing a memory segment. It
+//  can't point to itself, because an offset of zero represents 'nullptr'.
+//
+
+template<class t_type>
+class OffsetPtr
+{
+public:
+  using element_type = t_type;
+
+  OffsetPtr() noexcept = default;
+
+  OffsetPtr(std::nullptr_t) noexcept
+  {}
+
+  OffsetPtr(t_type * const p_pointer) noexcept
+  {
+    set(p_pointer);
+  }
+
+  OffsetPtr(OffsetPtr const & p_other) noexcept
+  {
+    set(p_other.get());
+  }
+
+  OffsetPtr &
+  operator=(OffsetPtr const & p_other) noexcept
+  {
+    set(p_other.get());
+    return *this;
+  }
+
+  OffsetPtr &
+  operator=(t_type * const p_pointer) noexcept
+  {
+    set(p_pointer);
+    return *this;
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return (m_offset != 0);
+  }
+
+  t_type *
+  get() const noexcept
+  {
+    return (m_offset == 0 ? nullptr
+                          : reinterpret_cast<t_type *>(reinterpret_cast<std::uintptr_t>(this)
+                                                       + static_cast<std::uintptr_t>(m_offset)));
+  }
+
+  t_type &
+  operator*() const noexcept
+  {
+    PNTR_ASSERT(m_offset != 0);
+    return *get();
+  }
+
+  t_type *
+  operator->() const noexcept
+  {
+    PNTR_ASSERT(m_offset != 0);
+    return get();
+  }
+
+private:
+  void
+  set(t_type * const p_pointer) noexcept
+  {
+    m_offset = (p_pointer == nullptr ? 0
+                                     : static_cast<std::ptrdiff_t>(reinterpret_cast<std::uintptr_t>(p_pointer)
+                                                                   - reinterpret_cast<std::uintptr_t>(this)));
+  }
+
+  std::ptrdiff_t m_offset{};
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        OffsetSharedPtr                                         //
+//                                                                                                //
+//         A shared pointer that stores an 'OffsetPtr' and owns one reference to its target       //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'OffsetSharedPtr' is meant to be stored inside of shared objects in a memory segment which is
+//  mapped by several processes, see 'AllocatorSharedMemory'. Access from outside of the segment
+//  should use 'SharedPtr', which can be obtained with 'get_shared()'.
+//
+
+template<class t_shared>
+class OffsetSharedPtr
+{
+public:
+  using element_type = t_shared;
+
+  OffsetSharedPtr() noexcept = default;
+
+  OffsetSharedPtr(std::nullptr_t) noexcept
+  {}
+
+  OffsetSharedPtr(SharedPtr<t_shared> p_shared) noexcept
+  : m_pointer(p_shared.detach())
+  {}
+
+  OffsetSharedPtr(OffsetSharedPtr const & p_other) noexcept
+  : OffsetSharedPtr(p_other.get_shared())
+  {}
+
+  ~OffsetSharedPtr() noexcept
+  {
+    reset();
+  }
+
+  OffsetSharedPtr &
+  operator=(OffsetSharedPtr const & p_other) noexcept
+  {
+    return (*this = p_other.get_shared());
+  }
+
+  OffsetSharedPtr &
+  operator=(SharedPtr<t_shared> p_shared) noexcept
+  {
+    reset();
+    m_pointer = p_shared.detach();
+    return *this;
+  }
+
+  void
+  reset() noexcept
+  {
+    // The temporary 'SharedPtr' adopts and releases the owned reference.
+    SharedPtr<t_shared>(m_pointer.get(), false);
+    m_pointer = nullptr;
+  }
+
+  // Return a 'SharedPtr' which shares the ownership.
+  SharedPtr<t_shared>
+  get_shared() const noexcept
+  {
+    return SharedPtr<t_shared>(m_pointer.get(), true);
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return static_cast<bool>(m_pointer);
+  }
+
+  t_shared *
+  get() const noexcept
+  {
+    return m_pointer.get();
+  }
+
+  t_shared &
+  operator*() const noexcept
+  {
+    return *m_pointer;
+  }
+
+  t_shared *
+  operator->() const noexcept
+  {
+    return m_pointer.get();
+  }
+
+  typename t_shared::PntrUsageValueType
+  use_count() const noexcept
+  {
+    return m_pointer ? m_pointer->pntr_use_count() : typename t_shared::PntrUsageValueType{};
+  }
+
+private:
+  OffsetPtr<t_shared> m_pointer;
+};
+
+
+PNTR_NAMESPACE_END
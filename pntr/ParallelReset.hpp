@@ -0,0 +1,198 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/CounterDeferred.hpp>
+#include <pntr/SharedPtr.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         parallel_reset                                         //
+//                                                                                                //
+//            Resets a large range of shared pointers on several threads concurrently             //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The range is partitioned into one chunk per thread of the executor, but not smaller than
+//  's_parallel_reset_chunk' pointers. Each chunk is reset by a task which is passed to the
+//  executor, which is any callable that runs a 'void()' task, like the submit function of a thread
+//  pool or 'ThreadExecutor'. Its number of threads is returned by its member function
+//  'concurrency()', if it has one, otherwise it is the number of hardware threads. If the executor
+//  throws, the task is run by the calling thread. 'parallel_reset' returns when all pointers of
+//  the range have been reset.
+//
+//  The objects whose count reaches zero are disposed by the thread which released them. The
+//  optional predicate 'p_keep' selects the objects which must be destroyed by the calling thread,
+//  for example objects with thread affinity. It is called by the tasks, so it must not throw.
+//  The tasks move those pointers to a list without releasing them, and the calling thread
+//  releases them after all tasks have finished. If a pointer can't be moved to the list, the task
+//  leaves it in the range, and the calling thread resets the remaining pointers of the range.
+//
+
+// The minimum number of pointers in the chunk of one task.
+inline constexpr std::size_t s_parallel_reset_chunk = 16384u;
+
+
+// Runs each task on a new thread, and joins the threads when it is destroyed.
+class ThreadExecutor
+{
+public:
+  explicit ThreadExecutor(std::size_t const p_concurrency = std::thread::hardware_concurrency()) noexcept
+  : m_concurrency(std::max<std::size_t>(1u, p_concurrency))
+  {}
+
+  ThreadExecutor(ThreadExecutor const &) = delete;
+  ThreadExecutor & operator=(ThreadExecutor const &) = delete;
+
+  ~ThreadExecutor()
+  {
+    for (std::thread & thread : m_threads)
+    {
+      thread.join();
+    }
+  }
+
+  // Throws 'std::system_error' if the thread can't be started.
+  template<class t_task>
+  void
+  operator()(t_task && p_task)
+  {
+    m_threads.emplace_back(std::forward<t_task>(p_task));
+  }
+
+  // The number of tasks which the range is partitioned into.
+  std::size_t
+  concurrency() const noexcept
+  {
+    return m_concurrency;
+  }
+
+private:
+  std::size_t m_concurrency;
+  std::vector<std::thread> m_threads;
+};
+
+
+namespace detail
+{
+  template<class t_executor, typename = void>
+  struct ExecutorConcurrency
+  {
+    static std::size_t
+    get(t_executor const &) noexcept
+    {
+      return std::max(1u, std::thread::hardware_concurrency());
+    }
+  };
+
+  template<class t_executor>
+  struct ExecutorConcurrency<t_executor, std::void_t<decltype(std::declval<t_executor const &>().concurrency())>>
+  {
+    static std::size_t
+    get(t_executor const & p_executor) noexcept
+    {
+      return std::max<std::size_t>(1u, p_executor.concurrency());
+    }
+  };
+} // namespace detail
+
+
+template<class t_iterator, class t_executor, class t_keep>
+void
+parallel_reset(t_iterator const p_first, t_iterator const p_last, t_executor && p_executor, t_keep && p_keep)
+{
+  using Pointer = typename std::iterator_traits<t_iterator>::value_type;
+  using Shared = typename Pointer::element_type;
+  static_assert(std::is_nothrow_invocable_v<t_keep &, Shared const &>, "The predicate must be noexcept");
+
+  std::size_t const size = static_cast<std::size_t>(std::distance(p_first, p_last));
+  std::size_t const threads = detail::ExecutorConcurrency<std::remove_reference_t<t_executor>>::get(p_executor);
+  std::size_t const tasks = std::max<std::size_t>(1u, std::min(threads, size / s_parallel_reset_chunk));
+  std::vector<std::vector<Pointer>> kept(tasks);
+
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::size_t remaining = tasks;
+  std::atomic<bool> left{false};
+
+  auto reset = [&](std::size_t const p_task) noexcept
+  {
+    t_iterator const begin = std::next(p_first, static_cast<std::ptrdiff_t>(size * p_task / tasks));
+    t_iterator const end = std::next(p_first, static_cast<std::ptrdiff_t>(size * (p_task + 1u) / tasks));
+    for (t_iterator it = begin; it != end; ++it)
+    {
+      if (*it != nullptr && p_keep(*(*it)))
+      {
+        try
+        {
+          kept[p_task].push_back(std::move(*it));
+        }
+        catch (...) // The object is released by the calling thread
+        {
+          left.store(true, std::memory_order_relaxed);
+          continue;
+        }
+      }
+      it->reset();
+    }
+    if constexpr (detail::is_deferred<Shared>)
+    {
+      flush_deferred();
+    }
+    std::lock_guard<std::mutex> const lock(mutex);
+    if (--remaining == 0u)
+    {
+      finished.notify_one();
+    }
+  };
+
+  // The calling thread resets the first chunk itself.
+  for (std::size_t task = 1u; task < tasks; ++task)
+  {
+    try
+    {
+      p_executor([&reset, task]() noexcept { reset(task); });
+    }
+    catch (...)
+    {
+      reset(task);
+    }
+  }
+  reset(0u);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [&remaining]() noexcept { return remaining == 0u; });
+  lock.unlock();
+  if (left.load(std::memory_order_relaxed))
+  {
+    std::for_each(p_first, p_last, [](Pointer & p_pointer) noexcept { p_pointer.reset(); });
+  }
+}
+
+
+template<class t_iterator, class t_executor>
+void
+parallel_reset(t_iterator const p_first, t_iterator const p_last, t_executor && p_executor)
+{
+  using Pointer = typename std::iterator_traits<t_iterator>::value_type;
+  parallel_reset(p_first, p_last, std::forward<t_executor>(p_executor),
+                 [](typename Pointer::element_type const &) noexcept { return false; });
+}
+
+
+PNTR_NAMESPACE_END
@@ -0,0 +1,938 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/detail/PersistentNode.hpp>
+
+#include <array>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         PersistentMap                                          //
+//                                                                                                //
+//      An immutable hash map with structural sharing, built from intrusive variable-size nodes     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'PersistentMap' is a compressed hash array mapped trie (CHAMP). Every node uses 5 bits of the
+//  hash value and stores two bitmaps, one for the entries and one for the sub-nodes stored inline
+//  behind the node header, so a node only allocates the memory it actually needs. Keys with equal
+//  hash values end up in collision nodes below the last level. All modifying functions are 'const'
+//  and return a new map which shares all unmodified nodes with the original one.
+//
+//  The nodes derive from 'Intruder' using 'ControlAlloc' without weak, offset, size or alignment
+//  bits, like the nodes of 'PersistentVector'. Because their size varies, they are allocated
+//  directly with the allocator, which therefore has to be an empty class using
+//  'PointerDeallocate', like 'AllocatorMalloc'.
+//
+//  The hash and key equal function objects are default constructed when they are used.
+//
+//  'Transient' is a mutable builder, see 'PersistentVector'.
+//
+
+template<typename t_key,
+         typename t_value,
+         class t_hash = std::hash<t_key>,
+         class t_key_equal = std::equal_to<t_key>,
+         class t_thread_safety = std::true_type,
+         typename t_control_value = std::uint8_t,
+         class t_allocator = AllocatorMalloc<NoStaticSupport>>
+class PersistentMap
+{
+public:
+  using key_type = t_key;
+  using mapped_type = t_value;
+  using value_type = std::pair<t_key, t_value>;
+  using size_type = std::size_t;
+
+private:
+  static_assert(std::is_empty_v<t_allocator> && detail::HasPointerDeallocate<t_allocator>::value,
+                "The nodes are allocated with an empty allocator using 'PointerDeallocate'");
+  static_assert(alignof(value_type) <= alignof(std::max_align_t));
+
+  static constexpr unsigned s_bits = 5u;
+  static constexpr unsigned s_hash_bits = std::numeric_limits<std::size_t>::digits;
+  static constexpr unsigned s_max_depth = (s_hash_bits + s_bits - 1u) / s_bits + 1u;
+
+  class Node;
+  using NodePtr = SharedPtr<Node>;
+
+  // The header of a node, followed by its sub-nodes and entries. Nodes below the last hash level
+  // are collision nodes, which don't use the bitmaps and only store entries.
+  class Node: public detail::PersistentIntruder<Node, t_thread_safety, t_control_value, t_allocator>
+  {
+  public:
+    Node(std::uint32_t const p_datamap, std::uint32_t const p_nodemap, unsigned const p_node_count) noexcept
+    : m_node_count(static_cast<std::uint8_t>(p_node_count))
+    , m_datamap(p_datamap)
+    , m_nodemap(p_nodemap)
+    {
+      for (unsigned i = 0u; i < m_node_count; ++i)
+      {
+        new (children() + i) NodePtr();
+      }
+    }
+
+    ~Node() noexcept
+    {
+      for (unsigned i = 0u; i < m_data_count; ++i)
+      {
+        entries()[i].~value_type();
+      }
+      for (unsigned i = 0u; i < m_node_count; ++i)
+      {
+        children()[i].~NodePtr();
+      }
+    }
+
+    Node(Node const &) = delete;
+    Node & operator=(Node const &) = delete;
+
+    static std::size_t
+    calc_size(unsigned const p_data_count, unsigned const p_node_count) noexcept
+    {
+      return calc_entries_offset(p_node_count) + p_data_count * sizeof(value_type);
+    }
+
+    unsigned
+    data_count() const noexcept
+    {
+      return m_data_count;
+    }
+
+    unsigned
+    node_count() const noexcept
+    {
+      return m_node_count;
+    }
+
+    std::uint32_t
+    datamap() const noexcept
+    {
+      return m_datamap;
+    }
+
+    std::uint32_t
+    nodemap() const noexcept
+    {
+      return m_nodemap;
+    }
+
+    NodePtr *
+    children() noexcept
+    {
+      return std::launder(reinterpret_cast<NodePtr *>(reinterpret_cast<std::byte *>(this) + calc_children_offset()));
+    }
+
+    NodePtr const *
+    children() const noexcept
+    {
+      return std::launder(
+        reinterpret_cast<NodePtr const *>(reinterpret_cast<std::byte const *>(this) + calc_children_offset()));
+    }
+
+    value_type *
+    entries() noexcept
+    {
+      return std::launder(
+        reinterpret_cast<value_type *>(reinterpret_cast<std::byte *>(this) + calc_entries_offset(m_node_count)));
+    }
+
+    value_type const *
+    entries() const noexcept
+    {
+      return std::launder(reinterpret_cast<value_type const *>(reinterpret_cast<std::byte const *>(this)
+                                                               + calc_entries_offset(m_node_count)));
+    }
+
+    // Construct the next entry. The caller has to make sure that there is enough space.
+    template<typename... t_args>
+    void
+    emplace_entry(t_args &&... p_args)
+    {
+      new (reinterpret_cast<std::byte *>(this) + calc_entries_offset(m_node_count) + m_data_count * sizeof(value_type))
+        value_type(std::forward<t_args>(p_args)...);
+      ++m_data_count;
+    }
+
+  private:
+    static constexpr std::size_t
+    calc_entries_offset(unsigned const p_node_count) noexcept
+    {
+      return detail::align_up(calc_children_offset() + p_node_count * sizeof(NodePtr), alignof(value_type));
+    }
+
+    static constexpr std::size_t
+    calc_children_offset() noexcept
+    {
+      return detail::align_up(sizeof(Node), alignof(NodePtr));
+    }
+
+    std::uint8_t m_node_count;
+    std::uint16_t m_data_count{};
+    std::uint32_t m_datamap;
+    std::uint32_t m_nodemap;
+  };
+
+  static constexpr unsigned s_none = std::numeric_limits<unsigned>::max();
+
+  static constexpr std::size_t s_node_align =
+    (alignof(value_type) > alignof(NodePtr) ? alignof(value_type) : alignof(NodePtr));
+
+  // The complete state of a map.
+  struct State
+  {
+    std::size_t m_size{};
+    NodePtr m_root;
+  };
+
+  static std::size_t
+  hash(t_key const & p_key)
+  {
+    return static_cast<std::size_t>(t_hash()(p_key));
+  }
+
+  static std::uint32_t
+  bit_for(std::size_t const p_hash, unsigned const p_shift) noexcept
+  {
+    return std::uint32_t{1u} << ((p_hash >> p_shift) & 31u);
+  }
+
+  static unsigned
+  index_for(std::uint32_t const p_bitmap, std::uint32_t const p_bit) noexcept
+  {
+    return detail::popcount(p_bitmap & (p_bit - 1u));
+  }
+
+  // Share a node, or a copy of it if its usage counter is close to saturation.
+  static NodePtr
+  share(NodePtr const & p_node)
+  {
+    if (!p_node || detail::persistent_can_share<t_thread_safety>(*p_node))
+    {
+      return p_node;
+    }
+    return clone(*p_node);
+  }
+
+  // Allocate a node, take control of it, and let the callback fill in its children and entries.
+  // If the callback throws, the partially filled node is released again.
+  template<class t_fill>
+  static NodePtr
+  create(std::uint32_t const p_datamap, std::uint32_t const p_nodemap, unsigned const p_data_count,
+         unsigned const p_node_count, t_fill && p_fill)
+  {
+    void * const storage = t_allocator().allocate(Node::calc_size(p_data_count, p_node_count), s_node_align);
+    if (storage == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    NodePtr node(new (storage) Node(p_datamap, p_nodemap, p_node_count));
+    p_fill(*node);
+    PNTR_ASSERT(node->data_count() == p_data_count);
+    return node;
+  }
+
+  // Create a copy of a node which shares its children.
+  static NodePtr
+  clone(Node const & p_node)
+  {
+    return create(p_node.datamap(), p_node.nodemap(), p_node.data_count(), p_node.node_count(),
+                  [&p_node](Node & p_new)
+                  {
+                    for (unsigned i = 0u; i < p_node.node_count(); ++i)
+                    {
+                      p_new.children()[i] = share(p_node.children()[i]);
+                    }
+                    for (unsigned i = 0u; i < p_node.data_count(); ++i)
+                    {
+                      p_new.emplace_entry(p_node.entries()[i]);
+                    }
+                  });
+  }
+
+  // Copy or move the entries and children of a node into a new node, skipping and inserting at
+  // most one entry or child. Exclusively owned nodes are moved from, but entries only if that can't
+  // throw. Entries have to be transferred before the children, so the original node stays intact
+  // if creating its replacement fails.
+  class Transfer
+  {
+  public:
+    explicit Transfer(NodePtr & p_node) noexcept
+    : m_node(*p_node)
+    , m_exclusive(detail::persistent_is_exclusive<t_thread_safety>(*p_node))
+    , m_move_entries(m_exclusive && std::is_nothrow_move_constructible_v<value_type>)
+    {}
+
+    bool
+    move_entries() const noexcept
+    {
+      return m_move_entries;
+    }
+
+    void
+    entries(Node & p_new, unsigned const p_skip) const
+    {
+      entries(p_new, p_skip, s_none, nullptr);
+    }
+
+    // The inserted entry is moved if it is an rvalue. Passing 'nullptr' doesn't insert an entry.
+    template<class t_entry>
+    void
+    entries(Node & p_new, unsigned const p_skip, unsigned const p_insert, t_entry && p_entry) const
+    {
+      for (unsigned i = 0u; i <= m_node.data_count(); ++i)
+      {
+        if constexpr (!std::is_null_pointer_v<std::decay_t<t_entry>>)
+        {
+          if (i == p_insert)
+          {
+            p_new.emplace_entry(std::forward<t_entry>(p_entry));
+          }
+        }
+        if (i < m_node.data_count() && i != p_skip)
+        {
+          if (m_move_entries)
+          {
+            p_new.emplace_entry(std::move(m_node.entries()[i]));
+          }
+          else
+          {
+            p_new.emplace_entry(m_node.entries()[i]);
+          }
+        }
+      }
+    }
+
+    void
+    children(Node & p_new,
+             unsigned const p_skip,
+             unsigned const p_insert = s_none,
+             NodePtr && p_child = NodePtr()) const
+    {
+      unsigned target = 0u;
+      for (unsigned i = 0u; i <= m_node.node_count(); ++i)
+      {
+        if (i == p_insert)
+        {
+          p_new.children()[target++] = std::move(p_child);
+        }
+        if (i < m_node.node_count() && i != p_skip)
+        {
+          p_new.children()[target++] = (m_exclusive ? std::move(m_node.children()[i]) : share(m_node.children()[i]));
+        }
+      }
+    }
+
+  private:
+    Node & m_node;
+    bool const m_exclusive;
+    bool const m_move_entries;
+  };
+
+  // Return a reference to a node which can be modified in place, copying it if it is shared.
+  static Node &
+  edit(NodePtr & p_node)
+  {
+    if (!detail::persistent_is_exclusive<t_thread_safety>(*p_node))
+    {
+      p_node = clone(*p_node);
+    }
+    return *p_node;
+  }
+
+  // Create a node storing a copy of the existing entry and the new entry, or a chain of nodes down
+  // to the level where their hash values differ.
+  static NodePtr
+  merge(unsigned const p_shift, value_type const & p_entry, std::size_t const p_entry_hash, value_type && p_new_entry,
+        std::size_t const p_hash)
+  {
+    if (p_shift >= s_hash_bits)
+    {
+      return create(0u, 0u, 2u, 0u,
+                    [&](Node & p_new)
+                    {
+                      p_new.emplace_entry(p_entry);
+                      p_new.emplace_entry(std::move(p_new_entry));
+                    });
+    }
+    std::uint32_t const entry_bit = bit_for(p_entry_hash, p_shift);
+    std::uint32_t const bit = bit_for(p_hash, p_shift);
+    if (entry_bit == bit)
+    {
+      NodePtr child = merge(p_shift + s_bits, p_entry, p_entry_hash, std::move(p_new_entry), p_hash);
+      return create(0u, bit, 0u, 1u,
+                    [&child](Node & p_new)
+                    {
+                      p_new.children()[0u] = std::move(child);
+                    });
+    }
+    return create(entry_bit | bit, 0u, 2u, 0u,
+                  [&](Node & p_new)
+                  {
+                    if (entry_bit < bit)
+                    {
+                      p_new.emplace_entry(p_entry);
+                      p_new.emplace_entry(std::move(p_new_entry));
+                    }
+                    else
+                    {
+                      p_new.emplace_entry(std::move(p_new_entry));
+                      p_new.emplace_entry(p_entry);
+                    }
+                  });
+  }
+
+  static value_type const *
+  find(State const & p_state, t_key const & p_key)
+  {
+    if (!p_state.m_root)
+    {
+      return nullptr;
+    }
+    std::size_t const key_hash = hash(p_key);
+    Node const * node = p_state.m_root.get();
+    for (unsigned shift = 0u;; shift += s_bits)
+    {
+      if (shift >= s_hash_bits)
+      {
+        for (unsigned i = 0u; i < node->data_count(); ++i)
+        {
+          if (t_key_equal()(node->entries()[i].first, p_key))
+          {
+            return &node->entries()[i];
+          }
+        }
+        return nullptr;
+      }
+      std::uint32_t const bit = bit_for(key_hash, shift);
+      if ((node->datamap() & bit) != 0u)
+      {
+        value_type const & entry = node->entries()[index_for(node->datamap(), bit)];
+        return (t_key_equal()(entry.first, p_key) ? &entry : nullptr);
+      }
+      if ((node->nodemap() & bit) == 0u)
+      {
+        return nullptr;
+      }
+      node = node->children()[index_for(node->nodemap(), bit)].get();
+    }
+  }
+
+  // The modifying algorithms, which are shared by persistent maps and transients, see
+  // 'PersistentVector'.
+  struct Modifier: State
+  {
+    Modifier() noexcept = default;
+
+    Modifier(State && p_state) noexcept
+    : State(std::move(p_state))
+    {}
+
+    // Insert or assign a value and return true if the key was inserted.
+    template<typename t_forward_key, typename t_forward_value>
+    bool
+    set(t_forward_key && p_key, t_forward_value && p_value)
+    {
+      value_type const * const entry = find(*this, p_key);
+      if (entry != nullptr)
+      {
+        assign(this->m_root, 0u, hash(entry->first), entry->first, std::forward<t_forward_value>(p_value));
+        return false;
+      }
+      value_type new_entry(std::forward<t_forward_key>(p_key), std::forward<t_forward_value>(p_value));
+      std::size_t const key_hash = hash(new_entry.first);
+      if (!this->m_root)
+      {
+        this->m_root = create(bit_for(key_hash, 0u), 0u, 1u, 0u,
+                              [&new_entry](Node & p_new)
+                              {
+                                p_new.emplace_entry(std::move(new_entry));
+                              });
+      }
+      else
+      {
+        insert(this->m_root, 0u, key_hash, std::move(new_entry));
+      }
+      ++this->m_size;
+      return true;
+    }
+
+    // Remove a key and return true if it was found.
+    bool
+    erase(t_key const & p_key)
+    {
+      if (find(*this, p_key) == nullptr)
+      {
+        return false;
+      }
+      erase(this->m_root, 0u, hash(p_key), p_key);
+      Node const & root = *this->m_root;
+      if (root.data_count() == 0u && root.node_count() == 0u)
+      {
+        this->m_root.reset();
+      }
+      --this->m_size;
+      return true;
+    }
+
+  private:
+    // Assign a value to a key, which has to exist below the given node.
+    template<typename t_forward_value>
+    static void
+    assign(NodePtr & p_node, unsigned const p_shift, std::size_t const p_hash, t_key const & p_key,
+           t_forward_value && p_value)
+    {
+      Node & node = edit(p_node);
+      if (p_shift >= s_hash_bits)
+      {
+        for (unsigned i = 0u; i < node.data_count(); ++i)
+        {
+          if (t_key_equal()(node.entries()[i].first, p_key))
+          {
+            node.entries()[i].second = std::forward<t_forward_value>(p_value);
+            return;
+          }
+        }
+        return;
+      }
+      std::uint32_t const bit = bit_for(p_hash, p_shift);
+      if ((node.datamap() & bit) != 0u)
+      {
+        node.entries()[index_for(node.datamap(), bit)].second = std::forward<t_forward_value>(p_value);
+        return;
+      }
+      assign(node.children()[index_for(node.nodemap(), bit)], p_shift + s_bits, p_hash, p_key,
+             std::forward<t_forward_value>(p_value));
+    }
+
+    // Insert an entry with a key which doesn't exist yet below the given node.
+    static void
+    insert(NodePtr & p_node, unsigned const p_shift, std::size_t const p_hash, value_type && p_entry)
+    {
+      Node & node = *p_node;
+      if (p_shift >= s_hash_bits)
+      {
+        Transfer const transfer(p_node);
+        p_node = create(0u, 0u, node.data_count() + 1u, 0u,
+                        [&](Node & p_new)
+                        {
+                          transfer.entries(p_new, s_none, node.data_count(), std::move(p_entry));
+                        });
+        return;
+      }
+      std::uint32_t const bit = bit_for(p_hash, p_shift);
+      if ((node.datamap() & bit) != 0u)
+      {
+        // Replace the existing entry with a sub-node storing both entries.
+        unsigned const index = index_for(node.datamap(), bit);
+        value_type const & entry = node.entries()[index];
+        NodePtr child = merge(p_shift + s_bits, entry, hash(entry.first), std::move(p_entry), p_hash);
+        Transfer const transfer(p_node);
+        p_node = create(node.datamap() & ~bit, node.nodemap() | bit, node.data_count() - 1u, node.node_count() + 1u,
+                        [&](Node & p_new)
+                        {
+                          transfer.entries(p_new, index);
+                          transfer.children(p_new, s_none, index_for(node.nodemap(), bit), std::move(child));
+                        });
+        return;
+      }
+      if ((node.nodemap() & bit) != 0u)
+      {
+        Node & editable = edit(p_node);
+        insert(editable.children()[index_for(editable.nodemap(), bit)], p_shift + s_bits, p_hash, std::move(p_entry));
+        return;
+      }
+      Transfer const transfer(p_node);
+      p_node = create(node.datamap() | bit, node.nodemap(), node.data_count() + 1u, node.node_count(),
+                      [&](Node & p_new)
+                      {
+                        transfer.entries(p_new, s_none, index_for(node.datamap(), bit), std::move(p_entry));
+                        transfer.children(p_new, s_none);
+                      });
+    }
+
+    // Remove a key, which has to exist below the given node.
+    static void
+    erase(NodePtr & p_node, unsigned const p_shift, std::size_t const p_hash, t_key const & p_key)
+    {
+      Node & node = *p_node;
+      if (p_shift >= s_hash_bits)
+      {
+        unsigned index = 0u;
+        while (!t_key_equal()(node.entries()[index].first, p_key))
+        {
+          ++index;
+        }
+        Transfer const transfer(p_node);
+        p_node = create(0u, 0u, node.data_count() - 1u, 0u,
+                        [&](Node & p_new)
+                        {
+                          transfer.entries(p_new, index);
+                        });
+        return;
+      }
+      std::uint32_t const bit = bit_for(p_hash, p_shift);
+      if ((node.datamap() & bit) != 0u)
+      {
+        unsigned const index = index_for(node.datamap(), bit);
+        Transfer const transfer(p_node);
+        p_node = create(node.datamap() & ~bit, node.nodemap(), node.data_count() - 1u, node.node_count(),
+                        [&](Node & p_new)
+                        {
+                          transfer.entries(p_new, index);
+                          transfer.children(p_new, s_none);
+                        });
+        return;
+      }
+      Node & editable = edit(p_node);
+      unsigned const child_index = index_for(editable.nodemap(), bit);
+      NodePtr & child = editable.children()[child_index];
+      erase(child, p_shift + s_bits, p_hash, p_key);
+
+      // Keep the trie canonical by pulling a single remaining entry of a sub-node up.
+      if (child->data_count() != 1u || child->node_count() != 0u)
+      {
+        return;
+      }
+      Transfer const transfer(p_node);
+      Transfer const child_transfer(child);
+      unsigned const insert = index_for(editable.datamap(), bit);
+      p_node = create(editable.datamap() | bit, editable.nodemap() & ~bit, editable.data_count() + 1u,
+                      editable.node_count() - 1u,
+                      [&](Node & p_new)
+                      {
+                        if (child_transfer.move_entries())
+                        {
+                          transfer.entries(p_new, s_none, insert, std::move(child->entries()[0u]));
+                        }
+                        else
+                        {
+                          transfer.entries(p_new, s_none, insert, std::as_const(child->entries()[0u]));
+                        }
+                        transfer.children(p_new, child_index);
+                      });
+    }
+  };
+
+public:
+  class Transient;
+
+  // A forward iterator, which visits the entries of each node before its sub-nodes.
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename PersistentMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type const *;
+    using reference = value_type const &;
+
+    const_iterator() noexcept = default;
+
+    reference
+    operator*() const noexcept
+    {
+      return *m_current;
+    }
+
+    pointer
+    operator->() const noexcept
+    {
+      return m_current;
+    }
+
+    const_iterator &
+    operator++() noexcept
+    {
+      advance();
+      return *this;
+    }
+
+    const_iterator
+    operator++(int) noexcept
+    {
+      const_iterator result(*this);
+      advance();
+      return result;
+    }
+
+    friend bool
+    operator==(const_iterator const & p_left, const_iterator const & p_right) noexcept
+    {
+      return (p_left.m_current == p_right.m_current);
+    }
+
+    friend bool
+    operator!=(const_iterator const & p_left, const_iterator const & p_right) noexcept
+    {
+      return (p_left.m_current != p_right.m_current);
+    }
+
+  private:
+    struct Frame
+    {
+      Node const * m_node;
+      unsigned m_entry;
+      unsigned m_child;
+    };
+
+    explicit const_iterator(Node const * const p_root) noexcept
+    {
+      if (p_root != nullptr)
+      {
+        m_stack[0u] = Frame{p_root, 0u, 0u};
+        m_depth = 1u;
+        advance();
+      }
+    }
+
+    void
+    advance() noexcept
+    {
+      m_current = nullptr;
+      while (m_depth > 0u)
+      {
+        Frame & frame = m_stack[m_depth - 1u];
+        if (frame.m_entry < frame.m_node->data_count())
+        {
+          m_current = &frame.m_node->entries()[frame.m_entry++];
+          return;
+        }
+        if (frame.m_child < frame.m_node->node_count())
+        {
+          m_stack[m_depth++] = Frame{frame.m_node->children()[frame.m_child++].get(), 0u, 0u};
+        }
+        else
+        {
+          --m_depth;
+        }
+      }
+    }
+
+    std::array<Frame, s_max_depth> m_stack{};
+    unsigned m_depth{};
+    value_type const * m_current{};
+
+    friend class PersistentMap;
+  };
+
+  using iterator = const_iterator;
+
+  PersistentMap() noexcept = default;
+
+  PersistentMap(std::initializer_list<value_type> p_values)
+  {
+    Transient transient;
+    for (value_type const & value: p_values)
+    {
+      transient.set(value.first, value.second);
+    }
+    *this = std::move(transient).persistent();
+  }
+
+  PersistentMap(PersistentMap const & p_other)
+  : m_state(copy(p_other.m_state))
+  {}
+
+  PersistentMap(PersistentMap && p_other) noexcept
+  : m_state(std::exchange(p_other.m_state, State()))
+  {}
+
+  PersistentMap &
+  operator=(PersistentMap const & p_other)
+  {
+    PersistentMap(p_other).swap(*this);
+    return *this;
+  }
+
+  PersistentMap &
+  operator=(PersistentMap && p_other) noexcept
+  {
+    PersistentMap(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  size_type
+  size() const noexcept
+  {
+    return m_state.m_size;
+  }
+
+  bool
+  empty() const noexcept
+  {
+    return (m_state.m_size == 0u);
+  }
+
+  // Return a pointer to the value of the given key, or nullptr if it doesn't exist.
+  t_value const *
+  find(t_key const & p_key) const
+  {
+    value_type const * const entry = find(m_state, p_key);
+    return (entry != nullptr ? &entry->second : nullptr);
+  }
+
+  bool
+  contains(t_key const & p_key) const
+  {
+    return (find(m_state, p_key) != nullptr);
+  }
+
+  t_value const &
+  at(t_key const & p_key) const
+  {
+    value_type const * const entry = find(m_state, p_key);
+    if (entry == nullptr)
+    {
+      throw std::out_of_range("PersistentMap::at");
+    }
+    return entry->second;
+  }
+
+  const_iterator
+  begin() const noexcept
+  {
+    return const_iterator(m_state.m_root.get());
+  }
+
+  const_iterator
+  end() const noexcept
+  {
+    return const_iterator();
+  }
+
+  // Return a map with the given value inserted or assigned.
+  template<typename t_forward_key, typename t_forward_value>
+  PersistentMap
+  set(t_forward_key && p_key, t_forward_value && p_value) const
+  {
+    PersistentMap result(*this);
+    result.m_state.set(std::forward<t_forward_key>(p_key), std::forward<t_forward_value>(p_value));
+    return result;
+  }
+
+  // Return a map without the given key.
+  PersistentMap
+  erase(t_key const & p_key) const
+  {
+    if (!contains(p_key))
+    {
+      return *this;
+    }
+    PersistentMap result(*this);
+    result.m_state.erase(p_key);
+    return result;
+  }
+
+  // Return a mutable builder which starts with the entries of this map.
+  Transient
+  transient() const
+  {
+    return Transient(*this);
+  }
+
+  void
+  swap(PersistentMap & p_other) noexcept
+  {
+    std::swap(m_state.m_size, p_other.m_state.m_size);
+    m_state.m_root.swap(p_other.m_state.m_root);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //                                         Transient                                          //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  class Transient
+  {
+  public:
+    Transient() noexcept = default;
+
+    explicit Transient(PersistentMap const & p_map)
+    : m_state(copy(p_map.m_state))
+    {}
+
+    Transient(Transient && p_other) noexcept
+    : m_state(std::exchange(p_other.m_state, State()))
+    {}
+
+    Transient &
+    operator=(Transient && p_other) noexcept
+    {
+      m_state = std::exchange(p_other.m_state, State());
+      return *this;
+    }
+
+    Transient(Transient const &) = delete;
+    Transient & operator=(Transient const &) = delete;
+
+    size_type
+    size() const noexcept
+    {
+      return m_state.m_size;
+    }
+
+    bool
+    empty() const noexcept
+    {
+      return (m_state.m_size == 0u);
+    }
+
+    t_value const *
+    find(t_key const & p_key) const
+    {
+      value_type const * const entry = PersistentMap::find(m_state, p_key);
+      return (entry != nullptr ? &entry->second : nullptr);
+    }
+
+    // Insert or assign a value and return true if the key was inserted.
+    template<typename t_forward_key, typename t_forward_value>
+    bool
+    set(t_forward_key && p_key, t_forward_value && p_value)
+    {
+      return m_state.set(std::forward<t_forward_key>(p_key), std::forward<t_forward_value>(p_value));
+    }
+
+    // Remove a key and return true if it was found.
+    bool
+    erase(t_key const & p_key)
+    {
+      return m_state.erase(p_key);
+    }
+
+    // Return a persistent map with the entries of this builder, which is empty afterwards.
+    PersistentMap
+    persistent() &&
+    {
+      PersistentMap result;
+      result.m_state = std::exchange(m_state, State());
+      return result;
+    }
+
+  private:
+    Modifier m_state;
+  };
+
+private:
+  static State
+  copy(State const & p_state)
+  {
+    return State{p_state.m_size, share(p_state.m_root)};
+  }
+
+  Modifier m_state;
+};
+
+
+PNTR_NAMESPACE_END
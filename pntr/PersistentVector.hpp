@@ -0,0 +1,771 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/detail/PersistentNode.hpp>
+
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        PersistentVector                                        //
+//                                                                                                //
+//          An immutable vector with structural sharing, built from intrusive tree nodes          //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'PersistentVector' is a bit-partitioned vector trie with a branching factor of 32 and a separate
+//  tail leaf, as popularized by Clojure. All modifying functions are 'const' and return a new
+//  vector which shares all unmodified nodes with the original one, so copies are cheap and
+//  different versions can be used safely from different threads if 't_thread_safety' is
+//  'std::true_type'.
+//
+//  The tree nodes derive from 'Intruder' using 'ControlAlloc' without weak, offset, size or
+//  alignment bits, so the control block is just a usage counter of type 't_control_value'. The
+//  default of 'std::uint8_t' adds only one byte per node. A node whose counter gets close to its
+//  maximum is copied instead of being shared, so small counters can't overflow.
+//
+//  'Transient' is a mutable builder, which modifies nodes in place as long as it holds the only
+//  reference to them. Nodes which are shared with other vectors are copied on the first write,
+//  so a transient never modifies a node which is visible through a persistent vector.
+//
+
+template<typename t_value,
+         class t_thread_safety = std::true_type,
+         typename t_control_value = std::uint8_t,
+         class t_allocator = AllocatorMalloc<NoStaticSupport>>
+class PersistentVector
+{
+  static constexpr unsigned s_bits = 5u;
+  static constexpr std::size_t s_width = std::size_t{1u} << s_bits;
+  static constexpr std::size_t s_mask = s_width - 1u;
+
+  class Leaf;
+  class Branch;
+  using LeafPtr = SharedPtr<Leaf>;
+  using BranchPtr = SharedPtr<Branch>;
+
+  // A leaf stores up to 's_width' values.
+  class Leaf: public detail::PersistentIntruder<Leaf, t_thread_safety, t_control_value, t_allocator>
+  {
+  public:
+    Leaf() noexcept = default;
+
+    // Delegating to the default constructor makes sure that the destructor is called on exceptions.
+    Leaf(Leaf const & p_other)
+    : Leaf()
+    {
+      for (; m_size < p_other.m_size; ++m_size)
+      {
+        new (data() + m_size) t_value(p_other.data()[m_size]);
+      }
+    }
+
+    ~Leaf() noexcept
+    {
+      clear();
+    }
+
+    Leaf & operator=(Leaf const &) = delete;
+
+    t_value *
+    data() noexcept
+    {
+      return std::launder(reinterpret_cast<t_value *>(&m_storage));
+    }
+
+    t_value const *
+    data() const noexcept
+    {
+      return std::launder(reinterpret_cast<t_value const *>(&m_storage));
+    }
+
+    template<typename... t_args>
+    void
+    emplace_back(t_args &&... p_args)
+    {
+      PNTR_ASSERT(m_size < s_width);
+      new (data() + m_size) t_value(std::forward<t_args>(p_args)...);
+      ++m_size;
+    }
+
+    void
+    pop_back() noexcept
+    {
+      --m_size;
+      data()[m_size].~t_value();
+    }
+
+  private:
+    void
+    clear() noexcept
+    {
+      while (m_size > 0u)
+      {
+        pop_back();
+      }
+    }
+
+    std::uint8_t m_size{};
+    alignas(t_value) std::byte m_storage[s_width * sizeof(t_value)];
+  };
+
+  // A branch stores up to 's_width' children, which are either all leaves or all branches.
+  class Branch: public detail::PersistentIntruder<Branch, t_thread_safety, t_control_value, t_allocator>
+  {
+  public:
+    explicit Branch(bool const p_leaves) noexcept
+    : m_leaves(p_leaves)
+    {
+      // The storage is sized for leaf pointers, which have to match branch pointers.
+      static_assert(sizeof(LeafPtr) == sizeof(BranchPtr) && alignof(LeafPtr) == alignof(BranchPtr));
+      for (std::size_t i = 0u; i < s_width; ++i)
+      {
+        if (m_leaves)
+        {
+          new (reinterpret_cast<LeafPtr *>(&m_storage) + i) LeafPtr();
+        }
+        else
+        {
+          new (reinterpret_cast<BranchPtr *>(&m_storage) + i) BranchPtr();
+        }
+      }
+    }
+
+    Branch(Branch const & p_other)
+    : Branch(p_other.m_leaves)
+    {
+      for (std::size_t i = 0u; i < s_width; ++i)
+      {
+        if (m_leaves)
+        {
+          leaf(i) = share(p_other.leaf(i));
+        }
+        else
+        {
+          branch(i) = share(p_other.branch(i));
+        }
+      }
+    }
+
+    ~Branch() noexcept
+    {
+      for (std::size_t i = 0u; i < s_width; ++i)
+      {
+        if (m_leaves)
+        {
+          leaf(i).~LeafPtr();
+        }
+        else
+        {
+          branch(i).~BranchPtr();
+        }
+      }
+    }
+
+    Branch & operator=(Branch const &) = delete;
+
+    LeafPtr &
+    leaf(std::size_t const p_index) noexcept
+    {
+      return std::launder(reinterpret_cast<LeafPtr *>(&m_storage))[p_index];
+    }
+
+    LeafPtr const &
+    leaf(std::size_t const p_index) const noexcept
+    {
+      return std::launder(reinterpret_cast<LeafPtr const *>(&m_storage))[p_index];
+    }
+
+    BranchPtr &
+    branch(std::size_t const p_index) noexcept
+    {
+      return std::launder(reinterpret_cast<BranchPtr *>(&m_storage))[p_index];
+    }
+
+    BranchPtr const &
+    branch(std::size_t const p_index) const noexcept
+    {
+      return std::launder(reinterpret_cast<BranchPtr const *>(&m_storage))[p_index];
+    }
+
+  private:
+    bool const m_leaves;
+    alignas(LeafPtr) std::byte m_storage[s_width * sizeof(LeafPtr)];
+  };
+
+  // The complete state of a vector. The last 1 to 's_width' values are stored in the tail leaf,
+  // all others in the tree below the root branch.
+  struct State
+  {
+    std::size_t m_size{};
+    unsigned m_shift{s_bits};
+    BranchPtr m_root;
+    LeafPtr m_tail;
+  };
+
+  // The modifying algorithms, which are shared by persistent vectors and transients. They work in
+  // place on exclusively owned nodes and copy all others, so a persistent vector only has to copy
+  // its state before applying them. On exceptions the state remains valid and unchanged, though
+  // some of its nodes might have been replaced by copies.
+  struct Modifier: State
+  {
+    Modifier() noexcept = default;
+
+    Modifier(State && p_state) noexcept
+    : State(std::move(p_state))
+    {}
+
+    template<typename... t_args>
+    void
+    emplace_back(t_args &&... p_args)
+    {
+      std::size_t const tail_size = this->m_size - tail_offset(this->m_size);
+      if (!this->m_tail)
+      {
+        LeafPtr tail = allocate_shared<Leaf>(t_allocator());
+        tail->emplace_back(std::forward<t_args>(p_args)...);
+        this->m_tail = std::move(tail);
+      }
+      else if (tail_size < s_width)
+      {
+        edit(this->m_tail).emplace_back(std::forward<t_args>(p_args)...);
+      }
+      else
+      {
+        LeafPtr tail = allocate_shared<Leaf>(t_allocator());
+        tail->emplace_back(std::forward<t_args>(p_args)...);
+        push_full_tail();
+        this->m_tail = std::move(tail);
+      }
+      ++this->m_size;
+    }
+
+    template<typename t_forward>
+    void
+    set(std::size_t const p_index, t_forward && p_value)
+    {
+      PNTR_ASSERT(p_index < this->m_size);
+      if (p_index >= tail_offset(this->m_size))
+      {
+        edit(this->m_tail).data()[p_index & s_mask] = std::forward<t_forward>(p_value);
+        return;
+      }
+      Branch * node = &edit(this->m_root);
+      for (unsigned level = this->m_shift; level > s_bits; level -= s_bits)
+      {
+        node = &edit(node->branch((p_index >> level) & s_mask));
+      }
+      edit(node->leaf((p_index >> s_bits) & s_mask)).data()[p_index & s_mask] = std::forward<t_forward>(p_value);
+    }
+
+    void
+    pop_back()
+    {
+      PNTR_ASSERT(this->m_size > 0u);
+      if (this->m_size == 1u)
+      {
+        static_cast<State &>(*this) = State();
+      }
+      else if (this->m_size - tail_offset(this->m_size) > 1u)
+      {
+        edit(this->m_tail).pop_back();
+        --this->m_size;
+      }
+      else
+      {
+        // The tail holds just one value, so the last leaf of the tree becomes the new tail.
+        LeafPtr tail = share(leaf_ptr_for(*this, this->m_size - 2u));
+        if (pop_tail(this->m_root, this->m_shift, this->m_size - 2u))
+        {
+          this->m_root.reset();
+          this->m_shift = s_bits;
+        }
+        else if (this->m_shift > s_bits && !this->m_root->branch(1u))
+        {
+          BranchPtr root = share(this->m_root->branch(0u));
+          this->m_root = std::move(root);
+          this->m_shift -= s_bits;
+        }
+        this->m_tail = std::move(tail);
+        --this->m_size;
+      }
+    }
+
+  private:
+    // Move the full tail into the tree, adding a new root level if the tree is full.
+    void
+    push_full_tail()
+    {
+      std::size_t const index = this->m_size - 1u;
+      if (!this->m_root)
+      {
+        BranchPtr root = allocate_shared<Branch>(t_allocator(), true);
+        root->leaf(0u) = std::move(this->m_tail);
+        this->m_root = std::move(root);
+      }
+      else if ((this->m_size >> s_bits) > (std::size_t{1u} << this->m_shift))
+      {
+        BranchPtr root = allocate_shared<Branch>(t_allocator(), false);
+        LeafPtr * slot = nullptr;
+        root->branch(1u) = new_path(this->m_shift, slot);
+        *slot = std::move(this->m_tail);
+        root->branch(0u) = std::move(this->m_root);
+        this->m_root = std::move(root);
+        this->m_shift += s_bits;
+      }
+      else
+      {
+        push_tail(this->m_root, this->m_shift, index, this->m_tail);
+      }
+    }
+  };
+
+public:
+  using value_type = t_value;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = t_value const &;
+  using const_reference = t_value const &;
+
+  class Transient;
+
+  // A forward iterator which caches the current leaf.
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = t_value;
+    using difference_type = std::ptrdiff_t;
+    using pointer = t_value const *;
+    using reference = t_value const &;
+
+    const_iterator() noexcept = default;
+
+    reference
+    operator*() const noexcept
+    {
+      return m_leaf->data()[m_index & s_mask];
+    }
+
+    pointer
+    operator->() const noexcept
+    {
+      return &**this;
+    }
+
+    const_iterator &
+    operator++() noexcept
+    {
+      ++m_index;
+      if ((m_index & s_mask) == 0u && m_index < m_state->m_size)
+      {
+        m_leaf = &leaf_for(*m_state, m_index);
+      }
+      return *this;
+    }
+
+    const_iterator
+    operator++(int) noexcept
+    {
+      const_iterator result(*this);
+      ++*this;
+      return result;
+    }
+
+    friend bool
+    operator==(const_iterator const & p_left, const_iterator const & p_right) noexcept
+    {
+      return (p_left.m_index == p_right.m_index);
+    }
+
+    friend bool
+    operator!=(const_iterator const & p_left, const_iterator const & p_right) noexcept
+    {
+      return (p_left.m_index != p_right.m_index);
+    }
+
+  private:
+    const_iterator(State const & p_state, std::size_t const p_index) noexcept
+    : m_state(&p_state)
+    , m_leaf(p_index < p_state.m_size ? &leaf_for(p_state, p_index) : nullptr)
+    , m_index(p_index)
+    {}
+
+    State const * m_state{};
+    Leaf const * m_leaf{};
+    std::size_t m_index{};
+
+    friend class PersistentVector;
+  };
+
+  using iterator = const_iterator;
+
+  PersistentVector() noexcept = default;
+
+  PersistentVector(std::initializer_list<t_value> p_values)
+  {
+    Transient transient;
+    for (t_value const & value: p_values)
+    {
+      transient.push_back(value);
+    }
+    *this = std::move(transient).persistent();
+  }
+
+  PersistentVector(PersistentVector const & p_other)
+  : m_state(copy(p_other.m_state))
+  {}
+
+  PersistentVector(PersistentVector && p_other) noexcept
+  : m_state(std::exchange(p_other.m_state, State()))
+  {}
+
+  PersistentVector &
+  operator=(PersistentVector const & p_other)
+  {
+    PersistentVector(p_other).swap(*this);
+    return *this;
+  }
+
+  PersistentVector &
+  operator=(PersistentVector && p_other) noexcept
+  {
+    PersistentVector(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  size_type
+  size() const noexcept
+  {
+    return m_state.m_size;
+  }
+
+  bool
+  empty() const noexcept
+  {
+    return (m_state.m_size == 0u);
+  }
+
+  const_reference
+  operator[](size_type const p_index) const noexcept
+  {
+    PNTR_ASSERT(p_index < m_state.m_size);
+    return leaf_for(m_state, p_index).data()[p_index & s_mask];
+  }
+
+  const_reference
+  at(size_type const p_index) const
+  {
+    if (p_index >= m_state.m_size)
+    {
+      throw std::out_of_range("PersistentVector::at");
+    }
+    return (*this)[p_index];
+  }
+
+  const_reference
+  front() const noexcept
+  {
+    return (*this)[0u];
+  }
+
+  const_reference
+  back() const noexcept
+  {
+    return (*this)[m_state.m_size - 1u];
+  }
+
+  const_iterator
+  begin() const noexcept
+  {
+    return const_iterator(m_state, 0u);
+  }
+
+  const_iterator
+  end() const noexcept
+  {
+    return const_iterator(m_state, m_state.m_size);
+  }
+
+  // Return a vector with the given value appended.
+  template<typename... t_args>
+  PersistentVector
+  emplace_back(t_args &&... p_args) const
+  {
+    PersistentVector result(*this);
+    result.m_state.emplace_back(std::forward<t_args>(p_args)...);
+    return result;
+  }
+
+  PersistentVector
+  push_back(t_value const & p_value) const
+  {
+    return emplace_back(p_value);
+  }
+
+  PersistentVector
+  push_back(t_value && p_value) const
+  {
+    return emplace_back(std::move(p_value));
+  }
+
+  // Return a vector with the value at the given index replaced.
+  template<typename t_forward>
+  PersistentVector
+  set(size_type const p_index, t_forward && p_value) const
+  {
+    PersistentVector result(*this);
+    result.m_state.set(p_index, std::forward<t_forward>(p_value));
+    return result;
+  }
+
+  // Return a vector without the last value.
+  PersistentVector
+  pop_back() const
+  {
+    PersistentVector result(*this);
+    result.m_state.pop_back();
+    return result;
+  }
+
+  // Return a mutable builder which starts with the values of this vector.
+  Transient
+  transient() const
+  {
+    return Transient(*this);
+  }
+
+  void
+  swap(PersistentVector & p_other) noexcept
+  {
+    std::swap(m_state.m_size, p_other.m_state.m_size);
+    std::swap(m_state.m_shift, p_other.m_state.m_shift);
+    m_state.m_root.swap(p_other.m_state.m_root);
+    m_state.m_tail.swap(p_other.m_state.m_tail);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //                                         Transient                                          //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  class Transient
+  {
+  public:
+    Transient() noexcept = default;
+
+    explicit Transient(PersistentVector const & p_vector)
+    : m_state(copy(p_vector.m_state))
+    {}
+
+    Transient(Transient && p_other) noexcept
+    : m_state(std::exchange(p_other.m_state, State()))
+    {}
+
+    Transient &
+    operator=(Transient && p_other) noexcept
+    {
+      m_state = std::exchange(p_other.m_state, State());
+      return *this;
+    }
+
+    Transient(Transient const &) = delete;
+    Transient & operator=(Transient const &) = delete;
+
+    size_type
+    size() const noexcept
+    {
+      return m_state.m_size;
+    }
+
+    bool
+    empty() const noexcept
+    {
+      return (m_state.m_size == 0u);
+    }
+
+    const_reference
+    operator[](size_type const p_index) const noexcept
+    {
+      PNTR_ASSERT(p_index < m_state.m_size);
+      return leaf_for(m_state, p_index).data()[p_index & s_mask];
+    }
+
+    template<typename... t_args>
+    void
+    emplace_back(t_args &&... p_args)
+    {
+      m_state.emplace_back(std::forward<t_args>(p_args)...);
+    }
+
+    void
+    push_back(t_value const & p_value)
+    {
+      m_state.emplace_back(p_value);
+    }
+
+    void
+    push_back(t_value && p_value)
+    {
+      m_state.emplace_back(std::move(p_value));
+    }
+
+    template<typename t_forward>
+    void
+    set(size_type const p_index, t_forward && p_value)
+    {
+      m_state.set(p_index, std::forward<t_forward>(p_value));
+    }
+
+    void
+    pop_back()
+    {
+      m_state.pop_back();
+    }
+
+    // Return a persistent vector with the values of this builder, which is empty afterwards.
+    PersistentVector
+    persistent() &&
+    {
+      PersistentVector result;
+      result.m_state = std::exchange(m_state, State());
+      return result;
+    }
+
+  private:
+    Modifier m_state;
+  };
+
+private:
+  // Share a node, or a copy of it if its usage counter is close to saturation.
+  template<class t_node>
+  static SharedPtr<t_node>
+  share(SharedPtr<t_node> const & p_node)
+  {
+    if (!p_node || detail::persistent_can_share<t_thread_safety>(*p_node))
+    {
+      return p_node;
+    }
+    return allocate_shared<t_node>(t_allocator(), *p_node);
+  }
+
+  // Return a reference to a node which can be modified in place, copying it if it is shared.
+  template<class t_node>
+  static t_node &
+  edit(SharedPtr<t_node> & p_node)
+  {
+    if (!detail::persistent_is_exclusive<t_thread_safety>(*p_node))
+    {
+      p_node = allocate_shared<t_node>(t_allocator(), *p_node);
+    }
+    return *p_node;
+  }
+
+  static State
+  copy(State const & p_state)
+  {
+    return State{p_state.m_size, p_state.m_shift, share(p_state.m_root), share(p_state.m_tail)};
+  }
+
+  // Return the index of the first value stored in the tail.
+  static std::size_t
+  tail_offset(std::size_t const p_size) noexcept
+  {
+    return (p_size < s_width ? 0u : ((p_size - 1u) >> s_bits) << s_bits);
+  }
+
+  static LeafPtr const &
+  leaf_ptr_for(State const & p_state, std::size_t const p_index) noexcept
+  {
+    if (p_index >= tail_offset(p_state.m_size))
+    {
+      return p_state.m_tail;
+    }
+    Branch const * node = p_state.m_root.get();
+    for (unsigned level = p_state.m_shift; level > s_bits; level -= s_bits)
+    {
+      node = node->branch((p_index >> level) & s_mask).get();
+    }
+    return node->leaf((p_index >> s_bits) & s_mask);
+  }
+
+  static Leaf const &
+  leaf_for(State const & p_state, std::size_t const p_index) noexcept
+  {
+    return *leaf_ptr_for(p_state, p_index);
+  }
+
+  // Create a path of branches down to an empty leaf slot, which is returned in 'p_slot'.
+  static BranchPtr
+  new_path(unsigned const p_level, LeafPtr *& p_slot)
+  {
+    if (p_level == s_bits)
+    {
+      BranchPtr branch = allocate_shared<Branch>(t_allocator(), true);
+      p_slot = &branch->leaf(0u);
+      return branch;
+    }
+    BranchPtr branch = allocate_shared<Branch>(t_allocator(), false);
+    branch->branch(0u) = new_path(p_level - s_bits, p_slot);
+    return branch;
+  }
+
+  // Move the full tail leaf into the tree below the given branch.
+  static void
+  push_tail(BranchPtr & p_node, unsigned const p_level, std::size_t const p_index, LeafPtr & p_tail)
+  {
+    Branch & node = edit(p_node);
+    std::size_t const child = (p_index >> p_level) & s_mask;
+    if (p_level == s_bits)
+    {
+      node.leaf(child) = std::move(p_tail);
+    }
+    else if (node.branch(child))
+    {
+      push_tail(node.branch(child), p_level - s_bits, p_index, p_tail);
+    }
+    else
+    {
+      LeafPtr * slot = nullptr;
+      BranchPtr path = new_path(p_level - s_bits, slot);
+      *slot = std::move(p_tail);
+      node.branch(child) = std::move(path);
+    }
+  }
+
+  // Remove the last leaf below the given branch and return true if the branch became empty.
+  static bool
+  pop_tail(BranchPtr & p_node, unsigned const p_level, std::size_t const p_index)
+  {
+    std::size_t const child = (p_index >> p_level) & s_mask;
+    if (p_level > s_bits)
+    {
+      Branch & node = edit(p_node);
+      if (pop_tail(node.branch(child), p_level - s_bits, p_index))
+      {
+        node.branch(child).reset();
+        return (child == 0u);
+      }
+      return false;
+    }
+    if (child == 0u)
+    {
+      return true;
+    }
+    edit(p_node).leaf(child).reset();
+    return false;
+  }
+
+  Modifier m_state;
+};
+
+
+PNTR_NAMESPACE_END
@@ -0,0 +1,381 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/ControlData.hpp>
+#include <pntr/ControlNew.hpp>
+#include <pntr/CounterThreadSafe.hpp>
+#include <pntr/Intruder.hpp>
+#include <pntr/SharedPtr.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  template<class t_shared, typename = void>
+  struct HasRetainedBytes: std::false_type
+  {};
+
+  template<class t_shared>
+  struct HasRetainedBytes<t_shared, std::void_t<decltype(std::declval<t_shared const &>().retained_bytes())>>
+  : std::true_type
+  {};
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         RetentionCache                                         //
+//                                                                                                //
+//            A cache which retains unreferenced objects in a memory-bounded LRU list             //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The cached type 't_shared' derives from 'RetentionCache::Entry', which embeds a control block
+//  like 'IntruderNew' with the deleter 'RetentionCache::Deleter'. When the last 'SharedPtr' to a
+//  cached object is released, the deleter doesn't delete it, but appends it to the list of
+//  unreferenced objects. A lookup which hits such an object removes it from the list and revives
+//  it with 'pntr_try_revive', so it doesn't have to be created again. Referenced objects are never
+//  evicted.
+//
+//  The unreferenced objects are limited by the capacity in bytes. Each object is charged with its
+//  'retained_bytes()' if it provides that member function, and with its size otherwise. Whenever an
+//  object is retained, the least recently used objects are evicted and deleted until the retained
+//  bytes fit the capacity again. 'trim' evicts down to any number of bytes, for example under
+//  memory pressure.
+//
+//  All functions are thread-safe and lock a single mutex, but objects are created and deleted
+//  without holding it, so their constructors and destructors may use the cache. A lookup which
+//  finds an object whose last reference is being released waits until the deleter has retained it.
+//  Objects which are still referenced when the cache is erased or destroyed are detached, and
+//  deleted by their last release. The cache must not be destroyed while other threads use it or
+//  release its objects.
+//
+
+template<class t_key, class t_shared, class t_hash = std::hash<t_key>, class t_equal = std::equal_to<t_key>>
+class RetentionCache
+{
+public:
+  // Retains the object in its cache, or deletes it if it was detached.
+  struct Deleter
+  {
+    void
+    operator()(t_shared const * const p_shared) const noexcept
+    {
+      RetentionCache::dispose(*const_cast<t_shared *>(p_shared));
+    }
+  };
+
+  class Entry: public Intruder<ControlNew<t_shared, ControlData<CounterThreadSafe, std::uint32_t, 32u>, Deleter>>
+  {
+  protected:
+    Entry() noexcept = default;
+
+    Entry(Entry const &) = delete;
+    Entry & operator=(Entry const &) = delete;
+
+  private:
+    std::atomic<RetentionCache *> m_cache = nullptr;
+    t_key const * m_key = nullptr;
+    std::size_t m_bytes = 0u;
+    Entry * m_older = nullptr;
+    Entry * m_newer = nullptr;
+    bool m_retained = false;
+
+    friend class RetentionCache;
+  };
+
+  explicit RetentionCache(std::size_t const p_capacity) noexcept
+  : m_capacity(p_capacity)
+  {}
+
+  RetentionCache(RetentionCache const &) = delete;
+  RetentionCache & operator=(RetentionCache const &) = delete;
+
+  ~RetentionCache() noexcept
+  {
+    Entry * evicted = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(m_mutex);
+      evicted = evict(0u);
+      for (auto const & [key, shared] : m_map)
+      {
+        static_cast<Entry &>(*shared).m_cache.store(nullptr, std::memory_order_release);
+      }
+      m_map.clear();
+    }
+    destroy(evicted);
+  }
+
+  // Return the object of the key, or an empty pointer if it isn't cached.
+  SharedPtr<t_shared>
+  find(t_key const & p_key)
+  {
+    for (;;)
+    {
+      {
+        std::lock_guard<std::mutex> const lock(m_mutex);
+        auto const found = m_map.find(p_key);
+        if (found == m_map.end())
+        {
+          return {};
+        }
+        if (SharedPtr<t_shared> shared = acquire(*found->second); shared != nullptr)
+        {
+          return shared;
+        }
+      }
+      // The last reference is being released, and the deleter is about to retain the object.
+      std::this_thread::yield();
+    }
+  }
+
+  // Return the object of the key, or create it with the arguments and insert it. The object is
+  // created without holding the lock, so a concurrent call may insert the same key first, and
+  // its object is returned instead. May throw allocation and constructor exceptions.
+  template<typename... t_args>
+  SharedPtr<t_shared>
+  find_or_create(t_key const & p_key, t_args &&... p_args)
+  {
+    if (SharedPtr<t_shared> found = find(p_key); found != nullptr)
+    {
+      return found;
+    }
+    SharedPtr<t_shared> created = make_shared<t_shared>(std::forward<t_args>(p_args)...);
+    for (;;)
+    {
+      SharedPtr<t_shared> existing;
+      {
+        std::lock_guard<std::mutex> const lock(m_mutex);
+        auto const [position, inserted] = m_map.try_emplace(p_key, created.get());
+        if (inserted)
+        {
+          Entry & entry = *created;
+          entry.m_key = &position->first;
+          entry.m_bytes = bytes_of(*created);
+          entry.m_cache.store(this, std::memory_order_release);
+          return created;
+        }
+        existing = acquire(*position->second);
+      }
+      // The created object is deleted without holding the lock.
+      if (existing != nullptr)
+      {
+        return existing;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  // Remove the object of the key from the cache, and return true if it was cached. A retained
+  // object is deleted, and a referenced object is detached.
+  bool
+  erase(t_key const & p_key) noexcept
+  {
+    Entry * evicted = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(m_mutex);
+      auto const found = m_map.find(p_key);
+      if (found == m_map.end())
+      {
+        return false;
+      }
+      Entry & entry = *found->second;
+      if (entry.m_retained)
+      {
+        unlink(entry);
+        evicted = &entry;
+      }
+      entry.m_cache.store(nullptr, std::memory_order_release);
+      m_map.erase(found);
+    }
+    destroy(evicted);
+    return true;
+  }
+
+  // Evict the least recently used objects until the retained bytes don't exceed the given number.
+  void
+  trim(std::size_t const p_bytes) noexcept
+  {
+    Entry * evicted = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(m_mutex);
+      evicted = evict(p_bytes);
+    }
+    destroy(evicted);
+  }
+
+  // Set the capacity in bytes of the retained objects, and evict the objects which exceed it.
+  void
+  set_capacity(std::size_t const p_capacity) noexcept
+  {
+    Entry * evicted = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(m_mutex);
+      m_capacity = p_capacity;
+      evicted = evict(p_capacity);
+    }
+    destroy(evicted);
+  }
+
+  std::size_t
+  capacity() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    return m_capacity;
+  }
+
+  // Return the number of cached objects, referenced or not.
+  std::size_t
+  size() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    return m_map.size();
+  }
+
+  // Return the number of unreferenced objects.
+  std::size_t
+  retained_count() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    return m_retained_count;
+  }
+
+  // Return the charged bytes of the unreferenced objects.
+  std::size_t
+  retained_bytes() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    return m_retained_bytes;
+  }
+
+private:
+  static std::size_t
+  bytes_of(t_shared const & p_shared) noexcept
+  {
+    if constexpr (detail::HasRetainedBytes<t_shared>::value)
+    {
+      return p_shared.retained_bytes();
+    }
+    else
+    {
+      return sizeof(t_shared);
+    }
+  }
+
+  // Called by the deleter when the last reference is released.
+  static void
+  dispose(t_shared & p_shared) noexcept
+  {
+    RetentionCache * const cache = static_cast<Entry &>(p_shared).m_cache.load(std::memory_order_acquire);
+    if (cache == nullptr || !cache->retain(p_shared))
+    {
+      delete &p_shared;
+    }
+  }
+
+  // Append the object to the unreferenced objects, and evict the objects which exceed the
+  // capacity. Return false if the object has been detached in the meantime.
+  bool
+  retain(Entry & p_entry) noexcept
+  {
+    Entry * evicted = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(m_mutex);
+      if (p_entry.m_cache.load(std::memory_order_relaxed) == nullptr)
+      {
+        return false;
+      }
+      // Lookups don't revive objects before they are retained, so each release is retained once.
+      PNTR_ASSERT(!p_entry.m_retained);
+      p_entry.m_retained = true;
+      p_entry.m_older = m_newest;
+      p_entry.m_newer = nullptr;
+      (m_newest != nullptr ? m_newest->m_newer : m_oldest) = &p_entry;
+      m_newest = &p_entry;
+      m_retained_bytes += p_entry.m_bytes;
+      ++m_retained_count;
+      evicted = evict(m_capacity);
+    }
+    destroy(evicted);
+    return true;
+  }
+
+  // Return a new reference to the cached object. A retained object is removed from the list and
+  // revived. Return an empty pointer if the last reference is being released.
+  SharedPtr<t_shared>
+  acquire(t_shared & p_shared) noexcept
+  {
+    Entry & entry = p_shared;
+    if (entry.m_retained)
+    {
+      unlink(entry);
+      [[maybe_unused]] bool const revived = p_shared.pntr_try_revive();
+      PNTR_ASSERT(revived);
+    }
+    return SharedPtr<t_shared>(&p_shared);
+  }
+
+  void
+  unlink(Entry & p_entry) noexcept
+  {
+    (p_entry.m_older != nullptr ? p_entry.m_older->m_newer : m_oldest) = p_entry.m_newer;
+    (p_entry.m_newer != nullptr ? p_entry.m_newer->m_older : m_newest) = p_entry.m_older;
+    p_entry.m_retained = false;
+    m_retained_bytes -= p_entry.m_bytes;
+    --m_retained_count;
+  }
+
+  // Remove the least recently used objects from the cache until the retained bytes don't exceed
+  // the given number, and return them as a list linked by 'm_newer' to be destroyed without lock.
+  Entry *
+  evict(std::size_t const p_bytes) noexcept
+  {
+    Entry * evicted = nullptr;
+    while (m_retained_bytes > p_bytes)
+    {
+      Entry & entry = *m_oldest;
+      unlink(entry);
+      entry.m_cache.store(nullptr, std::memory_order_relaxed);
+      m_map.erase(m_map.find(*entry.m_key));
+      entry.m_newer = evicted;
+      evicted = &entry;
+    }
+    return evicted;
+  }
+
+  // The destructors may release other objects of the cache.
+  static void
+  destroy(Entry * p_evicted) noexcept
+  {
+    while (p_evicted != nullptr)
+    {
+      Entry * const next = p_evicted->m_newer;
+      delete static_cast<t_shared *>(p_evicted);
+      p_evicted = next;
+    }
+  }
+
+  mutable std::mutex m_mutex;
+  std::unordered_map<t_key, t_shared *, t_hash, t_equal> m_map;
+  Entry * m_oldest = nullptr;
+  Entry * m_newest = nullptr;
+  std::size_t m_capacity;
+  std::size_t m_retained_bytes = 0u;
+  std::size_t m_retained_count = 0u;
+};
+
+
+PNTR_NAMESPACE_END
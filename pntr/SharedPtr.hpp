@@ -99,7 +99,7 @@ public:
   {
     if (m_shared != nullptr)
     {
-      m_shared->pntr_add_ref();
+      add_ref();
     }
   }
 
@@ -115,7 +115,7 @@ public:
   {
     if (m_shared != nullptr)
     {
-      m_shared->pntr_add_ref();
+      add_ref();
     }
   }
 
@@ -144,9 +144,26 @@ public:
 
   ~SharedPtr() noexcept
   {
+    if constexpr (detail::is_cycle_collected<t_shared>)
+    {
+      // A possible root of a garbage cycle is buffered with the reference released here.
+      if (m_shared != nullptr && detail::cycle_buffer(const_cast<detail::BaseType<std::remove_const_t<t_shared>> *>(
+                                   static_cast<detail::BaseType<t_shared> *>(m_shared))))
+      {
+        return;
+      }
+    }
+    if constexpr (detail::is_deferred<t_shared>)
+    {
+      // The release is logged by the current thread and applied when its log is flushed.
+      if (m_shared != nullptr && detail::deferred_release(m_shared))
+      {
+        return;
+      }
+    }
     if (m_shared != nullptr && m_shared->pntr_release())
     {
-      t_shared::pntr_deallocate(t_shared::template pntr_dispose(const_cast<std::remove_const_t<t_shared> *>(m_shared)));
+      dispose(m_shared);
     }
   }
 
@@ -277,18 +294,83 @@ public:
     std::swap(m_shared, p_other.m_shared);
   }
 
+  // Give up the ownership without releasing the object and return its pointer, which keeps the
+  // reference. It has to be passed to 'adopt' exactly once to release the object again. Allows to
+  // transfer the ownership through channels for raw pointers without touching the usage counter.
+  t_shared *
+  release_raw() noexcept
+  {
+    return detach();
+  }
+
+  // Take the ownership of a pointer returned by 'release_raw' without incrementing the usage counter.
+  static SharedPtr
+  adopt(t_shared * const p_shared) noexcept
+  {
+    return SharedPtr(p_shared, false);
+  }
+
 private:
-  // Only called from 'make_shared', 'make_shared_with_deleter', pointer casts, and 'WeakPtr::lock'.
+  // Only called from 'make_shared', 'make_shared_with_deleter', pointer casts, 'WeakPtr::lock',
+  // 'OffsetSharedPtr', 'LocalSharedPtr', and 'CycleCollector'.
   SharedPtr(t_shared * const p_shared, bool p_add_ref) noexcept
   : m_shared(p_shared)
   {
     if (m_shared != nullptr && p_add_ref)
     {
-      m_shared->pntr_add_ref();
+      add_ref();
     }
   }
 
-  // Only called from pointer casts with move semantics
+  // A pending deferred release of the same object is cancelled instead of incrementing the counter.
+  void
+  add_ref() const noexcept
+  {
+    if constexpr (detail::is_deferred<t_shared>)
+    {
+      if (detail::deferred_cancel(m_shared))
+      {
+        return;
+      }
+    }
+    m_shared->pntr_add_ref();
+  }
+
+  // Only called from 'DeferredLog' to apply the deferred releases of an object with one decrement.
+  // The count doesn't exceed the usage count, as each release was logged for an owned reference.
+  static void
+  release_deferred(void * const p_shared, std::size_t const p_count) noexcept
+  {
+    auto * const shared = static_cast<t_shared *>(p_shared);
+    if (shared->pntr_release(static_cast<typename t_shared::PntrUsageValueType>(p_count)))
+    {
+      dispose(shared);
+    }
+  }
+
+  // Only called from 'release_range', which disposes the object later if this returns true.
+  static bool
+  release_counter(t_shared * const p_shared, typename t_shared::PntrUsageValueType const p_count) noexcept
+  {
+    return p_shared->pntr_release(p_count);
+  }
+
+  // Only called from 'copy_range', which adopts the references with the private constructor.
+  static void
+  add_ref_counter(t_shared * const p_shared, typename t_shared::PntrUsageValueType const p_count) noexcept
+  {
+    p_shared->pntr_add_ref(p_count);
+  }
+
+  // Only called from the destructor, 'release_deferred', and 'release_range', after the usage
+  // counter has reached zero.
+  static void
+  dispose(t_shared * const p_shared) noexcept
+  {
+    t_shared::pntr_deallocate(t_shared::template pntr_dispose(const_cast<std::remove_const_t<t_shared> *>(p_shared)));
+  }
+
+  // Only called from pointer casts with move semantics, 'OffsetSharedPtr', and 'CycleCollector'
   t_shared *
   detach() noexcept
   {
@@ -302,6 +384,11 @@ private:
   template<class t_other>
   friend class SharedPtr;
   friend class WeakPtr<t_shared>;
+  friend class OffsetSharedPtr<t_shared>;
+  friend class LocalSharedPtr<t_shared>;
+  friend class CycleCollector;
+  friend class detail::DeferredLog;
+  friend class detail::SharedRange;
 
   template<class t_self, class t_nothrow, typename... t_args>
   friend SharedPtr<t_self> detail::make_shared_impl(t_args &&... p_args) noexcept(t_nothrow::value);
@@ -0,0 +1,256 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/SharedPtr.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                          SharedQueue                                           //
+//                                                                                                //
+//          A bounded lock-free queue for many producers and consumers of shared objects          //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  A ring buffer of raw pointers, which carry the references of the pushed 'SharedPtr' objects
+//  with 'SharedPtr::release_raw' and 'SharedPtr::adopt'. So passing an object through the queue
+//  doesn't touch its usage counter at all. Each slot has a sequence number which tells producers
+//  and consumers whether it is free or filled in the current round, so they only contend for the
+//  positions at the ends of the queue.
+//
+//  The capacity is rounded up to a power of two. Empty pointers are rejected, so an empty result
+//  of 'try_pop' always means that the queue is empty. The objects left in the queue are released
+//  when it is destroyed.
+//
+
+template<class t_shared>
+class SharedQueue
+{
+public:
+  // Throws 'std::bad_alloc' if the slots can't be allocated.
+  explicit SharedQueue(std::size_t const p_capacity)
+  : m_mask(ceil_capacity(p_capacity) - 1u)
+  , m_slots(new Slot[m_mask + 1u])
+  {
+    for (std::size_t i = 0u; i <= m_mask; ++i)
+    {
+      m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  SharedQueue(SharedQueue const &) = delete;
+  SharedQueue & operator=(SharedQueue const &) = delete;
+
+  ~SharedQueue()
+  {
+    // No other thread accesses the queue anymore, so all slots between the ends are filled.
+    std::size_t const tail = m_tail.load(std::memory_order_acquire);
+    for (std::size_t position = m_head.load(std::memory_order_relaxed); position != tail; ++position)
+    {
+      SharedPtr<t_shared>::adopt(m_slots[position & m_mask].m_shared);
+    }
+  }
+
+  std::size_t
+  capacity() const noexcept
+  {
+    return m_mask + 1u;
+  }
+
+  // Move the object into the queue and return true, or return false and keep it if the queue is full
+  // or the pointer is empty.
+  bool
+  try_push(SharedPtr<t_shared> & p_shared) noexcept
+  {
+    if (p_shared == nullptr)
+    {
+      return false;
+    }
+    std::size_t position = m_tail.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      Slot & slot = m_slots[position & m_mask];
+      auto const difference =
+        static_cast<std::ptrdiff_t>(slot.m_sequence.load(std::memory_order_acquire) - position);
+      if (difference == 0)
+      {
+        if (m_tail.compare_exchange_weak(position, position + 1u, std::memory_order_relaxed))
+        {
+          slot.m_shared = p_shared.release_raw();
+          slot.m_sequence.store(position + 1u, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (difference < 0)
+      {
+        return false;
+      }
+      else
+      {
+        position = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool
+  try_push(SharedPtr<t_shared> && p_shared) noexcept
+  {
+    return try_push(p_shared);
+  }
+
+  // Return the oldest object, or an empty pointer if the queue is empty.
+  SharedPtr<t_shared>
+  try_pop() noexcept
+  {
+    std::size_t position = m_head.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      Slot & slot = m_slots[position & m_mask];
+      auto const difference =
+        static_cast<std::ptrdiff_t>(slot.m_sequence.load(std::memory_order_acquire) - (position + 1u));
+      if (difference == 0)
+      {
+        if (m_head.compare_exchange_weak(position, position + 1u, std::memory_order_relaxed))
+        {
+          t_shared * const shared = slot.m_shared;
+          slot.m_sequence.store(position + m_mask + 1u, std::memory_order_release);
+          return SharedPtr<t_shared>::adopt(shared);
+        }
+      }
+      else if (difference < 0)
+      {
+        return nullptr;
+      }
+      else
+      {
+        position = m_head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  struct Slot
+  {
+    std::atomic<std::size_t> m_sequence;
+    t_shared * m_shared;
+  };
+
+  static std::size_t
+  ceil_capacity(std::size_t const p_capacity) noexcept
+  {
+    std::size_t capacity = 2u;
+    while (capacity < p_capacity)
+    {
+      capacity <<= 1u;
+    }
+    return capacity;
+  }
+
+  std::size_t const m_mask;
+  std::unique_ptr<Slot[]> const m_slots;
+  alignas(64) std::atomic<std::size_t> m_tail{0u};
+  alignas(64) std::atomic<std::size_t> m_head{0u};
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        SharedQueueMpsc                                         //
+//                                                                                                //
+//       An unbounded lock-free queue for many producers and one consumer of shared objects       //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  A linked list of nodes which carry the references like 'SharedQueue'. Producers append a node
+//  with a single atomic exchange, and only the consumer follows the links, so 'try_pop' must not
+//  be called by more than one thread at a time. A node whose producer has exchanged the tail but
+//  not linked it yet hides the nodes behind it for a moment, in which 'try_pop' returns an empty
+//  pointer although the queue is not empty. Empty pointers are ignored by 'push'.
+//
+
+template<class t_shared>
+class SharedQueueMpsc
+{
+public:
+  // Throws 'std::bad_alloc' if the first node can't be allocated.
+  SharedQueueMpsc()
+  : m_head(new Node{{nullptr}, nullptr})
+  , m_tail(m_head)
+  {}
+
+  SharedQueueMpsc(SharedQueueMpsc const &) = delete;
+  SharedQueueMpsc & operator=(SharedQueueMpsc const &) = delete;
+
+  ~SharedQueueMpsc()
+  {
+    // No producer links a node anymore, so the list ends at the tail.
+    while (Node * const next = m_head->m_next.load(std::memory_order_acquire))
+    {
+      SharedPtr<t_shared>::adopt(next->m_shared);
+      delete m_head;
+      m_head = next;
+    }
+    delete m_head;
+  }
+
+  // Move the object into the queue, unless the pointer is empty. Throws 'std::bad_alloc' and keeps
+  // the object if the node can't be allocated.
+  void
+  push(SharedPtr<t_shared> & p_shared)
+  {
+    if (p_shared == nullptr)
+    {
+      return;
+    }
+    Node * const node = new Node{{nullptr}, nullptr};
+    node->m_shared = p_shared.release_raw();
+    Node * const previous = m_tail.exchange(node, std::memory_order_acq_rel);
+    previous->m_next.store(node, std::memory_order_release);
+  }
+
+  void
+  push(SharedPtr<t_shared> && p_shared)
+  {
+    push(p_shared);
+  }
+
+  // Return the oldest object, or an empty pointer if the queue is empty. Only for the consumer.
+  SharedPtr<t_shared>
+  try_pop() noexcept
+  {
+    Node * const head = m_head;
+    Node * const next = head->m_next.load(std::memory_order_acquire);
+    if (next == nullptr)
+    {
+      return nullptr;
+    }
+    // The next node becomes the empty head, so the producers never see a deleted node.
+    t_shared * const shared = next->m_shared;
+    next->m_shared = nullptr;
+    m_head = next;
+    delete head;
+    return SharedPtr<t_shared>::adopt(shared);
+  }
+
+private:
+  struct Node
+  {
+    std::atomic<Node *> m_next;
+    t_shared * m_shared;
+  };
+
+  Node * m_head;
+  alignas(64) std::atomic<Node *> m_tail;
+};
+
+
+PNTR_NAMESPACE_END
@@ -0,0 +1,202 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/SharedPtr.hpp>
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  class SharedRange
+  {
+  public:
+    // The number of pointers whose objects are prefetched ahead of the current one.
+    static constexpr std::ptrdiff_t s_prefetch_distance = 8;
+
+    // The number of objects whose disposal is delayed until after the counter pass.
+    static constexpr std::size_t s_dispose_batch = 64u;
+
+    template<class t_iterator>
+    static void
+    release(t_iterator const p_first, t_iterator const p_last) noexcept
+    {
+      using Shared = typename std::iterator_traits<t_iterator>::value_type::element_type;
+      if constexpr (is_cycle_collected<Shared> || is_deferred<Shared>)
+      {
+        // These releases are buffered anyway.
+        for (t_iterator it = p_first; it != p_last; ++it)
+        {
+          it->reset();
+        }
+      }
+      else
+      {
+        Shared * disposals[s_dispose_batch];
+        std::size_t disposal_count = 0u;
+        t_iterator it = p_first;
+        while (it != p_last)
+        {
+          if (p_last - it > s_prefetch_distance)
+          {
+            PNTR_PREFETCH(it[s_prefetch_distance].m_shared);
+          }
+          Shared * const shared = it->m_shared;
+          auto const count = run_length<Shared>(it, p_last);
+          for (auto i = count; i != 0u; --i, ++it)
+          {
+            it->m_shared = nullptr;
+          }
+          // Only the single decrement of a whole run might reach zero.
+          if (shared != nullptr && SharedPtr<Shared>::release_counter(shared, count))
+          {
+            disposals[disposal_count++] = shared;
+            if (disposal_count == s_dispose_batch)
+            {
+              dispose(disposals, disposal_count);
+            }
+          }
+        }
+        dispose(disposals, disposal_count);
+      }
+    }
+
+    template<class t_input, class t_output>
+    static t_output
+    copy(t_input const p_first, t_input const p_last, t_output p_output)
+    {
+      using Shared = typename std::iterator_traits<t_input>::value_type::element_type;
+      if constexpr (is_cycle_collected<Shared> || is_deferred<Shared>)
+      {
+        for (t_input it = p_first; it != p_last; ++it, ++p_output)
+        {
+          if (p_last - it > s_prefetch_distance)
+          {
+            PNTR_PREFETCH(it[s_prefetch_distance].m_shared);
+          }
+          *p_output = *it;
+        }
+      }
+      else
+      {
+        t_input it = p_first;
+        while (it != p_last)
+        {
+          if (p_last - it > s_prefetch_distance)
+          {
+            PNTR_PREFETCH(it[s_prefetch_distance].m_shared);
+          }
+          Shared * const shared = it->m_shared;
+          RunReferences<Shared> run{shared, run_length<Shared>(it, p_last)};
+          if (shared != nullptr)
+          {
+            SharedPtr<Shared>::add_ref_counter(shared, run.m_count);
+          }
+          for (; run.m_count != 0u; ++it, ++p_output)
+          {
+            --run.m_count;
+            *p_output = SharedPtr<Shared>(shared, false);
+          }
+        }
+      }
+      return p_output;
+    }
+
+  private:
+    // The references of a run which are not adopted by the output yet. They are released if an
+    // assignment throws. As the input still holds its own references, this can't be the last release.
+    template<class t_shared>
+    struct RunReferences
+    {
+      ~RunReferences() noexcept
+      {
+        if (m_shared != nullptr && m_count != 0u)
+        {
+          [[maybe_unused]] bool const last = SharedPtr<t_shared>::release_counter(m_shared, m_count);
+          PNTR_ASSERT(!last);
+        }
+      }
+
+      t_shared * const m_shared;
+      typename t_shared::PntrUsageValueType m_count;
+    };
+
+    // Return the number of pointers equal to the first one, which is limited by the maximum usage count.
+    template<class t_shared, class t_iterator>
+    static typename t_shared::PntrUsageValueType
+    run_length(t_iterator p_it, t_iterator const p_last) noexcept
+    {
+      t_shared * const shared = p_it->m_shared;
+      typename t_shared::PntrUsageValueType count = 1u;
+      for (++p_it; p_it != p_last && p_it->m_shared == shared; ++p_it)
+      {
+        if (count == t_shared::pntr_get_max_usage_count())
+        {
+          break;
+        }
+        ++count;
+      }
+      return count;
+    }
+
+    template<class t_shared>
+    static void
+    dispose(t_shared * const * const p_disposals, std::size_t & p_count) noexcept
+    {
+      for (std::size_t i = 0u; i < p_count; ++i)
+      {
+        SharedPtr<t_shared>::dispose(p_disposals[i]);
+      }
+      p_count = 0u;
+    }
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                   release_range, copy_range                                    //
+//                                                                                                //
+//           Release and copy ranges of shared pointers with prefetched control blocks            //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Releasing or copying the pointers of a container one by one waits for each control block to
+//  be loaded into the cache. These algorithms prefetch the objects 's_prefetch_distance' pointers
+//  ahead, so the loads overlap. The ranges require random access iterators.
+//
+//  'release_range' empties all pointers of the range in a first pass, which only decrements the
+//  counters, and disposes the objects whose count reached zero in batches afterwards, so the
+//  destructors don't evict the control blocks that are prefetched next. A run of equal pointers
+//  is released with a single decrement of its counter. Objects with deferred or cycle collected
+//  counters are released as usual, as their releases are buffered anyway.
+//
+//  'copy_range' assigns the pointers of the input range to the output range, like 'std::copy'.
+//  The references of a run of equal pointers are added with a single increment. If an assignment
+//  throws, for example when a 'std::back_inserter' grows its container, the exception propagates
+//  and the output holds the pointers assigned before it.
+//
+
+template<class t_iterator>
+void
+release_range(t_iterator const p_first, t_iterator const p_last) noexcept
+{
+  detail::SharedRange::release(p_first, p_last);
+}
+
+
+template<class t_input, class t_output>
+t_output
+copy_range(t_input const p_first, t_input const p_last, t_output const p_output)
+{
+  return detail::SharedRange::copy(p_first, p_last, p_output);
+}
+
+
+PNTR_NAMESPACE_END
@@ -0,0 +1,429 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/SharedPtr.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+  #include <cerrno>
+
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+PNTR_NAMESPACE_BEGIN
+
+
+class SnapshotWriter;
+
+namespace detail
+{
+  struct SnapshotHeader
+  {
+    static constexpr std::uint64_t s_magic = 0x706E74722D736E70u; // "pntr-snp"
+    static constexpr std::uint32_t s_version = 1u;
+
+    std::uint64_t m_magic;
+    std::uint32_t m_version;
+    std::uint32_t m_reserved;
+    std::uint64_t m_size;
+    std::uint64_t m_root;
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                          SnapshotPtr                                           //
+//                                                                                                //
+//                   A constant link between two object images in a snapshot                      //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The link stores the distance to its target relative to its own address, so the snapshot can be
+//  mapped at any address. It is only set by 'SnapshotWriter::link'.
+//
+
+template<class t_image>
+class SnapshotPtr
+{
+public:
+  using element_type = t_image const;
+
+  SnapshotPtr() noexcept = default;
+
+  explicit operator bool() const noexcept
+  {
+    return (m_offset != 0);
+  }
+
+  t_image const *
+  get() const noexcept
+  {
+    return (m_offset == 0 ? nullptr
+                          : reinterpret_cast<t_image const *>(reinterpret_cast<std::uintptr_t>(this)
+                                                              + static_cast<std::uintptr_t>(m_offset)));
+  }
+
+  t_image const &
+  operator*() const noexcept
+  {
+    PNTR_ASSERT(m_offset != 0);
+    return *get();
+  }
+
+  t_image const *
+  operator->() const noexcept
+  {
+    PNTR_ASSERT(m_offset != 0);
+    return get();
+  }
+
+private:
+  std::int64_t m_offset{};
+
+  friend SnapshotWriter;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         SnapshotWriter                                         //
+//                                                                                                //
+//             Writes a graph of shared objects into a relocatable image for 'Snapshot'           //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Each shared class which can be written has to provide:
+//  - The type definition 'PntrSnapshot' of its image, which must be trivially copyable and may only
+//    link to other images with 'SnapshotPtr'. Its alignment may not exceed 64 bytes.
+//  - The member function 'void pntr_snapshot(SnapshotWriter &, PntrSnapshot &) const', which fills
+//    the value initialized image. It calls 'link' for each shared pointer of the object.
+//
+//  Each object is written only once, and all links to it point to the same image, which preserves
+//  the shared ownership of the graph, including cycles. The images are filled from a work list
+//  instead of recursively, so long chains of links don't exhaust the stack.
+//
+
+class SnapshotWriter
+{
+public:
+  static constexpr std::size_t s_max_alignment = 64u;
+
+  SnapshotWriter()
+  {
+    m_header = new (allocate(sizeof(detail::SnapshotHeader), alignof(detail::SnapshotHeader)))
+      detail::SnapshotHeader{detail::SnapshotHeader::s_magic, detail::SnapshotHeader::s_version, 0u, m_size, 0u};
+  }
+
+  SnapshotWriter(SnapshotWriter const &) = delete;
+  SnapshotWriter & operator=(SnapshotWriter const &) = delete;
+
+  // Write the object, unless it has been written before, and link the image to it. Only called
+  // from 'pntr_snapshot'.
+  template<class t_image, class t_shared>
+  void
+  link(SnapshotPtr<t_image> & p_link, SharedPtr<t_shared> const & p_shared)
+  {
+    static_assert(std::is_same_v<t_image, typename std::remove_const_t<t_shared>::PntrSnapshot>);
+    p_link.m_offset =
+      (p_shared ? static_cast<std::int64_t>(write(p_shared.get()) - file_offset(&p_link)) : std::int64_t{});
+  }
+
+  // Write the root object of the snapshot and all objects reachable from it. If it is called
+  // several times, the last root is stored.
+  template<class t_shared>
+  void
+  set_root(SharedPtr<t_shared> const & p_shared)
+  {
+    m_header->m_root = (p_shared ? write(p_shared.get()) : 0u);
+    drain();
+  }
+
+  // Return the number of bytes of the snapshot.
+  std::size_t
+  size() const noexcept
+  {
+    return m_size;
+  }
+
+  // Copy the snapshot into a buffer of at least 'size()' bytes.
+  void
+  copy(void * const p_buffer) const noexcept
+  {
+    auto * const buffer = static_cast<std::byte *>(p_buffer);
+    std::uint64_t position = 0u;
+    for (Chunk const & chunk: m_chunks)
+    {
+      std::memset(buffer + position, 0, static_cast<std::size_t>(chunk.m_file_offset - position));
+      std::memcpy(buffer + chunk.m_file_offset, chunk.m_data.get(), chunk.m_used);
+      position = chunk.m_file_offset + chunk.m_used;
+    }
+  }
+
+  // Write the snapshot into a file. Throws 'std::system_error' on failure.
+  void
+  save(char const * const p_path) const
+  {
+    std::ofstream file;
+    file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+    file.open(p_path, std::ofstream::binary | std::ofstream::trunc);
+    std::uint64_t position = 0u;
+    for (Chunk const & chunk: m_chunks)
+    {
+      for (; position < chunk.m_file_offset; ++position)
+      {
+        file.put('\0');
+      }
+      file.write(reinterpret_cast<char const *>(chunk.m_data.get()), static_cast<std::streamsize>(chunk.m_used));
+      position += chunk.m_used;
+    }
+  }
+
+private:
+  static constexpr std::size_t s_chunk_size = std::size_t{1u} << 20u;
+
+  struct alignas(s_max_alignment) Block
+  {
+    std::byte m_bytes[s_max_alignment];
+  };
+
+  struct Chunk
+  {
+    std::unique_ptr<Block[]> m_data;
+    std::size_t m_capacity;
+    std::size_t m_used;
+    std::uint64_t m_file_offset;
+  };
+
+  // An image which has been allocated but not filled yet.
+  struct Pending
+  {
+    void const * m_object;
+    void * m_image;
+    void (*m_fill)(SnapshotWriter &, void const *, void *);
+  };
+
+  template<class t_shared>
+  static void
+  fill(SnapshotWriter & p_writer, void const * const p_object, void * const p_image)
+  {
+    static_cast<t_shared const *>(p_object)->pntr_snapshot(p_writer,
+                                                           *new (p_image) typename t_shared::PntrSnapshot{});
+  }
+
+  // Return the file offset of the image of the object. New images are filled later by 'drain', so
+  // the stack depth doesn't depend on the length of linked chains.
+  template<class t_shared>
+  std::uint64_t
+  write(t_shared * const p_shared)
+  {
+    using Shared = std::remove_const_t<t_shared>;
+    using Image = typename Shared::PntrSnapshot;
+    static_assert(std::is_trivially_copyable_v<Image>);
+    static_assert(alignof(Image) <= s_max_alignment);
+    auto const found = m_written.find(static_cast<void const *>(p_shared));
+    if (found != m_written.end())
+    {
+      return found->second;
+    }
+    void * const storage = allocate(sizeof(Image), alignof(Image));
+    std::uint64_t const offset = file_offset(storage);
+    m_written.emplace(static_cast<void const *>(p_shared), offset);
+    m_pending.push_back(Pending{static_cast<void const *>(p_shared), storage, &fill<Shared>});
+    return offset;
+  }
+
+  void
+  drain()
+  {
+    while (!m_pending.empty())
+    {
+      Pending const pending = m_pending.back();
+      m_pending.pop_back();
+      pending.m_fill(*this, pending.m_object, pending.m_image);
+    }
+  }
+
+  // Allocate storage in the last chunk. The chunks never move.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment)
+  {
+    std::uint64_t offset = (m_size + p_alignment - 1u) & ~std::uint64_t{p_alignment - 1u};
+    if (m_chunks.empty() || offset + p_size > m_chunks.back().m_file_offset + m_chunks.back().m_capacity)
+    {
+      offset = (m_size + s_max_alignment - 1u) & ~std::uint64_t{s_max_alignment - 1u};
+      std::size_t const capacity = std::max(s_chunk_size, (p_size + s_max_alignment - 1u) & ~(s_max_alignment - 1u));
+      m_chunks.push_back(Chunk{std::make_unique<Block[]>(capacity / s_max_alignment), capacity, 0u, offset});
+      m_addresses.emplace(reinterpret_cast<std::uintptr_t>(m_chunks.back().m_data.get()), m_chunks.size() - 1u);
+    }
+    Chunk & chunk = m_chunks.back();
+    chunk.m_used = static_cast<std::size_t>(offset + p_size - chunk.m_file_offset);
+    m_size = offset + p_size;
+    if (m_header != nullptr)
+    {
+      m_header->m_size = m_size;
+    }
+    return reinterpret_cast<std::byte *>(chunk.m_data.get()) + (offset - chunk.m_file_offset);
+  }
+
+  // Return the file offset of an address in any chunk.
+  std::uint64_t
+  file_offset(void const * const p_address) const noexcept
+  {
+    auto const address = reinterpret_cast<std::uintptr_t>(p_address);
+    auto const found = std::prev(m_addresses.upper_bound(address));
+    return m_chunks[found->second].m_file_offset + (address - found->first);
+  }
+
+  std::vector<Chunk> m_chunks;
+  std::map<std::uintptr_t, std::size_t> m_addresses;
+  std::unordered_map<void const *, std::uint64_t> m_written;
+  std::vector<Pending> m_pending;
+  detail::SnapshotHeader * m_header{};
+  std::uint64_t m_size{};
+};
+
+
+#if defined(__linux__)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                            Snapshot                                            //
+//                                                                                                //
+//                     A read-only memory mapping of a 'SnapshotWriter' file                      //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Loading a snapshot only maps the file, so the pages are read on demand and shared with the page
+//  cache. The snapshot doesn't contain the shared objects themselves, but their images of the
+//  separate type 'PntrSnapshot', which have no control block and are linked by 'SnapshotPtr'
+//  instead of 'SharedPtr'. So code which reads a snapshot works with the image types, not with the
+//  'Intruder' classes. The images are immortal constant objects without reference counters, which
+//  are valid as long as the snapshot is. The root type has to match the type written by 'set_root'.
+//
+//  'load' throws 'std::system_error' if the file can't be mapped or its header is invalid. 'root'
+//  returns nullptr if the root image doesn't fit into the mapping or is misaligned. The links
+//  between the images aren't validated, since the images are untyped, so a corrupted link may point
+//  outside of the mapping. Only load snapshots from trusted files.
+//
+
+class Snapshot
+{
+public:
+  static Snapshot
+  load(char const * const p_path)
+  {
+    int const file_descriptor = ::open(p_path, O_RDONLY | O_CLOEXEC);
+    if (file_descriptor < 0)
+    {
+      throw std::system_error(errno, std::generic_category(), "open");
+    }
+    struct stat status{};
+    if (::fstat(file_descriptor, &status) < 0)
+    {
+      int const error = errno;
+      ::close(file_descriptor);
+      throw std::system_error(error, std::generic_category(), "fstat");
+    }
+    auto const size = static_cast<std::size_t>(status.st_size);
+    if (size < sizeof(detail::SnapshotHeader))
+    {
+      ::close(file_descriptor);
+      throw std::system_error(std::make_error_code(std::errc::invalid_argument), "invalid snapshot");
+    }
+    void * const base = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    int const error = errno;
+    ::close(file_descriptor);
+    if (base == MAP_FAILED)
+    {
+      throw std::system_error(error, std::generic_category(), "mmap");
+    }
+    Snapshot snapshot(static_cast<std::byte const *>(base), size);
+    detail::SnapshotHeader const & header = snapshot.header();
+    if (header.m_magic != detail::SnapshotHeader::s_magic || header.m_version != detail::SnapshotHeader::s_version
+        || header.m_size != size || header.m_root >= size
+        || (header.m_root != 0u && header.m_root < sizeof(detail::SnapshotHeader)))
+    {
+      throw std::system_error(std::make_error_code(std::errc::invalid_argument), "invalid snapshot");
+    }
+    return snapshot;
+  }
+
+  Snapshot(Snapshot && p_other) noexcept
+  : m_base(std::exchange(p_other.m_base, nullptr))
+  , m_size(std::exchange(p_other.m_size, 0u))
+  {}
+
+  ~Snapshot() noexcept
+  {
+    if (m_base != nullptr)
+    {
+      ::munmap(const_cast<std::byte *>(m_base), m_size);
+    }
+  }
+
+  Snapshot(Snapshot const &) = delete;
+  Snapshot & operator=(Snapshot const &) = delete;
+  Snapshot & operator=(Snapshot &&) = delete;
+
+  std::size_t
+  size() const noexcept
+  {
+    return m_size;
+  }
+
+  // Return the image of the root object, or nullptr if there is none, or if the image doesn't fit
+  // into the mapping or is misaligned.
+  template<class t_shared>
+  typename t_shared::PntrSnapshot const *
+  root() const noexcept
+  {
+    using Image = typename t_shared::PntrSnapshot;
+    std::uint64_t const offset = header().m_root;
+    if (offset == 0u || sizeof(Image) > m_size - offset || offset % alignof(Image) != 0u)
+    {
+      return nullptr;
+    }
+    return std::launder(reinterpret_cast<Image const *>(m_base + offset));
+  }
+
+private:
+  Snapshot(std::byte const * const p_base, std::size_t const p_size) noexcept
+  : m_base(p_base)
+  , m_size(p_size)
+  {}
+
+  detail::SnapshotHeader const &
+  header() const noexcept
+  {
+    return *std::launder(reinterpret_cast<detail::SnapshotHeader const *>(m_base));
+  }
+
+  std::byte const * m_base;
+  std::size_t m_size;
+};
+
+#endif
+
+
+PNTR_NAMESPACE_END
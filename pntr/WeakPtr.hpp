@@ -2,7 +2,7 @@
 
 #pragma once
 
-#include <pntr/common.hpp>
+#include <pntr/detail/PntrTypeTraits.hpp>
 
 PNTR_NAMESPACE_BEGIN
 
@@ -23,7 +23,7 @@ PNTR_NAMESPACE_BEGIN
 template<class t_shared>
 class WeakPtr
 {
-  using ControlType = typename t_shared::PntrControlType;
+  using ControlType = detail::WeakControlType<typename t_shared::PntrControlType>;
 
 public:
   using element_type = t_shared;
@@ -56,7 +56,7 @@ public:
 
   template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
   WeakPtr(SharedPtr<t_other> const & p_shared_ptr) noexcept
-  : m_control(ControlType::weak_add_ref(p_shared_ptr ? &p_shared_ptr->control() : nullptr))
+  : m_control(ControlType::weak_add_ref(p_shared_ptr ? p_shared_ptr->pntr_get_weak_control() : nullptr))
   {}
 
   WeakPtr(ControlType & p_control) noexcept
@@ -69,7 +69,14 @@ public:
   {
     if (m_control != nullptr && m_control->weak_release())
     {
-      t_shared::pntr_deallocate(m_control);
+      if constexpr (std::is_same_v<ControlType, typename t_shared::PntrControlType>)
+      {
+        t_shared::pntr_deallocate(m_control);
+      }
+      else
+      {
+        ControlType::deallocate(m_control);
+      }
     }
   }
 
@@ -171,7 +178,14 @@ private:
   void const *
   get_owner() const noexcept
   {
-    return m_control;
+    if constexpr (std::is_same_v<ControlType, typename t_shared::PntrControlType>)
+    {
+      return m_control;
+    }
+    else
+    {
+      return (m_control != nullptr ? m_control->get_owner() : nullptr);
+    }
   }
 
   ControlType * m_control;
@@ -181,6 +195,8 @@ private:
 
   template<class t_self>
   friend class SharedPtr;
+
+  friend class detail::WeakRange;
 };
 
 
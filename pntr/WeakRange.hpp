@@ -0,0 +1,226 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/SharedPtr.hpp>
+#include <pntr/WeakPtr.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+// The gathers are disabled for ThreadSanitizer, which would miss their loads.
+#if defined(__AVX2__) && !defined(__SANITIZE_THREAD__)
+  #if defined(__has_feature)
+    #if !__has_feature(thread_sanitizer)
+      #define PNTR_WEAK_RANGE_GATHER
+    #endif
+  #else
+    #define PNTR_WEAK_RANGE_GATHER
+  #endif
+#endif
+
+#if defined(PNTR_WEAK_RANGE_GATHER)
+  #include <immintrin.h>
+#endif
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Detects a control block whose usage count can be loaded from a word with a mask.
+  template<class t_control, typename = void>
+  struct UsageWord: std::false_type
+  {};
+
+  template<class t_control>
+  struct UsageWord<t_control, std::void_t<decltype(std::declval<t_control const &>().usage_word()),
+                                          decltype(t_control::Data::get_usage_mask())>>
+  : std::true_type
+  {};
+
+
+  class WeakRange
+  {
+  public:
+    // The number of weak pointers which are tested together.
+    static constexpr std::size_t s_block = 8u;
+
+    // Return a mask with bit i set if the weak pointer i of the block is empty or expired.
+    template<class t_iterator>
+    static unsigned
+    expired_mask(t_iterator const p_block, std::size_t const p_count) noexcept
+    {
+      using Control = typename std::iterator_traits<t_iterator>::value_type::ControlType;
+      if constexpr (UsageWord<Control>::value)
+      {
+#if defined(PNTR_WEAK_RANGE_GATHER)
+        using Word = std::remove_const_t<std::remove_pointer_t<decltype(std::declval<Control const &>().usage_word())>>;
+        if constexpr (sizeof(Word) == 4u || sizeof(Word) == 8u)
+        {
+          if (p_count == s_block)
+          {
+            return gather_expired<Word>(p_block, Control::Data::get_usage_mask());
+          }
+        }
+#endif
+      }
+      unsigned mask = 0u;
+      for (std::size_t i = 0u; i < p_count; ++i)
+      {
+        Control const * const control = p_block[static_cast<std::ptrdiff_t>(i)].m_control;
+        mask |= ((control == nullptr || control->use_count() == 0u) ? 1u : 0u) << i;
+      }
+      return mask;
+    }
+
+    template<class t_iterator>
+    static t_iterator
+    sweep(t_iterator const p_first, t_iterator const p_last) noexcept
+    {
+      t_iterator output = p_first;
+      t_iterator it = p_first;
+      while (it != p_last)
+      {
+        std::size_t const count = std::min(s_block, static_cast<std::size_t>(p_last - it));
+        unsigned const expired = expired_mask(it, count);
+        for (std::size_t i = 0u; i < count; ++i, ++it)
+        {
+          if ((expired & (1u << i)) != 0u)
+          {
+            it->reset();
+          }
+          else
+          {
+            if (output != it)
+            {
+              *output = std::move(*it);
+            }
+            ++output;
+          }
+        }
+      }
+      return output;
+    }
+
+    template<class t_iterator, class t_output>
+    static t_output
+    lock(t_iterator const p_first, t_iterator const p_last, t_output p_output)
+    {
+      using Shared = typename std::iterator_traits<t_iterator>::value_type::element_type;
+      t_iterator it = p_first;
+      while (it != p_last)
+      {
+        std::size_t const count = std::min(s_block, static_cast<std::size_t>(p_last - it));
+        unsigned const expired = expired_mask(it, count);
+        for (std::size_t i = 0u; i < count; ++i, ++it, ++p_output)
+        {
+          // An object which expires after the test is detected by 'lock'.
+          *p_output = ((expired & (1u << i)) != 0u ? SharedPtr<Shared>() : it->lock());
+        }
+      }
+      return p_output;
+    }
+
+  private:
+#if defined(PNTR_WEAK_RANGE_GATHER)
+    // Load the usage words of a full block with two gathers, and test them for zero.
+    //
+    // The gathers read the atomic usage words with plain loads, which is a data race under the C++
+    // memory model. It is deliberate: the words are naturally aligned, and x86 loads each aligned
+    // element of a gather atomically, so every lane holds a value the counter actually had. The
+    // acquire fence orders the loads like 'use_count()' before a word which reads as alive is
+    // trusted. Builds with ThreadSanitizer test the words one by one with atomic loads instead.
+    template<class t_word, class t_iterator>
+    static unsigned
+    gather_expired(t_iterator const p_block, t_word const p_mask) noexcept
+    {
+      // Empty pointers load a zero word, so they are reported as expired.
+      static t_word const s_zero = 0u;
+      alignas(32) long long addresses[s_block];
+      for (std::size_t i = 0u; i < s_block; ++i)
+      {
+        auto const * const control = p_block[static_cast<std::ptrdiff_t>(i)].m_control;
+        addresses[i] = static_cast<long long>(
+          reinterpret_cast<std::uintptr_t>(control != nullptr ? control->usage_word() : &s_zero));
+      }
+      unsigned mask = 0u;
+      for (std::size_t half = 0u; half < 2u; ++half)
+      {
+        __m256i const indices = _mm256_load_si256(reinterpret_cast<__m256i const *>(addresses + 4u * half));
+        unsigned bits = 0u;
+        if constexpr (sizeof(t_word) == 8u)
+        {
+          __m256i const words = _mm256_i64gather_epi64(static_cast<long long const *>(nullptr), indices, 1);
+          __m256i const counts = _mm256_and_si256(words, _mm256_set1_epi64x(static_cast<long long>(p_mask)));
+          __m256i const zero = _mm256_cmpeq_epi64(counts, _mm256_setzero_si256());
+          bits = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(zero)));
+        }
+        else
+        {
+          __m128i const words = _mm256_i64gather_epi32(static_cast<int const *>(nullptr), indices, 1);
+          __m128i const counts = _mm_and_si128(words, _mm_set1_epi32(static_cast<int>(p_mask)));
+          __m128i const zero = _mm_cmpeq_epi32(counts, _mm_setzero_si128());
+          bits = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(zero)));
+        }
+        mask |= bits << (4u * half);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return mask;
+    }
+#endif
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                    sweep_expired, lock_all                                     //
+//                                                                                                //
+//              Test the usage counts of ranges of weak pointers in blocks of eight               //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The usage counts of eight weak pointers are loaded together, so the cache misses of their
+//  control blocks overlap. If the code is compiled for AVX2 and the control data has a usage word,
+//  like 'ControlData' with 32 or 64 bit words, they are loaded with two gather instructions and
+//  tested with one comparison. Other control blocks, like the side blocks of 'ControlNew', are
+//  tested one by one. The ranges require random access iterators.
+//
+//  'sweep_expired' removes the empty and expired weak pointers from the range, keeps the order of
+//  the others like 'std::remove_if', and returns the new end. The removed pointers are released,
+//  so the pointers behind the new end are empty. Objects which expire while the range is swept
+//  are either removed, or kept and removed by the next sweep. An object which is recycled by a
+//  custom deleter can become alive again with 'pntr_try_revive', like the cached objects of
+//  'RetentionCache'. Its weak pointers are removed if the sweep finds it expired, even though
+//  'lock()' would succeed again after it has been revived.
+//
+//  'lock_all' writes the result of 'lock()' for each weak pointer of the range to the output, but
+//  skips the atomic update for the pointers which were found expired. If an assignment throws, for
+//  example when a 'std::back_inserter' grows its container, the exception propagates and the output
+//  holds the pointers assigned before it.
+//
+
+template<class t_iterator>
+t_iterator
+sweep_expired(t_iterator const p_first, t_iterator const p_last) noexcept
+{
+  return detail::WeakRange::sweep(p_first, p_last);
+}
+
+
+template<class t_iterator, class t_output>
+t_output
+lock_all(t_iterator const p_first, t_iterator const p_last, t_output const p_output)
+{
+  return detail::WeakRange::lock(p_first, p_last, p_output);
+}
+
+
+PNTR_NAMESPACE_END
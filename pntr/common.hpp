@@ -2,6 +2,7 @@
 
 #pragma once
 
+#include <algorithm>
 #include <climits>
 #include <cstddef>
 #include <cstdint>
@@ -92,6 +93,14 @@
   #endif
 #endif
 
+#ifndef PNTR_PREFETCH
+  #if defined(__GNUC__) || defined(__clang__)
+    #define PNTR_PREFETCH(x_address) __builtin_prefetch(x_address, 1)
+  #else
+    #define PNTR_PREFETCH(x_address) static_cast<void>(x_address)
+  #endif
+#endif
+
 
 PNTR_NAMESPACE_BEGIN
 
@@ -99,6 +108,11 @@ PNTR_NAMESPACE_BEGIN
 using StaticSupport = std::true_type;
 using NoStaticSupport = std::false_type;
 
+// Static support which stores a small type index in the user bits of the control data instead of a
+// function pointer, see 'AllocatorMalloc'.
+struct StaticSupportIndex: std::true_type
+{};
+
 enum class ControlStatus
 {
   e_invalid,
@@ -112,6 +126,14 @@ class SharedPtr;
 template<class t_shared>
 class WeakPtr;
 
+template<class t_shared>
+class OffsetSharedPtr;
+
+template<class t_shared>
+class LocalSharedPtr;
+
+class CycleCollector;
+
 
 namespace detail
 {
@@ -125,6 +147,21 @@ namespace detail
   template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
   std::enable_if_t<!std::is_void_v<typename t_shared::PntrAllocator>, SharedPtr<t_shared>>
   allocate_shared_impl(t_forward && p_allocator, t_args &&... p_args) noexcept(t_nothrow::value);
+
+  template<class t_shared>
+  bool cycle_buffer(t_shared * p_shared) noexcept;
+
+  class DeferredLog;
+
+  template<class t_shared>
+  bool deferred_release(t_shared * p_shared) noexcept;
+
+  template<class t_shared>
+  bool deferred_cancel(t_shared * p_shared) noexcept;
+
+  class SharedRange;
+
+  class WeakRange;
 }
 
 
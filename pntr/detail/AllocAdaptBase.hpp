@@ -3,6 +3,7 @@
 #pragma once
 
 #include <pntr/detail/PntrTypeTraits.hpp>
+#include <pntr/detail/TypeRegistry.hpp>
 
 PNTR_NAMESPACE_BEGIN
 
@@ -46,17 +47,69 @@ namespace detail
   };
 
   template<class t_shared_base, class t_data, class t_allocator>
-  class AllocAdaptDataFunction<t_shared_base, t_data, t_allocator, std::enable_if_t<t_allocator::SupportsStatic::value>>
+  class AllocAdaptDataFunction<
+    t_shared_base, t_data, t_allocator,
+    std::enable_if_t<t_allocator::SupportsStatic::value && !SupportsStaticIndex<t_allocator>::value>>
   : public AllocAdaptData<t_shared_base, t_data, t_allocator>
   {
     using Base = AllocAdaptData<t_shared_base, t_data, t_allocator>;
 
   public:
+    using Function = typename Base::Function;
+
     explicit AllocAdaptDataFunction(typename t_data::DataValueType const p_user_init) noexcept
     : Base(p_user_init)
     {}
 
-    typename Base::Function m_function{};
+    template<Function t_function>
+    void
+    set_function() noexcept
+    {
+      m_function = t_function;
+    }
+
+    Function
+    function() const noexcept
+    {
+      return m_function;
+    }
+
+  private:
+    Function m_function{};
+  };
+
+  // Stores the index of the function in the user bits instead of the function pointer.
+  template<class t_shared_base, class t_data, class t_allocator>
+  class AllocAdaptDataFunction<t_shared_base, t_data, t_allocator,
+                               std::enable_if_t<SupportsStaticIndex<t_allocator>::value>>
+  : public AllocAdaptData<t_shared_base, t_data, t_allocator>
+  {
+    using Base = AllocAdaptData<t_shared_base, t_data, t_allocator>;
+    using Registry = TypeRegistry<typename Base::Function>;
+
+    static_assert(t_data::get_max_user() >= Registry::s_capacity - 1u,
+                  "The control data doesn't have enough user bits for the type index");
+    static_assert(!HasUserIndex<t_allocator>::value, "The user bits are already used by the allocator index");
+
+  public:
+    using Function = typename Base::Function;
+
+    explicit AllocAdaptDataFunction(typename t_data::DataValueType const p_user_init) noexcept
+    : Base(p_user_init)
+    {}
+
+    template<Function t_function>
+    void
+    set_function() noexcept
+    {
+      this->m_data.try_set_user(static_cast<typename t_data::DataValueType>(Registry::template index<t_function>()));
+    }
+
+    Function
+    function() const noexcept
+    {
+      return Registry::get(static_cast<std::size_t>(this->m_data.get_user()));
+    }
   };
 
 
@@ -76,6 +129,13 @@ namespace detail
       return m_allocator;
     }
 
+    template<class t_forward>
+    void
+    set_allocator(t_forward && p_allocator) noexcept
+    {
+      m_allocator = std::forward<t_forward>(p_allocator);
+    }
+
   private:
     t_allocator m_allocator;
   };
@@ -97,6 +157,41 @@ namespace detail
     {
       return *this;
     }
+
+    template<class t_forward>
+    void
+    set_allocator(t_forward && p_allocator) noexcept
+    {
+      allocator() = std::forward<t_forward>(p_allocator);
+    }
+  };
+
+  template<class t_shared_base, class t_data, class t_allocator>
+  class AllocAdaptBase<t_shared_base, t_data, t_allocator,
+                       std::enable_if_t<HasUserIndex<t_allocator>::value && !is_empty_base<t_allocator>>>
+  : public AllocAdaptDataFunction<t_shared_base, t_data, t_allocator>
+  {
+    static_assert(t_data::get_max_user() >= t_allocator::get_max_index(),
+                  "The control data doesn't have enough user bits for the allocator index");
+
+  public:
+    using SupportsStatic = typename t_allocator::SupportsStatic;
+
+    explicit AllocAdaptBase(typename t_data::DataValueType const p_user_init) noexcept
+    : AllocAdaptDataFunction<t_shared_base, t_data, t_allocator>(p_user_init)
+    {}
+
+    t_allocator
+    allocator() const noexcept
+    {
+      return t_allocator::from_index(static_cast<std::size_t>(this->m_data.get_user()));
+    }
+
+    void
+    set_allocator(t_allocator const & p_allocator) noexcept
+    {
+      this->m_data.try_set_user(static_cast<typename t_data::DataValueType>(p_allocator.index()));
+    }
   };
 } // namespace detail
 
@@ -100,7 +100,7 @@ namespace detail
       std::size_t offset = 0u;
       if constexpr (s_supports_static)
       {
-        p_self.m_function = destroy_or_deallocate<t_shared>;
+        p_self.template set_function<destroy_or_deallocate<t_shared>>();
         if constexpr (!is_static_castable<t_shared>)
         {
           offset = calc_base_offset(p_shared);
@@ -116,14 +116,14 @@ namespace detail
         {
           if constexpr (s_supports_static)
           {
-            p_self.allocator() = std::forward<t_forward>(p_allocator);
+            p_self.set_allocator(std::forward<t_forward>(p_allocator));
             return p_shared;
           }
           else if (p_self.m_data.try_set_offset(offset))
           {
             p_self.m_data.try_set_size(calc_base_size_offset<t_shared>());
             p_self.m_data.try_set_align(calc_base_align_offset<t_shared>());
-            p_self.allocator() = std::forward<t_forward>(p_allocator);
+            p_self.set_allocator(std::forward<t_forward>(p_allocator));
             return p_shared;
           }
           else
@@ -149,10 +149,11 @@ namespace detail
     {
       if constexpr (s_supports_static)
       {
-        PNTR_TRY_LOG_ERROR(this->m_function == nullptr, "Invalid function pointer");
-        if (this->m_function != nullptr)
+        typename Base::Function const type_function = this->function();
+        PNTR_TRY_LOG_ERROR(type_function == nullptr, "Invalid function pointer");
+        if (type_function != nullptr)
         {
-          this->m_function(*this, p_control, Mode::e_destroy);
+          type_function(*this, p_control, Mode::e_destroy);
         }
       }
       else
@@ -166,10 +167,11 @@ namespace detail
     {
       if constexpr (s_supports_static)
       {
-        PNTR_TRY_LOG_ERROR(p_self.m_function == nullptr, "Invalid function pointer");
-        if (p_self.m_function != nullptr)
+        typename Base::Function const type_function = p_self.function();
+        PNTR_TRY_LOG_ERROR(type_function == nullptr, "Invalid function pointer");
+        if (type_function != nullptr)
         {
-          p_self.m_function(p_self, p_control, Mode::e_deallocate);
+          type_function(p_self, p_control, Mode::e_deallocate);
         }
       }
       else
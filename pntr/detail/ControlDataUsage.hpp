@@ -3,6 +3,7 @@
 #pragma once
 
 #include <pntr/detail/ControlDataStorage.hpp>
+#include <pntr/detail/SpillTable.hpp>
 
 PNTR_NAMESPACE_BEGIN
 
@@ -53,26 +54,80 @@ namespace detail
       return s_usage_max;
     }
 
-    // Return the usage count.
+    // Return the mask of the usage count in the word returned by 'usage_word'.
+    static constexpr UsageValueType
+    get_usage_mask() noexcept
+    {
+      return s_usage_mask;
+    }
+
+    // Return the address of the word which holds the usage count, which 'sweep_expired' loads in bulk.
+    UsageValueType const *
+    usage_word() const noexcept
+    {
+      static_assert(sizeof(this->usage_counter()) == sizeof(UsageValueType));
+      return reinterpret_cast<UsageValueType const *>(&this->usage_counter());
+    }
+
+    // Return the usage count, which includes the spilled count of a saturated spill counter.
     UsageValueType
     use_count() const noexcept
     {
-      return (this->usage_counter().get_count() & s_usage_mask);
+      UsageValueType const count = (this->usage_counter().get_count() & s_usage_mask);
+      if constexpr (s_spill)
+      {
+        return SpillTable::total<UsageValueType>(this, SpillTable::Kind::e_usage, count, s_usage_max);
+      }
+      return count;
     }
 
-    // Increment the usage counter.
+    // Increment the usage counter, or the spilled count if a spill counter is saturated.
     void
     add_ref() noexcept
     {
+      if constexpr (s_spill)
+      {
+        [[maybe_unused]] bool const incremented = SpillTable::increment(
+          this, SpillTable::Kind::e_usage, this->usage_counter(), s_usage_mask, s_usage_one, s_usage_max);
+        PNTR_ASSERT(incremented);
+        return;
+      }
       [[maybe_unused]] UsageValueType const previous = (this->usage_counter().increment(s_usage_one) & s_usage_mask);
       PNTR_ASSERT(previous > s_usage_zero && previous < s_usage_max);
     }
 
+    // Increment the usage counter by the given number of references at once.
+    void
+    add_ref(UsageValueType const p_count) noexcept
+    {
+      if constexpr (s_spill)
+      {
+        for (UsageValueType i = s_usage_zero; i < p_count; ++i)
+        {
+          add_ref();
+        }
+        return;
+      }
+      [[maybe_unused]] UsageValueType const previous =
+        (this->usage_counter().increment(static_cast<UsageValueType>(p_count * s_usage_one)) & s_usage_mask);
+      PNTR_ASSERT(previous > s_usage_zero && previous < s_usage_max && p_count <= s_usage_max - previous);
+    }
+
     // Decrement the usage counter and return true if it reaches zero or was invalid.
     bool
     release() noexcept
     {
-      UsageValueType const previous = (this->usage_counter().decrement(s_usage_one) & s_usage_mask);
+      UsageValueType previous = s_usage_zero;
+      if constexpr (s_spill)
+      {
+        // The release of a spilled reference returns max, which is not the last reference.
+        previous = SpillTable::decrement(this, SpillTable::Kind::e_usage, this->usage_counter(), s_usage_mask,
+                                         s_usage_one, s_usage_max);
+      }
+      else
+      {
+        previous = (this->usage_counter().decrement(s_usage_one) & s_usage_mask);
+      }
       if (previous > s_usage_one && previous <= s_usage_max)
       {
         return false;
@@ -86,9 +141,39 @@ namespace detail
       return true;
     }
 
+    // Decrement the usage counter by the given number of references at once, and return true if it
+    // reaches zero or was invalid.
+    bool
+    release(UsageValueType const p_count) noexcept
+    {
+      PNTR_ASSERT(p_count >= s_usage_one);
+      if constexpr (s_spill)
+      {
+        for (UsageValueType i = s_usage_one; i < p_count; ++i)
+        {
+          [[maybe_unused]] bool const last = release();
+          PNTR_ASSERT(!last);
+        }
+        return release();
+      }
+      UsageValueType const previous =
+        (this->usage_counter().decrement(static_cast<UsageValueType>(p_count * s_usage_one)) & s_usage_mask);
+      if (previous > p_count && previous <= s_usage_max)
+      {
+        return false;
+      }
+      if (previous != p_count)
+      {
+        PNTR_ASSERT(previous == s_uncontrolled);
+        // Undo decrement on invalid counter.
+        this->usage_counter().increment(static_cast<UsageValueType>(p_count * s_usage_one));
+      }
+      return true;
+    }
+
     // If the usage counter is
     // - uncontrolled: Initialize it with its first reference and return ControlStatus::e_acquired
-    // - zero or max:  Return ControlStatus::e_invalid
+    // - zero or max:  Return ControlStatus::e_invalid, unless a spill counter spills at max
     // - otherwise:    Increment it and return ControlStatus::e_shared
     ControlStatus
     try_control() noexcept
@@ -101,6 +186,13 @@ namespace detail
       {
         return ControlStatus::e_acquired;
       }
+      if constexpr (s_spill)
+      {
+        return (SpillTable::increment(this, SpillTable::Kind::e_usage, this->usage_counter(), s_usage_mask,
+                                      s_usage_one, s_usage_max)
+                  ? ControlStatus::e_shared
+                  : ControlStatus::e_invalid);
+      }
       while ((count & s_usage_mask) > s_usage_zero && (count & s_usage_mask) < s_usage_max
              && !this->usage_counter().compare_exchange_weak(count, count + s_usage_one))
       {}
@@ -110,9 +202,15 @@ namespace detail
     }
 
     // Increment the usage counter if it is not zero or max, and return true if it was incremented.
+    // A saturated spill counter increments the spilled count instead.
     bool
     try_add_ref() noexcept
     {
+      if constexpr (s_spill)
+      {
+        return SpillTable::increment(this, SpillTable::Kind::e_usage, this->usage_counter(), s_usage_mask, s_usage_one,
+                                     s_usage_max);
+      }
       UsageValueType count = this->usage_counter().get_count();
       while ((count & s_usage_mask) > s_usage_zero && (count & s_usage_mask) < s_usage_max
              && !this->usage_counter().compare_exchange_weak(count, count + s_usage_one))
@@ -140,9 +238,12 @@ namespace detail
     static constexpr UsageValueType s_uncontrolled = s_usage_mask;
     static constexpr UsageValueType s_usage_max =
       (Base::s_shared_offset ? (s_uncontrolled >> 1u) : s_uncontrolled - s_usage_one);
+    static constexpr bool s_spill = is_spill<t_counter<t_storage>>;
 
     // At least two bits are required for the usage count.
     static_assert(Base::s_usage_bits >= 2u);
+    // A spill counter has to tell its maximum from its last reference.
+    static_assert(!s_spill || s_usage_max > s_usage_one);
 
     friend ControlDataOffset<t_counter, t_storage, t_usage_bits, t_weak_bits, t_offset_bits, t_size_bits, t_align_bits>;
   };
@@ -53,6 +53,23 @@ namespace detail
       return true;
     }
 
+    // Try to set the user bits selected by the mask, and keep the others, in a single atomic
+    // update. Return true on success.
+    bool
+    try_set_user(DataValueType const p_user, DataValueType const p_mask) noexcept
+    {
+      if (p_mask > s_user_max || (p_user & ~p_mask) != 0u)
+      {
+        return false;
+      }
+      DataValueType const user = static_cast<DataValueType>(p_user << Base::s_user_shift);
+      DataValueType const mask = static_cast<DataValueType>(p_mask << Base::s_user_shift);
+      DataValueType count = this->data().get_count();
+      while (!this->data().compare_exchange_weak(count, ((count & ~mask) | user)))
+      {}
+      return true;
+    }
+
   private:
     static constexpr DataValueType s_user_max =
       (std::numeric_limits<DataValueType>::max() >> (type_bits<DataValueType>() - Base::s_user_bits));
@@ -96,6 +113,12 @@ namespace detail
       return (p_user == s_user_zero);
     }
 
+    bool
+    try_set_user(DataValueType const p_user, DataValueType const) noexcept
+    {
+      return (p_user == s_user_zero);
+    }
+
   private:
     static constexpr DataValueType s_user_zero = static_cast<DataValueType>(0u);
   };
@@ -33,17 +33,29 @@ namespace detail
       return s_weak_max;
     }
 
-    // Return the weak count.
+    // Return the weak count, which includes the spilled count of a saturated spill counter.
     WeakValueType
     weak_count() const noexcept
     {
-      return ((this->weak_counter().get_count() & s_weak_mask) >> Base::s_weak_shift);
+      WeakValueType const count = ((this->weak_counter().get_count() & s_weak_mask) >> Base::s_weak_shift);
+      if constexpr (s_spill)
+      {
+        return SpillTable::total<WeakValueType>(this, SpillTable::Kind::e_weak, count, s_weak_max);
+      }
+      return count;
     }
 
-    // Increment the weak counter.
+    // Increment the weak counter, or the spilled count if a spill counter is saturated.
     void
     weak_add_ref() noexcept
     {
+      if constexpr (s_spill)
+      {
+        [[maybe_unused]] bool const incremented = SpillTable::increment(
+          this, SpillTable::Kind::e_weak, this->weak_counter(), s_weak_mask, s_weak_one_shifted, s_weak_mask);
+        PNTR_ASSERT(incremented);
+        return;
+      }
       [[maybe_unused]] WeakValueType const previous =
         ((this->weak_counter().increment(s_weak_one_shifted) & s_weak_mask) >> Base::s_weak_shift);
       PNTR_ASSERT(previous < s_weak_max);
@@ -53,8 +65,18 @@ namespace detail
     bool
     weak_release() noexcept
     {
-      WeakValueType const previous =
-        ((this->weak_counter().decrement(s_weak_one_shifted) & s_weak_mask) >> Base::s_weak_shift);
+      WeakValueType previous = s_weak_zero;
+      if constexpr (s_spill)
+      {
+        // The release of a spilled reference returns max, which is not the last reference.
+        previous = (SpillTable::decrement(this, SpillTable::Kind::e_weak, this->weak_counter(), s_weak_mask,
+                                          s_weak_one_shifted, s_weak_mask)
+                    >> Base::s_weak_shift);
+      }
+      else
+      {
+        previous = ((this->weak_counter().decrement(s_weak_one_shifted) & s_weak_mask) >> Base::s_weak_shift);
+      }
       if (previous > s_weak_one)
       {
         return false;
@@ -75,6 +97,7 @@ namespace detail
     static constexpr WeakValueType s_weak_max =
       (std::numeric_limits<WeakValueType>::max() >> (type_bits<WeakValueType>() - Base::s_weak_bits));
     static constexpr WeakValueType s_weak_mask = (s_weak_max << Base::s_weak_shift);
+    static constexpr bool s_spill = is_spill<t_counter<t_storage>>;
 
     // At least two bits are required for the weak count.
     static_assert(Base::s_weak_bits >= 2u);
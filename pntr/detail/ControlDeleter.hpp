@@ -4,6 +4,9 @@
 
 #include <pntr/common.hpp>
 
+#include <cstddef>
+#include <utility>
+
 PNTR_NAMESPACE_BEGIN
 
 
@@ -28,6 +31,13 @@ namespace detail
       return *this;
     }
 
+    template<class t_forward>
+    void
+    set_deleter(t_forward && p_deleter) noexcept
+    {
+      deleter() = std::forward<t_forward>(p_deleter);
+    }
+
     template<class t_shared>
     void
     init() noexcept
@@ -58,6 +68,13 @@ namespace detail
       return *this;
     }
 
+    template<class t_forward>
+    void
+    set_deleter(t_forward && p_deleter) noexcept
+    {
+      deleter() = std::forward<t_forward>(p_deleter);
+    }
+
     template<class t_shared>
     void
     init() noexcept
@@ -88,6 +105,13 @@ namespace detail
       return m_deleter;
     }
 
+    template<class t_forward>
+    void
+    set_deleter(t_forward && p_deleter) noexcept
+    {
+      deleter() = std::forward<t_forward>(p_deleter);
+    }
+
     template<class t_shared>
     void
     init() noexcept
@@ -122,6 +146,13 @@ namespace detail
       return m_deleter;
     }
 
+    template<class t_forward>
+    void
+    set_deleter(t_forward && p_deleter) noexcept
+    {
+      deleter() = std::forward<t_forward>(p_deleter);
+    }
+
     template<class t_shared>
     void
     init() noexcept
@@ -138,6 +169,47 @@ namespace detail
     t_data m_data;
     t_deleter m_deleter;
   };
+
+  // ControlDeleter with a templated deleter which is restored from an index in the user bits
+  template<class t_shared_base, class t_data, typename t_deleter>
+  class ControlDeleterIndexed;
+
+  template<class t_shared_base, class t_data, template<class> class t_deleter>
+  class ControlDeleterIndexed<t_shared_base, t_data, t_deleter<t_shared_base>>
+  {
+    static_assert(t_data::get_max_user() >= t_deleter<t_shared_base>::get_max_index(),
+                  "The control data doesn't have enough user bits for the deleter index");
+
+  public:
+    explicit ControlDeleterIndexed(typename t_data::DataValueType const p_user_init) noexcept
+    : m_data(p_user_init)
+    {}
+
+    template<class t_forward>
+    void
+    set_deleter(t_forward && p_deleter) noexcept
+    {
+      m_data.try_set_user(static_cast<typename t_data::DataValueType>(p_deleter.index()));
+    }
+
+    template<class t_shared>
+    void
+    init() noexcept
+    {
+      set_deleter(t_deleter<t_shared>());
+    }
+
+    template<class t_shared>
+    static void
+    destroy(ControlDeleterIndexed & p_self, t_shared * p_shared) noexcept
+    {
+      t_deleter<t_shared_base> const deleter =
+        t_deleter<t_shared_base>::from_index(static_cast<std::size_t>(p_self.m_data.get_user()));
+      deleter(p_shared);
+    }
+
+    t_data m_data;
+  };
 } // namespace detail
 
 
@@ -0,0 +1,134 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/ControlData.hpp>
+#include <pntr/detail/PntrTypeTraits.hpp>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The declared maxima of a control block, see 'IntruderRequirements'. The flags describe what the
+  // control class stores in the control data.
+  struct ControlNeeds
+  {
+    std::uint64_t m_max_usage_count;
+    std::uint64_t m_max_weak_count;
+    std::uint64_t m_max_offset;
+    std::uint64_t m_max_size_offset;
+    std::uint64_t m_max_align;
+    unsigned m_user_bits;
+    unsigned m_min_storage_bits;
+    bool m_weak;
+    bool m_offset;
+    bool m_shared_offset;
+    bool m_size_align;
+    bool m_offset_flag;
+  };
+
+  // The bit counts of a 'ControlData' configuration. 'm_storage_bits' is zero if the needs don't fit.
+  struct ControlLayout
+  {
+    unsigned m_storage_bits;
+    unsigned m_usage_bits;
+    unsigned m_weak_bits;
+    unsigned m_offset_bits;
+    unsigned m_size_bits;
+    unsigned m_align_bits;
+  };
+
+  constexpr unsigned
+  ceil_power_of_two(unsigned const p_value) noexcept
+  {
+    unsigned power = 1u;
+    while (power < p_value)
+    {
+      power <<= 1u;
+    }
+    return power;
+  }
+
+  // Return the smallest layout for the needs. If the storage has room to spare, the counters are
+  // widened to match a 'ControlDataStorage' specialization with separate counters, which don't
+  // require to mask the other bits.
+  constexpr ControlLayout
+  calc_control_layout(ControlNeeds const & p_needs) noexcept
+  {
+    ControlLayout layout{};
+    for (unsigned storage_bits = 8u; storage_bits <= 64u; storage_bits <<= 1u)
+    {
+      // The offset is stored in units of the alignment of the control block, which is at least the
+      // size of the storage.
+      std::uint64_t const unit = storage_bits / 8u;
+      unsigned const offset_bits = bit_width(p_needs.m_max_offset / unit);
+
+      unsigned usage_bits = std::max(2u, bit_width(p_needs.m_max_usage_count + 1u));
+      unsigned weak_bits = (p_needs.m_weak ? std::max(1u, bit_width(p_needs.m_max_weak_count + 1u)) : 0u);
+      unsigned other_bits = p_needs.m_user_bits;
+      layout.m_offset_bits = 0u;
+      if (p_needs.m_offset && p_needs.m_shared_offset)
+      {
+        // The offset is stored in the usage bits after the object has been destroyed, which halves the
+        // maximum usage count.
+        usage_bits = std::max(bit_width(p_needs.m_max_usage_count) + 1u, usage_bits);
+        if (p_needs.m_max_offset != 0u)
+        {
+          usage_bits = std::max(bit_width(p_needs.m_max_offset / unit + 1u) + 1u, usage_bits);
+          layout.m_offset_bits = shared_bits;
+        }
+      }
+      else if (p_needs.m_offset)
+      {
+        layout.m_offset_bits = offset_bits + (p_needs.m_offset_flag ? 1u : 0u);
+        other_bits += layout.m_offset_bits;
+      }
+      layout.m_size_bits = (p_needs.m_size_align ? bit_width(p_needs.m_max_size_offset / unit) : 0u);
+      layout.m_align_bits = (p_needs.m_size_align && p_needs.m_max_align > alignof(std::max_align_t)
+                               ? bit_width(log2(ceil_power_of_two(static_cast<unsigned>(p_needs.m_max_align))))
+                               : 0u);
+      other_bits += layout.m_size_bits + layout.m_align_bits;
+
+      if (storage_bits < p_needs.m_min_storage_bits || usage_bits + weak_bits + other_bits > storage_bits)
+      {
+        continue;
+      }
+
+      if (weak_bits == 0u && other_bits == 0u && layout.m_offset_bits == 0u)
+      {
+        usage_bits = storage_bits;
+      }
+      else if (storage_bits >= 16u)
+      {
+        unsigned const wide_usage = std::max(8u, ceil_power_of_two(usage_bits));
+        unsigned const wide_weak = std::max(8u, ceil_power_of_two(weak_bits));
+        unsigned const rest = storage_bits - wide_usage - wide_weak;
+        if (weak_bits != 0u && wide_usage >= wide_weak && wide_usage + wide_weak < storage_bits
+            && is_power_of_two(rest) && other_bits <= rest)
+        {
+          usage_bits = wide_usage;
+          weak_bits = wide_weak;
+        }
+        else if (usage_bits <= storage_bits / 2u && weak_bits + other_bits <= storage_bits / 2u
+                 && (weak_bits < 8u || weak_bits != storage_bits / 4u))
+        {
+          usage_bits = storage_bits / 2u;
+        }
+      }
+
+      layout.m_storage_bits = storage_bits;
+      layout.m_usage_bits = usage_bits;
+      layout.m_weak_bits = weak_bits;
+      return layout;
+    }
+    return ControlLayout{};
+  }
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
@@ -0,0 +1,47 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/common.hpp>
+
+#include <utility>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Make an object of 't_type' current for the calling thread in the lifetime of the scope, and
+  // restore the previous one at its end. The pools and segments use it to pass themselves to their
+  // allocators through 'make_shared', which default constructs the allocator.
+  template<class t_type>
+  class CurrentScope
+  {
+  public:
+    explicit CurrentScope(t_type & p_current) noexcept
+    : m_previous(std::exchange(current(), &p_current))
+    {}
+
+    ~CurrentScope() noexcept
+    {
+      current() = m_previous;
+    }
+
+    CurrentScope(CurrentScope const &) = delete;
+    CurrentScope & operator=(CurrentScope const &) = delete;
+
+    // Return the current object of the calling thread, or nullptr if there is none.
+    static t_type *&
+    current() noexcept
+    {
+      static thread_local t_type * s_current = nullptr;
+      return s_current;
+    }
+
+  private:
+    t_type * const m_previous;
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
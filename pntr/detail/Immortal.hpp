@@ -0,0 +1,30 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/common.hpp>
+
+#include <cstddef>
+#include <new>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Return the instance of 't_type', which is constructed on the first call and never destroyed,
+  // so it can still be used by the destructors of static objects. As there is one instance per
+  // type, each registry passes its own class. Classes with a private default constructor declare
+  // this function a friend.
+  template<class t_type>
+  t_type &
+  immortal() noexcept
+  {
+    alignas(t_type) static std::byte s_storage[sizeof(t_type)];
+    static t_type * const s_instance = new (s_storage) t_type();
+    return *s_instance;
+  }
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
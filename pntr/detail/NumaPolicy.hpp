@@ -0,0 +1,106 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/common.hpp>
+
+#if defined(__linux__)
+
+  #include <climits>
+  #include <cstddef>
+
+  #include <sys/syscall.h>
+  #include <unistd.h>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The memory policy system calls, which are used directly to avoid a dependency on 'libnuma'.
+  // All functions fall back to a single node if the kernel doesn't support NUMA.
+  struct NumaPolicy
+  {
+    static constexpr int s_preferred = 1;
+    static constexpr unsigned long s_flag_node = 1u;
+    static constexpr unsigned long s_flag_address = 2u;
+    static constexpr unsigned long s_flag_mems_allowed = 4u;
+    static constexpr std::size_t s_max_nodes = 1024u;
+    static constexpr std::size_t s_mask_bits = sizeof(unsigned long) * CHAR_BIT;
+    // The number of calls of 'current_node' before the node of the thread is read again.
+    static constexpr unsigned s_node_refresh = 1024u;
+
+    // Return the number of nodes, including nodes which the process isn't allowed to use.
+    static std::size_t
+    node_count() noexcept
+    {
+      unsigned long mask[s_max_nodes / s_mask_bits] = {};
+      int mode = 0;
+      if (::syscall(SYS_get_mempolicy, &mode, mask, s_max_nodes, nullptr, s_flag_mems_allowed) != 0)
+      {
+        return 1u;
+      }
+      std::size_t count = 1u;
+      for (std::size_t node = 0u; node < s_max_nodes; ++node)
+      {
+        if ((mask[node / s_mask_bits] >> (node % s_mask_bits) & 1u) != 0u)
+        {
+          count = node + 1u;
+        }
+      }
+      return count;
+    }
+
+    // Return the node of the CPU the calling thread is running on. The result is cached, as the
+    // thread might be migrated at any time anyway.
+    static unsigned
+    current_node() noexcept
+    {
+      struct Cache
+      {
+        unsigned m_node = 0u;
+        unsigned m_countdown = 0u;
+      };
+      static thread_local Cache s_cache;
+      if (s_cache.m_countdown-- == 0u)
+      {
+        unsigned cpu = 0u;
+        unsigned node = 0u;
+        s_cache.m_node = (::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 ? node : 0u);
+        s_cache.m_countdown = s_node_refresh;
+      }
+      return s_cache.m_node;
+    }
+
+    // Prefer the given node for the pages of the memory range, which must not be touched yet.
+    // Return false on failure, in which case the pages are allocated by the default policy.
+    static bool
+    bind(void * const p_address, std::size_t const p_size, unsigned const p_node) noexcept
+    {
+      if (p_node >= s_max_nodes)
+      {
+        return false;
+      }
+      unsigned long mask[s_max_nodes / s_mask_bits] = {};
+      mask[p_node / s_mask_bits] = 1ul << (p_node % s_mask_bits);
+      return (::syscall(SYS_mbind, p_address, p_size, s_preferred, mask, s_max_nodes, 0u) == 0);
+    }
+
+    // Return the node of the page at the given address, or -1 if it is unknown.
+    static int
+    node_of(void const * const p_address) noexcept
+    {
+      int node = -1;
+      if (::syscall(SYS_get_mempolicy, &node, nullptr, 0ul, p_address, s_flag_node | s_flag_address) != 0)
+      {
+        return -1;
+      }
+      return node;
+    }
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
+
+#endif
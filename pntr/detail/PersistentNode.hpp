@@ -0,0 +1,80 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/AllocatorMalloc.hpp>
+#include <pntr/ControlAlloc.hpp>
+#include <pntr/ControlData.hpp>
+#include <pntr/Intruder.hpp>
+#include <pntr/SharedPtr.hpp>
+
+#include <atomic>
+#include <new>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The nodes of persistent containers don't support weak pointers and are always created with
+  // the shared base at the front, so the whole control value is used for the usage counter.
+  template<class t_thread_safety, typename t_control_value>
+  using PersistentData = std::conditional_t<t_thread_safety::value, ControlData<CounterThreadSafe, t_control_value>,
+                                            ControlData<CounterThreadUnsafe, t_control_value>>;
+
+  template<class t_node, class t_thread_safety, typename t_control_value, class t_allocator>
+  using PersistentIntruder =
+    Intruder<ControlAlloc<t_node, PersistentData<t_thread_safety, t_control_value>, t_allocator>>;
+
+
+  // Return true if the node can be shared without the risk of an overflow of its usage counter.
+  // Thread-safe nodes keep half of the counter range as headroom for concurrent sharing.
+  template<class t_thread_safety, class t_node>
+  inline bool
+  persistent_can_share(t_node const & p_node) noexcept
+  {
+    constexpr auto limit = (t_thread_safety::value ? t_node::pntr_get_max_usage_count() / 2u
+                                                   : t_node::pntr_get_max_usage_count());
+    return (p_node.pntr_use_count() < limit);
+  }
+
+  // Return true if the caller holds the only reference to the node, so it can be modified in place.
+  template<class t_thread_safety, class t_node>
+  inline bool
+  persistent_is_exclusive(t_node const & p_node) noexcept
+  {
+    if (p_node.pntr_use_count() != 1u)
+    {
+      return false;
+    }
+    if constexpr (t_thread_safety::value)
+    {
+      // Synchronize with the release of the last other reference.
+      std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return true;
+  }
+
+  // Return the number of bits set in the given bitmap.
+  inline unsigned
+  popcount(std::uint32_t p_bitmap) noexcept
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_popcount(p_bitmap));
+#else
+    p_bitmap = p_bitmap - ((p_bitmap >> 1u) & 0x55555555u);
+    p_bitmap = (p_bitmap & 0x33333333u) + ((p_bitmap >> 2u) & 0x33333333u);
+    return static_cast<unsigned>((((p_bitmap + (p_bitmap >> 4u)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24u);
+#endif
+  }
+
+  // Round the given size up to a multiple of the given power of two alignment.
+  inline constexpr std::size_t
+  align_up(std::size_t const p_size, std::size_t const p_align) noexcept
+  {
+    return ((p_size + p_align - 1u) & ~(p_align - 1u));
+  }
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
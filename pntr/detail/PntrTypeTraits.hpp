@@ -60,6 +60,75 @@ namespace detail
   inline constexpr bool is_static_castable = StaticCastable<t_shared>::value;
 
 
+  // Only used to detect the member function template 'pntr_visit_children', see 'CycleCollector'.
+  struct CycleProbe
+  {
+    template<class t_shared>
+    void operator()(SharedPtr<t_shared> &) const noexcept;
+  };
+
+  template<class t_shared, typename = void>
+  struct CycleCollected: std::false_type
+  {};
+
+  template<class t_shared>
+  struct CycleCollected<t_shared, std::void_t<decltype(std::declval<std::remove_const_t<BaseType<t_shared>> &>()
+                                                         .pntr_visit_children(std::declval<CycleProbe &>()))>>
+  : std::true_type
+  {};
+
+  template<class t_shared>
+  inline constexpr bool is_cycle_collected = CycleCollected<t_shared>::value;
+
+
+  // The type referenced by 'WeakPtr', which is either the control class or a separate side block.
+  template<class t_control, typename = void>
+  struct WeakControlImpl
+  {
+    using Type = t_control;
+  };
+
+  template<class t_control>
+  struct WeakControlImpl<t_control, std::void_t<typename t_control::WeakControl>>
+  {
+    using Type = typename t_control::WeakControl;
+  };
+
+  template<class t_control>
+  using WeakControlType = typename WeakControlImpl<t_control>::Type;
+
+
+  template<class t_shared>
+  using UsageCounterType =
+    std::remove_reference_t<decltype(std::declval<typename t_shared::PntrControlType::Data &>().usage_counter())>;
+
+  // Detects a usage counter that defers and coalesces its updates, see 'CounterDeferred'.
+  template<class t_shared, typename = void>
+  struct Deferred: std::false_type
+  {};
+
+  template<class t_shared>
+  struct Deferred<t_shared, std::void_t<typename UsageCounterType<t_shared>::Deferred>>: std::true_type
+  {};
+
+  template<class t_shared>
+  inline constexpr bool is_deferred = Deferred<t_shared>::value;
+
+
+  // Marks the shared base classes whose deallocations are reported to the 'Census'.
+  struct CensusTag
+  {};
+
+  template<class t_shared_base>
+  inline constexpr bool is_census_member = std::is_base_of_v<CensusTag, t_shared_base>;
+
+  // Report the deallocation of a census member. Defined in 'Census.hpp', which declares the
+  // 'CensusMember' base, so it is only instantiated where the definition is available.
+  template<class t_shared_base>
+  void
+  census_deallocate(void const * p_address) noexcept;
+
+
   template<class t_shared>
   inline t_shared *
   static_or_dynamic_cast(BaseType<t_shared> * p_base) noexcept
@@ -88,6 +157,53 @@ namespace detail
   template<class t_allocator>
   inline constexpr bool supports_static = SupportsStatic<t_allocator>::value;
 
+  template<class t_allocator, typename = void>
+  struct SupportsStaticIndex: std::false_type
+  {};
+
+  template<class t_allocator>
+  struct SupportsStaticIndex<t_allocator, std::void_t<typename t_allocator::SupportsStatic>>
+  : std::is_same<typename t_allocator::SupportsStatic, StaticSupportIndex>
+  {};
+
+  // Allocators and deleters with 'UserIndex' are restored from an index stored in the user bits of
+  // the control data, instead of being stored in the control block, see 'AllocatorMemoryResourceIndex'.
+  template<class t_type, typename = void>
+  struct HasUserIndex: std::false_type
+  {};
+
+  template<class t_type>
+  struct HasUserIndex<t_type, std::void_t<typename t_type::UserIndex>>: std::true_type
+  {};
+
+  // Return the alignment of the members which follow the control data in the control block.
+  template<class t_shared>
+  constexpr std::size_t
+  control_member_align() noexcept
+  {
+    using DeleterType = typename t_shared::PntrDeleter;
+    using Allocator = typename t_shared::PntrAllocator;
+    if constexpr (std::is_void_v<DeleterType>)
+    {
+      constexpr bool stores_function = (supports_static<Allocator> && !SupportsStaticIndex<Allocator>::value);
+      return std::max((stores_function ? alignof(void *) : 0u), alignof(Allocator));
+    }
+    else
+    {
+      return alignof(DeleterType);
+    }
+  }
+
+  // Return the bytes of padding which follow the control data in the control block.
+  template<class t_shared>
+  constexpr std::size_t
+  control_padding() noexcept
+  {
+    constexpr std::size_t data_size = sizeof(typename t_shared::PntrControlType::Data);
+    constexpr std::size_t align = control_member_align<t_shared>();
+    return (data_size < align ? align - data_size : 0u);
+  }
+
 
   template<class t_shared>
   inline std::size_t
@@ -0,0 +1,58 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/common.hpp>
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // A map from addresses to values, which is sharded by the address, so threads which access
+  // different addresses rarely contend for the same mutex. The low bits of the address are ignored,
+  // as they are equal for all objects of the same alignment.
+  template<class t_value, std::size_t t_shards = 16u>
+  class ShardedMap
+  {
+  public:
+    struct Shard
+    {
+      std::mutex m_mutex;
+      std::unordered_map<void const *, t_value> m_map;
+    };
+
+    // Return the shard of the given address.
+    Shard &
+    shard(void const * const p_key) noexcept
+    {
+      return m_shards[(std::hash<void const *>()(p_key) >> 4u) % t_shards];
+    }
+
+    // Iterate all shards, which have to be locked one by one.
+    Shard *
+    begin() noexcept
+    {
+      return m_shards;
+    }
+
+    Shard *
+    end() noexcept
+    {
+      return m_shards + t_shards;
+    }
+
+  private:
+    Shard m_shards[t_shards];
+
+    static_assert(t_shards > 0u);
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
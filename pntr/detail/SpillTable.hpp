@@ -0,0 +1,169 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/detail/Immortal.hpp>
+#include <pntr/detail/ShardedMap.hpp>
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Detects a counter that spills its excess count into the 'SpillTable', see 'CounterSpillThreadSafe'.
+  template<class t_counter, typename = void>
+  struct Spill: std::false_type
+  {};
+
+  template<class t_counter>
+  struct Spill<t_counter, std::void_t<typename t_counter::Spill>>: std::true_type
+  {};
+
+  template<class t_counter>
+  inline constexpr bool is_spill = Spill<t_counter>::value;
+
+
+  // Holds the counts which exceed saturated counters, keyed by the address of their control data.
+  // A counter only spills if it is saturated, so the count is the sum of both, and it is only
+  // decremented below its maximum if nothing is spilled. Both rules are kept by changing a saturated
+  // counter only while the mutex of its shard is locked.
+  //
+  // The table is sharded by the address of the control data. Running out of memory while spilling
+  // terminates the program, as the count can't be lost.
+  class SpillTable
+  {
+  public:
+    // The usage and the weak counter of one control data are spilled separately.
+    enum class Kind : unsigned
+    {
+      e_usage,
+      e_weak
+    };
+
+    // Increment the counter by 'p_one' if its masked value is below 'p_max', otherwise the spilled
+    // count. Return false, and don't increment anything, if the masked value is zero or invalid.
+    template<class t_counter, typename t_value>
+    static bool
+    increment(void const * const p_key, Kind const p_kind, t_counter & p_counter, t_value const p_mask,
+              t_value const p_one, t_value const p_max) noexcept
+    {
+      t_value count = p_counter.get_count();
+      if (try_increment(p_counter, count, p_mask, p_one, p_max))
+      {
+        return true;
+      }
+      if ((count & p_mask) != p_max)
+      {
+        return false;
+      }
+      Shard & shard = instance().shard(p_key);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      count = p_counter.get_count();
+      if (try_increment(p_counter, count, p_mask, p_one, p_max))
+      {
+        return true;
+      }
+      if ((count & p_mask) != p_max)
+      {
+        return false;
+      }
+      ++shard.m_map[p_key][static_cast<unsigned>(p_kind)];
+      return true;
+    }
+
+    // Decrement the spilled count if the counter is saturated and something is spilled, and return
+    // 'p_max'. Otherwise decrement the counter by 'p_one' and return its previous masked value.
+    template<class t_counter, typename t_value>
+    static t_value
+    decrement(void const * const p_key, Kind const p_kind, t_counter & p_counter, t_value const p_mask,
+              t_value const p_one, t_value const p_max) noexcept
+    {
+      t_value count = p_counter.get_count();
+      std::atomic_thread_fence(std::memory_order_release);
+      while ((count & p_mask) < p_max && (count & p_mask) != 0u)
+      {
+        if (p_counter.compare_exchange_weak(count, count - p_one))
+        {
+          if ((count & p_mask) == p_one)
+          {
+            std::atomic_thread_fence(std::memory_order_acquire);
+          }
+          return (count & p_mask);
+        }
+      }
+      Shard & shard = instance().shard(p_key);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      auto const found = shard.m_map.find(p_key);
+      if (found != shard.m_map.end() && found->second[static_cast<unsigned>(p_kind)] != 0u)
+      {
+        --found->second[static_cast<unsigned>(p_kind)];
+        if (found->second == Counts{})
+        {
+          shard.m_map.erase(found);
+        }
+        return p_max;
+      }
+      return (p_counter.decrement(p_one) & p_mask);
+    }
+
+    // Return the spilled count.
+    static std::size_t
+    count(void const * const p_key, Kind const p_kind) noexcept
+    {
+      Shard & shard = instance().shard(p_key);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      auto const found = shard.m_map.find(p_key);
+      return (found != shard.m_map.end() ? found->second[static_cast<unsigned>(p_kind)] : 0u);
+    }
+
+    // Return the sum of the masked value of the counter and the spilled count, limited to the
+    // maximum of 't_result'.
+    template<typename t_result, typename t_value>
+    static t_result
+    total(void const * const p_key, Kind const p_kind, t_value const p_count, t_value const p_max) noexcept
+    {
+      std::size_t const spilled = (p_count == p_max ? count(p_key, p_kind) : 0u);
+      std::size_t const value = static_cast<std::size_t>(p_count);
+      std::size_t const limit = std::numeric_limits<t_result>::max();
+      return static_cast<t_result>(spilled >= limit - value ? limit : value + spilled);
+    }
+
+  private:
+    // The spilled counts of both kinds.
+    using Counts = std::array<std::size_t, 2u>;
+    using Shard = ShardedMap<Counts>::Shard;
+
+    static ShardedMap<Counts> &
+    instance() noexcept
+    {
+      return immortal<SpillTable>().m_counts;
+    }
+
+    template<class t_counter, typename t_value>
+    static bool
+    try_increment(t_counter & p_counter, t_value & p_count, t_value const p_mask, t_value const p_one,
+                  t_value const p_max) noexcept
+    {
+      while ((p_count & p_mask) < p_max && (p_count & p_mask) != 0u)
+      {
+        if (p_counter.compare_exchange_weak(p_count, p_count + p_one))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    ShardedMap<Counts> m_counts;
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
@@ -0,0 +1,62 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/common.hpp>
+
+#include <atomic>
+#include <cstddef>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Assigns small indices to the functions which restore the dynamic type of shared objects, so
+  // the control data can store an index instead of a function pointer. Each function type has its
+  // own table, which is usually specific to one class hierarchy, so the indices stay small.
+  //
+  // A function is registered when its index is requested for the first time. The index zero is
+  // reserved for nullptr, which is also returned if the table is full. The tables are constant
+  // initialized, so they can be used by the constructors and destructors of static objects.
+  template<typename t_function>
+  class TypeRegistry
+  {
+  public:
+    static constexpr std::size_t s_capacity = 256u;
+
+    template<t_function t_entry>
+    static std::size_t
+    index() noexcept
+    {
+      static std::size_t const s_index = add(t_entry);
+      return s_index;
+    }
+
+    static t_function
+    get(std::size_t const p_index) noexcept
+    {
+      return (p_index < s_capacity ? s_table[p_index].load(std::memory_order_acquire) : nullptr);
+    }
+
+  private:
+    static std::size_t
+    add(t_function const p_entry) noexcept
+    {
+      std::size_t const index = s_count.fetch_add(1u, std::memory_order_relaxed) + 1u;
+      PNTR_TRY_LOG_ERROR(index >= s_capacity, "Too many types in the type registry");
+      if (index >= s_capacity)
+      {
+        return 0u;
+      }
+      s_table[index].store(p_entry, std::memory_order_release);
+      return index;
+    }
+
+    inline static std::atomic<t_function> s_table[s_capacity] = {};
+    inline static std::atomic<std::size_t> s_count{0u};
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
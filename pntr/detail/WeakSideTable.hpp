@@ -0,0 +1,149 @@
+// Copyright (c) 2023 John Plate (john.plate@gmx.com)
+
+#pragma once
+
+#include <pntr/detail/Immortal.hpp>
+#include <pntr/detail/ShardedMap.hpp>
+
+#include <atomic>
+#include <limits>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Maps the addresses of control blocks to their weak side blocks.
+  class WeakSideTable: public ShardedMap<void *>
+  {
+  public:
+    static WeakSideTable &
+    instance() noexcept
+    {
+      return immortal<WeakSideTable>();
+    }
+  };
+
+
+  // The block referenced by 'WeakPtr' for a control block without weak counter, which is allocated
+  // when the first weak reference is created. Its weak count includes one reference for the object
+  // until it expires, like the weak counter of 'ControlData'.
+  template<class t_control>
+  class WeakSideBlock
+  {
+  public:
+    using UsageValueType = typename t_control::UsageValueType;
+    using WeakValueType = typename t_control::WeakValueType;
+
+    explicit WeakSideBlock(t_control & p_control) noexcept
+    : m_control(&p_control)
+    , m_owner(&p_control)
+    , m_weak_count(1u)
+    {}
+
+    // Increment the weak counter.
+    void
+    weak_add_ref() noexcept
+    {
+      [[maybe_unused]] WeakValueType const previous = m_weak_count.fetch_add(1u, std::memory_order_relaxed);
+      PNTR_ASSERT(previous > 0u && previous < std::numeric_limits<WeakValueType>::max());
+    }
+
+    // Increment the weak counter.
+    static WeakSideBlock *
+    weak_add_ref(WeakSideBlock * const p_block) noexcept
+    {
+      if (p_block != nullptr)
+      {
+        p_block->weak_add_ref();
+      }
+      return p_block;
+    }
+
+    // Decrement the weak counter and return true if it reaches zero.
+    bool
+    weak_release() noexcept
+    {
+      return (m_weak_count.fetch_sub(1u, std::memory_order_acq_rel) == 1u);
+    }
+
+    // Deallocate the block. Called when the weak count reaches zero.
+    static void
+    deallocate(WeakSideBlock * const p_block) noexcept
+    {
+      delete p_block;
+    }
+
+    // Return the usage count of the object, or zero if it has expired.
+    UsageValueType
+    use_count() const noexcept
+    {
+      Guard const guard(*this);
+      return (m_control != nullptr ? m_control->use_count() : UsageValueType{});
+    }
+
+    // Return the weak count.
+    WeakValueType
+    weak_count() const noexcept
+    {
+      return m_weak_count.load(std::memory_order_relaxed);
+    }
+
+    // Try to increment the usage counter and return a pointer to the shared object on success.
+    // The lock prevents that the object is deallocated in the meantime, see 'expire'.
+    template<class t_shared>
+    t_shared *
+    try_get_shared() noexcept
+    {
+      Guard const guard(*this);
+      return (m_control != nullptr ? m_control->template try_get_shared<t_shared>() : nullptr);
+    }
+
+    // Return the address of the control block, even after the object has expired.
+    void const *
+    get_owner() const noexcept
+    {
+      return m_owner;
+    }
+
+    // Detach the block from the object before it is deallocated.
+    void
+    expire() noexcept
+    {
+      Guard const guard(*this);
+      m_control = nullptr;
+    }
+
+  private:
+    // A spin lock, as it is only held for a few instructions.
+    class Guard
+    {
+    public:
+      explicit Guard(WeakSideBlock const & p_block) noexcept
+      : m_lock(p_block.m_lock)
+      {
+        while (m_lock.test_and_set(std::memory_order_acquire))
+        {}
+      }
+
+      ~Guard()
+      {
+        m_lock.clear(std::memory_order_release);
+      }
+
+      Guard(Guard const &) = delete;
+      Guard & operator=(Guard const &) = delete;
+
+    private:
+      std::atomic_flag & m_lock;
+    };
+
+    mutable std::atomic_flag m_lock = ATOMIC_FLAG_INIT;
+    t_control * m_control;
+    void const * const m_owner;
+    std::atomic<WeakValueType> m_weak_count;
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
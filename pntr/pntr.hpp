@@ -2,17 +2,38 @@
 
 #pragma once
 
+#include <pntr/AllocatorArena.hpp>
 #include <pntr/AllocatorMalloc.hpp>
 #include <pntr/AllocatorMemoryResource.hpp>
+#include <pntr/AllocatorMemoryResourceIndex.hpp>
+#include <pntr/AllocatorNuma.hpp>
+#include <pntr/AllocatorSharedMemory.hpp>
+#include <pntr/Census.hpp>
 #include <pntr/ControlAlloc.hpp>
 #include <pntr/ControlData.hpp>
+#include <pntr/ControlDataSharded.hpp>
 #include <pntr/ControlNew.hpp>
+#include <pntr/Coroutine.hpp>
+#include <pntr/CounterDeferred.hpp>
+#include <pntr/CounterSpill.hpp>
 #include <pntr/CounterThreadSafe.hpp>
 #include <pntr/CounterThreadUnsafe.hpp>
+#include <pntr/CycleCollector.hpp>
 #include <pntr/Deleter.hpp>
 #include <pntr/Intruder.hpp>
+#include <pntr/LocalSharedPtr.hpp>
+#include <pntr/OffsetPtr.hpp>
+#include <pntr/ParallelReset.hpp>
+#include <pntr/PersistentMap.hpp>
+#include <pntr/PersistentVector.hpp>
+#include <pntr/RetentionCache.hpp>
 #include <pntr/SharedPtr.hpp>
+#include <pntr/SharedQueue.hpp>
+#include <pntr/SharedRange.hpp>
+#include <pntr/Snapshot.hpp>
 #include <pntr/WeakPtr.hpp>
+#include <pntr/WeakRange.hpp>
+#include <pntr/detail/ControlLayout.hpp>
 
 PNTR_NAMESPACE_BEGIN
 
@@ -66,6 +87,35 @@ using IntruderNew =
                                          ControlNewDataThreadUnsafe<t_control_value, t_usage_bits>>,
                       t_deleter>>;
 
+// Supports 'WeakPtr' with side blocks, which are only allocated for objects with weak references.
+// Reserves one user bit, see 'ControlNew'.
+template<class t_shared_base,
+         class t_thread_safety    = ThreadSafe,
+         typename t_control_value = std::uint32_t,
+         unsigned t_usage_bits    = detail::type_bits<t_control_value>() - 1u,
+         typename t_deleter       = std::default_delete<t_shared_base>>
+using IntruderNewWeak =
+  Intruder<ControlNew<t_shared_base,
+                      std::conditional_t<t_thread_safety::value,
+                                         ControlNewDataThreadSafe<t_control_value, t_usage_bits>,
+                                         ControlNewDataThreadUnsafe<t_control_value, t_usage_bits>>,
+                      t_deleter,
+                      std::true_type>>;
+
+// Shards the usage counter by threads for objects copied by many threads, see 'ControlDataSharded'.
+template<class t_shared_base,
+         std::size_t t_shards     = 64u,
+         typename t_deleter       = std::default_delete<t_shared_base>>
+using IntruderNewSharded = Intruder<ControlNew<t_shared_base, ControlDataSharded<t_shards>, t_deleter>>;
+
+// Defers and coalesces the releases of each thread, see 'CounterDeferred'.
+template<class t_shared_base,
+         typename t_control_value = std::uint32_t,
+         unsigned t_usage_bits    = detail::type_bits<t_control_value>(),
+         typename t_deleter       = std::default_delete<t_shared_base>>
+using IntruderNewDeferred =
+  Intruder<ControlNew<t_shared_base, ControlData<CounterDeferred, t_control_value, t_usage_bits>, t_deleter>>;
+
 template<class t_shared_base,
          class t_thread_safety    = ThreadSafe,
          typename t_control_value = std::conditional_t<sizeof(void *) == 8u, std::uint64_t, std::uint32_t>,
@@ -77,6 +127,18 @@ using IntruderNewStatic =
                                          ControlNewDataThreadUnsafe<t_control_value, t_usage_bits>>,
                       Deleter<t_shared_base>>>;
 
+// Stores the type index of 'DeleterIndexed' in 8 user bits instead of a function pointer.
+template<class t_shared_base,
+         class t_thread_safety    = ThreadSafe,
+         typename t_control_value = std::uint32_t,
+         unsigned t_usage_bits    = detail::type_bits<t_control_value>() - 8u>
+using IntruderNewStaticIndex =
+  Intruder<ControlNew<t_shared_base,
+                      std::conditional_t<t_thread_safety::value,
+                                         ControlNewDataThreadSafe<t_control_value, t_usage_bits>,
+                                         ControlNewDataThreadUnsafe<t_control_value, t_usage_bits>>,
+                      DeleterIndexed<t_shared_base>>>;
+
 
 template<class t_shared_base,
          class t_thread_safety    = ThreadSafe,
@@ -97,18 +159,158 @@ using IntruderAlloc =
                         t_allocator>>;
 
 
+// Spills the excess counts of saturated counters into a global table, see 'CounterSpill'.
+template<class t_shared_base,
+         class t_thread_safety    = ThreadSafe,
+         typename t_control_value = std::uint8_t,
+         unsigned t_usage_bits    = 6u,
+         unsigned t_weak_bits     = 2u,
+         unsigned t_offset_bits   = 0u,
+         unsigned t_size_bits     = 0u,
+         unsigned t_align_bits    = 0u,
+         class t_allocator        = AllocatorMalloc<NoStaticSupport>>
+using IntruderAllocSpill =
+  Intruder<ControlAlloc<t_shared_base,
+                        std::conditional_t<t_thread_safety::value,
+                                           ControlData<CounterSpillThreadSafe, t_control_value, t_usage_bits,
+                                                       t_weak_bits, t_offset_bits, t_size_bits, t_align_bits>,
+                                           ControlData<CounterSpillThreadUnsafe, t_control_value, t_usage_bits,
+                                                       t_weak_bits, t_offset_bits, t_size_bits, t_align_bits>>,
+                        t_allocator>>;
+
+
 template<class t_shared_base, class t_thread_safety = ThreadSafe>
 using IntruderMallocStatic = IntruderAlloc<t_shared_base, t_thread_safety, std::uint64_t, 32u, 32u,
                                            shared_bits, 0u, 0u, AllocatorMalloc<StaticSupport>>;
 
+// Stores a type index in 8 user bits instead of a function pointer, see 'StaticSupportIndex'.
+template<class t_shared_base, class t_thread_safety = ThreadSafe>
+using IntruderMallocStaticIndex = IntruderAlloc<t_shared_base, t_thread_safety, std::uint64_t, 32u, 24u,
+                                                shared_bits, 0u, 0u, AllocatorMalloc<StaticSupportIndex>>;
+
 
 template<class t_shared_base, class t_thread_safety = ThreadSafe>
 using IntruderStdAllocator = IntruderAlloc<t_shared_base, t_thread_safety, std::uint64_t, 32u, 32u,
                                            shared_bits, 0u, 0u, std::allocator<t_shared_base>>;
 
+
+// Reserves the 3 user bits required by 'CycleCollector', which is not thread-safe.
+template<class t_shared_base, class t_thread_safety = ThreadUnsafe>
+using IntruderCycle = IntruderAlloc<t_shared_base, t_thread_safety, std::uint32_t, 29u, 0u, 0u>;
+
 // clang-format on
 
 
+// The declared maxima of the shared objects, which 'AutoIntruder' uses to choose the control data.
+// Derive from it and redeclare the members that differ.
+template<class t_thread_safety = ThreadSafe, class t_allocator = void>
+struct IntruderRequirements
+{
+  using ThreadSafety = t_thread_safety;
+
+  // 'void' selects 'ControlNew' with 'std::default_delete', otherwise 'ControlAlloc' with this allocator.
+  using Allocator = t_allocator;
+
+  // The maximum number of shared pointers to one object. The default fits into 32 bits, even if the
+  // offset is stored in the usage bits.
+  static constexpr std::uint64_t s_max_usage_count = std::numeric_limits<std::int32_t>::max();
+
+  // The maximum number of weak pointers to one object, or zero if weak pointers are not used.
+  static constexpr std::uint64_t s_max_weak_count = 0u;
+
+  // The maximum byte offset of the shared base in derived classes, which grows with the size of the
+  // base classes in front of it. Zero if it is always the first base class.
+  static constexpr std::size_t s_max_base_offset = 0u;
+
+  // The maximum number of bytes that derived classes add to the size of the shared base.
+  // Only used by allocators like 'AllocatorMemoryResource' without static support.
+  static constexpr std::size_t s_max_derived_size = 0u;
+
+  // The maximum alignment of derived classes.
+  static constexpr std::size_t s_max_align = alignof(std::max_align_t);
+
+  // The number of user bits which have to be available.
+  static constexpr unsigned s_user_bits = 0u;
+};
+
+
+namespace detail
+{
+  template<class t_shared_base, class t_requirements>
+  class AutoControl
+  {
+    using Allocator = typename t_requirements::Allocator;
+
+    static constexpr bool s_new = std::is_void_v<Allocator>;
+    static constexpr bool s_new_weak = (s_new && t_requirements::s_max_weak_count != 0u);
+
+    static constexpr ControlNeeds
+    needs() noexcept
+    {
+      ControlNeeds needs{};
+      needs.m_max_usage_count = t_requirements::s_max_usage_count;
+      needs.m_max_weak_count = t_requirements::s_max_weak_count;
+      needs.m_max_offset = t_requirements::s_max_base_offset;
+      needs.m_max_size_offset = t_requirements::s_max_derived_size;
+      needs.m_max_align = t_requirements::s_max_align;
+      needs.m_user_bits = t_requirements::s_user_bits + (s_new_weak ? 1u : 0u);
+      needs.m_min_storage_bits = 8u;
+      if constexpr (!s_new)
+      {
+        constexpr bool stores_function = (supports_static<Allocator> && !SupportsStaticIndex<Allocator>::value);
+        constexpr bool stores_index = (SupportsStaticIndex<Allocator>::value || HasUserIndex<Allocator>::value);
+        static_assert(!stores_index || t_requirements::s_user_bits == 0u,
+                      "The user bits are reserved for the index of the allocator");
+        needs.m_user_bits += (stores_index ? 8u : 0u);
+        if constexpr (stores_function)
+        {
+          needs.m_min_storage_bits = static_cast<unsigned>(alignof(void *) * 8u);
+        }
+        if constexpr (!is_empty_base<Allocator> && !HasUserIndex<Allocator>::value)
+        {
+          needs.m_min_storage_bits =
+            std::max(needs.m_min_storage_bits, static_cast<unsigned>(alignof(Allocator) * 8u));
+        }
+        needs.m_weak = (t_requirements::s_max_weak_count != 0u);
+        needs.m_offset = true;
+        needs.m_shared_offset = supports_static<Allocator>;
+        needs.m_size_align = (HasTypeInfoDeallocate<Allocator>::value && !supports_static<Allocator>);
+#ifdef _WIN32
+        needs.m_offset_flag = (HasPointerDeallocate<Allocator>::value && !supports_static<Allocator>);
+#endif
+      }
+      return needs;
+    }
+
+    static constexpr ControlLayout s_layout = calc_control_layout(needs());
+    static_assert(s_layout.m_storage_bits != 0u, "The requirements don't fit into a control value of 64 bits");
+
+    template<template<typename> class t_counter>
+    using Data = ControlData<t_counter, TypeFromBits<Bits<std::max(s_layout.m_storage_bits, 8u)>>,
+                             s_layout.m_usage_bits, s_layout.m_weak_bits, s_layout.m_offset_bits,
+                             s_layout.m_size_bits, s_layout.m_align_bits>;
+
+    using CounterData = std::conditional_t<t_requirements::ThreadSafety::value, Data<CounterThreadSafe>,
+                                           Data<CounterThreadUnsafe>>;
+
+  public:
+    using Type = std::conditional_t<s_new,
+                                    ControlNew<t_shared_base, CounterData, std::default_delete<t_shared_base>,
+                                               std::bool_constant<s_new_weak>>,
+                                    ControlAlloc<t_shared_base, CounterData, Allocator>>;
+
+    static_assert(Type::get_max_usage_count() >= t_requirements::s_max_usage_count);
+    static_assert(Type::get_max_user() >= (std::uint64_t{1u} << t_requirements::s_user_bits) - 1u);
+  };
+} // namespace detail
+
+
+// An 'Intruder' whose control data is configured from the declared requirements at compile-time.
+// It selects the smallest control value and prefers separate counters when they fit.
+template<class t_shared_base, class t_requirements = IntruderRequirements<>>
+using AutoIntruder = Intruder<typename detail::AutoControl<t_shared_base, t_requirements>::Type>;
+
+
 template<class t_shared>
 inline std::size_t
 calc_pointer_offset(t_shared & p_shared) noexcept
@@ -131,6 +333,60 @@ calc_align_offset() noexcept
 }
 
 
+// The possible improvements of an 'Intruder' which can be determined at compile-time, without an
+// object, see 'check_intruder_efficiency'. Use it with
+// 'static_assert(pntr::intruder_efficiency<T>().is_efficient())'.
+struct IntruderEfficiency
+{
+  bool m_padding = false;
+  bool m_wide_usage_count = false;
+  bool m_wide_weak_count = false;
+  bool m_unused_weak_bits = false;
+  bool m_unused_offset_bits = false;
+  bool m_unused_size_bits = false;
+  bool m_unused_align_bits = false;
+  bool m_unused_deleter = false;
+
+  constexpr bool
+  is_efficient() const noexcept
+  {
+    return !(m_padding || m_wide_usage_count || m_wide_weak_count || m_unused_weak_bits || m_unused_offset_bits
+             || m_unused_size_bits || m_unused_align_bits || m_unused_deleter);
+  }
+};
+
+template<class t_shared>
+inline constexpr IntruderEfficiency
+intruder_efficiency() noexcept
+{
+  using SharedBase = detail::BaseType<t_shared>;
+  using Data = typename t_shared::PntrControlType::Data;
+  using DeleterType = typename t_shared::PntrDeleter;
+  using Allocator = typename t_shared::PntrAllocator;
+
+  IntruderEfficiency report;
+  report.m_padding = (sizeof(Data) < detail::control_member_align<t_shared>());
+  report.m_wide_usage_count = (Data::s_usage_bits > 32u);
+  report.m_wide_weak_count = (t_shared::PntrSupportsWeak::value && Data::s_weak_bits > 32u);
+  report.m_unused_weak_bits = (!t_shared::PntrSupportsWeak::value && Data::s_weak_bits != 0u);
+  if constexpr (!std::is_void_v<DeleterType>)
+  {
+    report.m_unused_offset_bits = (Data::s_offset_bits != 0u);
+    report.m_unused_size_bits = (Data::s_size_bits != 0u);
+    report.m_unused_align_bits = (Data::s_align_bits != 0u);
+    report.m_unused_deleter =
+      (std::is_same_v<DeleterType, Deleter<t_shared>>
+       && (std::has_virtual_destructor_v<SharedBase> || std::is_same_v<t_shared, SharedBase>));
+  }
+  else if constexpr (!detail::HasTypeInfoDeallocate<Allocator>::value || detail::supports_static<Allocator>)
+  {
+    report.m_unused_size_bits = (Data::s_size_bits != 0u);
+    report.m_unused_align_bits = (Data::s_align_bits != 0u);
+  }
+  return report;
+}
+
+
 // Check the efficiency of the 'Intruder' and write possible improvements to the given stream.
 // Return true if there are no proposed improvements.
 template<class t_shared, class t_char, class t_traits>
@@ -145,17 +401,7 @@ check_intruder_efficiency(SharedPtr<t_shared> const & p_shared_ptr,
   using Allocator = typename t_shared::PntrAllocator;
 
   bool efficient = true;
-  constexpr std::size_t align = []
-  {
-    if constexpr (std::is_void_v<DeleterType>)
-    {
-      return std::max((detail::supports_static<Allocator> ? alignof(void *) : 0u), alignof(Allocator));
-    }
-    else
-    {
-      return alignof(DeleterType);
-    }
-  }();
+  constexpr std::size_t align = detail::control_member_align<t_shared>();
   if constexpr (sizeof(Data) < align)
   {
     p_ostream << "Padding detected. You can increase the control data value type to " << align << " bytes."
@@ -30,6 +30,7 @@
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
 #include <climits>
 #include <cstddef>
 #include <cstdint>
@@ -120,6 +121,14 @@
   #endif
 #endif
 
+#ifndef PNTR_PREFETCH
+  #if defined(__GNUC__) || defined(__clang__)
+    #define PNTR_PREFETCH(x_address) __builtin_prefetch(x_address, 1)
+  #else
+    #define PNTR_PREFETCH(x_address) static_cast<void>(x_address)
+  #endif
+#endif
+
 
 PNTR_NAMESPACE_BEGIN
 
@@ -127,6 +136,11 @@ PNTR_NAMESPACE_BEGIN
 using StaticSupport = std::true_type;
 using NoStaticSupport = std::false_type;
 
+// Static support which stores a small type index in the user bits of the control data instead of a
+// function pointer, see 'AllocatorMalloc'.
+struct StaticSupportIndex: std::true_type
+{};
+
 enum class ControlStatus
 {
   e_invalid,
@@ -140,6 +154,14 @@ class SharedPtr;
 template<class t_shared>
 class WeakPtr;
 
+template<class t_shared>
+class OffsetSharedPtr;
+
+template<class t_shared>
+class LocalSharedPtr;
+
+class CycleCollector;
+
 
 namespace detail
 {
@@ -153,6 +175,21 @@ namespace detail
   template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
   std::enable_if_t<!std::is_void_v<typename t_shared::PntrAllocator>, SharedPtr<t_shared>>
   allocate_shared_impl(t_forward && p_allocator, t_args &&... p_args) noexcept(t_nothrow::value);
+
+  template<class t_shared>
+  bool cycle_buffer(t_shared * p_shared) noexcept;
+
+  class DeferredLog;
+
+  template<class t_shared>
+  bool deferred_release(t_shared * p_shared) noexcept;
+
+  template<class t_shared>
+  bool deferred_cancel(t_shared * p_shared) noexcept;
+
+  class SharedRange;
+
+  class WeakRange;
 }
 
 
@@ -279,6 +316,62 @@ private:
 };
 
 
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                     pntr/CounterSpill.hpp                                      //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <type_traits>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                          CounterSpill                                          //
+//                                                                                                //
+//             Reference counters which spill their excess count into a global table              //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Selected as the 't_counter' template parameter of 'ControlData', see 'IntruderAllocSpill'.
+//  A usage or weak counter with a few bits normally limits the number of shared or weak pointers
+//  to an object. When a spill counter reaches its maximum, further references are counted in a
+//  global table keyed by the address of the control data, and released from there first.
+//
+//  The counters stay small for the common case, and only the rare objects with many references
+//  pay for a locked table lookup when they are copied or released. 'use_count()' and
+//  'weak_count()' include the spilled counts, limited to the maximum of their value types.
+//
+
+template<typename t_value>
+class CounterSpillThreadSafe: public CounterThreadSafe<t_value>
+{
+public:
+  using Spill = std::true_type;
+
+  explicit CounterSpillThreadSafe(t_value const p_init_value) noexcept
+  : CounterThreadSafe<t_value>(p_init_value)
+  {}
+};
+
+
+template<typename t_value>
+class CounterSpillThreadUnsafe: public CounterThreadUnsafe<t_value>
+{
+public:
+  using Spill = std::true_type;
+
+  explicit CounterSpillThreadUnsafe(t_value const p_init_value) noexcept
+  : CounterThreadUnsafe<t_value>(p_init_value)
+  {}
+};
+
+
 PNTR_NAMESPACE_END
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -343,6 +436,75 @@ namespace detail
   inline constexpr bool is_static_castable = StaticCastable<t_shared>::value;
 
 
+  // Only used to detect the member function template 'pntr_visit_children', see 'CycleCollector'.
+  struct CycleProbe
+  {
+    template<class t_shared>
+    void operator()(SharedPtr<t_shared> &) const noexcept;
+  };
+
+  template<class t_shared, typename = void>
+  struct CycleCollected: std::false_type
+  {};
+
+  template<class t_shared>
+  struct CycleCollected<t_shared, std::void_t<decltype(std::declval<std::remove_const_t<BaseType<t_shared>> &>()
+                                                         .pntr_visit_children(std::declval<CycleProbe &>()))>>
+  : std::true_type
+  {};
+
+  template<class t_shared>
+  inline constexpr bool is_cycle_collected = CycleCollected<t_shared>::value;
+
+
+  // The type referenced by 'WeakPtr', which is either the control class or a separate side block.
+  template<class t_control, typename = void>
+  struct WeakControlImpl
+  {
+    using Type = t_control;
+  };
+
+  template<class t_control>
+  struct WeakControlImpl<t_control, std::void_t<typename t_control::WeakControl>>
+  {
+    using Type = typename t_control::WeakControl;
+  };
+
+  template<class t_control>
+  using WeakControlType = typename WeakControlImpl<t_control>::Type;
+
+
+  template<class t_shared>
+  using UsageCounterType =
+    std::remove_reference_t<decltype(std::declval<typename t_shared::PntrControlType::Data &>().usage_counter())>;
+
+  // Detects a usage counter that defers and coalesces its updates, see 'CounterDeferred'.
+  template<class t_shared, typename = void>
+  struct Deferred: std::false_type
+  {};
+
+  template<class t_shared>
+  struct Deferred<t_shared, std::void_t<typename UsageCounterType<t_shared>::Deferred>>: std::true_type
+  {};
+
+  template<class t_shared>
+  inline constexpr bool is_deferred = Deferred<t_shared>::value;
+
+
+  // Marks the shared base classes whose deallocations are reported to the 'Census'.
+  struct CensusTag
+  {};
+
+  template<class t_shared_base>
+  inline constexpr bool is_census_member = std::is_base_of_v<CensusTag, t_shared_base>;
+
+  // Report the deallocation of a census member. Defined in 'Census.hpp', which declares the
+  // 'CensusMember' base, so it is only instantiated where the definition is available.
+  template<class t_shared_base>
+  void
+  census_deallocate(void const * p_address) noexcept;
+
+
   template<class t_shared>
   inline t_shared *
   static_or_dynamic_cast(BaseType<t_shared> * p_base) noexcept
@@ -371,6 +533,53 @@ namespace detail
   template<class t_allocator>
   inline constexpr bool supports_static = SupportsStatic<t_allocator>::value;
 
+  template<class t_allocator, typename = void>
+  struct SupportsStaticIndex: std::false_type
+  {};
+
+  template<class t_allocator>
+  struct SupportsStaticIndex<t_allocator, std::void_t<typename t_allocator::SupportsStatic>>
+  : std::is_same<typename t_allocator::SupportsStatic, StaticSupportIndex>
+  {};
+
+  // Allocators and deleters with 'UserIndex' are restored from an index stored in the user bits of
+  // the control data, instead of being stored in the control block, see 'AllocatorMemoryResourceIndex'.
+  template<class t_type, typename = void>
+  struct HasUserIndex: std::false_type
+  {};
+
+  template<class t_type>
+  struct HasUserIndex<t_type, std::void_t<typename t_type::UserIndex>>: std::true_type
+  {};
+
+  // Return the alignment of the members which follow the control data in the control block.
+  template<class t_shared>
+  constexpr std::size_t
+  control_member_align() noexcept
+  {
+    using DeleterType = typename t_shared::PntrDeleter;
+    using Allocator = typename t_shared::PntrAllocator;
+    if constexpr (std::is_void_v<DeleterType>)
+    {
+      constexpr bool stores_function = (supports_static<Allocator> && !SupportsStaticIndex<Allocator>::value);
+      return std::max((stores_function ? alignof(void *) : 0u), alignof(Allocator));
+    }
+    else
+    {
+      return alignof(DeleterType);
+    }
+  }
+
+  // Return the bytes of padding which follow the control data in the control block.
+  template<class t_shared>
+  constexpr std::size_t
+  control_padding() noexcept
+  {
+    constexpr std::size_t data_size = sizeof(typename t_shared::PntrControlType::Data);
+    constexpr std::size_t align = control_member_align<t_shared>();
+    return (data_size < align ? align - data_size : 0u);
+  }
+
 
   template<class t_shared>
   inline std::size_t
@@ -436,132 +645,502 @@ PNTR_NAMESPACE_END
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                               pntr/detail/ControlDataStorage.hpp                               //
+//                                    pntr/detail/Immortal.hpp                                    //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <cstddef>
+#include <new>
+
 PNTR_NAMESPACE_BEGIN
 
 
 namespace detail
 {
-  // Only support architectures where one byte has eight bits.
-  static_assert(static_cast<unsigned>(CHAR_BIT) == 8u);
-
-  template<typename t_type>
-  inline constexpr unsigned
-  type_bits() noexcept
-  {
-    return static_cast<unsigned>(sizeof(t_type) * CHAR_BIT);
+  // Return the instance of 't_type', which is constructed on the first call and never destroyed,
+  // so it can still be used by the destructors of static objects. As there is one instance per
+  // type, each registry passes its own class. Classes with a private default constructor declare
+  // this function a friend.
+  template<class t_type>
+  t_type &
+  immortal() noexcept
+  {
+    alignas(t_type) static std::byte s_storage[sizeof(t_type)];
+    static t_type * const s_instance = new (s_storage) t_type();
+    return *s_instance;
   }
+} // namespace detail
 
-  template<unsigned t_bits>
-  using Bits = std::integral_constant<unsigned, t_bits>;
 
-  using NoBits = Bits<0u>;
-  using SharedBits = Bits<std::numeric_limits<unsigned>::max()>;
+PNTR_NAMESPACE_END
 
-  template<class t_bits>
-  struct TypeFromBitsImpl;
-  template<>
-  struct TypeFromBitsImpl<Bits<8u>>
-  {
-    using Type = std::uint8_t;
-  };
-  template<>
-  struct TypeFromBitsImpl<Bits<16u>>
-  {
-    using Type = std::uint16_t;
-  };
-  template<>
-  struct TypeFromBitsImpl<Bits<32u>>
-  {
-    using Type = std::uint32_t;
-  };
-  template<>
-  struct TypeFromBitsImpl<Bits<64u>>
-  {
-    using Type = std::uint64_t;
-  };
-  template<class t_bits>
-  using TypeFromBits = typename TypeFromBitsImpl<t_bits>::Type;
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                  pntr/detail/CurrentScope.hpp                                  //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
-  template<class t_bits>
-  inline constexpr bool
-  is_power_of_two() noexcept
-  {
-    return is_power_of_two(t_bits::value);
-  }
+#include <utility>
+
+PNTR_NAMESPACE_BEGIN
 
 
-  // ControlDataStorage is a data structure that is able to combine usage and weak count,
-  // pointer offset, type size and alignment, and a user value for the remaining bits.
-  template<template<typename> class t_counter, typename t_storage, class t_usage_bits, class t_weak_bits,
-           class t_offset_bits, class t_size_bits, class t_align_bits, typename = void>
-  class ControlDataStorage
+namespace detail
+{
+  // Make an object of 't_type' current for the calling thread in the lifetime of the scope, and
+  // restore the previous one at its end. The pools and segments use it to pass themselves to their
+  // allocators through 'make_shared', which default constructs the allocator.
+  template<class t_type>
+  class CurrentScope
   {
-    static constexpr unsigned s_storage_bits = type_bits<t_storage>();
-
   public:
-    using StorageType = t_storage;
-    using UsageValueType = t_storage;
-    using WeakValueType = t_storage;
-    using DataValueType = t_storage;
+    explicit CurrentScope(t_type & p_current) noexcept
+    : m_previous(std::exchange(current(), &p_current))
+    {}
 
-    static constexpr bool s_shared_offset = std::is_same_v<t_offset_bits, SharedBits>;
-    using OffsetValueType = t_storage;
+    ~CurrentScope() noexcept
+    {
+      current() = m_previous;
+    }
 
-    static constexpr unsigned s_usage_bits = t_usage_bits::value;
-    static constexpr unsigned s_weak_bits = t_weak_bits::value;
-    static constexpr unsigned s_offset_bits = (s_shared_offset ? 0u : t_offset_bits::value);
-    static constexpr unsigned s_size_bits = t_size_bits::value;
-    static constexpr unsigned s_align_bits = t_align_bits::value;
-    static constexpr unsigned s_user_bits =
-      s_storage_bits - s_usage_bits - s_weak_bits - s_offset_bits - s_size_bits - s_align_bits;
+    CurrentScope(CurrentScope const &) = delete;
+    CurrentScope & operator=(CurrentScope const &) = delete;
 
-    static constexpr unsigned s_weak_shift = s_usage_bits;
-    static constexpr unsigned s_offset_shift = s_weak_shift + s_weak_bits;
-    static constexpr unsigned s_size_shift = s_offset_shift + s_offset_bits;
-    static constexpr unsigned s_align_shift = s_size_shift + s_size_bits;
-    static constexpr unsigned s_user_shift = s_align_shift + s_align_bits;
+    // Return the current object of the calling thread, or nullptr if there is none.
+    static t_type *&
+    current() noexcept
+    {
+      static thread_local t_type * s_current = nullptr;
+      return s_current;
+    }
 
-    ControlDataStorage(UsageValueType const p_usage_init, WeakValueType const p_weak_init,
-                       DataValueType const p_data_init) noexcept
-    : m_counter(p_usage_init | p_weak_init | p_data_init)
-    {}
+  private:
+    t_type * const m_previous;
+  };
+} // namespace detail
 
-    template<unsigned t_bits = s_usage_bits, typename = std::enable_if_t<t_bits != 0u>>
-    t_counter<UsageValueType> &
-    usage_counter() noexcept
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                   pntr/detail/ShardedMap.hpp                                   //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <unordered_map>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // A map from addresses to values, which is sharded by the address, so threads which access
+  // different addresses rarely contend for the same mutex. The low bits of the address are ignored,
+  // as they are equal for all objects of the same alignment.
+  template<class t_value, std::size_t t_shards = 16u>
+  class ShardedMap
+  {
+  public:
+    struct Shard
     {
-      return m_counter;
-    }
+      std::mutex m_mutex;
+      std::unordered_map<void const *, t_value> m_map;
+    };
 
-    template<unsigned t_bits = s_usage_bits, typename = std::enable_if_t<t_bits != 0u>>
-    t_counter<UsageValueType> const &
-    usage_counter() const noexcept
+    // Return the shard of the given address.
+    Shard &
+    shard(void const * const p_key) noexcept
     {
-      return m_counter;
+      return m_shards[(std::hash<void const *>()(p_key) >> 4u) % t_shards];
     }
 
-    template<unsigned t_bits = s_weak_bits, typename = std::enable_if_t<t_bits != 0u>>
-    t_counter<WeakValueType> &
-    weak_counter() noexcept
+    // Iterate all shards, which have to be locked one by one.
+    Shard *
+    begin() noexcept
     {
-      return m_counter;
+      return m_shards;
     }
 
-    template<unsigned t_bits = s_weak_bits, typename = std::enable_if_t<t_bits != 0u>>
-    t_counter<WeakValueType> const &
-    weak_counter() const noexcept
+    Shard *
+    end() noexcept
     {
-      return m_counter;
+      return m_shards + t_shards;
     }
 
-    template<unsigned t_bits = s_offset_bits + s_size_bits + s_align_bits + s_user_bits,
-             typename = std::enable_if_t<t_bits != 0u>>
-    t_counter<DataValueType> &
-    data() noexcept
+  private:
+    Shard m_shards[t_shards];
+
+    static_assert(t_shards > 0u);
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                   pntr/detail/SpillTable.hpp                                   //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <limits>
+#include <mutex>
+#include <type_traits>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Detects a counter that spills its excess count into the 'SpillTable', see 'CounterSpillThreadSafe'.
+  template<class t_counter, typename = void>
+  struct Spill: std::false_type
+  {};
+
+  template<class t_counter>
+  struct Spill<t_counter, std::void_t<typename t_counter::Spill>>: std::true_type
+  {};
+
+  template<class t_counter>
+  inline constexpr bool is_spill = Spill<t_counter>::value;
+
+
+  // Holds the counts which exceed saturated counters, keyed by the address of their control data.
+  // A counter only spills if it is saturated, so the count is the sum of both, and it is only
+  // decremented below its maximum if nothing is spilled. Both rules are kept by changing a saturated
+  // counter only while the mutex of its shard is locked.
+  //
+  // The table is sharded by the address of the control data. Running out of memory while spilling
+  // terminates the program, as the count can't be lost.
+  class SpillTable
+  {
+  public:
+    // The usage and the weak counter of one control data are spilled separately.
+    enum class Kind : unsigned
+    {
+      e_usage,
+      e_weak
+    };
+
+    // Increment the counter by 'p_one' if its masked value is below 'p_max', otherwise the spilled
+    // count. Return false, and don't increment anything, if the masked value is zero or invalid.
+    template<class t_counter, typename t_value>
+    static bool
+    increment(void const * const p_key, Kind const p_kind, t_counter & p_counter, t_value const p_mask,
+              t_value const p_one, t_value const p_max) noexcept
+    {
+      t_value count = p_counter.get_count();
+      if (try_increment(p_counter, count, p_mask, p_one, p_max))
+      {
+        return true;
+      }
+      if ((count & p_mask) != p_max)
+      {
+        return false;
+      }
+      Shard & shard = instance().shard(p_key);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      count = p_counter.get_count();
+      if (try_increment(p_counter, count, p_mask, p_one, p_max))
+      {
+        return true;
+      }
+      if ((count & p_mask) != p_max)
+      {
+        return false;
+      }
+      ++shard.m_map[p_key][static_cast<unsigned>(p_kind)];
+      return true;
+    }
+
+    // Decrement the spilled count if the counter is saturated and something is spilled, and return
+    // 'p_max'. Otherwise decrement the counter by 'p_one' and return its previous masked value.
+    template<class t_counter, typename t_value>
+    static t_value
+    decrement(void const * const p_key, Kind const p_kind, t_counter & p_counter, t_value const p_mask,
+              t_value const p_one, t_value const p_max) noexcept
+    {
+      t_value count = p_counter.get_count();
+      std::atomic_thread_fence(std::memory_order_release);
+      while ((count & p_mask) < p_max && (count & p_mask) != 0u)
+      {
+        if (p_counter.compare_exchange_weak(count, count - p_one))
+        {
+          if ((count & p_mask) == p_one)
+          {
+            std::atomic_thread_fence(std::memory_order_acquire);
+          }
+          return (count & p_mask);
+        }
+      }
+      Shard & shard = instance().shard(p_key);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      auto const found = shard.m_map.find(p_key);
+      if (found != shard.m_map.end() && found->second[static_cast<unsigned>(p_kind)] != 0u)
+      {
+        --found->second[static_cast<unsigned>(p_kind)];
+        if (found->second == Counts{})
+        {
+          shard.m_map.erase(found);
+        }
+        return p_max;
+      }
+      return (p_counter.decrement(p_one) & p_mask);
+    }
+
+    // Return the spilled count.
+    static std::size_t
+    count(void const * const p_key, Kind const p_kind) noexcept
+    {
+      Shard & shard = instance().shard(p_key);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      auto const found = shard.m_map.find(p_key);
+      return (found != shard.m_map.end() ? found->second[static_cast<unsigned>(p_kind)] : 0u);
+    }
+
+    // Return the sum of the masked value of the counter and the spilled count, limited to the
+    // maximum of 't_result'.
+    template<typename t_result, typename t_value>
+    static t_result
+    total(void const * const p_key, Kind const p_kind, t_value const p_count, t_value const p_max) noexcept
+    {
+      std::size_t const spilled = (p_count == p_max ? count(p_key, p_kind) : 0u);
+      std::size_t const value = static_cast<std::size_t>(p_count);
+      std::size_t const limit = std::numeric_limits<t_result>::max();
+      return static_cast<t_result>(spilled >= limit - value ? limit : value + spilled);
+    }
+
+  private:
+    // The spilled counts of both kinds.
+    using Counts = std::array<std::size_t, 2u>;
+    using Shard = ShardedMap<Counts>::Shard;
+
+    static ShardedMap<Counts> &
+    instance() noexcept
+    {
+      return immortal<SpillTable>().m_counts;
+    }
+
+    template<class t_counter, typename t_value>
+    static bool
+    try_increment(t_counter & p_counter, t_value & p_count, t_value const p_mask, t_value const p_one,
+                  t_value const p_max) noexcept
+    {
+      while ((p_count & p_mask) < p_max && (p_count & p_mask) != 0u)
+      {
+        if (p_counter.compare_exchange_weak(p_count, p_count + p_one))
+        {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    ShardedMap<Counts> m_counts;
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                  pntr/detail/TypeRegistry.hpp                                  //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstddef>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Assigns small indices to the functions which restore the dynamic type of shared objects, so
+  // the control data can store an index instead of a function pointer. Each function type has its
+  // own table, which is usually specific to one class hierarchy, so the indices stay small.
+  //
+  // A function is registered when its index is requested for the first time. The index zero is
+  // reserved for nullptr, which is also returned if the table is full. The tables are constant
+  // initialized, so they can be used by the constructors and destructors of static objects.
+  template<typename t_function>
+  class TypeRegistry
+  {
+  public:
+    static constexpr std::size_t s_capacity = 256u;
+
+    template<t_function t_entry>
+    static std::size_t
+    index() noexcept
+    {
+      static std::size_t const s_index = add(t_entry);
+      return s_index;
+    }
+
+    static t_function
+    get(std::size_t const p_index) noexcept
+    {
+      return (p_index < s_capacity ? s_table[p_index].load(std::memory_order_acquire) : nullptr);
+    }
+
+  private:
+    static std::size_t
+    add(t_function const p_entry) noexcept
+    {
+      std::size_t const index = s_count.fetch_add(1u, std::memory_order_relaxed) + 1u;
+      PNTR_TRY_LOG_ERROR(index >= s_capacity, "Too many types in the type registry");
+      if (index >= s_capacity)
+      {
+        return 0u;
+      }
+      s_table[index].store(p_entry, std::memory_order_release);
+      return index;
+    }
+
+    inline static std::atomic<t_function> s_table[s_capacity] = {};
+    inline static std::atomic<std::size_t> s_count{0u};
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                               pntr/detail/ControlDataStorage.hpp                               //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Only support architectures where one byte has eight bits.
+  static_assert(static_cast<unsigned>(CHAR_BIT) == 8u);
+
+  template<typename t_type>
+  inline constexpr unsigned
+  type_bits() noexcept
+  {
+    return static_cast<unsigned>(sizeof(t_type) * CHAR_BIT);
+  }
+
+  template<unsigned t_bits>
+  using Bits = std::integral_constant<unsigned, t_bits>;
+
+  using NoBits = Bits<0u>;
+  using SharedBits = Bits<std::numeric_limits<unsigned>::max()>;
+
+  template<class t_bits>
+  struct TypeFromBitsImpl;
+  template<>
+  struct TypeFromBitsImpl<Bits<8u>>
+  {
+    using Type = std::uint8_t;
+  };
+  template<>
+  struct TypeFromBitsImpl<Bits<16u>>
+  {
+    using Type = std::uint16_t;
+  };
+  template<>
+  struct TypeFromBitsImpl<Bits<32u>>
+  {
+    using Type = std::uint32_t;
+  };
+  template<>
+  struct TypeFromBitsImpl<Bits<64u>>
+  {
+    using Type = std::uint64_t;
+  };
+  template<class t_bits>
+  using TypeFromBits = typename TypeFromBitsImpl<t_bits>::Type;
+
+  template<class t_bits>
+  inline constexpr bool
+  is_power_of_two() noexcept
+  {
+    return is_power_of_two(t_bits::value);
+  }
+
+
+  // ControlDataStorage is a data structure that is able to combine usage and weak count,
+  // pointer offset, type size and alignment, and a user value for the remaining bits.
+  template<template<typename> class t_counter, typename t_storage, class t_usage_bits, class t_weak_bits,
+           class t_offset_bits, class t_size_bits, class t_align_bits, typename = void>
+  class ControlDataStorage
+  {
+    static constexpr unsigned s_storage_bits = type_bits<t_storage>();
+
+  public:
+    using StorageType = t_storage;
+    using UsageValueType = t_storage;
+    using WeakValueType = t_storage;
+    using DataValueType = t_storage;
+
+    static constexpr bool s_shared_offset = std::is_same_v<t_offset_bits, SharedBits>;
+    using OffsetValueType = t_storage;
+
+    static constexpr unsigned s_usage_bits = t_usage_bits::value;
+    static constexpr unsigned s_weak_bits = t_weak_bits::value;
+    static constexpr unsigned s_offset_bits = (s_shared_offset ? 0u : t_offset_bits::value);
+    static constexpr unsigned s_size_bits = t_size_bits::value;
+    static constexpr unsigned s_align_bits = t_align_bits::value;
+    static constexpr unsigned s_user_bits =
+      s_storage_bits - s_usage_bits - s_weak_bits - s_offset_bits - s_size_bits - s_align_bits;
+
+    static constexpr unsigned s_weak_shift = s_usage_bits;
+    static constexpr unsigned s_offset_shift = s_weak_shift + s_weak_bits;
+    static constexpr unsigned s_size_shift = s_offset_shift + s_offset_bits;
+    static constexpr unsigned s_align_shift = s_size_shift + s_size_bits;
+    static constexpr unsigned s_user_shift = s_align_shift + s_align_bits;
+
+    ControlDataStorage(UsageValueType const p_usage_init, WeakValueType const p_weak_init,
+                       DataValueType const p_data_init) noexcept
+    : m_counter(p_usage_init | p_weak_init | p_data_init)
+    {}
+
+    template<unsigned t_bits = s_usage_bits, typename = std::enable_if_t<t_bits != 0u>>
+    t_counter<UsageValueType> &
+    usage_counter() noexcept
+    {
+      return m_counter;
+    }
+
+    template<unsigned t_bits = s_usage_bits, typename = std::enable_if_t<t_bits != 0u>>
+    t_counter<UsageValueType> const &
+    usage_counter() const noexcept
+    {
+      return m_counter;
+    }
+
+    template<unsigned t_bits = s_weak_bits, typename = std::enable_if_t<t_bits != 0u>>
+    t_counter<WeakValueType> &
+    weak_counter() noexcept
+    {
+      return m_counter;
+    }
+
+    template<unsigned t_bits = s_weak_bits, typename = std::enable_if_t<t_bits != 0u>>
+    t_counter<WeakValueType> const &
+    weak_counter() const noexcept
+    {
+      return m_counter;
+    }
+
+    template<unsigned t_bits = s_offset_bits + s_size_bits + s_align_bits + s_user_bits,
+             typename = std::enable_if_t<t_bits != 0u>>
+    t_counter<DataValueType> &
+    data() noexcept
     {
       return m_counter;
     }
@@ -818,26 +1397,80 @@ namespace detail
       return s_usage_max;
     }
 
-    // Return the usage count.
-    UsageValueType
-    use_count() const noexcept
+    // Return the mask of the usage count in the word returned by 'usage_word'.
+    static constexpr UsageValueType
+    get_usage_mask() noexcept
     {
-      return (this->usage_counter().get_count() & s_usage_mask);
+      return s_usage_mask;
     }
 
-    // Increment the usage counter.
-    void
-    add_ref() noexcept
+    // Return the address of the word which holds the usage count, which 'sweep_expired' loads in bulk.
+    UsageValueType const *
+    usage_word() const noexcept
     {
-      [[maybe_unused]] UsageValueType const previous = (this->usage_counter().increment(s_usage_one) & s_usage_mask);
-      PNTR_ASSERT(previous > s_usage_zero && previous < s_usage_max);
+      static_assert(sizeof(this->usage_counter()) == sizeof(UsageValueType));
+      return reinterpret_cast<UsageValueType const *>(&this->usage_counter());
     }
 
-    // Decrement the usage counter and return true if it reaches zero or was invalid.
-    bool
+    // Return the usage count, which includes the spilled count of a saturated spill counter.
+    UsageValueType
+    use_count() const noexcept
+    {
+      UsageValueType const count = (this->usage_counter().get_count() & s_usage_mask);
+      if constexpr (s_spill)
+      {
+        return SpillTable::total<UsageValueType>(this, SpillTable::Kind::e_usage, count, s_usage_max);
+      }
+      return count;
+    }
+
+    // Increment the usage counter, or the spilled count if a spill counter is saturated.
+    void
+    add_ref() noexcept
+    {
+      if constexpr (s_spill)
+      {
+        [[maybe_unused]] bool const incremented = SpillTable::increment(
+          this, SpillTable::Kind::e_usage, this->usage_counter(), s_usage_mask, s_usage_one, s_usage_max);
+        PNTR_ASSERT(incremented);
+        return;
+      }
+      [[maybe_unused]] UsageValueType const previous = (this->usage_counter().increment(s_usage_one) & s_usage_mask);
+      PNTR_ASSERT(previous > s_usage_zero && previous < s_usage_max);
+    }
+
+    // Increment the usage counter by the given number of references at once.
+    void
+    add_ref(UsageValueType const p_count) noexcept
+    {
+      if constexpr (s_spill)
+      {
+        for (UsageValueType i = s_usage_zero; i < p_count; ++i)
+        {
+          add_ref();
+        }
+        return;
+      }
+      [[maybe_unused]] UsageValueType const previous =
+        (this->usage_counter().increment(static_cast<UsageValueType>(p_count * s_usage_one)) & s_usage_mask);
+      PNTR_ASSERT(previous > s_usage_zero && previous < s_usage_max && p_count <= s_usage_max - previous);
+    }
+
+    // Decrement the usage counter and return true if it reaches zero or was invalid.
+    bool
     release() noexcept
     {
-      UsageValueType const previous = (this->usage_counter().decrement(s_usage_one) & s_usage_mask);
+      UsageValueType previous = s_usage_zero;
+      if constexpr (s_spill)
+      {
+        // The release of a spilled reference returns max, which is not the last reference.
+        previous = SpillTable::decrement(this, SpillTable::Kind::e_usage, this->usage_counter(), s_usage_mask,
+                                         s_usage_one, s_usage_max);
+      }
+      else
+      {
+        previous = (this->usage_counter().decrement(s_usage_one) & s_usage_mask);
+      }
       if (previous > s_usage_one && previous <= s_usage_max)
       {
         return false;
@@ -851,9 +1484,39 @@ namespace detail
       return true;
     }
 
+    // Decrement the usage counter by the given number of references at once, and return true if it
+    // reaches zero or was invalid.
+    bool
+    release(UsageValueType const p_count) noexcept
+    {
+      PNTR_ASSERT(p_count >= s_usage_one);
+      if constexpr (s_spill)
+      {
+        for (UsageValueType i = s_usage_one; i < p_count; ++i)
+        {
+          [[maybe_unused]] bool const last = release();
+          PNTR_ASSERT(!last);
+        }
+        return release();
+      }
+      UsageValueType const previous =
+        (this->usage_counter().decrement(static_cast<UsageValueType>(p_count * s_usage_one)) & s_usage_mask);
+      if (previous > p_count && previous <= s_usage_max)
+      {
+        return false;
+      }
+      if (previous != p_count)
+      {
+        PNTR_ASSERT(previous == s_uncontrolled);
+        // Undo decrement on invalid counter.
+        this->usage_counter().increment(static_cast<UsageValueType>(p_count * s_usage_one));
+      }
+      return true;
+    }
+
     // If the usage counter is
     // - uncontrolled: Initialize it with its first reference and return ControlStatus::e_acquired
-    // - zero or max:  Return ControlStatus::e_invalid
+    // - zero or max:  Return ControlStatus::e_invalid, unless a spill counter spills at max
     // - otherwise:    Increment it and return ControlStatus::e_shared
     ControlStatus
     try_control() noexcept
@@ -866,6 +1529,13 @@ namespace detail
       {
         return ControlStatus::e_acquired;
       }
+      if constexpr (s_spill)
+      {
+        return (SpillTable::increment(this, SpillTable::Kind::e_usage, this->usage_counter(), s_usage_mask,
+                                      s_usage_one, s_usage_max)
+                  ? ControlStatus::e_shared
+                  : ControlStatus::e_invalid);
+      }
       while ((count & s_usage_mask) > s_usage_zero && (count & s_usage_mask) < s_usage_max
              && !this->usage_counter().compare_exchange_weak(count, count + s_usage_one))
       {}
@@ -875,9 +1545,15 @@ namespace detail
     }
 
     // Increment the usage counter if it is not zero or max, and return true if it was incremented.
+    // A saturated spill counter increments the spilled count instead.
     bool
     try_add_ref() noexcept
     {
+      if constexpr (s_spill)
+      {
+        return SpillTable::increment(this, SpillTable::Kind::e_usage, this->usage_counter(), s_usage_mask, s_usage_one,
+                                     s_usage_max);
+      }
       UsageValueType count = this->usage_counter().get_count();
       while ((count & s_usage_mask) > s_usage_zero && (count & s_usage_mask) < s_usage_max
              && !this->usage_counter().compare_exchange_weak(count, count + s_usage_one))
@@ -905,9 +1581,12 @@ namespace detail
     static constexpr UsageValueType s_uncontrolled = s_usage_mask;
     static constexpr UsageValueType s_usage_max =
       (Base::s_shared_offset ? (s_uncontrolled >> 1u) : s_uncontrolled - s_usage_one);
+    static constexpr bool s_spill = is_spill<t_counter<t_storage>>;
 
     // At least two bits are required for the usage count.
     static_assert(Base::s_usage_bits >= 2u);
+    // A spill counter has to tell its maximum from its last reference.
+    static_assert(!s_spill || s_usage_max > s_usage_one);
 
     friend ControlDataOffset<t_counter, t_storage, t_usage_bits, t_weak_bits, t_offset_bits, t_size_bits, t_align_bits>;
   };
@@ -969,17 +1648,29 @@ namespace detail
       return s_weak_max;
     }
 
-    // Return the weak count.
+    // Return the weak count, which includes the spilled count of a saturated spill counter.
     WeakValueType
     weak_count() const noexcept
     {
-      return ((this->weak_counter().get_count() & s_weak_mask) >> Base::s_weak_shift);
+      WeakValueType const count = ((this->weak_counter().get_count() & s_weak_mask) >> Base::s_weak_shift);
+      if constexpr (s_spill)
+      {
+        return SpillTable::total<WeakValueType>(this, SpillTable::Kind::e_weak, count, s_weak_max);
+      }
+      return count;
     }
 
-    // Increment the weak counter.
+    // Increment the weak counter, or the spilled count if a spill counter is saturated.
     void
     weak_add_ref() noexcept
     {
+      if constexpr (s_spill)
+      {
+        [[maybe_unused]] bool const incremented = SpillTable::increment(
+          this, SpillTable::Kind::e_weak, this->weak_counter(), s_weak_mask, s_weak_one_shifted, s_weak_mask);
+        PNTR_ASSERT(incremented);
+        return;
+      }
       [[maybe_unused]] WeakValueType const previous =
         ((this->weak_counter().increment(s_weak_one_shifted) & s_weak_mask) >> Base::s_weak_shift);
       PNTR_ASSERT(previous < s_weak_max);
@@ -989,8 +1680,18 @@ namespace detail
     bool
     weak_release() noexcept
     {
-      WeakValueType const previous =
-        ((this->weak_counter().decrement(s_weak_one_shifted) & s_weak_mask) >> Base::s_weak_shift);
+      WeakValueType previous = s_weak_zero;
+      if constexpr (s_spill)
+      {
+        // The release of a spilled reference returns max, which is not the last reference.
+        previous = (SpillTable::decrement(this, SpillTable::Kind::e_weak, this->weak_counter(), s_weak_mask,
+                                          s_weak_one_shifted, s_weak_mask)
+                    >> Base::s_weak_shift);
+      }
+      else
+      {
+        previous = ((this->weak_counter().decrement(s_weak_one_shifted) & s_weak_mask) >> Base::s_weak_shift);
+      }
       if (previous > s_weak_one)
       {
         return false;
@@ -1011,6 +1712,7 @@ namespace detail
     static constexpr WeakValueType s_weak_max =
       (std::numeric_limits<WeakValueType>::max() >> (type_bits<WeakValueType>() - Base::s_weak_bits));
     static constexpr WeakValueType s_weak_mask = (s_weak_max << Base::s_weak_shift);
+    static constexpr bool s_spill = is_spill<t_counter<t_storage>>;
 
     // At least two bits are required for the weak count.
     static_assert(Base::s_weak_bits >= 2u);
@@ -1468,6 +2170,23 @@ namespace detail
       return true;
     }
 
+    // Try to set the user bits selected by the mask, and keep the others, in a single atomic
+    // update. Return true on success.
+    bool
+    try_set_user(DataValueType const p_user, DataValueType const p_mask) noexcept
+    {
+      if (p_mask > s_user_max || (p_user & ~p_mask) != 0u)
+      {
+        return false;
+      }
+      DataValueType const user = static_cast<DataValueType>(p_user << Base::s_user_shift);
+      DataValueType const mask = static_cast<DataValueType>(p_mask << Base::s_user_shift);
+      DataValueType count = this->data().get_count();
+      while (!this->data().compare_exchange_weak(count, ((count & ~mask) | user)))
+      {}
+      return true;
+    }
+
   private:
     static constexpr DataValueType s_user_max =
       (std::numeric_limits<DataValueType>::max() >> (type_bits<DataValueType>() - Base::s_user_bits));
@@ -1511,6 +2230,12 @@ namespace detail
       return (p_user == s_user_zero);
     }
 
+    bool
+    try_set_user(DataValueType const p_user, DataValueType const) noexcept
+    {
+      return (p_user == s_user_zero);
+    }
+
   private:
     static constexpr DataValueType s_user_zero = static_cast<DataValueType>(0u);
   };
@@ -1567,17 +2292,69 @@ namespace detail
   };
 
   template<class t_shared_base, class t_data, class t_allocator>
-  class AllocAdaptDataFunction<t_shared_base, t_data, t_allocator, std::enable_if_t<t_allocator::SupportsStatic::value>>
+  class AllocAdaptDataFunction<
+    t_shared_base, t_data, t_allocator,
+    std::enable_if_t<t_allocator::SupportsStatic::value && !SupportsStaticIndex<t_allocator>::value>>
+  : public AllocAdaptData<t_shared_base, t_data, t_allocator>
+  {
+    using Base = AllocAdaptData<t_shared_base, t_data, t_allocator>;
+
+  public:
+    using Function = typename Base::Function;
+
+    explicit AllocAdaptDataFunction(typename t_data::DataValueType const p_user_init) noexcept
+    : Base(p_user_init)
+    {}
+
+    template<Function t_function>
+    void
+    set_function() noexcept
+    {
+      m_function = t_function;
+    }
+
+    Function
+    function() const noexcept
+    {
+      return m_function;
+    }
+
+  private:
+    Function m_function{};
+  };
+
+  // Stores the index of the function in the user bits instead of the function pointer.
+  template<class t_shared_base, class t_data, class t_allocator>
+  class AllocAdaptDataFunction<t_shared_base, t_data, t_allocator,
+                               std::enable_if_t<SupportsStaticIndex<t_allocator>::value>>
   : public AllocAdaptData<t_shared_base, t_data, t_allocator>
   {
     using Base = AllocAdaptData<t_shared_base, t_data, t_allocator>;
+    using Registry = TypeRegistry<typename Base::Function>;
+
+    static_assert(t_data::get_max_user() >= Registry::s_capacity - 1u,
+                  "The control data doesn't have enough user bits for the type index");
+    static_assert(!HasUserIndex<t_allocator>::value, "The user bits are already used by the allocator index");
 
   public:
+    using Function = typename Base::Function;
+
     explicit AllocAdaptDataFunction(typename t_data::DataValueType const p_user_init) noexcept
     : Base(p_user_init)
     {}
 
-    typename Base::Function m_function{};
+    template<Function t_function>
+    void
+    set_function() noexcept
+    {
+      this->m_data.try_set_user(static_cast<typename t_data::DataValueType>(Registry::template index<t_function>()));
+    }
+
+    Function
+    function() const noexcept
+    {
+      return Registry::get(static_cast<std::size_t>(this->m_data.get_user()));
+    }
   };
 
 
@@ -1597,6 +2374,13 @@ namespace detail
       return m_allocator;
     }
 
+    template<class t_forward>
+    void
+    set_allocator(t_forward && p_allocator) noexcept
+    {
+      m_allocator = std::forward<t_forward>(p_allocator);
+    }
+
   private:
     t_allocator m_allocator;
   };
@@ -1618,6 +2402,41 @@ namespace detail
     {
       return *this;
     }
+
+    template<class t_forward>
+    void
+    set_allocator(t_forward && p_allocator) noexcept
+    {
+      allocator() = std::forward<t_forward>(p_allocator);
+    }
+  };
+
+  template<class t_shared_base, class t_data, class t_allocator>
+  class AllocAdaptBase<t_shared_base, t_data, t_allocator,
+                       std::enable_if_t<HasUserIndex<t_allocator>::value && !is_empty_base<t_allocator>>>
+  : public AllocAdaptDataFunction<t_shared_base, t_data, t_allocator>
+  {
+    static_assert(t_data::get_max_user() >= t_allocator::get_max_index(),
+                  "The control data doesn't have enough user bits for the allocator index");
+
+  public:
+    using SupportsStatic = typename t_allocator::SupportsStatic;
+
+    explicit AllocAdaptBase(typename t_data::DataValueType const p_user_init) noexcept
+    : AllocAdaptDataFunction<t_shared_base, t_data, t_allocator>(p_user_init)
+    {}
+
+    t_allocator
+    allocator() const noexcept
+    {
+      return t_allocator::from_index(static_cast<std::size_t>(this->m_data.get_user()));
+    }
+
+    void
+    set_allocator(t_allocator const & p_allocator) noexcept
+    {
+      this->m_data.try_set_user(static_cast<typename t_data::DataValueType>(p_allocator.index()));
+    }
   };
 } // namespace detail
 
@@ -1730,7 +2549,7 @@ namespace detail
       std::size_t offset = 0u;
       if constexpr (s_supports_static)
       {
-        p_self.m_function = destroy_or_deallocate<t_shared>;
+        p_self.template set_function<destroy_or_deallocate<t_shared>>();
         if constexpr (!is_static_castable<t_shared>)
         {
           offset = calc_base_offset(p_shared);
@@ -1756,12 +2575,12 @@ namespace detail
         {
           if constexpr (s_supports_static)
           {
-            p_self.allocator() = std::forward<t_forward>(p_allocator);
+            p_self.set_allocator(std::forward<t_forward>(p_allocator));
             return p_shared;
           }
           else if (p_self.m_data.try_set_offset(offset))
           {
-            p_self.allocator() = std::forward<t_forward>(p_allocator);
+            p_self.set_allocator(std::forward<t_forward>(p_allocator));
             return p_shared;
           }
           else
@@ -1791,10 +2610,11 @@ namespace detail
     {
       if constexpr (s_supports_static)
       {
-        PNTR_TRY_LOG_ERROR(this->m_function == nullptr, "Invalid function pointer");
-        if (this->m_function != nullptr)
+        typename Base::Function const type_function = this->function();
+        PNTR_TRY_LOG_ERROR(type_function == nullptr, "Invalid function pointer");
+        if (type_function != nullptr)
         {
-          this->m_function(*this, p_control, Mode::e_destroy);
+          type_function(*this, p_control, Mode::e_destroy);
         }
       }
       else
@@ -1808,10 +2628,11 @@ namespace detail
     {
       if constexpr (s_supports_static)
       {
-        PNTR_TRY_LOG_ERROR(p_self.m_function == nullptr, "Invalid function pointer");
-        if (p_self.m_function != nullptr)
+        typename Base::Function const type_function = p_self.function();
+        PNTR_TRY_LOG_ERROR(type_function == nullptr, "Invalid function pointer");
+        if (type_function != nullptr)
         {
-          p_self.m_function(p_self, p_control, Mode::e_deallocate);
+          type_function(p_self, p_control, Mode::e_deallocate);
         }
       }
       else
@@ -1999,7 +2820,7 @@ namespace detail
       std::size_t offset = 0u;
       if constexpr (s_supports_static)
       {
-        p_self.m_function = destroy_or_deallocate<t_shared>;
+        p_self.template set_function<destroy_or_deallocate<t_shared>>();
         if constexpr (!is_static_castable<t_shared>)
         {
           offset = calc_base_offset(p_shared);
@@ -2015,14 +2836,14 @@ namespace detail
         {
           if constexpr (s_supports_static)
           {
-            p_self.allocator() = std::forward<t_forward>(p_allocator);
+            p_self.set_allocator(std::forward<t_forward>(p_allocator));
             return p_shared;
           }
           else if (p_self.m_data.try_set_offset(offset))
           {
             p_self.m_data.try_set_size(calc_base_size_offset<t_shared>());
             p_self.m_data.try_set_align(calc_base_align_offset<t_shared>());
-            p_self.allocator() = std::forward<t_forward>(p_allocator);
+            p_self.set_allocator(std::forward<t_forward>(p_allocator));
             return p_shared;
           }
           else
@@ -2048,10 +2869,11 @@ namespace detail
     {
       if constexpr (s_supports_static)
       {
-        PNTR_TRY_LOG_ERROR(this->m_function == nullptr, "Invalid function pointer");
-        if (this->m_function != nullptr)
+        typename Base::Function const type_function = this->function();
+        PNTR_TRY_LOG_ERROR(type_function == nullptr, "Invalid function pointer");
+        if (type_function != nullptr)
         {
-          this->m_function(*this, p_control, Mode::e_destroy);
+          type_function(*this, p_control, Mode::e_destroy);
         }
       }
       else
@@ -2065,10 +2887,11 @@ namespace detail
     {
       if constexpr (s_supports_static)
       {
-        PNTR_TRY_LOG_ERROR(p_self.m_function == nullptr, "Invalid function pointer");
-        if (p_self.m_function != nullptr)
+        typename Base::Function const type_function = p_self.function();
+        PNTR_TRY_LOG_ERROR(type_function == nullptr, "Invalid function pointer");
+        if (type_function != nullptr)
         {
-          p_self.m_function(p_self, p_control, Mode::e_deallocate);
+          type_function(p_self, p_control, Mode::e_deallocate);
         }
       }
       else
@@ -2393,6 +3216,9 @@ PNTR_NAMESPACE_END
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <cstddef>
+#include <utility>
+
 PNTR_NAMESPACE_BEGIN
 
 
@@ -2417,6 +3243,13 @@ namespace detail
       return *this;
     }
 
+    template<class t_forward>
+    void
+    set_deleter(t_forward && p_deleter) noexcept
+    {
+      deleter() = std::forward<t_forward>(p_deleter);
+    }
+
     template<class t_shared>
     void
     init() noexcept
@@ -2447,6 +3280,13 @@ namespace detail
       return *this;
     }
 
+    template<class t_forward>
+    void
+    set_deleter(t_forward && p_deleter) noexcept
+    {
+      deleter() = std::forward<t_forward>(p_deleter);
+    }
+
     template<class t_shared>
     void
     init() noexcept
@@ -2477,6 +3317,13 @@ namespace detail
       return m_deleter;
     }
 
+    template<class t_forward>
+    void
+    set_deleter(t_forward && p_deleter) noexcept
+    {
+      deleter() = std::forward<t_forward>(p_deleter);
+    }
+
     template<class t_shared>
     void
     init() noexcept
@@ -2511,6 +3358,13 @@ namespace detail
       return m_deleter;
     }
 
+    template<class t_forward>
+    void
+    set_deleter(t_forward && p_deleter) noexcept
+    {
+      deleter() = std::forward<t_forward>(p_deleter);
+    }
+
     template<class t_shared>
     void
     init() noexcept
@@ -2527,6 +3381,47 @@ namespace detail
     t_data m_data;
     t_deleter m_deleter;
   };
+
+  // ControlDeleter with a templated deleter which is restored from an index in the user bits
+  template<class t_shared_base, class t_data, typename t_deleter>
+  class ControlDeleterIndexed;
+
+  template<class t_shared_base, class t_data, template<class> class t_deleter>
+  class ControlDeleterIndexed<t_shared_base, t_data, t_deleter<t_shared_base>>
+  {
+    static_assert(t_data::get_max_user() >= t_deleter<t_shared_base>::get_max_index(),
+                  "The control data doesn't have enough user bits for the deleter index");
+
+  public:
+    explicit ControlDeleterIndexed(typename t_data::DataValueType const p_user_init) noexcept
+    : m_data(p_user_init)
+    {}
+
+    template<class t_forward>
+    void
+    set_deleter(t_forward && p_deleter) noexcept
+    {
+      m_data.try_set_user(static_cast<typename t_data::DataValueType>(p_deleter.index()));
+    }
+
+    template<class t_shared>
+    void
+    init() noexcept
+    {
+      set_deleter(t_deleter<t_shared>());
+    }
+
+    template<class t_shared>
+    static void
+    destroy(ControlDeleterIndexed & p_self, t_shared * p_shared) noexcept
+    {
+      t_deleter<t_shared_base> const deleter =
+        t_deleter<t_shared_base>::from_index(static_cast<std::size_t>(p_self.m_data.get_user()));
+      deleter(p_shared);
+    }
+
+    t_data m_data;
+  };
 } // namespace detail
 
 
@@ -2534,68 +3429,325 @@ PNTR_NAMESPACE_END
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                    pntr/AllocatorMalloc.hpp                                    //
+//                                 pntr/detail/WeakSideTable.hpp                                  //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
-#include <cstdlib>
+#include <atomic>
+#include <limits>
 
 PNTR_NAMESPACE_BEGIN
 
 
-////////////////////////////////////////////////////////////////////////////////////////////////////
-//                                                                                                //
-//                                        AllocatorMalloc                                         //
-//                                                                                                //
-//                    An allocator for 'ControlAlloc' which uses 'std::malloc'                    //
-//                                                                                                //
-////////////////////////////////////////////////////////////////////////////////////////////////////
+namespace detail
+{
+  // Maps the addresses of control blocks to their weak side blocks.
+  class WeakSideTable: public ShardedMap<void *>
+  {
+  public:
+    static WeakSideTable &
+    instance() noexcept
+    {
+      return immortal<WeakSideTable>();
+    }
+  };
 
-//
-//  'AllocatorMalloc' uses 'std::malloc' and related functions to allocate memory. 'ControlAlloc'
-//  can save a pointer offset between a created object and its shared base, which makes it possible
-//  to restore and deallocate the original pointer without storing the object's type information.
-//
-//  The number of bits used for the stored pointer offset is configurable in the control data block
-//  and can usually be quite small to minimize the intrusive control block size. It can even be set
-//  to zero for classes where the shared base class is at the front of the memory layout of the
-//  created class.
-//
-//  The template parameter can be configured with 'StaticSupport' to enable the proper destruction
-//  of non-polymorphic classes. In this case the control block will store an additonal pointer to
-//  save type information.
-//
-//  The Microsoft Standard Library does not support 'std::aligned_alloc', see
-//  https://en.cppreference.com/w/cpp/memory/c/aligned_alloc
-//  Instead it provides '_aligned_malloc', which is not compatible with 'std::free'. It requires
-//  to use '_aligned_free', but 'AllocatorMalloc::deallocate' doesn't have alignment information
-//  of the created type. It would be possible to always use '_alligned_malloc' and '_aligned_free',
-//  but this would probably cause a performance penalty. So, it is necessary to use a bit in the
-//  pointer offset to store the information which function has to be used to free the memory block.
-//  A static assertion ensures that this bit is available for types with special alignment.
-//
 
-template<class t_static_support = NoStaticSupport>
-class AllocatorMalloc
-{
-public:
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-  //                                                                                            //
-  //      The type definitions and member functions required by 'ControlAlloc' start here       //
-  //                                                                                            //
-  ////////////////////////////////////////////////////////////////////////////////////////////////
+  // The block referenced by 'WeakPtr' for a control block without weak counter, which is allocated
+  // when the first weak reference is created. Its weak count includes one reference for the object
+  // until it expires, like the weak counter of 'ControlData'.
+  template<class t_control>
+  class WeakSideBlock
+  {
+  public:
+    using UsageValueType = typename t_control::UsageValueType;
+    using WeakValueType = typename t_control::WeakValueType;
 
-  // 'SupportsStatic' has to be either 'StaticSupport' or 'NoStaticSupport'. The former will
-  // request 'ControlAlloc' to store type information in an additonal pointer in the control
-  // block that supports the correct object destruction and deallocation from shared pointers
-  // to non-polymorphic base classes.
-  using SupportsStatic = t_static_support;
+    explicit WeakSideBlock(t_control & p_control) noexcept
+    : m_control(&p_control)
+    , m_owner(&p_control)
+    , m_weak_count(1u)
+    {}
 
-  // 'ControlAlloc' identifies the type of this allocator with this type definition.
-  using PointerDeallocate = void;
+    // Increment the weak counter.
+    void
+    weak_add_ref() noexcept
+    {
+      [[maybe_unused]] WeakValueType const previous = m_weak_count.fetch_add(1u, std::memory_order_relaxed);
+      PNTR_ASSERT(previous > 0u && previous < std::numeric_limits<WeakValueType>::max());
+    }
 
-  // Allocate a memory block.
-  void *
+    // Increment the weak counter.
+    static WeakSideBlock *
+    weak_add_ref(WeakSideBlock * const p_block) noexcept
+    {
+      if (p_block != nullptr)
+      {
+        p_block->weak_add_ref();
+      }
+      return p_block;
+    }
+
+    // Decrement the weak counter and return true if it reaches zero.
+    bool
+    weak_release() noexcept
+    {
+      return (m_weak_count.fetch_sub(1u, std::memory_order_acq_rel) == 1u);
+    }
+
+    // Deallocate the block. Called when the weak count reaches zero.
+    static void
+    deallocate(WeakSideBlock * const p_block) noexcept
+    {
+      delete p_block;
+    }
+
+    // Return the usage count of the object, or zero if it has expired.
+    UsageValueType
+    use_count() const noexcept
+    {
+      Guard const guard(*this);
+      return (m_control != nullptr ? m_control->use_count() : UsageValueType{});
+    }
+
+    // Return the weak count.
+    WeakValueType
+    weak_count() const noexcept
+    {
+      return m_weak_count.load(std::memory_order_relaxed);
+    }
+
+    // Try to increment the usage counter and return a pointer to the shared object on success.
+    // The lock prevents that the object is deallocated in the meantime, see 'expire'.
+    template<class t_shared>
+    t_shared *
+    try_get_shared() noexcept
+    {
+      Guard const guard(*this);
+      return (m_control != nullptr ? m_control->template try_get_shared<t_shared>() : nullptr);
+    }
+
+    // Return the address of the control block, even after the object has expired.
+    void const *
+    get_owner() const noexcept
+    {
+      return m_owner;
+    }
+
+    // Detach the block from the object before it is deallocated.
+    void
+    expire() noexcept
+    {
+      Guard const guard(*this);
+      m_control = nullptr;
+    }
+
+  private:
+    // A spin lock, as it is only held for a few instructions.
+    class Guard
+    {
+    public:
+      explicit Guard(WeakSideBlock const & p_block) noexcept
+      : m_lock(p_block.m_lock)
+      {
+        while (m_lock.test_and_set(std::memory_order_acquire))
+        {}
+      }
+
+      ~Guard()
+      {
+        m_lock.clear(std::memory_order_release);
+      }
+
+      Guard(Guard const &) = delete;
+      Guard & operator=(Guard const &) = delete;
+
+    private:
+      std::atomic_flag & m_lock;
+    };
+
+    mutable std::atomic_flag m_lock = ATOMIC_FLAG_INIT;
+    t_control * m_control;
+    void const * const m_owner;
+    std::atomic<WeakValueType> m_weak_count;
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                   pntr/detail/NumaPolicy.hpp                                   //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__linux__)
+
+  #include <climits>
+  #include <cstddef>
+
+  #include <sys/syscall.h>
+  #include <unistd.h>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The memory policy system calls, which are used directly to avoid a dependency on 'libnuma'.
+  // All functions fall back to a single node if the kernel doesn't support NUMA.
+  struct NumaPolicy
+  {
+    static constexpr int s_preferred = 1;
+    static constexpr unsigned long s_flag_node = 1u;
+    static constexpr unsigned long s_flag_address = 2u;
+    static constexpr unsigned long s_flag_mems_allowed = 4u;
+    static constexpr std::size_t s_max_nodes = 1024u;
+    static constexpr std::size_t s_mask_bits = sizeof(unsigned long) * CHAR_BIT;
+    // The number of calls of 'current_node' before the node of the thread is read again.
+    static constexpr unsigned s_node_refresh = 1024u;
+
+    // Return the number of nodes, including nodes which the process isn't allowed to use.
+    static std::size_t
+    node_count() noexcept
+    {
+      unsigned long mask[s_max_nodes / s_mask_bits] = {};
+      int mode = 0;
+      if (::syscall(SYS_get_mempolicy, &mode, mask, s_max_nodes, nullptr, s_flag_mems_allowed) != 0)
+      {
+        return 1u;
+      }
+      std::size_t count = 1u;
+      for (std::size_t node = 0u; node < s_max_nodes; ++node)
+      {
+        if ((mask[node / s_mask_bits] >> (node % s_mask_bits) & 1u) != 0u)
+        {
+          count = node + 1u;
+        }
+      }
+      return count;
+    }
+
+    // Return the node of the CPU the calling thread is running on. The result is cached, as the
+    // thread might be migrated at any time anyway.
+    static unsigned
+    current_node() noexcept
+    {
+      struct Cache
+      {
+        unsigned m_node = 0u;
+        unsigned m_countdown = 0u;
+      };
+      static thread_local Cache s_cache;
+      if (s_cache.m_countdown-- == 0u)
+      {
+        unsigned cpu = 0u;
+        unsigned node = 0u;
+        s_cache.m_node = (::syscall(SYS_getcpu, &cpu, &node, nullptr) == 0 ? node : 0u);
+        s_cache.m_countdown = s_node_refresh;
+      }
+      return s_cache.m_node;
+    }
+
+    // Prefer the given node for the pages of the memory range, which must not be touched yet.
+    // Return false on failure, in which case the pages are allocated by the default policy.
+    static bool
+    bind(void * const p_address, std::size_t const p_size, unsigned const p_node) noexcept
+    {
+      if (p_node >= s_max_nodes)
+      {
+        return false;
+      }
+      unsigned long mask[s_max_nodes / s_mask_bits] = {};
+      mask[p_node / s_mask_bits] = 1ul << (p_node % s_mask_bits);
+      return (::syscall(SYS_mbind, p_address, p_size, s_preferred, mask, s_max_nodes, 0u) == 0);
+    }
+
+    // Return the node of the page at the given address, or -1 if it is unknown.
+    static int
+    node_of(void const * const p_address) noexcept
+    {
+      int node = -1;
+      if (::syscall(SYS_get_mempolicy, &node, nullptr, 0ul, p_address, s_flag_node | s_flag_address) != 0)
+      {
+        return -1;
+      }
+      return node;
+    }
+  };
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                    pntr/AllocatorMalloc.hpp                                    //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstdlib>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        AllocatorMalloc                                         //
+//                                                                                                //
+//                    An allocator for 'ControlAlloc' which uses 'std::malloc'                    //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'AllocatorMalloc' uses 'std::malloc' and related functions to allocate memory. 'ControlAlloc'
+//  can save a pointer offset between a created object and its shared base, which makes it possible
+//  to restore and deallocate the original pointer without storing the object's type information.
+//
+//  The number of bits used for the stored pointer offset is configurable in the control data block
+//  and can usually be quite small to minimize the intrusive control block size. It can even be set
+//  to zero for classes where the shared base class is at the front of the memory layout of the
+//  created class.
+//
+//  The template parameter can be configured with 'StaticSupport' to enable the proper destruction
+//  of non-polymorphic classes. In this case the control block will store an additonal pointer to
+//  save type information. With 'StaticSupportIndex' it stores a type index in 8 user bits of the
+//  control data instead, see 'detail::TypeRegistry'.
+//
+//  The Microsoft Standard Library does not support 'std::aligned_alloc', see
+//  https://en.cppreference.com/w/cpp/memory/c/aligned_alloc
+//  Instead it provides '_aligned_malloc', which is not compatible with 'std::free'. It requires
+//  to use '_aligned_free', but 'AllocatorMalloc::deallocate' doesn't have alignment information
+//  of the created type. It would be possible to always use '_alligned_malloc' and '_aligned_free',
+//  but this would probably cause a performance penalty. So, it is necessary to use a bit in the
+//  pointer offset to store the information which function has to be used to free the memory block.
+//  A static assertion ensures that this bit is available for types with special alignment.
+//
+
+template<class t_static_support = NoStaticSupport>
+class AllocatorMalloc
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //      The type definitions and member functions required by 'ControlAlloc' start here       //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // 'SupportsStatic' has to be either 'StaticSupport' or 'NoStaticSupport'. The former will
+  // request 'ControlAlloc' to store type information in an additonal pointer in the control
+  // block that supports the correct object destruction and deallocation from shared pointers
+  // to non-polymorphic base classes. 'StaticSupportIndex' stores a type index in the user bits.
+  using SupportsStatic = t_static_support;
+
+  // 'ControlAlloc' identifies the type of this allocator with this type definition.
+  using PointerDeallocate = void;
+
+  // Allocate a memory block.
+  void *
   allocate(std::size_t p_size, std::size_t p_alignment) noexcept
   {
     void * const storage = (p_alignment <= alignof(std::max_align_t) ? std::malloc(p_size)
@@ -2845,172 +3997,224 @@ PNTR_NAMESPACE_END
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                        pntr/Deleter.hpp                                        //
+//                             pntr/AllocatorMemoryResourceIndex.hpp                              //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <version>
+#ifdef __cpp_lib_memory_resource
+  #include <atomic>
+  #include <cstddef>
+  #include <memory_resource>
+  #include <mutex>
+  #include <stdexcept>
+
 PNTR_NAMESPACE_BEGIN
 
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                            Deleter                                             //
+//                                     MemoryResourceRegistry                                     //
 //                                                                                                //
-//                 A deleter for 'ControlNew' which saves the shared object type                  //
+//           A global table of memory resources, which are identified by a small index            //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 //
-//  During construction this deleter saves a pointer to a function that casts the shared object
-//  pointer to the original type before it is deleted. This makes it possible to use 'SharedPtr'
-//  with base classes of non-polymorphic class hierarchies.
+//  The index zero is reserved for the default resource, as returned by
+//  'std::pmr::get_default_resource' when the registry is used first. Registering a resource twice
+//  returns the same index. The registry is 'detail::immortal', so the destructors of static
+//  objects can still use it.
 //
-//  It requires the size of a pointer in the control block, so it is more efficient not to use it
-//  with polymorphic types where it is safe to call the virtual destructor of the base class.
+//  A resource must not be removed while there are still objects allocated from it, and its index
+//  must not be used anymore afterwards. Looking up a resource doesn't lock the registry.
 //
 
-template<typename t_shared>
-struct Deleter
+class MemoryResourceRegistry
 {
-  using SharedBase = std::remove_const_t<detail::BaseType<t_shared>>;
-
-  Deleter & operator=(Deleter &&) = default;
-  Deleter & operator=(Deleter const &) = default;
-
-  template<typename t_other,
-           typename = std::enable_if_t<std::is_convertible_v<std::remove_const_t<t_other> *, t_shared *>>>
-  Deleter(Deleter<t_other> const & p_other) noexcept
-  : m_delete_function(p_other.m_delete_function)
-#ifndef PNTR_UNITTESTS
-  {}
-
-  constexpr Deleter() noexcept = default;
-  Deleter(Deleter const &) noexcept = default;
-  Deleter(Deleter &&) noexcept = default;
-
-#else
-  {
-    ++g_deleter_construct;
-  }
-
-  Deleter() noexcept
-  {
-    ++g_deleter_construct;
-  }
+public:
+  static constexpr std::size_t s_capacity = 256u;
 
-  Deleter(Deleter const & p_deleter) noexcept
-  : m_delete_function(p_deleter.m_delete_function)
+  // Register the resource and return its index. Throws 'std::length_error' if the registry is full.
+  static std::size_t
+  add(std::pmr::memory_resource * const p_resource)
   {
-    ++g_deleter_construct;
+    PNTR_ASSERT(p_resource != nullptr);
+    MemoryResourceRegistry & registry = instance();
+    std::lock_guard<std::mutex> const lock(registry.m_mutex);
+    std::size_t free = s_capacity;
+    for (std::size_t index = 0u; index < s_capacity; ++index)
+    {
+      std::pmr::memory_resource * const resource = registry.m_resources[index].load(std::memory_order_relaxed);
+      if (resource == p_resource)
+      {
+        return index;
+      }
+      if (resource == nullptr && free == s_capacity)
+      {
+        free = index;
+      }
+    }
+    if (free == s_capacity)
+    {
+      throw std::length_error("The memory resource registry is full");
+    }
+    registry.m_resources[free].store(p_resource, std::memory_order_release);
+    return free;
   }
 
-  Deleter(Deleter && p_deleter) noexcept
-  : m_delete_function(p_deleter.m_delete_function)
+  // Unregister the resource with the given index, except for the default resource.
+  static void
+  remove(std::size_t const p_index) noexcept
   {
-    ++g_deleter_construct;
+    PNTR_ASSERT(p_index < s_capacity);
+    if (p_index != 0u)
+    {
+      MemoryResourceRegistry & registry = instance();
+      std::lock_guard<std::mutex> const lock(registry.m_mutex);
+      registry.m_resources[p_index].store(nullptr, std::memory_order_release);
+    }
   }
 
-  ~Deleter() noexcept
+  // Return the resource with the given index, or nullptr.
+  static std::pmr::memory_resource *
+  get(std::size_t const p_index) noexcept
   {
-    ++g_deleter_destroy;
+    PNTR_ASSERT(p_index < s_capacity);
+    return instance().m_resources[p_index].load(std::memory_order_acquire);
   }
 
-#endif
-
-  void
-  operator()(t_shared * p_shared) const noexcept
+private:
+  MemoryResourceRegistry() noexcept
   {
-    static_assert(sizeof(t_shared) != 0u, "incomplete type");
-    m_delete_function(p_shared);
+    m_resources[0].store(std::pmr::get_default_resource(), std::memory_order_relaxed);
   }
 
-private:
-  static void
-  delete_shared(SharedBase const * p_base) noexcept
+  static MemoryResourceRegistry &
+  instance() noexcept
   {
-    delete detail::static_or_dynamic_cast<std::add_const_t<t_shared>>(p_base);
+    return detail::immortal<MemoryResourceRegistry>();
   }
 
-  using DeleteFunction = void (*)(SharedBase const *) noexcept;
-  DeleteFunction m_delete_function = &delete_shared;
+  friend MemoryResourceRegistry & detail::immortal<MemoryResourceRegistry>() noexcept;
 
-  template<typename t_other>
-  friend struct Deleter;
+  std::mutex m_mutex;
+  std::atomic<std::pmr::memory_resource *> m_resources[s_capacity] = {};
 };
 
 
-PNTR_NAMESPACE_END
-
-////////////////////////////////////////////////////////////////////////////////////////////////////
-//                                                                                                //
-//                                      pntr/ControlData.hpp                                      //
-//                                                                                                //
-////////////////////////////////////////////////////////////////////////////////////////////////////
-
-PNTR_NAMESPACE_BEGIN
-
-
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                          ControlData                                           //
+//                                  AllocatorMemoryResourceIndex                                  //
 //                                                                                                //
-//                             The data storage for the control block                             //
+//     An allocator for 'ControlAlloc' which stores the index of a registered memory resource     //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 //
-//  'ControlData' stores unsigned integer data with a combined size of the 't_storage' type, which
-//  is typically one of 'std::uint8_t', 'std::uint16_t', 'std::uint32_t', or 'std::uint64_t'.
-//  't_counter' is a counter template class like 'CounterThreadSafe' or 'CounterThreadUnsafe'.
+//  'AllocatorMemoryResource' stores a pointer to its memory resource in every control block,
+//  which usually requires a 64 bit control value and adds the size of a pointer. Applications with
+//  only a few resources can use 'AllocatorMemoryResourceIndex' instead, which registers the resource
+//  in the 'MemoryResourceRegistry'. 'ControlAlloc' stores its index in the user bits of the control
+//  data instead of the allocator, so the control block can be as small as a 32 bit control value.
 //
-//  The remaining template parameters specify how many bits should be reserved for which purpose:
-//  - 't_usage_bits':  The usage reference counter.
-//  - 't_weak_bits':   The weak reference counter.
-//                     This should be zero for control blocks that don't support weak pointers.
-//  - 't_offset_bits': An offset value to calculate the original pointer for deallocation.
-//                     This can be 'shared_bits' to store the offset in the usage bits after
-//                     the object has been destroyed. This is only possible if the allocator
-//                     requests 'StaticSupport' to store type information in an extra pointer.
-//  - 't_size_bits':   An offset value to calculate the original type size for deallocation.
-//                     Size and align bits are only required for allocators compatible to
-//                     'AllocatorMemoryResource' with 'NoStaticSupport' configuration.
-//  - 't_align_bits':  An offset value to calculate the original type alignment for deallocation.
-//                     This can be zero even for an allocator that requires the alignment,
-//                     if the object types don't exceed standard alignment ('std::max_align_t').
-//  - ('t_user_bits'): The bits used for a custom user value accessible through the 'Intruder'.
-//                     This number is automatically calculated by the unused bits of 't_storage',
-//                     so no bits get wasted to alignment padding.
-//
-//  Specializations of the data storage will use separate usage and weak counters for improved
-//  performance if the bit values allow it. For example it will use 'std::uint32_t' for the usage
-//  counter if the storage type is 'std::uint64_t' with 32 bits reserved for the usage counter.
+//  The control data requires at least 8 user bits, which are not available to the user anymore.
+//  A static assertion ensures that enough bits are available. Like 'AllocatorMemoryResource',
+//  it requires bits for the size and alignment of derived classes, see there.
 //
 
-// clang-format off
+template<class t_static_support = NoStaticSupport>
+class AllocatorMemoryResourceIndex
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //      The type definitions and member functions required by 'ControlAlloc' start here       //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
 
-// A bug in 'Microsoft Visual C++' compiler requires to use type parameters for bit count values
-// instead of a value parameters. 'detail::Bits' converts the values to a type.
+  // See 'AllocatorMemoryResource'.
+  using SupportsStatic = t_static_support;
 
-inline constexpr unsigned shared_bits = std::numeric_limits<unsigned>::max();
+  // 'ControlAlloc' identifies the type of this allocator with this type definition.
+  using TypeInfoDeallocate = void;
 
-template<template<typename> class t_counter,
-         typename t_storage,
-         unsigned t_usage_bits = detail::type_bits<t_storage>(),
-         unsigned t_weak_bits = 0u,
-         unsigned t_offset_bits = 0u,
-         unsigned t_size_bits = 0u,
-         unsigned t_align_bits = 0u>
-using ControlData =
-  detail::ControlDataUser<t_counter, t_storage, detail::Bits<t_usage_bits>, detail::Bits<t_weak_bits>,
-                          detail::Bits<t_offset_bits>, detail::Bits<t_size_bits>, detail::Bits<t_align_bits>>;
+  // 'ControlAlloc' stores the index in the user bits of the control data.
+  using UserIndex = void;
+
+  // Return the maximum index.
+  static constexpr std::size_t
+  get_max_index() noexcept
+  {
+    return MemoryResourceRegistry::s_capacity - 1u;
+  }
+
+  // Restore the allocator from its index.
+  static AllocatorMemoryResourceIndex
+  from_index(std::size_t const p_index) noexcept
+  {
+    AllocatorMemoryResourceIndex allocator;
+    allocator.m_index = static_cast<unsigned char>(p_index);
+    return allocator;
+  }
+
+  // Return the index of the resource.
+  std::size_t
+  index() const noexcept
+  {
+    return m_index;
+  }
+
+  // Allocate a memory block.
+  void *
+  allocate(std::size_t p_size, std::size_t p_alignment) noexcept
+  {
+    return resource()->allocate(p_size, p_alignment);
+  }
+
+  // Deallocate a memory block.
+  void
+  deallocate(void * p_pointer, std::size_t p_size, std::size_t p_alignment) noexcept
+  {
+    resource()->deallocate(p_pointer, p_size, p_alignment);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //       The type definitions and member functions required by 'ControlAlloc' end here        //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // Use the default resource.
+  AllocatorMemoryResourceIndex() noexcept = default;
+
+  // Register the resource if required. Throws 'std::length_error' if the registry is full.
+  AllocatorMemoryResourceIndex(std::pmr::memory_resource * const p_resource)
+  : m_index(static_cast<unsigned char>(MemoryResourceRegistry::add(p_resource)))
+  {}
+
+  std::pmr::memory_resource *
+  resource() const noexcept
+  {
+    std::pmr::memory_resource * const resource = MemoryResourceRegistry::get(m_index);
+    PNTR_ASSERT(resource != nullptr);
+    return resource;
+  }
+
+private:
+  static_assert(MemoryResourceRegistry::s_capacity <= 256u);
+
+  unsigned char m_index = 0u;
+};
 
-// clang-format on
 
 PNTR_NAMESPACE_END
 
+#endif // __cpp_lib_memory_resource
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                     pntr/ControlAlloc.hpp                                      //
+//                                        pntr/Deleter.hpp                                        //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -3019,472 +4223,701 @@ PNTR_NAMESPACE_BEGIN
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                          ControlAlloc                                          //
+//                                            Deleter                                             //
 //                                                                                                //
-//          A control class for 'Intruder', using an allocator, and usage and weak count          //
+//                 A deleter for 'ControlNew' which saves the shared object type                  //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 //
-//  'ControlAlloc' supports three types of allocators:
-//  - Allocators which only require the original untyped pointer for deallocation. The most common
-//    example is 'std::free'. Those allocators are required to provide the type definitions and
-//    member functions as implemented by and documented in the class 'AllocatorMalloc'.
-//  - Allocators which require the original untyped pointer and the size and alignment of the
-//    allocated memory block for deallocation, for example 'std::pmr::memory_resource'. Those
-//    allocators are required to provide the type definitions and member functions as implemented
-//    by and documented in the class 'AllocatorMemoryResource'.
-//  - Allocators which require the original type for deallocation, for example 'std::allocator'.
-//    Those allocators are required to provide the type definitions and member functions as
-//    documented in the C++ Standard Library, see
-//    https://en.cppreference.com/w/cpp/named_req/Allocator
-//
-//  Requires that the shared base class type specified as template argument provides the
-//  type definitions and member functions as implemented by and documented in the class 'Intruder'.
+//  During construction this deleter saves a pointer to a function that casts the shared object
+//  pointer to the original type before it is deleted. This makes it possible to use 'SharedPtr'
+//  with base classes of non-polymorphic class hierarchies.
 //
-//  Requires that the data class type specified as template argument provides the type definitions
-//  and member functions as implemented by and documented in the class 'ControlData'.
+//  It requires the size of a pointer in the control block, so it is more efficient not to use it
+//  with polymorphic types where it is safe to call the virtual destructor of the base class.
 //
 
-template<class t_shared_base, class t_data, class t_allocator>
-class ControlAlloc
+template<typename t_shared>
+struct Deleter
 {
-public:
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-  //                                                                                            //
-  //        The type definitions and member functions required by 'Intruder' start here         //
-  //                                                                                            //
-  ////////////////////////////////////////////////////////////////////////////////////////////////
+  using SharedBase = std::remove_const_t<detail::BaseType<t_shared>>;
 
-  using SharedBase = t_shared_base;
-  using Data = t_data;
-  using Deleter = void;
-  using Allocator = t_allocator;
-  using UsageValueType = typename t_data::UsageValueType;
-  using WeakValueType = typename t_data::WeakValueType;
-  using DataValueType = typename t_data::DataValueType;
-  using SupportsWeak = typename t_data::SupportsWeak;
+  Deleter & operator=(Deleter &&) = default;
+  Deleter & operator=(Deleter const &) = default;
 
-  explicit ControlAlloc(DataValueType const p_user_init) noexcept
-  : m_adapter(p_user_init)
+  template<typename t_other,
+           typename = std::enable_if_t<std::is_convertible_v<std::remove_const_t<t_other> *, t_shared *>>>
+  Deleter(Deleter<t_other> const & p_other) noexcept
+  : m_delete_function(p_other.m_delete_function)
+#ifndef PNTR_UNITTESTS
   {}
 
-  // Allocate storage for a new instance of the specified type, call its constructor
-  // using the forwarded arguments, and return a pointer to it on success.
-  template<class t_shared, class t_nothrow, class t_shared_allocator, typename... t_args>
-  static t_shared *
-  create(t_shared_allocator & p_allocator, t_args &&... p_args) noexcept(t_nothrow::value)
-  {
-    return AllocAdapter::template create<t_shared, t_nothrow>(p_allocator, std::forward<t_args>(p_args)...);
-  }
+  constexpr Deleter() noexcept = default;
+  Deleter(Deleter const &) noexcept = default;
+  Deleter(Deleter &&) noexcept = default;
 
-  // Try to initialize the control pointer object and to forward the allocator to it.
-  template<class t_shared, class t_forward>
-  static t_shared *
-  try_init(ControlAlloc & p_self, t_shared * p_shared, t_forward && p_allocator) noexcept
+#else
   {
-    return AllocAdapter::template try_init(p_self.m_adapter, p_shared, std::forward<t_forward>(p_allocator));
+    ++g_deleter_construct;
   }
 
-  // Try to take control of the given object, either by taking new or by sharing the existing
-  // ownership. Return a pointer to the given object on success.
-  template<class t_shared>
-  t_shared *
-  try_control(t_shared & p_shared) noexcept
+  Deleter() noexcept
   {
-    // Check if the address returned from get_shared_base() is equal
-    // to the address of the implicitly upcasted shared instance.
-    if (t_shared::get_shared_base(*this) != &p_shared)
-    {
-      return nullptr;
-    }
-    return (m_adapter.m_data.try_control() != ControlStatus::e_invalid ? &p_shared : nullptr);
+    ++g_deleter_construct;
   }
 
-  // Try to increment the usage counter and return a pointer to the shared object on success.
-  template<class t_shared>
-  t_shared *
-  try_get_shared() noexcept
+  Deleter(Deleter const & p_deleter) noexcept
+  : m_delete_function(p_deleter.m_delete_function)
   {
-    if (!m_adapter.m_data.try_add_ref())
-    {
-      return nullptr;
-    }
-    return detail::static_or_dynamic_cast<t_shared>(t_shared::get_shared_base(*this));
+    ++g_deleter_construct;
   }
 
-  // Return true if this is not controlled (yet).
-  bool
-  is_uncontrolled() const noexcept
+  Deleter(Deleter && p_deleter) noexcept
+  : m_delete_function(p_deleter.m_delete_function)
   {
-    return m_adapter.m_data.is_uncontrolled();
+    ++g_deleter_construct;
   }
 
-  // Return maximum usage count value.
-  static constexpr UsageValueType
-  get_max_usage_count() noexcept
+  ~Deleter() noexcept
   {
-    return t_data::get_max_usage_count();
+    ++g_deleter_destroy;
   }
 
-  // Return maximum weak count value.
-  static constexpr WeakValueType
-  get_max_weak_count() noexcept
+#endif
+
+  void
+  operator()(t_shared * p_shared) const noexcept
   {
-    return t_data::get_max_weak_count();
+    static_assert(sizeof(t_shared) != 0u, "incomplete type");
+    m_delete_function(p_shared);
   }
 
-  // Return the usage count.
-  UsageValueType
-  use_count() const noexcept
+private:
+  static void
+  delete_shared(SharedBase const * p_base) noexcept
   {
-    return m_adapter.m_data.use_count();
+    delete detail::static_or_dynamic_cast<std::add_const_t<t_shared>>(p_base);
   }
 
-  // Return the weak count.
-  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
-  WeakValueType
-  weak_count() const noexcept
+  using DeleteFunction = void (*)(SharedBase const *) noexcept;
+  DeleteFunction m_delete_function = &delete_shared;
+
+  template<typename t_other>
+  friend struct Deleter;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         DeleterIndexed                                         //
+//                                                                                                //
+//        A deleter for 'ControlNew' which saves the shared object type as a small index          //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Like 'Deleter', but the function that casts the shared object pointer to the original type is
+//  registered in a 'detail::TypeRegistry' of its class hierarchy. 'ControlNew' stores its index in
+//  the user bits of the control data instead of the deleter, so the control block doesn't grow by
+//  the size of a pointer. Each hierarchy can register up to 255 types.
+//
+//  The control data requires at least 8 user bits, which are not available to the user anymore.
+//  A static assertion ensures that enough bits are available.
+//
+
+template<typename t_shared>
+struct DeleterIndexed
+{
+  using SharedBase = std::remove_const_t<detail::BaseType<t_shared>>;
+
+  // 'ControlNew' stores the index in the user bits of the control data.
+  using UserIndex = void;
+
+  // Return the maximum index.
+  static constexpr std::size_t
+  get_max_index() noexcept
   {
-    return m_adapter.m_data.weak_count();
+    return Registry::s_capacity - 1u;
   }
 
-  // Increment the usage counter.
-  void
-  add_ref() noexcept
+  // Restore the deleter from its index.
+  static DeleterIndexed
+  from_index(std::size_t const p_index) noexcept
   {
-    m_adapter.m_data.add_ref();
+    DeleterIndexed deleter;
+    deleter.m_index = static_cast<unsigned char>(p_index);
+    return deleter;
   }
 
-  // Increment the weak counter.
-  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
-  void
-  weak_add_ref() noexcept
+  // Return the index of the delete function.
+  std::size_t
+  index() const noexcept
   {
-    m_adapter.m_data.weak_add_ref();
+    return m_index;
   }
 
-  // Increment the weak counter.
-  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
-  static ControlAlloc *
-  weak_add_ref(ControlAlloc * p_control) noexcept
+  DeleterIndexed() noexcept
+  : m_index(static_cast<unsigned char>(Registry::template index<&delete_shared>()))
+  {}
+
+  template<typename t_other,
+           typename = std::enable_if_t<std::is_convertible_v<std::remove_const_t<t_other> *, t_shared *>>>
+  DeleterIndexed(DeleterIndexed<t_other> const & p_other) noexcept
+  : m_index(p_other.m_index)
+  {}
+
+  void
+  operator()(t_shared * p_shared) const noexcept
   {
-    if (p_control != nullptr)
+    static_assert(sizeof(t_shared) != 0u, "incomplete type");
+    DeleteFunction const function = Registry::get(m_index);
+    PNTR_TRY_LOG_ERROR(function == nullptr, "Invalid type index");
+    if (function != nullptr)
     {
-      p_control->m_adapter.m_data.weak_add_ref();
+      function(p_shared);
     }
-    return p_control;
   }
 
-  // Decrement the usage counter and return true if it reaches zero or was invalid.
-  bool
-  release() noexcept
+private:
+  static void
+  delete_shared(SharedBase const * p_base) noexcept
   {
-    return m_adapter.m_data.release();
+    delete detail::static_or_dynamic_cast<std::add_const_t<t_shared>>(p_base);
   }
 
-  // Decrement the weak counter and return true if it reaches or was zero.
-  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
-  bool
-  weak_release() noexcept
-  {
-    return m_adapter.m_data.weak_release();
-  }
+  using DeleteFunction = void (*)(SharedBase const *) noexcept;
+  using Registry = detail::TypeRegistry<DeleteFunction>;
 
-  // Return maximum user value.
-  static constexpr DataValueType
-  get_max_user() noexcept
-  {
-    return t_data::get_max_user();
-  }
+  unsigned char m_index;
 
-  // Return the user value.
-  DataValueType
-  get_user() const noexcept
-  {
-    return m_adapter.m_data.get_user();
-  }
+  template<typename t_other>
+  friend struct DeleterIndexed;
+};
 
-  // Try to set the user value and return true on success.
-  bool
-  try_set_user(DataValueType const p_user) noexcept
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                      pntr/ControlData.hpp                                      //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                          ControlData                                           //
+//                                                                                                //
+//                             The data storage for the control block                             //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'ControlData' stores unsigned integer data with a combined size of the 't_storage' type, which
+//  is typically one of 'std::uint8_t', 'std::uint16_t', 'std::uint32_t', or 'std::uint64_t'.
+//  't_counter' is a counter template class like 'CounterThreadSafe' or 'CounterThreadUnsafe'.
+//
+//  The remaining template parameters specify how many bits should be reserved for which purpose:
+//  - 't_usage_bits':  The usage reference counter.
+//  - 't_weak_bits':   The weak reference counter.
+//                     This should be zero for control blocks that don't support weak pointers.
+//  - 't_offset_bits': An offset value to calculate the original pointer for deallocation.
+//                     This can be 'shared_bits' to store the offset in the usage bits after
+//                     the object has been destroyed. This is only possible if the allocator
+//                     requests 'StaticSupport' to store type information in an extra pointer.
+//  - 't_size_bits':   An offset value to calculate the original type size for deallocation.
+//                     Size and align bits are only required for allocators compatible to
+//                     'AllocatorMemoryResource' with 'NoStaticSupport' configuration.
+//  - 't_align_bits':  An offset value to calculate the original type alignment for deallocation.
+//                     This can be zero even for an allocator that requires the alignment,
+//                     if the object types don't exceed standard alignment ('std::max_align_t').
+//  - ('t_user_bits'): The bits used for a custom user value accessible through the 'Intruder'.
+//                     This number is automatically calculated by the unused bits of 't_storage',
+//                     so no bits get wasted to alignment padding.
+//
+//  Specializations of the data storage will use separate usage and weak counters for improved
+//  performance if the bit values allow it. For example it will use 'std::uint32_t' for the usage
+//  counter if the storage type is 'std::uint64_t' with 32 bits reserved for the usage counter.
+//
+
+// clang-format off
+
+// A bug in 'Microsoft Visual C++' compiler requires to use type parameters for bit count values
+// instead of a value parameters. 'detail::Bits' converts the values to a type.
+
+inline constexpr unsigned shared_bits = std::numeric_limits<unsigned>::max();
+
+template<template<typename> class t_counter,
+         typename t_storage,
+         unsigned t_usage_bits = detail::type_bits<t_storage>(),
+         unsigned t_weak_bits = 0u,
+         unsigned t_offset_bits = 0u,
+         unsigned t_size_bits = 0u,
+         unsigned t_align_bits = 0u>
+using ControlData =
+  detail::ControlDataUser<t_counter, t_storage, detail::Bits<t_usage_bits>, detail::Bits<t_weak_bits>,
+                          detail::Bits<t_offset_bits>, detail::Bits<t_size_bits>, detail::Bits<t_align_bits>>;
+
+// clang-format on
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                 pntr/detail/ControlLayout.hpp                                  //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The declared maxima of a control block, see 'IntruderRequirements'. The flags describe what the
+  // control class stores in the control data.
+  struct ControlNeeds
+  {
+    std::uint64_t m_max_usage_count;
+    std::uint64_t m_max_weak_count;
+    std::uint64_t m_max_offset;
+    std::uint64_t m_max_size_offset;
+    std::uint64_t m_max_align;
+    unsigned m_user_bits;
+    unsigned m_min_storage_bits;
+    bool m_weak;
+    bool m_offset;
+    bool m_shared_offset;
+    bool m_size_align;
+    bool m_offset_flag;
+  };
+
+  // The bit counts of a 'ControlData' configuration. 'm_storage_bits' is zero if the needs don't fit.
+  struct ControlLayout
   {
-    return m_adapter.m_data.try_set_user(p_user);
-  }
+    unsigned m_storage_bits;
+    unsigned m_usage_bits;
+    unsigned m_weak_bits;
+    unsigned m_offset_bits;
+    unsigned m_size_bits;
+    unsigned m_align_bits;
+  };
 
-  // Delete (non-weak) or destroy (weak) the object. Called when 'pntr_release' returns true.
-  // Return a pointer to the control block if it should be deallocated.
-  template<class t_shared>
-  static typename t_shared::PntrControlType *
-  dispose(ControlAlloc & p_control, t_shared & p_shared) noexcept
+  constexpr unsigned
+  ceil_power_of_two(unsigned const p_value) noexcept
   {
-    PNTR_TRY_LOG_WARNING(p_control.m_adapter.m_data.is_alive(), "disposing object which is still alive");
-    p_control.m_adapter.destroy(p_control, p_shared);
-    ControlAlloc * control = &p_control;
-    if constexpr (SupportsWeak::value)
+    unsigned power = 1u;
+    while (power < p_value)
     {
-      if (!p_control.m_adapter.m_data.weak_release())
-      {
-        control = nullptr;
-      }
+      power <<= 1u;
     }
-    return control;
+    return power;
   }
 
-  // Deallocate the memory of the shared instance.
-  static void
-  deallocate(ControlAlloc * p_control) noexcept
+  // Return the smallest layout for the needs. If the storage has room to spare, the counters are
+  // widened to match a 'ControlDataStorage' specialization with separate counters, which don't
+  // require to mask the other bits.
+  constexpr ControlLayout
+  calc_control_layout(ControlNeeds const & p_needs) noexcept
   {
-    if (p_control != nullptr)
+    ControlLayout layout{};
+    for (unsigned storage_bits = 8u; storage_bits <= 64u; storage_bits <<= 1u)
     {
-      AllocAdapter::deallocate(p_control->m_adapter, *p_control);
-    }
-  }
+      // The offset is stored in units of the alignment of the control block, which is at least the
+      // size of the storage.
+      std::uint64_t const unit = storage_bits / 8u;
+      unsigned const offset_bits = bit_width(p_needs.m_max_offset / unit);
 
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-  //                                                                                            //
-  //         The type definitions and member functions required by 'Intruder' end here          //
-  //                                                                                            //
-  ////////////////////////////////////////////////////////////////////////////////////////////////
+      unsigned usage_bits = std::max(2u, bit_width(p_needs.m_max_usage_count + 1u));
+      unsigned weak_bits = (p_needs.m_weak ? std::max(1u, bit_width(p_needs.m_max_weak_count + 1u)) : 0u);
+      unsigned other_bits = p_needs.m_user_bits;
+      layout.m_offset_bits = 0u;
+      if (p_needs.m_offset && p_needs.m_shared_offset)
+      {
+        // The offset is stored in the usage bits after the object has been destroyed, which halves the
+        // maximum usage count.
+        usage_bits = std::max(bit_width(p_needs.m_max_usage_count) + 1u, usage_bits);
+        if (p_needs.m_max_offset != 0u)
+        {
+          usage_bits = std::max(bit_width(p_needs.m_max_offset / unit + 1u) + 1u, usage_bits);
+          layout.m_offset_bits = shared_bits;
+        }
+      }
+      else if (p_needs.m_offset)
+      {
+        layout.m_offset_bits = offset_bits + (p_needs.m_offset_flag ? 1u : 0u);
+        other_bits += layout.m_offset_bits;
+      }
+      layout.m_size_bits = (p_needs.m_size_align ? bit_width(p_needs.m_max_size_offset / unit) : 0u);
+      layout.m_align_bits = (p_needs.m_size_align && p_needs.m_max_align > alignof(std::max_align_t)
+                               ? bit_width(log2(ceil_power_of_two(static_cast<unsigned>(p_needs.m_max_align))))
+                               : 0u);
+      other_bits += layout.m_size_bits + layout.m_align_bits;
 
-private:
-  using AllocAdapter =
-    std::conditional_t<detail::HasPointerDeallocate<t_allocator>::value,
-                       detail::AllocAdaptPointer<t_shared_base, t_data, t_allocator>,
-                       std::conditional_t<detail::HasTypeInfoDeallocate<t_allocator>::value,
-                                          detail::AllocAdaptTypeInfo<t_shared_base, t_data, t_allocator>,
-                                          detail::AllocAdaptTyped<t_shared_base, t_data, t_allocator>>>;
+      if (storage_bits < p_needs.m_min_storage_bits || usage_bits + weak_bits + other_bits > storage_bits)
+      {
+        continue;
+      }
 
-  AllocAdapter m_adapter;
+      if (weak_bits == 0u && other_bits == 0u && layout.m_offset_bits == 0u)
+      {
+        usage_bits = storage_bits;
+      }
+      else if (storage_bits >= 16u)
+      {
+        unsigned const wide_usage = std::max(8u, ceil_power_of_two(usage_bits));
+        unsigned const wide_weak = std::max(8u, ceil_power_of_two(weak_bits));
+        unsigned const rest = storage_bits - wide_usage - wide_weak;
+        if (weak_bits != 0u && wide_usage >= wide_weak && wide_usage + wide_weak < storage_bits
+            && is_power_of_two(rest) && other_bits <= rest)
+        {
+          usage_bits = wide_usage;
+          weak_bits = wide_weak;
+        }
+        else if (usage_bits <= storage_bits / 2u && weak_bits + other_bits <= storage_bits / 2u
+                 && (weak_bits < 8u || weak_bits != storage_bits / 4u))
+        {
+          usage_bits = storage_bits / 2u;
+        }
+      }
 
-  ControlAlloc(ControlAlloc const &) = delete;
-  ControlAlloc(ControlAlloc &&) = delete;
-  ControlAlloc & operator=(ControlAlloc const &) = delete;
-  ControlAlloc & operator=(ControlAlloc &&) = delete;
-};
+      layout.m_storage_bits = storage_bits;
+      layout.m_usage_bits = usage_bits;
+      layout.m_weak_bits = weak_bits;
+      return layout;
+    }
+    return ControlLayout{};
+  }
+} // namespace detail
 
 
 PNTR_NAMESPACE_END
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                      pntr/ControlNew.hpp                                       //
+//                                  pntr/ControlDataSharded.hpp                                   //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <atomic>
+#include <cstddef>
+#include <limits>
+
 PNTR_NAMESPACE_BEGIN
 
 
+namespace detail
+{
+  // Return an index that is distinct for each thread, assigned in the order of the first call.
+  inline std::size_t
+  thread_slot() noexcept
+  {
+    static std::atomic<std::size_t> s_next{0u};
+    static thread_local std::size_t const s_slot = s_next.fetch_add(1u, std::memory_order_relaxed);
+    return s_slot;
+  }
+} // namespace detail
+
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                           ControlNew                                           //
+//                                       ControlDataSharded                                       //
 //                                                                                                //
-//        A control class for 'Intruder', using 'new' expression, deleter, and usage count        //
+//          The data storage for a control block with a usage counter sharded by threads          //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 //
-//  Requires that the shared base class type specified as template argument provides the type
-//  definitions and member functions as implemented by and documented in the class 'Intruder'.
+//  A data class for 'ControlNew', see 'IntruderNewSharded'. It is meant for a few objects that are
+//  copied by many threads concurrently, like global configurations or registries, as it occupies
+//  one cache line for each of the 't_shards' sub-counters and one for the central counter.
 //
-//  Requires that the data class type specified as template argument provides the type definitions
-//  and member functions as implemented by and documented in the class 'ControlData'.
+//  The usage count is the sum of the central counter and all sub-counters. A thread increments
+//  the sub-counter of its own slot, so threads that copy and release the same object don't share
+//  a cache line. A release decrements a non-zero sub-counter, preferably the own one, or otherwise
+//  the central counter while it is above one. As the central counter never drops below one while
+//  the object is alive, these releases can't be the last ones.
+//
+//  Only a release that finds all counters at their minimum might be the last one, which is
+//  detected in two phases. The first phase reads all sub-counters, and the second one verifies
+//  that they haven't changed and sets the central counter to zero if it hasn't changed either.
+//  Each counter is stored with a version number that changes on every update, which makes both
+//  phases an atomic snapshot of the usage count.
+//
+//  It supports neither weak pointers nor a user value.
 //
 
-template<class t_shared_base, class t_data, typename t_deleter>
-class ControlNew
+template<std::size_t t_shards = 64u>
+class ControlDataSharded
 {
 public:
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-  //                                                                                            //
-  //        The type definitions and member functions required by 'Intruder' start here         //
-  //                                                                                            //
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-
-  using SharedBase = t_shared_base;
-  using Data = t_data;
-  using Deleter = t_deleter;
-  using Allocator = void;
-  using UsageValueType = typename t_data::UsageValueType;
-  using WeakValueType = typename t_data::WeakValueType;
-  using DataValueType = typename t_data::DataValueType;
-  using SupportsWeak = std::false_type;
-
-  explicit ControlNew(DataValueType const p_user_init) noexcept
-  : m_control_deleter(p_user_init)
-  {}
+  using UsageValueType = std::uint32_t;
+  using WeakValueType = void;
+  using DataValueType = std::uint8_t;
 
-  // Allocate storage for a new instance of the specified type, call its constructor
-  // using the forwarded arguments, and return a pointer to it on success.
-  template<class t_shared, class t_nothrow, typename... t_args>
-  static t_shared *
-  create(t_args &&... p_args) noexcept(t_nothrow::value)
+  explicit ControlDataSharded(DataValueType const p_user_init) noexcept
+  : m_central{make_word(0u, s_uncontrolled)}
   {
-    t_shared * shared = nullptr;
-    if constexpr (t_nothrow::value)
-    {
-      try
-      {
-        // Ignore allocation exceptions
-        shared = new (std::nothrow) t_shared(std::forward<t_args>(p_args)...);
-      }
-      catch (...) // Ignore constructor exceptions
-      {}
-    }
-    else
+    PNTR_ASSERT(p_user_init == 0u);
+    for (Slot & shard: m_shards)
     {
-      shared = new t_shared(std::forward<t_args>(p_args)...);
+      shard.m_word.store(0u, std::memory_order_relaxed);
     }
-    return shared;
   }
 
-  // Try to take control of the given object, either by taking new or by sharing the existing
-  // ownership. Return a pointer to the given object on success.
-  template<class t_shared>
-  t_shared *
-  try_control(t_shared & p_shared) noexcept
+  // Return true if this is not controlled (yet).
+  bool
+  is_uncontrolled() const noexcept
   {
-    // Check if the address returned from get_shared_base() is equal
-    // to the address of the implicitly upcasted shared instance.
-    PNTR_ASSERT(t_shared::get_shared_base(*this) == &p_shared);
+    return (count(m_central.m_word.load(std::memory_order_relaxed)) == s_uncontrolled);
+  }
 
-    switch (m_control_deleter.m_data.try_control())
-    {
-      case ControlStatus::e_invalid:
-        return nullptr;
-      case ControlStatus::e_acquired:
-        m_control_deleter.template init<std::remove_const_t<t_shared>>();
-        break;
-      case ControlStatus::e_shared:
-        break;
-    }
-    return &p_shared;
+  // Return true if this is controlled and not expired (yet).
+  bool
+  is_alive() const noexcept
+  {
+    return (count(m_central.m_word.load(std::memory_order_relaxed)) > s_expired);
   }
 
-  // Try to take control of the given object, either by taking new or by sharing the existing
-  // ownership. Assign the deleter and return a pointer to the given object on success.
-  template<class t_shared, class t_forward>
-  t_shared *
-  try_control(t_shared & p_shared, t_forward && p_deleter) noexcept
+  // Return maximum usage count value.
+  static constexpr UsageValueType
+  get_max_usage_count() noexcept
   {
-    // Check if the address returned from get_shared_base() is equal
-    // to the address of the implicitly upcasted shared instance.
-    PNTR_ASSERT(t_shared::get_shared_base(*this) == &p_shared);
+    return static_cast<UsageValueType>(s_usage_max);
+  }
 
-    switch (m_control_deleter.m_data.try_control())
+  // Return the usage count, which is only exact if no other thread changes it concurrently.
+  UsageValueType
+  use_count() const noexcept
+  {
+    std::int32_t const central = count(m_central.m_word.load(std::memory_order_relaxed));
+    if (central <= s_expired)
     {
-      case ControlStatus::e_invalid:
-        return nullptr;
-      case ControlStatus::e_acquired:
-        m_control_deleter.deleter() = std::forward<t_forward>(p_deleter);
-        break;
-      case ControlStatus::e_shared:
-        break;
+      return 0u;
     }
-    return &p_shared;
+    UsageValueType sum = static_cast<UsageValueType>(central);
+    for (Slot const & shard: m_shards)
+    {
+      sum += static_cast<UsageValueType>(count(shard.m_word.load(std::memory_order_relaxed)));
+    }
+    return sum;
   }
 
-  // Try to increment the usage counter and return a pointer to the shared object on success.
-  template<class t_shared>
-  t_shared *
-  try_get_shared() noexcept
+  // Increment the sub-counter of the current thread.
+  void
+  add_ref() noexcept
   {
-    if (!m_control_deleter.m_data.try_add_ref())
-    {
-      return nullptr;
-    }
-    return detail::static_or_dynamic_cast<t_shared>(t_shared::get_shared_base(*this));
+    [[maybe_unused]] std::uint64_t const previous =
+      own_shard().m_word.fetch_add(s_version_one + 1u, std::memory_order_relaxed);
+    PNTR_ASSERT(count(previous) >= 0 && count(previous) < s_usage_max);
   }
 
-  // Re-initialize the usage counter of an expired object. Return true if it is or was uncontrolled.
+  // Increment the sub-counter of the current thread by the given number of references at once.
+  void
+  add_ref(UsageValueType const p_count) noexcept
+  {
+    [[maybe_unused]] std::uint64_t const previous =
+      own_shard().m_word.fetch_add(s_version_one + p_count, std::memory_order_relaxed);
+    PNTR_ASSERT(count(previous) >= 0
+                && static_cast<UsageValueType>(count(previous)) + p_count <= get_max_usage_count());
+  }
+
+  // Decrement the usage count and return true if it reaches zero or was invalid.
   bool
-  try_revive() noexcept
+  release() noexcept
   {
-    return m_control_deleter.m_data.try_revive();
+    std::size_t const own = detail::thread_slot();
+    for (;;)
+    {
+      for (std::size_t i = 0u; i < t_shards; ++i)
+      {
+        if (try_decrement(m_shards[(own + i) % t_shards].m_word))
+        {
+          return false;
+        }
+      }
+      std::uint64_t central = m_central.m_word.load(std::memory_order_acquire);
+      if (count(central) <= s_expired)
+      {
+        PNTR_ASSERT(count(central) == s_uncontrolled);
+        return true;
+      }
+      if (count(central) > 1)
+      {
+        if (m_central.m_word.compare_exchange_weak(central, make_word(central, count(central) - 1),
+                                                   std::memory_order_release, std::memory_order_relaxed))
+        {
+          return false;
+        }
+        continue;
+      }
+      if (is_last(central))
+      {
+        return true;
+      }
+    }
   }
 
-  // Return maximum usage count value.
-  static constexpr UsageValueType
-  get_max_usage_count() noexcept
+  // Decrement the usage count by the given number of references, and return true if it reaches
+  // zero or was invalid. Only the last decrement can reach zero, the others find a counter above it.
+  bool
+  release(UsageValueType const p_count) noexcept
   {
-    return t_data::get_max_usage_count();
+    PNTR_ASSERT(p_count >= 1u);
+    for (UsageValueType i = 1u; i < p_count; ++i)
+    {
+      [[maybe_unused]] bool const last = release();
+      PNTR_ASSERT(!last);
+    }
+    return release();
   }
 
-  // Return the usage count.
-  UsageValueType
-  use_count() const noexcept
+  // If the usage counter is
+  // - uncontrolled: Initialize it with its first reference and return ControlStatus::e_acquired
+  // - zero or max:  Return ControlStatus::e_invalid
+  // - otherwise:    Increment it and return ControlStatus::e_shared
+  ControlStatus
+  try_control() noexcept
   {
-    return m_control_deleter.m_data.use_count();
+    std::uint64_t central = m_central.m_word.load(std::memory_order_relaxed);
+    while (count(central) == s_uncontrolled
+           && !m_central.m_word.compare_exchange_weak(central, make_word(central, 1), std::memory_order_relaxed))
+    {}
+    if (count(central) == s_uncontrolled)
+    {
+      return ControlStatus::e_acquired;
+    }
+    return (try_add_ref() ? ControlStatus::e_shared : ControlStatus::e_invalid);
   }
 
-  // Increment the usage counter.
-  void
-  add_ref() noexcept
+  // Increment the central counter if it is not zero or max, and return true if it was incremented.
+  bool
+  try_add_ref() noexcept
   {
-    m_control_deleter.m_data.add_ref();
+    std::uint64_t central = m_central.m_word.load(std::memory_order_relaxed);
+    while (count(central) > s_expired && count(central) < s_usage_max
+           && !m_central.m_word.compare_exchange_weak(central, make_word(central, count(central) + 1),
+                                                      std::memory_order_relaxed))
+    {}
+    return (count(central) > s_expired && count(central) < s_usage_max);
   }
 
-  // Decrement the usage counter and return true if it reaches zero or was invalid.
+  // Re-initialize the usage counter of an expired object. Return true if it is or was uncontrolled.
   bool
-  release() noexcept
+  try_revive() noexcept
   {
-    return m_control_deleter.m_data.release();
+    std::uint64_t central = m_central.m_word.load(std::memory_order_relaxed);
+    while (count(central) == s_expired
+           && !m_central.m_word.compare_exchange_weak(central, make_word(central, s_uncontrolled),
+                                                      std::memory_order_relaxed))
+    {}
+    return (count(central) == s_expired || count(central) == s_uncontrolled);
   }
 
   // Return maximum user value.
   static constexpr DataValueType
   get_max_user() noexcept
   {
-    return t_data::get_max_user();
+    return 0u;
   }
 
   // Return the user value.
   DataValueType
   get_user() const noexcept
   {
-    return m_control_deleter.m_data.get_user();
+    return 0u;
   }
 
   // Try to set the user value and return true on success.
   bool
   try_set_user(DataValueType const p_user) noexcept
   {
-    return m_control_deleter.m_data.try_set_user(p_user);
+    return (p_user == 0u);
   }
 
-  // Delete (non-weak) or destroy (weak) the object. Called when 'pntr_release' returns true.
-  // Return a pointer to the control block if it should be deallocated.
-  template<class t_shared>
-  static typename t_shared::PntrControlType *
-  dispose(ControlNew & p_control, t_shared & p_shared) noexcept
+private:
+  // Each counter is a 32 bit count in the lower half and a version number in the upper half.
+  struct alignas(64) Slot
   {
-    PNTR_TRY_LOG_WARNING(p_control.m_control_deleter.m_data.is_alive(), "disposing object which is still alive");
-    ControlDeleter::destroy(p_control.m_control_deleter, &p_shared);
-    return nullptr;
+    std::atomic<std::uint64_t> m_word;
+  };
+
+  static constexpr std::uint64_t s_count_mask = 0xFFFFFFFFu;
+  static constexpr std::uint64_t s_version_one = std::uint64_t{1u} << 32u;
+  static constexpr std::int32_t s_uncontrolled = -1;
+  static constexpr std::int32_t s_expired = 0;
+  static constexpr std::int32_t s_usage_max = std::numeric_limits<std::int32_t>::max();
+
+  static std::int32_t
+  count(std::uint64_t const p_word) noexcept
+  {
+    return static_cast<std::int32_t>(static_cast<std::uint32_t>(p_word & s_count_mask));
   }
 
-  // Deallocate the memory of the shared instance.
-  static void
-  deallocate([[maybe_unused]] ControlNew * p_control) noexcept
+  // Return the next version of the given word with the given count.
+  static std::uint64_t
+  make_word(std::uint64_t const p_word, std::int32_t const p_count) noexcept
   {
-    PNTR_TRY_LOG_ERROR(p_control != nullptr, "should never reveice a valid pointer");
+    return (((p_word & ~s_count_mask) + s_version_one) | static_cast<std::uint32_t>(p_count));
   }
 
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-  //                                                                                            //
-  //         The type definitions and member functions required by 'Intruder' end here          //
-  //                                                                                            //
-  ////////////////////////////////////////////////////////////////////////////////////////////////
+  Slot &
+  own_shard() noexcept
+  {
+    return m_shards[detail::thread_slot() % t_shards];
+  }
 
-private:
-  using ControlDeleter = detail::ControlDeleter<t_shared_base, t_data, t_deleter, detail::is_empty_base<t_deleter>>;
+  // Decrement the given sub-counter if it is not zero, and return true if it was decremented.
+  static bool
+  try_decrement(std::atomic<std::uint64_t> & p_word) noexcept
+  {
+    std::uint64_t word = p_word.load(std::memory_order_relaxed);
+    while (count(word) > 0)
+    {
+      if (p_word.compare_exchange_weak(word, make_word(word, count(word) - 1), std::memory_order_release,
+                                       std::memory_order_relaxed))
+      {
+        return true;
+      }
+    }
+    return false;
+  }
 
-  ControlDeleter m_control_deleter;
+  // Return true if the given central word with a count of one is the last reference, which also
+  // expires it. Return false if any counter has changed, or a sub-counter is not zero.
+  bool
+  is_last(std::uint64_t p_central) noexcept
+  {
+    std::uint64_t words[t_shards];
+    for (std::size_t i = 0u; i < t_shards; ++i)
+    {
+      words[i] = m_shards[i].m_word.load(std::memory_order_acquire);
+      if (count(words[i]) != 0)
+      {
+        return false;
+      }
+    }
+    for (std::size_t i = 0u; i < t_shards; ++i)
+    {
+      if (m_shards[i].m_word.load(std::memory_order_acquire) != words[i])
+      {
+        return false;
+      }
+    }
+    return m_central.m_word.compare_exchange_strong(p_central, make_word(p_central, s_expired),
+                                                    std::memory_order_acq_rel, std::memory_order_relaxed);
+  }
 
-  ControlNew(ControlNew const &) = delete;
-  ControlNew(ControlNew &&) = delete;
-  ControlNew & operator=(ControlNew const &) = delete;
-  ControlNew & operator=(ControlNew &&) = delete;
+  Slot m_central;
+  Slot m_shards[t_shards];
+
+  static_assert(t_shards > 0u);
 };
 
 
@@ -3492,7 +4925,7 @@ PNTR_NAMESPACE_END
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                       pntr/Intruder.hpp                                        //
+//                                     pntr/ControlAlloc.hpp                                      //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -3501,351 +4934,317 @@ PNTR_NAMESPACE_BEGIN
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                            Intruder                                            //
+//                                          ControlAlloc                                          //
 //                                                                                                //
-//       An intrusive base class that embeds a control block for 'SharedPtr' and 'WeakPtr'        //
+//          A control class for 'Intruder', using an allocator, and usage and weak count          //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 //
-//  Requires that the control class type specified as template argument
-//  provides the type definitions and member functions as implemented
-//  by and documented in the classes 'ControlNew' and 'ControlAlloc'.
+//  'ControlAlloc' supports three types of allocators:
+//  - Allocators which only require the original untyped pointer for deallocation. The most common
+//    example is 'std::free'. Those allocators are required to provide the type definitions and
+//    member functions as implemented by and documented in the class 'AllocatorMalloc'.
+//  - Allocators which require the original untyped pointer and the size and alignment of the
+//    allocated memory block for deallocation, for example 'std::pmr::memory_resource'. Those
+//    allocators are required to provide the type definitions and member functions as implemented
+//    by and documented in the class 'AllocatorMemoryResource'.
+//  - Allocators which require the original type for deallocation, for example 'std::allocator'.
+//    Those allocators are required to provide the type definitions and member functions as
+//    documented in the C++ Standard Library, see
+//    https://en.cppreference.com/w/cpp/named_req/Allocator
+//
+//  Requires that the shared base class type specified as template argument provides the
+//  type definitions and member functions as implemented by and documented in the class 'Intruder'.
+//
+//  Requires that the data class type specified as template argument provides the type definitions
+//  and member functions as implemented by and documented in the class 'ControlData'.
 //
 
-template<class t_control>
-class Intruder
+template<class t_shared_base, class t_data, class t_allocator>
+class ControlAlloc
 {
 public:
   ////////////////////////////////////////////////////////////////////////////////////////////////
   //                                                                                            //
-  // The type definitions and member functions required by 'SharedPtr' and 'WeakPtr' start here //
+  //        The type definitions and member functions required by 'Intruder' start here         //
   //                                                                                            //
   ////////////////////////////////////////////////////////////////////////////////////////////////
 
-  // 'PntrControlType' is the intrusive control class. It can be 'void'.
-  using PntrControlType = t_control;
-
-  // 'PntrSharedBase' is the base class specified as template parameter for the control class.
-  // It has to be statically (not virtual) derived from the 'Intruder' class.
-  using PntrSharedBase = typename t_control::SharedBase;
-
-  // 'PntrUsageValueType' is the integer type used for usage reference counting.
-  using PntrUsageValueType = typename t_control::UsageValueType;
-
-  // 'PntrWeakValueType' is the integer type used for weak reference counting.
-  using PntrWeakValueType = typename t_control::WeakValueType;
-
-  // 'PntrDeleter' type has to be either 'void' or a supported deleter type.
-  using PntrDeleter = typename t_control::Deleter;
-
-  // 'PntrAllocator' type has to be either 'void' or a supported allocator type.
-  using PntrAllocator = typename t_control::Allocator;
-
-  // 'PntrSupportsWeak' indicates if weak reference counting is supported.
-  // It has to be either 'std::true_type' or 'std::false_type'.
-  using PntrSupportsWeak = typename t_control::SupportsWeak;
+  using SharedBase = t_shared_base;
+  using Data = t_data;
+  using Deleter = void;
+  using Allocator = t_allocator;
+  using UsageValueType = typename t_data::UsageValueType;
+  using WeakValueType = typename t_data::WeakValueType;
+  using DataValueType = typename t_data::DataValueType;
+  using SupportsWeak = typename t_data::SupportsWeak;
 
-private:
-  // Most functions should be private to prevent the derived class from messing around.
+  explicit ControlAlloc(DataValueType const p_user_init) noexcept
+  : m_adapter(p_user_init)
+  {}
 
   // Allocate storage for a new instance of the specified type, call its constructor
   // using the forwarded arguments, and return a pointer to it on success.
-  template<class t_shared, class t_nothrow, typename... t_args>
+  template<class t_shared, class t_nothrow, class t_shared_allocator, typename... t_args>
   static t_shared *
-  pntr_create(t_args &&... p_args) noexcept(t_nothrow::value)
+  create(t_shared_allocator & p_allocator, t_args &&... p_args) noexcept(t_nothrow::value)
   {
-    return t_control::template create<t_shared, t_nothrow>(std::forward<t_args>(p_args)...);
+    return AllocAdapter::template create<t_shared, t_nothrow>(p_allocator, std::forward<t_args>(p_args)...);
   }
 
-  // Use the allocator to allocate storage for a new instance of the specified type,
-  // call its constructor using the forwarded arguments, and assign the allocator
-  // and return a pointer to the new instance on success.
-  template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
-  static std::enable_if_t<!std::is_void_v<PntrAllocator>, t_shared *>
-  pntr_create_with_allocator(t_forward && p_allocator, t_args &&... p_args) noexcept(t_nothrow::value)
+  // Try to initialize the control pointer object and to forward the allocator to it.
+  template<class t_shared, class t_forward>
+  static t_shared *
+  try_init(ControlAlloc & p_self, t_shared * p_shared, t_forward && p_allocator) noexcept
   {
-    t_shared * shared = t_control::template create<t_shared, t_nothrow>(p_allocator, std::forward<t_args>(p_args)...);
-    if (shared != nullptr)
-    {
-      shared = t_control::template try_init(shared->control(), shared, std::forward<t_forward>(p_allocator));
-    }
-    return shared;
+    return AllocAdapter::template try_init(p_self.m_adapter, p_shared, std::forward<t_forward>(p_allocator));
   }
 
   // Try to take control of the given object, either by taking new or by sharing the existing
-  // ownership. Return the given pointer on success.
+  // ownership. Return a pointer to the given object on success.
   template<class t_shared>
-  static t_shared *
-  pntr_try_control(t_shared * p_shared) noexcept
+  t_shared *
+  try_control(t_shared & p_shared) noexcept
   {
-    return (p_shared == nullptr ? nullptr : p_shared->control().try_control(*p_shared));
-  }
-
-  // Try to take control of the given object, either by taking new or by sharing the existing
-  // ownership. Assign the deleter and return the given pointer on success.
-  template<class t_shared, class t_forward, typename = std::enable_if_t<!std::is_void_v<typename t_shared::PntrDeleter>>>
-  static t_shared *
-  pntr_try_control(t_shared * p_shared, t_forward && p_deleter) noexcept
-  {
-    return (p_shared == nullptr ? nullptr
-                                : p_shared->control().try_control(*p_shared, std::forward<t_forward>(p_deleter)));
+    // Check if the address returned from get_shared_base() is equal
+    // to the address of the implicitly upcasted shared instance.
+    if (t_shared::get_shared_base(*this) != &p_shared)
+    {
+      return nullptr;
+    }
+    return (m_adapter.m_data.try_control() != ControlStatus::e_invalid ? &p_shared : nullptr);
   }
 
   // Try to increment the usage counter and return a pointer to the shared object on success.
   template<class t_shared>
-  static t_shared *
-  pntr_try_get_shared(PntrControlType & p_control) noexcept
-  {
-    return p_control.template try_get_shared<t_shared>();
-  }
-
-  // Return an owner-based pointer for ordering in associative containers.
-  // All 'SharedPtr' and 'WeakPtr' who own the same object should return the same pointer.
-  // Types which support 'WeakPtr' have to return the address of the control class instance.
-  void const *
-  pntr_get_owner() const noexcept
-  {
-    // Check assumption that addresses of 'Intruder' and 'm_control_storage' are identical.
-    static_assert(offsetof(Intruder<t_control>, m_control_storage) == 0u);
-    static_assert(sizeof(Intruder) == sizeof(t_control));
-
-    return this;
-  }
-
-public:
-  // Return the current usage count.
-  PntrUsageValueType
-  pntr_use_count() const noexcept
-  {
-    return control().use_count();
-  }
-
-  // Return the current weak count.
-  PntrWeakValueType
-  pntr_weak_count() const noexcept
+  t_shared *
+  try_get_shared() noexcept
   {
-    PntrWeakValueType weak_count{};
-    if constexpr (PntrSupportsWeak::value)
+    if (!m_adapter.m_data.try_add_ref())
     {
-      weak_count = control().weak_count();
+      return nullptr;
     }
-    return weak_count;
-  }
-
-private:
-  // Increment the usage counter.
-  void
-  pntr_add_ref() const noexcept
-  {
-    control().add_ref();
+    return detail::static_or_dynamic_cast<t_shared>(t_shared::get_shared_base(*this));
   }
 
-  // Decrement the usage counter and return true if it reaches zero or was invalid.
+  // Return true if this is not controlled (yet).
   bool
-  pntr_release() const noexcept
+  is_uncontrolled() const noexcept
   {
-    return control().release();
+    return m_adapter.m_data.is_uncontrolled();
   }
 
-  // Delete (non-weak) or destroy (weak) the object. Called when 'pntr_release' returns true.
-  // Return a pointer to the control block if it should be deallocated.
-  template<class t_shared>
-  static PntrControlType *
-  pntr_dispose(t_shared * p_shared) noexcept
+  // Return maximum usage count value.
+  static constexpr UsageValueType
+  get_max_usage_count() noexcept
   {
-    return (p_shared == nullptr ? nullptr : t_control::template dispose(p_shared->control(), *p_shared));
+    return t_data::get_max_usage_count();
   }
 
-  // Deallocate the object. Called when the weak count reaches zero.
-  static void
-  pntr_deallocate(PntrControlType * p_control) noexcept
+  // Return maximum weak count value.
+  static constexpr WeakValueType
+  get_max_weak_count() noexcept
   {
-    t_control::deallocate(p_control);
+    return t_data::get_max_weak_count();
   }
 
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-  //                                                                                            //
-  //  The type definitions and member functions required by 'SharedPtr' and 'WeakPtr' end here  //
-  //                                                                                            //
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-
-public:
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-  //                                                                                            //
-  //      The type definitions and member functions required by control classes start here      //
-  //                                                                                            //
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-
-  // Accept a control instance and return a pointer to the shared base instance.
-  static PntrSharedBase *
-  get_shared_base(t_control & p_control) noexcept
+  // Return the usage count.
+  UsageValueType
+  use_count() const noexcept
   {
-    return static_cast<PntrSharedBase *>(reinterpret_cast<Intruder *>(&p_control));
+    return m_adapter.m_data.use_count();
   }
 
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-  //                                                                                            //
-  //       The type definitions and member functions required by control classes end here       //
-  //                                                                                            //
-  ////////////////////////////////////////////////////////////////////////////////////////////////
-
-  // 'Intruder' is copyable and movable, but the control block is not.
-
-  Intruder(Intruder const &) noexcept
+  // Return the address of the word which holds the usage count, if the control data has one.
+  template<class UsageData = t_data, typename = decltype(UsageData::get_usage_mask())>
+  UsageValueType const *
+  usage_word() const noexcept
   {
-    new (&m_control_storage) t_control;
+    return m_adapter.m_data.usage_word();
   }
 
-  Intruder(Intruder &&) noexcept
+  // Return the weak count.
+  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
+  WeakValueType
+  weak_count() const noexcept
   {
-    new (&m_control_storage) t_control;
+    return m_adapter.m_data.weak_count();
   }
 
-  Intruder &
-  operator=(Intruder const &) noexcept
+  // Increment the usage counter.
+  void
+  add_ref() noexcept
   {
-    return *this;
+    m_adapter.m_data.add_ref();
   }
 
-  Intruder &
-  operator=(Intruder &&) noexcept
+  // Increment the usage counter by the given number of references at once.
+  void
+  add_ref(UsageValueType const p_count) noexcept
   {
-    return *this;
+    m_adapter.m_data.add_ref(p_count);
   }
 
-  // The function 'shared_from_this' is equivalent to the one in 'std::enable_shared_from_this',
-  // but does not have its restriction that it is permitted to be called only from an object that
-  // is already managed by a shared pointer. So it is permitted to call 'shared_from_this' from
-  // 'Intruder' to acquire control of a shared object, but it can be undefined behaviour if the
-  // shared base is not fully initialized yet, for example calling it during the member
-  // initialization of a constructor of the shared base.
-
-  SharedPtr<PntrSharedBase>
-  shared_from_this() noexcept
+  // Increment the weak counter.
+  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
+  void
+  weak_add_ref() noexcept
   {
-    return SharedPtr<PntrSharedBase>(static_cast<PntrSharedBase *>(this));
+    m_adapter.m_data.weak_add_ref();
   }
 
-  SharedPtr<PntrSharedBase const>
-  shared_from_this() const noexcept
+  // Increment the weak counter.
+  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
+  static ControlAlloc *
+  weak_add_ref(ControlAlloc * p_control) noexcept
   {
-    return SharedPtr<PntrSharedBase const>(static_cast<PntrSharedBase const *>(this));
+    if (p_control != nullptr)
+    {
+      p_control->m_adapter.m_data.weak_add_ref();
+    }
+    return p_control;
   }
 
-  // The function 'weak_from_this' is equivalent to the one in 'std::enable_shared_from_this',
-  // but does not have its restriction that it is empty until the object is managed by a shared
-  // pointer. So it is permitted to call 'weak_from_this' from 'Intruder' at any time. It can
-  // even be used to construct a 'SharedPtr' to acquire control of the shared object, though
-  // this can be undefined behaviour if the shared base is not fully initialized yet, for
-  // example calling it during the member initialization of a constructor of the shared base.
-
-  template<typename t_weak = PntrSupportsWeak, typename = std::enable_if_t<t_weak::value>>
-  WeakPtr<PntrSharedBase>
-  weak_from_this() noexcept
+  // Decrement the usage counter and return true if it reaches zero or was invalid.
+  bool
+  release() noexcept
   {
-    return WeakPtr<PntrSharedBase>(control());
+    return m_adapter.m_data.release();
   }
 
-  template<typename t_weak = PntrSupportsWeak, typename = std::enable_if_t<t_weak::value>>
-  WeakPtr<PntrSharedBase const>
-  weak_from_this() const noexcept
+  // Decrement the usage counter by the given number of references at once, and return true if it
+  // reaches zero or was invalid.
+  bool
+  release(UsageValueType const p_count) noexcept
   {
-    return WeakPtr<PntrSharedBase const>(control());
+    return m_adapter.m_data.release(p_count);
   }
 
-  // Re-initialize the usage counter of an expired object. Should only be used if an object was
-  // recycled with a custom deleter. It is undefined behaviour to call it in other cases.
-  template<class t_deleter = PntrDeleter, typename = std::enable_if_t<!std::is_void_v<t_deleter>>>
+  // Decrement the weak counter and return true if it reaches or was zero.
+  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
   bool
-  pntr_try_revive() const noexcept
+  weak_release() noexcept
   {
-    return control().try_revive();
+    return m_adapter.m_data.weak_release();
   }
 
-  // Return maximum usage count value.
-  static constexpr PntrUsageValueType
-  pntr_get_max_usage_count() noexcept
+  // Return maximum user value. The user bits are reserved for allocators and types with an index,
+  // and the lowest 3 user bits of cycle collected types for 'CycleCollector'.
+  static constexpr DataValueType
+  get_max_user() noexcept
   {
-    return t_control::get_max_usage_count();
+    return (s_user_index ? DataValueType{} : static_cast<DataValueType>(t_data::get_max_user() & ~cycle_mask()));
   }
 
-  // Return maximum weak count value.
-  static constexpr PntrWeakValueType
-  pntr_get_max_weak_count() noexcept
+  // Return the user value.
+  DataValueType
+  get_user() const noexcept
   {
-    PntrWeakValueType max_weak_count{};
-    if constexpr (PntrSupportsWeak::value)
-    {
-      max_weak_count = t_control::get_max_weak_count();
-    }
-    return max_weak_count;
+    return (s_user_index ? DataValueType{} : static_cast<DataValueType>(m_adapter.m_data.get_user() & ~cycle_mask()));
   }
 
-  // 'PntrDataValueType' is the integer type used for the user value.
-  using PntrDataValueType = typename t_control::DataValueType;
-
-  // Return maximum user value, see 'ControlData'.
-  static constexpr PntrDataValueType
-  pntr_get_max_user() noexcept
+  // Try to set the user value and return true on success.
+  bool
+  try_set_user(DataValueType const p_user) noexcept
   {
-    return t_control::get_max_user();
+    if constexpr (s_user_index)
+    {
+      return (p_user == DataValueType{});
+    }
+    else if constexpr (cycle_mask() != 0u)
+    {
+      return m_adapter.m_data.try_set_user(p_user, get_max_user());
+    }
+    else
+    {
+      return m_adapter.m_data.try_set_user(p_user);
+    }
   }
 
-  // Return the user value, see 'ControlData'.
-  PntrDataValueType
-  pntr_get_user() const noexcept
+  // Return the user bits reserved for 'CycleCollector'.
+  DataValueType
+  get_cycle_bits() const noexcept
   {
-    return control().get_user();
+    return static_cast<DataValueType>(m_adapter.m_data.get_user() & cycle_mask());
   }
 
-  // Try to set the user value and return true on success, see 'ControlData'.
-  bool
-  pntr_try_set_user(PntrDataValueType const p_user) const noexcept
+  // Set the user bits reserved for 'CycleCollector' and keep the other user bits.
+  void
+  set_cycle_bits(DataValueType const p_bits) noexcept
   {
-    return control().try_set_user(p_user);
+    m_adapter.m_data.try_set_user(p_bits, cycle_mask());
   }
 
-protected:
-  explicit Intruder(PntrDataValueType const p_user_init = 0u) noexcept
+  // Delete (non-weak) or destroy (weak) the object. Called when 'pntr_release' returns true.
+  // Return a pointer to the control block if it should be deallocated.
+  template<class t_shared>
+  static typename t_shared::PntrControlType *
+  dispose(ControlAlloc & p_control, t_shared & p_shared) noexcept
   {
-    new (&m_control_storage) t_control(p_user_init);
+    PNTR_TRY_LOG_WARNING(p_control.m_adapter.m_data.is_alive(), "disposing object which is still alive");
+    p_control.m_adapter.destroy(p_control, p_shared);
+    ControlAlloc * control = &p_control;
+    if constexpr (SupportsWeak::value)
+    {
+      if (!p_control.m_adapter.m_data.weak_release())
+      {
+        control = nullptr;
+      }
+    }
+    return control;
   }
 
-  ~Intruder() noexcept
+  // Deallocate the memory of the shared instance.
+  static void
+  deallocate(ControlAlloc * p_control) noexcept
   {
-    if constexpr (!std::is_void_v<PntrDeleter>)
+    if (p_control != nullptr)
     {
-      control().~t_control();
-    }
-    else if (control().is_uncontrolled())
-    {
-      control().~t_control();
+      AllocAdapter::deallocate(p_control->m_adapter, *p_control);
     }
   }
 
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //         The type definitions and member functions required by 'Intruder' end here          //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
 private:
-  t_control &
-  control() const noexcept
+  static constexpr bool s_user_index =
+    (detail::HasUserIndex<t_allocator>::value || detail::SupportsStaticIndex<t_allocator>::value);
+
+  using AllocAdapter =
+    std::conditional_t<detail::HasPointerDeallocate<t_allocator>::value,
+                       detail::AllocAdaptPointer<t_shared_base, t_data, t_allocator>,
+                       std::conditional_t<detail::HasTypeInfoDeallocate<t_allocator>::value,
+                                          detail::AllocAdaptTypeInfo<t_shared_base, t_data, t_allocator>,
+                                          detail::AllocAdaptTyped<t_shared_base, t_data, t_allocator>>>;
+
+  // The lowest 3 user bits of cycle collected types are reserved. Evaluated on use, when the
+  // shared base class is complete.
+  static constexpr DataValueType
+  cycle_mask() noexcept
   {
-    return *std::launder(reinterpret_cast<t_control *>(&m_control_storage));
+    if constexpr (detail::is_cycle_collected<t_shared_base>)
+    {
+      static_assert(!s_user_index, "Cycle collection and the allocator index both use the user bits");
+      static_assert(t_data::get_max_user() >= 7u, "The cycle collector requires 3 user bits");
+      return DataValueType{7u};
+    }
+    else
+    {
+      return DataValueType{};
+    }
   }
 
-  alignas(t_control) mutable std::byte m_control_storage[sizeof(t_control)];
-
-  template<class t_shared>
-  friend class SharedPtr;
-  template<class t_shared>
-  friend class WeakPtr;
+  AllocAdapter m_adapter;
 
-  template<class t_shared, class t_nothrow, typename... t_args>
-  friend SharedPtr<t_shared> detail::make_shared_impl(t_args &&... p_args) noexcept(t_nothrow::value);
-  template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
-  friend std::enable_if_t<!std::is_void_v<typename t_shared::PntrDeleter>, SharedPtr<t_shared>>
-  detail::make_shared_with_deleter_impl(t_forward && p_deleter, t_args &&... p_args) noexcept(t_nothrow::value);
-  template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
-  friend std::enable_if_t<!std::is_void_v<typename t_shared::PntrAllocator>, SharedPtr<t_shared>>
-  detail::allocate_shared_impl(t_forward && p_allocator, t_args &&... p_args) noexcept(t_nothrow::value);
+  ControlAlloc(ControlAlloc const &) = delete;
+  ControlAlloc(ControlAlloc &&) = delete;
+  ControlAlloc & operator=(ControlAlloc const &) = delete;
+  ControlAlloc & operator=(ControlAlloc &&) = delete;
 };
 
 
@@ -3853,552 +5252,672 @@ PNTR_NAMESPACE_END
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                       pntr/SharedPtr.hpp                                       //
+//                                      pntr/ControlNew.hpp                                       //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 PNTR_NAMESPACE_BEGIN
 
-template<class t_shared, class t_other>
-SharedPtr<t_shared> static_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
-template<class t_shared, class t_other>
-SharedPtr<t_shared> static_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
-template<class t_shared, class t_other>
-SharedPtr<t_shared> dynamic_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
-template<class t_shared, class t_other>
-SharedPtr<t_shared> dynamic_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
-template<class t_shared, class t_other>
-SharedPtr<t_shared> const_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
-template<class t_shared, class t_other>
-SharedPtr<t_shared> const_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
-
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                           SharedPtr                                            //
+//                                           ControlNew                                           //
 //                                                                                                //
-//                      A smart pointer that uses an intrusive control block                      //
+//        A control class for 'Intruder', using 'new' expression, deleter, and usage count        //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 //
-//  Requires that the specified template type is a class that provides the type definitions
-//  and member functions as implemented by and documented in the class 'Intruder'.
-//
-//  It is recommended to inherit the specified class from the class 'Intruder' and to overload
-//  selected functions if required.
+//  Requires that the shared base class type specified as template argument provides the type
+//  definitions and member functions as implemented by and documented in the class 'Intruder'.
 //
-//  Custom reference counting implementations have the benefit that existing reference counters
-//  can be used, but it might not be compatible with existing intrusive weak counters.
+//  Requires that the data class type specified as template argument provides the type definitions
+//  and member functions as implemented by and documented in the class 'ControlData'.
 //
-//  The undocumented functions are equivalent to 'std::shared_ptr'. Its aliasing feature is not
-//  supported by design, as it would require to store an additional pointer.
+//  If 't_supports_weak' is 'std::true_type', the first weak reference to an object allocates a side
+//  block, which is referenced by all 'WeakPtr' instances and outlives the object. The highest user
+//  bit of the data class records that the object has a side block, whose address is stored in a
+//  global table instead of the object. So objects without weak references don't require additional
+//  memory or atomic operations. But every 'WeakPtr' created from a 'SharedPtr' or 'weak_from_this'
+//  locks the mutex of one shard of the table and looks up the side block, as do the weak count and
+//  the destruction of objects with weak references. Copying an existing 'WeakPtr' is the cheap path,
+//  which only increments the weak count of the side block. The flag is updated with a single
+//  compare-and-swap which keeps the other user bits.
 //
 
-template<class t_shared>
-class SharedPtr
+template<class t_shared_base, class t_data, typename t_deleter, class t_supports_weak = std::false_type>
+class ControlNew
 {
 public:
-  using element_type = t_shared;
-  using weak_type = std::conditional_t<t_shared::PntrSupportsWeak::value, WeakPtr<t_shared>, void>;
-
-  constexpr SharedPtr() noexcept
-  : m_shared(nullptr)
-  {}
-
-  constexpr SharedPtr(std::nullptr_t) noexcept
-  : m_shared(nullptr)
-  {}
-
-  // Try to take control of the given object, either by taking new or by sharing the existing
-  // ownership. On failure the contructed 'SharedPtr' will be empty.
-  // It is the responsibility of the user to allocate the object in a way that is compatible
-  // to the deallocation used by the control block.
-  // It is recommended to use make_shared, make_shared_with_deleter, or allocate_shared to let
-  // the control block allocate the object.
-  template<class t_other>
-  SharedPtr(t_other * const p_shared) noexcept
-  : m_shared(t_shared::template pntr_try_control(p_shared))
-  {}
-
-  // Same as above, but in addition accept a deleter object or function that is convertible
-  // and will be assigned to the deleter stored in the control block.
-  template<class t_other, class t_forward, typename = std::enable_if_t<!std::is_void_v<typename t_other::PntrDeleter>>>
-  SharedPtr(t_other * p_shared, t_forward && p_deleter) noexcept
-  : m_shared(t_shared::template pntr_try_control(p_shared, std::forward<t_forward>(p_deleter)))
-  {}
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //        The type definitions and member functions required by 'Intruder' start here         //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
 
-  // Same as above, but accept a 'std::unique_ptr' with deleter object or function that is
-  // convertible and will be assigned to the deleter stored in the control block.
-  template<class t_other, class t_deleter,
-           typename = std::enable_if_t<std::is_convertible_v<t_deleter, typename t_other::PntrDeleter>>>
-  SharedPtr(std::unique_ptr<t_other, t_deleter> && p_unique) noexcept
-  : m_shared(t_shared::template pntr_try_control(p_unique.release(), std::move(p_unique.get_deleter())))
-  {}
+  using SharedBase = t_shared_base;
+  using Data = t_data;
+  using Deleter = t_deleter;
+  using Allocator = void;
+  using UsageValueType = typename t_data::UsageValueType;
+  using DataValueType = typename t_data::DataValueType;
+  using SupportsWeak = t_supports_weak;
+  using WeakControl = std::conditional_t<SupportsWeak::value, detail::WeakSideBlock<ControlNew>, ControlNew>;
+  using WeakValueType = std::conditional_t<SupportsWeak::value, std::uint32_t, typename t_data::WeakValueType>;
 
-  // Same as above, but accept a 'std::unique_ptr' with a const object if the deleter is a templated
-  // empty class that can be default constructed and saved in the control block.
-  template<class t_other, template<class> class t_deleter,
-           typename = std::enable_if_t<
-             std::is_convertible_v<t_deleter<std::remove_const_t<t_other>>, typename t_other::PntrDeleter>
-             && std::is_nothrow_default_constructible_v<t_deleter<std::remove_const_t<t_other>>>
-             && detail::is_empty_base<t_deleter<t_other>>>>
-  SharedPtr(std::unique_ptr<t_other, t_deleter<t_other>> && p_unique) noexcept
-  : m_shared(t_shared::template pntr_try_control(p_unique.release(), t_deleter<std::remove_const_t<t_other>>()))
+  explicit ControlNew(DataValueType const p_user_init) noexcept
+  : m_control_deleter(p_user_init)
   {}
 
-  SharedPtr(SharedPtr const & p_other) noexcept
-  : m_shared(p_other.m_shared)
+  ~ControlNew() noexcept
   {
-    if (m_shared != nullptr)
+    if constexpr (SupportsWeak::value)
     {
-      m_shared->pntr_add_ref();
+      // Only required if an object with weak references is destroyed without being controlled.
+      expire_weak();
     }
   }
 
-  SharedPtr(SharedPtr && p_other) noexcept
-  : m_shared(p_other.m_shared)
+  // Allocate storage for a new instance of the specified type, call its constructor
+  // using the forwarded arguments, and return a pointer to it on success.
+  template<class t_shared, class t_nothrow, typename... t_args>
+  static t_shared *
+  create(t_args &&... p_args) noexcept(t_nothrow::value)
   {
-    p_other.m_shared = nullptr;
+    t_shared * shared = nullptr;
+    if constexpr (t_nothrow::value)
+    {
+      try
+      {
+        // Ignore allocation exceptions
+        shared = new (std::nothrow) t_shared(std::forward<t_args>(p_args)...);
+      }
+      catch (...) // Ignore constructor exceptions
+      {}
+    }
+    else
+    {
+      shared = new t_shared(std::forward<t_args>(p_args)...);
+    }
+    return shared;
   }
 
-  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
-  SharedPtr(SharedPtr<t_other> const & p_other) noexcept
-  : m_shared(p_other.m_shared)
+  // Try to take control of the given object, either by taking new or by sharing the existing
+  // ownership. Return a pointer to the given object on success.
+  template<class t_shared>
+  t_shared *
+  try_control(t_shared & p_shared) noexcept
   {
-    if (m_shared != nullptr)
+    // Check if the address returned from get_shared_base() is equal
+    // to the address of the implicitly upcasted shared instance.
+    PNTR_ASSERT(t_shared::get_shared_base(*this) == &p_shared);
+
+    switch (m_control_deleter.m_data.try_control())
     {
-      m_shared->pntr_add_ref();
+      case ControlStatus::e_invalid:
+        return nullptr;
+      case ControlStatus::e_acquired:
+        m_control_deleter.template init<std::remove_const_t<t_shared>>();
+        break;
+      case ControlStatus::e_shared:
+        break;
     }
+    return &p_shared;
   }
 
-  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
-  SharedPtr(SharedPtr<t_other> && p_other) noexcept
-  : m_shared(p_other.m_shared)
+  // Try to take control of the given object, either by taking new or by sharing the existing
+  // ownership. Assign the deleter and return a pointer to the given object on success.
+  template<class t_shared, class t_forward>
+  t_shared *
+  try_control(t_shared & p_shared, t_forward && p_deleter) noexcept
   {
-    p_other.m_shared = nullptr;
-  }
+    // Check if the address returned from get_shared_base() is equal
+    // to the address of the implicitly upcasted shared instance.
+    PNTR_ASSERT(t_shared::get_shared_base(*this) == &p_shared);
 
-  // Throws 'std::bad_weak_ptr' if the weak pointer is empty.
-  // The non-throwing alternative is to create the shared pointer with 'WeakPtr::lock()'.
-  template<class t_other, typename = std::enable_if_t<t_other::PntrSupportsWeak::value>>
-  explicit SharedPtr(WeakPtr<t_other> const & p_weak)
-  : m_shared(nullptr)
-  {
-    if (p_weak.m_control != nullptr)
-    {
-      m_shared = t_shared::template pntr_try_get_shared<t_other>(*p_weak.m_control);
-    }
-    else
+    switch (m_control_deleter.m_data.try_control())
     {
-      throw std::bad_weak_ptr();
+      case ControlStatus::e_invalid:
+        return nullptr;
+      case ControlStatus::e_acquired:
+        m_control_deleter.set_deleter(std::forward<t_forward>(p_deleter));
+        break;
+      case ControlStatus::e_shared:
+        break;
     }
+    return &p_shared;
   }
 
-  ~SharedPtr() noexcept
+  // Try to increment the usage counter and return a pointer to the shared object on success.
+  template<class t_shared>
+  t_shared *
+  try_get_shared() noexcept
   {
-    if (m_shared != nullptr && m_shared->pntr_release())
+    if (!m_control_deleter.m_data.try_add_ref())
     {
-      t_shared::pntr_deallocate(t_shared::template pntr_dispose(const_cast<std::remove_const_t<t_shared> *>(m_shared)));
+      return nullptr;
     }
+    return detail::static_or_dynamic_cast<t_shared>(t_shared::get_shared_base(*this));
   }
 
-  SharedPtr &
-  operator=(SharedPtr const & p_other) noexcept
+  // Re-initialize the usage counter of an expired object. Return true if it is or was uncontrolled.
+  bool
+  try_revive() noexcept
   {
-    SharedPtr(p_other).swap(*this);
-    return *this;
+    return m_control_deleter.m_data.try_revive();
   }
 
-  SharedPtr &
-  operator=(SharedPtr && p_other) noexcept
+  // Return maximum usage count value.
+  static constexpr UsageValueType
+  get_max_usage_count() noexcept
   {
-    SharedPtr(std::move(p_other)).swap(*this);
-    return *this;
+    return t_data::get_max_usage_count();
   }
 
-  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
-  SharedPtr &
-  operator=(SharedPtr<t_other> const & p_other) noexcept
+  // Return the usage count.
+  UsageValueType
+  use_count() const noexcept
   {
-    SharedPtr(p_other).swap(*this);
-    return *this;
+    return m_control_deleter.m_data.use_count();
   }
 
-  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
-  SharedPtr &
-  operator=(SharedPtr<t_other> && p_other) noexcept
+  // Return the weak count, which includes one reference for a living object.
+  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
+  WeakValueType
+  weak_count() const noexcept
   {
-    SharedPtr(std::move(p_other)).swap(*this);
-    return *this;
+    if (has_weak_control())
+    {
+      auto & shard = detail::WeakSideTable::instance().shard(this);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      auto const found = shard.m_map.find(this);
+      if (found != shard.m_map.end())
+      {
+        return static_cast<WeakControl *>(found->second)->weak_count();
+      }
+    }
+    return (m_control_deleter.m_data.is_alive() ? 1u : 0u);
   }
 
-  explicit operator bool() const noexcept
+  // Return the side block of the object, which is allocated by the first call.
+  // Return nullptr if the allocation fails.
+  template<typename Weak = SupportsWeak, typename = std::enable_if_t<Weak::value>>
+  WeakControl *
+  weak_control() noexcept
   {
-    return m_shared != nullptr;
+    // The flag is only set and cleared while the shard is locked.
+    auto & shard = detail::WeakSideTable::instance().shard(this);
+    std::lock_guard<std::mutex> const lock(shard.m_mutex);
+    if (has_weak_control())
+    {
+      return static_cast<WeakControl *>(shard.m_map.at(this));
+    }
+    WeakControl * const block = new (std::nothrow) WeakControl(*this);
+    if (block != nullptr)
+    {
+      try
+      {
+        shard.m_map.emplace(this, block);
+      }
+      catch (...)
+      {
+        delete block;
+        return nullptr;
+      }
+      m_control_deleter.m_data.try_set_user(s_weak_flag, s_weak_flag);
+    }
+    return block;
   }
 
-  t_shared *
-  get() const noexcept
+  // Increment the usage counter.
+  void
+  add_ref() noexcept
   {
-    return m_shared;
+    m_control_deleter.m_data.add_ref();
   }
 
-  t_shared &
-  operator*() const noexcept
+  // Increment the usage counter by the given number of references at once.
+  void
+  add_ref(UsageValueType const p_count) noexcept
   {
-    PNTR_ASSERT(m_shared != nullptr);
-    return *m_shared;
+    m_control_deleter.m_data.add_ref(p_count);
   }
 
-  t_shared *
-  operator->() const noexcept
+  // Decrement the usage counter and return true if it reaches zero or was invalid.
+  bool
+  release() noexcept
   {
-    PNTR_ASSERT(m_shared != nullptr);
-    return m_shared;
+    return m_control_deleter.m_data.release();
   }
 
-  typename t_shared::PntrUsageValueType
-  use_count() const noexcept
+  // Decrement the usage counter by the given number of references at once, and return true if it
+  // reaches zero or was invalid.
+  bool
+  release(UsageValueType const p_count) noexcept
   {
-    return m_shared != nullptr ? m_shared->pntr_use_count() : typename t_shared::PntrUsageValueType{};
+    return m_control_deleter.m_data.release(p_count);
   }
 
-  typename t_shared::PntrWeakValueType
-  weak_count() const noexcept
+  // Return maximum user value. The user bits are reserved for deleters with an index.
+  static constexpr DataValueType
+  get_max_user() noexcept
   {
-    return m_shared != nullptr ? m_shared->pntr_weak_count() : typename t_shared::PntrWeakValueType{};
+    return (s_user_index ? DataValueType{} : static_cast<DataValueType>(t_data::get_max_user() & ~s_weak_flag));
   }
 
-  template<class t_other>
-  bool
-  owner_before(SharedPtr<t_other> const & p_other) const noexcept
+  // Return the user value.
+  DataValueType
+  get_user() const noexcept
   {
-    return (m_shared != nullptr ? m_shared->pntr_get_owner() : nullptr)
-         < (p_other.m_shared != nullptr ? p_other.m_shared->pntr_get_owner() : nullptr);
+    return (s_user_index ? DataValueType{}
+                         : static_cast<DataValueType>(m_control_deleter.m_data.get_user() & ~s_weak_flag));
   }
 
-  template<class t_other, typename = std::enable_if_t<t_other::PntrSupportsWeak::value>>
+  // Try to set the user value and return true on success.
   bool
-  owner_before(WeakPtr<t_other> const & p_other) const noexcept
+  try_set_user(DataValueType const p_user) noexcept
   {
-    return (m_shared != nullptr ? m_shared->pntr_get_owner() : nullptr) < p_other.get_owner();
+    if constexpr (s_user_index)
+    {
+      return (p_user == DataValueType{});
+    }
+    else if constexpr (SupportsWeak::value)
+    {
+      if (p_user > get_max_user())
+      {
+        return false;
+      }
+      return m_control_deleter.m_data.try_set_user(p_user, get_max_user());
+    }
+    else
+    {
+      return m_control_deleter.m_data.try_set_user(p_user);
+    }
   }
 
-  void
-  reset() noexcept
+  // Delete (non-weak) or destroy (weak) the object. Called when 'pntr_release' returns true.
+  // Return a pointer to the control block if it should be deallocated.
+  template<class t_shared>
+  static typename t_shared::PntrControlType *
+  dispose(ControlNew & p_control, t_shared & p_shared) noexcept
   {
-    SharedPtr().swap(*this);
+    PNTR_TRY_LOG_WARNING(p_control.m_control_deleter.m_data.is_alive(), "disposing object which is still alive");
+    if constexpr (SupportsWeak::value)
+    {
+      p_control.expire_weak();
+    }
+    ControlDeleter::destroy(p_control.m_control_deleter, &p_shared);
+    return nullptr;
   }
 
-  template<class t_other>
-  void
-  reset(t_other * const p_shared) noexcept
+  // Deallocate the memory of the shared instance.
+  static void
+  deallocate([[maybe_unused]] ControlNew * p_control) noexcept
   {
-    SharedPtr(p_shared).swap(*this);
+    PNTR_TRY_LOG_ERROR(p_control != nullptr, "should never reveice a valid pointer");
   }
 
-  template<class t_other, class t_forward, typename = std::enable_if_t<!std::is_void_v<typename t_other::PntrDeleter>>>
-  void
-  reset(t_other * p_shared, t_forward && p_deleter) noexcept
-  {
-    SharedPtr(p_shared, std::forward<t_forward>(p_deleter)).swap(*this);
-  }
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //         The type definitions and member functions required by 'Intruder' end here          //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
 
-  template<class t_other, class t_deleter,
-           typename = std::enable_if_t<std::is_convertible_v<t_deleter, typename t_other::PntrDeleter>>>
-  void
-  reset(std::unique_ptr<t_other, t_deleter> && p_unique) noexcept
-  {
-    SharedPtr(std::move(p_unique)).swap(*this);
-  }
+private:
+  // Deleters with an index are stored in the user bits, see 'DeleterIndexed'.
+  static constexpr bool s_user_index = detail::HasUserIndex<t_deleter>::value;
 
-  template<class t_other, template<class> class t_deleter,
-           typename = std::enable_if_t<
-             std::is_convertible_v<t_deleter<std::remove_const_t<t_other>>, typename t_other::PntrDeleter>
-             && std::is_nothrow_default_constructible_v<t_deleter<std::remove_const_t<t_other>>>
-             && detail::is_empty_base<t_deleter<t_other>>>>
-  void
-  reset(std::unique_ptr<t_other, t_deleter<t_other>> && p_unique) noexcept
-  {
-    SharedPtr(std::move(p_unique)).swap(*this);
-  }
+  using ControlDeleter =
+    std::conditional_t<s_user_index, detail::ControlDeleterIndexed<t_shared_base, t_data, t_deleter>,
+                       detail::ControlDeleter<t_shared_base, t_data, t_deleter, detail::is_empty_base<t_deleter>>>;
 
-  void
-  swap(SharedPtr & p_other) noexcept
+  // The highest user bit records that a side block has been allocated.
+  static constexpr DataValueType s_weak_flag =
+    (SupportsWeak::value ? static_cast<DataValueType>(t_data::get_max_user() - (t_data::get_max_user() >> 1u)) : 0u);
+
+  static_assert(!SupportsWeak::value || s_weak_flag != 0u, "Weak references require at least one user bit");
+  static_assert(!SupportsWeak::value || !s_user_index, "Weak references and the deleter index both use the user bits");
+
+  bool
+  has_weak_control() const noexcept
   {
-    std::swap(m_shared, p_other.m_shared);
+    return ((m_control_deleter.m_data.get_user() & s_weak_flag) != 0u);
   }
 
-private:
-  // Only called from 'make_shared', 'make_shared_with_deleter', pointer casts, and 'WeakPtr::lock'.
-  SharedPtr(t_shared * const p_shared, bool p_add_ref) noexcept
-  : m_shared(p_shared)
+  // Detach the side block before the object is destroyed, and deallocate it if there are no weak
+  // references left.
+  void
+  expire_weak() noexcept
   {
-    if (m_shared != nullptr && p_add_ref)
+    if (!has_weak_control())
+    {
+      return;
+    }
+    WeakControl * block = nullptr;
+    {
+      auto & shard = detail::WeakSideTable::instance().shard(this);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      auto const found = shard.m_map.find(this);
+      block = static_cast<WeakControl *>(found->second);
+      shard.m_map.erase(found);
+      m_control_deleter.m_data.try_set_user(DataValueType{}, s_weak_flag);
+    }
+    block->expire();
+    if (block->weak_release())
     {
-      m_shared->pntr_add_ref();
+      WeakControl::deallocate(block);
     }
   }
 
-  // Only called from pointer casts with move semantics
-  t_shared *
-  detach() noexcept
-  {
-    t_shared * const shared = m_shared;
-    m_shared = nullptr;
-    return shared;
-  }
+  ControlDeleter m_control_deleter;
 
-  t_shared * m_shared;
+  ControlNew(ControlNew const &) = delete;
+  ControlNew(ControlNew &&) = delete;
+  ControlNew & operator=(ControlNew const &) = delete;
+  ControlNew & operator=(ControlNew &&) = delete;
+};
 
-  template<class t_other>
-  friend class SharedPtr;
-  friend class WeakPtr<t_shared>;
 
-  template<class t_self, class t_nothrow, typename... t_args>
-  friend SharedPtr<t_self> detail::make_shared_impl(t_args &&... p_args) noexcept(t_nothrow::value);
-  template<class t_self, class t_nothrow, class t_forward, typename... t_args>
-  friend std::enable_if_t<!std::is_void_v<typename t_self::PntrDeleter>, SharedPtr<t_self>>
-  detail::make_shared_with_deleter_impl(t_forward && p_deleter, t_args &&... p_args) noexcept(t_nothrow::value);
-  template<class t_self, class t_nothrow, class t_forward, typename... t_args>
-  friend std::enable_if_t<!std::is_void_v<typename t_self::PntrAllocator>, SharedPtr<t_self>>
-  detail::allocate_shared_impl(t_forward && p_allocator, t_args &&... p_args) noexcept(t_nothrow::value);
+PNTR_NAMESPACE_END
 
-  template<class t_self, class t_other>
-  friend SharedPtr<t_self> static_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
-  template<class t_self, class t_other>
-  friend SharedPtr<t_self> static_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
-  template<class t_self, class t_other>
-  friend SharedPtr<t_self> dynamic_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
-  template<class t_self, class t_other>
-  friend SharedPtr<t_self> dynamic_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
-  template<class t_self, class t_other>
-  friend SharedPtr<t_self> const_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
-  template<class t_self, class t_other>
-  friend SharedPtr<t_self> const_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
-};
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        pntr/Census.hpp                                         //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <mutex>
+#include <ostream>
+#include <typeinfo>
+#include <unordered_map>
+#include <vector>
 
-// clang-format off
+PNTR_NAMESPACE_BEGIN
 
-template<class L, class R> inline bool operator==(SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() == r.get(); }
-template<class L, class R> inline bool operator!=(SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() != r.get(); }
-template<class L, class R> inline bool operator< (SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() <  r.get(); }
-template<class L, class R> inline bool operator> (SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() >  r.get(); }
-template<class L, class R> inline bool operator<=(SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() <= r.get(); }
-template<class L, class R> inline bool operator>=(SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() >= r.get(); }
 
-template<class T> inline bool operator==(SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() == static_cast<T *>(nullptr); }
-template<class T> inline bool operator!=(SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() != static_cast<T *>(nullptr); }
-template<class T> inline bool operator< (SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() <  static_cast<T *>(nullptr); }
-template<class T> inline bool operator> (SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() >  static_cast<T *>(nullptr); }
-template<class T> inline bool operator<=(SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() <= static_cast<T *>(nullptr); }
-template<class T> inline bool operator>=(SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() >= static_cast<T *>(nullptr); }
+namespace detail
+{
+  // The layout of a type which is counted by the 'Census'.
+  struct CensusType
+  {
+    char const * m_name;
+    std::size_t m_size;
+    std::size_t m_control_size;
+    std::size_t m_padding;
+  };
+} // namespace detail
 
-template<class T> inline bool operator==(std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) == r.get(); }
-template<class T> inline bool operator!=(std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) != r.get(); }
-template<class T> inline bool operator< (std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) <  r.get(); }
-template<class T> inline bool operator> (std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) >  r.get(); }
-template<class T> inline bool operator<=(std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) <= r.get(); }
-template<class T> inline bool operator>=(std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) >= r.get(); }
 
-// clang-format on
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                             Census                                             //
+//                                                                                                //
+//                A registry of live objects with their per-type memory footprint                 //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
+//
+//  Objects of classes derived from 'CensusMember' are registered by the address of their shared
+//  base during their lifetime. 'Census::collect' returns the number of objects of each type, with
+//  their bytes, the bytes of their control blocks, and the padding which follows the control data,
+//  as reported by 'check_intruder_efficiency'.
+//
+//  Objects of a 'ControlAlloc' with weak references are destroyed when the last 'SharedPtr' is
+//  released, but their memory is kept until the last 'WeakPtr' is released. These objects are
+//  listed as pinned until their memory is deallocated, if the shared base is a 'CensusMember'.
+//
+//  The registry is a 'detail::ShardedMap', so threads which create and destroy different objects
+//  rarely contend for the same mutex. It is 'detail::immortal', so the destructors of static
+//  objects can still use it.
+//
 
-namespace detail
+class Census
 {
-  template<class t_shared, class t_nothrow, typename... t_args>
-  SharedPtr<t_shared>
-  make_shared_impl(t_args &&... p_args) noexcept(t_nothrow::value)
+public:
+  // The statistics of one type.
+  struct TypeStatistics
+  {
+    char const * m_name;
+    std::size_t m_size;
+    std::size_t m_count;
+    std::size_t m_bytes;
+    std::size_t m_control_bytes;
+    std::size_t m_padding_bytes;
+    std::size_t m_pinned_count;
+    std::size_t m_pinned_bytes;
+  };
+
+  // Return the statistics of all types with live or pinned objects, ordered by their bytes.
+  static std::vector<TypeStatistics>
+  collect()
   {
-    using Shared = std::remove_const_t<t_shared>;
-    using Allocator = typename Shared::PntrAllocator;
-    Shared * created = nullptr;
-    if constexpr (std::is_void_v<Allocator>)
+    std::unordered_map<detail::CensusType const *, TypeStatistics> types;
+    for (auto & shard : instance().m_entries)
     {
-      created = Shared::template pntr_create<Shared, t_nothrow>(std::forward<t_args>(p_args)...);
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      for (auto const & [address, entry] : shard.m_map)
+      {
+        detail::CensusType const & type = *entry.m_type;
+        TypeStatistics & statistics =
+          types.try_emplace(&type, TypeStatistics{type.m_name, type.m_size, 0u, 0u, 0u, 0u, 0u, 0u}).first->second;
+        if (entry.m_pinned)
+        {
+          ++statistics.m_pinned_count;
+          statistics.m_pinned_bytes += type.m_size;
+        }
+        else
+        {
+          ++statistics.m_count;
+          statistics.m_bytes += type.m_size;
+          statistics.m_control_bytes += type.m_control_size;
+          statistics.m_padding_bytes += type.m_padding;
+        }
+      }
     }
-    else
+    std::vector<TypeStatistics> result;
+    result.reserve(types.size());
+    for (auto const & type : types)
     {
-      created =
-        Shared::template pntr_create_with_allocator<Shared, t_nothrow>(Allocator(), std::forward<t_args>(p_args)...);
+      result.push_back(type.second);
     }
-    Shared * const shared = Shared::template pntr_try_control(created);
-    if (shared == nullptr)
+    std::sort(result.begin(), result.end(),
+              [](TypeStatistics const & p_a, TypeStatistics const & p_b) noexcept
+              { return (p_a.m_bytes + p_a.m_pinned_bytes > p_b.m_bytes + p_b.m_pinned_bytes); });
+    return result;
+  }
+
+  // Write a table of the statistics to the given stream.
+  template<class t_char, class t_traits>
+  static void
+  write(std::basic_ostream<t_char, t_traits> & p_ostream)
+  {
+    for (TypeStatistics const & statistics : collect())
     {
-      Shared::pntr_deallocate(Shared::template pntr_dispose(created));
+      p_ostream << statistics.m_name << ": " << statistics.m_count << " objects of " << statistics.m_size
+                << " bytes, " << statistics.m_bytes << " bytes, " << statistics.m_control_bytes
+                << " control bytes, " << statistics.m_padding_bytes << " padding bytes";
+      if (statistics.m_pinned_count != 0u)
+      {
+        p_ostream << ", " << statistics.m_pinned_count << " pinned by weak pointers with "
+                  << statistics.m_pinned_bytes << " bytes";
+      }
+      p_ostream << std::endl;
     }
-    return SharedPtr<t_shared>(const_cast<t_shared *>(shared), false);
   }
 
-  template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
-  std::enable_if_t<!std::is_void_v<typename t_shared::PntrDeleter>, SharedPtr<t_shared>>
-  make_shared_with_deleter_impl(t_forward && p_deleter, t_args &&... p_args) noexcept(t_nothrow::value)
+  // Return the number of live objects.
+  static std::size_t
+  live_count()
   {
-    using Shared = std::remove_const_t<t_shared>;
-    Shared * const created = Shared::template pntr_create<Shared, t_nothrow>(std::forward<t_args>(p_args)...);
-    Shared * const shared = Shared::template pntr_try_control(created, std::forward<t_forward>(p_deleter));
-    if (shared == nullptr)
+    std::size_t count = 0u;
+    for (auto & shard : instance().m_entries)
     {
-      Shared::pntr_deallocate(Shared::template pntr_dispose(created));
+      std::lock_guard<std::mutex> const lock(shard.m_mutex);
+      for (auto const & entry : shard.m_map)
+      {
+        count += (entry.second.m_pinned ? 0u : 1u);
+      }
     }
-    return SharedPtr<t_shared>(const_cast<t_shared *>(shared), false);
+    return count;
   }
 
-  template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
-  std::enable_if_t<!std::is_void_v<typename t_shared::PntrAllocator>, SharedPtr<t_shared>>
-  allocate_shared_impl(t_forward && p_allocator, t_args &&... p_args) noexcept(t_nothrow::value)
+private:
+  template<class t_shared>
+  friend class CensusMember;
+
+  template<class t_shared_base>
+  friend void detail::census_deallocate(void const * p_address) noexcept;
+
+  struct Entry
   {
-    using Shared = std::remove_const_t<t_shared>;
-    Shared * const created =
-      Shared::template pntr_create_with_allocator<Shared, t_nothrow>(std::forward<t_forward>(p_allocator),
-                                                                     std::forward<t_args>(p_args)...);
-    Shared * const shared = Shared::template pntr_try_control(created);
-    if (shared == nullptr)
+    detail::CensusType const * m_type;
+    bool m_pinned;
+  };
+
+  static Census &
+  instance() noexcept
+  {
+    return detail::immortal<Census>();
+  }
+
+  static void
+  add(void const * const p_address, detail::CensusType const & p_type) noexcept
+  {
+    auto & shard = instance().m_entries.shard(p_address);
+    std::lock_guard<std::mutex> const lock(shard.m_mutex);
+    try
     {
-      Shared::pntr_deallocate(Shared::template pntr_dispose(created));
+      shard.m_map.insert_or_assign(p_address, Entry{&p_type, false});
     }
-    return SharedPtr<t_shared>(const_cast<t_shared *>(shared), false);
+    catch (...) // The object is not counted
+    {}
   }
-} // namespace detail
-
-
-// May throw allocation and constructor exceptions.
-template<class t_shared, typename... t_args>
-SharedPtr<t_shared>
-make_shared(t_args &&... p_args)
-{
-  return detail::make_shared_impl<t_shared, std::false_type>(std::forward<t_args>(p_args)...);
-}
 
-// Doesn't throw. The returned 'SharedPtr' is empty if the allocation or construction fails.
-template<class t_shared, typename... t_args>
-SharedPtr<t_shared>
-make_shared_nothrow(t_args &&... p_args) noexcept
-{
-  return detail::make_shared_impl<t_shared, std::true_type>(std::forward<t_args>(p_args)...);
-}
+  // Remove a destroyed object, or keep it as pinned if its memory is kept by weak references.
+  static void
+  remove(void const * const p_address, bool const p_pinned) noexcept
+  {
+    Census & census = instance();
+    auto & shard = census.m_entries.shard(p_address);
+    std::lock_guard<std::mutex> const lock(shard.m_mutex);
+    auto const found = shard.m_map.find(p_address);
+    if (found != shard.m_map.end())
+    {
+      if (p_pinned)
+      {
+        found->second.m_pinned = true;
+        census.m_pinned.fetch_add(1u, std::memory_order_relaxed);
+      }
+      else
+      {
+        shard.m_map.erase(found);
+      }
+    }
+  }
 
-// May throw allocation and constructor exceptions.
-template<class t_shared, class t_forward, typename... t_args>
-std::enable_if_t<!std::is_void_v<typename t_shared::PntrDeleter>, SharedPtr<t_shared>>
-make_shared_with_deleter(t_forward && p_deleter, t_args &&... p_args)
-{
-  return detail::make_shared_with_deleter_impl<t_shared, std::false_type>(std::forward<t_forward>(p_deleter),
-                                                                          std::forward<t_args>(p_args)...);
-}
+  // Remove a pinned object whose memory is deallocated.
+  static void
+  deallocate(void const * const p_address) noexcept
+  {
+    Census & census = instance();
+    if (census.m_pinned.load(std::memory_order_relaxed) == 0u)
+    {
+      return;
+    }
+    auto & shard = census.m_entries.shard(p_address);
+    std::lock_guard<std::mutex> const lock(shard.m_mutex);
+    auto const found = shard.m_map.find(p_address);
+    if (found != shard.m_map.end() && found->second.m_pinned)
+    {
+      shard.m_map.erase(found);
+      census.m_pinned.fetch_sub(1u, std::memory_order_relaxed);
+    }
+  }
 
-// Doesn't throw. The returned 'SharedPtr' is empty if the allocation or construction fails.
-template<class t_shared, class t_forward, typename... t_args>
-std::enable_if_t<!std::is_void_v<typename t_shared::PntrDeleter>, SharedPtr<t_shared>>
-make_shared_with_deleter_nothrow(t_forward && p_deleter, t_args &&... p_args) noexcept
-{
-  return detail::make_shared_with_deleter_impl<t_shared, std::true_type>(std::forward<t_forward>(p_deleter),
-                                                                         std::forward<t_args>(p_args)...);
-}
+  detail::ShardedMap<Entry> m_entries;
+  std::atomic<std::size_t> m_pinned{0u};
+};
 
-// May throw allocation and constructor exceptions.
-template<class t_shared, class t_forward, typename... t_args>
-std::enable_if_t<!std::is_void_v<typename t_shared::PntrAllocator>, SharedPtr<t_shared>>
-allocate_shared(t_forward && p_allocator, t_args &&... p_args)
-{
-  return detail::allocate_shared_impl<t_shared, std::false_type>(std::forward<t_forward>(p_allocator),
-                                                                 std::forward<t_args>(p_args)...);
-}
 
-// Doesn't throw. The returned 'SharedPtr' is empty if the allocation or construction fails.
-template<class t_shared, class t_forward, typename... t_args>
-std::enable_if_t<!std::is_void_v<typename t_shared::PntrAllocator>, SharedPtr<t_shared>>
-allocate_shared_nothrow(t_forward && p_allocator, t_args &&... p_args) noexcept
+namespace detail
 {
-  return detail::allocate_shared_impl<t_shared, std::true_type>(std::forward<t_forward>(p_allocator),
-                                                                std::forward<t_args>(p_args)...);
-}
-
+  template<class t_shared_base>
+  void
+  census_deallocate(void const * const p_address) noexcept
+  {
+    Census::deallocate(p_address);
+  }
+} // namespace detail
 
-template<class t_shared, class t_other>
-SharedPtr<t_shared>
-static_pointer_cast(SharedPtr<t_other> const & p_other) noexcept
-{
-  return SharedPtr<t_shared>(static_cast<t_shared *>(p_other.get()), true);
-}
 
-template<class t_shared, class t_other>
-SharedPtr<t_shared>
-static_pointer_cast(SharedPtr<t_other> && p_other) noexcept
-{
-  return SharedPtr<t_shared>(static_cast<t_shared *>(p_other.detach()), false);
-}
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                          CensusMember                                          //
+//                                                                                                //
+//                    An opt-in base class which registers objects in 'Census'                    //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
-template<class t_shared, class t_other>
-SharedPtr<t_shared>
-dynamic_pointer_cast(SharedPtr<t_other> const & p_other) noexcept
-{
-  return SharedPtr<t_shared>(dynamic_cast<t_shared *>(p_other.get()), true);
-}
+//
+//  The class 't_shared' has to derive from 'CensusMember<t_shared>' after its 'Intruder' base, so
+//  the control block is still alive when 'CensusMember' is destroyed. Objects are counted as
+//  't_shared', so classes of a hierarchy which should be counted separately need their own
+//  'CensusMember' base. Objects which are not managed by shared pointers are counted as well.
+//
 
-template<class t_shared, class t_other>
-SharedPtr<t_shared>
-dynamic_pointer_cast(SharedPtr<t_other> && p_other) noexcept
+template<class t_shared>
+class CensusMember: public detail::CensusTag
 {
-  t_shared * const shared = dynamic_cast<t_shared *>(p_other.get());
-  if (shared != nullptr)
+protected:
+  CensusMember() noexcept
   {
-    p_other.detach();
+    Census::add(address(), s_type);
   }
-  return SharedPtr<t_shared>(shared, false);
-}
 
-template<class t_shared, class t_other>
-SharedPtr<t_shared>
-const_pointer_cast(SharedPtr<t_other> const & p_other) noexcept
-{
-  return SharedPtr<t_shared>(const_cast<t_shared *>(p_other.get()), true);
-}
+  CensusMember(CensusMember const &) noexcept
+  : CensusMember()
+  {}
 
-template<class t_shared, class t_other>
-SharedPtr<t_shared>
-const_pointer_cast(SharedPtr<t_other> && p_other) noexcept
-{
-  return SharedPtr<t_shared>(const_cast<t_shared *>(p_other.detach()), false);
-}
+  CensusMember &
+  operator=(CensusMember const &) noexcept
+  {
+    return *this;
+  }
 
+  ~CensusMember() noexcept
+  {
+    bool pinned = false;
+    using Control = typename t_shared::PntrControlType;
+    if constexpr (t_shared::PntrSupportsWeak::value && std::is_same_v<detail::WeakControlType<Control>, Control>
+                  && detail::is_census_member<typename t_shared::PntrSharedBase>)
+    {
+      // The weak count includes one reference for the object, which is released after its destruction.
+      pinned = (static_cast<t_shared const *>(this)->pntr_weak_count() > 1u);
+    }
+    Census::remove(address(), pinned);
+  }
 
-template<class t_shared>
-void
-swap(SharedPtr<t_shared> & p_lhs, SharedPtr<t_shared> & p_rhs) noexcept
-{
-  p_lhs.swap(p_rhs);
-}
+private:
+  void const *
+  address() const noexcept
+  {
+    return static_cast<typename t_shared::PntrSharedBase const *>(static_cast<t_shared const *>(this));
+  }
 
-template<class t_char, class t_traits, class t_shared>
-std::basic_ostream<t_char, t_traits> &
-operator<<(std::basic_ostream<t_char, t_traits> & p_ostream, SharedPtr<t_shared> const & p_shared) noexcept
-{
-  return p_ostream << p_shared.get();
-}
+  inline static detail::CensusType const s_type{typeid(t_shared).name(), sizeof(t_shared),
+                                                sizeof(typename t_shared::PntrControlType),
+                                                detail::control_padding<t_shared>()};
+};
 
 
 PNTR_NAMESPACE_END
 
-
-namespace std
-{
-  template<class t_shared>
-  struct hash<::PNTR_NAMESPACE::SharedPtr<t_shared>>
-  {
-    std::size_t
-    operator()(::PNTR_NAMESPACE::SharedPtr<t_shared> const & p_shared) const noexcept
-    {
-      return std::hash<t_shared *>()(p_shared.get());
-    }
-  };
-}
-
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                        pntr/WeakPtr.hpp                                        //
+//                                       pntr/Intruder.hpp                                        //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
@@ -4407,189 +5926,7462 @@ PNTR_NAMESPACE_BEGIN
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 //                                                                                                //
-//                                            WeakPtr                                             //
+//                                            Intruder                                            //
 //                                                                                                //
-//                      A weak pointer that uses an intrusive control block                       //
+//       An intrusive base class that embeds a control block for 'SharedPtr' and 'WeakPtr'        //
 //                                                                                                //
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 
 //
-//  Requires that the specified template type is a class that provides the type definitions
-//  and member functions as implemented by and documented in the class 'Intruder'.
+//  Requires that the control class type specified as template argument
+//  provides the type definitions and member functions as implemented
+//  by and documented in the classes 'ControlNew' and 'ControlAlloc'.
 //
 
-template<class t_shared>
-class WeakPtr
+template<class t_control>
+class Intruder
 {
-  using ControlType = typename t_shared::PntrControlType;
-
 public:
-  using element_type = t_shared;
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  // The type definitions and member functions required by 'SharedPtr' and 'WeakPtr' start here //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
 
-  constexpr WeakPtr() noexcept
-  : m_control(nullptr)
-  {}
+  // 'PntrControlType' is the intrusive control class. It can be 'void'.
+  using PntrControlType = t_control;
 
-  WeakPtr(WeakPtr const & p_other) noexcept
-  : m_control(ControlType::weak_add_ref(p_other.m_control))
-  {}
+  // 'PntrSharedBase' is the base class specified as template parameter for the control class.
+  // It has to be statically (not virtual) derived from the 'Intruder' class.
+  using PntrSharedBase = typename t_control::SharedBase;
 
-  WeakPtr(WeakPtr && p_other) noexcept
-  : m_control(p_other.m_control)
-  {
-    p_other.m_control = nullptr;
-  }
+  // 'PntrUsageValueType' is the integer type used for usage reference counting.
+  using PntrUsageValueType = typename t_control::UsageValueType;
 
-  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
-  WeakPtr(WeakPtr<t_other> const & p_other) noexcept
-  : m_control(ControlType::weak_add_ref(p_other.m_control))
-  {}
+  // 'PntrWeakValueType' is the integer type used for weak reference counting.
+  using PntrWeakValueType = typename t_control::WeakValueType;
 
-  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
-  WeakPtr(WeakPtr<t_other> && p_other) noexcept
-  : m_control(p_other.m_control)
-  {
-    p_other.m_control = nullptr;
-  }
+  // 'PntrDeleter' type has to be either 'void' or a supported deleter type.
+  using PntrDeleter = typename t_control::Deleter;
 
-  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
-  WeakPtr(SharedPtr<t_other> const & p_shared_ptr) noexcept
-  : m_control(ControlType::weak_add_ref(p_shared_ptr ? &p_shared_ptr->control() : nullptr))
-  {}
+  // 'PntrAllocator' type has to be either 'void' or a supported allocator type.
+  using PntrAllocator = typename t_control::Allocator;
 
-  WeakPtr(ControlType & p_control) noexcept
-  : m_control(&p_control)
-  {
-    m_control->weak_add_ref();
+  // 'PntrSupportsWeak' indicates if weak reference counting is supported.
+  // It has to be either 'std::true_type' or 'std::false_type'.
+  using PntrSupportsWeak = typename t_control::SupportsWeak;
+
+private:
+  // Most functions should be private to prevent the derived class from messing around.
+
+  // Allocate storage for a new instance of the specified type, call its constructor
+  // using the forwarded arguments, and return a pointer to it on success.
+  template<class t_shared, class t_nothrow, typename... t_args>
+  static t_shared *
+  pntr_create(t_args &&... p_args) noexcept(t_nothrow::value)
+  {
+    return t_control::template create<t_shared, t_nothrow>(std::forward<t_args>(p_args)...);
+  }
+
+  // Use the allocator to allocate storage for a new instance of the specified type,
+  // call its constructor using the forwarded arguments, and assign the allocator
+  // and return a pointer to the new instance on success.
+  template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
+  static std::enable_if_t<!std::is_void_v<PntrAllocator>, t_shared *>
+  pntr_create_with_allocator(t_forward && p_allocator, t_args &&... p_args) noexcept(t_nothrow::value)
+  {
+    t_shared * shared = t_control::template create<t_shared, t_nothrow>(p_allocator, std::forward<t_args>(p_args)...);
+    if (shared != nullptr)
+    {
+      shared = t_control::template try_init(shared->control(), shared, std::forward<t_forward>(p_allocator));
+    }
+    return shared;
+  }
+
+  // Try to take control of the given object, either by taking new or by sharing the existing
+  // ownership. Return the given pointer on success.
+  template<class t_shared>
+  static t_shared *
+  pntr_try_control(t_shared * p_shared) noexcept
+  {
+    return (p_shared == nullptr ? nullptr : p_shared->control().try_control(*p_shared));
+  }
+
+  // Try to take control of the given object, either by taking new or by sharing the existing
+  // ownership. Assign the deleter and return the given pointer on success.
+  template<class t_shared, class t_forward, typename = std::enable_if_t<!std::is_void_v<typename t_shared::PntrDeleter>>>
+  static t_shared *
+  pntr_try_control(t_shared * p_shared, t_forward && p_deleter) noexcept
+  {
+    return (p_shared == nullptr ? nullptr
+                                : p_shared->control().try_control(*p_shared, std::forward<t_forward>(p_deleter)));
+  }
+
+  // Try to increment the usage counter and return a pointer to the shared object on success.
+  template<class t_shared>
+  static t_shared *
+  pntr_try_get_shared(detail::WeakControlType<t_control> & p_control) noexcept
+  {
+    return p_control.template try_get_shared<t_shared>();
+  }
+
+  // Return the instance referenced by 'WeakPtr', which is the control block unless it provides a
+  // separate side block. Return nullptr if the side block can't be allocated.
+  detail::WeakControlType<t_control> *
+  pntr_get_weak_control() const noexcept
+  {
+    if constexpr (std::is_same_v<detail::WeakControlType<t_control>, t_control>)
+    {
+      return &control();
+    }
+    else
+    {
+      return control().weak_control();
+    }
+  }
+
+  // Return an owner-based pointer for ordering in associative containers.
+  // All 'SharedPtr' and 'WeakPtr' who own the same object should return the same pointer.
+  // Types which support 'WeakPtr' have to return the address of the control class instance.
+  void const *
+  pntr_get_owner() const noexcept
+  {
+    // Check assumption that addresses of 'Intruder' and 'm_control_storage' are identical.
+    static_assert(offsetof(Intruder<t_control>, m_control_storage) == 0u);
+    static_assert(sizeof(Intruder) == sizeof(t_control));
+
+    return this;
+  }
+
+public:
+  // Return the current usage count.
+  PntrUsageValueType
+  pntr_use_count() const noexcept
+  {
+    return control().use_count();
+  }
+
+  // Return the current weak count.
+  PntrWeakValueType
+  pntr_weak_count() const noexcept
+  {
+    PntrWeakValueType weak_count{};
+    if constexpr (PntrSupportsWeak::value)
+    {
+      weak_count = control().weak_count();
+    }
+    return weak_count;
+  }
+
+private:
+  // Increment the usage counter.
+  void
+  pntr_add_ref() const noexcept
+  {
+    control().add_ref();
+  }
+
+  // Increment the usage counter by the given number of references at once.
+  void
+  pntr_add_ref(PntrUsageValueType const p_count) const noexcept
+  {
+    control().add_ref(p_count);
+  }
+
+  // Decrement the usage counter and return true if it reaches zero or was invalid.
+  bool
+  pntr_release() const noexcept
+  {
+    return control().release();
+  }
+
+  // Decrement the usage counter by the given number of references at once, and return true if it
+  // reaches zero or was invalid.
+  bool
+  pntr_release(PntrUsageValueType const p_count) const noexcept
+  {
+    return control().release(p_count);
+  }
+
+  // Delete (non-weak) or destroy (weak) the object. Called when 'pntr_release' returns true.
+  // Return a pointer to the control block if it should be deallocated.
+  template<class t_shared>
+  static PntrControlType *
+  pntr_dispose(t_shared * p_shared) noexcept
+  {
+    return (p_shared == nullptr ? nullptr : t_control::template dispose(p_shared->control(), *p_shared));
+  }
+
+  // Deallocate the object. Called when the weak count reaches zero.
+  static void
+  pntr_deallocate(PntrControlType * p_control) noexcept
+  {
+    if constexpr (detail::is_census_member<PntrSharedBase>)
+    {
+      if (p_control != nullptr)
+      {
+        detail::census_deallocate<PntrSharedBase>(get_shared_base(*p_control));
+      }
+    }
+    t_control::deallocate(p_control);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //  The type definitions and member functions required by 'SharedPtr' and 'WeakPtr' end here  //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //      The type definitions and member functions required by control classes start here      //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // Accept a control instance and return a pointer to the shared base instance.
+  static PntrSharedBase *
+  get_shared_base(t_control & p_control) noexcept
+  {
+    return static_cast<PntrSharedBase *>(reinterpret_cast<Intruder *>(&p_control));
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //       The type definitions and member functions required by control classes end here       //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // 'Intruder' is copyable and movable, but the control block is not.
+
+  Intruder(Intruder const &) noexcept
+  {
+    new (&m_control_storage) t_control;
+  }
+
+  Intruder(Intruder &&) noexcept
+  {
+    new (&m_control_storage) t_control;
+  }
+
+  Intruder &
+  operator=(Intruder const &) noexcept
+  {
+    return *this;
+  }
+
+  Intruder &
+  operator=(Intruder &&) noexcept
+  {
+    return *this;
+  }
+
+  // The function 'shared_from_this' is equivalent to the one in 'std::enable_shared_from_this',
+  // but does not have its restriction that it is permitted to be called only from an object that
+  // is already managed by a shared pointer. So it is permitted to call 'shared_from_this' from
+  // 'Intruder' to acquire control of a shared object, but it can be undefined behaviour if the
+  // shared base is not fully initialized yet, for example calling it during the member
+  // initialization of a constructor of the shared base.
+
+  SharedPtr<PntrSharedBase>
+  shared_from_this() noexcept
+  {
+    return SharedPtr<PntrSharedBase>(static_cast<PntrSharedBase *>(this));
+  }
+
+  SharedPtr<PntrSharedBase const>
+  shared_from_this() const noexcept
+  {
+    return SharedPtr<PntrSharedBase const>(static_cast<PntrSharedBase const *>(this));
+  }
+
+  // The function 'weak_from_this' is equivalent to the one in 'std::enable_shared_from_this',
+  // but does not have its restriction that it is empty until the object is managed by a shared
+  // pointer. So it is permitted to call 'weak_from_this' from 'Intruder' at any time. It can
+  // even be used to construct a 'SharedPtr' to acquire control of the shared object, though
+  // this can be undefined behaviour if the shared base is not fully initialized yet, for
+  // example calling it during the member initialization of a constructor of the shared base.
+
+  template<typename t_weak = PntrSupportsWeak, typename = std::enable_if_t<t_weak::value>>
+  WeakPtr<PntrSharedBase>
+  weak_from_this() noexcept
+  {
+    auto * const weak_control = pntr_get_weak_control();
+    return (weak_control != nullptr ? WeakPtr<PntrSharedBase>(*weak_control) : WeakPtr<PntrSharedBase>());
+  }
+
+  template<typename t_weak = PntrSupportsWeak, typename = std::enable_if_t<t_weak::value>>
+  WeakPtr<PntrSharedBase const>
+  weak_from_this() const noexcept
+  {
+    auto * const weak_control = pntr_get_weak_control();
+    return (weak_control != nullptr ? WeakPtr<PntrSharedBase const>(*weak_control) : WeakPtr<PntrSharedBase const>());
+  }
+
+  // Re-initialize the usage counter of an expired object. Should only be used if an object was
+  // recycled with a custom deleter. It is undefined behaviour to call it in other cases.
+  template<class t_deleter = PntrDeleter, typename = std::enable_if_t<!std::is_void_v<t_deleter>>>
+  bool
+  pntr_try_revive() const noexcept
+  {
+    return control().try_revive();
+  }
+
+  // Return maximum usage count value.
+  static constexpr PntrUsageValueType
+  pntr_get_max_usage_count() noexcept
+  {
+    return t_control::get_max_usage_count();
+  }
+
+  // Return maximum weak count value.
+  static constexpr PntrWeakValueType
+  pntr_get_max_weak_count() noexcept
+  {
+    PntrWeakValueType max_weak_count{};
+    if constexpr (PntrSupportsWeak::value)
+    {
+      max_weak_count = t_control::get_max_weak_count();
+    }
+    return max_weak_count;
+  }
+
+  // 'PntrDataValueType' is the integer type used for the user value.
+  using PntrDataValueType = typename t_control::DataValueType;
+
+  // Return maximum user value, see 'ControlData'.
+  static constexpr PntrDataValueType
+  pntr_get_max_user() noexcept
+  {
+    return t_control::get_max_user();
+  }
+
+  // Return the user value, see 'ControlData'.
+  PntrDataValueType
+  pntr_get_user() const noexcept
+  {
+    return control().get_user();
+  }
+
+  // Try to set the user value and return true on success, see 'ControlData'.
+  bool
+  pntr_try_set_user(PntrDataValueType const p_user) const noexcept
+  {
+    return control().try_set_user(p_user);
+  }
+
+protected:
+  explicit Intruder(PntrDataValueType const p_user_init = 0u) noexcept
+  {
+    new (&m_control_storage) t_control(p_user_init);
+  }
+
+  ~Intruder() noexcept
+  {
+    if constexpr (!std::is_void_v<PntrDeleter>)
+    {
+      control().~t_control();
+    }
+    else if (control().is_uncontrolled())
+    {
+      control().~t_control();
+    }
+  }
+
+private:
+  t_control &
+  control() const noexcept
+  {
+    return *std::launder(reinterpret_cast<t_control *>(&m_control_storage));
+  }
+
+  // Return the user bits reserved for 'CycleCollector', see 'ControlAlloc'.
+  PntrDataValueType
+  pntr_get_cycle_bits() const noexcept
+  {
+    return control().get_cycle_bits();
+  }
+
+  // Set the user bits reserved for 'CycleCollector', see 'ControlAlloc'.
+  void
+  pntr_set_cycle_bits(PntrDataValueType const p_bits) const noexcept
+  {
+    control().set_cycle_bits(p_bits);
+  }
+
+  alignas(t_control) mutable std::byte m_control_storage[sizeof(t_control)];
+
+  friend class CycleCollector;
+  template<class t_shared>
+  friend class SharedPtr;
+  template<class t_shared>
+  friend class WeakPtr;
+
+  template<class t_shared, class t_nothrow, typename... t_args>
+  friend SharedPtr<t_shared> detail::make_shared_impl(t_args &&... p_args) noexcept(t_nothrow::value);
+  template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
+  friend std::enable_if_t<!std::is_void_v<typename t_shared::PntrDeleter>, SharedPtr<t_shared>>
+  detail::make_shared_with_deleter_impl(t_forward && p_deleter, t_args &&... p_args) noexcept(t_nothrow::value);
+  template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
+  friend std::enable_if_t<!std::is_void_v<typename t_shared::PntrAllocator>, SharedPtr<t_shared>>
+  detail::allocate_shared_impl(t_forward && p_allocator, t_args &&... p_args) noexcept(t_nothrow::value);
+};
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                       pntr/SharedPtr.hpp                                       //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PNTR_NAMESPACE_BEGIN
+
+template<class t_shared, class t_other>
+SharedPtr<t_shared> static_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
+template<class t_shared, class t_other>
+SharedPtr<t_shared> static_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
+template<class t_shared, class t_other>
+SharedPtr<t_shared> dynamic_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
+template<class t_shared, class t_other>
+SharedPtr<t_shared> dynamic_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
+template<class t_shared, class t_other>
+SharedPtr<t_shared> const_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
+template<class t_shared, class t_other>
+SharedPtr<t_shared> const_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                           SharedPtr                                            //
+//                                                                                                //
+//                      A smart pointer that uses an intrusive control block                      //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Requires that the specified template type is a class that provides the type definitions
+//  and member functions as implemented by and documented in the class 'Intruder'.
+//
+//  It is recommended to inherit the specified class from the class 'Intruder' and to overload
+//  selected functions if required.
+//
+//  Custom reference counting implementations have the benefit that existing reference counters
+//  can be used, but it might not be compatible with existing intrusive weak counters.
+//
+//  The undocumented functions are equivalent to 'std::shared_ptr'. Its aliasing feature is not
+//  supported by design, as it would require to store an additional pointer.
+//
+
+template<class t_shared>
+class SharedPtr
+{
+public:
+  using element_type = t_shared;
+  using weak_type = std::conditional_t<t_shared::PntrSupportsWeak::value, WeakPtr<t_shared>, void>;
+
+  constexpr SharedPtr() noexcept
+  : m_shared(nullptr)
+  {}
+
+  constexpr SharedPtr(std::nullptr_t) noexcept
+  : m_shared(nullptr)
+  {}
+
+  // Try to take control of the given object, either by taking new or by sharing the existing
+  // ownership. On failure the contructed 'SharedPtr' will be empty.
+  // It is the responsibility of the user to allocate the object in a way that is compatible
+  // to the deallocation used by the control block.
+  // It is recommended to use make_shared, make_shared_with_deleter, or allocate_shared to let
+  // the control block allocate the object.
+  template<class t_other>
+  SharedPtr(t_other * const p_shared) noexcept
+  : m_shared(t_shared::template pntr_try_control(p_shared))
+  {}
+
+  // Same as above, but in addition accept a deleter object or function that is convertible
+  // and will be assigned to the deleter stored in the control block.
+  template<class t_other, class t_forward, typename = std::enable_if_t<!std::is_void_v<typename t_other::PntrDeleter>>>
+  SharedPtr(t_other * p_shared, t_forward && p_deleter) noexcept
+  : m_shared(t_shared::template pntr_try_control(p_shared, std::forward<t_forward>(p_deleter)))
+  {}
+
+  // Same as above, but accept a 'std::unique_ptr' with deleter object or function that is
+  // convertible and will be assigned to the deleter stored in the control block.
+  template<class t_other, class t_deleter,
+           typename = std::enable_if_t<std::is_convertible_v<t_deleter, typename t_other::PntrDeleter>>>
+  SharedPtr(std::unique_ptr<t_other, t_deleter> && p_unique) noexcept
+  : m_shared(t_shared::template pntr_try_control(p_unique.release(), std::move(p_unique.get_deleter())))
+  {}
+
+  // Same as above, but accept a 'std::unique_ptr' with a const object if the deleter is a templated
+  // empty class that can be default constructed and saved in the control block.
+  template<class t_other, template<class> class t_deleter,
+           typename = std::enable_if_t<
+             std::is_convertible_v<t_deleter<std::remove_const_t<t_other>>, typename t_other::PntrDeleter>
+             && std::is_nothrow_default_constructible_v<t_deleter<std::remove_const_t<t_other>>>
+             && detail::is_empty_base<t_deleter<t_other>>>>
+  SharedPtr(std::unique_ptr<t_other, t_deleter<t_other>> && p_unique) noexcept
+  : m_shared(t_shared::template pntr_try_control(p_unique.release(), t_deleter<std::remove_const_t<t_other>>()))
+  {}
+
+  SharedPtr(SharedPtr const & p_other) noexcept
+  : m_shared(p_other.m_shared)
+  {
+    if (m_shared != nullptr)
+    {
+      add_ref();
+    }
+  }
+
+  SharedPtr(SharedPtr && p_other) noexcept
+  : m_shared(p_other.m_shared)
+  {
+    p_other.m_shared = nullptr;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
+  SharedPtr(SharedPtr<t_other> const & p_other) noexcept
+  : m_shared(p_other.m_shared)
+  {
+    if (m_shared != nullptr)
+    {
+      add_ref();
+    }
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
+  SharedPtr(SharedPtr<t_other> && p_other) noexcept
+  : m_shared(p_other.m_shared)
+  {
+    p_other.m_shared = nullptr;
+  }
+
+  // Throws 'std::bad_weak_ptr' if the weak pointer is empty.
+  // The non-throwing alternative is to create the shared pointer with 'WeakPtr::lock()'.
+  template<class t_other, typename = std::enable_if_t<t_other::PntrSupportsWeak::value>>
+  explicit SharedPtr(WeakPtr<t_other> const & p_weak)
+  : m_shared(nullptr)
+  {
+    if (p_weak.m_control != nullptr)
+    {
+      m_shared = t_shared::template pntr_try_get_shared<t_other>(*p_weak.m_control);
+    }
+    else
+    {
+      throw std::bad_weak_ptr();
+    }
+  }
+
+  ~SharedPtr() noexcept
+  {
+    if constexpr (detail::is_cycle_collected<t_shared>)
+    {
+      // A possible root of a garbage cycle is buffered with the reference released here.
+      if (m_shared != nullptr && detail::cycle_buffer(const_cast<detail::BaseType<std::remove_const_t<t_shared>> *>(
+                                   static_cast<detail::BaseType<t_shared> *>(m_shared))))
+      {
+        return;
+      }
+    }
+    if constexpr (detail::is_deferred<t_shared>)
+    {
+      // The release is logged by the current thread and applied when its log is flushed.
+      if (m_shared != nullptr && detail::deferred_release(m_shared))
+      {
+        return;
+      }
+    }
+    if (m_shared != nullptr && m_shared->pntr_release())
+    {
+      dispose(m_shared);
+    }
+  }
+
+  SharedPtr &
+  operator=(SharedPtr const & p_other) noexcept
+  {
+    SharedPtr(p_other).swap(*this);
+    return *this;
+  }
+
+  SharedPtr &
+  operator=(SharedPtr && p_other) noexcept
+  {
+    SharedPtr(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
+  SharedPtr &
+  operator=(SharedPtr<t_other> const & p_other) noexcept
+  {
+    SharedPtr(p_other).swap(*this);
+    return *this;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
+  SharedPtr &
+  operator=(SharedPtr<t_other> && p_other) noexcept
+  {
+    SharedPtr(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return m_shared != nullptr;
+  }
+
+  t_shared *
+  get() const noexcept
+  {
+    return m_shared;
+  }
+
+  t_shared &
+  operator*() const noexcept
+  {
+    PNTR_ASSERT(m_shared != nullptr);
+    return *m_shared;
+  }
+
+  t_shared *
+  operator->() const noexcept
+  {
+    PNTR_ASSERT(m_shared != nullptr);
+    return m_shared;
+  }
+
+  typename t_shared::PntrUsageValueType
+  use_count() const noexcept
+  {
+    return m_shared != nullptr ? m_shared->pntr_use_count() : typename t_shared::PntrUsageValueType{};
+  }
+
+  typename t_shared::PntrWeakValueType
+  weak_count() const noexcept
+  {
+    return m_shared != nullptr ? m_shared->pntr_weak_count() : typename t_shared::PntrWeakValueType{};
+  }
+
+  template<class t_other>
+  bool
+  owner_before(SharedPtr<t_other> const & p_other) const noexcept
+  {
+    return (m_shared != nullptr ? m_shared->pntr_get_owner() : nullptr)
+         < (p_other.m_shared != nullptr ? p_other.m_shared->pntr_get_owner() : nullptr);
+  }
+
+  template<class t_other, typename = std::enable_if_t<t_other::PntrSupportsWeak::value>>
+  bool
+  owner_before(WeakPtr<t_other> const & p_other) const noexcept
+  {
+    return (m_shared != nullptr ? m_shared->pntr_get_owner() : nullptr) < p_other.get_owner();
+  }
+
+  void
+  reset() noexcept
+  {
+    SharedPtr().swap(*this);
+  }
+
+  template<class t_other>
+  void
+  reset(t_other * const p_shared) noexcept
+  {
+    SharedPtr(p_shared).swap(*this);
+  }
+
+  template<class t_other, class t_forward, typename = std::enable_if_t<!std::is_void_v<typename t_other::PntrDeleter>>>
+  void
+  reset(t_other * p_shared, t_forward && p_deleter) noexcept
+  {
+    SharedPtr(p_shared, std::forward<t_forward>(p_deleter)).swap(*this);
+  }
+
+  template<class t_other, class t_deleter,
+           typename = std::enable_if_t<std::is_convertible_v<t_deleter, typename t_other::PntrDeleter>>>
+  void
+  reset(std::unique_ptr<t_other, t_deleter> && p_unique) noexcept
+  {
+    SharedPtr(std::move(p_unique)).swap(*this);
+  }
+
+  template<class t_other, template<class> class t_deleter,
+           typename = std::enable_if_t<
+             std::is_convertible_v<t_deleter<std::remove_const_t<t_other>>, typename t_other::PntrDeleter>
+             && std::is_nothrow_default_constructible_v<t_deleter<std::remove_const_t<t_other>>>
+             && detail::is_empty_base<t_deleter<t_other>>>>
+  void
+  reset(std::unique_ptr<t_other, t_deleter<t_other>> && p_unique) noexcept
+  {
+    SharedPtr(std::move(p_unique)).swap(*this);
+  }
+
+  void
+  swap(SharedPtr & p_other) noexcept
+  {
+    std::swap(m_shared, p_other.m_shared);
+  }
+
+  // Give up the ownership without releasing the object and return its pointer, which keeps the
+  // reference. It has to be passed to 'adopt' exactly once to release the object again. Allows to
+  // transfer the ownership through channels for raw pointers without touching the usage counter.
+  t_shared *
+  release_raw() noexcept
+  {
+    return detach();
+  }
+
+  // Take the ownership of a pointer returned by 'release_raw' without incrementing the usage counter.
+  static SharedPtr
+  adopt(t_shared * const p_shared) noexcept
+  {
+    return SharedPtr(p_shared, false);
+  }
+
+private:
+  // Only called from 'make_shared', 'make_shared_with_deleter', pointer casts, 'WeakPtr::lock',
+  // 'OffsetSharedPtr', 'LocalSharedPtr', and 'CycleCollector'.
+  SharedPtr(t_shared * const p_shared, bool p_add_ref) noexcept
+  : m_shared(p_shared)
+  {
+    if (m_shared != nullptr && p_add_ref)
+    {
+      add_ref();
+    }
+  }
+
+  // A pending deferred release of the same object is cancelled instead of incrementing the counter.
+  void
+  add_ref() const noexcept
+  {
+    if constexpr (detail::is_deferred<t_shared>)
+    {
+      if (detail::deferred_cancel(m_shared))
+      {
+        return;
+      }
+    }
+    m_shared->pntr_add_ref();
+  }
+
+  // Only called from 'DeferredLog' to apply the deferred releases of an object with one decrement.
+  // The count doesn't exceed the usage count, as each release was logged for an owned reference.
+  static void
+  release_deferred(void * const p_shared, std::size_t const p_count) noexcept
+  {
+    auto * const shared = static_cast<t_shared *>(p_shared);
+    if (shared->pntr_release(static_cast<typename t_shared::PntrUsageValueType>(p_count)))
+    {
+      dispose(shared);
+    }
+  }
+
+  // Only called from 'release_range', which disposes the object later if this returns true.
+  static bool
+  release_counter(t_shared * const p_shared, typename t_shared::PntrUsageValueType const p_count) noexcept
+  {
+    return p_shared->pntr_release(p_count);
+  }
+
+  // Only called from 'copy_range', which adopts the references with the private constructor.
+  static void
+  add_ref_counter(t_shared * const p_shared, typename t_shared::PntrUsageValueType const p_count) noexcept
+  {
+    p_shared->pntr_add_ref(p_count);
+  }
+
+  // Only called from the destructor, 'release_deferred', and 'release_range', after the usage
+  // counter has reached zero.
+  static void
+  dispose(t_shared * const p_shared) noexcept
+  {
+    t_shared::pntr_deallocate(t_shared::template pntr_dispose(const_cast<std::remove_const_t<t_shared> *>(p_shared)));
+  }
+
+  // Only called from pointer casts with move semantics, 'OffsetSharedPtr', and 'CycleCollector'
+  t_shared *
+  detach() noexcept
+  {
+    t_shared * const shared = m_shared;
+    m_shared = nullptr;
+    return shared;
+  }
+
+  t_shared * m_shared;
+
+  template<class t_other>
+  friend class SharedPtr;
+  friend class WeakPtr<t_shared>;
+  friend class OffsetSharedPtr<t_shared>;
+  friend class LocalSharedPtr<t_shared>;
+  friend class CycleCollector;
+  friend class detail::DeferredLog;
+  friend class detail::SharedRange;
+
+  template<class t_self, class t_nothrow, typename... t_args>
+  friend SharedPtr<t_self> detail::make_shared_impl(t_args &&... p_args) noexcept(t_nothrow::value);
+  template<class t_self, class t_nothrow, class t_forward, typename... t_args>
+  friend std::enable_if_t<!std::is_void_v<typename t_self::PntrDeleter>, SharedPtr<t_self>>
+  detail::make_shared_with_deleter_impl(t_forward && p_deleter, t_args &&... p_args) noexcept(t_nothrow::value);
+  template<class t_self, class t_nothrow, class t_forward, typename... t_args>
+  friend std::enable_if_t<!std::is_void_v<typename t_self::PntrAllocator>, SharedPtr<t_self>>
+  detail::allocate_shared_impl(t_forward && p_allocator, t_args &&... p_args) noexcept(t_nothrow::value);
+
+  template<class t_self, class t_other>
+  friend SharedPtr<t_self> static_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
+  template<class t_self, class t_other>
+  friend SharedPtr<t_self> static_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
+  template<class t_self, class t_other>
+  friend SharedPtr<t_self> dynamic_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
+  template<class t_self, class t_other>
+  friend SharedPtr<t_self> dynamic_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
+  template<class t_self, class t_other>
+  friend SharedPtr<t_self> const_pointer_cast(SharedPtr<t_other> const & p_other) noexcept;
+  template<class t_self, class t_other>
+  friend SharedPtr<t_self> const_pointer_cast(SharedPtr<t_other> && p_other) noexcept;
+};
+
+
+// clang-format off
+
+template<class L, class R> inline bool operator==(SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() == r.get(); }
+template<class L, class R> inline bool operator!=(SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() != r.get(); }
+template<class L, class R> inline bool operator< (SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() <  r.get(); }
+template<class L, class R> inline bool operator> (SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() >  r.get(); }
+template<class L, class R> inline bool operator<=(SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() <= r.get(); }
+template<class L, class R> inline bool operator>=(SharedPtr<L> const & l, SharedPtr<R> const & r) noexcept { return l.get() >= r.get(); }
+
+template<class T> inline bool operator==(SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() == static_cast<T *>(nullptr); }
+template<class T> inline bool operator!=(SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() != static_cast<T *>(nullptr); }
+template<class T> inline bool operator< (SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() <  static_cast<T *>(nullptr); }
+template<class T> inline bool operator> (SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() >  static_cast<T *>(nullptr); }
+template<class T> inline bool operator<=(SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() <= static_cast<T *>(nullptr); }
+template<class T> inline bool operator>=(SharedPtr<T> const & l, std::nullptr_t) noexcept { return l.get() >= static_cast<T *>(nullptr); }
+
+template<class T> inline bool operator==(std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) == r.get(); }
+template<class T> inline bool operator!=(std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) != r.get(); }
+template<class T> inline bool operator< (std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) <  r.get(); }
+template<class T> inline bool operator> (std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) >  r.get(); }
+template<class T> inline bool operator<=(std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) <= r.get(); }
+template<class T> inline bool operator>=(std::nullptr_t, SharedPtr<T> const & r) noexcept { return static_cast<T *>(nullptr) >= r.get(); }
+
+// clang-format on
+
+
+namespace detail
+{
+  template<class t_shared, class t_nothrow, typename... t_args>
+  SharedPtr<t_shared>
+  make_shared_impl(t_args &&... p_args) noexcept(t_nothrow::value)
+  {
+    using Shared = std::remove_const_t<t_shared>;
+    using Allocator = typename Shared::PntrAllocator;
+    Shared * created = nullptr;
+    if constexpr (std::is_void_v<Allocator>)
+    {
+      created = Shared::template pntr_create<Shared, t_nothrow>(std::forward<t_args>(p_args)...);
+    }
+    else
+    {
+      created =
+        Shared::template pntr_create_with_allocator<Shared, t_nothrow>(Allocator(), std::forward<t_args>(p_args)...);
+    }
+    Shared * const shared = Shared::template pntr_try_control(created);
+    if (shared == nullptr)
+    {
+      Shared::pntr_deallocate(Shared::template pntr_dispose(created));
+    }
+    return SharedPtr<t_shared>(const_cast<t_shared *>(shared), false);
+  }
+
+  template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
+  std::enable_if_t<!std::is_void_v<typename t_shared::PntrDeleter>, SharedPtr<t_shared>>
+  make_shared_with_deleter_impl(t_forward && p_deleter, t_args &&... p_args) noexcept(t_nothrow::value)
+  {
+    using Shared = std::remove_const_t<t_shared>;
+    Shared * const created = Shared::template pntr_create<Shared, t_nothrow>(std::forward<t_args>(p_args)...);
+    Shared * const shared = Shared::template pntr_try_control(created, std::forward<t_forward>(p_deleter));
+    if (shared == nullptr)
+    {
+      Shared::pntr_deallocate(Shared::template pntr_dispose(created));
+    }
+    return SharedPtr<t_shared>(const_cast<t_shared *>(shared), false);
+  }
+
+  template<class t_shared, class t_nothrow, class t_forward, typename... t_args>
+  std::enable_if_t<!std::is_void_v<typename t_shared::PntrAllocator>, SharedPtr<t_shared>>
+  allocate_shared_impl(t_forward && p_allocator, t_args &&... p_args) noexcept(t_nothrow::value)
+  {
+    using Shared = std::remove_const_t<t_shared>;
+    Shared * const created =
+      Shared::template pntr_create_with_allocator<Shared, t_nothrow>(std::forward<t_forward>(p_allocator),
+                                                                     std::forward<t_args>(p_args)...);
+    Shared * const shared = Shared::template pntr_try_control(created);
+    if (shared == nullptr)
+    {
+      Shared::pntr_deallocate(Shared::template pntr_dispose(created));
+    }
+    return SharedPtr<t_shared>(const_cast<t_shared *>(shared), false);
+  }
+} // namespace detail
+
+
+// May throw allocation and constructor exceptions.
+template<class t_shared, typename... t_args>
+SharedPtr<t_shared>
+make_shared(t_args &&... p_args)
+{
+  return detail::make_shared_impl<t_shared, std::false_type>(std::forward<t_args>(p_args)...);
+}
+
+// Doesn't throw. The returned 'SharedPtr' is empty if the allocation or construction fails.
+template<class t_shared, typename... t_args>
+SharedPtr<t_shared>
+make_shared_nothrow(t_args &&... p_args) noexcept
+{
+  return detail::make_shared_impl<t_shared, std::true_type>(std::forward<t_args>(p_args)...);
+}
+
+// May throw allocation and constructor exceptions.
+template<class t_shared, class t_forward, typename... t_args>
+std::enable_if_t<!std::is_void_v<typename t_shared::PntrDeleter>, SharedPtr<t_shared>>
+make_shared_with_deleter(t_forward && p_deleter, t_args &&... p_args)
+{
+  return detail::make_shared_with_deleter_impl<t_shared, std::false_type>(std::forward<t_forward>(p_deleter),
+                                                                          std::forward<t_args>(p_args)...);
+}
+
+// Doesn't throw. The returned 'SharedPtr' is empty if the allocation or construction fails.
+template<class t_shared, class t_forward, typename... t_args>
+std::enable_if_t<!std::is_void_v<typename t_shared::PntrDeleter>, SharedPtr<t_shared>>
+make_shared_with_deleter_nothrow(t_forward && p_deleter, t_args &&... p_args) noexcept
+{
+  return detail::make_shared_with_deleter_impl<t_shared, std::true_type>(std::forward<t_forward>(p_deleter),
+                                                                         std::forward<t_args>(p_args)...);
+}
+
+// May throw allocation and constructor exceptions.
+template<class t_shared, class t_forward, typename... t_args>
+std::enable_if_t<!std::is_void_v<typename t_shared::PntrAllocator>, SharedPtr<t_shared>>
+allocate_shared(t_forward && p_allocator, t_args &&... p_args)
+{
+  return detail::allocate_shared_impl<t_shared, std::false_type>(std::forward<t_forward>(p_allocator),
+                                                                 std::forward<t_args>(p_args)...);
+}
+
+// Doesn't throw. The returned 'SharedPtr' is empty if the allocation or construction fails.
+template<class t_shared, class t_forward, typename... t_args>
+std::enable_if_t<!std::is_void_v<typename t_shared::PntrAllocator>, SharedPtr<t_shared>>
+allocate_shared_nothrow(t_forward && p_allocator, t_args &&... p_args) noexcept
+{
+  return detail::allocate_shared_impl<t_shared, std::true_type>(std::forward<t_forward>(p_allocator),
+                                                                std::forward<t_args>(p_args)...);
+}
+
+
+template<class t_shared, class t_other>
+SharedPtr<t_shared>
+static_pointer_cast(SharedPtr<t_other> const & p_other) noexcept
+{
+  return SharedPtr<t_shared>(static_cast<t_shared *>(p_other.get()), true);
+}
+
+template<class t_shared, class t_other>
+SharedPtr<t_shared>
+static_pointer_cast(SharedPtr<t_other> && p_other) noexcept
+{
+  return SharedPtr<t_shared>(static_cast<t_shared *>(p_other.detach()), false);
+}
+
+template<class t_shared, class t_other>
+SharedPtr<t_shared>
+dynamic_pointer_cast(SharedPtr<t_other> const & p_other) noexcept
+{
+  return SharedPtr<t_shared>(dynamic_cast<t_shared *>(p_other.get()), true);
+}
+
+template<class t_shared, class t_other>
+SharedPtr<t_shared>
+dynamic_pointer_cast(SharedPtr<t_other> && p_other) noexcept
+{
+  t_shared * const shared = dynamic_cast<t_shared *>(p_other.get());
+  if (shared != nullptr)
+  {
+    p_other.detach();
+  }
+  return SharedPtr<t_shared>(shared, false);
+}
+
+template<class t_shared, class t_other>
+SharedPtr<t_shared>
+const_pointer_cast(SharedPtr<t_other> const & p_other) noexcept
+{
+  return SharedPtr<t_shared>(const_cast<t_shared *>(p_other.get()), true);
+}
+
+template<class t_shared, class t_other>
+SharedPtr<t_shared>
+const_pointer_cast(SharedPtr<t_other> && p_other) noexcept
+{
+  return SharedPtr<t_shared>(const_cast<t_shared *>(p_other.detach()), false);
+}
+
+
+template<class t_shared>
+void
+swap(SharedPtr<t_shared> & p_lhs, SharedPtr<t_shared> & p_rhs) noexcept
+{
+  p_lhs.swap(p_rhs);
+}
+
+template<class t_char, class t_traits, class t_shared>
+std::basic_ostream<t_char, t_traits> &
+operator<<(std::basic_ostream<t_char, t_traits> & p_ostream, SharedPtr<t_shared> const & p_shared) noexcept
+{
+  return p_ostream << p_shared.get();
+}
+
+
+PNTR_NAMESPACE_END
+
+
+namespace std
+{
+  template<class t_shared>
+  struct hash<::PNTR_NAMESPACE::SharedPtr<t_shared>>
+  {
+    std::size_t
+    operator()(::PNTR_NAMESPACE::SharedPtr<t_shared> const & p_shared) const noexcept
+    {
+      return std::hash<t_shared *>()(p_shared.get());
+    }
+  };
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        pntr/WeakPtr.hpp                                        //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                            WeakPtr                                             //
+//                                                                                                //
+//                      A weak pointer that uses an intrusive control block                       //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Requires that the specified template type is a class that provides the type definitions
+//  and member functions as implemented by and documented in the class 'Intruder'.
+//
+
+template<class t_shared>
+class WeakPtr
+{
+  using ControlType = detail::WeakControlType<typename t_shared::PntrControlType>;
+
+public:
+  using element_type = t_shared;
+
+  constexpr WeakPtr() noexcept
+  : m_control(nullptr)
+  {}
+
+  WeakPtr(WeakPtr const & p_other) noexcept
+  : m_control(ControlType::weak_add_ref(p_other.m_control))
+  {}
+
+  WeakPtr(WeakPtr && p_other) noexcept
+  : m_control(p_other.m_control)
+  {
+    p_other.m_control = nullptr;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
+  WeakPtr(WeakPtr<t_other> const & p_other) noexcept
+  : m_control(ControlType::weak_add_ref(p_other.m_control))
+  {}
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
+  WeakPtr(WeakPtr<t_other> && p_other) noexcept
+  : m_control(p_other.m_control)
+  {
+    p_other.m_control = nullptr;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
+  WeakPtr(SharedPtr<t_other> const & p_shared_ptr) noexcept
+  : m_control(ControlType::weak_add_ref(p_shared_ptr ? p_shared_ptr->pntr_get_weak_control() : nullptr))
+  {}
+
+  WeakPtr(ControlType & p_control) noexcept
+  : m_control(&p_control)
+  {
+    m_control->weak_add_ref();
+  }
+
+  ~WeakPtr() noexcept
+  {
+    if (m_control != nullptr && m_control->weak_release())
+    {
+      if constexpr (std::is_same_v<ControlType, typename t_shared::PntrControlType>)
+      {
+        t_shared::pntr_deallocate(m_control);
+      }
+      else
+      {
+        ControlType::deallocate(m_control);
+      }
+    }
+  }
+
+  WeakPtr &
+  operator=(WeakPtr const & p_other) noexcept
+  {
+    WeakPtr(p_other).swap(*this);
+    return *this;
+  }
+
+  WeakPtr &
+  operator=(WeakPtr && p_other) noexcept
+  {
+    WeakPtr(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
+  WeakPtr &
+  operator=(WeakPtr<t_other> const & p_other) noexcept
+  {
+    WeakPtr(p_other).swap(*this);
+    return *this;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
+  WeakPtr &
+  operator=(WeakPtr<t_other> && p_other) noexcept
+  {
+    WeakPtr(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
+  WeakPtr &
+  operator=(SharedPtr<t_other> const & p_shared_ptr) noexcept
+  {
+    WeakPtr(p_shared_ptr).swap(*this);
+    return *this;
+  }
+
+  bool
+  is_empty() const noexcept
+  {
+    return (m_control == nullptr);
+  }
+
+  void
+  reset() noexcept
+  {
+    WeakPtr().swap(*this);
+  }
+
+  void
+  swap(WeakPtr & p_other) noexcept
+  {
+    std::swap(m_control, p_other.m_control);
+  }
+
+  typename ControlType::UsageValueType
+  use_count() const noexcept
+  {
+    return m_control != nullptr ? m_control->use_count() : typename ControlType::UsageValueType{};
+  }
+
+  typename ControlType::WeakValueType
+  weak_count() const noexcept
+  {
+    return m_control != nullptr ? m_control->weak_count() : typename ControlType::WeakValueType{};
+  }
+
+  bool
+  expired() const noexcept
+  {
+    return (m_control != nullptr && m_control->use_count() == 0u);
+  }
+
+  SharedPtr<t_shared>
+  lock() const noexcept
+  {
+    return SharedPtr<t_shared>(m_control != nullptr ? m_control->template try_get_shared<t_shared>() : nullptr, false);
+  }
+
+  template<class t_other>
+  bool
+  owner_before(WeakPtr<t_other> const & p_other) const noexcept
+  {
+    return get_owner() < p_other.get_owner();
+  }
+
+  template<class t_other>
+  bool
+  owner_before(SharedPtr<t_other> const & p_other) const noexcept
+  {
+    return get_owner() < (p_other ? p_other->pntr_get_owner() : nullptr);
+  }
+
+private:
+  void const *
+  get_owner() const noexcept
+  {
+    if constexpr (std::is_same_v<ControlType, typename t_shared::PntrControlType>)
+    {
+      return m_control;
+    }
+    else
+    {
+      return (m_control != nullptr ? m_control->get_owner() : nullptr);
+    }
+  }
+
+  ControlType * m_control;
+
+  template<class t_other>
+  friend class WeakPtr;
+
+  template<class t_self>
+  friend class SharedPtr;
+
+  friend class detail::WeakRange;
+};
+
+
+template<class t_shared>
+void
+swap(WeakPtr<t_shared> & p_lhs, WeakPtr<t_shared> & p_rhs) noexcept
+{
+  p_lhs.swap(p_rhs);
+}
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                       pntr/WeakRange.hpp                                       //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <type_traits>
+#include <utility>
+
+// The gathers are disabled for ThreadSanitizer, which would miss their loads.
+#if defined(__AVX2__) && !defined(__SANITIZE_THREAD__)
+  #if defined(__has_feature)
+    #if !__has_feature(thread_sanitizer)
+      #define PNTR_WEAK_RANGE_GATHER
+    #endif
+  #else
+    #define PNTR_WEAK_RANGE_GATHER
+  #endif
+#endif
+
+#if defined(PNTR_WEAK_RANGE_GATHER)
+  #include <immintrin.h>
+#endif
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // Detects a control block whose usage count can be loaded from a word with a mask.
+  template<class t_control, typename = void>
+  struct UsageWord: std::false_type
+  {};
+
+  template<class t_control>
+  struct UsageWord<t_control, std::void_t<decltype(std::declval<t_control const &>().usage_word()),
+                                          decltype(t_control::Data::get_usage_mask())>>
+  : std::true_type
+  {};
+
+
+  class WeakRange
+  {
+  public:
+    // The number of weak pointers which are tested together.
+    static constexpr std::size_t s_block = 8u;
+
+    // Return a mask with bit i set if the weak pointer i of the block is empty or expired.
+    template<class t_iterator>
+    static unsigned
+    expired_mask(t_iterator const p_block, std::size_t const p_count) noexcept
+    {
+      using Control = typename std::iterator_traits<t_iterator>::value_type::ControlType;
+      if constexpr (UsageWord<Control>::value)
+      {
+#if defined(PNTR_WEAK_RANGE_GATHER)
+        using Word = std::remove_const_t<std::remove_pointer_t<decltype(std::declval<Control const &>().usage_word())>>;
+        if constexpr (sizeof(Word) == 4u || sizeof(Word) == 8u)
+        {
+          if (p_count == s_block)
+          {
+            return gather_expired<Word>(p_block, Control::Data::get_usage_mask());
+          }
+        }
+#endif
+      }
+      unsigned mask = 0u;
+      for (std::size_t i = 0u; i < p_count; ++i)
+      {
+        Control const * const control = p_block[static_cast<std::ptrdiff_t>(i)].m_control;
+        mask |= ((control == nullptr || control->use_count() == 0u) ? 1u : 0u) << i;
+      }
+      return mask;
+    }
+
+    template<class t_iterator>
+    static t_iterator
+    sweep(t_iterator const p_first, t_iterator const p_last) noexcept
+    {
+      t_iterator output = p_first;
+      t_iterator it = p_first;
+      while (it != p_last)
+      {
+        std::size_t const count = std::min(s_block, static_cast<std::size_t>(p_last - it));
+        unsigned const expired = expired_mask(it, count);
+        for (std::size_t i = 0u; i < count; ++i, ++it)
+        {
+          if ((expired & (1u << i)) != 0u)
+          {
+            it->reset();
+          }
+          else
+          {
+            if (output != it)
+            {
+              *output = std::move(*it);
+            }
+            ++output;
+          }
+        }
+      }
+      return output;
+    }
+
+    template<class t_iterator, class t_output>
+    static t_output
+    lock(t_iterator const p_first, t_iterator const p_last, t_output p_output)
+    {
+      using Shared = typename std::iterator_traits<t_iterator>::value_type::element_type;
+      t_iterator it = p_first;
+      while (it != p_last)
+      {
+        std::size_t const count = std::min(s_block, static_cast<std::size_t>(p_last - it));
+        unsigned const expired = expired_mask(it, count);
+        for (std::size_t i = 0u; i < count; ++i, ++it, ++p_output)
+        {
+          // An object which expires after the test is detected by 'lock'.
+          *p_output = ((expired & (1u << i)) != 0u ? SharedPtr<Shared>() : it->lock());
+        }
+      }
+      return p_output;
+    }
+
+  private:
+#if defined(PNTR_WEAK_RANGE_GATHER)
+    // Load the usage words of a full block with two gathers, and test them for zero.
+    //
+    // The gathers read the atomic usage words with plain loads, which is a data race under the C++
+    // memory model. It is deliberate: the words are naturally aligned, and x86 loads each aligned
+    // element of a gather atomically, so every lane holds a value the counter actually had. The
+    // acquire fence orders the loads like 'use_count()' before a word which reads as alive is
+    // trusted. Builds with ThreadSanitizer test the words one by one with atomic loads instead.
+    template<class t_word, class t_iterator>
+    static unsigned
+    gather_expired(t_iterator const p_block, t_word const p_mask) noexcept
+    {
+      // Empty pointers load a zero word, so they are reported as expired.
+      static t_word const s_zero = 0u;
+      alignas(32) long long addresses[s_block];
+      for (std::size_t i = 0u; i < s_block; ++i)
+      {
+        auto const * const control = p_block[static_cast<std::ptrdiff_t>(i)].m_control;
+        addresses[i] = static_cast<long long>(
+          reinterpret_cast<std::uintptr_t>(control != nullptr ? control->usage_word() : &s_zero));
+      }
+      unsigned mask = 0u;
+      for (std::size_t half = 0u; half < 2u; ++half)
+      {
+        __m256i const indices = _mm256_load_si256(reinterpret_cast<__m256i const *>(addresses + 4u * half));
+        unsigned bits = 0u;
+        if constexpr (sizeof(t_word) == 8u)
+        {
+          __m256i const words = _mm256_i64gather_epi64(static_cast<long long const *>(nullptr), indices, 1);
+          __m256i const counts = _mm256_and_si256(words, _mm256_set1_epi64x(static_cast<long long>(p_mask)));
+          __m256i const zero = _mm256_cmpeq_epi64(counts, _mm256_setzero_si256());
+          bits = static_cast<unsigned>(_mm256_movemask_pd(_mm256_castsi256_pd(zero)));
+        }
+        else
+        {
+          __m128i const words = _mm256_i64gather_epi32(static_cast<int const *>(nullptr), indices, 1);
+          __m128i const counts = _mm_and_si128(words, _mm_set1_epi32(static_cast<int>(p_mask)));
+          __m128i const zero = _mm_cmpeq_epi32(counts, _mm_setzero_si128());
+          bits = static_cast<unsigned>(_mm_movemask_ps(_mm_castsi128_ps(zero)));
+        }
+        mask |= bits << (4u * half);
+      }
+      std::atomic_thread_fence(std::memory_order_acquire);
+      return mask;
+    }
+#endif
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                    sweep_expired, lock_all                                     //
+//                                                                                                //
+//              Test the usage counts of ranges of weak pointers in blocks of eight               //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The usage counts of eight weak pointers are loaded together, so the cache misses of their
+//  control blocks overlap. If the code is compiled for AVX2 and the control data has a usage word,
+//  like 'ControlData' with 32 or 64 bit words, they are loaded with two gather instructions and
+//  tested with one comparison. Other control blocks, like the side blocks of 'ControlNew', are
+//  tested one by one. The ranges require random access iterators.
+//
+//  'sweep_expired' removes the empty and expired weak pointers from the range, keeps the order of
+//  the others like 'std::remove_if', and returns the new end. The removed pointers are released,
+//  so the pointers behind the new end are empty. Objects which expire while the range is swept
+//  are either removed, or kept and removed by the next sweep. An object which is recycled by a
+//  custom deleter can become alive again with 'pntr_try_revive', like the cached objects of
+//  'RetentionCache'. Its weak pointers are removed if the sweep finds it expired, even though
+//  'lock()' would succeed again after it has been revived.
+//
+//  'lock_all' writes the result of 'lock()' for each weak pointer of the range to the output, but
+//  skips the atomic update for the pointers which were found expired. If an assignment throws, for
+//  example when a 'std::back_inserter' grows its container, the exception propagates and the output
+//  holds the pointers assigned before it.
+//
+
+template<class t_iterator>
+t_iterator
+sweep_expired(t_iterator const p_first, t_iterator const p_last) noexcept
+{
+  return detail::WeakRange::sweep(p_first, p_last);
+}
+
+
+template<class t_iterator, class t_output>
+t_output
+lock_all(t_iterator const p_first, t_iterator const p_last, t_output const p_output)
+{
+  return detail::WeakRange::lock(p_first, p_last, p_output);
+}
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                       pntr/OffsetPtr.hpp                                       //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                           OffsetPtr                                            //
+//                                                                                                //
+//           A raw pointer that stores the distance to its target relative to its own address     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'OffsetPtr' remains valid if the memory block that contains both the pointer and its target is
+//  mapped at a different address, for example by another process sharing a memory segment. It
+//  can't point to itself, because an offset of zero represents 'nullptr'.
+//
+
+template<class t_type>
+class OffsetPtr
+{
+public:
+  using element_type = t_type;
+
+  OffsetPtr() noexcept = default;
+
+  OffsetPtr(std::nullptr_t) noexcept
+  {}
+
+  OffsetPtr(t_type * const p_pointer) noexcept
+  {
+    set(p_pointer);
+  }
+
+  OffsetPtr(OffsetPtr const & p_other) noexcept
+  {
+    set(p_other.get());
+  }
+
+  OffsetPtr &
+  operator=(OffsetPtr const & p_other) noexcept
+  {
+    set(p_other.get());
+    return *this;
+  }
+
+  OffsetPtr &
+  operator=(t_type * const p_pointer) noexcept
+  {
+    set(p_pointer);
+    return *this;
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return (m_offset != 0);
+  }
+
+  t_type *
+  get() const noexcept
+  {
+    return (m_offset == 0 ? nullptr
+                          : reinterpret_cast<t_type *>(reinterpret_cast<std::uintptr_t>(this)
+                                                       + static_cast<std::uintptr_t>(m_offset)));
+  }
+
+  t_type &
+  operator*() const noexcept
+  {
+    PNTR_ASSERT(m_offset != 0);
+    return *get();
+  }
+
+  t_type *
+  operator->() const noexcept
+  {
+    PNTR_ASSERT(m_offset != 0);
+    return get();
+  }
+
+private:
+  void
+  set(t_type * const p_pointer) noexcept
+  {
+    m_offset = (p_pointer == nullptr ? 0
+                                     : static_cast<std::ptrdiff_t>(reinterpret_cast<std::uintptr_t>(p_pointer)
+                                                                   - reinterpret_cast<std::uintptr_t>(this)));
+  }
+
+  std::ptrdiff_t m_offset{};
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        OffsetSharedPtr                                         //
+//                                                                                                //
+//         A shared pointer that stores an 'OffsetPtr' and owns one reference to its target       //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'OffsetSharedPtr' is meant to be stored inside of shared objects in a memory segment which is
+//  mapped by several processes, see 'AllocatorSharedMemory'. Access from outside of the segment
+//  should use 'SharedPtr', which can be obtained with 'get_shared()'.
+//
+
+template<class t_shared>
+class OffsetSharedPtr
+{
+public:
+  using element_type = t_shared;
+
+  OffsetSharedPtr() noexcept = default;
+
+  OffsetSharedPtr(std::nullptr_t) noexcept
+  {}
+
+  OffsetSharedPtr(SharedPtr<t_shared> p_shared) noexcept
+  : m_pointer(p_shared.detach())
+  {}
+
+  OffsetSharedPtr(OffsetSharedPtr const & p_other) noexcept
+  : OffsetSharedPtr(p_other.get_shared())
+  {}
+
+  ~OffsetSharedPtr() noexcept
+  {
+    reset();
+  }
+
+  OffsetSharedPtr &
+  operator=(OffsetSharedPtr const & p_other) noexcept
+  {
+    return (*this = p_other.get_shared());
+  }
+
+  OffsetSharedPtr &
+  operator=(SharedPtr<t_shared> p_shared) noexcept
+  {
+    reset();
+    m_pointer = p_shared.detach();
+    return *this;
+  }
+
+  void
+  reset() noexcept
+  {
+    // The temporary 'SharedPtr' adopts and releases the owned reference.
+    SharedPtr<t_shared>(m_pointer.get(), false);
+    m_pointer = nullptr;
+  }
+
+  // Return a 'SharedPtr' which shares the ownership.
+  SharedPtr<t_shared>
+  get_shared() const noexcept
+  {
+    return SharedPtr<t_shared>(m_pointer.get(), true);
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return static_cast<bool>(m_pointer);
+  }
+
+  t_shared *
+  get() const noexcept
+  {
+    return m_pointer.get();
+  }
+
+  t_shared &
+  operator*() const noexcept
+  {
+    return *m_pointer;
+  }
+
+  t_shared *
+  operator->() const noexcept
+  {
+    return m_pointer.get();
+  }
+
+  typename t_shared::PntrUsageValueType
+  use_count() const noexcept
+  {
+    return m_pointer ? m_pointer->pntr_use_count() : typename t_shared::PntrUsageValueType{};
+  }
+
+private:
+  OffsetPtr<t_shared> m_pointer;
+};
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                    pntr/LocalSharedPtr.hpp                                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <new>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The non-atomic count shared by the copies of a 'LocalSharedPtr'.
+  struct LocalCount
+  {
+    std::size_t m_count;
+    void (*m_destroy)(LocalCount *) noexcept;
+  };
+
+  // Owns the single reference of all copies of a 'LocalSharedPtr'.
+  template<class t_shared>
+  struct LocalCountShared: LocalCount
+  {
+    explicit LocalCountShared(SharedPtr<t_shared> && p_shared) noexcept
+    : LocalCount{1u, &destroy}
+    , m_shared(std::move(p_shared))
+    {}
+
+    static void
+    destroy(LocalCount * const p_count) noexcept
+    {
+      delete static_cast<LocalCountShared *>(p_count);
+    }
+
+    SharedPtr<t_shared> m_shared;
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         LocalSharedPtr                                         //
+//                                                                                                //
+//        A shared pointer for one thread, whose copies share a single counted reference          //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'LocalSharedPtr' is constructed explicitly from a 'SharedPtr', which allocates a regular
+//  counter that holds the only reference to the object. Copies of the 'LocalSharedPtr' increment
+//  that counter instead of the usage counter of the object, which is released when the last copy
+//  is destroyed. So copying costs the same as with a thread-unsafe counter, even if the object
+//  uses a thread-safe one. The 'LocalSharedPtr' is empty if the counter can't be allocated.
+//
+//  The counter is shared by the copies of one 'LocalSharedPtr' only. Each construction from a
+//  'SharedPtr' allocates a new counter with its own reference, even if the same thread already
+//  holds a 'LocalSharedPtr' to the object. So a thread should construct it once and copy it.
+//
+//  A 'LocalSharedPtr' and its copies must not be used by more than one thread. To pass the object
+//  to another thread, convert it back explicitly to a 'SharedPtr' with 'get_shared()'.
+//
+
+template<class t_shared>
+class LocalSharedPtr
+{
+public:
+  using element_type = t_shared;
+
+  constexpr LocalSharedPtr() noexcept
+  : m_shared(nullptr)
+  , m_count(nullptr)
+  {}
+
+  constexpr LocalSharedPtr(std::nullptr_t) noexcept
+  : LocalSharedPtr()
+  {}
+
+  // Take the reference of the given 'SharedPtr' with a new counter. Release it, and construct an
+  // empty pointer, if the counter can't be allocated.
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other *, t_shared *>>>
+  explicit LocalSharedPtr(SharedPtr<t_other> p_shared) noexcept
+  : m_shared(p_shared.get())
+  , m_count(m_shared != nullptr ? new (std::nothrow) detail::LocalCountShared<t_other>(std::move(p_shared)) : nullptr)
+  {
+    if (m_count == nullptr)
+    {
+      m_shared = nullptr;
+    }
+  }
+
+  LocalSharedPtr(LocalSharedPtr const & p_other) noexcept
+  : m_shared(p_other.m_shared)
+  , m_count(p_other.m_count)
+  {
+    add_ref();
+  }
+
+  LocalSharedPtr(LocalSharedPtr && p_other) noexcept
+  : m_shared(p_other.m_shared)
+  , m_count(p_other.m_count)
+  {
+    p_other.m_shared = nullptr;
+    p_other.m_count = nullptr;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other *, t_shared *>>>
+  LocalSharedPtr(LocalSharedPtr<t_other> const & p_other) noexcept
+  : m_shared(p_other.m_shared)
+  , m_count(p_other.m_count)
+  {
+    add_ref();
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other *, t_shared *>>>
+  LocalSharedPtr(LocalSharedPtr<t_other> && p_other) noexcept
+  : m_shared(p_other.m_shared)
+  , m_count(p_other.m_count)
+  {
+    p_other.m_shared = nullptr;
+    p_other.m_count = nullptr;
+  }
+
+  ~LocalSharedPtr() noexcept
+  {
+    if (m_count != nullptr && --m_count->m_count == 0u)
+    {
+      m_count->m_destroy(m_count);
+    }
+  }
+
+  LocalSharedPtr &
+  operator=(LocalSharedPtr const & p_other) noexcept
+  {
+    LocalSharedPtr(p_other).swap(*this);
+    return *this;
+  }
+
+  LocalSharedPtr &
+  operator=(LocalSharedPtr && p_other) noexcept
+  {
+    LocalSharedPtr(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other *, t_shared *>>>
+  LocalSharedPtr &
+  operator=(LocalSharedPtr<t_other> const & p_other) noexcept
+  {
+    LocalSharedPtr(p_other).swap(*this);
+    return *this;
+  }
+
+  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other *, t_shared *>>>
+  LocalSharedPtr &
+  operator=(LocalSharedPtr<t_other> && p_other) noexcept
+  {
+    LocalSharedPtr(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  // Return a 'SharedPtr' which shares the ownership and can be passed to another thread.
+  SharedPtr<t_shared>
+  get_shared() const noexcept
+  {
+    return SharedPtr<t_shared>(m_shared, true);
+  }
+
+  explicit operator bool() const noexcept
+  {
+    return m_shared != nullptr;
+  }
+
+  t_shared *
+  get() const noexcept
+  {
+    return m_shared;
+  }
+
+  t_shared &
+  operator*() const noexcept
+  {
+    PNTR_ASSERT(m_shared != nullptr);
+    return *m_shared;
+  }
+
+  t_shared *
+  operator->() const noexcept
+  {
+    PNTR_ASSERT(m_shared != nullptr);
+    return m_shared;
+  }
+
+  // Return the number of 'LocalSharedPtr' objects sharing the counter.
+  std::size_t
+  local_use_count() const noexcept
+  {
+    return m_count != nullptr ? m_count->m_count : 0u;
+  }
+
+  typename t_shared::PntrUsageValueType
+  use_count() const noexcept
+  {
+    return m_shared != nullptr ? m_shared->pntr_use_count() : typename t_shared::PntrUsageValueType{};
+  }
+
+  void
+  reset() noexcept
+  {
+    LocalSharedPtr().swap(*this);
+  }
+
+  void
+  swap(LocalSharedPtr & p_other) noexcept
+  {
+    std::swap(m_shared, p_other.m_shared);
+    std::swap(m_count, p_other.m_count);
+  }
+
+private:
+  void
+  add_ref() const noexcept
+  {
+    if (m_count != nullptr)
+    {
+      ++m_count->m_count;
+    }
+  }
+
+  t_shared * m_shared;
+  detail::LocalCount * m_count;
+
+  template<class t_other>
+  friend class LocalSharedPtr;
+};
+
+
+// clang-format off
+
+template<class L, class R> inline bool operator==(LocalSharedPtr<L> const & l, LocalSharedPtr<R> const & r) noexcept { return l.get() == r.get(); }
+template<class L, class R> inline bool operator!=(LocalSharedPtr<L> const & l, LocalSharedPtr<R> const & r) noexcept { return l.get() != r.get(); }
+template<class L> inline bool operator==(LocalSharedPtr<L> const & l, std::nullptr_t) noexcept { return !l; }
+template<class R> inline bool operator==(std::nullptr_t, LocalSharedPtr<R> const & r) noexcept { return !r; }
+template<class L> inline bool operator!=(LocalSharedPtr<L> const & l, std::nullptr_t) noexcept { return static_cast<bool>(l); }
+template<class R> inline bool operator!=(std::nullptr_t, LocalSharedPtr<R> const & r) noexcept { return static_cast<bool>(r); }
+
+// clang-format on
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                      pntr/SharedQueue.hpp                                      //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                          SharedQueue                                           //
+//                                                                                                //
+//          A bounded lock-free queue for many producers and consumers of shared objects          //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  A ring buffer of raw pointers, which carry the references of the pushed 'SharedPtr' objects
+//  with 'SharedPtr::release_raw' and 'SharedPtr::adopt'. So passing an object through the queue
+//  doesn't touch its usage counter at all. Each slot has a sequence number which tells producers
+//  and consumers whether it is free or filled in the current round, so they only contend for the
+//  positions at the ends of the queue.
+//
+//  The capacity is rounded up to a power of two. Empty pointers are rejected, so an empty result
+//  of 'try_pop' always means that the queue is empty. The objects left in the queue are released
+//  when it is destroyed.
+//
+
+template<class t_shared>
+class SharedQueue
+{
+public:
+  // Throws 'std::bad_alloc' if the slots can't be allocated.
+  explicit SharedQueue(std::size_t const p_capacity)
+  : m_mask(ceil_capacity(p_capacity) - 1u)
+  , m_slots(new Slot[m_mask + 1u])
+  {
+    for (std::size_t i = 0u; i <= m_mask; ++i)
+    {
+      m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+
+  SharedQueue(SharedQueue const &) = delete;
+  SharedQueue & operator=(SharedQueue const &) = delete;
+
+  ~SharedQueue()
+  {
+    // No other thread accesses the queue anymore, so all slots between the ends are filled.
+    std::size_t const tail = m_tail.load(std::memory_order_acquire);
+    for (std::size_t position = m_head.load(std::memory_order_relaxed); position != tail; ++position)
+    {
+      SharedPtr<t_shared>::adopt(m_slots[position & m_mask].m_shared);
+    }
+  }
+
+  std::size_t
+  capacity() const noexcept
+  {
+    return m_mask + 1u;
+  }
+
+  // Move the object into the queue and return true, or return false and keep it if the queue is full
+  // or the pointer is empty.
+  bool
+  try_push(SharedPtr<t_shared> & p_shared) noexcept
+  {
+    if (p_shared == nullptr)
+    {
+      return false;
+    }
+    std::size_t position = m_tail.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      Slot & slot = m_slots[position & m_mask];
+      auto const difference =
+        static_cast<std::ptrdiff_t>(slot.m_sequence.load(std::memory_order_acquire) - position);
+      if (difference == 0)
+      {
+        if (m_tail.compare_exchange_weak(position, position + 1u, std::memory_order_relaxed))
+        {
+          slot.m_shared = p_shared.release_raw();
+          slot.m_sequence.store(position + 1u, std::memory_order_release);
+          return true;
+        }
+      }
+      else if (difference < 0)
+      {
+        return false;
+      }
+      else
+      {
+        position = m_tail.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+  bool
+  try_push(SharedPtr<t_shared> && p_shared) noexcept
+  {
+    return try_push(p_shared);
+  }
+
+  // Return the oldest object, or an empty pointer if the queue is empty.
+  SharedPtr<t_shared>
+  try_pop() noexcept
+  {
+    std::size_t position = m_head.load(std::memory_order_relaxed);
+    for (;;)
+    {
+      Slot & slot = m_slots[position & m_mask];
+      auto const difference =
+        static_cast<std::ptrdiff_t>(slot.m_sequence.load(std::memory_order_acquire) - (position + 1u));
+      if (difference == 0)
+      {
+        if (m_head.compare_exchange_weak(position, position + 1u, std::memory_order_relaxed))
+        {
+          t_shared * const shared = slot.m_shared;
+          slot.m_sequence.store(position + m_mask + 1u, std::memory_order_release);
+          return SharedPtr<t_shared>::adopt(shared);
+        }
+      }
+      else if (difference < 0)
+      {
+        return nullptr;
+      }
+      else
+      {
+        position = m_head.load(std::memory_order_relaxed);
+      }
+    }
+  }
+
+private:
+  struct Slot
+  {
+    std::atomic<std::size_t> m_sequence;
+    t_shared * m_shared;
+  };
+
+  static std::size_t
+  ceil_capacity(std::size_t const p_capacity) noexcept
+  {
+    std::size_t capacity = 2u;
+    while (capacity < p_capacity)
+    {
+      capacity <<= 1u;
+    }
+    return capacity;
+  }
+
+  std::size_t const m_mask;
+  std::unique_ptr<Slot[]> const m_slots;
+  alignas(64) std::atomic<std::size_t> m_tail{0u};
+  alignas(64) std::atomic<std::size_t> m_head{0u};
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        SharedQueueMpsc                                         //
+//                                                                                                //
+//       An unbounded lock-free queue for many producers and one consumer of shared objects       //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  A linked list of nodes which carry the references like 'SharedQueue'. Producers append a node
+//  with a single atomic exchange, and only the consumer follows the links, so 'try_pop' must not
+//  be called by more than one thread at a time. A node whose producer has exchanged the tail but
+//  not linked it yet hides the nodes behind it for a moment, in which 'try_pop' returns an empty
+//  pointer although the queue is not empty. Empty pointers are ignored by 'push'.
+//
+
+template<class t_shared>
+class SharedQueueMpsc
+{
+public:
+  // Throws 'std::bad_alloc' if the first node can't be allocated.
+  SharedQueueMpsc()
+  : m_head(new Node{{nullptr}, nullptr})
+  , m_tail(m_head)
+  {}
+
+  SharedQueueMpsc(SharedQueueMpsc const &) = delete;
+  SharedQueueMpsc & operator=(SharedQueueMpsc const &) = delete;
+
+  ~SharedQueueMpsc()
+  {
+    // No producer links a node anymore, so the list ends at the tail.
+    while (Node * const next = m_head->m_next.load(std::memory_order_acquire))
+    {
+      SharedPtr<t_shared>::adopt(next->m_shared);
+      delete m_head;
+      m_head = next;
+    }
+    delete m_head;
+  }
+
+  // Move the object into the queue, unless the pointer is empty. Throws 'std::bad_alloc' and keeps
+  // the object if the node can't be allocated.
+  void
+  push(SharedPtr<t_shared> & p_shared)
+  {
+    if (p_shared == nullptr)
+    {
+      return;
+    }
+    Node * const node = new Node{{nullptr}, nullptr};
+    node->m_shared = p_shared.release_raw();
+    Node * const previous = m_tail.exchange(node, std::memory_order_acq_rel);
+    previous->m_next.store(node, std::memory_order_release);
+  }
+
+  void
+  push(SharedPtr<t_shared> && p_shared)
+  {
+    push(p_shared);
+  }
+
+  // Return the oldest object, or an empty pointer if the queue is empty. Only for the consumer.
+  SharedPtr<t_shared>
+  try_pop() noexcept
+  {
+    Node * const head = m_head;
+    Node * const next = head->m_next.load(std::memory_order_acquire);
+    if (next == nullptr)
+    {
+      return nullptr;
+    }
+    // The next node becomes the empty head, so the producers never see a deleted node.
+    t_shared * const shared = next->m_shared;
+    next->m_shared = nullptr;
+    m_head = next;
+    delete head;
+    return SharedPtr<t_shared>::adopt(shared);
+  }
+
+private:
+  struct Node
+  {
+    std::atomic<Node *> m_next;
+    t_shared * m_shared;
+  };
+
+  Node * m_head;
+  alignas(64) std::atomic<Node *> m_tail;
+};
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                      pntr/SharedRange.hpp                                      //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <iterator>
+#include <type_traits>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  class SharedRange
+  {
+  public:
+    // The number of pointers whose objects are prefetched ahead of the current one.
+    static constexpr std::ptrdiff_t s_prefetch_distance = 8;
+
+    // The number of objects whose disposal is delayed until after the counter pass.
+    static constexpr std::size_t s_dispose_batch = 64u;
+
+    template<class t_iterator>
+    static void
+    release(t_iterator const p_first, t_iterator const p_last) noexcept
+    {
+      using Shared = typename std::iterator_traits<t_iterator>::value_type::element_type;
+      if constexpr (is_cycle_collected<Shared> || is_deferred<Shared>)
+      {
+        // These releases are buffered anyway.
+        for (t_iterator it = p_first; it != p_last; ++it)
+        {
+          it->reset();
+        }
+      }
+      else
+      {
+        Shared * disposals[s_dispose_batch];
+        std::size_t disposal_count = 0u;
+        t_iterator it = p_first;
+        while (it != p_last)
+        {
+          if (p_last - it > s_prefetch_distance)
+          {
+            PNTR_PREFETCH(it[s_prefetch_distance].m_shared);
+          }
+          Shared * const shared = it->m_shared;
+          auto const count = run_length<Shared>(it, p_last);
+          for (auto i = count; i != 0u; --i, ++it)
+          {
+            it->m_shared = nullptr;
+          }
+          // Only the single decrement of a whole run might reach zero.
+          if (shared != nullptr && SharedPtr<Shared>::release_counter(shared, count))
+          {
+            disposals[disposal_count++] = shared;
+            if (disposal_count == s_dispose_batch)
+            {
+              dispose(disposals, disposal_count);
+            }
+          }
+        }
+        dispose(disposals, disposal_count);
+      }
+    }
+
+    template<class t_input, class t_output>
+    static t_output
+    copy(t_input const p_first, t_input const p_last, t_output p_output)
+    {
+      using Shared = typename std::iterator_traits<t_input>::value_type::element_type;
+      if constexpr (is_cycle_collected<Shared> || is_deferred<Shared>)
+      {
+        for (t_input it = p_first; it != p_last; ++it, ++p_output)
+        {
+          if (p_last - it > s_prefetch_distance)
+          {
+            PNTR_PREFETCH(it[s_prefetch_distance].m_shared);
+          }
+          *p_output = *it;
+        }
+      }
+      else
+      {
+        t_input it = p_first;
+        while (it != p_last)
+        {
+          if (p_last - it > s_prefetch_distance)
+          {
+            PNTR_PREFETCH(it[s_prefetch_distance].m_shared);
+          }
+          Shared * const shared = it->m_shared;
+          RunReferences<Shared> run{shared, run_length<Shared>(it, p_last)};
+          if (shared != nullptr)
+          {
+            SharedPtr<Shared>::add_ref_counter(shared, run.m_count);
+          }
+          for (; run.m_count != 0u; ++it, ++p_output)
+          {
+            --run.m_count;
+            *p_output = SharedPtr<Shared>(shared, false);
+          }
+        }
+      }
+      return p_output;
+    }
+
+  private:
+    // The references of a run which are not adopted by the output yet. They are released if an
+    // assignment throws. As the input still holds its own references, this can't be the last release.
+    template<class t_shared>
+    struct RunReferences
+    {
+      ~RunReferences() noexcept
+      {
+        if (m_shared != nullptr && m_count != 0u)
+        {
+          [[maybe_unused]] bool const last = SharedPtr<t_shared>::release_counter(m_shared, m_count);
+          PNTR_ASSERT(!last);
+        }
+      }
+
+      t_shared * const m_shared;
+      typename t_shared::PntrUsageValueType m_count;
+    };
+
+    // Return the number of pointers equal to the first one, which is limited by the maximum usage count.
+    template<class t_shared, class t_iterator>
+    static typename t_shared::PntrUsageValueType
+    run_length(t_iterator p_it, t_iterator const p_last) noexcept
+    {
+      t_shared * const shared = p_it->m_shared;
+      typename t_shared::PntrUsageValueType count = 1u;
+      for (++p_it; p_it != p_last && p_it->m_shared == shared; ++p_it)
+      {
+        if (count == t_shared::pntr_get_max_usage_count())
+        {
+          break;
+        }
+        ++count;
+      }
+      return count;
+    }
+
+    template<class t_shared>
+    static void
+    dispose(t_shared * const * const p_disposals, std::size_t & p_count) noexcept
+    {
+      for (std::size_t i = 0u; i < p_count; ++i)
+      {
+        SharedPtr<t_shared>::dispose(p_disposals[i]);
+      }
+      p_count = 0u;
+    }
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                   release_range, copy_range                                    //
+//                                                                                                //
+//           Release and copy ranges of shared pointers with prefetched control blocks            //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Releasing or copying the pointers of a container one by one waits for each control block to
+//  be loaded into the cache. These algorithms prefetch the objects 's_prefetch_distance' pointers
+//  ahead, so the loads overlap. The ranges require random access iterators.
+//
+//  'release_range' empties all pointers of the range in a first pass, which only decrements the
+//  counters, and disposes the objects whose count reached zero in batches afterwards, so the
+//  destructors don't evict the control blocks that are prefetched next. A run of equal pointers
+//  is released with a single decrement of its counter. Objects with deferred or cycle collected
+//  counters are released as usual, as their releases are buffered anyway.
+//
+//  'copy_range' assigns the pointers of the input range to the output range, like 'std::copy'.
+//  The references of a run of equal pointers are added with a single increment. If an assignment
+//  throws, for example when a 'std::back_inserter' grows its container, the exception propagates
+//  and the output holds the pointers assigned before it.
+//
+
+template<class t_iterator>
+void
+release_range(t_iterator const p_first, t_iterator const p_last) noexcept
+{
+  detail::SharedRange::release(p_first, p_last);
+}
+
+
+template<class t_input, class t_output>
+t_output
+copy_range(t_input const p_first, t_input const p_last, t_output const p_output)
+{
+  return detail::SharedRange::copy(p_first, p_last, p_output);
+}
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                       pntr/Coroutine.hpp                                       //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__cpp_impl_coroutine)
+  #include <coroutine>
+  #include <cstddef>
+  #include <cstdint>
+  #include <new>
+  #include <type_traits>
+  #include <utility>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        DeleterCoroutine                                        //
+//                                                                                                //
+//               A deleter for 'ControlNew' which destroys the frame of a coroutine               //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The promise of a coroutine lives in its frame, whose layout is defined by the compiler. So the
+//  promise can't be deleted like other objects, but the frame has to be destroyed by its handle,
+//  which destroys the promise and the local variables, and deallocates the frame with the
+//  'operator delete' of the promise type.
+//
+
+template<class t_promise>
+struct DeleterCoroutine
+{
+  void
+  operator()(t_promise * p_promise) const noexcept
+  {
+    using Promise = std::remove_const_t<t_promise>;
+    std::coroutine_handle<Promise>::from_promise(const_cast<Promise &>(*p_promise)).destroy();
+  }
+};
+
+
+namespace detail
+{
+  // Like 'IntruderNewWeak', but the frame is destroyed by its coroutine handle.
+  template<class t_promise, class t_thread_safety>
+  using CoroutineControl =
+    ControlNew<t_promise,
+               std::conditional_t<t_thread_safety::value, ControlData<CounterThreadSafe, std::uint32_t, 31u>,
+                                  ControlData<CounterThreadUnsafe, std::uint32_t, 31u>>,
+               DeleterCoroutine<t_promise>, std::true_type>;
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        CoroutinePromise                                        //
+//                                                                                                //
+//                  A promise base whose coroutine frame is owned by 'SharedPtr'                  //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The promise type 't_promise' of a coroutine derives from 'CoroutinePromise<t_promise>', which
+//  embeds the control block in the promise and therefore in the coroutine frame. The result of
+//  'get_return_object' is a 'SharedPtr' to the promise, a handle of the size of a single pointer,
+//  from which the return type of the coroutine is constructed. When the last 'SharedPtr' releases
+//  the promise, the frame is destroyed with 'DeleterCoroutine'. 'WeakPtr' references a side block,
+//  like 'IntruderNewWeak', so a scheduler can hold weak references to suspended coroutines and
+//  skip the cancelled ones, whose 'lock' returns an empty pointer.
+//
+//  The frame is allocated with the allocator 't_allocator', which is default constructed for each
+//  allocation, for example 'AllocatorArena' to reuse the frames of a size class from the pool of
+//  an active 'ArenaPool::Scope'. All allocators for 'ControlAlloc' which deallocate by pointer or
+//  by size and alignment are supported. A failed allocation throws 'std::bad_alloc'.
+//
+//  'final_suspend' always suspends, so the frame is destroyed by the last owner, also after the
+//  coroutine has completed. 'handle' returns the coroutine handle to resume the coroutine. The
+//  derived promise has to provide 'initial_suspend', 'unhandled_exception', and 'return_void' or
+//  'return_value', like any other promise type. 'initial_suspend' has to return
+//  'std::suspend_always': if the coroutine started eagerly and 'unhandled_exception' rethrew, the
+//  compiler would destroy the frame, and then the returned 'SharedPtr' a second time. The last
+//  owner must not release the frame while the coroutine is running, as only suspended coroutines
+//  can be destroyed. The coroutines require C++20.
+//
+
+template<class t_promise, class t_allocator = AllocatorMalloc<NoStaticSupport>, class t_thread_safety = std::true_type>
+class CoroutinePromise: public Intruder<detail::CoroutineControl<t_promise, t_thread_safety>>
+{
+public:
+  static void *
+  operator new(std::size_t const p_size)
+  {
+    void * const frame = t_allocator().allocate(p_size, s_frame_alignment);
+    if (frame == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    return frame;
+  }
+
+  static void
+  operator delete(void * const p_frame, [[maybe_unused]] std::size_t const p_size) noexcept
+  {
+    t_allocator allocator;
+    if constexpr (detail::HasTypeInfoDeallocate<t_allocator>::value)
+    {
+      allocator.deallocate(p_frame, p_size, s_frame_alignment);
+    }
+    else
+    {
+#ifdef _WIN32
+      allocator.deallocate(p_frame, false);
+#else
+      allocator.deallocate(p_frame);
+#endif
+    }
+  }
+
+  SharedPtr<t_promise>
+  get_return_object() noexcept
+  {
+    static_assert(std::is_same_v<decltype(std::declval<t_promise &>().initial_suspend()), std::suspend_always>,
+                  "The coroutine has to suspend initially, so the frame is only destroyed by its last owner");
+    // Takes control of the promise, which is the shared base.
+    return this->shared_from_this();
+  }
+
+  std::suspend_always
+  final_suspend() const noexcept
+  {
+    return {};
+  }
+
+  std::coroutine_handle<t_promise>
+  handle() noexcept
+  {
+    return std::coroutine_handle<t_promise>::from_promise(static_cast<t_promise &>(*this));
+  }
+
+private:
+  // Frames are allocated with the alignment of the global 'operator new' without alignment.
+  static constexpr std::size_t s_frame_alignment = alignof(std::max_align_t);
+
+  static_assert(detail::HasPointerDeallocate<t_allocator>::value || detail::HasTypeInfoDeallocate<t_allocator>::value,
+                "The frame allocator has to deallocate by pointer or by size and alignment");
+};
+
+
+PNTR_NAMESPACE_END
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                    pntr/RetentionCache.hpp                                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  template<class t_shared, typename = void>
+  struct HasRetainedBytes: std::false_type
+  {};
+
+  template<class t_shared>
+  struct HasRetainedBytes<t_shared, std::void_t<decltype(std::declval<t_shared const &>().retained_bytes())>>
+  : std::true_type
+  {};
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         RetentionCache                                         //
+//                                                                                                //
+//            A cache which retains unreferenced objects in a memory-bounded LRU list             //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The cached type 't_shared' derives from 'RetentionCache::Entry', which embeds a control block
+//  like 'IntruderNew' with the deleter 'RetentionCache::Deleter'. When the last 'SharedPtr' to a
+//  cached object is released, the deleter doesn't delete it, but appends it to the list of
+//  unreferenced objects. A lookup which hits such an object removes it from the list and revives
+//  it with 'pntr_try_revive', so it doesn't have to be created again. Referenced objects are never
+//  evicted.
+//
+//  The unreferenced objects are limited by the capacity in bytes. Each object is charged with its
+//  'retained_bytes()' if it provides that member function, and with its size otherwise. Whenever an
+//  object is retained, the least recently used objects are evicted and deleted until the retained
+//  bytes fit the capacity again. 'trim' evicts down to any number of bytes, for example under
+//  memory pressure.
+//
+//  All functions are thread-safe and lock a single mutex, but objects are created and deleted
+//  without holding it, so their constructors and destructors may use the cache. A lookup which
+//  finds an object whose last reference is being released waits until the deleter has retained it.
+//  Objects which are still referenced when the cache is erased or destroyed are detached, and
+//  deleted by their last release. The cache must not be destroyed while other threads use it or
+//  release its objects.
+//
+
+template<class t_key, class t_shared, class t_hash = std::hash<t_key>, class t_equal = std::equal_to<t_key>>
+class RetentionCache
+{
+public:
+  // Retains the object in its cache, or deletes it if it was detached.
+  struct Deleter
+  {
+    void
+    operator()(t_shared const * const p_shared) const noexcept
+    {
+      RetentionCache::dispose(*const_cast<t_shared *>(p_shared));
+    }
+  };
+
+  class Entry: public Intruder<ControlNew<t_shared, ControlData<CounterThreadSafe, std::uint32_t, 32u>, Deleter>>
+  {
+  protected:
+    Entry() noexcept = default;
+
+    Entry(Entry const &) = delete;
+    Entry & operator=(Entry const &) = delete;
+
+  private:
+    std::atomic<RetentionCache *> m_cache = nullptr;
+    t_key const * m_key = nullptr;
+    std::size_t m_bytes = 0u;
+    Entry * m_older = nullptr;
+    Entry * m_newer = nullptr;
+    bool m_retained = false;
+
+    friend class RetentionCache;
+  };
+
+  explicit RetentionCache(std::size_t const p_capacity) noexcept
+  : m_capacity(p_capacity)
+  {}
+
+  RetentionCache(RetentionCache const &) = delete;
+  RetentionCache & operator=(RetentionCache const &) = delete;
+
+  ~RetentionCache() noexcept
+  {
+    Entry * evicted = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(m_mutex);
+      evicted = evict(0u);
+      for (auto const & [key, shared] : m_map)
+      {
+        static_cast<Entry &>(*shared).m_cache.store(nullptr, std::memory_order_release);
+      }
+      m_map.clear();
+    }
+    destroy(evicted);
+  }
+
+  // Return the object of the key, or an empty pointer if it isn't cached.
+  SharedPtr<t_shared>
+  find(t_key const & p_key)
+  {
+    for (;;)
+    {
+      {
+        std::lock_guard<std::mutex> const lock(m_mutex);
+        auto const found = m_map.find(p_key);
+        if (found == m_map.end())
+        {
+          return {};
+        }
+        if (SharedPtr<t_shared> shared = acquire(*found->second); shared != nullptr)
+        {
+          return shared;
+        }
+      }
+      // The last reference is being released, and the deleter is about to retain the object.
+      std::this_thread::yield();
+    }
+  }
+
+  // Return the object of the key, or create it with the arguments and insert it. The object is
+  // created without holding the lock, so a concurrent call may insert the same key first, and
+  // its object is returned instead. May throw allocation and constructor exceptions.
+  template<typename... t_args>
+  SharedPtr<t_shared>
+  find_or_create(t_key const & p_key, t_args &&... p_args)
+  {
+    if (SharedPtr<t_shared> found = find(p_key); found != nullptr)
+    {
+      return found;
+    }
+    SharedPtr<t_shared> created = make_shared<t_shared>(std::forward<t_args>(p_args)...);
+    for (;;)
+    {
+      SharedPtr<t_shared> existing;
+      {
+        std::lock_guard<std::mutex> const lock(m_mutex);
+        auto const [position, inserted] = m_map.try_emplace(p_key, created.get());
+        if (inserted)
+        {
+          Entry & entry = *created;
+          entry.m_key = &position->first;
+          entry.m_bytes = bytes_of(*created);
+          entry.m_cache.store(this, std::memory_order_release);
+          return created;
+        }
+        existing = acquire(*position->second);
+      }
+      // The created object is deleted without holding the lock.
+      if (existing != nullptr)
+      {
+        return existing;
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  // Remove the object of the key from the cache, and return true if it was cached. A retained
+  // object is deleted, and a referenced object is detached.
+  bool
+  erase(t_key const & p_key) noexcept
+  {
+    Entry * evicted = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(m_mutex);
+      auto const found = m_map.find(p_key);
+      if (found == m_map.end())
+      {
+        return false;
+      }
+      Entry & entry = *found->second;
+      if (entry.m_retained)
+      {
+        unlink(entry);
+        evicted = &entry;
+      }
+      entry.m_cache.store(nullptr, std::memory_order_release);
+      m_map.erase(found);
+    }
+    destroy(evicted);
+    return true;
+  }
+
+  // Evict the least recently used objects until the retained bytes don't exceed the given number.
+  void
+  trim(std::size_t const p_bytes) noexcept
+  {
+    Entry * evicted = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(m_mutex);
+      evicted = evict(p_bytes);
+    }
+    destroy(evicted);
+  }
+
+  // Set the capacity in bytes of the retained objects, and evict the objects which exceed it.
+  void
+  set_capacity(std::size_t const p_capacity) noexcept
+  {
+    Entry * evicted = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(m_mutex);
+      m_capacity = p_capacity;
+      evicted = evict(p_capacity);
+    }
+    destroy(evicted);
+  }
+
+  std::size_t
+  capacity() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    return m_capacity;
+  }
+
+  // Return the number of cached objects, referenced or not.
+  std::size_t
+  size() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    return m_map.size();
+  }
+
+  // Return the number of unreferenced objects.
+  std::size_t
+  retained_count() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    return m_retained_count;
+  }
+
+  // Return the charged bytes of the unreferenced objects.
+  std::size_t
+  retained_bytes() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    return m_retained_bytes;
+  }
+
+private:
+  static std::size_t
+  bytes_of(t_shared const & p_shared) noexcept
+  {
+    if constexpr (detail::HasRetainedBytes<t_shared>::value)
+    {
+      return p_shared.retained_bytes();
+    }
+    else
+    {
+      return sizeof(t_shared);
+    }
+  }
+
+  // Called by the deleter when the last reference is released.
+  static void
+  dispose(t_shared & p_shared) noexcept
+  {
+    RetentionCache * const cache = static_cast<Entry &>(p_shared).m_cache.load(std::memory_order_acquire);
+    if (cache == nullptr || !cache->retain(p_shared))
+    {
+      delete &p_shared;
+    }
+  }
+
+  // Append the object to the unreferenced objects, and evict the objects which exceed the
+  // capacity. Return false if the object has been detached in the meantime.
+  bool
+  retain(Entry & p_entry) noexcept
+  {
+    Entry * evicted = nullptr;
+    {
+      std::lock_guard<std::mutex> const lock(m_mutex);
+      if (p_entry.m_cache.load(std::memory_order_relaxed) == nullptr)
+      {
+        return false;
+      }
+      // Lookups don't revive objects before they are retained, so each release is retained once.
+      PNTR_ASSERT(!p_entry.m_retained);
+      p_entry.m_retained = true;
+      p_entry.m_older = m_newest;
+      p_entry.m_newer = nullptr;
+      (m_newest != nullptr ? m_newest->m_newer : m_oldest) = &p_entry;
+      m_newest = &p_entry;
+      m_retained_bytes += p_entry.m_bytes;
+      ++m_retained_count;
+      evicted = evict(m_capacity);
+    }
+    destroy(evicted);
+    return true;
+  }
+
+  // Return a new reference to the cached object. A retained object is removed from the list and
+  // revived. Return an empty pointer if the last reference is being released.
+  SharedPtr<t_shared>
+  acquire(t_shared & p_shared) noexcept
+  {
+    Entry & entry = p_shared;
+    if (entry.m_retained)
+    {
+      unlink(entry);
+      [[maybe_unused]] bool const revived = p_shared.pntr_try_revive();
+      PNTR_ASSERT(revived);
+    }
+    return SharedPtr<t_shared>(&p_shared);
+  }
+
+  void
+  unlink(Entry & p_entry) noexcept
+  {
+    (p_entry.m_older != nullptr ? p_entry.m_older->m_newer : m_oldest) = p_entry.m_newer;
+    (p_entry.m_newer != nullptr ? p_entry.m_newer->m_older : m_newest) = p_entry.m_older;
+    p_entry.m_retained = false;
+    m_retained_bytes -= p_entry.m_bytes;
+    --m_retained_count;
+  }
+
+  // Remove the least recently used objects from the cache until the retained bytes don't exceed
+  // the given number, and return them as a list linked by 'm_newer' to be destroyed without lock.
+  Entry *
+  evict(std::size_t const p_bytes) noexcept
+  {
+    Entry * evicted = nullptr;
+    while (m_retained_bytes > p_bytes)
+    {
+      Entry & entry = *m_oldest;
+      unlink(entry);
+      entry.m_cache.store(nullptr, std::memory_order_relaxed);
+      m_map.erase(m_map.find(*entry.m_key));
+      entry.m_newer = evicted;
+      evicted = &entry;
+    }
+    return evicted;
+  }
+
+  // The destructors may release other objects of the cache.
+  static void
+  destroy(Entry * p_evicted) noexcept
+  {
+    while (p_evicted != nullptr)
+    {
+      Entry * const next = p_evicted->m_newer;
+      delete static_cast<t_shared *>(p_evicted);
+      p_evicted = next;
+    }
+  }
+
+  mutable std::mutex m_mutex;
+  std::unordered_map<t_key, t_shared *, t_hash, t_equal> m_map;
+  Entry * m_oldest = nullptr;
+  Entry * m_newest = nullptr;
+  std::size_t m_capacity;
+  std::size_t m_retained_bytes = 0u;
+  std::size_t m_retained_count = 0u;
+};
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                 pntr/AllocatorSharedMemory.hpp                                 //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__linux__)
+
+  #include <algorithm>
+  #include <atomic>
+  #include <cerrno>
+  #include <cstddef>
+  #include <cstdint>
+  #include <limits>
+  #include <mutex>
+  #include <new>
+  #include <system_error>
+  #include <utility>
+
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The layout of a shared memory segment. The first chunk holds the header, all others are
+  // dedicated to one size class each. Offsets are stored in units of the minimum block size.
+  struct SharedMemoryLayout
+  {
+    static constexpr std::uint64_t s_magic = 0x706E74722D73686Du; // "pntr-shm"
+    // Version 2 limits the size classes to 8 KiB.
+    static constexpr std::uint32_t s_version = 2u;
+    static constexpr unsigned s_chunk_bits = 16u;
+    static constexpr std::size_t s_chunk_size = std::size_t{1u} << s_chunk_bits;
+    static constexpr std::size_t s_chunk_header = 64u;
+    static constexpr unsigned s_unit_bits = 4u;
+    static constexpr std::size_t s_min_block = std::size_t{1u} << s_unit_bits;
+    // The largest class is an eighth of a chunk, so the chunk header wastes at most one block.
+    static constexpr unsigned s_class_count = s_chunk_bits - 2u - s_unit_bits;
+    static constexpr std::size_t s_max_block = s_min_block << (s_class_count - 1u);
+    static constexpr std::size_t s_max_alignment = s_chunk_header;
+
+    // 'OffsetSharedPtr' is a single 'OffsetPtr', regardless of the type.
+    static constexpr std::size_t s_root_size = sizeof(std::ptrdiff_t);
+
+    static_assert(std::atomic<std::uint64_t>::is_always_lock_free);
+    static_assert(std::atomic<std::uint32_t>::is_always_lock_free);
+    static_assert((s_chunk_size - s_chunk_header) / s_max_block >= 4u);
+  };
+
+  struct SharedMemoryHeader
+  {
+    std::uint64_t m_magic;
+    std::uint32_t m_version;
+    std::uint32_t m_chunk_bits;
+    std::uint64_t m_size;
+    std::atomic<std::uint64_t> m_next_chunk;
+    // Tagged freelist heads: the upper 32 bits count the modifications to prevent ABA problems,
+    // the lower 32 bits are the offset of the first free block in units.
+    std::atomic<std::uint64_t> m_free[SharedMemoryLayout::s_class_count];
+    alignas(std::max_align_t) std::byte m_root[SharedMemoryLayout::s_root_size];
+  };
+
+  struct SharedMemoryChunk
+  {
+    std::uint32_t m_class;
+  };
+
+  static_assert(sizeof(SharedMemoryHeader) <= SharedMemoryLayout::s_chunk_size);
+  static_assert(sizeof(SharedMemoryChunk) <= SharedMemoryLayout::s_chunk_header);
+
+
+  // The segments mapped by the current process, to find the segment of a deallocated pointer.
+  class SharedMemoryRegistry
+  {
+  public:
+    static constexpr std::size_t s_capacity = 64u;
+
+    static bool
+    add(std::byte * const p_base, std::size_t const p_size) noexcept
+    {
+      std::lock_guard<std::mutex> const lock(instance().m_mutex);
+      for (Entry & entry: instance().m_entries)
+      {
+        if (entry.m_base.load(std::memory_order_relaxed) == nullptr)
+        {
+          entry.m_size.store(p_size, std::memory_order_relaxed);
+          entry.m_base.store(p_base, std::memory_order_release);
+          return true;
+        }
+      }
+      return false;
+    }
+
+    static void
+    remove(std::byte * const p_base) noexcept
+    {
+      std::lock_guard<std::mutex> const lock(instance().m_mutex);
+      for (Entry & entry: instance().m_entries)
+      {
+        if (entry.m_base.load(std::memory_order_relaxed) == p_base)
+        {
+          entry.m_base.store(nullptr, std::memory_order_release);
+        }
+      }
+    }
+
+    // Return the base address of the segment that contains the given pointer, or nullptr.
+    static std::byte *
+    find(void const * const p_pointer) noexcept
+    {
+      auto const address = reinterpret_cast<std::uintptr_t>(p_pointer);
+      for (Entry const & entry: instance().m_entries)
+      {
+        std::byte * const base = entry.m_base.load(std::memory_order_acquire);
+        if (base != nullptr && address >= reinterpret_cast<std::uintptr_t>(base)
+            && address - reinterpret_cast<std::uintptr_t>(base) < entry.m_size.load(std::memory_order_relaxed))
+        {
+          return base;
+        }
+      }
+      return nullptr;
+    }
+
+  private:
+    struct Entry
+    {
+      std::atomic<std::byte *> m_base{nullptr};
+      std::atomic<std::size_t> m_size{0u};
+    };
+
+    static SharedMemoryRegistry &
+    instance() noexcept
+    {
+      static SharedMemoryRegistry s_instance;
+      return s_instance;
+    }
+
+    std::mutex m_mutex;
+    Entry m_entries[s_capacity];
+  };
+
+
+  // Allocate and deallocate blocks in a mapped segment. All shared state is modified with single
+  // compare-and-swap operations, so a process which crashes at any point can't block others. At
+  // worst it leaks the blocks it was allocating.
+  class SharedMemoryHeap
+  {
+    using Layout = SharedMemoryLayout;
+
+  public:
+    // Return the size class for the given size and alignment, or 's_class_count' if unsupported.
+    static unsigned
+    size_class(std::size_t const p_size, std::size_t const p_alignment) noexcept
+    {
+      if (p_alignment > Layout::s_max_alignment)
+      {
+        return Layout::s_class_count;
+      }
+      std::size_t const size = std::max({p_size, p_alignment, Layout::s_min_block});
+      unsigned const bits = detail::bit_width(size - 1u);
+      return (bits - Layout::s_unit_bits < Layout::s_class_count ? bits - Layout::s_unit_bits : Layout::s_class_count);
+    }
+
+    static void *
+    allocate(std::byte * const p_base, std::size_t const p_size, std::size_t const p_alignment) noexcept
+    {
+      unsigned const size_class = SharedMemoryHeap::size_class(p_size, p_alignment);
+      if (size_class >= Layout::s_class_count)
+      {
+        return nullptr;
+      }
+      SharedMemoryHeader & header = *std::launder(reinterpret_cast<SharedMemoryHeader *>(p_base));
+      std::uint32_t unit = pop(p_base, header.m_free[size_class]);
+      if (unit == 0u)
+      {
+        unit = carve(p_base, header, size_class);
+      }
+      return (unit == 0u ? nullptr : p_base + (std::size_t{unit} << Layout::s_unit_bits));
+    }
+
+    static void
+    deallocate(std::byte * const p_base, void * const p_pointer) noexcept
+    {
+      std::size_t const offset = static_cast<std::size_t>(static_cast<std::byte *>(p_pointer) - p_base);
+      auto const & chunk =
+        *std::launder(reinterpret_cast<SharedMemoryChunk const *>(p_base + (offset & ~(Layout::s_chunk_size - 1u))));
+      SharedMemoryHeader & header = *std::launder(reinterpret_cast<SharedMemoryHeader *>(p_base));
+      auto const unit = static_cast<std::uint32_t>(offset >> Layout::s_unit_bits);
+      push(p_base, header.m_free[chunk.m_class], unit, unit);
+    }
+
+  private:
+    static std::atomic<std::uint32_t> &
+    link(std::byte * const p_base, std::uint32_t const p_unit) noexcept
+    {
+      std::byte * const address = p_base + (std::size_t{p_unit} << Layout::s_unit_bits);
+      return *std::launder(reinterpret_cast<std::atomic<std::uint32_t> *>(address));
+    }
+
+    static std::uint64_t
+    tagged(std::uint64_t const p_head, std::uint32_t const p_unit) noexcept
+    {
+      return (((p_head >> 32u) + 1u) << 32u) | p_unit;
+    }
+
+    static std::uint32_t
+    pop(std::byte * const p_base, std::atomic<std::uint64_t> & p_head) noexcept
+    {
+      std::uint64_t head = p_head.load(std::memory_order_acquire);
+      while (static_cast<std::uint32_t>(head) != 0u)
+      {
+        // The link might be overwritten concurrently, but then the tag of the head has changed.
+        std::uint32_t const next = link(p_base, static_cast<std::uint32_t>(head)).load(std::memory_order_relaxed);
+        if (p_head.compare_exchange_weak(head, tagged(head, next), std::memory_order_acquire,
+                                         std::memory_order_acquire))
+        {
+          return static_cast<std::uint32_t>(head);
+        }
+      }
+      return 0u;
+    }
+
+    // Push a chain of linked blocks.
+    static void
+    push(std::byte * const p_base, std::atomic<std::uint64_t> & p_head, std::uint32_t const p_first,
+         std::uint32_t const p_last) noexcept
+    {
+      std::uint64_t head = p_head.load(std::memory_order_relaxed);
+      do
+      {
+        link(p_base, p_last).store(static_cast<std::uint32_t>(head), std::memory_order_relaxed);
+      }
+      while (!p_head.compare_exchange_weak(head, tagged(head, p_first), std::memory_order_release,
+                                           std::memory_order_relaxed));
+    }
+
+    // Dedicate a new chunk to the size class, push all but its first block onto the freelist,
+    // and return the first one.
+    static std::uint32_t
+    carve(std::byte * const p_base, SharedMemoryHeader & p_header, unsigned const p_class) noexcept
+    {
+      std::uint64_t const offset = p_header.m_next_chunk.fetch_add(Layout::s_chunk_size, std::memory_order_relaxed);
+      if (offset + Layout::s_chunk_size > p_header.m_size)
+      {
+        return 0u;
+      }
+      new (p_base + offset) SharedMemoryChunk{p_class};
+      std::size_t const block_units = std::size_t{1u} << p_class;
+      auto const first = static_cast<std::uint32_t>((offset + Layout::s_chunk_header) >> Layout::s_unit_bits);
+      auto const end = static_cast<std::uint32_t>((offset + Layout::s_chunk_size) >> Layout::s_unit_bits);
+      std::uint32_t last = first;
+      for (std::uint32_t unit = first + block_units; unit + block_units <= end; unit += block_units)
+      {
+        new (p_base + (std::size_t{last} << Layout::s_unit_bits)) std::atomic<std::uint32_t>(unit);
+        last = unit;
+      }
+      if (last != first)
+      {
+        std::uint32_t const second = first + static_cast<std::uint32_t>(block_units);
+        new (p_base + (std::size_t{last} << Layout::s_unit_bits)) std::atomic<std::uint32_t>(0u);
+        push(p_base, p_header.m_free[p_class], second, last);
+      }
+      return first;
+    }
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                      SharedMemorySegment                                       //
+//                                                                                                //
+//                  A memory segment which can be mapped by several processes                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  A segment is either an anonymous file created with 'memfd_create', whose file descriptor can be
+//  inherited or passed to other processes, or a named POSIX shared memory object created with
+//  'shm_open'. Each process maps the segment at an arbitrary address, so objects in the segment
+//  have to use 'OffsetPtr' and 'OffsetSharedPtr' instead of raw pointers. Objects with virtual
+//  functions are only supported if all processes are forked from the same parent.
+//
+//  The segment is divided into chunks of 64 KiB, each dedicated to one power of two size class
+//  from 16 bytes to 8 KiB, so at least seven blocks fit next to the chunk header. The freelists of
+//  the size classes are lock-free stacks in the segment header, so a crashed process can't leave
+//  them locked.
+//
+//  The root slot is an 'OffsetSharedPtr' in the segment header, which can be used to publish
+//  objects to other processes. Accessing it concurrently requires external synchronization.
+//
+//  Functions which call the operating system throw 'std::system_error' on failure.
+//
+
+class SharedMemorySegment
+{
+  using Layout = detail::SharedMemoryLayout;
+
+public:
+  // Create an anonymous segment using 'memfd_create'.
+  static SharedMemorySegment
+  create(std::size_t const p_size)
+  {
+    return SharedMemorySegment(check(::memfd_create("pntr", MFD_CLOEXEC), "memfd_create"), p_size);
+  }
+
+  // Create a named segment using 'shm_open'. The name has to start with a slash.
+  static SharedMemorySegment
+  create(char const * const p_name, std::size_t const p_size)
+  {
+    return SharedMemorySegment(check(::shm_open(p_name, O_RDWR | O_CREAT | O_EXCL, 0600), "shm_open"), p_size);
+  }
+
+  // Map an existing segment from a file descriptor, which is duplicated.
+  static SharedMemorySegment
+  open(int const p_file_descriptor)
+  {
+    return SharedMemorySegment(check(::dup(p_file_descriptor), "dup"), 0u);
+  }
+
+  // Map an existing named segment.
+  static SharedMemorySegment
+  open(char const * const p_name)
+  {
+    return SharedMemorySegment(check(::shm_open(p_name, O_RDWR, 0), "shm_open"), 0u);
+  }
+
+  // Remove the name of a named segment. It will be released after it has been unmapped everywhere.
+  static void
+  unlink(char const * const p_name)
+  {
+    check(::shm_unlink(p_name), "shm_unlink");
+  }
+
+  SharedMemorySegment(SharedMemorySegment && p_other) noexcept
+  : m_base(std::exchange(p_other.m_base, nullptr))
+  , m_size(std::exchange(p_other.m_size, 0u))
+  , m_file_descriptor(std::exchange(p_other.m_file_descriptor, -1))
+  {}
+
+  // The objects in the segment must not be accessed by this process after it has been unmapped.
+  ~SharedMemorySegment() noexcept
+  {
+    if (m_base != nullptr)
+    {
+      if (Scope::current() == this)
+      {
+        Scope::current() = nullptr;
+      }
+      detail::SharedMemoryRegistry::remove(m_base);
+      ::munmap(m_base, m_size);
+    }
+    if (m_file_descriptor >= 0)
+    {
+      ::close(m_file_descriptor);
+    }
+  }
+
+  SharedMemorySegment(SharedMemorySegment const &) = delete;
+  SharedMemorySegment & operator=(SharedMemorySegment const &) = delete;
+  SharedMemorySegment & operator=(SharedMemorySegment &&) = delete;
+
+  int
+  file_descriptor() const noexcept
+  {
+    return m_file_descriptor;
+  }
+
+  void *
+  base() const noexcept
+  {
+    return m_base;
+  }
+
+  std::size_t
+  size() const noexcept
+  {
+    return m_size;
+  }
+
+  // Return the number of bytes of all chunks in use, including the header.
+  std::size_t
+  used_size() const noexcept
+  {
+    auto const used = static_cast<std::size_t>(header().m_next_chunk.load(std::memory_order_relaxed));
+    return (used < m_size ? used : m_size);
+  }
+
+  bool
+  contains(void const * const p_pointer) const noexcept
+  {
+    auto const address = reinterpret_cast<std::uintptr_t>(p_pointer);
+    auto const base = reinterpret_cast<std::uintptr_t>(m_base);
+    return (address >= base && address - base < m_size);
+  }
+
+  // Allocate a block, or return nullptr if the segment is full or the request is too big.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    return detail::SharedMemoryHeap::allocate(m_base, p_size, p_alignment);
+  }
+
+  // Make the segment current for the allocations of 'AllocatorSharedMemory' in the lifetime of the
+  // scope.
+  using Scope = detail::CurrentScope<SharedMemorySegment>;
+
+  // Create a shared object in this segment. The type has to use 'AllocatorSharedMemory'.
+  template<class t_shared, typename... t_args>
+  SharedPtr<t_shared>
+  make_shared(t_args &&... p_args)
+  {
+    Scope const scope(*this);
+    return pntr::make_shared<t_shared>(std::forward<t_args>(p_args)...);
+  }
+
+  // Return the root slot of the segment.
+  template<class t_shared>
+  OffsetSharedPtr<t_shared> &
+  root() noexcept
+  {
+    static_assert(sizeof(OffsetSharedPtr<t_shared>) == Layout::s_root_size);
+    return *std::launder(reinterpret_cast<OffsetSharedPtr<t_shared> *>(&header().m_root));
+  }
+
+private:
+  SharedMemorySegment(int const p_file_descriptor, std::size_t const p_size)
+  : m_file_descriptor(p_file_descriptor)
+  {
+    bool const create = (p_size != 0u);
+    if (create)
+    {
+      m_size = (p_size + Layout::s_chunk_size - 1u) & ~(Layout::s_chunk_size - 1u);
+      if (m_size > (std::size_t{std::numeric_limits<std::uint32_t>::max()} << Layout::s_unit_bits))
+      {
+        ::close(m_file_descriptor);
+        throw std::system_error(std::make_error_code(std::errc::invalid_argument), "segment too big");
+      }
+      verify(::ftruncate(m_file_descriptor, static_cast<off_t>(m_size)), "ftruncate");
+    }
+    else
+    {
+      struct stat status{};
+      verify(::fstat(m_file_descriptor, &status), "fstat");
+      m_size = static_cast<std::size_t>(status.st_size);
+    }
+    void * const base = ::mmap(nullptr, m_size, PROT_READ | PROT_WRITE, MAP_SHARED, m_file_descriptor, 0);
+    if (base == MAP_FAILED)
+    {
+      fail("mmap");
+    }
+    m_base = static_cast<std::byte *>(base);
+    if (create)
+    {
+      auto * const header = new (m_base) detail::SharedMemoryHeader{};
+      header->m_magic = Layout::s_magic;
+      header->m_version = Layout::s_version;
+      header->m_chunk_bits = Layout::s_chunk_bits;
+      header->m_size = m_size;
+      header->m_next_chunk.store(Layout::s_chunk_size, std::memory_order_relaxed);
+      std::atomic_thread_fence(std::memory_order_release);
+    }
+    else if (m_size < Layout::s_chunk_size || header().m_magic != Layout::s_magic
+             || header().m_version != Layout::s_version || header().m_chunk_bits != Layout::s_chunk_bits
+             || header().m_size != m_size)
+    {
+      ::munmap(m_base, m_size);
+      m_base = nullptr;
+      ::close(std::exchange(m_file_descriptor, -1));
+      throw std::system_error(std::make_error_code(std::errc::invalid_argument), "invalid shared memory segment");
+    }
+    if (!detail::SharedMemoryRegistry::add(m_base, m_size))
+    {
+      ::munmap(m_base, m_size);
+      m_base = nullptr;
+      ::close(std::exchange(m_file_descriptor, -1));
+      throw std::system_error(std::make_error_code(std::errc::too_many_files_open), "too many mapped segments");
+    }
+  }
+
+  detail::SharedMemoryHeader &
+  header() const noexcept
+  {
+    return *std::launder(reinterpret_cast<detail::SharedMemoryHeader *>(m_base));
+  }
+
+  [[noreturn]] void
+  fail(char const * const p_what)
+  {
+    int const error = errno;
+    ::close(std::exchange(m_file_descriptor, -1));
+    throw std::system_error(error, std::generic_category(), p_what);
+  }
+
+  void
+  verify(int const p_result, char const * const p_what)
+  {
+    if (p_result < 0)
+    {
+      fail(p_what);
+    }
+  }
+
+  static int
+  check(int const p_result, char const * const p_what)
+  {
+    if (p_result < 0)
+    {
+      throw std::system_error(errno, std::generic_category(), p_what);
+    }
+    return p_result;
+  }
+
+  std::byte * m_base{};
+  std::size_t m_size{};
+  int m_file_descriptor{-1};
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                     AllocatorSharedMemory                                      //
+//                                                                                                //
+//               An allocator for 'ControlAlloc' which uses a 'SharedMemorySegment'               //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'AllocatorSharedMemory' is an empty class, so the control block doesn't store any process
+//  specific addresses. It allocates from the segment which calls 'SharedMemorySegment::make_shared'
+//  and deallocates into the segment that contains the pointer. So the last process which releases
+//  an object returns its memory to the segment.
+//
+//  The control data must use a 'CounterThreadSafe' counter, because the usage counter is modified
+//  concurrently by all processes. It doesn't need any offset bits if the shared base is at the
+//  front of the created class, see 'AllocatorMalloc'.
+//
+
+class AllocatorSharedMemory
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //      The type definitions and member functions required by 'ControlAlloc' start here       //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // Static support would store a process specific function pointer.
+  using SupportsStatic = NoStaticSupport;
+
+  // 'ControlAlloc' identifies the type of this allocator with this type definition.
+  using PointerDeallocate = void;
+
+  // Allocate a memory block in the current segment.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    SharedMemorySegment * const segment = SharedMemorySegment::Scope::current();
+    PNTR_TRY_LOG_ERROR(segment == nullptr, "No current shared memory segment");
+    return (segment != nullptr ? segment->allocate(p_size, p_alignment) : nullptr);
+  }
+
+  // Deallocate a memory block into the segment that contains it.
+  void
+  deallocate(void * const p_pointer) noexcept
+  {
+    std::byte * const base = detail::SharedMemoryRegistry::find(p_pointer);
+    PNTR_TRY_LOG_ERROR(base == nullptr, "Pointer is not in a mapped shared memory segment");
+    if (base != nullptr)
+    {
+      detail::SharedMemoryHeap::deallocate(base, p_pointer);
+    }
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //       The type definitions and member functions required by 'ControlAlloc' end here        //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+};
+
+
+PNTR_NAMESPACE_END
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                    pntr/AllocatorArena.hpp                                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__linux__)
+
+  #include <algorithm>
+  #include <cerrno>
+  #include <cstddef>
+  #include <cstdint>
+  #include <iterator>
+  #include <mutex>
+  #include <new>
+  #include <system_error>
+  #include <utility>
+
+  #include <sys/mman.h>
+
+PNTR_NAMESPACE_BEGIN
+
+
+class ArenaPool;
+
+namespace detail
+{
+  // The layout of an arena. The first chunk holds the header, all others are dedicated to one size
+  // class each. Arenas are aligned to their size, so the header of a block's arena can be found
+  // by masking its address.
+  struct ArenaLayout
+  {
+    // 32 MiB, a multiple of the 2 MiB huge page size.
+    static constexpr unsigned s_arena_bits = 25u;
+    static constexpr std::size_t s_arena_size = std::size_t{1u} << s_arena_bits;
+    static constexpr unsigned s_chunk_bits = 16u;
+    static constexpr std::size_t s_chunk_size = std::size_t{1u} << s_chunk_bits;
+    static constexpr std::size_t s_chunk_count = s_arena_size >> s_chunk_bits;
+    static constexpr std::size_t s_chunk_header = 64u;
+    static constexpr unsigned s_unit_bits = 4u;
+    static constexpr std::size_t s_min_block = std::size_t{1u} << s_unit_bits;
+    // The largest class is an eighth of a chunk, so the chunk header wastes at most one block.
+    static constexpr unsigned s_class_count = s_chunk_bits - 2u - s_unit_bits;
+    static constexpr std::size_t s_max_block = s_min_block << (s_class_count - 1u);
+    static constexpr std::size_t s_max_alignment = s_chunk_header;
+    static constexpr std::size_t s_page_size = 4096u;
+    // The number of caches, which are selected by the thread, and their blocks per size class.
+    static constexpr std::size_t s_cache_count = 16u;
+    static constexpr unsigned s_cache_blocks = 16u;
+    static constexpr unsigned s_cache_refill = 8u;
+
+    static_assert((s_chunk_size - s_chunk_header) / s_max_block >= 4u);
+  };
+
+  struct ArenaBlock
+  {
+    ArenaBlock * m_next;
+  };
+
+  struct ArenaChunk
+  {
+    unsigned m_class;
+  };
+
+  // The state of an arena, which is only accessed while the mutex of its pool is locked.
+  struct ArenaHeader
+  {
+    ArenaPool * m_pool;
+    ArenaHeader * m_next;
+    std::size_t m_live;
+    std::size_t m_next_chunk;
+    bool m_resident;
+    ArenaBlock * m_free[ArenaLayout::s_class_count];
+    std::byte * m_bump[ArenaLayout::s_class_count];
+    std::byte * m_bump_end[ArenaLayout::s_class_count];
+  };
+
+  // Free blocks which are allocated and deallocated without locking the pool. Each thread uses one
+  // of the caches of a pool, so threads rarely contend for the same mutex.
+  struct alignas(64) ArenaCache
+  {
+    std::mutex m_mutex;
+    ArenaBlock * m_free[ArenaLayout::s_class_count] = {};
+    unsigned m_count[ArenaLayout::s_class_count] = {};
+  };
+
+  static_assert(sizeof(ArenaHeader) <= ArenaLayout::s_chunk_size);
+  static_assert(sizeof(ArenaChunk) <= ArenaLayout::s_chunk_header);
+
+
+  // Allocate and deallocate blocks in an arena, like 'SharedMemoryHeap', but without atomics.
+  // Chunks are carved lazily, so the pages of an arena are only touched when they are used.
+  class ArenaHeap
+  {
+    using Layout = ArenaLayout;
+
+  public:
+    // Return the size class for the given size and alignment, or 's_class_count' if unsupported.
+    static unsigned
+    size_class(std::size_t const p_size, std::size_t const p_alignment) noexcept
+    {
+      if (p_alignment > Layout::s_max_alignment)
+      {
+        return Layout::s_class_count;
+      }
+      std::size_t const size = std::max({p_size, p_alignment, Layout::s_min_block});
+      unsigned const bits = detail::bit_width(size - 1u);
+      return (bits - Layout::s_unit_bits < Layout::s_class_count ? bits - Layout::s_unit_bits : Layout::s_class_count);
+    }
+
+    static ArenaHeader &
+    arena_of(void const * const p_pointer) noexcept
+    {
+      auto const address = reinterpret_cast<std::uintptr_t>(p_pointer) & ~(Layout::s_arena_size - 1u);
+      return *std::launder(reinterpret_cast<ArenaHeader *>(address));
+    }
+
+    static void
+    reset(ArenaHeader & p_arena) noexcept
+    {
+      p_arena.m_next_chunk = 1u;
+      std::fill(std::begin(p_arena.m_free), std::end(p_arena.m_free), nullptr);
+      std::fill(std::begin(p_arena.m_bump), std::end(p_arena.m_bump), nullptr);
+      std::fill(std::begin(p_arena.m_bump_end), std::end(p_arena.m_bump_end), nullptr);
+    }
+
+    static bool
+    can_allocate(ArenaHeader const & p_arena, unsigned const p_class) noexcept
+    {
+      return (p_arena.m_free[p_class] != nullptr || p_arena.m_bump[p_class] != p_arena.m_bump_end[p_class]
+              || p_arena.m_next_chunk < Layout::s_chunk_count);
+    }
+
+    static void *
+    allocate(ArenaHeader & p_arena, unsigned const p_class) noexcept
+    {
+      std::size_t const block_size = Layout::s_min_block << p_class;
+      void * block = nullptr;
+      if (ArenaBlock * const free = p_arena.m_free[p_class]; free != nullptr)
+      {
+        p_arena.m_free[p_class] = free->m_next;
+        block = free;
+      }
+      else
+      {
+        if (p_arena.m_bump[p_class] == p_arena.m_bump_end[p_class])
+        {
+          if (p_arena.m_next_chunk == Layout::s_chunk_count)
+          {
+            return nullptr;
+          }
+          std::byte * const chunk =
+            reinterpret_cast<std::byte *>(&p_arena) + (p_arena.m_next_chunk++ << Layout::s_chunk_bits);
+          new (chunk) ArenaChunk{p_class};
+          // Only complete blocks are carved, so the largest class has seven blocks per chunk.
+          std::size_t const blocks = (Layout::s_chunk_size - Layout::s_chunk_header) / block_size;
+          p_arena.m_bump[p_class] = chunk + Layout::s_chunk_header;
+          p_arena.m_bump_end[p_class] = p_arena.m_bump[p_class] + blocks * block_size;
+        }
+        block = p_arena.m_bump[p_class];
+        p_arena.m_bump[p_class] += block_size;
+      }
+      ++p_arena.m_live;
+      return block;
+    }
+
+    // Return the size class of the chunk which contains the block.
+    static unsigned
+    class_of(void const * const p_pointer) noexcept
+    {
+      auto const address = reinterpret_cast<std::uintptr_t>(p_pointer) & ~(Layout::s_chunk_size - 1u);
+      return std::launder(reinterpret_cast<ArenaChunk const *>(address))->m_class;
+    }
+
+    // Return true if the arena is empty afterwards.
+    static bool
+    deallocate(ArenaHeader & p_arena, void * const p_pointer) noexcept
+    {
+      unsigned const size_class = class_of(p_pointer);
+      p_arena.m_free[size_class] = new (p_pointer) ArenaBlock{p_arena.m_free[size_class]};
+      PNTR_ASSERT(p_arena.m_live > 0u);
+      return (--p_arena.m_live == 0u);
+    }
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                           ArenaPool                                            //
+//                                                                                                //
+//               A pool of large arenas backed by huge pages, for 'AllocatorArena'                //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Large populations of small objects allocated with 'std::malloc' are spread over many pages,
+//  which causes many TLB misses on random access and one page fault per page on first touch.
+//  'ArenaPool' reserves arenas of 32 MiB with anonymous 'mmap' and advises the kernel to back them
+//  with transparent huge pages using 'MADV_HUGEPAGE', which is ignored if unsupported.
+//
+//  Each arena is divided into chunks of 64 KiB, each dedicated to one power of two size class
+//  from 16 bytes to 8 KiB, like 'SharedMemorySegment'. The largest class is limited to an eighth of
+//  a chunk, so the chunk header wastes little space.
+//
+//  Each thread allocates from and deallocates into one of the pool's caches of free blocks, which
+//  are selected by the thread, so threads rarely contend for the same mutex. A cache refills and
+//  flushes a few blocks at a time under the mutex of the pool, so objects can be released by any
+//  thread. Cached blocks keep their arena resident until they are reused or 'trim' returns them.
+//
+//  The options can request a number of arenas to be mapped by the constructor as a warm-up, and to
+//  prefault all pages of mapped arenas with 'MADV_POPULATE_WRITE', or by touching them on older
+//  kernels. The pages of an arena whose blocks have all been deallocated are returned to the
+//  operating system with 'MADV_DONTNEED', except for the number of empty arenas to retain. The
+//  address space stays reserved for later allocations until the pool is destroyed.
+//
+//  The pages of the arenas can be bound to a preferred NUMA node, see 'NumaPool'.
+//
+//  The pool must outlive all of its objects. Functions which call the operating system throw
+//  'std::system_error' on failure, except for the allocation which returns nullptr.
+//
+
+class ArenaPool
+{
+  using Layout = detail::ArenaLayout;
+  using Heap = detail::ArenaHeap;
+
+public:
+  struct Options
+  {
+    // The number of arenas mapped by the constructor.
+    std::size_t m_arenas = 0u;
+    // The number of empty arenas whose pages are not returned to the operating system.
+    std::size_t m_retain = 1u;
+    // The NUMA node preferred for the pages of the arenas, or -1 for the default policy.
+    int m_node = -1;
+    bool m_huge_pages = true;
+    bool m_prefault = false;
+  };
+
+  ArenaPool()
+  : ArenaPool(Options{})
+  {}
+
+  explicit ArenaPool(Options const & p_options)
+  : m_options(p_options)
+  {
+    reserve(p_options.m_arenas);
+  }
+
+  ~ArenaPool() noexcept
+  {
+    PNTR_TRY_LOG_ERROR(live_count() != 0u, "Destroying an arena pool with live blocks");
+    if (Scope::current() == this)
+    {
+      Scope::current() = nullptr;
+    }
+    for (detail::ArenaHeader * arena = m_arenas; arena != nullptr;)
+    {
+      detail::ArenaHeader * const next = arena->m_next;
+      ::munmap(arena, Layout::s_arena_size);
+      arena = next;
+    }
+  }
+
+  ArenaPool(ArenaPool const &) = delete;
+  ArenaPool & operator=(ArenaPool const &) = delete;
+
+  // Map arenas until the pool has at least the given number.
+  void
+  reserve(std::size_t const p_arenas)
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    while (m_arena_count < p_arenas)
+    {
+      if (map_arena() == nullptr)
+      {
+        throw std::system_error(errno, std::generic_category(), "mmap");
+      }
+    }
+  }
+
+  // Allocate a block, or return nullptr if no arena can be mapped or the request is too big.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    unsigned const size_class = Heap::size_class(p_size, p_alignment);
+    if (size_class >= Layout::s_class_count)
+    {
+      return nullptr;
+    }
+    detail::ArenaCache & cache = own_cache();
+    std::lock_guard<std::mutex> const lock(cache.m_mutex);
+    if (cache.m_free[size_class] == nullptr && !refill(cache, size_class))
+    {
+      return nullptr;
+    }
+    detail::ArenaBlock * const block = cache.m_free[size_class];
+    cache.m_free[size_class] = block->m_next;
+    --cache.m_count[size_class];
+    return block;
+  }
+
+  // Deallocate a block allocated by any pool.
+  static void
+  deallocate(void * const p_pointer) noexcept
+  {
+    ArenaPool & pool = pool_of(p_pointer);
+    unsigned const size_class = Heap::class_of(p_pointer);
+    detail::ArenaCache & cache = pool.own_cache();
+    std::lock_guard<std::mutex> const lock(cache.m_mutex);
+    cache.m_free[size_class] = new (p_pointer) detail::ArenaBlock{cache.m_free[size_class]};
+    if (++cache.m_count[size_class] > Layout::s_cache_blocks)
+    {
+      pool.flush(cache, size_class, Layout::s_cache_blocks / 2u);
+    }
+  }
+
+  // Return the cached blocks of all threads to their arenas, so the pages of empty arenas can be
+  // returned to the operating system.
+  void
+  trim() noexcept
+  {
+    for (detail::ArenaCache & cache : m_caches)
+    {
+      std::lock_guard<std::mutex> const lock(cache.m_mutex);
+      for (unsigned size_class = 0u; size_class < Layout::s_class_count; ++size_class)
+      {
+        flush(cache, size_class, 0u);
+      }
+    }
+  }
+
+  // Make the pool current for the allocations of 'AllocatorArena' in the lifetime of the scope,
+  // for example of objects which aren't created by 'make_shared', like coroutine frames.
+  using Scope = detail::CurrentScope<ArenaPool>;
+
+  // Create a shared object in this pool. The type has to use 'AllocatorArena'.
+  template<class t_shared, typename... t_args>
+  SharedPtr<t_shared>
+  make_shared(t_args &&... p_args)
+  {
+    Scope const scope(*this);
+    return pntr::make_shared<t_shared>(std::forward<t_args>(p_args)...);
+  }
+
+  // Return the preferred NUMA node, or -1.
+  int
+  node() const noexcept
+  {
+    return m_options.m_node;
+  }
+
+  // Return the pool of the arena that contains the given block.
+  static ArenaPool &
+  pool_of(void const * const p_pointer) noexcept
+  {
+    return *Heap::arena_of(p_pointer).m_pool;
+  }
+
+  // Return the number of mapped arenas.
+  std::size_t
+  arena_count() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    return m_arena_count;
+  }
+
+  // Return the number of arenas whose pages have not been returned to the operating system.
+  std::size_t
+  resident_count() const noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    std::size_t count = 0u;
+    for (detail::ArenaHeader const * arena = m_arenas; arena != nullptr; arena = arena->m_next)
+    {
+      count += (arena->m_resident ? 1u : 0u);
+    }
+    return count;
+  }
+
+  // Return the number of allocated blocks, which don't include the cached blocks. The count is
+  // only exact if no other thread allocates or deallocates concurrently.
+  std::size_t
+  live_count() const noexcept
+  {
+    std::size_t cached = 0u;
+    for (detail::ArenaCache & cache : m_caches)
+    {
+      std::lock_guard<std::mutex> const lock(cache.m_mutex);
+      for (unsigned const count : cache.m_count)
+      {
+        cached += count;
+      }
+    }
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    std::size_t count = 0u;
+    for (detail::ArenaHeader const * arena = m_arenas; arena != nullptr; arena = arena->m_next)
+    {
+      count += arena->m_live;
+    }
+    return (count > cached ? count - cached : 0u);
+  }
+
+private:
+  detail::ArenaCache &
+  own_cache() noexcept
+  {
+    return m_caches[detail::thread_slot() % Layout::s_cache_count];
+  }
+
+  // Move a few blocks of the size class from the arenas to the locked cache. Return false if no
+  // block could be allocated.
+  bool
+  refill(detail::ArenaCache & p_cache, unsigned const p_class) noexcept
+  {
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    for (unsigned i = 0u; i < Layout::s_cache_refill; ++i)
+    {
+      if (m_current == nullptr || !Heap::can_allocate(*m_current, p_class))
+      {
+        m_current = find_arena(p_class);
+        if (m_current == nullptr)
+        {
+          break;
+        }
+      }
+      if (m_current->m_live == 0u)
+      {
+        if (m_current->m_resident)
+        {
+          --m_empty;
+        }
+        m_current->m_resident = true;
+      }
+      p_cache.m_free[p_class] = new (Heap::allocate(*m_current, p_class)) detail::ArenaBlock{p_cache.m_free[p_class]};
+      ++p_cache.m_count[p_class];
+    }
+    return (p_cache.m_free[p_class] != nullptr);
+  }
+
+  // Return the blocks of the size class from the locked cache to their arenas, except for the
+  // given number of blocks.
+  void
+  flush(detail::ArenaCache & p_cache, unsigned const p_class, unsigned const p_keep) noexcept
+  {
+    if (p_cache.m_count[p_class] <= p_keep)
+    {
+      return;
+    }
+    std::lock_guard<std::mutex> const lock(m_mutex);
+    while (p_cache.m_count[p_class] > p_keep)
+    {
+      detail::ArenaBlock * const block = p_cache.m_free[p_class];
+      p_cache.m_free[p_class] = block->m_next;
+      --p_cache.m_count[p_class];
+      detail::ArenaHeader & arena = Heap::arena_of(block);
+      if (Heap::deallocate(arena, block))
+      {
+        retire(arena);
+      }
+    }
+  }
+
+  // Prefer arenas with live blocks, so empty arenas can be returned to the operating system.
+  detail::ArenaHeader *
+  find_arena(unsigned const p_class) noexcept
+  {
+    detail::ArenaHeader * empty = nullptr;
+    for (detail::ArenaHeader * arena = m_arenas; arena != nullptr; arena = arena->m_next)
+    {
+      if (arena->m_live != 0u)
+      {
+        if (Heap::can_allocate(*arena, p_class))
+        {
+          return arena;
+        }
+      }
+      else if (empty == nullptr || (arena->m_resident && !empty->m_resident))
+      {
+        empty = arena;
+      }
+    }
+    return (empty != nullptr ? empty : map_arena());
+  }
+
+  // Map an arena aligned to its size, or return nullptr on failure.
+  detail::ArenaHeader *
+  map_arena() noexcept
+  {
+    void * const mapping = ::mmap(nullptr, 2u * Layout::s_arena_size, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (mapping == MAP_FAILED)
+    {
+      return nullptr;
+    }
+    auto * const begin = static_cast<std::byte *>(mapping);
+    auto const address = reinterpret_cast<std::uintptr_t>(mapping);
+    std::size_t const head = ((address + Layout::s_arena_size - 1u) & ~(Layout::s_arena_size - 1u)) - address;
+    std::byte * const base = begin + head;
+    if (head != 0u)
+    {
+      ::munmap(begin, head);
+    }
+    ::munmap(base + Layout::s_arena_size, Layout::s_arena_size - head);
+
+    if (m_options.m_node >= 0)
+    {
+      detail::NumaPolicy::bind(base, Layout::s_arena_size, static_cast<unsigned>(m_options.m_node));
+    }
+  #ifdef MADV_HUGEPAGE
+    if (m_options.m_huge_pages)
+    {
+      ::madvise(base, Layout::s_arena_size, MADV_HUGEPAGE);
+    }
+  #endif
+    if (m_options.m_prefault)
+    {
+      prefault(base, Layout::s_arena_size);
+    }
+
+    auto * const arena = new (base) detail::ArenaHeader{};
+    arena->m_pool = this;
+    arena->m_next = m_arenas;
+    arena->m_resident = true;
+    Heap::reset(*arena);
+    m_arenas = arena;
+    ++m_arena_count;
+    ++m_empty;
+    return arena;
+  }
+
+  // Reset an arena whose blocks have all been deallocated, and return its pages to the operating
+  // system unless enough empty arenas are retained.
+  void
+  retire(detail::ArenaHeader & p_arena) noexcept
+  {
+    Heap::reset(p_arena);
+    if (m_empty < m_options.m_retain)
+    {
+      ++m_empty;
+      return;
+    }
+    ::madvise(reinterpret_cast<std::byte *>(&p_arena) + Layout::s_chunk_size,
+              Layout::s_arena_size - Layout::s_chunk_size, MADV_DONTNEED);
+    p_arena.m_resident = false;
+  }
+
+  static void
+  prefault(std::byte * const p_base, std::size_t const p_size) noexcept
+  {
+  #ifdef MADV_POPULATE_WRITE
+    if (::madvise(p_base, p_size, MADV_POPULATE_WRITE) == 0)
+    {
+      return;
+    }
+  #endif
+    for (std::size_t offset = 0u; offset < p_size; offset += Layout::s_page_size)
+    {
+      static_cast<std::byte volatile *>(p_base)[offset] = std::byte{};
+    }
+  }
+
+  Options const m_options;
+  mutable detail::ArenaCache m_caches[Layout::s_cache_count];
+  mutable std::mutex m_mutex;
+  detail::ArenaHeader * m_arenas = nullptr;
+  detail::ArenaHeader * m_current = nullptr;
+  std::size_t m_arena_count = 0u;
+  // The number of resident arenas without live blocks.
+  std::size_t m_empty = 0u;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         AllocatorArena                                         //
+//                                                                                                //
+//                   An allocator for 'ControlAlloc' which uses an 'ArenaPool'                    //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'AllocatorArena' is an empty class. It allocates from the pool which calls
+//  'ArenaPool::make_shared', or whose 'ArenaPool::Scope' is active, and deallocates into the pool
+//  of the arena that contains the pointer.
+//  It doesn't need any offset bits if the shared base is at the front of the created class, see
+//  'AllocatorMalloc'.
+//
+
+template<class t_static_support = NoStaticSupport>
+class AllocatorArena
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //      The type definitions and member functions required by 'ControlAlloc' start here       //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // See 'AllocatorMalloc'.
+  using SupportsStatic = t_static_support;
+
+  // 'ControlAlloc' identifies the type of this allocator with this type definition.
+  using PointerDeallocate = void;
+
+  // Allocate a memory block in the current pool.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    ArenaPool * const pool = ArenaPool::Scope::current();
+    PNTR_TRY_LOG_ERROR(pool == nullptr, "No current arena pool");
+    return (pool != nullptr ? pool->allocate(p_size, p_alignment) : nullptr);
+  }
+
+  // Deallocate a memory block into the pool of its arena.
+  void
+  deallocate(void * const p_pointer) noexcept
+  {
+    ArenaPool::deallocate(p_pointer);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //       The type definitions and member functions required by 'ControlAlloc' end here        //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+};
+
+
+PNTR_NAMESPACE_END
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                     pntr/AllocatorNuma.hpp                                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#if defined(__linux__)
+
+  #include <cstddef>
+  #include <memory>
+  #include <utility>
+  #include <vector>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                            NumaPool                                            //
+//                                                                                                //
+//                     An 'ArenaPool' for each NUMA node, for 'AllocatorNuma'                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Objects which are allocated on one NUMA node and whose counters are modified from another one
+//  cause coherence traffic between the sockets. 'NumaPool' creates an 'ArenaPool' for each node,
+//  whose arenas prefer that node using 'mbind'. Objects are allocated in the pool of the node
+//  which runs the calling thread, and deallocated into the pool of the arena that contains them,
+//  which is the pool of the node that owns the memory.
+//
+//  The nodes are determined with 'get_mempolicy' and 'getcpu'. On machines with a single node, or
+//  kernels without NUMA support, there is only the pool of node zero.
+//
+//  The node count is fixed when the pool is created. The pool must outlive all of its objects.
+//
+
+class NumaPool
+{
+public:
+  // The statistics of the pool of one node.
+  struct NodeStatistics
+  {
+    std::size_t m_arenas;
+    std::size_t m_resident;
+    std::size_t m_live;
+  };
+
+  NumaPool()
+  : NumaPool(ArenaPool::Options{})
+  {}
+
+  // The options are used for the pools of all nodes, except for 'm_node', which is set to their node
+  // on machines with more than one node.
+  explicit NumaPool(ArenaPool::Options const & p_options)
+  {
+    std::size_t const node_count = detail::NumaPolicy::node_count();
+    m_pools.reserve(node_count);
+    for (std::size_t node = 0u; node < node_count; ++node)
+    {
+      ArenaPool::Options options = p_options;
+      options.m_node = (node_count > 1u ? static_cast<int>(node) : -1);
+      m_pools.push_back(std::make_unique<ArenaPool>(options));
+    }
+  }
+
+  ~NumaPool() noexcept
+  {
+    if (Scope::current() == this)
+    {
+      Scope::current() = nullptr;
+    }
+  }
+
+  NumaPool(NumaPool const &) = delete;
+  NumaPool & operator=(NumaPool const &) = delete;
+
+  // Return the number of nodes.
+  std::size_t
+  node_count() const noexcept
+  {
+    return m_pools.size();
+  }
+
+  // Return the node of the calling thread.
+  std::size_t
+  current_node() const noexcept
+  {
+    return detail::NumaPolicy::current_node() % m_pools.size();
+  }
+
+  ArenaPool &
+  node_pool(std::size_t const p_node) noexcept
+  {
+    return *m_pools[p_node];
+  }
+
+  // Return the node of the pool which owns the given block.
+  std::size_t
+  node_of(void const * const p_pointer) const noexcept
+  {
+    ArenaPool const & pool = ArenaPool::pool_of(p_pointer);
+    return (pool.node() >= 0 ? static_cast<std::size_t>(pool.node()) : 0u);
+  }
+
+  NodeStatistics
+  statistics(std::size_t const p_node) const noexcept
+  {
+    ArenaPool const & pool = *m_pools[p_node];
+    return NodeStatistics{pool.arena_count(), pool.resident_count(), pool.live_count()};
+  }
+
+  // Allocate a block on the node of the calling thread.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    return m_pools[current_node()]->allocate(p_size, p_alignment);
+  }
+
+  // Make the pool current for the allocations of 'AllocatorNuma' in the lifetime of the scope.
+  using Scope = detail::CurrentScope<NumaPool>;
+
+  // Create a shared object on the node of the calling thread. The type has to use 'AllocatorNuma'.
+  template<class t_shared, typename... t_args>
+  SharedPtr<t_shared>
+  make_shared(t_args &&... p_args)
+  {
+    Scope const scope(*this);
+    return pntr::make_shared<t_shared>(std::forward<t_args>(p_args)...);
+  }
+
+private:
+  std::vector<std::unique_ptr<ArenaPool>> m_pools;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         AllocatorNuma                                          //
+//                                                                                                //
+//                    An allocator for 'ControlAlloc' which uses a 'NumaPool'                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'AllocatorNuma' is an empty class. It allocates from the pool which calls
+//  'NumaPool::make_shared' on the node of the calling thread, and deallocates into the pool of the
+//  node that owns the pointer, see 'AllocatorArena'.
+//
+
+template<class t_static_support = NoStaticSupport>
+class AllocatorNuma
+{
+public:
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //      The type definitions and member functions required by 'ControlAlloc' start here       //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  // See 'AllocatorMalloc'.
+  using SupportsStatic = t_static_support;
+
+  // 'ControlAlloc' identifies the type of this allocator with this type definition.
+  using PointerDeallocate = void;
+
+  // Allocate a memory block on the node of the calling thread in the current pool.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+  {
+    NumaPool * const pool = NumaPool::Scope::current();
+    PNTR_TRY_LOG_ERROR(pool == nullptr, "No current NUMA pool");
+    return (pool != nullptr ? pool->allocate(p_size, p_alignment) : nullptr);
+  }
+
+  // Deallocate a memory block into the pool of the node that owns it.
+  void
+  deallocate(void * const p_pointer) noexcept
+  {
+    ArenaPool::deallocate(p_pointer);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //       The type definitions and member functions required by 'ControlAlloc' end here        //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+};
+
+
+PNTR_NAMESPACE_END
+
+#endif
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                       pntr/Snapshot.hpp                                        //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <memory>
+#include <new>
+#include <system_error>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+  #include <cerrno>
+
+  #include <fcntl.h>
+  #include <sys/mman.h>
+  #include <sys/stat.h>
+  #include <unistd.h>
+#endif
+
+PNTR_NAMESPACE_BEGIN
+
+
+class SnapshotWriter;
+
+namespace detail
+{
+  struct SnapshotHeader
+  {
+    static constexpr std::uint64_t s_magic = 0x706E74722D736E70u; // "pntr-snp"
+    static constexpr std::uint32_t s_version = 1u;
+
+    std::uint64_t m_magic;
+    std::uint32_t m_version;
+    std::uint32_t m_reserved;
+    std::uint64_t m_size;
+    std::uint64_t m_root;
+  };
+} // namespace detail
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                          SnapshotPtr                                           //
+//                                                                                                //
+//                   A constant link between two object images in a snapshot                      //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The link stores the distance to its target relative to its own address, so the snapshot can be
+//  mapped at any address. It is only set by 'SnapshotWriter::link'.
+//
+
+template<class t_image>
+class SnapshotPtr
+{
+public:
+  using element_type = t_image const;
+
+  SnapshotPtr() noexcept = default;
+
+  explicit operator bool() const noexcept
+  {
+    return (m_offset != 0);
+  }
+
+  t_image const *
+  get() const noexcept
+  {
+    return (m_offset == 0 ? nullptr
+                          : reinterpret_cast<t_image const *>(reinterpret_cast<std::uintptr_t>(this)
+                                                              + static_cast<std::uintptr_t>(m_offset)));
+  }
+
+  t_image const &
+  operator*() const noexcept
+  {
+    PNTR_ASSERT(m_offset != 0);
+    return *get();
+  }
+
+  t_image const *
+  operator->() const noexcept
+  {
+    PNTR_ASSERT(m_offset != 0);
+    return get();
+  }
+
+private:
+  std::int64_t m_offset{};
+
+  friend SnapshotWriter;
+};
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         SnapshotWriter                                         //
+//                                                                                                //
+//             Writes a graph of shared objects into a relocatable image for 'Snapshot'           //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Each shared class which can be written has to provide:
+//  - The type definition 'PntrSnapshot' of its image, which must be trivially copyable and may only
+//    link to other images with 'SnapshotPtr'. Its alignment may not exceed 64 bytes.
+//  - The member function 'void pntr_snapshot(SnapshotWriter &, PntrSnapshot &) const', which fills
+//    the value initialized image. It calls 'link' for each shared pointer of the object.
+//
+//  Each object is written only once, and all links to it point to the same image, which preserves
+//  the shared ownership of the graph, including cycles. The images are filled from a work list
+//  instead of recursively, so long chains of links don't exhaust the stack.
+//
+
+class SnapshotWriter
+{
+public:
+  static constexpr std::size_t s_max_alignment = 64u;
+
+  SnapshotWriter()
+  {
+    m_header = new (allocate(sizeof(detail::SnapshotHeader), alignof(detail::SnapshotHeader)))
+      detail::SnapshotHeader{detail::SnapshotHeader::s_magic, detail::SnapshotHeader::s_version, 0u, m_size, 0u};
+  }
+
+  SnapshotWriter(SnapshotWriter const &) = delete;
+  SnapshotWriter & operator=(SnapshotWriter const &) = delete;
+
+  // Write the object, unless it has been written before, and link the image to it. Only called
+  // from 'pntr_snapshot'.
+  template<class t_image, class t_shared>
+  void
+  link(SnapshotPtr<t_image> & p_link, SharedPtr<t_shared> const & p_shared)
+  {
+    static_assert(std::is_same_v<t_image, typename std::remove_const_t<t_shared>::PntrSnapshot>);
+    p_link.m_offset =
+      (p_shared ? static_cast<std::int64_t>(write(p_shared.get()) - file_offset(&p_link)) : std::int64_t{});
+  }
+
+  // Write the root object of the snapshot and all objects reachable from it. If it is called
+  // several times, the last root is stored.
+  template<class t_shared>
+  void
+  set_root(SharedPtr<t_shared> const & p_shared)
+  {
+    m_header->m_root = (p_shared ? write(p_shared.get()) : 0u);
+    drain();
+  }
+
+  // Return the number of bytes of the snapshot.
+  std::size_t
+  size() const noexcept
+  {
+    return m_size;
+  }
+
+  // Copy the snapshot into a buffer of at least 'size()' bytes.
+  void
+  copy(void * const p_buffer) const noexcept
+  {
+    auto * const buffer = static_cast<std::byte *>(p_buffer);
+    std::uint64_t position = 0u;
+    for (Chunk const & chunk: m_chunks)
+    {
+      std::memset(buffer + position, 0, static_cast<std::size_t>(chunk.m_file_offset - position));
+      std::memcpy(buffer + chunk.m_file_offset, chunk.m_data.get(), chunk.m_used);
+      position = chunk.m_file_offset + chunk.m_used;
+    }
+  }
+
+  // Write the snapshot into a file. Throws 'std::system_error' on failure.
+  void
+  save(char const * const p_path) const
+  {
+    std::ofstream file;
+    file.exceptions(std::ofstream::failbit | std::ofstream::badbit);
+    file.open(p_path, std::ofstream::binary | std::ofstream::trunc);
+    std::uint64_t position = 0u;
+    for (Chunk const & chunk: m_chunks)
+    {
+      for (; position < chunk.m_file_offset; ++position)
+      {
+        file.put('\0');
+      }
+      file.write(reinterpret_cast<char const *>(chunk.m_data.get()), static_cast<std::streamsize>(chunk.m_used));
+      position += chunk.m_used;
+    }
+  }
+
+private:
+  static constexpr std::size_t s_chunk_size = std::size_t{1u} << 20u;
+
+  struct alignas(s_max_alignment) Block
+  {
+    std::byte m_bytes[s_max_alignment];
+  };
+
+  struct Chunk
+  {
+    std::unique_ptr<Block[]> m_data;
+    std::size_t m_capacity;
+    std::size_t m_used;
+    std::uint64_t m_file_offset;
+  };
+
+  // An image which has been allocated but not filled yet.
+  struct Pending
+  {
+    void const * m_object;
+    void * m_image;
+    void (*m_fill)(SnapshotWriter &, void const *, void *);
+  };
+
+  template<class t_shared>
+  static void
+  fill(SnapshotWriter & p_writer, void const * const p_object, void * const p_image)
+  {
+    static_cast<t_shared const *>(p_object)->pntr_snapshot(p_writer,
+                                                           *new (p_image) typename t_shared::PntrSnapshot{});
+  }
+
+  // Return the file offset of the image of the object. New images are filled later by 'drain', so
+  // the stack depth doesn't depend on the length of linked chains.
+  template<class t_shared>
+  std::uint64_t
+  write(t_shared * const p_shared)
+  {
+    using Shared = std::remove_const_t<t_shared>;
+    using Image = typename Shared::PntrSnapshot;
+    static_assert(std::is_trivially_copyable_v<Image>);
+    static_assert(alignof(Image) <= s_max_alignment);
+    auto const found = m_written.find(static_cast<void const *>(p_shared));
+    if (found != m_written.end())
+    {
+      return found->second;
+    }
+    void * const storage = allocate(sizeof(Image), alignof(Image));
+    std::uint64_t const offset = file_offset(storage);
+    m_written.emplace(static_cast<void const *>(p_shared), offset);
+    m_pending.push_back(Pending{static_cast<void const *>(p_shared), storage, &fill<Shared>});
+    return offset;
+  }
+
+  void
+  drain()
+  {
+    while (!m_pending.empty())
+    {
+      Pending const pending = m_pending.back();
+      m_pending.pop_back();
+      pending.m_fill(*this, pending.m_object, pending.m_image);
+    }
+  }
+
+  // Allocate storage in the last chunk. The chunks never move.
+  void *
+  allocate(std::size_t const p_size, std::size_t const p_alignment)
+  {
+    std::uint64_t offset = (m_size + p_alignment - 1u) & ~std::uint64_t{p_alignment - 1u};
+    if (m_chunks.empty() || offset + p_size > m_chunks.back().m_file_offset + m_chunks.back().m_capacity)
+    {
+      offset = (m_size + s_max_alignment - 1u) & ~std::uint64_t{s_max_alignment - 1u};
+      std::size_t const capacity = std::max(s_chunk_size, (p_size + s_max_alignment - 1u) & ~(s_max_alignment - 1u));
+      m_chunks.push_back(Chunk{std::make_unique<Block[]>(capacity / s_max_alignment), capacity, 0u, offset});
+      m_addresses.emplace(reinterpret_cast<std::uintptr_t>(m_chunks.back().m_data.get()), m_chunks.size() - 1u);
+    }
+    Chunk & chunk = m_chunks.back();
+    chunk.m_used = static_cast<std::size_t>(offset + p_size - chunk.m_file_offset);
+    m_size = offset + p_size;
+    if (m_header != nullptr)
+    {
+      m_header->m_size = m_size;
+    }
+    return reinterpret_cast<std::byte *>(chunk.m_data.get()) + (offset - chunk.m_file_offset);
+  }
+
+  // Return the file offset of an address in any chunk.
+  std::uint64_t
+  file_offset(void const * const p_address) const noexcept
+  {
+    auto const address = reinterpret_cast<std::uintptr_t>(p_address);
+    auto const found = std::prev(m_addresses.upper_bound(address));
+    return m_chunks[found->second].m_file_offset + (address - found->first);
+  }
+
+  std::vector<Chunk> m_chunks;
+  std::map<std::uintptr_t, std::size_t> m_addresses;
+  std::unordered_map<void const *, std::uint64_t> m_written;
+  std::vector<Pending> m_pending;
+  detail::SnapshotHeader * m_header{};
+  std::uint64_t m_size{};
+};
+
+
+#if defined(__linux__)
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                            Snapshot                                            //
+//                                                                                                //
+//                     A read-only memory mapping of a 'SnapshotWriter' file                      //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Loading a snapshot only maps the file, so the pages are read on demand and shared with the page
+//  cache. The snapshot doesn't contain the shared objects themselves, but their images of the
+//  separate type 'PntrSnapshot', which have no control block and are linked by 'SnapshotPtr'
+//  instead of 'SharedPtr'. So code which reads a snapshot works with the image types, not with the
+//  'Intruder' classes. The images are immortal constant objects without reference counters, which
+//  are valid as long as the snapshot is. The root type has to match the type written by 'set_root'.
+//
+//  'load' throws 'std::system_error' if the file can't be mapped or its header is invalid. 'root'
+//  returns nullptr if the root image doesn't fit into the mapping or is misaligned. The links
+//  between the images aren't validated, since the images are untyped, so a corrupted link may point
+//  outside of the mapping. Only load snapshots from trusted files.
+//
+
+class Snapshot
+{
+public:
+  static Snapshot
+  load(char const * const p_path)
+  {
+    int const file_descriptor = ::open(p_path, O_RDONLY | O_CLOEXEC);
+    if (file_descriptor < 0)
+    {
+      throw std::system_error(errno, std::generic_category(), "open");
+    }
+    struct stat status{};
+    if (::fstat(file_descriptor, &status) < 0)
+    {
+      int const error = errno;
+      ::close(file_descriptor);
+      throw std::system_error(error, std::generic_category(), "fstat");
+    }
+    auto const size = static_cast<std::size_t>(status.st_size);
+    if (size < sizeof(detail::SnapshotHeader))
+    {
+      ::close(file_descriptor);
+      throw std::system_error(std::make_error_code(std::errc::invalid_argument), "invalid snapshot");
+    }
+    void * const base = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file_descriptor, 0);
+    int const error = errno;
+    ::close(file_descriptor);
+    if (base == MAP_FAILED)
+    {
+      throw std::system_error(error, std::generic_category(), "mmap");
+    }
+    Snapshot snapshot(static_cast<std::byte const *>(base), size);
+    detail::SnapshotHeader const & header = snapshot.header();
+    if (header.m_magic != detail::SnapshotHeader::s_magic || header.m_version != detail::SnapshotHeader::s_version
+        || header.m_size != size || header.m_root >= size
+        || (header.m_root != 0u && header.m_root < sizeof(detail::SnapshotHeader)))
+    {
+      throw std::system_error(std::make_error_code(std::errc::invalid_argument), "invalid snapshot");
+    }
+    return snapshot;
+  }
+
+  Snapshot(Snapshot && p_other) noexcept
+  : m_base(std::exchange(p_other.m_base, nullptr))
+  , m_size(std::exchange(p_other.m_size, 0u))
+  {}
+
+  ~Snapshot() noexcept
+  {
+    if (m_base != nullptr)
+    {
+      ::munmap(const_cast<std::byte *>(m_base), m_size);
+    }
+  }
+
+  Snapshot(Snapshot const &) = delete;
+  Snapshot & operator=(Snapshot const &) = delete;
+  Snapshot & operator=(Snapshot &&) = delete;
+
+  std::size_t
+  size() const noexcept
+  {
+    return m_size;
+  }
+
+  // Return the image of the root object, or nullptr if there is none, or if the image doesn't fit
+  // into the mapping or is misaligned.
+  template<class t_shared>
+  typename t_shared::PntrSnapshot const *
+  root() const noexcept
+  {
+    using Image = typename t_shared::PntrSnapshot;
+    std::uint64_t const offset = header().m_root;
+    if (offset == 0u || sizeof(Image) > m_size - offset || offset % alignof(Image) != 0u)
+    {
+      return nullptr;
+    }
+    return std::launder(reinterpret_cast<Image const *>(m_base + offset));
+  }
+
+private:
+  Snapshot(std::byte const * const p_base, std::size_t const p_size) noexcept
+  : m_base(p_base)
+  , m_size(p_size)
+  {}
+
+  detail::SnapshotHeader const &
+  header() const noexcept
+  {
+    return *std::launder(reinterpret_cast<detail::SnapshotHeader const *>(m_base));
+  }
+
+  std::byte const * m_base;
+  std::size_t m_size;
+};
+
+#endif
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                    pntr/CycleCollector.hpp                                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <unordered_map>
+#include <vector>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         CycleCollector                                         //
+//                                                                                                //
+//            An incremental trial deletion collector for cycles of shared objects                //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  A shared base class takes part in cycle collection by providing the member function template
+//  'template<class t_visitor> void pntr_visit_children(t_visitor && p_visit)', which calls
+//  'p_visit' with each 'SharedPtr' member of the object as non-constant reference. Objects of
+//  all other types are acyclic, and their shared pointers don't pay anything at all.
+//
+//  The collector uses the lowest 3 bits of the user value of the control block for a buffered
+//  flag and the color of the synchronous algorithm by Bacon and Rajan, so the control block
+//  needs at least 3 user bits, see 'IntruderCycle'. 'ControlAlloc' reserves these bits: the user
+//  value excludes them, and setting it keeps them.
+//
+//  When a 'SharedPtr' to a collected object is destroyed and the object has other owners, it is
+//  a possible root of a garbage cycle. Unless it is buffered already, the reference is moved to
+//  the buffer of the collector instead of being released. So buffered objects stay alive until
+//  they have been processed by 'collect'.
+//
+//  'collect' processes the buffered roots in batches. It marks the objects reachable from the
+//  roots with trial counts in a side table, without modifying the usage counters, and finally
+//  releases the garbage cycles. The trial counts are only valid as long as the graph isn't
+//  modified, so a batch can't be resumed later. Instead, a batch whose traversal exceeds the
+//  remaining budget is abandoned: its side table is dropped, and its roots are buffered again at
+//  the end, so each pause stays bounded by the budget. A subgraph which is larger than the budget
+//  is only collected by a call with a larger budget, at the latest when the thread exits.
+//  Traversal stops at objects which are buffered for later batches, which usually keeps the
+//  batches small.
+//
+//  Each thread has its own collector, which isn't thread-safe. So the objects of a graph must
+//  only be released and collected by one thread at a time. The collector of a thread collects
+//  all remaining roots when the thread exits.
+//
+
+class CycleCollector
+{
+public:
+  // Return the collector of the current thread.
+  static CycleCollector &
+  local() noexcept
+  {
+    static thread_local CycleCollector s_collector;
+    return s_collector;
+  }
+
+  CycleCollector(CycleCollector const &) = delete;
+  CycleCollector & operator=(CycleCollector const &) = delete;
+
+  // Process batches of buffered roots until the number of visited objects reaches the budget.
+  // A batch which would exceed the remaining budget is abandoned, and its roots are buffered
+  // again at the end. Return the number of released objects.
+  std::size_t
+  collect(std::size_t const p_budget = std::numeric_limits<std::size_t>::max())
+  {
+    std::size_t released = 0u;
+    std::size_t work = 0u;
+    while (!m_roots.empty() && work < p_budget)
+    {
+      m_batch.clear();
+      while (!m_roots.empty() && work + m_batch.size() < p_budget)
+      {
+        Node const root = m_roots.front();
+        m_roots.pop_front();
+        if (root.m_ops->m_use_count(root.m_object) == 1u)
+        {
+          // Only the buffer owns the root.
+          root.set_bits(s_black);
+          root.m_ops->m_release(root.m_object);
+          ++released;
+          ++work;
+        }
+        else
+        {
+          root.set_bits(s_buffered | s_purple);
+          m_batch.push_back(root);
+        }
+      }
+      if (!mark_gray(p_budget - work))
+      {
+        abandon();
+        break;
+      }
+      scan();
+      released += collect_white();
+      work += m_visited.size();
+      m_visited.clear();
+      m_index.clear();
+    }
+    return released;
+  }
+
+  // Return the number of buffered roots.
+  std::size_t
+  pending() const noexcept
+  {
+    return m_roots.size();
+  }
+
+private:
+  static constexpr unsigned s_black = 0u;
+  static constexpr unsigned s_gray = 1u;
+  static constexpr unsigned s_white = 2u;
+  static constexpr unsigned s_purple = 3u;
+  static constexpr unsigned s_color_mask = 3u;
+  static constexpr unsigned s_buffered = 4u;
+  static constexpr unsigned s_bits_mask = 7u;
+
+  struct Node;
+
+  using VisitCallback = void (*)(CycleCollector &, Node const &);
+
+  // The functions for a type of objects.
+  struct Ops
+  {
+    std::size_t (*m_use_count)(void *) noexcept;
+    unsigned (*m_get_bits)(void *) noexcept;
+    void (*m_set_bits)(void *, unsigned) noexcept;
+    void (*m_visit)(void *, CycleCollector &, VisitCallback);
+    void (*m_clear)(void *);
+    void (*m_add_ref)(void *) noexcept;
+    void (*m_release)(void *) noexcept;
+  };
+
+  struct Node
+  {
+    void * m_object;
+    Ops const * m_ops;
+
+    unsigned
+    get_bits() const noexcept
+    {
+      return m_ops->m_get_bits(m_object);
+    }
+
+    void
+    set_bits(unsigned const p_bits) const noexcept
+    {
+      m_ops->m_set_bits(m_object, p_bits);
+    }
+  };
+
+  // A visited object and its trial count.
+  struct Entry
+  {
+    Node m_node;
+    std::size_t m_count;
+  };
+
+  template<class t_base>
+  struct TypeOps
+  {
+    static std::size_t
+    use_count(void * const p_object) noexcept
+    {
+      return static_cast<std::size_t>(static_cast<t_base *>(p_object)->pntr_use_count());
+    }
+
+    static unsigned
+    get_bits(void * const p_object) noexcept
+    {
+      return static_cast<unsigned>(static_cast<t_base *>(p_object)->pntr_get_cycle_bits());
+    }
+
+    static void
+    set_bits(void * const p_object, unsigned const p_bits) noexcept
+    {
+      using User = typename t_base::PntrDataValueType;
+      static_cast<t_base *>(p_object)->pntr_set_cycle_bits(static_cast<User>(p_bits));
+    }
+
+    static void
+    visit(void * const p_object, CycleCollector & p_collector, VisitCallback const p_callback)
+    {
+      static_cast<t_base *>(p_object)->pntr_visit_children(Visitor{p_collector, p_callback});
+    }
+
+    static void
+    clear(void * const p_object)
+    {
+      static_cast<t_base *>(p_object)->pntr_visit_children(Clear{});
+    }
+
+    static void
+    add_ref(void * const p_object) noexcept
+    {
+      SharedPtr<t_base>(static_cast<t_base *>(p_object), true).detach();
+    }
+
+    static void
+    release(void * const p_object) noexcept
+    {
+      SharedPtr<t_base>(static_cast<t_base *>(p_object), false);
+    }
+
+    static constexpr Ops s_ops{&use_count, &get_bits, &set_bits, &visit, &clear, &add_ref, &release};
+  };
+
+  // Pass the collected children to the callback.
+  struct Visitor
+  {
+    CycleCollector & m_collector;
+    VisitCallback m_callback;
+
+    template<class t_shared>
+    void
+    operator()(SharedPtr<t_shared> & p_child) const
+    {
+      if constexpr (detail::is_cycle_collected<t_shared>)
+      {
+        if (p_child)
+        {
+          m_callback(m_collector, node(p_child.get()));
+        }
+      }
+    }
+  };
+
+  // Release all children.
+  struct Clear
+  {
+    template<class t_shared>
+    void
+    operator()(SharedPtr<t_shared> & p_child) const noexcept
+    {
+      p_child.reset();
+    }
+  };
+
+  CycleCollector() noexcept = default;
+
+  // The remaining roots are leaked if they can't be collected.
+  ~CycleCollector()
+  {
+    try
+    {
+      collect();
+    }
+    catch (...)
+    {
+      PNTR_LOG_ERROR("Can't collect the remaining roots at thread exit");
+    }
+    exited() = true;
+  }
+
+  // Return true if the collector of the current thread has been destroyed.
+  static bool &
+  exited() noexcept
+  {
+    static thread_local bool s_exited = false;
+    return s_exited;
+  }
+
+  template<class t_shared>
+  static Node
+  node(t_shared * const p_shared) noexcept
+  {
+    using Base = std::remove_const_t<detail::BaseType<t_shared>>;
+    return Node{const_cast<Base *>(static_cast<detail::BaseType<t_shared> *>(p_shared)), &TypeOps<Base>::s_ops};
+  }
+
+  // Move the reference to the buffer if the object is a possible root of a garbage cycle.
+  template<class t_base>
+  bool
+  buffer(t_base * const p_base) noexcept
+  {
+    Node const root = node(p_base);
+    unsigned const bits = root.get_bits();
+    if (m_releasing || (bits & s_buffered) != 0u || (bits & s_color_mask) == s_white || p_base->pntr_use_count() <= 1u)
+    {
+      return false;
+    }
+    try
+    {
+      m_roots.push_back(root);
+    }
+    catch (...)
+    {
+      return false;
+    }
+    root.set_bits(bits | s_buffered);
+    return true;
+  }
+
+  std::size_t
+  add(Node const & p_node)
+  {
+    // The reference of the buffer to a root of the batch is not an internal reference.
+    unsigned const bits = p_node.get_bits();
+    std::size_t const count = p_node.m_ops->m_use_count(p_node.m_object) - ((bits & s_buffered) != 0u ? 1u : 0u);
+    std::size_t const index = m_visited.size();
+    m_visited.push_back(Entry{p_node, count});
+    m_index.emplace(p_node.m_object, index);
+    p_node.set_bits((bits & ~s_color_mask) | s_gray);
+    return index;
+  }
+
+  // Return the index of a visited object, or 'm_visited.size()' if it was skipped.
+  std::size_t
+  find(Node const & p_node) const
+  {
+    auto const found = m_index.find(p_node.m_object);
+    return (found == m_index.end() ? m_visited.size() : found->second);
+  }
+
+  // Subtract the internal references of all objects reachable from the roots of the batch from
+  // their trial counts. Objects which are buffered for a later batch are alive, so they and their
+  // children are skipped, and their cycles are found later. Return false as soon as more objects
+  // than the limit have been visited.
+  bool
+  mark_gray(std::size_t const p_limit)
+  {
+    for (Node const & root: m_batch)
+    {
+      if ((root.get_bits() & s_color_mask) != s_purple)
+      {
+        continue;
+      }
+      m_stack.push_back(add(root));
+      while (!m_stack.empty())
+      {
+        if (m_visited.size() > p_limit)
+        {
+          m_stack.clear();
+          return false;
+        }
+        Node const node = m_visited[m_stack.back()].m_node;
+        m_stack.pop_back();
+        node.m_ops->m_visit(node.m_object, *this, [](CycleCollector & p_self, Node const & p_child) {
+          std::size_t child = p_self.find(p_child);
+          if (child == p_self.m_visited.size())
+          {
+            unsigned const bits = p_child.get_bits();
+            if ((bits & s_buffered) != 0u && (bits & s_color_mask) != s_purple)
+            {
+              return;
+            }
+            child = p_self.add(p_child);
+            p_self.m_stack.push_back(child);
+          }
+          --p_self.m_visited[child].m_count;
+        });
+      }
+    }
+    return true;
+  }
+
+  // Drop the trial counts of an abandoned batch, reset the colors of the visited objects, and
+  // buffer the roots of the batch again. The usage counters haven't been modified.
+  void
+  abandon()
+  {
+    for (Entry const & entry: m_visited)
+    {
+      entry.m_node.set_bits(entry.m_node.get_bits() & s_buffered);
+    }
+    for (Node const & root: m_batch)
+    {
+      root.set_bits(s_buffered);
+      m_roots.push_back(root);
+    }
+    m_visited.clear();
+    m_index.clear();
+  }
+
+  // Color the objects white if they are only referenced by garbage, and black otherwise.
+  void
+  scan()
+  {
+    for (Node const & root: m_batch)
+    {
+      m_stack.push_back(find(root));
+    }
+    while (!m_stack.empty())
+    {
+      Entry const & entry = m_visited[m_stack.back()];
+      m_stack.pop_back();
+      if ((entry.m_node.get_bits() & s_color_mask) != s_gray)
+      {
+        continue;
+      }
+      if (entry.m_count > 0u)
+      {
+        scan_black(entry.m_node);
+        continue;
+      }
+      entry.m_node.set_bits((entry.m_node.get_bits() & ~s_color_mask) | s_white);
+      entry.m_node.m_ops->m_visit(entry.m_node.m_object, *this, [](CycleCollector & p_self, Node const & p_child) {
+        std::size_t const child = p_self.find(p_child);
+        if (child != p_self.m_visited.size())
+        {
+          p_self.m_stack.push_back(child);
+        }
+      });
+    }
+  }
+
+  // Restore the trial counts of all objects reachable from a live object.
+  void
+  scan_black(Node const & p_node)
+  {
+    p_node.set_bits(p_node.get_bits() & ~s_color_mask);
+    m_black.push_back(p_node);
+    while (!m_black.empty())
+    {
+      Node const node = m_black.back();
+      m_black.pop_back();
+      node.m_ops->m_visit(node.m_object, *this, [](CycleCollector & p_self, Node const & p_child) {
+        std::size_t const child = p_self.find(p_child);
+        if (child == p_self.m_visited.size())
+        {
+          return;
+        }
+        ++p_self.m_visited[child].m_count;
+        unsigned const bits = p_child.get_bits();
+        if ((bits & s_color_mask) != s_black)
+        {
+          p_child.set_bits(bits & ~s_color_mask);
+          p_self.m_black.push_back(p_child);
+        }
+      });
+    }
+  }
+
+  // Release the white objects and the buffered references to the roots of the batch.
+  std::size_t
+  collect_white()
+  {
+    m_garbage.clear();
+    for (Entry const & entry: m_visited)
+    {
+      if ((entry.m_node.get_bits() & s_color_mask) == s_white)
+      {
+        entry.m_node.m_ops->m_add_ref(entry.m_node.m_object);
+        m_garbage.push_back(entry.m_node);
+      }
+    }
+    // The live roots aren't buffered again, and the white color prevents buffering the garbage
+    // while its children are released.
+    m_releasing = true;
+    for (Node const & root: m_batch)
+    {
+      root.set_bits(root.get_bits() & s_color_mask);
+      root.m_ops->m_release(root.m_object);
+    }
+    m_releasing = false;
+    for (Node const & node: m_garbage)
+    {
+      node.m_ops->m_clear(node.m_object);
+    }
+    for (Node const & node: m_garbage)
+    {
+      node.m_ops->m_release(node.m_object);
+    }
+    return m_garbage.size();
+  }
+
+  std::deque<Node> m_roots;
+  std::vector<Node> m_batch;
+  std::vector<Entry> m_visited;
+  std::unordered_map<void *, std::size_t> m_index;
+  std::vector<std::size_t> m_stack;
+  std::vector<Node> m_black;
+  std::vector<Node> m_garbage;
+  bool m_releasing{};
+
+  template<class t_shared>
+  friend bool detail::cycle_buffer(t_shared * p_shared) noexcept;
+};
+
+
+namespace detail
+{
+  template<class t_shared>
+  bool
+  cycle_buffer(t_shared * const p_shared) noexcept
+  {
+    return (!CycleCollector::exited() && CycleCollector::local().buffer(p_shared));
+  }
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                    pntr/CounterDeferred.hpp                                    //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <cstddef>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        CounterDeferred                                         //
+//                                                                                                //
+//               An atomic reference counter whose releases are buffered per thread               //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  Selected as the 't_counter' template parameter of 'ControlData', see 'IntruderNewDeferred'.
+//  Each thread logs the releases of its 'SharedPtr' objects in a small local buffer instead of
+//  decrementing the atomic counter. Copying a 'SharedPtr' cancels a logged release of the same
+//  object, so a copy followed by a destruction doesn't touch the shared counter at all. The
+//  remaining releases are applied with 'flush_deferred()', when the buffer is full, or when the
+//  thread exits. All logged releases of an object are applied with a single decrement, and only
+//  then the object is destroyed if its count reaches zero.
+//
+//  Increments that don't cancel a logged release are applied immediately, so the counter is never
+//  lower than the number of owners and other threads can safely share the object. In turn,
+//  'use_count()' includes the releases that are still pending, and released objects live until
+//  the log of the releasing thread is flushed.
+//
+
+template<typename t_value>
+class CounterDeferred: public CounterThreadSafe<t_value>
+{
+public:
+  using Deferred = std::true_type;
+
+  explicit CounterDeferred(t_value const p_init_value) noexcept
+  : CounterThreadSafe<t_value>(p_init_value)
+  {}
+};
+
+
+namespace detail
+{
+  class DeferredLog
+  {
+  public:
+    static constexpr std::size_t s_capacity = 16u;
+
+    // Return the log of the current thread.
+    static DeferredLog &
+    local() noexcept
+    {
+      static thread_local DeferredLog s_local;
+      return s_local;
+    }
+
+    // Return true if the log of the current thread has been destroyed at thread exit.
+    static bool &
+    exited() noexcept
+    {
+      static thread_local bool s_exited = false;
+      return s_exited;
+    }
+
+    // Log the release of the given object. Return false if it has to be released immediately.
+    template<class t_shared>
+    bool
+    release(t_shared * const p_shared) noexcept
+    {
+      void * const key = key_of(p_shared);
+      for (std::size_t i = 0u; i < m_size; ++i)
+      {
+        if (m_entries[i].m_key == key)
+        {
+          ++m_entries[i].m_count;
+          return true;
+        }
+      }
+      if (m_size == s_capacity)
+      {
+        if (m_flushing)
+        {
+          // Releases while flushing a full log are applied immediately to bound the recursion.
+          return false;
+        }
+        flush();
+      }
+      m_entries[m_size++] = Entry{key, const_cast<std::remove_const_t<t_shared> *>(p_shared),
+                                  &SharedPtr<std::remove_const_t<t_shared>>::release_deferred, 1u};
+      return true;
+    }
+
+    // Cancel a logged release of the given object and return true, or return false if none is logged.
+    template<class t_shared>
+    bool
+    cancel(t_shared * const p_shared) noexcept
+    {
+      void * const key = key_of(p_shared);
+      for (std::size_t i = 0u; i < m_size; ++i)
+      {
+        if (m_entries[i].m_key == key)
+        {
+          if (--m_entries[i].m_count == 0u)
+          {
+            m_entries[i] = m_entries[--m_size];
+          }
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Apply all logged releases, including those logged by destructors while flushing.
+    void
+    flush() noexcept
+    {
+      if (m_flushing)
+      {
+        return;
+      }
+      m_flushing = true;
+      while (m_size > 0u)
+      {
+        Entry const entry = m_entries[--m_size];
+        entry.m_release(entry.m_object, entry.m_count);
+      }
+      m_flushing = false;
+    }
+
+    // Return the number of logged entries.
+    std::size_t
+    pending() const noexcept
+    {
+      return m_size;
+    }
+
+  private:
+    struct Entry
+    {
+      void * m_key;
+      void * m_object;
+      void (*m_release)(void *, std::size_t) noexcept;
+      std::size_t m_count;
+    };
+
+    DeferredLog() noexcept = default;
+
+    ~DeferredLog()
+    {
+      flush();
+      exited() = true;
+    }
+
+    // Pointers to different classes of the same object are logged with the address of its base.
+    template<class t_shared>
+    static void *
+    key_of(t_shared * const p_shared) noexcept
+    {
+      return const_cast<std::remove_const_t<BaseType<t_shared>> *>(static_cast<BaseType<t_shared> *>(p_shared));
+    }
+
+    Entry m_entries[s_capacity];
+    std::size_t m_size = 0u;
+    bool m_flushing = false;
+  };
+
+
+  template<class t_shared>
+  bool
+  deferred_release(t_shared * const p_shared) noexcept
+  {
+    return (!DeferredLog::exited() && DeferredLog::local().release(p_shared));
+  }
+
+  template<class t_shared>
+  bool
+  deferred_cancel(t_shared * const p_shared) noexcept
+  {
+    return (!DeferredLog::exited() && DeferredLog::local().cancel(p_shared));
+  }
+} // namespace detail
+
+
+// Apply the deferred releases of the current thread, see 'CounterDeferred'.
+inline void
+flush_deferred() noexcept
+{
+  if (!detail::DeferredLog::exited())
+  {
+    detail::DeferredLog::local().flush();
+  }
+}
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                     pntr/ParallelReset.hpp                                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <iterator>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         parallel_reset                                         //
+//                                                                                                //
+//            Resets a large range of shared pointers on several threads concurrently             //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  The range is partitioned into one chunk per thread of the executor, but not smaller than
+//  's_parallel_reset_chunk' pointers. Each chunk is reset by a task which is passed to the
+//  executor, which is any callable that runs a 'void()' task, like the submit function of a thread
+//  pool or 'ThreadExecutor'. Its number of threads is returned by its member function
+//  'concurrency()', if it has one, otherwise it is the number of hardware threads. If the executor
+//  throws, the task is run by the calling thread. 'parallel_reset' returns when all pointers of
+//  the range have been reset.
+//
+//  The objects whose count reaches zero are disposed by the thread which released them. The
+//  optional predicate 'p_keep' selects the objects which must be destroyed by the calling thread,
+//  for example objects with thread affinity. It is called by the tasks, so it must not throw.
+//  The tasks move those pointers to a list without releasing them, and the calling thread
+//  releases them after all tasks have finished. If a pointer can't be moved to the list, the task
+//  leaves it in the range, and the calling thread resets the remaining pointers of the range.
+//
+
+// The minimum number of pointers in the chunk of one task.
+inline constexpr std::size_t s_parallel_reset_chunk = 16384u;
+
+
+// Runs each task on a new thread, and joins the threads when it is destroyed.
+class ThreadExecutor
+{
+public:
+  explicit ThreadExecutor(std::size_t const p_concurrency = std::thread::hardware_concurrency()) noexcept
+  : m_concurrency(std::max<std::size_t>(1u, p_concurrency))
+  {}
+
+  ThreadExecutor(ThreadExecutor const &) = delete;
+  ThreadExecutor & operator=(ThreadExecutor const &) = delete;
+
+  ~ThreadExecutor()
+  {
+    for (std::thread & thread : m_threads)
+    {
+      thread.join();
+    }
+  }
+
+  // Throws 'std::system_error' if the thread can't be started.
+  template<class t_task>
+  void
+  operator()(t_task && p_task)
+  {
+    m_threads.emplace_back(std::forward<t_task>(p_task));
+  }
+
+  // The number of tasks which the range is partitioned into.
+  std::size_t
+  concurrency() const noexcept
+  {
+    return m_concurrency;
+  }
+
+private:
+  std::size_t m_concurrency;
+  std::vector<std::thread> m_threads;
+};
+
+
+namespace detail
+{
+  template<class t_executor, typename = void>
+  struct ExecutorConcurrency
+  {
+    static std::size_t
+    get(t_executor const &) noexcept
+    {
+      return std::max(1u, std::thread::hardware_concurrency());
+    }
+  };
+
+  template<class t_executor>
+  struct ExecutorConcurrency<t_executor, std::void_t<decltype(std::declval<t_executor const &>().concurrency())>>
+  {
+    static std::size_t
+    get(t_executor const & p_executor) noexcept
+    {
+      return std::max<std::size_t>(1u, p_executor.concurrency());
+    }
+  };
+} // namespace detail
+
+
+template<class t_iterator, class t_executor, class t_keep>
+void
+parallel_reset(t_iterator const p_first, t_iterator const p_last, t_executor && p_executor, t_keep && p_keep)
+{
+  using Pointer = typename std::iterator_traits<t_iterator>::value_type;
+  using Shared = typename Pointer::element_type;
+  static_assert(std::is_nothrow_invocable_v<t_keep &, Shared const &>, "The predicate must be noexcept");
+
+  std::size_t const size = static_cast<std::size_t>(std::distance(p_first, p_last));
+  std::size_t const threads = detail::ExecutorConcurrency<std::remove_reference_t<t_executor>>::get(p_executor);
+  std::size_t const tasks = std::max<std::size_t>(1u, std::min(threads, size / s_parallel_reset_chunk));
+  std::vector<std::vector<Pointer>> kept(tasks);
+
+  std::mutex mutex;
+  std::condition_variable finished;
+  std::size_t remaining = tasks;
+  std::atomic<bool> left{false};
+
+  auto reset = [&](std::size_t const p_task) noexcept
+  {
+    t_iterator const begin = std::next(p_first, static_cast<std::ptrdiff_t>(size * p_task / tasks));
+    t_iterator const end = std::next(p_first, static_cast<std::ptrdiff_t>(size * (p_task + 1u) / tasks));
+    for (t_iterator it = begin; it != end; ++it)
+    {
+      if (*it != nullptr && p_keep(*(*it)))
+      {
+        try
+        {
+          kept[p_task].push_back(std::move(*it));
+        }
+        catch (...) // The object is released by the calling thread
+        {
+          left.store(true, std::memory_order_relaxed);
+          continue;
+        }
+      }
+      it->reset();
+    }
+    if constexpr (detail::is_deferred<Shared>)
+    {
+      flush_deferred();
+    }
+    std::lock_guard<std::mutex> const lock(mutex);
+    if (--remaining == 0u)
+    {
+      finished.notify_one();
+    }
+  };
+
+  // The calling thread resets the first chunk itself.
+  for (std::size_t task = 1u; task < tasks; ++task)
+  {
+    try
+    {
+      p_executor([&reset, task]() noexcept { reset(task); });
+    }
+    catch (...)
+    {
+      reset(task);
+    }
+  }
+  reset(0u);
+
+  std::unique_lock<std::mutex> lock(mutex);
+  finished.wait(lock, [&remaining]() noexcept { return remaining == 0u; });
+  lock.unlock();
+  if (left.load(std::memory_order_relaxed))
+  {
+    std::for_each(p_first, p_last, [](Pointer & p_pointer) noexcept { p_pointer.reset(); });
+  }
+}
+
+
+template<class t_iterator, class t_executor>
+void
+parallel_reset(t_iterator const p_first, t_iterator const p_last, t_executor && p_executor)
+{
+  using Pointer = typename std::iterator_traits<t_iterator>::value_type;
+  parallel_reset(p_first, p_last, std::forward<t_executor>(p_executor),
+                 [](typename Pointer::element_type const &) noexcept { return false; });
+}
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                 pntr/detail/PersistentNode.hpp                                 //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <atomic>
+#include <new>
+
+PNTR_NAMESPACE_BEGIN
+
+
+namespace detail
+{
+  // The nodes of persistent containers don't support weak pointers and are always created with
+  // the shared base at the front, so the whole control value is used for the usage counter.
+  template<class t_thread_safety, typename t_control_value>
+  using PersistentData = std::conditional_t<t_thread_safety::value, ControlData<CounterThreadSafe, t_control_value>,
+                                            ControlData<CounterThreadUnsafe, t_control_value>>;
+
+  template<class t_node, class t_thread_safety, typename t_control_value, class t_allocator>
+  using PersistentIntruder =
+    Intruder<ControlAlloc<t_node, PersistentData<t_thread_safety, t_control_value>, t_allocator>>;
+
+
+  // Return true if the node can be shared without the risk of an overflow of its usage counter.
+  // Thread-safe nodes keep half of the counter range as headroom for concurrent sharing.
+  template<class t_thread_safety, class t_node>
+  inline bool
+  persistent_can_share(t_node const & p_node) noexcept
+  {
+    constexpr auto limit = (t_thread_safety::value ? t_node::pntr_get_max_usage_count() / 2u
+                                                   : t_node::pntr_get_max_usage_count());
+    return (p_node.pntr_use_count() < limit);
+  }
+
+  // Return true if the caller holds the only reference to the node, so it can be modified in place.
+  template<class t_thread_safety, class t_node>
+  inline bool
+  persistent_is_exclusive(t_node const & p_node) noexcept
+  {
+    if (p_node.pntr_use_count() != 1u)
+    {
+      return false;
+    }
+    if constexpr (t_thread_safety::value)
+    {
+      // Synchronize with the release of the last other reference.
+      std::atomic_thread_fence(std::memory_order_acquire);
+    }
+    return true;
+  }
+
+  // Return the number of bits set in the given bitmap.
+  inline unsigned
+  popcount(std::uint32_t p_bitmap) noexcept
+  {
+#if defined(__GNUC__) || defined(__clang__)
+    return static_cast<unsigned>(__builtin_popcount(p_bitmap));
+#else
+    p_bitmap = p_bitmap - ((p_bitmap >> 1u) & 0x55555555u);
+    p_bitmap = (p_bitmap & 0x33333333u) + ((p_bitmap >> 2u) & 0x33333333u);
+    return static_cast<unsigned>((((p_bitmap + (p_bitmap >> 4u)) & 0x0F0F0F0Fu) * 0x01010101u) >> 24u);
+#endif
+  }
+
+  // Round the given size up to a multiple of the given power of two alignment.
+  inline constexpr std::size_t
+  align_up(std::size_t const p_size, std::size_t const p_align) noexcept
+  {
+    return ((p_size + p_align - 1u) & ~(p_align - 1u));
+  }
+} // namespace detail
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                     pntr/PersistentMap.hpp                                     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <array>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                         PersistentMap                                          //
+//                                                                                                //
+//      An immutable hash map with structural sharing, built from intrusive variable-size nodes     //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'PersistentMap' is a compressed hash array mapped trie (CHAMP). Every node uses 5 bits of the
+//  hash value and stores two bitmaps, one for the entries and one for the sub-nodes stored inline
+//  behind the node header, so a node only allocates the memory it actually needs. Keys with equal
+//  hash values end up in collision nodes below the last level. All modifying functions are 'const'
+//  and return a new map which shares all unmodified nodes with the original one.
+//
+//  The nodes derive from 'Intruder' using 'ControlAlloc' without weak, offset, size or alignment
+//  bits, like the nodes of 'PersistentVector'. Because their size varies, they are allocated
+//  directly with the allocator, which therefore has to be an empty class using
+//  'PointerDeallocate', like 'AllocatorMalloc'.
+//
+//  The hash and key equal function objects are default constructed when they are used.
+//
+//  'Transient' is a mutable builder, see 'PersistentVector'.
+//
+
+template<typename t_key,
+         typename t_value,
+         class t_hash = std::hash<t_key>,
+         class t_key_equal = std::equal_to<t_key>,
+         class t_thread_safety = std::true_type,
+         typename t_control_value = std::uint8_t,
+         class t_allocator = AllocatorMalloc<NoStaticSupport>>
+class PersistentMap
+{
+public:
+  using key_type = t_key;
+  using mapped_type = t_value;
+  using value_type = std::pair<t_key, t_value>;
+  using size_type = std::size_t;
+
+private:
+  static_assert(std::is_empty_v<t_allocator> && detail::HasPointerDeallocate<t_allocator>::value,
+                "The nodes are allocated with an empty allocator using 'PointerDeallocate'");
+  static_assert(alignof(value_type) <= alignof(std::max_align_t));
+
+  static constexpr unsigned s_bits = 5u;
+  static constexpr unsigned s_hash_bits = std::numeric_limits<std::size_t>::digits;
+  static constexpr unsigned s_max_depth = (s_hash_bits + s_bits - 1u) / s_bits + 1u;
+
+  class Node;
+  using NodePtr = SharedPtr<Node>;
+
+  // The header of a node, followed by its sub-nodes and entries. Nodes below the last hash level
+  // are collision nodes, which don't use the bitmaps and only store entries.
+  class Node: public detail::PersistentIntruder<Node, t_thread_safety, t_control_value, t_allocator>
+  {
+  public:
+    Node(std::uint32_t const p_datamap, std::uint32_t const p_nodemap, unsigned const p_node_count) noexcept
+    : m_node_count(static_cast<std::uint8_t>(p_node_count))
+    , m_datamap(p_datamap)
+    , m_nodemap(p_nodemap)
+    {
+      for (unsigned i = 0u; i < m_node_count; ++i)
+      {
+        new (children() + i) NodePtr();
+      }
+    }
+
+    ~Node() noexcept
+    {
+      for (unsigned i = 0u; i < m_data_count; ++i)
+      {
+        entries()[i].~value_type();
+      }
+      for (unsigned i = 0u; i < m_node_count; ++i)
+      {
+        children()[i].~NodePtr();
+      }
+    }
+
+    Node(Node const &) = delete;
+    Node & operator=(Node const &) = delete;
+
+    static std::size_t
+    calc_size(unsigned const p_data_count, unsigned const p_node_count) noexcept
+    {
+      return calc_entries_offset(p_node_count) + p_data_count * sizeof(value_type);
+    }
+
+    unsigned
+    data_count() const noexcept
+    {
+      return m_data_count;
+    }
+
+    unsigned
+    node_count() const noexcept
+    {
+      return m_node_count;
+    }
+
+    std::uint32_t
+    datamap() const noexcept
+    {
+      return m_datamap;
+    }
+
+    std::uint32_t
+    nodemap() const noexcept
+    {
+      return m_nodemap;
+    }
+
+    NodePtr *
+    children() noexcept
+    {
+      return std::launder(reinterpret_cast<NodePtr *>(reinterpret_cast<std::byte *>(this) + calc_children_offset()));
+    }
+
+    NodePtr const *
+    children() const noexcept
+    {
+      return std::launder(
+        reinterpret_cast<NodePtr const *>(reinterpret_cast<std::byte const *>(this) + calc_children_offset()));
+    }
+
+    value_type *
+    entries() noexcept
+    {
+      return std::launder(
+        reinterpret_cast<value_type *>(reinterpret_cast<std::byte *>(this) + calc_entries_offset(m_node_count)));
+    }
+
+    value_type const *
+    entries() const noexcept
+    {
+      return std::launder(reinterpret_cast<value_type const *>(reinterpret_cast<std::byte const *>(this)
+                                                               + calc_entries_offset(m_node_count)));
+    }
+
+    // Construct the next entry. The caller has to make sure that there is enough space.
+    template<typename... t_args>
+    void
+    emplace_entry(t_args &&... p_args)
+    {
+      new (reinterpret_cast<std::byte *>(this) + calc_entries_offset(m_node_count) + m_data_count * sizeof(value_type))
+        value_type(std::forward<t_args>(p_args)...);
+      ++m_data_count;
+    }
+
+  private:
+    static constexpr std::size_t
+    calc_entries_offset(unsigned const p_node_count) noexcept
+    {
+      return detail::align_up(calc_children_offset() + p_node_count * sizeof(NodePtr), alignof(value_type));
+    }
+
+    static constexpr std::size_t
+    calc_children_offset() noexcept
+    {
+      return detail::align_up(sizeof(Node), alignof(NodePtr));
+    }
+
+    std::uint8_t m_node_count;
+    std::uint16_t m_data_count{};
+    std::uint32_t m_datamap;
+    std::uint32_t m_nodemap;
+  };
+
+  static constexpr unsigned s_none = std::numeric_limits<unsigned>::max();
+
+  static constexpr std::size_t s_node_align =
+    (alignof(value_type) > alignof(NodePtr) ? alignof(value_type) : alignof(NodePtr));
+
+  // The complete state of a map.
+  struct State
+  {
+    std::size_t m_size{};
+    NodePtr m_root;
+  };
+
+  static std::size_t
+  hash(t_key const & p_key)
+  {
+    return static_cast<std::size_t>(t_hash()(p_key));
+  }
+
+  static std::uint32_t
+  bit_for(std::size_t const p_hash, unsigned const p_shift) noexcept
+  {
+    return std::uint32_t{1u} << ((p_hash >> p_shift) & 31u);
+  }
+
+  static unsigned
+  index_for(std::uint32_t const p_bitmap, std::uint32_t const p_bit) noexcept
+  {
+    return detail::popcount(p_bitmap & (p_bit - 1u));
+  }
+
+  // Share a node, or a copy of it if its usage counter is close to saturation.
+  static NodePtr
+  share(NodePtr const & p_node)
+  {
+    if (!p_node || detail::persistent_can_share<t_thread_safety>(*p_node))
+    {
+      return p_node;
+    }
+    return clone(*p_node);
+  }
+
+  // Allocate a node, take control of it, and let the callback fill in its children and entries.
+  // If the callback throws, the partially filled node is released again.
+  template<class t_fill>
+  static NodePtr
+  create(std::uint32_t const p_datamap, std::uint32_t const p_nodemap, unsigned const p_data_count,
+         unsigned const p_node_count, t_fill && p_fill)
+  {
+    void * const storage = t_allocator().allocate(Node::calc_size(p_data_count, p_node_count), s_node_align);
+    if (storage == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    NodePtr node(new (storage) Node(p_datamap, p_nodemap, p_node_count));
+    p_fill(*node);
+    PNTR_ASSERT(node->data_count() == p_data_count);
+    return node;
+  }
+
+  // Create a copy of a node which shares its children.
+  static NodePtr
+  clone(Node const & p_node)
+  {
+    return create(p_node.datamap(), p_node.nodemap(), p_node.data_count(), p_node.node_count(),
+                  [&p_node](Node & p_new)
+                  {
+                    for (unsigned i = 0u; i < p_node.node_count(); ++i)
+                    {
+                      p_new.children()[i] = share(p_node.children()[i]);
+                    }
+                    for (unsigned i = 0u; i < p_node.data_count(); ++i)
+                    {
+                      p_new.emplace_entry(p_node.entries()[i]);
+                    }
+                  });
+  }
+
+  // Copy or move the entries and children of a node into a new node, skipping and inserting at
+  // most one entry or child. Exclusively owned nodes are moved from, but entries only if that can't
+  // throw. Entries have to be transferred before the children, so the original node stays intact
+  // if creating its replacement fails.
+  class Transfer
+  {
+  public:
+    explicit Transfer(NodePtr & p_node) noexcept
+    : m_node(*p_node)
+    , m_exclusive(detail::persistent_is_exclusive<t_thread_safety>(*p_node))
+    , m_move_entries(m_exclusive && std::is_nothrow_move_constructible_v<value_type>)
+    {}
+
+    bool
+    move_entries() const noexcept
+    {
+      return m_move_entries;
+    }
+
+    void
+    entries(Node & p_new, unsigned const p_skip) const
+    {
+      entries(p_new, p_skip, s_none, nullptr);
+    }
+
+    // The inserted entry is moved if it is an rvalue. Passing 'nullptr' doesn't insert an entry.
+    template<class t_entry>
+    void
+    entries(Node & p_new, unsigned const p_skip, unsigned const p_insert, t_entry && p_entry) const
+    {
+      for (unsigned i = 0u; i <= m_node.data_count(); ++i)
+      {
+        if constexpr (!std::is_null_pointer_v<std::decay_t<t_entry>>)
+        {
+          if (i == p_insert)
+          {
+            p_new.emplace_entry(std::forward<t_entry>(p_entry));
+          }
+        }
+        if (i < m_node.data_count() && i != p_skip)
+        {
+          if (m_move_entries)
+          {
+            p_new.emplace_entry(std::move(m_node.entries()[i]));
+          }
+          else
+          {
+            p_new.emplace_entry(m_node.entries()[i]);
+          }
+        }
+      }
+    }
+
+    void
+    children(Node & p_new,
+             unsigned const p_skip,
+             unsigned const p_insert = s_none,
+             NodePtr && p_child = NodePtr()) const
+    {
+      unsigned target = 0u;
+      for (unsigned i = 0u; i <= m_node.node_count(); ++i)
+      {
+        if (i == p_insert)
+        {
+          p_new.children()[target++] = std::move(p_child);
+        }
+        if (i < m_node.node_count() && i != p_skip)
+        {
+          p_new.children()[target++] = (m_exclusive ? std::move(m_node.children()[i]) : share(m_node.children()[i]));
+        }
+      }
+    }
+
+  private:
+    Node & m_node;
+    bool const m_exclusive;
+    bool const m_move_entries;
+  };
+
+  // Return a reference to a node which can be modified in place, copying it if it is shared.
+  static Node &
+  edit(NodePtr & p_node)
+  {
+    if (!detail::persistent_is_exclusive<t_thread_safety>(*p_node))
+    {
+      p_node = clone(*p_node);
+    }
+    return *p_node;
+  }
+
+  // Create a node storing a copy of the existing entry and the new entry, or a chain of nodes down
+  // to the level where their hash values differ.
+  static NodePtr
+  merge(unsigned const p_shift, value_type const & p_entry, std::size_t const p_entry_hash, value_type && p_new_entry,
+        std::size_t const p_hash)
+  {
+    if (p_shift >= s_hash_bits)
+    {
+      return create(0u, 0u, 2u, 0u,
+                    [&](Node & p_new)
+                    {
+                      p_new.emplace_entry(p_entry);
+                      p_new.emplace_entry(std::move(p_new_entry));
+                    });
+    }
+    std::uint32_t const entry_bit = bit_for(p_entry_hash, p_shift);
+    std::uint32_t const bit = bit_for(p_hash, p_shift);
+    if (entry_bit == bit)
+    {
+      NodePtr child = merge(p_shift + s_bits, p_entry, p_entry_hash, std::move(p_new_entry), p_hash);
+      return create(0u, bit, 0u, 1u,
+                    [&child](Node & p_new)
+                    {
+                      p_new.children()[0u] = std::move(child);
+                    });
+    }
+    return create(entry_bit | bit, 0u, 2u, 0u,
+                  [&](Node & p_new)
+                  {
+                    if (entry_bit < bit)
+                    {
+                      p_new.emplace_entry(p_entry);
+                      p_new.emplace_entry(std::move(p_new_entry));
+                    }
+                    else
+                    {
+                      p_new.emplace_entry(std::move(p_new_entry));
+                      p_new.emplace_entry(p_entry);
+                    }
+                  });
+  }
+
+  static value_type const *
+  find(State const & p_state, t_key const & p_key)
+  {
+    if (!p_state.m_root)
+    {
+      return nullptr;
+    }
+    std::size_t const key_hash = hash(p_key);
+    Node const * node = p_state.m_root.get();
+    for (unsigned shift = 0u;; shift += s_bits)
+    {
+      if (shift >= s_hash_bits)
+      {
+        for (unsigned i = 0u; i < node->data_count(); ++i)
+        {
+          if (t_key_equal()(node->entries()[i].first, p_key))
+          {
+            return &node->entries()[i];
+          }
+        }
+        return nullptr;
+      }
+      std::uint32_t const bit = bit_for(key_hash, shift);
+      if ((node->datamap() & bit) != 0u)
+      {
+        value_type const & entry = node->entries()[index_for(node->datamap(), bit)];
+        return (t_key_equal()(entry.first, p_key) ? &entry : nullptr);
+      }
+      if ((node->nodemap() & bit) == 0u)
+      {
+        return nullptr;
+      }
+      node = node->children()[index_for(node->nodemap(), bit)].get();
+    }
+  }
+
+  // The modifying algorithms, which are shared by persistent maps and transients, see
+  // 'PersistentVector'.
+  struct Modifier: State
+  {
+    Modifier() noexcept = default;
+
+    Modifier(State && p_state) noexcept
+    : State(std::move(p_state))
+    {}
+
+    // Insert or assign a value and return true if the key was inserted.
+    template<typename t_forward_key, typename t_forward_value>
+    bool
+    set(t_forward_key && p_key, t_forward_value && p_value)
+    {
+      value_type const * const entry = find(*this, p_key);
+      if (entry != nullptr)
+      {
+        assign(this->m_root, 0u, hash(entry->first), entry->first, std::forward<t_forward_value>(p_value));
+        return false;
+      }
+      value_type new_entry(std::forward<t_forward_key>(p_key), std::forward<t_forward_value>(p_value));
+      std::size_t const key_hash = hash(new_entry.first);
+      if (!this->m_root)
+      {
+        this->m_root = create(bit_for(key_hash, 0u), 0u, 1u, 0u,
+                              [&new_entry](Node & p_new)
+                              {
+                                p_new.emplace_entry(std::move(new_entry));
+                              });
+      }
+      else
+      {
+        insert(this->m_root, 0u, key_hash, std::move(new_entry));
+      }
+      ++this->m_size;
+      return true;
+    }
+
+    // Remove a key and return true if it was found.
+    bool
+    erase(t_key const & p_key)
+    {
+      if (find(*this, p_key) == nullptr)
+      {
+        return false;
+      }
+      erase(this->m_root, 0u, hash(p_key), p_key);
+      Node const & root = *this->m_root;
+      if (root.data_count() == 0u && root.node_count() == 0u)
+      {
+        this->m_root.reset();
+      }
+      --this->m_size;
+      return true;
+    }
+
+  private:
+    // Assign a value to a key, which has to exist below the given node.
+    template<typename t_forward_value>
+    static void
+    assign(NodePtr & p_node, unsigned const p_shift, std::size_t const p_hash, t_key const & p_key,
+           t_forward_value && p_value)
+    {
+      Node & node = edit(p_node);
+      if (p_shift >= s_hash_bits)
+      {
+        for (unsigned i = 0u; i < node.data_count(); ++i)
+        {
+          if (t_key_equal()(node.entries()[i].first, p_key))
+          {
+            node.entries()[i].second = std::forward<t_forward_value>(p_value);
+            return;
+          }
+        }
+        return;
+      }
+      std::uint32_t const bit = bit_for(p_hash, p_shift);
+      if ((node.datamap() & bit) != 0u)
+      {
+        node.entries()[index_for(node.datamap(), bit)].second = std::forward<t_forward_value>(p_value);
+        return;
+      }
+      assign(node.children()[index_for(node.nodemap(), bit)], p_shift + s_bits, p_hash, p_key,
+             std::forward<t_forward_value>(p_value));
+    }
+
+    // Insert an entry with a key which doesn't exist yet below the given node.
+    static void
+    insert(NodePtr & p_node, unsigned const p_shift, std::size_t const p_hash, value_type && p_entry)
+    {
+      Node & node = *p_node;
+      if (p_shift >= s_hash_bits)
+      {
+        Transfer const transfer(p_node);
+        p_node = create(0u, 0u, node.data_count() + 1u, 0u,
+                        [&](Node & p_new)
+                        {
+                          transfer.entries(p_new, s_none, node.data_count(), std::move(p_entry));
+                        });
+        return;
+      }
+      std::uint32_t const bit = bit_for(p_hash, p_shift);
+      if ((node.datamap() & bit) != 0u)
+      {
+        // Replace the existing entry with a sub-node storing both entries.
+        unsigned const index = index_for(node.datamap(), bit);
+        value_type const & entry = node.entries()[index];
+        NodePtr child = merge(p_shift + s_bits, entry, hash(entry.first), std::move(p_entry), p_hash);
+        Transfer const transfer(p_node);
+        p_node = create(node.datamap() & ~bit, node.nodemap() | bit, node.data_count() - 1u, node.node_count() + 1u,
+                        [&](Node & p_new)
+                        {
+                          transfer.entries(p_new, index);
+                          transfer.children(p_new, s_none, index_for(node.nodemap(), bit), std::move(child));
+                        });
+        return;
+      }
+      if ((node.nodemap() & bit) != 0u)
+      {
+        Node & editable = edit(p_node);
+        insert(editable.children()[index_for(editable.nodemap(), bit)], p_shift + s_bits, p_hash, std::move(p_entry));
+        return;
+      }
+      Transfer const transfer(p_node);
+      p_node = create(node.datamap() | bit, node.nodemap(), node.data_count() + 1u, node.node_count(),
+                      [&](Node & p_new)
+                      {
+                        transfer.entries(p_new, s_none, index_for(node.datamap(), bit), std::move(p_entry));
+                        transfer.children(p_new, s_none);
+                      });
+    }
+
+    // Remove a key, which has to exist below the given node.
+    static void
+    erase(NodePtr & p_node, unsigned const p_shift, std::size_t const p_hash, t_key const & p_key)
+    {
+      Node & node = *p_node;
+      if (p_shift >= s_hash_bits)
+      {
+        unsigned index = 0u;
+        while (!t_key_equal()(node.entries()[index].first, p_key))
+        {
+          ++index;
+        }
+        Transfer const transfer(p_node);
+        p_node = create(0u, 0u, node.data_count() - 1u, 0u,
+                        [&](Node & p_new)
+                        {
+                          transfer.entries(p_new, index);
+                        });
+        return;
+      }
+      std::uint32_t const bit = bit_for(p_hash, p_shift);
+      if ((node.datamap() & bit) != 0u)
+      {
+        unsigned const index = index_for(node.datamap(), bit);
+        Transfer const transfer(p_node);
+        p_node = create(node.datamap() & ~bit, node.nodemap(), node.data_count() - 1u, node.node_count(),
+                        [&](Node & p_new)
+                        {
+                          transfer.entries(p_new, index);
+                          transfer.children(p_new, s_none);
+                        });
+        return;
+      }
+      Node & editable = edit(p_node);
+      unsigned const child_index = index_for(editable.nodemap(), bit);
+      NodePtr & child = editable.children()[child_index];
+      erase(child, p_shift + s_bits, p_hash, p_key);
+
+      // Keep the trie canonical by pulling a single remaining entry of a sub-node up.
+      if (child->data_count() != 1u || child->node_count() != 0u)
+      {
+        return;
+      }
+      Transfer const transfer(p_node);
+      Transfer const child_transfer(child);
+      unsigned const insert = index_for(editable.datamap(), bit);
+      p_node = create(editable.datamap() | bit, editable.nodemap() & ~bit, editable.data_count() + 1u,
+                      editable.node_count() - 1u,
+                      [&](Node & p_new)
+                      {
+                        if (child_transfer.move_entries())
+                        {
+                          transfer.entries(p_new, s_none, insert, std::move(child->entries()[0u]));
+                        }
+                        else
+                        {
+                          transfer.entries(p_new, s_none, insert, std::as_const(child->entries()[0u]));
+                        }
+                        transfer.children(p_new, child_index);
+                      });
+    }
+  };
+
+public:
+  class Transient;
+
+  // A forward iterator, which visits the entries of each node before its sub-nodes.
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = typename PersistentMap::value_type;
+    using difference_type = std::ptrdiff_t;
+    using pointer = value_type const *;
+    using reference = value_type const &;
+
+    const_iterator() noexcept = default;
+
+    reference
+    operator*() const noexcept
+    {
+      return *m_current;
+    }
+
+    pointer
+    operator->() const noexcept
+    {
+      return m_current;
+    }
+
+    const_iterator &
+    operator++() noexcept
+    {
+      advance();
+      return *this;
+    }
+
+    const_iterator
+    operator++(int) noexcept
+    {
+      const_iterator result(*this);
+      advance();
+      return result;
+    }
+
+    friend bool
+    operator==(const_iterator const & p_left, const_iterator const & p_right) noexcept
+    {
+      return (p_left.m_current == p_right.m_current);
+    }
+
+    friend bool
+    operator!=(const_iterator const & p_left, const_iterator const & p_right) noexcept
+    {
+      return (p_left.m_current != p_right.m_current);
+    }
+
+  private:
+    struct Frame
+    {
+      Node const * m_node;
+      unsigned m_entry;
+      unsigned m_child;
+    };
+
+    explicit const_iterator(Node const * const p_root) noexcept
+    {
+      if (p_root != nullptr)
+      {
+        m_stack[0u] = Frame{p_root, 0u, 0u};
+        m_depth = 1u;
+        advance();
+      }
+    }
+
+    void
+    advance() noexcept
+    {
+      m_current = nullptr;
+      while (m_depth > 0u)
+      {
+        Frame & frame = m_stack[m_depth - 1u];
+        if (frame.m_entry < frame.m_node->data_count())
+        {
+          m_current = &frame.m_node->entries()[frame.m_entry++];
+          return;
+        }
+        if (frame.m_child < frame.m_node->node_count())
+        {
+          m_stack[m_depth++] = Frame{frame.m_node->children()[frame.m_child++].get(), 0u, 0u};
+        }
+        else
+        {
+          --m_depth;
+        }
+      }
+    }
+
+    std::array<Frame, s_max_depth> m_stack{};
+    unsigned m_depth{};
+    value_type const * m_current{};
+
+    friend class PersistentMap;
+  };
+
+  using iterator = const_iterator;
+
+  PersistentMap() noexcept = default;
+
+  PersistentMap(std::initializer_list<value_type> p_values)
+  {
+    Transient transient;
+    for (value_type const & value: p_values)
+    {
+      transient.set(value.first, value.second);
+    }
+    *this = std::move(transient).persistent();
+  }
+
+  PersistentMap(PersistentMap const & p_other)
+  : m_state(copy(p_other.m_state))
+  {}
+
+  PersistentMap(PersistentMap && p_other) noexcept
+  : m_state(std::exchange(p_other.m_state, State()))
+  {}
+
+  PersistentMap &
+  operator=(PersistentMap const & p_other)
+  {
+    PersistentMap(p_other).swap(*this);
+    return *this;
+  }
+
+  PersistentMap &
+  operator=(PersistentMap && p_other) noexcept
+  {
+    PersistentMap(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  size_type
+  size() const noexcept
+  {
+    return m_state.m_size;
+  }
+
+  bool
+  empty() const noexcept
+  {
+    return (m_state.m_size == 0u);
+  }
+
+  // Return a pointer to the value of the given key, or nullptr if it doesn't exist.
+  t_value const *
+  find(t_key const & p_key) const
+  {
+    value_type const * const entry = find(m_state, p_key);
+    return (entry != nullptr ? &entry->second : nullptr);
+  }
+
+  bool
+  contains(t_key const & p_key) const
+  {
+    return (find(m_state, p_key) != nullptr);
+  }
+
+  t_value const &
+  at(t_key const & p_key) const
+  {
+    value_type const * const entry = find(m_state, p_key);
+    if (entry == nullptr)
+    {
+      throw std::out_of_range("PersistentMap::at");
+    }
+    return entry->second;
+  }
+
+  const_iterator
+  begin() const noexcept
+  {
+    return const_iterator(m_state.m_root.get());
+  }
+
+  const_iterator
+  end() const noexcept
+  {
+    return const_iterator();
+  }
+
+  // Return a map with the given value inserted or assigned.
+  template<typename t_forward_key, typename t_forward_value>
+  PersistentMap
+  set(t_forward_key && p_key, t_forward_value && p_value) const
+  {
+    PersistentMap result(*this);
+    result.m_state.set(std::forward<t_forward_key>(p_key), std::forward<t_forward_value>(p_value));
+    return result;
+  }
+
+  // Return a map without the given key.
+  PersistentMap
+  erase(t_key const & p_key) const
+  {
+    if (!contains(p_key))
+    {
+      return *this;
+    }
+    PersistentMap result(*this);
+    result.m_state.erase(p_key);
+    return result;
+  }
+
+  // Return a mutable builder which starts with the entries of this map.
+  Transient
+  transient() const
+  {
+    return Transient(*this);
+  }
+
+  void
+  swap(PersistentMap & p_other) noexcept
+  {
+    std::swap(m_state.m_size, p_other.m_state.m_size);
+    m_state.m_root.swap(p_other.m_state.m_root);
+  }
+
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //                                         Transient                                          //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  class Transient
+  {
+  public:
+    Transient() noexcept = default;
+
+    explicit Transient(PersistentMap const & p_map)
+    : m_state(copy(p_map.m_state))
+    {}
+
+    Transient(Transient && p_other) noexcept
+    : m_state(std::exchange(p_other.m_state, State()))
+    {}
+
+    Transient &
+    operator=(Transient && p_other) noexcept
+    {
+      m_state = std::exchange(p_other.m_state, State());
+      return *this;
+    }
+
+    Transient(Transient const &) = delete;
+    Transient & operator=(Transient const &) = delete;
+
+    size_type
+    size() const noexcept
+    {
+      return m_state.m_size;
+    }
+
+    bool
+    empty() const noexcept
+    {
+      return (m_state.m_size == 0u);
+    }
+
+    t_value const *
+    find(t_key const & p_key) const
+    {
+      value_type const * const entry = PersistentMap::find(m_state, p_key);
+      return (entry != nullptr ? &entry->second : nullptr);
+    }
+
+    // Insert or assign a value and return true if the key was inserted.
+    template<typename t_forward_key, typename t_forward_value>
+    bool
+    set(t_forward_key && p_key, t_forward_value && p_value)
+    {
+      return m_state.set(std::forward<t_forward_key>(p_key), std::forward<t_forward_value>(p_value));
+    }
+
+    // Remove a key and return true if it was found.
+    bool
+    erase(t_key const & p_key)
+    {
+      return m_state.erase(p_key);
+    }
+
+    // Return a persistent map with the entries of this builder, which is empty afterwards.
+    PersistentMap
+    persistent() &&
+    {
+      PersistentMap result;
+      result.m_state = std::exchange(m_state, State());
+      return result;
+    }
+
+  private:
+    Modifier m_state;
+  };
+
+private:
+  static State
+  copy(State const & p_state)
+  {
+    return State{p_state.m_size, share(p_state.m_root)};
   }
 
-  ~WeakPtr() noexcept
+  Modifier m_state;
+};
+
+
+PNTR_NAMESPACE_END
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                   pntr/PersistentVector.hpp                                    //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+#include <initializer_list>
+#include <iterator>
+#include <stdexcept>
+
+PNTR_NAMESPACE_BEGIN
+
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+//                                                                                                //
+//                                        PersistentVector                                        //
+//                                                                                                //
+//          An immutable vector with structural sharing, built from intrusive tree nodes          //
+//                                                                                                //
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+//
+//  'PersistentVector' is a bit-partitioned vector trie with a branching factor of 32 and a separate
+//  tail leaf, as popularized by Clojure. All modifying functions are 'const' and return a new
+//  vector which shares all unmodified nodes with the original one, so copies are cheap and
+//  different versions can be used safely from different threads if 't_thread_safety' is
+//  'std::true_type'.
+//
+//  The tree nodes derive from 'Intruder' using 'ControlAlloc' without weak, offset, size or
+//  alignment bits, so the control block is just a usage counter of type 't_control_value'. The
+//  default of 'std::uint8_t' adds only one byte per node. A node whose counter gets close to its
+//  maximum is copied instead of being shared, so small counters can't overflow.
+//
+//  'Transient' is a mutable builder, which modifies nodes in place as long as it holds the only
+//  reference to them. Nodes which are shared with other vectors are copied on the first write,
+//  so a transient never modifies a node which is visible through a persistent vector.
+//
+
+template<typename t_value,
+         class t_thread_safety = std::true_type,
+         typename t_control_value = std::uint8_t,
+         class t_allocator = AllocatorMalloc<NoStaticSupport>>
+class PersistentVector
+{
+  static constexpr unsigned s_bits = 5u;
+  static constexpr std::size_t s_width = std::size_t{1u} << s_bits;
+  static constexpr std::size_t s_mask = s_width - 1u;
+
+  class Leaf;
+  class Branch;
+  using LeafPtr = SharedPtr<Leaf>;
+  using BranchPtr = SharedPtr<Branch>;
+
+  // A leaf stores up to 's_width' values.
+  class Leaf: public detail::PersistentIntruder<Leaf, t_thread_safety, t_control_value, t_allocator>
   {
-    if (m_control != nullptr && m_control->weak_release())
+  public:
+    Leaf() noexcept = default;
+
+    // Delegating to the default constructor makes sure that the destructor is called on exceptions.
+    Leaf(Leaf const & p_other)
+    : Leaf()
+    {
+      for (; m_size < p_other.m_size; ++m_size)
+      {
+        new (data() + m_size) t_value(p_other.data()[m_size]);
+      }
+    }
+
+    ~Leaf() noexcept
+    {
+      clear();
+    }
+
+    Leaf & operator=(Leaf const &) = delete;
+
+    t_value *
+    data() noexcept
+    {
+      return std::launder(reinterpret_cast<t_value *>(&m_storage));
+    }
+
+    t_value const *
+    data() const noexcept
+    {
+      return std::launder(reinterpret_cast<t_value const *>(&m_storage));
+    }
+
+    template<typename... t_args>
+    void
+    emplace_back(t_args &&... p_args)
+    {
+      PNTR_ASSERT(m_size < s_width);
+      new (data() + m_size) t_value(std::forward<t_args>(p_args)...);
+      ++m_size;
+    }
+
+    void
+    pop_back() noexcept
+    {
+      --m_size;
+      data()[m_size].~t_value();
+    }
+
+  private:
+    void
+    clear() noexcept
+    {
+      while (m_size > 0u)
+      {
+        pop_back();
+      }
+    }
+
+    std::uint8_t m_size{};
+    alignas(t_value) std::byte m_storage[s_width * sizeof(t_value)];
+  };
+
+  // A branch stores up to 's_width' children, which are either all leaves or all branches.
+  class Branch: public detail::PersistentIntruder<Branch, t_thread_safety, t_control_value, t_allocator>
+  {
+  public:
+    explicit Branch(bool const p_leaves) noexcept
+    : m_leaves(p_leaves)
+    {
+      // The storage is sized for leaf pointers, which have to match branch pointers.
+      static_assert(sizeof(LeafPtr) == sizeof(BranchPtr) && alignof(LeafPtr) == alignof(BranchPtr));
+      for (std::size_t i = 0u; i < s_width; ++i)
+      {
+        if (m_leaves)
+        {
+          new (reinterpret_cast<LeafPtr *>(&m_storage) + i) LeafPtr();
+        }
+        else
+        {
+          new (reinterpret_cast<BranchPtr *>(&m_storage) + i) BranchPtr();
+        }
+      }
+    }
+
+    Branch(Branch const & p_other)
+    : Branch(p_other.m_leaves)
+    {
+      for (std::size_t i = 0u; i < s_width; ++i)
+      {
+        if (m_leaves)
+        {
+          leaf(i) = share(p_other.leaf(i));
+        }
+        else
+        {
+          branch(i) = share(p_other.branch(i));
+        }
+      }
+    }
+
+    ~Branch() noexcept
+    {
+      for (std::size_t i = 0u; i < s_width; ++i)
+      {
+        if (m_leaves)
+        {
+          leaf(i).~LeafPtr();
+        }
+        else
+        {
+          branch(i).~BranchPtr();
+        }
+      }
+    }
+
+    Branch & operator=(Branch const &) = delete;
+
+    LeafPtr &
+    leaf(std::size_t const p_index) noexcept
+    {
+      return std::launder(reinterpret_cast<LeafPtr *>(&m_storage))[p_index];
+    }
+
+    LeafPtr const &
+    leaf(std::size_t const p_index) const noexcept
+    {
+      return std::launder(reinterpret_cast<LeafPtr const *>(&m_storage))[p_index];
+    }
+
+    BranchPtr &
+    branch(std::size_t const p_index) noexcept
+    {
+      return std::launder(reinterpret_cast<BranchPtr *>(&m_storage))[p_index];
+    }
+
+    BranchPtr const &
+    branch(std::size_t const p_index) const noexcept
+    {
+      return std::launder(reinterpret_cast<BranchPtr const *>(&m_storage))[p_index];
+    }
+
+  private:
+    bool const m_leaves;
+    alignas(LeafPtr) std::byte m_storage[s_width * sizeof(LeafPtr)];
+  };
+
+  // The complete state of a vector. The last 1 to 's_width' values are stored in the tail leaf,
+  // all others in the tree below the root branch.
+  struct State
+  {
+    std::size_t m_size{};
+    unsigned m_shift{s_bits};
+    BranchPtr m_root;
+    LeafPtr m_tail;
+  };
+
+  // The modifying algorithms, which are shared by persistent vectors and transients. They work in
+  // place on exclusively owned nodes and copy all others, so a persistent vector only has to copy
+  // its state before applying them. On exceptions the state remains valid and unchanged, though
+  // some of its nodes might have been replaced by copies.
+  struct Modifier: State
+  {
+    Modifier() noexcept = default;
+
+    Modifier(State && p_state) noexcept
+    : State(std::move(p_state))
+    {}
+
+    template<typename... t_args>
+    void
+    emplace_back(t_args &&... p_args)
+    {
+      std::size_t const tail_size = this->m_size - tail_offset(this->m_size);
+      if (!this->m_tail)
+      {
+        LeafPtr tail = allocate_shared<Leaf>(t_allocator());
+        tail->emplace_back(std::forward<t_args>(p_args)...);
+        this->m_tail = std::move(tail);
+      }
+      else if (tail_size < s_width)
+      {
+        edit(this->m_tail).emplace_back(std::forward<t_args>(p_args)...);
+      }
+      else
+      {
+        LeafPtr tail = allocate_shared<Leaf>(t_allocator());
+        tail->emplace_back(std::forward<t_args>(p_args)...);
+        push_full_tail();
+        this->m_tail = std::move(tail);
+      }
+      ++this->m_size;
+    }
+
+    template<typename t_forward>
+    void
+    set(std::size_t const p_index, t_forward && p_value)
+    {
+      PNTR_ASSERT(p_index < this->m_size);
+      if (p_index >= tail_offset(this->m_size))
+      {
+        edit(this->m_tail).data()[p_index & s_mask] = std::forward<t_forward>(p_value);
+        return;
+      }
+      Branch * node = &edit(this->m_root);
+      for (unsigned level = this->m_shift; level > s_bits; level -= s_bits)
+      {
+        node = &edit(node->branch((p_index >> level) & s_mask));
+      }
+      edit(node->leaf((p_index >> s_bits) & s_mask)).data()[p_index & s_mask] = std::forward<t_forward>(p_value);
+    }
+
+    void
+    pop_back()
+    {
+      PNTR_ASSERT(this->m_size > 0u);
+      if (this->m_size == 1u)
+      {
+        static_cast<State &>(*this) = State();
+      }
+      else if (this->m_size - tail_offset(this->m_size) > 1u)
+      {
+        edit(this->m_tail).pop_back();
+        --this->m_size;
+      }
+      else
+      {
+        // The tail holds just one value, so the last leaf of the tree becomes the new tail.
+        LeafPtr tail = share(leaf_ptr_for(*this, this->m_size - 2u));
+        if (pop_tail(this->m_root, this->m_shift, this->m_size - 2u))
+        {
+          this->m_root.reset();
+          this->m_shift = s_bits;
+        }
+        else if (this->m_shift > s_bits && !this->m_root->branch(1u))
+        {
+          BranchPtr root = share(this->m_root->branch(0u));
+          this->m_root = std::move(root);
+          this->m_shift -= s_bits;
+        }
+        this->m_tail = std::move(tail);
+        --this->m_size;
+      }
+    }
+
+  private:
+    // Move the full tail into the tree, adding a new root level if the tree is full.
+    void
+    push_full_tail()
+    {
+      std::size_t const index = this->m_size - 1u;
+      if (!this->m_root)
+      {
+        BranchPtr root = allocate_shared<Branch>(t_allocator(), true);
+        root->leaf(0u) = std::move(this->m_tail);
+        this->m_root = std::move(root);
+      }
+      else if ((this->m_size >> s_bits) > (std::size_t{1u} << this->m_shift))
+      {
+        BranchPtr root = allocate_shared<Branch>(t_allocator(), false);
+        LeafPtr * slot = nullptr;
+        root->branch(1u) = new_path(this->m_shift, slot);
+        *slot = std::move(this->m_tail);
+        root->branch(0u) = std::move(this->m_root);
+        this->m_root = std::move(root);
+        this->m_shift += s_bits;
+      }
+      else
+      {
+        push_tail(this->m_root, this->m_shift, index, this->m_tail);
+      }
+    }
+  };
+
+public:
+  using value_type = t_value;
+  using size_type = std::size_t;
+  using difference_type = std::ptrdiff_t;
+  using reference = t_value const &;
+  using const_reference = t_value const &;
+
+  class Transient;
+
+  // A forward iterator which caches the current leaf.
+  class const_iterator
+  {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = t_value;
+    using difference_type = std::ptrdiff_t;
+    using pointer = t_value const *;
+    using reference = t_value const &;
+
+    const_iterator() noexcept = default;
+
+    reference
+    operator*() const noexcept
     {
-      t_shared::pntr_deallocate(m_control);
+      return m_leaf->data()[m_index & s_mask];
     }
+
+    pointer
+    operator->() const noexcept
+    {
+      return &**this;
+    }
+
+    const_iterator &
+    operator++() noexcept
+    {
+      ++m_index;
+      if ((m_index & s_mask) == 0u && m_index < m_state->m_size)
+      {
+        m_leaf = &leaf_for(*m_state, m_index);
+      }
+      return *this;
+    }
+
+    const_iterator
+    operator++(int) noexcept
+    {
+      const_iterator result(*this);
+      ++*this;
+      return result;
+    }
+
+    friend bool
+    operator==(const_iterator const & p_left, const_iterator const & p_right) noexcept
+    {
+      return (p_left.m_index == p_right.m_index);
+    }
+
+    friend bool
+    operator!=(const_iterator const & p_left, const_iterator const & p_right) noexcept
+    {
+      return (p_left.m_index != p_right.m_index);
+    }
+
+  private:
+    const_iterator(State const & p_state, std::size_t const p_index) noexcept
+    : m_state(&p_state)
+    , m_leaf(p_index < p_state.m_size ? &leaf_for(p_state, p_index) : nullptr)
+    , m_index(p_index)
+    {}
+
+    State const * m_state{};
+    Leaf const * m_leaf{};
+    std::size_t m_index{};
+
+    friend class PersistentVector;
+  };
+
+  using iterator = const_iterator;
+
+  PersistentVector() noexcept = default;
+
+  PersistentVector(std::initializer_list<t_value> p_values)
+  {
+    Transient transient;
+    for (t_value const & value: p_values)
+    {
+      transient.push_back(value);
+    }
+    *this = std::move(transient).persistent();
+  }
+
+  PersistentVector(PersistentVector const & p_other)
+  : m_state(copy(p_other.m_state))
+  {}
+
+  PersistentVector(PersistentVector && p_other) noexcept
+  : m_state(std::exchange(p_other.m_state, State()))
+  {}
+
+  PersistentVector &
+  operator=(PersistentVector const & p_other)
+  {
+    PersistentVector(p_other).swap(*this);
+    return *this;
+  }
+
+  PersistentVector &
+  operator=(PersistentVector && p_other) noexcept
+  {
+    PersistentVector(std::move(p_other)).swap(*this);
+    return *this;
+  }
+
+  size_type
+  size() const noexcept
+  {
+    return m_state.m_size;
+  }
+
+  bool
+  empty() const noexcept
+  {
+    return (m_state.m_size == 0u);
+  }
+
+  const_reference
+  operator[](size_type const p_index) const noexcept
+  {
+    PNTR_ASSERT(p_index < m_state.m_size);
+    return leaf_for(m_state, p_index).data()[p_index & s_mask];
+  }
+
+  const_reference
+  at(size_type const p_index) const
+  {
+    if (p_index >= m_state.m_size)
+    {
+      throw std::out_of_range("PersistentVector::at");
+    }
+    return (*this)[p_index];
+  }
+
+  const_reference
+  front() const noexcept
+  {
+    return (*this)[0u];
+  }
+
+  const_reference
+  back() const noexcept
+  {
+    return (*this)[m_state.m_size - 1u];
+  }
+
+  const_iterator
+  begin() const noexcept
+  {
+    return const_iterator(m_state, 0u);
   }
 
-  WeakPtr &
-  operator=(WeakPtr const & p_other) noexcept
+  const_iterator
+  end() const noexcept
   {
-    WeakPtr(p_other).swap(*this);
-    return *this;
+    return const_iterator(m_state, m_state.m_size);
   }
 
-  WeakPtr &
-  operator=(WeakPtr && p_other) noexcept
+  // Return a vector with the given value appended.
+  template<typename... t_args>
+  PersistentVector
+  emplace_back(t_args &&... p_args) const
   {
-    WeakPtr(std::move(p_other)).swap(*this);
-    return *this;
+    PersistentVector result(*this);
+    result.m_state.emplace_back(std::forward<t_args>(p_args)...);
+    return result;
   }
 
-  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
-  WeakPtr &
-  operator=(WeakPtr<t_other> const & p_other) noexcept
+  PersistentVector
+  push_back(t_value const & p_value) const
   {
-    WeakPtr(p_other).swap(*this);
-    return *this;
+    return emplace_back(p_value);
   }
 
-  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
-  WeakPtr &
-  operator=(WeakPtr<t_other> && p_other) noexcept
+  PersistentVector
+  push_back(t_value && p_value) const
   {
-    WeakPtr(std::move(p_other)).swap(*this);
-    return *this;
+    return emplace_back(std::move(p_value));
   }
 
-  template<class t_other, typename = std::enable_if_t<std::is_convertible_v<t_other, t_shared>>>
-  WeakPtr &
-  operator=(SharedPtr<t_other> const & p_shared_ptr) noexcept
+  // Return a vector with the value at the given index replaced.
+  template<typename t_forward>
+  PersistentVector
+  set(size_type const p_index, t_forward && p_value) const
   {
-    WeakPtr(p_shared_ptr).swap(*this);
-    return *this;
+    PersistentVector result(*this);
+    result.m_state.set(p_index, std::forward<t_forward>(p_value));
+    return result;
   }
 
-  bool
-  is_empty() const noexcept
+  // Return a vector without the last value.
+  PersistentVector
+  pop_back() const
   {
-    return (m_control == nullptr);
+    PersistentVector result(*this);
+    result.m_state.pop_back();
+    return result;
   }
 
-  void
-  reset() noexcept
+  // Return a mutable builder which starts with the values of this vector.
+  Transient
+  transient() const
   {
-    WeakPtr().swap(*this);
+    return Transient(*this);
   }
 
   void
-  swap(WeakPtr & p_other) noexcept
+  swap(PersistentVector & p_other) noexcept
   {
-    std::swap(m_control, p_other.m_control);
+    std::swap(m_state.m_size, p_other.m_state.m_size);
+    std::swap(m_state.m_shift, p_other.m_state.m_shift);
+    m_state.m_root.swap(p_other.m_state.m_root);
+    m_state.m_tail.swap(p_other.m_state.m_tail);
   }
 
-  typename ControlType::UsageValueType
-  use_count() const noexcept
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+  //                                                                                            //
+  //                                         Transient                                          //
+  //                                                                                            //
+  ////////////////////////////////////////////////////////////////////////////////////////////////
+
+  class Transient
   {
-    return m_control != nullptr ? m_control->use_count() : typename ControlType::UsageValueType{};
+  public:
+    Transient() noexcept = default;
+
+    explicit Transient(PersistentVector const & p_vector)
+    : m_state(copy(p_vector.m_state))
+    {}
+
+    Transient(Transient && p_other) noexcept
+    : m_state(std::exchange(p_other.m_state, State()))
+    {}
+
+    Transient &
+    operator=(Transient && p_other) noexcept
+    {
+      m_state = std::exchange(p_other.m_state, State());
+      return *this;
+    }
+
+    Transient(Transient const &) = delete;
+    Transient & operator=(Transient const &) = delete;
+
+    size_type
+    size() const noexcept
+    {
+      return m_state.m_size;
+    }
+
+    bool
+    empty() const noexcept
+    {
+      return (m_state.m_size == 0u);
+    }
+
+    const_reference
+    operator[](size_type const p_index) const noexcept
+    {
+      PNTR_ASSERT(p_index < m_state.m_size);
+      return leaf_for(m_state, p_index).data()[p_index & s_mask];
+    }
+
+    template<typename... t_args>
+    void
+    emplace_back(t_args &&... p_args)
+    {
+      m_state.emplace_back(std::forward<t_args>(p_args)...);
+    }
+
+    void
+    push_back(t_value const & p_value)
+    {
+      m_state.emplace_back(p_value);
+    }
+
+    void
+    push_back(t_value && p_value)
+    {
+      m_state.emplace_back(std::move(p_value));
+    }
+
+    template<typename t_forward>
+    void
+    set(size_type const p_index, t_forward && p_value)
+    {
+      m_state.set(p_index, std::forward<t_forward>(p_value));
+    }
+
+    void
+    pop_back()
+    {
+      m_state.pop_back();
+    }
+
+    // Return a persistent vector with the values of this builder, which is empty afterwards.
+    PersistentVector
+    persistent() &&
+    {
+      PersistentVector result;
+      result.m_state = std::exchange(m_state, State());
+      return result;
+    }
+
+  private:
+    Modifier m_state;
+  };
+
+private:
+  // Share a node, or a copy of it if its usage counter is close to saturation.
+  template<class t_node>
+  static SharedPtr<t_node>
+  share(SharedPtr<t_node> const & p_node)
+  {
+    if (!p_node || detail::persistent_can_share<t_thread_safety>(*p_node))
+    {
+      return p_node;
+    }
+    return allocate_shared<t_node>(t_allocator(), *p_node);
   }
 
-  typename ControlType::WeakValueType
-  weak_count() const noexcept
+  // Return a reference to a node which can be modified in place, copying it if it is shared.
+  template<class t_node>
+  static t_node &
+  edit(SharedPtr<t_node> & p_node)
   {
-    return m_control != nullptr ? m_control->weak_count() : typename ControlType::WeakValueType{};
+    if (!detail::persistent_is_exclusive<t_thread_safety>(*p_node))
+    {
+      p_node = allocate_shared<t_node>(t_allocator(), *p_node);
+    }
+    return *p_node;
   }
 
-  bool
-  expired() const noexcept
+  static State
+  copy(State const & p_state)
   {
-    return (m_control != nullptr && m_control->use_count() == 0u);
+    return State{p_state.m_size, p_state.m_shift, share(p_state.m_root), share(p_state.m_tail)};
   }
 
-  SharedPtr<t_shared>
-  lock() const noexcept
+  // Return the index of the first value stored in the tail.
+  static std::size_t
+  tail_offset(std::size_t const p_size) noexcept
   {
-    return SharedPtr<t_shared>(m_control != nullptr ? m_control->template try_get_shared<t_shared>() : nullptr, false);
+    return (p_size < s_width ? 0u : ((p_size - 1u) >> s_bits) << s_bits);
   }
 
-  template<class t_other>
-  bool
-  owner_before(WeakPtr<t_other> const & p_other) const noexcept
+  static LeafPtr const &
+  leaf_ptr_for(State const & p_state, std::size_t const p_index) noexcept
   {
-    return get_owner() < p_other.get_owner();
+    if (p_index >= tail_offset(p_state.m_size))
+    {
+      return p_state.m_tail;
+    }
+    Branch const * node = p_state.m_root.get();
+    for (unsigned level = p_state.m_shift; level > s_bits; level -= s_bits)
+    {
+      node = node->branch((p_index >> level) & s_mask).get();
+    }
+    return node->leaf((p_index >> s_bits) & s_mask);
   }
 
-  template<class t_other>
-  bool
-  owner_before(SharedPtr<t_other> const & p_other) const noexcept
+  static Leaf const &
+  leaf_for(State const & p_state, std::size_t const p_index) noexcept
   {
-    return get_owner() < (p_other ? p_other->pntr_get_owner() : nullptr);
+    return *leaf_ptr_for(p_state, p_index);
   }
 
-private:
-  void const *
-  get_owner() const noexcept
+  // Create a path of branches down to an empty leaf slot, which is returned in 'p_slot'.
+  static BranchPtr
+  new_path(unsigned const p_level, LeafPtr *& p_slot)
   {
-    return m_control;
+    if (p_level == s_bits)
+    {
+      BranchPtr branch = allocate_shared<Branch>(t_allocator(), true);
+      p_slot = &branch->leaf(0u);
+      return branch;
+    }
+    BranchPtr branch = allocate_shared<Branch>(t_allocator(), false);
+    branch->branch(0u) = new_path(p_level - s_bits, p_slot);
+    return branch;
   }
 
-  ControlType * m_control;
+  // Move the full tail leaf into the tree below the given branch.
+  static void
+  push_tail(BranchPtr & p_node, unsigned const p_level, std::size_t const p_index, LeafPtr & p_tail)
+  {
+    Branch & node = edit(p_node);
+    std::size_t const child = (p_index >> p_level) & s_mask;
+    if (p_level == s_bits)
+    {
+      node.leaf(child) = std::move(p_tail);
+    }
+    else if (node.branch(child))
+    {
+      push_tail(node.branch(child), p_level - s_bits, p_index, p_tail);
+    }
+    else
+    {
+      LeafPtr * slot = nullptr;
+      BranchPtr path = new_path(p_level - s_bits, slot);
+      *slot = std::move(p_tail);
+      node.branch(child) = std::move(path);
+    }
+  }
 
-  template<class t_other>
-  friend class WeakPtr;
+  // Remove the last leaf below the given branch and return true if the branch became empty.
+  static bool
+  pop_tail(BranchPtr & p_node, unsigned const p_level, std::size_t const p_index)
+  {
+    std::size_t const child = (p_index >> p_level) & s_mask;
+    if (p_level > s_bits)
+    {
+      Branch & node = edit(p_node);
+      if (pop_tail(node.branch(child), p_level - s_bits, p_index))
+      {
+        node.branch(child).reset();
+        return (child == 0u);
+      }
+      return false;
+    }
+    if (child == 0u)
+    {
+      return true;
+    }
+    edit(p_node).leaf(child).reset();
+    return false;
+  }
 
-  template<class t_self>
-  friend class SharedPtr;
+  Modifier m_state;
 };
 
 
-template<class t_shared>
-void
-swap(WeakPtr<t_shared> & p_lhs, WeakPtr<t_shared> & p_rhs) noexcept
-{
-  p_lhs.swap(p_rhs);
-}
-
-
 PNTR_NAMESPACE_END
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -4650,6 +13442,35 @@ using IntruderNew =
                                          ControlNewDataThreadUnsafe<t_control_value, t_usage_bits>>,
                       t_deleter>>;
 
+// Supports 'WeakPtr' with side blocks, which are only allocated for objects with weak references.
+// Reserves one user bit, see 'ControlNew'.
+template<class t_shared_base,
+         class t_thread_safety    = ThreadSafe,
+         typename t_control_value = std::uint32_t,
+         unsigned t_usage_bits    = detail::type_bits<t_control_value>() - 1u,
+         typename t_deleter       = std::default_delete<t_shared_base>>
+using IntruderNewWeak =
+  Intruder<ControlNew<t_shared_base,
+                      std::conditional_t<t_thread_safety::value,
+                                         ControlNewDataThreadSafe<t_control_value, t_usage_bits>,
+                                         ControlNewDataThreadUnsafe<t_control_value, t_usage_bits>>,
+                      t_deleter,
+                      std::true_type>>;
+
+// Shards the usage counter by threads for objects copied by many threads, see 'ControlDataSharded'.
+template<class t_shared_base,
+         std::size_t t_shards     = 64u,
+         typename t_deleter       = std::default_delete<t_shared_base>>
+using IntruderNewSharded = Intruder<ControlNew<t_shared_base, ControlDataSharded<t_shards>, t_deleter>>;
+
+// Defers and coalesces the releases of each thread, see 'CounterDeferred'.
+template<class t_shared_base,
+         typename t_control_value = std::uint32_t,
+         unsigned t_usage_bits    = detail::type_bits<t_control_value>(),
+         typename t_deleter       = std::default_delete<t_shared_base>>
+using IntruderNewDeferred =
+  Intruder<ControlNew<t_shared_base, ControlData<CounterDeferred, t_control_value, t_usage_bits>, t_deleter>>;
+
 template<class t_shared_base,
          class t_thread_safety    = ThreadSafe,
          typename t_control_value = std::conditional_t<sizeof(void *) == 8u, std::uint64_t, std::uint32_t>,
@@ -4661,6 +13482,18 @@ using IntruderNewStatic =
                                          ControlNewDataThreadUnsafe<t_control_value, t_usage_bits>>,
                       Deleter<t_shared_base>>>;
 
+// Stores the type index of 'DeleterIndexed' in 8 user bits instead of a function pointer.
+template<class t_shared_base,
+         class t_thread_safety    = ThreadSafe,
+         typename t_control_value = std::uint32_t,
+         unsigned t_usage_bits    = detail::type_bits<t_control_value>() - 8u>
+using IntruderNewStaticIndex =
+  Intruder<ControlNew<t_shared_base,
+                      std::conditional_t<t_thread_safety::value,
+                                         ControlNewDataThreadSafe<t_control_value, t_usage_bits>,
+                                         ControlNewDataThreadUnsafe<t_control_value, t_usage_bits>>,
+                      DeleterIndexed<t_shared_base>>>;
+
 
 template<class t_shared_base,
          class t_thread_safety    = ThreadSafe,
@@ -4681,18 +13514,158 @@ using IntruderAlloc =
                         t_allocator>>;
 
 
+// Spills the excess counts of saturated counters into a global table, see 'CounterSpill'.
+template<class t_shared_base,
+         class t_thread_safety    = ThreadSafe,
+         typename t_control_value = std::uint8_t,
+         unsigned t_usage_bits    = 6u,
+         unsigned t_weak_bits     = 2u,
+         unsigned t_offset_bits   = 0u,
+         unsigned t_size_bits     = 0u,
+         unsigned t_align_bits    = 0u,
+         class t_allocator        = AllocatorMalloc<NoStaticSupport>>
+using IntruderAllocSpill =
+  Intruder<ControlAlloc<t_shared_base,
+                        std::conditional_t<t_thread_safety::value,
+                                           ControlData<CounterSpillThreadSafe, t_control_value, t_usage_bits,
+                                                       t_weak_bits, t_offset_bits, t_size_bits, t_align_bits>,
+                                           ControlData<CounterSpillThreadUnsafe, t_control_value, t_usage_bits,
+                                                       t_weak_bits, t_offset_bits, t_size_bits, t_align_bits>>,
+                        t_allocator>>;
+
+
 template<class t_shared_base, class t_thread_safety = ThreadSafe>
 using IntruderMallocStatic = IntruderAlloc<t_shared_base, t_thread_safety, std::uint64_t, 32u, 32u,
                                            shared_bits, 0u, 0u, AllocatorMalloc<StaticSupport>>;
 
+// Stores a type index in 8 user bits instead of a function pointer, see 'StaticSupportIndex'.
+template<class t_shared_base, class t_thread_safety = ThreadSafe>
+using IntruderMallocStaticIndex = IntruderAlloc<t_shared_base, t_thread_safety, std::uint64_t, 32u, 24u,
+                                                shared_bits, 0u, 0u, AllocatorMalloc<StaticSupportIndex>>;
+
 
 template<class t_shared_base, class t_thread_safety = ThreadSafe>
 using IntruderStdAllocator = IntruderAlloc<t_shared_base, t_thread_safety, std::uint64_t, 32u, 32u,
                                            shared_bits, 0u, 0u, std::allocator<t_shared_base>>;
 
+
+// Reserves the 3 user bits required by 'CycleCollector', which is not thread-safe.
+template<class t_shared_base, class t_thread_safety = ThreadUnsafe>
+using IntruderCycle = IntruderAlloc<t_shared_base, t_thread_safety, std::uint32_t, 29u, 0u, 0u>;
+
 // clang-format on
 
 
+// The declared maxima of the shared objects, which 'AutoIntruder' uses to choose the control data.
+// Derive from it and redeclare the members that differ.
+template<class t_thread_safety = ThreadSafe, class t_allocator = void>
+struct IntruderRequirements
+{
+  using ThreadSafety = t_thread_safety;
+
+  // 'void' selects 'ControlNew' with 'std::default_delete', otherwise 'ControlAlloc' with this allocator.
+  using Allocator = t_allocator;
+
+  // The maximum number of shared pointers to one object. The default fits into 32 bits, even if the
+  // offset is stored in the usage bits.
+  static constexpr std::uint64_t s_max_usage_count = std::numeric_limits<std::int32_t>::max();
+
+  // The maximum number of weak pointers to one object, or zero if weak pointers are not used.
+  static constexpr std::uint64_t s_max_weak_count = 0u;
+
+  // The maximum byte offset of the shared base in derived classes, which grows with the size of the
+  // base classes in front of it. Zero if it is always the first base class.
+  static constexpr std::size_t s_max_base_offset = 0u;
+
+  // The maximum number of bytes that derived classes add to the size of the shared base.
+  // Only used by allocators like 'AllocatorMemoryResource' without static support.
+  static constexpr std::size_t s_max_derived_size = 0u;
+
+  // The maximum alignment of derived classes.
+  static constexpr std::size_t s_max_align = alignof(std::max_align_t);
+
+  // The number of user bits which have to be available.
+  static constexpr unsigned s_user_bits = 0u;
+};
+
+
+namespace detail
+{
+  template<class t_shared_base, class t_requirements>
+  class AutoControl
+  {
+    using Allocator = typename t_requirements::Allocator;
+
+    static constexpr bool s_new = std::is_void_v<Allocator>;
+    static constexpr bool s_new_weak = (s_new && t_requirements::s_max_weak_count != 0u);
+
+    static constexpr ControlNeeds
+    needs() noexcept
+    {
+      ControlNeeds needs{};
+      needs.m_max_usage_count = t_requirements::s_max_usage_count;
+      needs.m_max_weak_count = t_requirements::s_max_weak_count;
+      needs.m_max_offset = t_requirements::s_max_base_offset;
+      needs.m_max_size_offset = t_requirements::s_max_derived_size;
+      needs.m_max_align = t_requirements::s_max_align;
+      needs.m_user_bits = t_requirements::s_user_bits + (s_new_weak ? 1u : 0u);
+      needs.m_min_storage_bits = 8u;
+      if constexpr (!s_new)
+      {
+        constexpr bool stores_function = (supports_static<Allocator> && !SupportsStaticIndex<Allocator>::value);
+        constexpr bool stores_index = (SupportsStaticIndex<Allocator>::value || HasUserIndex<Allocator>::value);
+        static_assert(!stores_index || t_requirements::s_user_bits == 0u,
+                      "The user bits are reserved for the index of the allocator");
+        needs.m_user_bits += (stores_index ? 8u : 0u);
+        if constexpr (stores_function)
+        {
+          needs.m_min_storage_bits = static_cast<unsigned>(alignof(void *) * 8u);
+        }
+        if constexpr (!is_empty_base<Allocator> && !HasUserIndex<Allocator>::value)
+        {
+          needs.m_min_storage_bits =
+            std::max(needs.m_min_storage_bits, static_cast<unsigned>(alignof(Allocator) * 8u));
+        }
+        needs.m_weak = (t_requirements::s_max_weak_count != 0u);
+        needs.m_offset = true;
+        needs.m_shared_offset = supports_static<Allocator>;
+        needs.m_size_align = (HasTypeInfoDeallocate<Allocator>::value && !supports_static<Allocator>);
+#ifdef _WIN32
+        needs.m_offset_flag = (HasPointerDeallocate<Allocator>::value && !supports_static<Allocator>);
+#endif
+      }
+      return needs;
+    }
+
+    static constexpr ControlLayout s_layout = calc_control_layout(needs());
+    static_assert(s_layout.m_storage_bits != 0u, "The requirements don't fit into a control value of 64 bits");
+
+    template<template<typename> class t_counter>
+    using Data = ControlData<t_counter, TypeFromBits<Bits<std::max(s_layout.m_storage_bits, 8u)>>,
+                             s_layout.m_usage_bits, s_layout.m_weak_bits, s_layout.m_offset_bits,
+                             s_layout.m_size_bits, s_layout.m_align_bits>;
+
+    using CounterData = std::conditional_t<t_requirements::ThreadSafety::value, Data<CounterThreadSafe>,
+                                           Data<CounterThreadUnsafe>>;
+
+  public:
+    using Type = std::conditional_t<s_new,
+                                    ControlNew<t_shared_base, CounterData, std::default_delete<t_shared_base>,
+                                               std::bool_constant<s_new_weak>>,
+                                    ControlAlloc<t_shared_base, CounterData, Allocator>>;
+
+    static_assert(Type::get_max_usage_count() >= t_requirements::s_max_usage_count);
+    static_assert(Type::get_max_user() >= (std::uint64_t{1u} << t_requirements::s_user_bits) - 1u);
+  };
+} // namespace detail
+
+
+// An 'Intruder' whose control data is configured from the declared requirements at compile-time.
+// It selects the smallest control value and prefers separate counters when they fit.
+template<class t_shared_base, class t_requirements = IntruderRequirements<>>
+using AutoIntruder = Intruder<typename detail::AutoControl<t_shared_base, t_requirements>::Type>;
+
+
 template<class t_shared>
 inline std::size_t
 calc_pointer_offset(t_shared & p_shared) noexcept
@@ -4715,6 +13688,60 @@ calc_align_offset() noexcept
 }
 
 
+// The possible improvements of an 'Intruder' which can be determined at compile-time, without an
+// object, see 'check_intruder_efficiency'. Use it with
+// 'static_assert(pntr::intruder_efficiency<T>().is_efficient())'.
+struct IntruderEfficiency
+{
+  bool m_padding = false;
+  bool m_wide_usage_count = false;
+  bool m_wide_weak_count = false;
+  bool m_unused_weak_bits = false;
+  bool m_unused_offset_bits = false;
+  bool m_unused_size_bits = false;
+  bool m_unused_align_bits = false;
+  bool m_unused_deleter = false;
+
+  constexpr bool
+  is_efficient() const noexcept
+  {
+    return !(m_padding || m_wide_usage_count || m_wide_weak_count || m_unused_weak_bits || m_unused_offset_bits
+             || m_unused_size_bits || m_unused_align_bits || m_unused_deleter);
+  }
+};
+
+template<class t_shared>
+inline constexpr IntruderEfficiency
+intruder_efficiency() noexcept
+{
+  using SharedBase = detail::BaseType<t_shared>;
+  using Data = typename t_shared::PntrControlType::Data;
+  using DeleterType = typename t_shared::PntrDeleter;
+  using Allocator = typename t_shared::PntrAllocator;
+
+  IntruderEfficiency report;
+  report.m_padding = (sizeof(Data) < detail::control_member_align<t_shared>());
+  report.m_wide_usage_count = (Data::s_usage_bits > 32u);
+  report.m_wide_weak_count = (t_shared::PntrSupportsWeak::value && Data::s_weak_bits > 32u);
+  report.m_unused_weak_bits = (!t_shared::PntrSupportsWeak::value && Data::s_weak_bits != 0u);
+  if constexpr (!std::is_void_v<DeleterType>)
+  {
+    report.m_unused_offset_bits = (Data::s_offset_bits != 0u);
+    report.m_unused_size_bits = (Data::s_size_bits != 0u);
+    report.m_unused_align_bits = (Data::s_align_bits != 0u);
+    report.m_unused_deleter =
+      (std::is_same_v<DeleterType, Deleter<t_shared>>
+       && (std::has_virtual_destructor_v<SharedBase> || std::is_same_v<t_shared, SharedBase>));
+  }
+  else if constexpr (!detail::HasTypeInfoDeallocate<Allocator>::value || detail::supports_static<Allocator>)
+  {
+    report.m_unused_size_bits = (Data::s_size_bits != 0u);
+    report.m_unused_align_bits = (Data::s_align_bits != 0u);
+  }
+  return report;
+}
+
+
 // Check the efficiency of the 'Intruder' and write possible improvements to the given stream.
 // Return true if there are no proposed improvements.
 template<class t_shared, class t_char, class t_traits>
@@ -4729,17 +13756,7 @@ check_intruder_efficiency(SharedPtr<t_shared> const & p_shared_ptr,
   using Allocator = typename t_shared::PntrAllocator;
 
   bool efficient = true;
-  constexpr std::size_t align = []
-  {
-    if constexpr (std::is_void_v<DeleterType>)
-    {
-      return std::max((detail::supports_static<Allocator> ? alignof(void *) : 0u), alignof(Allocator));
-    }
-    else
-    {
-      return alignof(DeleterType);
-    }
-  }();
+  constexpr std::size_t align = detail::control_member_align<t_shared>();
   if constexpr (sizeof(Data) < align)
   {
     p_ostream << "Padding detected. You can increase the control data value type to " << align << " bytes."
@@ -0,0 +1,110 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "benchmark-counters.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <algorithm>
+#include <numeric>
+#include <random>
+#include <vector>
+
+
+#if defined(__linux__)
+
+namespace
+{
+  template<class t_allocator>
+  struct Node
+  : public pntr::Intruder<
+      pntr::ControlAlloc<Node<t_allocator>, pntr::ControlData<pntr::CounterThreadSafe, std::uint32_t>, t_allocator>>
+  {
+    std::uint64_t m_value = 1u;
+    Node * m_next = nullptr;
+  };
+
+  using MallocNode = Node<pntr::AllocatorMalloc<>>;
+  using ArenaNode = Node<pntr::AllocatorArena<>>;
+
+  // Create the nodes and link them in a random order to a single cycle, using raw pointers.
+  template<class t_node, class t_create>
+  std::vector<pntr::SharedPtr<t_node>>
+  make_graph(std::size_t const p_count, t_create && p_create)
+  {
+    std::vector<pntr::SharedPtr<t_node>> nodes;
+    nodes.reserve(p_count);
+    for (std::size_t i = 0u; i < p_count; ++i)
+    {
+      nodes.push_back(p_create());
+    }
+    std::vector<std::size_t> order(p_count);
+    std::iota(order.begin(), order.end(), std::size_t{0u});
+    std::shuffle(order.begin(), order.end(), std::mt19937_64(12345u));
+    for (std::size_t i = 0u; i < p_count; ++i)
+    {
+      nodes[order[i]]->m_next = nodes[order[(i + 1u) % p_count]].get();
+    }
+    return nodes;
+  }
+
+  template<class t_node>
+  std::uint64_t
+  visit(t_node const * p_node, std::size_t const p_steps)
+  {
+    std::uint64_t sum = 0u;
+    for (std::size_t i = 0u; i < p_steps; ++i)
+    {
+      sum += p_node->m_value;
+      p_node = p_node->m_next;
+    }
+    return sum;
+  }
+} // namespace
+
+
+TEST_CASE("AllocatorArena benchmark")
+{
+  std::size_t const count = 1u << 22u;
+
+  BENCHMARK_COUNTED("AllocatorMalloc, create 4M nodes")
+  {
+    return make_graph<MallocNode>(count, [] { return pntr::make_shared<MallocNode>(); }).size();
+  };
+
+  BENCHMARK_COUNTED("AllocatorArena, create 4M nodes")
+  {
+    pntr::ArenaPool pool;
+    return make_graph<ArenaNode>(count, [&pool] { return pool.make_shared<ArenaNode>(); }).size();
+  };
+
+  BENCHMARK_COUNTED("AllocatorArena with prefaulting, create 4M nodes")
+  {
+    pntr::ArenaPool::Options options;
+    options.m_arenas = 4u;
+    options.m_prefault = true;
+    pntr::ArenaPool pool(options);
+    return make_graph<ArenaNode>(count, [&pool] { return pool.make_shared<ArenaNode>(); }).size();
+  };
+
+  {
+    std::vector<pntr::SharedPtr<MallocNode>> const nodes =
+      make_graph<MallocNode>(count, [] { return pntr::make_shared<MallocNode>(); });
+    BENCHMARK_COUNTED("AllocatorMalloc, visit 4M random nodes")
+    {
+      return visit(nodes.front().get(), count);
+    };
+  }
+
+  {
+    pntr::ArenaPool pool;
+    std::vector<pntr::SharedPtr<ArenaNode>> const nodes =
+      make_graph<ArenaNode>(count, [&pool] { return pool.make_shared<ArenaNode>(); });
+    BENCHMARK_COUNTED("AllocatorArena, visit 4M random nodes")
+    {
+      return visit(nodes.front().get(), count);
+    };
+  }
+}
+
+#endif
@@ -0,0 +1,223 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "benchmark-common.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <thread>
+#include <vector>
+#ifdef __cpp_lib_memory_resource
+  #include <memory_resource>
+#endif
+
+
+namespace
+{
+  constexpr std::size_t s_operations = 1000000u;
+  constexpr std::uint32_t s_young_slots = 64u;
+  constexpr std::uint32_t s_slots = 16384u;
+
+  // Puts the shared base behind other data, so the allocators have to restore the original pointer.
+  struct Padding
+  {
+    std::uint64_t m_padding[2] = {};
+  };
+
+  template<template<class> class t_intruder>
+  struct Churn
+  : Padding
+  , t_intruder<Churn<t_intruder>>
+  {
+    std::uint64_t m_value[3] = {};
+  };
+
+  template<class t_shared>
+  using IntruderMalloc = pntr::IntruderAlloc<t_shared>;
+  template<class t_shared>
+  using IntruderMallocStatic = pntr::IntruderMallocStatic<t_shared>;
+  template<class t_shared>
+  using IntruderMallocStaticIndex = pntr::IntruderMallocStaticIndex<t_shared>;
+  template<class t_shared>
+  using IntruderStdAllocator = pntr::IntruderStdAllocator<t_shared>;
+#ifdef __cpp_lib_memory_resource
+  // Restores the size and alignment from the control data, see 'calc_shared_size'.
+  template<class t_shared>
+  using IntruderResource = pntr::IntruderAlloc<t_shared, pntr::ThreadSafe, std::uint64_t, 32u, 16u, 6u, 6u, 4u,
+                                               pntr::AllocatorMemoryResource<pntr::NoStaticSupport>>;
+  template<class t_shared>
+  using IntruderResourceStatic = pntr::IntruderAlloc<t_shared, pntr::ThreadSafe, std::uint64_t, 32u, 32u,
+                                                     pntr::shared_bits, 0u, 0u,
+                                                     pntr::AllocatorMemoryResource<pntr::StaticSupport>>;
+#endif
+
+  // Return the slots replaced by each operation. Most objects die young: 90% of the operations
+  // replace one of the few young slots, and the others replace one of the many old slots.
+  std::vector<std::uint32_t>
+  make_slots(std::uint64_t const p_seed)
+  {
+    std::mt19937_64 random(p_seed);
+    std::bernoulli_distribution young(0.9);
+    std::uniform_int_distribution<std::uint32_t> young_slot(0u, s_young_slots - 1u);
+    std::uniform_int_distribution<std::uint32_t> old_slot(s_young_slots, s_slots - 1u);
+    std::vector<std::uint32_t> slots(s_operations);
+    for (std::uint32_t & slot : slots)
+    {
+      slot = (young(random) ? young_slot(random) : old_slot(random));
+    }
+    return slots;
+  }
+
+  // Fill the slots, and return the cycles of each operation, which creates an object and destroys
+  // the object of its slot.
+  template<class t_shared, class t_make>
+  double
+  churn(std::vector<std::uint32_t> const & p_slots, t_make const & p_make)
+  {
+    std::vector<pntr::SharedPtr<t_shared>> live(s_slots);
+    for (pntr::SharedPtr<t_shared> & object : live)
+    {
+      object = p_make();
+    }
+    std::uint64_t const start = cycles();
+    for (std::uint32_t const slot : p_slots)
+    {
+      live[slot] = p_make();
+    }
+    std::uint64_t const end = cycles();
+    return static_cast<double>(end - start) / static_cast<double>(p_slots.size());
+  }
+
+  // Return the average cycles of each operation of all threads churning at the same time.
+  template<class t_shared, class t_make>
+  double
+  churn_threads(std::vector<std::vector<std::uint32_t>> const & p_slots, t_make const & p_make)
+  {
+    std::atomic<std::size_t> ready = 0u;
+    std::vector<double> results(p_slots.size());
+    std::vector<std::thread> threads;
+    for (std::size_t t = 0u; t < p_slots.size(); ++t)
+    {
+      threads.emplace_back(
+        [&p_slots, &p_make, &ready, &results, t, count = p_slots.size()]() noexcept
+        {
+          ++ready;
+          while (ready.load() != count)
+          {
+            std::this_thread::yield();
+          }
+          results[t] = churn<t_shared>(p_slots[t], p_make);
+        });
+    }
+    for (std::thread & thread : threads)
+    {
+      thread.join();
+    }
+    double sum = 0.0;
+    for (double const result : results)
+    {
+      sum += result;
+    }
+    return sum / static_cast<double>(results.size());
+  }
+
+  class Report
+  {
+  public:
+    Report()
+    : m_threads(std::clamp(std::thread::hardware_concurrency(), 2u, 4u))
+    {
+      for (std::size_t t = 0u; t < m_threads.size(); ++t)
+      {
+        m_threads[t] = make_slots(t + 1u);
+      }
+      char const * const unit = (BENCHMARK_CYCLES ? "cycles" : "ns");
+      std::cout << "\n"
+                << s_operations << " creations and destructions per thread, " << s_slots << " live objects\n"
+                << std::left << std::setw(66) << "adapter, allocator" << std::right << std::setw(10) << "1 thread"
+                << std::setw(6) << m_threads.size() << " threads\n"
+                << std::left << std::setw(66) << "" << std::right << std::setw(10) << unit << std::setw(14) << unit
+                << std::endl;
+    }
+
+    // Print the cycles of the allocator, and of concurrent threads unless it isn't thread-safe.
+    template<class t_shared, class t_make>
+    void
+    measure(char const * const p_name, t_make const & p_make, bool const p_threads = true) const
+    {
+      std::cout << std::left << std::setw(66) << p_name << std::right << std::fixed << std::setprecision(1)
+                << std::setw(10) << churn<t_shared>(m_threads.front(), p_make);
+      if (p_threads)
+      {
+        std::cout << std::setw(14) << churn_threads<t_shared>(m_threads, p_make);
+      }
+      else
+      {
+        std::cout << std::setw(14) << "-";
+      }
+      std::cout << std::endl;
+    }
+
+  private:
+    std::vector<std::vector<std::uint32_t>> m_threads;
+  };
+
+  template<template<class> class t_intruder>
+  void
+  measure_make_shared(Report const & p_report, char const * const p_name)
+  {
+    using Shared = Churn<t_intruder>;
+    p_report.measure<Shared>(p_name, [] { return pntr::make_shared<Shared>(); });
+  }
+
+#ifdef __cpp_lib_memory_resource
+  template<template<class> class t_intruder, class t_allocator>
+  void
+  measure_resource(Report const & p_report,
+                   char const * const p_name,
+                   std::pmr::memory_resource * const p_resource,
+                   bool const p_threads = true)
+  {
+    using Shared = Churn<t_intruder>;
+    p_report.measure<Shared>(
+      p_name, [p_resource] { return pntr::allocate_shared<Shared>(t_allocator(p_resource)); }, p_threads);
+  }
+#endif
+} // namespace
+
+
+// Compares the deallocation paths of 'ControlAlloc': 'AllocAdaptPointer' restores the original
+// pointer from the offset or calls the stored function, 'AllocAdaptTypeInfo' also restores the size
+// and alignment, and 'AllocAdaptTyped' rebinds the standard allocator to the stored type.
+TEST_CASE("AllocatorChurn benchmark")
+{
+  Report const report;
+
+  measure_make_shared<IntruderMalloc>(report, "AllocAdaptPointer, AllocatorMalloc<NoStaticSupport>");
+  measure_make_shared<IntruderMallocStatic>(report, "AllocAdaptPointer, AllocatorMalloc<StaticSupport>");
+  measure_make_shared<IntruderMallocStaticIndex>(report, "AllocAdaptPointer, AllocatorMalloc<StaticSupportIndex>");
+
+#ifdef __cpp_lib_memory_resource
+  using Resource = pntr::AllocatorMemoryResource<pntr::NoStaticSupport>;
+  using ResourceStatic = pntr::AllocatorMemoryResource<pntr::StaticSupport>;
+  std::pmr::synchronized_pool_resource synchronized_pool;
+  std::pmr::unsynchronized_pool_resource unsynchronized_pool;
+
+  measure_resource<IntruderResource, Resource>(
+    report, "AllocAdaptTypeInfo, AllocatorMemoryResource, new_delete_resource", std::pmr::new_delete_resource());
+  measure_resource<IntruderResource, Resource>(
+    report, "AllocAdaptTypeInfo, AllocatorMemoryResource, synchronized_pool", &synchronized_pool);
+  measure_resource<IntruderResource, Resource>(
+    report, "AllocAdaptTypeInfo, AllocatorMemoryResource, unsynchronized_pool", &unsynchronized_pool, false);
+  measure_resource<IntruderResourceStatic, ResourceStatic>(
+    report, "AllocAdaptTypeInfo, AllocatorMemoryResource<Static>, sync. pool", &synchronized_pool);
+#endif
+
+  measure_make_shared<IntruderStdAllocator>(report, "AllocAdaptTyped, std::allocator");
+}
@@ -0,0 +1,171 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "benchmark-counters.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+  struct AtomicGlobal: pntr::IntruderNew<AtomicGlobal>
+  {
+    std::uint64_t m_value = 1u;
+  };
+
+  struct ShardedGlobal: pntr::IntruderNewSharded<ShardedGlobal>
+  {
+    std::uint64_t m_value = 1u;
+  };
+
+  // Threads which are started once outside of the measurement. Each call of 'run' releases them
+  // with a new generation, and waits until all of them have called the function once.
+  class Workers
+  {
+  public:
+    Workers(unsigned const p_threads, std::function<void(unsigned)> p_function)
+    : m_function(std::move(p_function))
+    {
+      for (unsigned i = 0u; i < p_threads; ++i)
+      {
+        m_threads.emplace_back([this, i]() noexcept { work(i); });
+      }
+    }
+
+    ~Workers() noexcept
+    {
+      {
+        std::lock_guard<std::mutex> const lock(m_mutex);
+        m_stop = true;
+        ++m_generation;
+      }
+      m_start.notify_all();
+      for (std::thread & thread : m_threads)
+      {
+        thread.join();
+      }
+    }
+
+    Workers(Workers const &) = delete;
+    Workers & operator=(Workers const &) = delete;
+
+    void
+    run() noexcept
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_running = static_cast<unsigned>(m_threads.size());
+      ++m_generation;
+      m_start.notify_all();
+      m_done.wait(lock, [this]() noexcept { return m_running == 0u; });
+    }
+
+  private:
+    void
+    work(unsigned const p_index) noexcept
+    {
+      std::uint64_t generation = 0u;
+      for (;;)
+      {
+        {
+          std::unique_lock<std::mutex> lock(m_mutex);
+          m_start.wait(lock, [this, generation]() noexcept { return m_generation != generation; });
+          generation = m_generation;
+          if (m_stop)
+          {
+            return;
+          }
+        }
+        m_function(p_index);
+        std::lock_guard<std::mutex> const lock(m_mutex);
+        if (--m_running == 0u)
+        {
+          m_done.notify_one();
+        }
+      }
+    }
+
+    std::function<void(unsigned)> m_function;
+    std::mutex m_mutex;
+    std::condition_variable m_start;
+    std::condition_variable m_done;
+    std::uint64_t m_generation = 0u;
+    unsigned m_running = 0u;
+    bool m_stop = false;
+    std::vector<std::thread> m_threads;
+  };
+
+  // Let each thread copy and release the same global object, like a configuration or a registry.
+  // The threads are started before the benchmark, so only the copies are measured.
+  template<class t_shared>
+  class CopyFromThreads
+  {
+  public:
+    CopyFromThreads(pntr::SharedPtr<t_shared> const & p_global, unsigned const p_threads)
+    : m_sums(p_threads)
+    , m_workers(p_threads,
+                [&p_global, this](unsigned const p_index) noexcept
+                {
+                  std::uint64_t sum = 0u;
+                  for (unsigned j = 0u; j < 100000u; ++j)
+                  {
+                    pntr::SharedPtr<t_shared> const copy = p_global;
+                    sum += copy->m_value;
+                  }
+                  m_sums[p_index] += sum;
+                })
+    {}
+
+    std::uint64_t
+    operator()() noexcept
+    {
+      m_workers.run();
+      std::uint64_t sum = 0u;
+      for (std::uint64_t const thread_sum : m_sums)
+      {
+        sum += thread_sum;
+      }
+      return sum;
+    }
+
+  private:
+    std::vector<std::uint64_t> m_sums;
+    Workers m_workers;
+  };
+} // namespace
+
+
+// Each thread performs the same amount of work, so linear scaling shows as a constant time
+// as long as the number of threads doesn't exceed the number of CPUs.
+TEST_CASE("ControlDataSharded benchmark")
+{
+  pntr::SharedPtr<AtomicGlobal> const atomic_global = pntr::make_shared<AtomicGlobal>();
+  pntr::SharedPtr<ShardedGlobal> const sharded_global = pntr::make_shared<ShardedGlobal>();
+
+  for (unsigned threads = 1u; threads <= 64u; threads *= 2u)
+  {
+    {
+      CopyFromThreads<AtomicGlobal> copy_from_threads(atomic_global, threads);
+      BENCHMARK_COUNTED("CounterThreadSafe, 100000 copies on " + std::to_string(threads) + " threads")
+      {
+        return copy_from_threads();
+      };
+    }
+
+    {
+      CopyFromThreads<ShardedGlobal> copy_from_threads(sharded_global, threads);
+      BENCHMARK_COUNTED("ControlDataSharded, 100000 copies on " + std::to_string(threads) + " threads")
+      {
+        return copy_from_threads();
+      };
+    }
+  }
+}
@@ -0,0 +1,129 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "benchmark-counters.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <coroutine>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+  constexpr int s_coroutines = 1000;
+
+  struct PromiseBody
+  {
+    std::suspend_always
+    initial_suspend() const noexcept
+    {
+      return {};
+    }
+
+    void
+    return_value(int const p_value) noexcept
+    {
+      m_value = p_value;
+    }
+
+    void
+    unhandled_exception() const noexcept
+    {
+      std::abort();
+    }
+
+    int m_value = 0;
+  };
+
+  // The frame is allocated with the global 'operator new' and owned by a 'std::shared_ptr', which
+  // allocates a separate control block.
+  struct StdTask
+  {
+    struct promise_type: PromiseBody
+    {
+      StdTask
+      get_return_object()
+      {
+        return {std::shared_ptr<promise_type>(
+          this, [](promise_type * const p_promise) noexcept
+          { std::coroutine_handle<promise_type>::from_promise(*p_promise).destroy(); })};
+      }
+
+      std::suspend_always
+      final_suspend() const noexcept
+      {
+        return {};
+      }
+    };
+
+    void
+    resume() const
+    {
+      std::coroutine_handle<promise_type>::from_promise(*m_frame).resume();
+    }
+
+    std::shared_ptr<promise_type> m_frame;
+  };
+
+  // The frame embeds the control block and is allocated by 't_allocator'.
+  template<class t_allocator>
+  struct PntrTask
+  {
+    struct promise_type: pntr::CoroutinePromise<promise_type, t_allocator>, PromiseBody
+    {};
+
+    PntrTask(pntr::SharedPtr<promise_type> p_frame) noexcept
+    : m_frame(std::move(p_frame))
+    {}
+
+    void
+    resume() const
+    {
+      m_frame->handle().resume();
+    }
+
+    pntr::SharedPtr<promise_type> m_frame;
+  };
+
+  template<class t_task>
+  t_task
+  compute(int const p_value)
+  {
+    co_return p_value * 2;
+  }
+
+  // Create, run, and release a batch of coroutines, like a request handler.
+  template<class t_task>
+  void
+  benchmark_frames(std::string const & p_name)
+  {
+    std::vector<t_task> tasks;
+    tasks.reserve(s_coroutines);
+    BENCHMARK_COUNTED(p_name + ", handle of " + std::to_string(sizeof(t_task)) + " bytes")
+    {
+      for (int i = 0; i < s_coroutines; ++i)
+      {
+        tasks.push_back(compute<t_task>(i));
+        tasks.back().resume();
+      }
+      tasks.clear();
+      return tasks.capacity();
+    };
+  }
+} // namespace
+
+
+TEST_CASE("Coroutine benchmark")
+{
+  benchmark_frames<StdTask>("1000 coroutines with operator new and std::shared_ptr");
+  benchmark_frames<PntrTask<pntr::AllocatorMalloc<>>>("1000 coroutines with AllocatorMalloc and SharedPtr");
+
+  pntr::ArenaPool pool;
+  pntr::ArenaPool::Scope const scope(pool);
+  benchmark_frames<PntrTask<pntr::AllocatorArena<>>>("1000 coroutines with AllocatorArena and SharedPtr");
+}
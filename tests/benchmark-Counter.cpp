@@ -1,6 +1,8 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/benchmark/catch_benchmark.hpp>
 
+#include "benchmark-counters.hpp"
+
 #include <pntr/pntr.hpp>
 
 #include <cstdlib>
@@ -28,42 +30,42 @@ TEST_CASE("Counter benchmark")
 {
   std::uint32_t const r = static_cast<std::uint32_t>(std::rand());
 
-  BENCHMARK("CounterThreadSafe<std::uint8_t>")
+  BENCHMARK_COUNTED("CounterThreadSafe<std::uint8_t>")
   {
     return benchmark<pntr::CounterThreadSafe<std::uint8_t>>(r);
   };
 
-  BENCHMARK("CounterThreadSafe<std::uint16_t>")
+  BENCHMARK_COUNTED("CounterThreadSafe<std::uint16_t>")
   {
     return benchmark<pntr::CounterThreadSafe<std::uint16_t>>(r);
   };
 
-  BENCHMARK("CounterThreadSafe<std::uint32_t>")
+  BENCHMARK_COUNTED("CounterThreadSafe<std::uint32_t>")
   {
     return benchmark<pntr::CounterThreadSafe<std::uint32_t>>(r);
   };
 
-  BENCHMARK("CounterThreadSafe<std::uint64_t>")
+  BENCHMARK_COUNTED("CounterThreadSafe<std::uint64_t>")
   {
     return benchmark<pntr::CounterThreadSafe<std::uint64_t>>(r);
   };
 
-  BENCHMARK("CounterThreadUnsafe<std::uint8_t>")
+  BENCHMARK_COUNTED("CounterThreadUnsafe<std::uint8_t>")
   {
     return benchmark<pntr::CounterThreadUnsafe<std::uint8_t>>(r);
   };
 
-  BENCHMARK("CounterThreadUnsafe<std::uint16_t>")
+  BENCHMARK_COUNTED("CounterThreadUnsafe<std::uint16_t>")
   {
     return benchmark<pntr::CounterThreadUnsafe<std::uint16_t>>(r);
   };
 
-  BENCHMARK("CounterThreadUnsafe<std::uint32_t>")
+  BENCHMARK_COUNTED("CounterThreadUnsafe<std::uint32_t>")
   {
     return benchmark<pntr::CounterThreadUnsafe<std::uint32_t>>(r);
   };
 
-  BENCHMARK("CounterThreadUnsafe<std::uint64_t>")
+  BENCHMARK_COUNTED("CounterThreadUnsafe<std::uint64_t>")
   {
     return benchmark<pntr::CounterThreadUnsafe<std::uint64_t>>(r);
   };
@@ -106,11 +108,11 @@ TEST_CASE("Launder benchmark")
 {
   std::uint32_t const r = static_cast<std::uint32_t>(std::rand());
 
-  BENCHMARK("benchmark_regular")
+  BENCHMARK_COUNTED("benchmark_regular")
   {
     return benchmark_regular(r);
   };
-  BENCHMARK("benchmark_launder")
+  BENCHMARK_COUNTED("benchmark_launder")
   {
     return benchmark_launder(r);
   };
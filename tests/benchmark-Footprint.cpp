@@ -0,0 +1,145 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "benchmark-common.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <chrono>
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <vector>
+
+
+namespace
+{
+  // 10M objects make the heap and page overheads visible next to the control blocks.
+  constexpr std::size_t s_objects = 10000000u;
+
+  template<class t_shared>
+  using IntruderNew8 = pntr::IntruderNew<t_shared, pntr::ThreadSafe, std::uint8_t>;
+  template<class t_shared>
+  using IntruderNew16 = pntr::IntruderNew<t_shared, pntr::ThreadSafe, std::uint16_t>;
+  template<class t_shared>
+  using IntruderNew32 = pntr::IntruderNew<t_shared, pntr::ThreadSafe, std::uint32_t>;
+  template<class t_shared>
+  using IntruderNewStatic = pntr::IntruderNewStatic<t_shared>;
+  template<class t_shared>
+  using IntruderNewStaticIndex = pntr::IntruderNewStaticIndex<t_shared>;
+  template<class t_shared>
+  using IntruderAlloc = pntr::IntruderAlloc<t_shared>;
+  template<class t_shared>
+  using IntruderAlloc32 = pntr::IntruderAlloc<t_shared, pntr::ThreadSafe, std::uint32_t, 24u, 8u, 0u>;
+  template<class t_shared>
+  using IntruderAllocSpill = pntr::IntruderAllocSpill<t_shared>;
+  template<class t_shared>
+  using IntruderMallocStatic = pntr::IntruderMallocStatic<t_shared>;
+  template<class t_shared>
+  using IntruderMallocStaticIndex = pntr::IntruderMallocStaticIndex<t_shared>;
+  template<class t_shared>
+  using IntruderStdAllocator = pntr::IntruderStdAllocator<t_shared>;
+
+  template<template<class> class t_intruder, std::size_t t_payload>
+  struct Object: t_intruder<Object<t_intruder, t_payload>>
+  {
+    unsigned char m_payload[t_payload] = {};
+  };
+
+  template<std::size_t t_payload>
+  struct Plain
+  {
+    unsigned char m_payload[t_payload] = {};
+  };
+
+  double
+  per_object(std::chrono::steady_clock::duration const p_duration) noexcept
+  {
+    return static_cast<double>(std::chrono::duration_cast<std::chrono::nanoseconds>(p_duration).count())
+           / static_cast<double>(s_objects);
+  }
+
+  double
+  per_object(std::size_t const p_before, std::size_t const p_after) noexcept
+  {
+    return (p_after > p_before ? static_cast<double>(p_after - p_before) / static_cast<double>(s_objects) : 0.0);
+  }
+
+  // Create and destroy the objects, and print the bytes and nanoseconds per object.
+  template<class t_pointer, class t_make>
+  void
+  measure(char const * const p_name, std::size_t const p_sizeof, t_make const & p_make)
+  {
+    // The pointers are written once before the baseline, so their pages are resident already.
+    std::vector<t_pointer> objects(s_objects);
+    trim_heap();
+    std::size_t const heap_before = heap_bytes();
+    std::size_t const resident_before = resident_bytes();
+
+    auto const create_start = std::chrono::steady_clock::now();
+    for (t_pointer & object : objects)
+    {
+      object = p_make();
+    }
+    auto const create_end = std::chrono::steady_clock::now();
+
+    std::size_t const heap_after = heap_bytes();
+    std::size_t const resident_after = resident_bytes();
+
+    auto const destroy_start = std::chrono::steady_clock::now();
+    for (t_pointer & object : objects)
+    {
+      object.reset();
+    }
+    auto const destroy_end = std::chrono::steady_clock::now();
+
+    std::cout << std::left << std::setw(28) << p_name << std::right << std::setw(8) << p_sizeof << std::fixed
+              << std::setprecision(1) << std::setw(12) << per_object(heap_before, heap_after) << std::setw(12)
+              << per_object(resident_before, resident_after) << std::setw(12)
+              << per_object(create_end - create_start) << std::setw(12) << per_object(destroy_end - destroy_start)
+              << std::endl;
+  }
+
+  template<template<class> class t_intruder, std::size_t t_payload>
+  void
+  measure_intruder(char const * const p_name)
+  {
+    using Shared = Object<t_intruder, t_payload>;
+    measure<pntr::SharedPtr<Shared>>(p_name, sizeof(Shared), [] { return pntr::make_shared<Shared>(); });
+  }
+
+  template<std::size_t t_payload>
+  void
+  measure_payload()
+  {
+    std::cout << "\n"
+              << t_payload << " bytes payload, " << s_objects << " objects\n"
+              << std::left << std::setw(28) << "configuration" << std::right << std::setw(8) << "sizeof"
+              << std::setw(12) << "heap B/obj" << std::setw(12) << "RSS B/obj" << std::setw(12) << "create ns"
+              << std::setw(12) << "destroy ns" << std::endl;
+
+    using Std = Plain<t_payload>;
+    measure<std::shared_ptr<Std>>("std::make_shared", sizeof(Std), [] { return std::make_shared<Std>(); });
+    measure_intruder<IntruderNew8, t_payload>("IntruderNew u8");
+    measure_intruder<IntruderNew16, t_payload>("IntruderNew u16");
+    measure_intruder<IntruderNew32, t_payload>("IntruderNew u32");
+    measure_intruder<IntruderNewStatic, t_payload>("IntruderNewStatic");
+    measure_intruder<IntruderNewStaticIndex, t_payload>("IntruderNewStaticIndex");
+    measure_intruder<IntruderAlloc, t_payload>("IntruderAlloc u64");
+    measure_intruder<IntruderAlloc32, t_payload>("IntruderAlloc u32");
+    measure_intruder<IntruderAllocSpill, t_payload>("IntruderAllocSpill u8");
+    measure_intruder<IntruderMallocStatic, t_payload>("IntruderMallocStatic");
+    measure_intruder<IntruderMallocStaticIndex, t_payload>("IntruderMallocStaticIndex");
+    measure_intruder<IntruderStdAllocator, t_payload>("IntruderStdAllocator");
+  }
+} // namespace
+
+
+// The heap bytes include the allocator's chunk headers and padding, the resident set size also
+// includes the partially used pages. Both are zero if the platform doesn't provide them.
+TEST_CASE("Footprint benchmark")
+{
+  measure_payload<8u>();
+  measure_payload<32u>();
+  measure_payload<128u>();
+}
@@ -0,0 +1,437 @@
+#include <catch2/catch_test_macros.hpp>
+
+#include "benchmark-common.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+  constexpr std::size_t s_tree_nodes = 10000000u;
+  constexpr std::size_t s_graph_nodes = 65536u;
+  constexpr std::size_t s_graph_edges = 4u;
+  constexpr std::size_t s_searches = 256u;
+  constexpr std::size_t s_messages = 250000u;
+  constexpr std::size_t s_subscribers = 4u;
+  constexpr std::size_t s_inbox_capacity = 1024u;
+  constexpr std::size_t s_cache_keys = 1000000u;
+  constexpr std::size_t s_cache_capacity = 65536u;
+  constexpr std::size_t s_lookups = 2000000u;
+
+  template<class>
+  struct NoBase
+  {};
+
+  struct Pntr
+  {
+    static constexpr char const * s_name = "pntr";
+
+    template<class t_shared>
+    using Base = pntr::IntruderAlloc<t_shared>;
+    template<class t_shared>
+    using Shared = pntr::SharedPtr<t_shared>;
+    template<class t_shared>
+    using Weak = pntr::WeakPtr<t_shared>;
+
+    template<class t_shared>
+    static Shared<t_shared>
+    make()
+    {
+      return pntr::make_shared<t_shared>();
+    }
+  };
+
+  struct Std
+  {
+    static constexpr char const * s_name = "std";
+
+    template<class t_shared>
+    using Base = NoBase<t_shared>;
+    template<class t_shared>
+    using Shared = std::shared_ptr<t_shared>;
+    template<class t_shared>
+    using Weak = std::weak_ptr<t_shared>;
+
+    template<class t_shared>
+    static Shared<t_shared>
+    make()
+    {
+      return std::make_shared<t_shared>();
+    }
+  };
+
+  std::size_t
+  thread_count() noexcept
+  {
+    return std::clamp(std::thread::hardware_concurrency(), 2u, 4u);
+  }
+
+  std::atomic<std::uint64_t> g_checksum = 0u;
+
+  // The operations and the duration of a workload. The latencies are written by the workload.
+  struct Run
+  {
+    std::size_t m_operations = 0u;
+    std::chrono::steady_clock::duration m_duration{};
+  };
+
+  // Build a complete binary tree of 10M nodes and drop it.
+  template<class t_policy>
+  struct TreeNode: t_policy::template Base<TreeNode<t_policy>>
+  {
+    using Shared = typename t_policy::template Shared<TreeNode>;
+
+    // Build the subtree of the index in pre-order, and write the latency of each creation.
+    static Shared
+    build(std::size_t const p_index, std::uint64_t * const p_latencies)
+    {
+      std::uint64_t const start = cycles();
+      Shared node = t_policy::template make<TreeNode>();
+      p_latencies[p_index] = cycles() - start;
+      node->m_value = p_index;
+      if (2u * p_index + 1u < s_tree_nodes)
+      {
+        node->m_left = build(2u * p_index + 1u, p_latencies);
+      }
+      if (2u * p_index + 2u < s_tree_nodes)
+      {
+        node->m_right = build(2u * p_index + 2u, p_latencies);
+      }
+      return node;
+    }
+
+    Shared m_left;
+    Shared m_right;
+    std::uint64_t m_value = 0u;
+  };
+
+  template<class t_policy>
+  Run
+  tree(std::vector<std::uint64_t> & p_latencies)
+  {
+    auto const start = std::chrono::steady_clock::now();
+    auto root = TreeNode<t_policy>::build(0u, p_latencies.data());
+    root.reset();
+    return {s_tree_nodes, std::chrono::steady_clock::now() - start};
+  }
+
+  // Search a graph shared by concurrent threads breadth-first.
+  template<class t_policy>
+  struct GraphNode: t_policy::template Base<GraphNode<t_policy>>
+  {
+    std::vector<typename t_policy::template Shared<GraphNode>> m_edges;
+    std::uint32_t m_index = 0u;
+  };
+
+  // The edges only lead to nodes with a higher index, so the graph has no cycles to leak.
+  template<class t_policy>
+  std::vector<typename t_policy::template Shared<GraphNode<t_policy>>>
+  make_graph()
+  {
+    std::vector<typename t_policy::template Shared<GraphNode<t_policy>>> nodes(s_graph_nodes);
+    for (std::size_t i = 0u; i < s_graph_nodes; ++i)
+    {
+      nodes[i] = t_policy::template make<GraphNode<t_policy>>();
+      nodes[i]->m_index = static_cast<std::uint32_t>(i);
+    }
+    std::mt19937_64 random(12345u);
+    for (std::size_t i = 0u; i + 1u < s_graph_nodes; ++i)
+    {
+      std::uniform_int_distribution<std::size_t> target(i + 1u, s_graph_nodes - 1u);
+      for (std::size_t e = 0u; e < s_graph_edges; ++e)
+      {
+        nodes[i]->m_edges.push_back(nodes[target(random)]);
+      }
+    }
+    return nodes;
+  }
+
+  // Copy the shared pointers of the reached nodes into the queue, like a traversal which may
+  // outlive concurrent changes of the graph, and return the number of reached nodes.
+  template<class t_policy>
+  std::size_t
+  search(typename t_policy::template Shared<GraphNode<t_policy>> const & p_root,
+         std::vector<std::uint32_t> & p_visited,
+         std::uint32_t const p_stamp)
+  {
+    std::deque<typename t_policy::template Shared<GraphNode<t_policy>>> queue;
+    queue.push_back(p_root);
+    p_visited[p_root->m_index] = p_stamp;
+    std::size_t reached = 0u;
+    while (!queue.empty())
+    {
+      auto node = std::move(queue.front());
+      queue.pop_front();
+      ++reached;
+      for (auto const & edge : node->m_edges)
+      {
+        if (p_visited[edge->m_index] != p_stamp)
+        {
+          p_visited[edge->m_index] = p_stamp;
+          queue.push_back(edge);
+        }
+      }
+    }
+    return reached;
+  }
+
+  template<class t_policy>
+  Run
+  graph(std::vector<std::uint64_t> & p_latencies)
+  {
+    auto const nodes = make_graph<t_policy>();
+    std::size_t const threads = thread_count();
+    std::atomic<std::size_t> reached = 0u;
+    auto const start = std::chrono::steady_clock::now();
+    std::vector<std::thread> workers;
+    for (std::size_t t = 0u; t < threads; ++t)
+    {
+      workers.emplace_back(
+        [&nodes, &reached, &p_latencies, t]() noexcept
+        {
+          std::mt19937_64 random(t + 1u);
+          std::uniform_int_distribution<std::size_t> root(0u, 1023u);
+          std::vector<std::uint32_t> visited(s_graph_nodes);
+          std::size_t local = 0u;
+          for (std::size_t i = 0u; i < s_searches; ++i)
+          {
+            std::uint64_t const begin = cycles();
+            local += search<t_policy>(nodes[root(random)], visited, static_cast<std::uint32_t>(i + 1u));
+            p_latencies[t * s_searches + i] = cycles() - begin;
+          }
+          reached += local;
+        });
+    }
+    for (std::thread & worker : workers)
+    {
+      worker.join();
+    }
+    return {reached, std::chrono::steady_clock::now() - start};
+  }
+
+  // Publish messages to subscriber threads which share each message.
+  template<class t_policy>
+  struct Message: t_policy::template Base<Message<t_policy>>
+  {
+    std::uint64_t m_published = 0u;
+    std::uint64_t m_payload[6] = {};
+  };
+
+  // A bounded queue with a mutex, used for both pointer types.
+  template<class t_policy>
+  class Inbox
+  {
+  public:
+    using Shared = typename t_policy::template Shared<Message<t_policy>>;
+
+    void
+    push(Shared p_message)
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_changed.wait(lock, [this] { return m_messages.size() < s_inbox_capacity; });
+      m_messages.push_back(std::move(p_message));
+      m_changed.notify_all();
+    }
+
+    Shared
+    pop()
+    {
+      std::unique_lock<std::mutex> lock(m_mutex);
+      m_changed.wait(lock, [this] { return !m_messages.empty(); });
+      Shared message = std::move(m_messages.front());
+      m_messages.pop_front();
+      m_changed.notify_all();
+      return message;
+    }
+
+  private:
+    std::mutex m_mutex;
+    std::condition_variable m_changed;
+    std::deque<Shared> m_messages;
+  };
+
+  // The latency of each delivery is measured from the publication to the subscriber reading it.
+  template<class t_policy>
+  Run
+  fan_out(std::vector<std::uint64_t> & p_latencies)
+  {
+    std::vector<Inbox<t_policy>> inboxes(s_subscribers);
+    auto const start = std::chrono::steady_clock::now();
+    std::vector<std::thread> subscribers;
+    for (std::size_t s = 0u; s < s_subscribers; ++s)
+    {
+      subscribers.emplace_back(
+        [&inboxes, &p_latencies, s]() noexcept
+        {
+          std::uint64_t * const latencies = p_latencies.data() + s * s_messages;
+          std::uint64_t sum = 0u;
+          for (std::size_t i = 0u;; ++i)
+          {
+            auto const message = inboxes[s].pop();
+            if (message == nullptr)
+            {
+              break;
+            }
+            for (std::uint64_t const value : message->m_payload)
+            {
+              sum += value;
+            }
+            latencies[i] = cycles() - message->m_published;
+          }
+          g_checksum += sum;
+        });
+    }
+    for (std::size_t i = 0u; i < s_messages; ++i)
+    {
+      auto message = t_policy::template make<Message<t_policy>>();
+      message->m_payload[i % 6u] = i;
+      message->m_published = cycles();
+      for (Inbox<t_policy> & inbox : inboxes)
+      {
+        inbox.push(message);
+      }
+    }
+    for (Inbox<t_policy> & inbox : inboxes)
+    {
+      inbox.push(nullptr);
+    }
+    for (std::thread & subscriber : subscribers)
+    {
+      subscriber.join();
+    }
+    return {s_messages * s_subscribers, std::chrono::steady_clock::now() - start};
+  }
+
+  // Look up values in a cache with weak values, kept alive by an LRU ring buffer.
+  template<class t_policy>
+  struct Value: t_policy::template Base<Value<t_policy>>
+  {
+    std::uint64_t m_key = 0u;
+    std::uint64_t m_payload[7] = {};
+  };
+
+  // Log-uniform keys, so few keys are looked up often and many keys rarely.
+  std::vector<std::uint32_t>
+  make_keys()
+  {
+    std::mt19937_64 random(12345u);
+    std::uniform_real_distribution<double> exponent(0.0, 1.0);
+    std::vector<std::uint32_t> keys(s_lookups);
+    for (std::uint32_t & key : keys)
+    {
+      key = static_cast<std::uint32_t>(std::pow(static_cast<double>(s_cache_keys), exponent(random))) - 1u;
+    }
+    return keys;
+  }
+
+  // The map only holds weak pointers, so a value lives as long as the ring buffer of recently used
+  // values or any other owner references it. Expired values are created again.
+  template<class t_policy>
+  Run
+  cache(std::vector<std::uint64_t> & p_latencies)
+  {
+    std::vector<std::uint32_t> const keys = make_keys();
+    std::unordered_map<std::uint32_t, typename t_policy::template Weak<Value<t_policy>>> map;
+    map.reserve(s_cache_keys);
+    std::vector<typename t_policy::template Shared<Value<t_policy>>> recent(s_cache_capacity);
+    std::uint64_t sum = 0u;
+    auto const start = std::chrono::steady_clock::now();
+    for (std::size_t i = 0u; i < s_lookups; ++i)
+    {
+      std::uint64_t const begin = cycles();
+      auto & weak = map[keys[i]];
+      auto value = weak.lock();
+      if (value == nullptr)
+      {
+        value = t_policy::template make<Value<t_policy>>();
+        value->m_key = keys[i];
+        weak = value;
+      }
+      sum += value->m_key;
+      recent[i % s_cache_capacity] = std::move(value);
+      p_latencies[i] = cycles() - begin;
+    }
+    recent.clear();
+    map.clear();
+    g_checksum += sum;
+    return {s_lookups, std::chrono::steady_clock::now() - start};
+  }
+
+  // The report.
+
+  std::uint64_t
+  percentile(std::vector<std::uint64_t> & p_latencies, double const p_fraction)
+  {
+    auto const position = p_latencies.begin() + static_cast<std::ptrdiff_t>(
+                                                  p_fraction * static_cast<double>(p_latencies.size() - 1u));
+    std::nth_element(p_latencies.begin(), position, p_latencies.end());
+    return *position;
+  }
+
+  // Run the workload with a new peak resident set size, and print its throughput, the growth of
+  // the peak resident set size, and the percentiles of the latencies.
+  template<class t_policy>
+  void
+  measure(char const * const p_name, std::size_t const p_latencies, Run (*p_workload)(std::vector<std::uint64_t> &))
+  {
+    // The latencies are written once before the baseline, so their pages are resident already.
+    std::vector<std::uint64_t> latencies(p_latencies);
+    trim_heap();
+    reset_peak_resident();
+    std::size_t const baseline = resident_bytes();
+    Run const run = p_workload(latencies);
+    std::size_t const peak = peak_resident_bytes();
+
+    double const seconds = std::chrono::duration<double>(run.m_duration).count();
+    std::cout << std::left << std::setw(10) << p_name << std::setw(6) << t_policy::s_name << std::right << std::fixed
+              << std::setprecision(2) << std::setw(12) << static_cast<double>(run.m_operations) / seconds / 1e6
+              << std::setprecision(1) << std::setw(12)
+              << (peak > baseline ? static_cast<double>(peak - baseline) / (1024.0 * 1024.0) : 0.0) << std::setw(12)
+              << percentile(latencies, 0.5) << std::setw(12) << percentile(latencies, 0.99) << std::setw(12)
+              << percentile(latencies, 0.999) << std::endl;
+  }
+} // namespace
+
+
+// Each workload runs with 'pntr' and with the standard shared and weak pointers. The throughput is
+// in millions of operations per second, and the latencies are in cycles, or nanoseconds if the time
+// stamp counter is unavailable. The operations are the tree nodes, the nodes reached by the
+// searches, the delivered messages, and the cache lookups. The latencies are measured per created
+// tree node, per search, per delivered message, and per lookup.
+TEST_CASE("Macro benchmark")
+{
+  std::cout << "\n"
+            << std::left << std::setw(10) << "workload" << std::setw(6) << "ptr" << std::right << std::setw(12)
+            << "Mops/s" << std::setw(12) << "peak MB" << std::setw(12) << "p50" << std::setw(12) << "p99"
+            << std::setw(12) << "p99.9" << std::endl;
+  if (!reset_peak_resident())
+  {
+    std::cout << "The peak resident set size can't be reset, so it only grows." << std::endl;
+  }
+
+  measure<Pntr>("tree", s_tree_nodes, &tree<Pntr>);
+  measure<Std>("tree", s_tree_nodes, &tree<Std>);
+  measure<Pntr>("graph", thread_count() * s_searches, &graph<Pntr>);
+  measure<Std>("graph", thread_count() * s_searches, &graph<Std>);
+  measure<Pntr>("fan-out", s_subscribers * s_messages, &fan_out<Pntr>);
+  measure<Std>("fan-out", s_subscribers * s_messages, &fan_out<Std>);
+  measure<Pntr>("cache", s_lookups, &cache<Pntr>);
+  measure<Std>("cache", s_lookups, &cache<Std>);
+}
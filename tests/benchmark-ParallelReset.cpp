@@ -0,0 +1,48 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "benchmark-counters.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <string>
+#include <vector>
+
+
+namespace
+{
+  struct Object: pntr::IntruderNew<Object>
+  {
+    std::uint64_t m_value = 1u;
+  };
+} // namespace
+
+
+// Resetting a range frees one allocation per object, so the scaling depends on the allocator
+// as much as on the threads.
+TEST_CASE("ParallelReset benchmark")
+{
+  for (std::size_t threads = 1u; threads <= 16u; threads *= 2u)
+  {
+    BENCHMARK_ADVANCED("parallel_reset, 1000000 objects on " + std::to_string(threads) + " threads")
+    (Catch::Benchmark::Chronometer p_meter)
+    {
+      std::vector<std::vector<pntr::SharedPtr<Object>>> runs(static_cast<std::size_t>(p_meter.runs()));
+      for (std::vector<pntr::SharedPtr<Object>> & objects : runs)
+      {
+        objects.resize(1000000u);
+        for (pntr::SharedPtr<Object> & object : objects)
+        {
+          object = pntr::make_shared<Object>();
+        }
+      }
+      measure_counted(p_meter,
+        [&runs, threads](int const p_run)
+        {
+          std::vector<pntr::SharedPtr<Object>> & objects = runs[static_cast<std::size_t>(p_run)];
+          pntr::ThreadExecutor executor(threads);
+          pntr::parallel_reset(objects.begin(), objects.end(), executor);
+        });
+    };
+  }
+}
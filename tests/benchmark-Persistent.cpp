@@ -0,0 +1,439 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "benchmark-counters.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <array>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <vector>
+
+
+// Count the currently allocated bytes and blocks. Every block has a header storing its size.
+struct AllocationCounter
+{
+  static constexpr std::size_t s_header = alignof(std::max_align_t);
+
+  inline static std::size_t s_bytes = 0u;
+  inline static std::size_t s_blocks = 0u;
+
+  static void *
+  allocate(std::size_t const p_size)
+  {
+    void * const block = std::malloc(p_size + s_header);
+    if (block == nullptr)
+    {
+      return nullptr;
+    }
+    *static_cast<std::size_t *>(block) = p_size;
+    s_bytes += p_size;
+    ++s_blocks;
+    return static_cast<std::byte *>(block) + s_header;
+  }
+
+  static void
+  deallocate(void * const p_pointer) noexcept
+  {
+    void * const block = static_cast<std::byte *>(p_pointer) - s_header;
+    s_bytes -= *static_cast<std::size_t *>(block);
+    --s_blocks;
+    std::free(block);
+  }
+};
+
+
+// A counting allocator for the nodes of the persistent pntr containers.
+class CountingMalloc
+{
+public:
+  using SupportsStatic = pntr::NoStaticSupport;
+  using PointerDeallocate = void;
+
+  void *
+  allocate(std::size_t const p_size, std::size_t) noexcept
+  {
+    return AllocationCounter::allocate(p_size);
+  }
+
+#ifdef _WIN32
+  void
+  deallocate(void * const p_pointer, bool) noexcept
+#else
+  void
+  deallocate(void * const p_pointer) noexcept
+#endif
+  {
+    AllocationCounter::deallocate(p_pointer);
+  }
+};
+
+
+// A counting allocator for 'std::allocate_shared'.
+template<class t_type>
+class CountingAllocator
+{
+public:
+  using value_type = t_type;
+
+  CountingAllocator() noexcept = default;
+
+  template<class t_other>
+  CountingAllocator(CountingAllocator<t_other> const &) noexcept
+  {}
+
+  t_type *
+  allocate(std::size_t const p_count)
+  {
+    void * const storage = AllocationCounter::allocate(p_count * sizeof(t_type));
+    if (storage == nullptr)
+    {
+      throw std::bad_alloc();
+    }
+    return static_cast<t_type *>(storage);
+  }
+
+  void
+  deallocate(t_type * const p_pointer, std::size_t) noexcept
+  {
+    AllocationCounter::deallocate(p_pointer);
+  }
+
+  template<class t_other>
+  bool
+  operator==(CountingAllocator<t_other> const &) const noexcept
+  {
+    return true;
+  }
+
+  template<class t_other>
+  bool
+  operator!=(CountingAllocator<t_other> const &) const noexcept
+  {
+    return false;
+  }
+};
+
+
+// A persistent vector with the same trie layout as 'pntr::PersistentVector', but without a tail
+// and using 'std::shared_ptr' nodes. It only supports the operations used by the benchmark.
+template<typename t_value>
+class StdPersistentVector
+{
+  static constexpr unsigned s_bits = 5u;
+  static constexpr std::size_t s_width = std::size_t{1u} << s_bits;
+  static constexpr std::size_t s_mask = s_width - 1u;
+
+  struct Leaf
+  {
+    std::array<t_value, s_width> m_values{};
+  };
+
+  struct Branch
+  {
+    std::array<std::shared_ptr<void>, s_width> m_children;
+  };
+
+public:
+  std::size_t
+  size() const noexcept
+  {
+    return m_size;
+  }
+
+  t_value const &
+  operator[](std::size_t const p_index) const noexcept
+  {
+    void const * node = m_root.get();
+    for (unsigned level = m_shift; level > 0u; level -= s_bits)
+    {
+      node = static_cast<Branch const *>(node)->m_children[(p_index >> level) & s_mask].get();
+    }
+    return static_cast<Leaf const *>(node)->m_values[p_index & s_mask];
+  }
+
+  StdPersistentVector
+  push_back(t_value const & p_value) const
+  {
+    StdPersistentVector result(*this);
+    if (!m_root)
+    {
+      result.m_root = make<Leaf>();
+    }
+    else if (m_size == (std::size_t{s_width} << m_shift))
+    {
+      auto root = make<Branch>();
+      root->m_children[0u] = m_root;
+      result.m_root = std::move(root);
+      result.m_shift += s_bits;
+    }
+    result.m_root = update(result.m_root, result.m_shift, m_size, p_value);
+    ++result.m_size;
+    return result;
+  }
+
+  StdPersistentVector
+  set(std::size_t const p_index, t_value const & p_value) const
+  {
+    StdPersistentVector result(*this);
+    result.m_root = update(m_root, m_shift, p_index, p_value);
+    return result;
+  }
+
+private:
+  template<class t_node>
+  static std::shared_ptr<t_node>
+  make(t_node const & p_node = t_node())
+  {
+    return std::allocate_shared<t_node>(CountingAllocator<t_node>(), p_node);
+  }
+
+  static std::shared_ptr<void>
+  update(std::shared_ptr<void> const & p_node, unsigned const p_level, std::size_t const p_index,
+         t_value const & p_value)
+  {
+    if (p_level == 0u)
+    {
+      auto leaf = (p_node ? make<Leaf>(*static_cast<Leaf const *>(p_node.get())) : make<Leaf>());
+      leaf->m_values[p_index & s_mask] = p_value;
+      return leaf;
+    }
+    auto branch = (p_node ? make<Branch>(*static_cast<Branch const *>(p_node.get())) : make<Branch>());
+    std::shared_ptr<void> & child = branch->m_children[(p_index >> p_level) & s_mask];
+    child = update(child, p_level - s_bits, p_index, p_value);
+    return branch;
+  }
+
+  std::size_t m_size{};
+  unsigned m_shift{};
+  std::shared_ptr<void> m_root;
+};
+
+
+// A hash array mapped trie using 'std::shared_ptr' nodes with separately allocated arrays for the
+// entries and sub-nodes. It only supports setting keys with unique hash values.
+template<typename t_key, typename t_value>
+class StdPersistentMap
+{
+  template<class t_type>
+  using Vector = std::vector<t_type, CountingAllocator<t_type>>;
+
+  struct Node
+  {
+    std::uint32_t m_datamap{};
+    std::uint32_t m_nodemap{};
+    Vector<std::pair<t_key, t_value>> m_entries;
+    Vector<std::shared_ptr<Node>> m_children;
+  };
+
+public:
+  t_value const *
+  find(t_key const & p_key) const
+  {
+    std::size_t const hash = std::hash<t_key>()(p_key);
+    Node const * node = m_root.get();
+    for (unsigned shift = 0u; node != nullptr; shift += 5u)
+    {
+      std::uint32_t const bit = std::uint32_t{1u} << ((hash >> shift) & 31u);
+      if ((node->m_datamap & bit) != 0u)
+      {
+        auto const & entry = node->m_entries[pntr::detail::popcount(node->m_datamap & (bit - 1u))];
+        return (entry.first == p_key ? &entry.second : nullptr);
+      }
+      if ((node->m_nodemap & bit) == 0u)
+      {
+        return nullptr;
+      }
+      node = node->m_children[pntr::detail::popcount(node->m_nodemap & (bit - 1u))].get();
+    }
+    return nullptr;
+  }
+
+  StdPersistentMap
+  set(t_key const & p_key, t_value const & p_value) const
+  {
+    StdPersistentMap result;
+    result.m_root = insert(m_root.get(), 0u, std::hash<t_key>()(p_key), {p_key, p_value});
+    return result;
+  }
+
+private:
+  static std::shared_ptr<Node>
+  make(Node const & p_node)
+  {
+    return std::allocate_shared<Node>(CountingAllocator<Node>(), p_node);
+  }
+
+  static std::shared_ptr<Node>
+  insert(Node const * const p_node, unsigned const p_shift, std::size_t const p_hash,
+         std::pair<t_key, t_value> const & p_entry)
+  {
+    auto node = (p_node != nullptr ? make(*p_node) : make(Node()));
+    std::uint32_t const bit = std::uint32_t{1u} << ((p_hash >> p_shift) & 31u);
+    unsigned const data_index = pntr::detail::popcount(node->m_datamap & (bit - 1u));
+    unsigned const node_index = pntr::detail::popcount(node->m_nodemap & (bit - 1u));
+    if ((node->m_nodemap & bit) != 0u)
+    {
+      node->m_children[node_index] = insert(node->m_children[node_index].get(), p_shift + 5u, p_hash, p_entry);
+    }
+    else if ((node->m_datamap & bit) != 0u && node->m_entries[data_index].first == p_entry.first)
+    {
+      node->m_entries[data_index].second = p_entry.second;
+    }
+    else if ((node->m_datamap & bit) != 0u)
+    {
+      auto const existing = node->m_entries[data_index];
+      std::shared_ptr<Node> child = insert(nullptr, p_shift + 5u, std::hash<t_key>()(existing.first), existing);
+      child = insert(child.get(), p_shift + 5u, p_hash, p_entry);
+      node->m_entries.erase(node->m_entries.begin() + data_index);
+      node->m_children.insert(node->m_children.begin() + node_index, std::move(child));
+      node->m_datamap &= ~bit;
+      node->m_nodemap |= bit;
+    }
+    else
+    {
+      node->m_entries.insert(node->m_entries.begin() + data_index, p_entry);
+      node->m_datamap |= bit;
+    }
+    return node;
+  }
+
+  std::shared_ptr<Node> m_root;
+};
+
+
+using PntrVector = pntr::PersistentVector<std::uint32_t, pntr::ThreadSafe, std::uint8_t, CountingMalloc>;
+using PntrMap = pntr::PersistentMap<std::uint64_t, std::uint32_t, std::hash<std::uint64_t>,
+                                    std::equal_to<std::uint64_t>, pntr::ThreadSafe, std::uint8_t, CountingMalloc>;
+using StdVector = StdPersistentVector<std::uint32_t>;
+using StdMap = StdPersistentMap<std::uint64_t, std::uint32_t>;
+
+constexpr std::size_t g_size = 100000u;
+constexpr std::size_t g_versions = 1000u;
+
+
+// Build a container with 'g_size' values, keep 'g_versions' versions with one modified value each,
+// and print the allocated memory.
+template<class t_vector>
+void
+report_vector_memory(char const * const p_name)
+{
+  std::size_t const bytes = AllocationCounter::s_bytes;
+  std::size_t const blocks = AllocationCounter::s_blocks;
+  {
+    t_vector v;
+    for (std::size_t i = 0u; i < g_size; ++i)
+    {
+      v = v.push_back(static_cast<std::uint32_t>(i));
+    }
+    std::size_t const single = AllocationCounter::s_bytes - bytes;
+    std::vector<t_vector> versions(1u, v);
+    for (std::size_t i = 1u; i < g_versions; ++i)
+    {
+      versions.push_back(versions.back().set(static_cast<std::size_t>(std::rand()) % g_size, 0u));
+    }
+    std::printf("%-28s %10zu bytes for one vector, %10zu bytes and %7zu blocks for %zu versions\n", p_name,
+                single, AllocationCounter::s_bytes - bytes, AllocationCounter::s_blocks - blocks, g_versions);
+  }
+  REQUIRE(AllocationCounter::s_bytes == bytes);
+}
+
+template<class t_map>
+void
+report_map_memory(char const * const p_name)
+{
+  std::size_t const bytes = AllocationCounter::s_bytes;
+  std::size_t const blocks = AllocationCounter::s_blocks;
+  {
+    t_map m;
+    for (std::size_t i = 0u; i < g_size; ++i)
+    {
+      m = m.set(i * 0x9E3779B97F4A7C15u, static_cast<std::uint32_t>(i));
+    }
+    std::size_t const single = AllocationCounter::s_bytes - bytes;
+    std::vector<t_map> versions(1u, m);
+    for (std::size_t i = 1u; i < g_versions; ++i)
+    {
+      std::size_t const key = (static_cast<std::size_t>(std::rand()) % g_size) * 0x9E3779B97F4A7C15u;
+      versions.push_back(versions.back().set(key, 0u));
+    }
+    std::printf("%-28s %10zu bytes for one map,    %10zu bytes and %7zu blocks for %zu versions\n", p_name,
+                single, AllocationCounter::s_bytes - bytes, AllocationCounter::s_blocks - blocks, g_versions);
+  }
+  REQUIRE(AllocationCounter::s_bytes == bytes);
+}
+
+
+TEST_CASE("Persistent container memory")
+{
+  report_vector_memory<PntrVector>("pntr::PersistentVector");
+  report_vector_memory<StdVector>("std::shared_ptr vector");
+  report_map_memory<PntrMap>("pntr::PersistentMap");
+  report_map_memory<StdMap>("std::shared_ptr map");
+}
+
+
+TEST_CASE("Persistent container benchmark")
+{
+  BENCHMARK_COUNTED("pntr::PersistentVector push_back")
+  {
+    PntrVector v;
+    for (std::uint32_t i = 0u; i < 10000u; ++i)
+    {
+      v = v.push_back(i);
+    }
+    return v.size();
+  };
+
+  BENCHMARK_COUNTED("pntr::PersistentVector::Transient push_back")
+  {
+    PntrVector::Transient t;
+    for (std::uint32_t i = 0u; i < 10000u; ++i)
+    {
+      t.push_back(i);
+    }
+    return std::move(t).persistent().size();
+  };
+
+  BENCHMARK_COUNTED("std::shared_ptr vector push_back")
+  {
+    StdVector v;
+    for (std::uint32_t i = 0u; i < 10000u; ++i)
+    {
+      v = v.push_back(i);
+    }
+    return v.size();
+  };
+
+  BENCHMARK_COUNTED("pntr::PersistentMap set")
+  {
+    PntrMap m;
+    for (std::uint64_t i = 0u; i < 10000u; ++i)
+    {
+      m = m.set(i * 0x9E3779B97F4A7C15u, static_cast<std::uint32_t>(i));
+    }
+    return m.size();
+  };
+
+  BENCHMARK_COUNTED("pntr::PersistentMap::Transient set")
+  {
+    PntrMap::Transient t;
+    for (std::uint64_t i = 0u; i < 10000u; ++i)
+    {
+      t.set(i * 0x9E3779B97F4A7C15u, static_cast<std::uint32_t>(i));
+    }
+    return std::move(t).persistent().size();
+  };
+
+  BENCHMARK_COUNTED("std::shared_ptr map set")
+  {
+    StdMap m;
+    for (std::uint64_t i = 0u; i < 10000u; ++i)
+    {
+      m = m.set(i * 0x9E3779B97F4A7C15u, static_cast<std::uint32_t>(i));
+    }
+    return m.find(0u) != nullptr;
+  };
+}
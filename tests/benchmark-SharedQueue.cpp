@@ -0,0 +1,298 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "benchmark-counters.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <atomic>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+  struct Message: pntr::IntruderNew<Message>
+  {
+    std::uint64_t m_value = 1u;
+  };
+
+  struct StdMessage
+  {
+    std::uint64_t m_value = 1u;
+  };
+
+  // A locked queue of 'std::shared_ptr', as a baseline for the lock-free queues.
+  struct StdQueue
+  {
+    std::mutex m_mutex;
+    std::deque<std::shared_ptr<StdMessage>> m_queue;
+  };
+
+  // The ring of 'SharedQueue' with 'std::shared_ptr' slots, which are moved in and out, as a
+  // baseline which differs from 'SharedQueue' only in the pointer type.
+  class StdRing
+  {
+  public:
+    explicit StdRing(std::size_t const p_capacity)
+    : m_mask(ceil_capacity(p_capacity) - 1u)
+    , m_slots(new Slot[m_mask + 1u])
+    {
+      for (std::size_t i = 0u; i <= m_mask; ++i)
+      {
+        m_slots[i].m_sequence.store(i, std::memory_order_relaxed);
+      }
+    }
+
+    bool
+    try_push(std::shared_ptr<StdMessage> & p_shared) noexcept
+    {
+      std::size_t position = m_tail.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        Slot & slot = m_slots[position & m_mask];
+        auto const difference =
+          static_cast<std::ptrdiff_t>(slot.m_sequence.load(std::memory_order_acquire) - position);
+        if (difference == 0)
+        {
+          if (m_tail.compare_exchange_weak(position, position + 1u, std::memory_order_relaxed))
+          {
+            slot.m_shared = std::move(p_shared);
+            slot.m_sequence.store(position + 1u, std::memory_order_release);
+            return true;
+          }
+        }
+        else if (difference < 0)
+        {
+          return false;
+        }
+        else
+        {
+          position = m_tail.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+    std::shared_ptr<StdMessage>
+    try_pop() noexcept
+    {
+      std::size_t position = m_head.load(std::memory_order_relaxed);
+      for (;;)
+      {
+        Slot & slot = m_slots[position & m_mask];
+        auto const difference =
+          static_cast<std::ptrdiff_t>(slot.m_sequence.load(std::memory_order_acquire) - (position + 1u));
+        if (difference == 0)
+        {
+          if (m_head.compare_exchange_weak(position, position + 1u, std::memory_order_relaxed))
+          {
+            std::shared_ptr<StdMessage> shared = std::move(slot.m_shared);
+            slot.m_sequence.store(position + m_mask + 1u, std::memory_order_release);
+            return shared;
+          }
+        }
+        else if (difference < 0)
+        {
+          return nullptr;
+        }
+        else
+        {
+          position = m_head.load(std::memory_order_relaxed);
+        }
+      }
+    }
+
+  private:
+    struct Slot
+    {
+      std::atomic<std::size_t> m_sequence;
+      std::shared_ptr<StdMessage> m_shared;
+    };
+
+    static std::size_t
+    ceil_capacity(std::size_t const p_capacity) noexcept
+    {
+      std::size_t capacity = 2u;
+      while (capacity < p_capacity)
+      {
+        capacity <<= 1u;
+      }
+      return capacity;
+    }
+
+    std::size_t const m_mask;
+    std::unique_ptr<Slot[]> const m_slots;
+    alignas(64) std::atomic<std::size_t> m_tail{0u};
+    alignas(64) std::atomic<std::size_t> m_head{0u};
+  };
+
+  bool
+  push(pntr::SharedQueue<Message> & p_queue, pntr::SharedPtr<Message> & p_message)
+  {
+    return p_queue.try_push(p_message);
+  }
+
+  bool
+  push(pntr::SharedQueueMpsc<Message> & p_queue, pntr::SharedPtr<Message> & p_message)
+  {
+    p_queue.push(p_message);
+    return true;
+  }
+
+  bool
+  push(StdRing & p_queue, std::shared_ptr<StdMessage> & p_message)
+  {
+    return p_queue.try_push(p_message);
+  }
+
+  bool
+  push(StdQueue & p_queue, std::shared_ptr<StdMessage> & p_message)
+  {
+    std::lock_guard<std::mutex> const lock(p_queue.m_mutex);
+    p_queue.m_queue.push_back(std::move(p_message));
+    return true;
+  }
+
+  template<class t_queue>
+  auto
+  pop(t_queue & p_queue)
+  {
+    return p_queue.try_pop();
+  }
+
+  std::shared_ptr<StdMessage>
+  pop(StdQueue & p_queue)
+  {
+    std::lock_guard<std::mutex> const lock(p_queue.m_mutex);
+    if (p_queue.m_queue.empty())
+    {
+      return nullptr;
+    }
+    std::shared_ptr<StdMessage> message = std::move(p_queue.m_queue.front());
+    p_queue.m_queue.pop_front();
+    return message;
+  }
+
+  // Each producer pushes its messages, and the consumers collect them, so the messages are neither
+  // allocated nor destroyed while the pipeline runs. Afterwards they are returned to the producers.
+  template<class t_queue, class t_pointer>
+  std::uint64_t
+  run_pipeline(t_queue & p_queue, std::vector<std::vector<t_pointer>> & p_messages, unsigned const p_consumers)
+  {
+    std::size_t const total = p_messages.size() * p_messages.front().size();
+    std::vector<std::vector<t_pointer>> collected(p_consumers);
+    std::atomic<std::size_t> popped{0u};
+    std::vector<std::thread> threads;
+    for (std::vector<t_pointer> & messages : p_messages)
+    {
+      threads.emplace_back(
+        [&p_queue, &messages]() noexcept
+        {
+          for (t_pointer & message : messages)
+          {
+            while (!push(p_queue, message))
+            {
+              std::this_thread::yield();
+            }
+          }
+        });
+    }
+    for (std::vector<t_pointer> & sink : collected)
+    {
+      sink.reserve(total);
+      threads.emplace_back(
+        [&p_queue, &popped, &sink, total]() noexcept
+        {
+          while (popped.load(std::memory_order_relaxed) < total)
+          {
+            t_pointer message = pop(p_queue);
+            if (message != nullptr)
+            {
+              sink.push_back(std::move(message));
+              popped.fetch_add(1u, std::memory_order_relaxed);
+            }
+            else
+            {
+              std::this_thread::yield();
+            }
+          }
+        });
+    }
+    for (std::thread & thread : threads)
+    {
+      thread.join();
+    }
+    std::uint64_t sum = 0u;
+    std::size_t index = 0u;
+    for (std::vector<t_pointer> & sink : collected)
+    {
+      for (t_pointer & message : sink)
+      {
+        sum += message->m_value;
+        std::vector<t_pointer> & messages = p_messages[index % p_messages.size()];
+        messages[index / p_messages.size()] = std::move(message);
+        ++index;
+      }
+    }
+    return sum;
+  }
+
+  template<class t_pointer, class t_make>
+  std::vector<std::vector<t_pointer>>
+  make_messages(unsigned const p_producers, t_make && p_make)
+  {
+    std::vector<std::vector<t_pointer>> messages(p_producers);
+    for (std::vector<t_pointer> & producer : messages)
+    {
+      for (unsigned i = 0u; i < 100000u; ++i)
+      {
+        producer.push_back(p_make());
+      }
+    }
+    return messages;
+  }
+} // namespace
+
+
+// The lock-free queues move the references of 'SharedPtr' as raw pointers. Moving a
+// 'std::shared_ptr' doesn't touch its counter either, but copies two pointers into and out of the
+// slots of the same lock-free ring, or needs the lock of the locked queue.
+TEST_CASE("SharedQueue benchmark")
+{
+  for (unsigned threads = 1u; threads <= 4u; threads *= 2u)
+  {
+    std::string const suffix = ", 100000 messages per producer, " + std::to_string(threads) + " producers, ";
+    auto messages = make_messages<pntr::SharedPtr<Message>>(threads, []() { return pntr::make_shared<Message>(); });
+    auto std_messages =
+      make_messages<std::shared_ptr<StdMessage>>(threads, []() { return std::make_shared<StdMessage>(); });
+
+    BENCHMARK_COUNTED("SharedQueue" + suffix + std::to_string(threads) + " consumers")
+    {
+      pntr::SharedQueue<Message> queue(1024u);
+      return run_pipeline(queue, messages, threads);
+    };
+
+    BENCHMARK_COUNTED("SharedQueueMpsc" + suffix + "1 consumer")
+    {
+      pntr::SharedQueueMpsc<Message> queue;
+      return run_pipeline(queue, messages, 1u);
+    };
+
+    BENCHMARK_COUNTED("Lock-free ring of std::shared_ptr" + suffix + std::to_string(threads) + " consumers")
+    {
+      StdRing queue(1024u);
+      return run_pipeline(queue, std_messages, threads);
+    };
+
+    BENCHMARK_COUNTED("std::deque of std::shared_ptr with std::mutex" + suffix + std::to_string(threads) + " consumers")
+    {
+      StdQueue queue;
+      return run_pipeline(queue, std_messages, threads);
+    };
+  }
+}
@@ -0,0 +1,122 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "benchmark-counters.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+
+namespace
+{
+  // 1000000 objects of 128 bytes exceed the last level cache of most CPUs.
+  constexpr std::size_t s_objects = 1000000u;
+
+  struct Object: pntr::IntruderNew<Object>
+  {
+    std::uint64_t m_values[15] = {};
+  };
+
+  // Allocate the objects in order, and shuffle the pointers, so each pointer refers to a cold cache line.
+  std::vector<pntr::SharedPtr<Object>>
+  make_shuffled()
+  {
+    std::vector<pntr::SharedPtr<Object>> objects(s_objects);
+    for (pntr::SharedPtr<Object> & object : objects)
+    {
+      object = pntr::make_shared<Object>();
+    }
+    std::shuffle(objects.begin(), objects.end(), std::mt19937(42u));
+    return objects;
+  }
+
+  // Repeat each shuffled pointer in a run, like the rows of a table that refer to shared values.
+  std::vector<pntr::SharedPtr<Object>>
+  make_runs(std::size_t const p_run_length)
+  {
+    std::vector<pntr::SharedPtr<Object>> objects = make_shuffled();
+    objects.resize(s_objects / p_run_length);
+    std::vector<pntr::SharedPtr<Object>> runs;
+    runs.reserve(s_objects);
+    for (pntr::SharedPtr<Object> const & object : objects)
+    {
+      runs.insert(runs.end(), p_run_length, object);
+    }
+    return runs;
+  }
+
+  template<class t_release>
+  void
+  benchmark_release(Catch::Benchmark::Chronometer & p_meter, std::size_t const p_run_length, t_release && p_release)
+  {
+    std::vector<std::vector<pntr::SharedPtr<Object>>> runs(static_cast<std::size_t>(p_meter.runs()));
+    for (std::vector<pntr::SharedPtr<Object>> & objects : runs)
+    {
+      objects = (p_run_length == 1u ? make_shuffled() : make_runs(p_run_length));
+    }
+    measure_counted(p_meter,
+                    [&runs, &p_release](int const p_run) { p_release(runs[static_cast<std::size_t>(p_run)]); });
+  }
+} // namespace
+
+
+TEST_CASE("SharedRange benchmark")
+{
+  BENCHMARK_ADVANCED("Release 1000000 shuffled objects with std::vector::clear")
+  (Catch::Benchmark::Chronometer p_meter)
+  {
+    benchmark_release(p_meter, 1u, [](std::vector<pntr::SharedPtr<Object>> & p_objects) { p_objects.clear(); });
+  };
+
+  BENCHMARK_ADVANCED("Release 1000000 shuffled objects with release_range")
+  (Catch::Benchmark::Chronometer p_meter)
+  {
+    benchmark_release(p_meter, 1u, [](std::vector<pntr::SharedPtr<Object>> & p_objects)
+                      { pntr::release_range(p_objects.begin(), p_objects.end()); });
+  };
+
+  BENCHMARK_ADVANCED("Release 1000000 pointers in runs of 8 with std::vector::clear")
+  (Catch::Benchmark::Chronometer p_meter)
+  {
+    benchmark_release(p_meter, 8u, [](std::vector<pntr::SharedPtr<Object>> & p_objects) { p_objects.clear(); });
+  };
+
+  BENCHMARK_ADVANCED("Release 1000000 pointers in runs of 8 with release_range")
+  (Catch::Benchmark::Chronometer p_meter)
+  {
+    benchmark_release(p_meter, 8u, [](std::vector<pntr::SharedPtr<Object>> & p_objects)
+                      { pntr::release_range(p_objects.begin(), p_objects.end()); });
+  };
+
+  std::vector<pntr::SharedPtr<Object>> const objects = make_shuffled();
+  std::vector<pntr::SharedPtr<Object>> copy(objects.size());
+
+  BENCHMARK_COUNTED("Copy 1000000 shuffled pointers with std::copy")
+  {
+    std::copy(objects.begin(), objects.end(), copy.begin());
+    return copy.back().get();
+  };
+
+  BENCHMARK_COUNTED("Copy 1000000 shuffled pointers with copy_range")
+  {
+    pntr::copy_range(objects.begin(), objects.end(), copy.begin());
+    return copy.back().get();
+  };
+
+  std::vector<pntr::SharedPtr<Object>> const runs = make_runs(8u);
+
+  BENCHMARK_COUNTED("Copy 1000000 pointers in runs of 8 with std::copy")
+  {
+    std::copy(runs.begin(), runs.end(), copy.begin());
+    return copy.back().get();
+  };
+
+  BENCHMARK_COUNTED("Copy 1000000 pointers in runs of 8 with copy_range")
+  {
+    pntr::copy_range(runs.begin(), runs.end(), copy.begin());
+    return copy.back().get();
+  };
+}
@@ -0,0 +1,150 @@
+#include <catch2/catch_test_macros.hpp>
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include "benchmark-counters.hpp"
+
+#include <pntr/pntr.hpp>
+
+#include <cstdio>
+#include <vector>
+
+
+#if defined(__linux__)
+
+namespace
+{
+  struct GraphNode: pntr::IntruderNew<GraphNode>
+  {
+    struct Image
+    {
+      std::uint64_t m_value;
+      pntr::SnapshotPtr<Image> m_left;
+      pntr::SnapshotPtr<Image> m_right;
+    };
+
+    using PntrSnapshot = Image;
+
+    explicit GraphNode(std::uint64_t const p_value) noexcept
+    : m_value(p_value)
+    {}
+
+    void
+    pntr_snapshot(pntr::SnapshotWriter & p_writer, Image & p_image) const
+    {
+      p_image.m_value = m_value;
+      p_writer.link(p_image.m_left, m_left);
+      p_writer.link(p_image.m_right, m_right);
+    }
+
+    std::uint64_t m_value;
+    pntr::SharedPtr<GraphNode> m_left;
+    pntr::SharedPtr<GraphNode> m_right;
+  };
+
+  // A decoded message which describes a node by the indices of its children, like a protobuf.
+  struct Record
+  {
+    std::uint64_t m_value;
+    std::size_t m_left;
+    std::size_t m_right;
+  };
+
+  // A graph where each node links to two earlier nodes, so most nodes have several owners.
+  std::vector<Record>
+  make_records(std::size_t const p_count)
+  {
+    std::vector<Record> records;
+    std::uint64_t random = 12345u;
+    for (std::size_t i = 0u; i < p_count; ++i)
+    {
+      random = random * 6364136223846793005u + 1442695040888963407u;
+      std::size_t const left = (i == 0u ? p_count : static_cast<std::size_t>(random >> 33u) % i);
+      std::size_t const right = (i == 0u ? p_count : i - 1u);
+      records.push_back(Record{random, left, right});
+    }
+    return records;
+  }
+
+  pntr::SharedPtr<GraphNode>
+  rebuild(std::vector<Record> const & p_records)
+  {
+    std::vector<pntr::SharedPtr<GraphNode>> nodes;
+    nodes.reserve(p_records.size());
+    for (Record const & record: p_records)
+    {
+      pntr::SharedPtr<GraphNode> node = pntr::make_shared<GraphNode>(record.m_value);
+      if (record.m_left < nodes.size())
+      {
+        node->m_left = nodes[record.m_left];
+      }
+      if (record.m_right < nodes.size())
+      {
+        node->m_right = nodes[record.m_right];
+      }
+      nodes.push_back(std::move(node));
+    }
+    return nodes.back();
+  }
+
+  // Unlink all nodes before the last reference is released.
+  void
+  destroy(pntr::SharedPtr<GraphNode> p_root)
+  {
+    while (p_root)
+    {
+      pntr::SharedPtr<GraphNode> next = std::move(p_root->m_right);
+      p_root->m_left.reset();
+      p_root = std::move(next);
+    }
+  }
+
+  std::uint64_t
+  sum_values(GraphNode::Image const * p_image)
+  {
+    std::uint64_t sum = 0u;
+    for (; p_image != nullptr; p_image = p_image->m_right.get())
+    {
+      sum += p_image->m_value + (p_image->m_left ? p_image->m_left->m_value : 0u);
+    }
+    return sum;
+  }
+} // namespace
+
+
+TEST_CASE("Snapshot benchmark")
+{
+  std::size_t const count = 100000u;
+  char const * const path = "pntr-benchmark-Snapshot.bin";
+  std::vector<Record> const records = make_records(count);
+  {
+    pntr::SharedPtr<GraphNode> root = rebuild(records);
+    pntr::SnapshotWriter writer;
+    writer.set_root(root);
+    writer.save(path);
+    destroy(std::move(root));
+  }
+
+  BENCHMARK_COUNTED("Rebuild graph of 100000 nodes")
+  {
+    pntr::SharedPtr<GraphNode> root = rebuild(records);
+    std::uint64_t const value = root->m_value;
+    destroy(std::move(root));
+    return value;
+  };
+
+  BENCHMARK_COUNTED("Load snapshot of 100000 nodes")
+  {
+    pntr::Snapshot const snapshot = pntr::Snapshot::load(path);
+    return snapshot.root<GraphNode>()->m_value;
+  };
+
+  BENCHMARK_COUNTED("Load snapshot of 100000 nodes and visit all")
+  {
+    pntr::Snapshot const snapshot = pntr::Snapshot::load(path);
+    return sum_values(snapshot.root<GraphNode>());
+  };
+
+  std::remove(path);
+}
+
+#endif
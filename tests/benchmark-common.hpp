@@ -0,0 +1,118 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <fstream>
+#include <limits>
+#include <string>
+
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 33))
+  #include <malloc.h>
+  #define BENCHMARK_HEAP_STATISTICS 1
+#else
+  #define BENCHMARK_HEAP_STATISTICS 0
+#endif
+
+#ifdef __linux__
+  #include <unistd.h>
+#endif
+
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+  #include <intrin.h>
+  #define BENCHMARK_CYCLES 1
+#elif defined(__x86_64__) || defined(__i386__)
+  #include <x86intrin.h>
+  #define BENCHMARK_CYCLES 1
+#else
+  #define BENCHMARK_CYCLES 0
+#endif
+
+
+// Return the resident set size of the process from '/proc/self/statm', or zero if unavailable.
+inline std::size_t
+resident_bytes() noexcept
+{
+#ifdef __linux__
+  std::ifstream statm("/proc/self/statm");
+  std::size_t pages = 0u;
+  std::size_t resident = 0u;
+  if (statm >> pages >> resident)
+  {
+    return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  }
+#endif
+  return 0u;
+}
+
+
+// Return the peak resident set size of the process from '/proc/self/status', or zero if unavailable.
+inline std::size_t
+peak_resident_bytes() noexcept
+{
+#ifdef __linux__
+  std::ifstream status("/proc/self/status");
+  std::string key;
+  while (status >> key)
+  {
+    if (key == "VmHWM:")
+    {
+      std::size_t kilobytes = 0u;
+      status >> kilobytes;
+      return kilobytes * 1024u;
+    }
+    status.ignore(std::numeric_limits<std::streamsize>::max(), '\n');
+  }
+#endif
+  return 0u;
+}
+
+
+// Reset the peak resident set size to the current one, and return false if unsupported.
+inline bool
+reset_peak_resident() noexcept
+{
+#ifdef __linux__
+  std::ofstream clear_refs("/proc/self/clear_refs");
+  return static_cast<bool>(clear_refs << "5" << std::flush);
+#else
+  return false;
+#endif
+}
+
+
+// Return the bytes allocated from the heap by 'malloc' and 'operator new', or zero if unavailable.
+inline std::size_t
+heap_bytes() noexcept
+{
+#if BENCHMARK_HEAP_STATISTICS
+  return mallinfo2().uordblks;
+#else
+  return 0u;
+#endif
+}
+
+
+// Return the free memory of the heap to the operating system, so the next resident set size delta
+// isn't hidden by reused pages.
+inline void
+trim_heap() noexcept
+{
+#if BENCHMARK_HEAP_STATISTICS
+  malloc_trim(0u);
+#endif
+}
+
+
+// Return the time stamp counter, or the nanoseconds of the steady clock if unavailable.
+inline std::uint64_t
+cycles() noexcept
+{
+#if BENCHMARK_CYCLES
+  return __rdtsc();
+#else
+  return static_cast<std::uint64_t>(
+    std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
+#endif
+}
@@ -0,0 +1,269 @@
+#include "benchmark-counters.hpp"
+
+#include <catch2/reporters/catch_reporter_event_listener.hpp>
+#include <catch2/reporters/catch_reporter_registrars.hpp>
+
+#include <cstddef>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef __linux__
+  #include <linux/perf_event.h>
+  #include <sys/ioctl.h>
+  #include <sys/syscall.h>
+  #include <unistd.h>
+#endif
+
+
+namespace
+{
+  constexpr std::size_t s_events = 4u;
+
+  char const * const s_event_names[s_events] = {"cycles", "instructions", "cache misses", "branch misses"};
+
+  // The counts of the events and the times their counters were enabled and running.
+  struct Reading
+  {
+    std::uint64_t m_values[s_events] = {};
+    std::uint64_t m_enabled[s_events] = {};
+    std::uint64_t m_running[s_events] = {};
+  };
+
+  // Opens a counter for each event of the calling thread, which is inherited by the threads it
+  // creates afterwards, and also counts them. Inherited counters can't be read as a group, so each
+  // counter is enabled, disabled and read on its own. The events which can't be opened are left out.
+  class PerfCounters
+  {
+  public:
+    PerfCounters() noexcept
+    {
+#ifdef __linux__
+      std::uint64_t const configs[s_events] = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                               PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+      for (std::size_t event = 0u; event < s_events; ++event)
+      {
+        perf_event_attr attributes{};
+        attributes.type = PERF_TYPE_HARDWARE;
+        attributes.size = sizeof(attributes);
+        attributes.config = configs[event];
+        attributes.disabled = 1u;
+        attributes.inherit = 1u;
+        attributes.exclude_kernel = 1u;
+        attributes.exclude_hv = 1u;
+        attributes.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        m_descriptors[event] = static_cast<int>(syscall(SYS_perf_event_open, &attributes, 0, -1, -1, 0ul));
+      }
+#endif
+    }
+
+    ~PerfCounters() noexcept
+    {
+#ifdef __linux__
+      for (int const descriptor : m_descriptors)
+      {
+        if (descriptor != -1)
+        {
+          close(descriptor);
+        }
+      }
+#endif
+    }
+
+    PerfCounters(PerfCounters const &) = delete;
+    PerfCounters & operator=(PerfCounters const &) = delete;
+
+    bool
+    available(std::size_t const p_event) const noexcept
+    {
+      return m_descriptors[p_event] != -1;
+    }
+
+    void
+    enable() noexcept
+    {
+#ifdef __linux__
+      for (int const descriptor : m_descriptors)
+      {
+        if (descriptor != -1)
+        {
+          ioctl(descriptor, PERF_EVENT_IOC_ENABLE, 0);
+        }
+      }
+#endif
+    }
+
+    void
+    disable() noexcept
+    {
+#ifdef __linux__
+      for (int const descriptor : m_descriptors)
+      {
+        if (descriptor != -1)
+        {
+          ioctl(descriptor, PERF_EVENT_IOC_DISABLE, 0);
+        }
+      }
+#endif
+    }
+
+    Reading
+    read() const noexcept
+    {
+      Reading reading;
+#ifdef __linux__
+      for (std::size_t event = 0u; event < s_events; ++event)
+      {
+        // The value of the event, and the enabled and running times.
+        std::uint64_t buffer[3u] = {};
+        if (m_descriptors[event] != -1 && ::read(m_descriptors[event], buffer, sizeof(buffer)) > 0)
+        {
+          reading.m_values[event] = buffer[0];
+          reading.m_enabled[event] = buffer[1];
+          reading.m_running[event] = buffer[2];
+        }
+      }
+#endif
+      return reading;
+    }
+
+  private:
+    int m_descriptors[s_events] = {-1, -1, -1, -1};
+  };
+
+  // The counts of the scopes of a benchmark.
+  struct Counts
+  {
+    double m_values[s_events] = {};
+    bool m_available[s_events] = {};
+    std::uint64_t m_iterations = 0u;
+  };
+
+  std::mutex g_mutex;
+  Counts g_current;
+  std::vector<std::pair<std::string, Counts>> g_finished;
+
+  PerfCounters &
+  thread_counters() noexcept
+  {
+    thread_local PerfCounters counters;
+    return counters;
+  }
+
+  thread_local Reading g_start;
+
+  void
+  print_counts() noexcept
+  {
+    bool available = false;
+    for (auto const & [name, counts] : g_finished)
+    {
+      for (bool const event : counts.m_available)
+      {
+        available = available || event;
+      }
+    }
+    if (!available)
+    {
+      std::cout << "\nHardware counters are unavailable." << std::endl;
+      return;
+    }
+    std::cout << "\nHardware counters per iteration of the benchmark thread and its threads\n"
+              << std::left << std::setw(60) << "benchmark" << std::right;
+    for (char const * const event : s_event_names)
+    {
+      std::cout << std::setw(15) << event;
+    }
+    std::cout << "\n";
+    for (auto const & [name, counts] : g_finished)
+    {
+      std::cout << std::left << std::setw(60) << name.substr(0u, 59u) << std::right << std::fixed
+                << std::setprecision(1);
+      for (std::size_t event = 0u; event < s_events; ++event)
+      {
+        if (counts.m_available[event])
+        {
+          std::cout << std::setw(15) << counts.m_values[event] / static_cast<double>(counts.m_iterations);
+        }
+        else
+        {
+          std::cout << std::setw(15) << "n/a";
+        }
+      }
+      std::cout << "\n";
+    }
+    std::cout << std::flush;
+  }
+
+  // Attaches the counts of each benchmark to the output of its test case.
+  class CounterListener: public Catch::EventListenerBase
+  {
+  public:
+    using EventListenerBase::EventListenerBase;
+
+    // Opens the counters of the benchmark thread before any test creates threads, so they
+    // inherit the counters.
+    void
+    testRunStarting(Catch::TestRunInfo const &) override
+    {
+      thread_counters();
+    }
+
+    void
+    benchmarkEnded(Catch::BenchmarkStats<> const & p_stats) override
+    {
+      std::lock_guard<std::mutex> const lock(g_mutex);
+      if (g_current.m_iterations != 0u)
+      {
+        g_finished.emplace_back(p_stats.info.name, g_current);
+      }
+      g_current = Counts();
+    }
+
+    void
+    testCaseEnded(Catch::TestCaseStats const &) override
+    {
+      std::lock_guard<std::mutex> const lock(g_mutex);
+      if (!g_finished.empty())
+      {
+        print_counts();
+        g_finished.clear();
+      }
+    }
+  };
+} // namespace
+
+
+CATCH_REGISTER_LISTENER(CounterListener)
+
+
+CounterScope::CounterScope(std::uint64_t const p_iterations) noexcept
+: m_iterations(p_iterations)
+{
+  PerfCounters & counters = thread_counters();
+  g_start = counters.read();
+  counters.enable();
+}
+
+
+CounterScope::~CounterScope() noexcept
+{
+  PerfCounters & counters = thread_counters();
+  counters.disable();
+  Reading const end = counters.read();
+  std::lock_guard<std::mutex> const lock(g_mutex);
+  for (std::size_t event = 0u; event < s_events; ++event)
+  {
+    // Scales the counts if the counter was multiplexed with others.
+    std::uint64_t const running = end.m_running[event] - g_start.m_running[event];
+    double const scale = (running != 0u ? static_cast<double>(end.m_enabled[event] - g_start.m_enabled[event])
+                                            / static_cast<double>(running)
+                                        : 0.0);
+    g_current.m_values[event] += static_cast<double>(end.m_values[event] - g_start.m_values[event]) * scale;
+    g_current.m_available[event] = counters.available(event);
+  }
+  g_current.m_iterations += m_iterations;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include <catch2/benchmark/catch_benchmark.hpp>
+
+#include <cstdint>
+#include <utility>
+
+
+// Counts the cycles, instructions, cache misses, and branch misses of the calling thread while it
+// exists, and adds them to the current benchmark for the given number of iterations. The counters
+// of the main thread are opened when the test run starts, and are inherited by the threads it
+// creates, so the work of the worker threads of a benchmark is counted too. The listener in
+// 'benchmark-counters.cpp' prints the counts per iteration of each benchmark at the end of its
+// test case. The counters use 'perf_event_open' on Linux, and are unavailable on other platforms,
+// without permission, or without hardware support, for example in many virtual machines.
+class CounterScope
+{
+public:
+  explicit CounterScope(std::uint64_t p_iterations) noexcept;
+  ~CounterScope() noexcept;
+
+  CounterScope(CounterScope const &) = delete;
+  CounterScope & operator=(CounterScope const &) = delete;
+
+private:
+  std::uint64_t m_iterations;
+};
+
+
+// Measure the function like 'Chronometer::measure', and count its events. The counters are
+// enabled outside of the measured time.
+template<class t_function>
+void
+measure_counted(Catch::Benchmark::Chronometer p_meter, t_function && p_function)
+{
+  CounterScope const scope(static_cast<std::uint64_t>(p_meter.runs()));
+  p_meter.measure(std::forward<t_function>(p_function));
+}
+
+
+struct CountedBenchmark
+{};
+
+template<class t_function>
+auto
+operator+(CountedBenchmark, t_function p_function)
+{
+  return [function = std::move(p_function)](Catch::Benchmark::Chronometer p_meter)
+  { measure_counted(p_meter, function); };
+}
+
+// Like 'BENCHMARK', and counts the events of the benchmark and of its threads.
+#define BENCHMARK_COUNTED(p_name)                            \
+  if (Catch::Benchmark::Benchmark benchmark_counted{p_name}) \
+  benchmark_counted = CountedBenchmark{} + [&]()
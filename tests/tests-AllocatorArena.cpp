@@ -0,0 +1,160 @@
+#include "tests-common.hpp"
+
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+
+namespace
+{
+  unsigned g_arena_objects = 0u;
+
+  struct ArenaObject
+  : public pntr::Intruder<pntr::ControlAlloc<ArenaObject, pntr::ControlData<pntr::CounterThreadSafe, std::uint32_t>,
+                                             pntr::AllocatorArena<>>>
+  {
+    explicit ArenaObject(int const p_value) noexcept
+    : m_value(p_value)
+    {
+      ++g_arena_objects;
+    }
+
+    ~ArenaObject()
+    {
+      --g_arena_objects;
+    }
+
+    int m_value;
+  };
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "AllocatorArena")
+{
+  REQUIRE(g_arena_objects == 0u);
+
+  SECTION("Allocation size limits")
+  {
+    pntr::ArenaPool pool;
+    REQUIRE(pool.arena_count() == 0u);
+    void * const largest = pool.allocate(1u << 13u, 8u);
+    REQUIRE(largest != nullptr);
+    REQUIRE(pool.allocate((1u << 13u) + 1u, 8u) == nullptr);
+    REQUIRE(pool.allocate(16u, 128u) == nullptr);
+    void * const aligned = pool.allocate(8u, 64u);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(aligned) % 64u == 0u);
+    REQUIRE(pool.arena_count() == 1u);
+    REQUIRE(pool.live_count() == 2u);
+    pntr::ArenaPool::deallocate(largest);
+    pntr::ArenaPool::deallocate(aligned);
+    REQUIRE(pool.live_count() == 0u);
+  }
+
+  SECTION("Shared objects")
+  {
+    pntr::ArenaPool pool;
+    pntr::SharedPtr<ArenaObject> a = pool.make_shared<ArenaObject>(1);
+    pntr::SharedPtr<ArenaObject> b = pool.make_shared<ArenaObject>(2);
+    REQUIRE(a->m_value == 1);
+    REQUIRE(b->m_value == 2);
+    REQUIRE(pool.live_count() == 2u);
+
+    // Freed blocks are reused, and released on other threads.
+    void * const freed = a.get();
+    a.reset();
+    a = pool.make_shared<ArenaObject>(3);
+    REQUIRE(a.get() == freed);
+    std::thread thread(
+      [moved = std::move(b)]() mutable noexcept
+      {
+        moved.reset();
+      });
+    thread.join();
+    REQUIRE(pool.live_count() == 1u);
+    a.reset();
+    REQUIRE(pool.live_count() == 0u);
+  }
+
+  SECTION("Empty arenas are returned to the operating system")
+  {
+    pntr::ArenaPool::Options options;
+    options.m_retain = 0u;
+    pntr::ArenaPool pool(options);
+
+    // Each chunk holds seven blocks of the largest class, and an arena 511 chunks.
+    std::vector<void *> blocks;
+    for (std::size_t i = 0u; i < 4000u; ++i)
+    {
+      blocks.push_back(pool.allocate(1u << 13u, 8u));
+      REQUIRE(blocks.back() != nullptr);
+    }
+    REQUIRE(pool.arena_count() == 2u);
+    REQUIRE(pool.resident_count() == 2u);
+    for (void * const block: blocks)
+    {
+      pntr::ArenaPool::deallocate(block);
+    }
+    REQUIRE(pool.live_count() == 0u);
+    // The cached blocks keep their arena resident.
+    pool.trim();
+    REQUIRE(pool.resident_count() == 0u);
+
+    // The released arenas are reused.
+    void * const block = pool.allocate(16u, 8u);
+    REQUIRE(pool.arena_count() == 2u);
+    REQUIRE(pool.resident_count() == 1u);
+    pntr::ArenaPool::deallocate(block);
+  }
+
+  SECTION("Warm-up with prefaulting")
+  {
+    pntr::ArenaPool::Options options;
+    options.m_arenas = 2u;
+    options.m_retain = 2u;
+    options.m_prefault = true;
+    pntr::ArenaPool pool(options);
+    REQUIRE(pool.arena_count() == 2u);
+    REQUIRE(pool.resident_count() == 2u);
+    std::vector<pntr::SharedPtr<ArenaObject>> objects;
+    for (int i = 0; i < 1000; ++i)
+    {
+      objects.push_back(pool.make_shared<ArenaObject>(i));
+    }
+    REQUIRE(pool.arena_count() == 2u);
+    objects.clear();
+    REQUIRE(pool.resident_count() == 2u);
+  }
+
+  SECTION("Concurrent allocations and deallocations")
+  {
+    pntr::ArenaPool pool;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+      threads.emplace_back(
+        [&pool, t]() noexcept
+        {
+          std::vector<pntr::SharedPtr<ArenaObject>> objects;
+          for (int i = 0; i < 10000; ++i)
+          {
+            objects.push_back(pool.make_shared<ArenaObject>(t));
+            if (i % 3 == 0)
+            {
+              objects[static_cast<std::size_t>(i) / 2u].reset();
+            }
+          }
+        });
+    }
+    for (std::thread & thread : threads)
+    {
+      thread.join();
+    }
+    REQUIRE(pool.live_count() == 0u);
+    pool.trim();
+    REQUIRE(pool.resident_count() == 1u);
+  }
+
+  REQUIRE(g_arena_objects == 0u);
+}
+
+#endif
@@ -0,0 +1,98 @@
+#include "tests-common.hpp"
+
+#include <version>
+#ifdef __cpp_lib_memory_resource
+  #include <memory_resource>
+
+namespace
+{
+  // A resource which counts its allocated blocks.
+  class CountingResource: public std::pmr::memory_resource
+  {
+  public:
+    std::size_t m_blocks = 0u;
+
+  private:
+    void *
+    do_allocate(std::size_t const p_size, std::size_t const p_alignment) override
+    {
+      ++m_blocks;
+      return std::pmr::new_delete_resource()->allocate(p_size, p_alignment);
+    }
+
+    void
+    do_deallocate(void * const p_pointer, std::size_t const p_size, std::size_t const p_alignment) override
+    {
+      --m_blocks;
+      std::pmr::new_delete_resource()->deallocate(p_pointer, p_size, p_alignment);
+    }
+
+    bool
+    do_is_equal(std::pmr::memory_resource const & p_other) const noexcept override
+    {
+      return this == &p_other;
+    }
+  };
+
+  // 16 bits for the usage counter, 8 bits for the weak counter, and 8 bits for the index.
+  struct IndexObject
+  : public pntr::IntruderAlloc<IndexObject, pntr::ThreadSafe, std::uint32_t, 16u, 8u, 0u, 0u, 0u,
+                               pntr::AllocatorMemoryResourceIndex<>>
+  {
+    explicit IndexObject(int const p_value) noexcept
+    : m_value(p_value)
+    {}
+
+    int m_value;
+  };
+
+  static_assert(sizeof(pntr::IntruderAlloc<IndexObject, pntr::ThreadSafe, std::uint32_t, 16u, 8u, 0u, 0u, 0u,
+                                           pntr::AllocatorMemoryResourceIndex<>>)
+                == sizeof(std::uint32_t));
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "AllocatorMemoryResourceIndex")
+{
+  CountingResource first;
+  CountingResource second;
+  std::size_t const first_index = pntr::MemoryResourceRegistry::add(&first);
+  REQUIRE(first_index != 0u);
+  REQUIRE(pntr::MemoryResourceRegistry::add(&first) == first_index);
+  REQUIRE(pntr::MemoryResourceRegistry::get(first_index) == &first);
+  REQUIRE(pntr::MemoryResourceRegistry::get(0u) == std::pmr::get_default_resource());
+  REQUIRE(IndexObject::pntr_get_max_user() == 0u);
+
+  SECTION("Objects are deallocated with the resource of their index")
+  {
+    pntr::SharedPtr<IndexObject> a = pntr::allocate_shared<IndexObject>(IndexObject::PntrAllocator(&first), 1);
+    pntr::SharedPtr<IndexObject> b = pntr::allocate_shared<IndexObject>(IndexObject::PntrAllocator(&second), 2);
+    REQUIRE(first.m_blocks == 1u);
+    REQUIRE(second.m_blocks == 1u);
+    REQUIRE(a->m_value == 1);
+    REQUIRE(b->m_value == 2);
+    REQUIRE(a->pntr_get_user() == 0u);
+    REQUIRE(!a->pntr_try_set_user(1u));
+    a.reset();
+    REQUIRE(first.m_blocks == 0u);
+    REQUIRE(second.m_blocks == 1u);
+    b.reset();
+    REQUIRE(second.m_blocks == 0u);
+  }
+
+  SECTION("Weak references keep the memory")
+  {
+    pntr::SharedPtr<IndexObject> a = pntr::allocate_shared<IndexObject>(IndexObject::PntrAllocator(&second), 3);
+    pntr::WeakPtr<IndexObject> const weak(a);
+    a.reset();
+    REQUIRE(weak.expired());
+    REQUIRE(second.m_blocks == 1u);
+  }
+
+  REQUIRE(second.m_blocks == 0u);
+  pntr::MemoryResourceRegistry::remove(first_index);
+  pntr::MemoryResourceRegistry::remove(pntr::MemoryResourceRegistry::add(&second));
+  REQUIRE(pntr::MemoryResourceRegistry::get(first_index) == nullptr);
+}
+
+#endif // __cpp_lib_memory_resource
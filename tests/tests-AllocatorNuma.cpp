@@ -0,0 +1,119 @@
+#include "tests-common.hpp"
+
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+
+  #include <sys/mman.h>
+
+namespace
+{
+  struct NumaObject
+  : public pntr::Intruder<pntr::ControlAlloc<NumaObject, pntr::ControlData<pntr::CounterThreadSafe, std::uint32_t>,
+                                             pntr::AllocatorNuma<>>>
+  {
+    explicit NumaObject(int const p_value) noexcept
+    : m_value(p_value)
+    {}
+
+    int m_value;
+  };
+
+  std::size_t
+  live_count(pntr::NumaPool const & p_pool)
+  {
+    std::size_t count = 0u;
+    for (std::size_t node = 0u; node < p_pool.node_count(); ++node)
+    {
+      count += p_pool.statistics(node).m_live;
+    }
+    return count;
+  }
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "AllocatorNuma")
+{
+  pntr::NumaPool pool;
+  REQUIRE(pool.node_count() >= 1u);
+  REQUIRE(pool.current_node() < pool.node_count());
+
+  SECTION("Objects are allocated on the node of the calling thread")
+  {
+    std::size_t const node = pool.current_node();
+    pntr::SharedPtr<NumaObject> a = pool.make_shared<NumaObject>(1);
+    REQUIRE(a->m_value == 1);
+    REQUIRE(pool.node_of(a.get()) == node);
+    REQUIRE(pool.statistics(node).m_live == 1u);
+    REQUIRE(pool.statistics(node).m_arenas == 1u);
+    REQUIRE(pool.statistics(node).m_resident == 1u);
+
+    // The page is on the preferred node, if the kernel knows it.
+    int const page_node = pntr::detail::NumaPolicy::node_of(a.get());
+    REQUIRE((page_node < 0 || pool.node_count() == 1u || static_cast<std::size_t>(page_node) == node));
+    a.reset();
+    REQUIRE(pool.statistics(node).m_live == 0u);
+  }
+
+  SECTION("Objects are deallocated into the pool of their node")
+  {
+    std::vector<pntr::SharedPtr<NumaObject>> objects;
+    std::thread thread(
+      [&]() noexcept
+      {
+        for (int i = 0; i < 100; ++i)
+        {
+          objects.push_back(pool.make_shared<NumaObject>(i));
+        }
+      });
+    thread.join();
+    REQUIRE(live_count(pool) == 100u);
+    REQUIRE(pool.node_of(objects.front().get()) < pool.node_count());
+    objects.resize(50u);
+    REQUIRE(live_count(pool) == 50u);
+    objects.clear();
+    REQUIRE(live_count(pool) == 0u);
+  }
+
+  SECTION("Raw allocations")
+  {
+    void * const block = pool.allocate(64u, 64u);
+    REQUIRE(block != nullptr);
+    REQUIRE(pool.node_pool(pool.node_of(block)).live_count() == 1u);
+    pntr::AllocatorNuma<>().deallocate(block);
+    REQUIRE(live_count(pool) == 0u);
+  }
+}
+
+
+// The pool above only binds its arenas on machines with several nodes, so node 0 is bound
+// explicitly, which every kernel with NUMA support accepts.
+TEST_CASE(TEST_PREFIX "AllocatorNuma binds to node 0")
+{
+  SECTION("NumaPolicy")
+  {
+    std::size_t const size = std::size_t{1u} << 21u;
+    void * const mapping = ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    REQUIRE(mapping != MAP_FAILED);
+    REQUIRE(pntr::detail::NumaPolicy::bind(mapping, size, 0u));
+    *static_cast<unsigned char *>(mapping) = 1u;
+    REQUIRE(pntr::detail::NumaPolicy::node_of(mapping) == 0);
+    ::munmap(mapping, size);
+  }
+
+  SECTION("ArenaPool")
+  {
+    pntr::ArenaPool::Options options;
+    options.m_node = 0;
+    pntr::ArenaPool pool(options);
+    REQUIRE(pool.node() == 0);
+    void * const block = pool.allocate(64u, 64u);
+    REQUIRE(block != nullptr);
+    *static_cast<unsigned char *>(block) = 1u;
+    REQUIRE(pntr::detail::NumaPolicy::node_of(block) == 0);
+    pool.deallocate(block);
+  }
+}
+
+#endif
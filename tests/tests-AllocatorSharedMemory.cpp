@@ -0,0 +1,107 @@
+#include "tests-common.hpp"
+
+#if defined(__linux__)
+
+namespace
+{
+  struct SharedNode
+  : public pntr::Intruder<pntr::ControlAlloc<SharedNode, pntr::ControlData<pntr::CounterThreadSafe, std::uint32_t>,
+                                             pntr::AllocatorSharedMemory>>
+  {
+    explicit SharedNode(int const p_value) noexcept
+    : m_value(p_value)
+    {}
+
+    int m_value;
+    pntr::OffsetSharedPtr<SharedNode> m_next;
+  };
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "OffsetPtr")
+{
+  int values[2] = {1, 2};
+  pntr::OffsetPtr<int> pointer;
+  REQUIRE(!pointer);
+  REQUIRE(pointer.get() == nullptr);
+  pointer = &values[1];
+  REQUIRE(pointer);
+  REQUIRE(*pointer == 2);
+  pntr::OffsetPtr<int> const copy(pointer);
+  REQUIRE(copy.get() == &values[1]);
+  pointer = nullptr;
+  REQUIRE(!pointer);
+}
+
+
+TEST_CASE(TEST_PREFIX "AllocatorSharedMemory")
+{
+  pntr::SharedMemorySegment first = pntr::SharedMemorySegment::create(1u << 20u);
+  REQUIRE(first.size() == (1u << 20u));
+  REQUIRE(first.used_size() == (1u << 16u));
+
+  SECTION("Allocation size limits")
+  {
+    REQUIRE(first.allocate(1u << 13u, 8u) != nullptr);
+    REQUIRE(first.allocate((1u << 13u) + 1u, 8u) == nullptr);
+    REQUIRE(first.allocate(16u, 128u) == nullptr);
+    void * const aligned = first.allocate(8u, 64u);
+    REQUIRE(reinterpret_cast<std::uintptr_t>(aligned) % 64u == 0u);
+  }
+
+  SECTION("Segment exhaustion")
+  {
+    std::size_t count = 0u;
+    while (first.allocate(1u << 13u, 8u) != nullptr)
+    {
+      ++count;
+    }
+    // Seven blocks of the largest class fit into each of the 15 chunks after the header.
+    REQUIRE(count == 105u);
+    REQUIRE(first.used_size() == first.size());
+  }
+
+  SECTION("Objects are shared by two mappings")
+  {
+    pntr::SharedPtr<SharedNode> node = first.make_shared<SharedNode>(1);
+    REQUIRE(first.contains(node.get()));
+    node->m_next = first.make_shared<SharedNode>(2);
+    first.root<SharedNode>() = node;
+    REQUIRE(node.use_count() == 2u);
+
+    pntr::SharedMemorySegment second = pntr::SharedMemorySegment::open(first.file_descriptor());
+    REQUIRE(second.base() != first.base());
+    pntr::SharedPtr<SharedNode> mapped = second.root<SharedNode>().get_shared();
+    REQUIRE(second.contains(mapped.get()));
+    REQUIRE(mapped->m_value == 1);
+    REQUIRE(mapped->m_next->m_value == 2);
+    REQUIRE(node.use_count() == 3u);
+    REQUIRE(mapped->m_next.use_count() == 1u);
+
+    // The last reference is released through the second mapping, which frees the blocks there.
+    void * const freed = node.get();
+    node.reset();
+    first.root<SharedNode>().reset();
+    REQUIRE(mapped.use_count() == 1u);
+    mapped.reset();
+    pntr::SharedPtr<SharedNode> const reused = first.make_shared<SharedNode>(3);
+    pntr::SharedPtr<SharedNode> const reused_next = first.make_shared<SharedNode>(4);
+    REQUIRE((reused.get() == freed || reused_next.get() == freed));
+  }
+
+  SECTION("Named segment")
+  {
+    char const * const name = "/pntr-tests-AllocatorSharedMemory";
+    pntr::SharedMemorySegment named = pntr::SharedMemorySegment::create(name, 1u << 17u);
+    REQUIRE_THROWS_AS(pntr::SharedMemorySegment::create(name, 1u << 17u), std::system_error);
+    pntr::SharedMemorySegment opened = pntr::SharedMemorySegment::open(name);
+    pntr::SharedMemorySegment::unlink(name);
+    REQUIRE(opened.size() == named.size());
+    named.root<SharedNode>() = named.make_shared<SharedNode>(5);
+    REQUIRE(opened.root<SharedNode>()->m_value == 5);
+    opened.root<SharedNode>().reset();
+    REQUIRE_THROWS_AS(pntr::SharedMemorySegment::open(name), std::system_error);
+  }
+}
+
+#endif
@@ -0,0 +1,142 @@
+#include "tests-common.hpp"
+
+namespace
+{
+  struct SmallRequirements: pntr::IntruderRequirements<pntr::ThreadUnsafe>
+  {
+    static constexpr std::uint64_t s_max_usage_count = 100u;
+  };
+
+  struct WeakNewRequirements: pntr::IntruderRequirements<>
+  {
+    static constexpr std::uint64_t s_max_usage_count = 1000u;
+    static constexpr std::uint64_t s_max_weak_count = 1u;
+  };
+
+  struct AllocRequirements: pntr::IntruderRequirements<pntr::ThreadSafe, pntr::AllocatorMalloc<>>
+  {
+    static constexpr std::uint64_t s_max_usage_count = 1000u;
+    static constexpr std::uint64_t s_max_weak_count = 1000u;
+    static constexpr std::size_t s_max_base_offset = 32u;
+    static constexpr unsigned s_user_bits = 2u;
+  };
+
+  struct StaticRequirements: pntr::IntruderRequirements<pntr::ThreadSafe, pntr::AllocatorMalloc<pntr::StaticSupport>>
+  {
+    static constexpr std::uint64_t s_max_weak_count = 1000u;
+    static constexpr std::size_t s_max_base_offset = 64u;
+  };
+
+  struct DefaultObject: pntr::AutoIntruder<DefaultObject>
+  {};
+
+  struct SmallObject: pntr::AutoIntruder<SmallObject, SmallRequirements>
+  {};
+
+  struct WeakNewObject: pntr::AutoIntruder<WeakNewObject, WeakNewRequirements>
+  {};
+
+  struct AllocObject: pntr::AutoIntruder<AllocObject, AllocRequirements>
+  {
+    virtual ~AllocObject() = default;
+  };
+
+  struct Padding
+  {
+    char m_padding[24];
+  };
+
+  struct AllocDerived
+  : public Padding
+  , public AllocObject
+  {
+    explicit AllocDerived(int const p_value) noexcept
+    : m_value(p_value)
+    {}
+
+    int m_value;
+  };
+
+  struct StaticObject: pntr::AutoIntruder<StaticObject, StaticRequirements>
+  {};
+
+  using DefaultData = DefaultObject::PntrControlType::Data;
+  static_assert(std::is_same_v<DefaultObject::PntrControlType::Allocator, void>);
+  static_assert(sizeof(DefaultData) == sizeof(std::uint32_t));
+  static_assert(DefaultData::s_usage_bits == 32u);
+  static_assert(pntr::intruder_efficiency<DefaultObject>().is_efficient());
+
+  using SmallData = SmallObject::PntrControlType::Data;
+  static_assert(sizeof(SmallObject) == sizeof(std::uint8_t));
+  static_assert(SmallData::s_usage_bits == 8u);
+  static_assert(pntr::intruder_efficiency<SmallObject>().is_efficient());
+
+  static_assert(WeakNewObject::PntrSupportsWeak::value);
+  static_assert(sizeof(WeakNewObject) == sizeof(std::uint16_t));
+  static_assert(pntr::intruder_efficiency<WeakNewObject>().is_efficient());
+
+  // The separate counters use half of the control value each.
+  using AllocData = AllocObject::PntrControlType::Data;
+  static_assert(sizeof(AllocData) == sizeof(std::uint32_t));
+  static_assert(AllocData::s_usage_bits == 16u);
+  static_assert(AllocData::get_max_weak_count() >= 1000u);
+  static_assert(AllocData::get_max_offset() >= 8u);
+  static_assert(AllocObject::pntr_get_max_user() >= 3u);
+  static_assert(pntr::intruder_efficiency<AllocObject>().is_efficient());
+
+  // The function pointer of the static support requires a control value of its size.
+  using StaticData = StaticObject::PntrControlType::Data;
+  static_assert(sizeof(StaticData) == sizeof(void *));
+  static_assert(StaticData::s_shared_offset);
+  static_assert(pntr::intruder_efficiency<StaticObject>().is_efficient());
+
+  // A hand-written configuration with needless size bits.
+  struct SizeBitsObject
+  : pntr::IntruderAlloc<SizeBitsObject, pntr::ThreadSafe, std::uint64_t, 32u, 16u, 8u, 8u>
+  {};
+
+  static_assert(!pntr::intruder_efficiency<SizeBitsObject>().is_efficient());
+  static_assert(pntr::intruder_efficiency<SizeBitsObject>().m_unused_size_bits);
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "AutoIntruder")
+{
+  SECTION("ControlNew")
+  {
+    pntr::SharedPtr<SmallObject> const a = pntr::make_shared<SmallObject>();
+    pntr::SharedPtr<SmallObject> const b = a;
+    REQUIRE(a.use_count() == 2u);
+    REQUIRE(SmallObject::pntr_get_max_usage_count() >= 100u);
+  }
+
+  SECTION("ControlNew with weak pointers")
+  {
+    pntr::SharedPtr<WeakNewObject> a = pntr::make_shared<WeakNewObject>();
+    pntr::WeakPtr<WeakNewObject> const weak(a);
+    REQUIRE(weak.lock() == a);
+    a.reset();
+    REQUIRE(weak.expired());
+  }
+
+  SECTION("ControlAlloc with a base offset")
+  {
+    pntr::SharedPtr<AllocDerived> derived = pntr::make_shared<AllocDerived>(7);
+    pntr::SharedPtr<AllocObject> base = derived;
+    pntr::WeakPtr<AllocObject> const weak(base);
+    REQUIRE(pntr::calc_pointer_offset(*derived) <= AllocData::get_max_offset());
+    REQUIRE(derived->m_value == 7);
+    REQUIRE(base->pntr_try_set_user(3u));
+    REQUIRE(base->pntr_get_user() == 3u);
+    derived.reset();
+    base.reset();
+    REQUIRE(weak.expired());
+  }
+
+  SECTION("ControlAlloc with static support")
+  {
+    pntr::SharedPtr<StaticObject> const a = pntr::make_shared<StaticObject>();
+    pntr::WeakPtr<StaticObject> const weak(a);
+    REQUIRE(weak.use_count() == 1u);
+  }
+}
@@ -0,0 +1,104 @@
+#include "tests-common.hpp"
+
+#include <sstream>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  struct CensusNode
+  : public pntr::IntruderNew<CensusNode>
+  , public pntr::CensusMember<CensusNode>
+  {
+    std::uint64_t m_value = 0u;
+  };
+
+  struct CensusWeak
+  : public pntr::IntruderAlloc<CensusWeak, pntr::ThreadSafe, std::uint64_t, 32u, 16u, 16u>
+  , public pntr::CensusMember<CensusWeak>
+  {
+    char m_payload[100] = {};
+  };
+
+  pntr::Census::TypeStatistics
+  find(char const * const p_name)
+  {
+    for (pntr::Census::TypeStatistics const & statistics : pntr::Census::collect())
+    {
+      if (std::string_view(statistics.m_name) == p_name)
+      {
+        return statistics;
+      }
+    }
+    return pntr::Census::TypeStatistics{p_name, 0u, 0u, 0u, 0u, 0u, 0u, 0u};
+  }
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "Census")
+{
+  char const * const node_name = typeid(CensusNode).name();
+  char const * const weak_name = typeid(CensusWeak).name();
+  std::size_t const live_count = pntr::Census::live_count();
+
+  SECTION("Live objects are counted by type")
+  {
+    std::vector<pntr::SharedPtr<CensusNode>> nodes;
+    for (int i = 0; i < 10; ++i)
+    {
+      nodes.push_back(pntr::make_shared<CensusNode>());
+    }
+    pntr::Census::TypeStatistics const statistics = find(node_name);
+    REQUIRE(statistics.m_count == 10u);
+    REQUIRE(statistics.m_size == sizeof(CensusNode));
+    REQUIRE(statistics.m_bytes == 10u * sizeof(CensusNode));
+    REQUIRE(statistics.m_control_bytes == 10u * sizeof(CensusNode::PntrControlType));
+    REQUIRE(statistics.m_padding_bytes == 0u);
+    REQUIRE(pntr::Census::live_count() == live_count + 10u);
+    nodes.resize(4u);
+    REQUIRE(find(node_name).m_count == 4u);
+    nodes.clear();
+    REQUIRE(find(node_name).m_count == 0u);
+  }
+
+  SECTION("Objects destroyed on other threads")
+  {
+    std::vector<pntr::SharedPtr<CensusNode>> nodes(100u);
+    std::thread thread(
+      [&]() noexcept
+      {
+        for (pntr::SharedPtr<CensusNode> & node : nodes)
+        {
+          node = pntr::make_shared<CensusNode>();
+        }
+      });
+    thread.join();
+    REQUIRE(find(node_name).m_count == 100u);
+    nodes.clear();
+    REQUIRE(pntr::Census::live_count() == live_count);
+  }
+
+  SECTION("Objects pinned by weak pointers")
+  {
+    pntr::SharedPtr<CensusWeak> a = pntr::make_shared<CensusWeak>();
+    pntr::SharedPtr<CensusWeak> b = pntr::make_shared<CensusWeak>();
+    pntr::WeakPtr<CensusWeak> weak(a);
+    REQUIRE(find(weak_name).m_count == 2u);
+    a.reset();
+    b.reset();
+    pntr::Census::TypeStatistics const statistics = find(weak_name);
+    REQUIRE(statistics.m_count == 0u);
+    REQUIRE(statistics.m_pinned_count == 1u);
+    REQUIRE(statistics.m_pinned_bytes == sizeof(CensusWeak));
+
+    std::ostringstream stream;
+    pntr::Census::write(stream);
+    REQUIRE(stream.str().find("1 pinned by weak pointers") != std::string::npos);
+
+    weak.reset();
+    REQUIRE(find(weak_name).m_pinned_count == 0u);
+  }
+
+  REQUIRE(pntr::Census::live_count() == live_count);
+}
@@ -248,6 +248,36 @@ struct AllocatorMallocStatic
 };
 
 
+template<class t_shared>
+struct AllocatorMallocStaticIndex
+{
+  template<class t_shared_base>
+  using Intruder = pntr::IntruderMallocStaticIndex<t_shared_base, pntr::ThreadUnsafe>;
+
+  using Shared = typename t_shared::template Shared<Intruder>;
+  static constexpr bool s_const = t_shared::s_const;
+
+  template<typename t_type>
+  using Allocator = typename Shared::PntrAllocator;
+
+  template<typename t_type>
+  static Allocator<t_type>
+  create() noexcept
+  {
+    return Allocator<t_type>();
+  }
+
+  // Require that the size of a minimal class is as expected.
+  static_assert(sizeof(MinimalSharedClass<Intruder>) == sizeof(std::uint64_t));
+  static_assert(MinimalSharedClass<Intruder>::pntr_get_max_user() == 0u);
+
+  static constexpr bool s_saves_type = true;
+  static constexpr bool s_destroys_shared = false;
+  static constexpr bool s_supports_virtual = true;
+  static constexpr bool s_supports_aligned = true;
+};
+
+
 #ifdef __cpp_lib_memory_resource
 
 template<class t_shared>
@@ -344,13 +374,14 @@ struct AllocatorTest
 
 #ifdef __cpp_lib_memory_resource
 TEMPLATE_PRODUCT_TEST_CASE(TEST_PREFIX "ControlAlloc", "",
-                           (AllocatorMalloc, AllocatorMalloc8, AllocatorMallocStatic, AllocatorMemoryResource,
-                            AllocatorMemoryResourceStatic, AllocatorTest),
+                           (AllocatorMalloc, AllocatorMalloc8, AllocatorMallocStatic, AllocatorMallocStaticIndex,
+                            AllocatorMemoryResource, AllocatorMemoryResourceStatic, AllocatorTest),
                            (Minimal, MinimalAlign, MinimalConst, Static, StaticAlign, StaticConst, Polymorphic,
                             PolymorphicAlign, PolymorphicConst, Virtual, VirtualAlign, VirtualConst))
 #else
 TEMPLATE_PRODUCT_TEST_CASE(TEST_PREFIX "ControlAlloc", "",
-                           (AllocatorMalloc, AllocatorMalloc8, AllocatorMallocStatic, AllocatorTest),
+                           (AllocatorMalloc, AllocatorMalloc8, AllocatorMallocStatic, AllocatorMallocStaticIndex,
+                            AllocatorTest),
                            (Minimal, MinimalAlign, MinimalConst, Static, StaticAlign, StaticConst, Polymorphic,
                             PolymorphicAlign, PolymorphicConst, Virtual, VirtualAlign, VirtualConst))
 #endif
@@ -0,0 +1,106 @@
+#include "tests-common.hpp"
+
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+  struct ShardedObject
+  : pntr::IntruderNewSharded<ShardedObject, 4u>
+  , LiveCounted<ShardedObject>
+  {};
+
+  // Run the given function on a new thread, which uses another sub-counter than the current one.
+  template<class t_function>
+  void
+  run_thread(t_function && p_function)
+  {
+    std::thread thread(std::forward<t_function>(p_function));
+    thread.join();
+  }
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "ControlDataSharded")
+{
+  REQUIRE(ShardedObject::live_count() == 0u);
+
+  SECTION("Copies and releases on the same thread")
+  {
+    pntr::SharedPtr<ShardedObject> a = pntr::make_shared<ShardedObject>();
+    REQUIRE(a.use_count() == 1u);
+    {
+      std::vector<pntr::SharedPtr<ShardedObject>> copies(10u, a);
+      REQUIRE(a.use_count() == 11u);
+    }
+    REQUIRE(a.use_count() == 1u);
+    a.reset();
+    REQUIRE(ShardedObject::live_count() == 0u);
+  }
+
+  SECTION("Releases of references copied by other threads")
+  {
+    pntr::SharedPtr<ShardedObject> a = pntr::make_shared<ShardedObject>();
+    std::vector<pntr::SharedPtr<ShardedObject>> copies;
+    run_thread(
+      [&]() noexcept
+      {
+        copies.assign(5u, a);
+      });
+    REQUIRE(a.use_count() == 6u);
+    copies.clear();
+    REQUIRE(a.use_count() == 1u);
+
+    // The last reference is released by another thread.
+    copies.assign(3u, a);
+    a.reset();
+    run_thread(
+      [&]() noexcept
+      {
+        copies.clear();
+      });
+    REQUIRE(ShardedObject::live_count() == 0u);
+  }
+
+  SECTION("Control of an already controlled object")
+  {
+    pntr::SharedPtr<ShardedObject> a = pntr::make_shared<ShardedObject>();
+    pntr::SharedPtr<ShardedObject> b = a->shared_from_this();
+    REQUIRE(b == a);
+    REQUIRE(a.use_count() == 2u);
+    a.reset();
+    REQUIRE(b.use_count() == 1u);
+    b.reset();
+    REQUIRE(ShardedObject::live_count() == 0u);
+  }
+
+  SECTION("Concurrent copies and releases")
+  {
+    for (unsigned round = 0u; round < 20u; ++round)
+    {
+      pntr::SharedPtr<ShardedObject> a = pntr::make_shared<ShardedObject>();
+      std::vector<std::thread> threads;
+      for (unsigned i = 0u; i < 6u; ++i)
+      {
+        threads.emplace_back(
+          [b = a]() mutable noexcept
+          {
+            for (unsigned j = 0u; j < 1000u; ++j)
+            {
+              pntr::SharedPtr<ShardedObject> const c = b;
+              pntr::SharedPtr<ShardedObject> d = c;
+              d.swap(b);
+            }
+            b.reset();
+          });
+      }
+      a.reset();
+      for (std::thread & thread: threads)
+      {
+        thread.join();
+      }
+      REQUIRE(ShardedObject::live_count() == 0u);
+    }
+  }
+}
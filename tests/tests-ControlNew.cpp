@@ -269,6 +269,35 @@ struct PntrDeleter
 };
 
 
+template<class t_shared>
+struct PntrDeleterIndexed
+{
+  template<class t_shared_base>
+  using Intruder =
+    pntr::IntruderNew<t_shared_base, pntr::ThreadUnsafe, std::uint16_t, 8u, pntr::DeleterIndexed<t_shared_base>>;
+
+  using Shared = typename t_shared::template Shared<Intruder>;
+  static constexpr bool s_const = t_shared::s_const;
+
+  template<typename t_type>
+  using Deleter = pntr::DeleterIndexed<t_type>;
+
+  template<typename t_type>
+  static Deleter<t_type>
+  create() noexcept
+  {
+    return Deleter<t_type>();
+  }
+
+  // Require that the size of a minimal class is as expected.
+  static_assert(sizeof(MinimalSharedClass<Intruder>) == sizeof(std::uint16_t));
+  static_assert(MinimalSharedClass<Intruder>::pntr_get_max_user() == 0u);
+
+  static constexpr bool s_saves_type = true;
+  static constexpr bool s_destroys_shared = false;
+};
+
+
 template<class t_shared>
 struct FunctionDeleter
 {
@@ -301,7 +330,7 @@ struct FunctionDeleter
 
 
 TEMPLATE_PRODUCT_TEST_CASE(TEST_PREFIX "ControlNew default construct", "",
-                           (DefaultDeleter, TemplateDeleter, EmptyDeleter, PntrDeleter),
+                           (DefaultDeleter, TemplateDeleter, EmptyDeleter, PntrDeleter, PntrDeleterIndexed),
                            (Minimal, MinimalAlign, MinimalConst, Static, StaticAlign, StaticConst, Polymorphic,
                             PolymorphicAlign, PolymorphicConst, Virtual, VirtualAlign, VirtualConst))
 {
@@ -415,7 +444,8 @@ TEMPLATE_PRODUCT_TEST_CASE(TEST_PREFIX "ControlNew default construct", "",
 
 
 TEMPLATE_PRODUCT_TEST_CASE(TEST_PREFIX "ControlNew explicit construct", "",
-                           (DefaultDeleter, TemplateDeleter, EmptyDeleter, PntrDeleter, FunctionDeleter),
+                           (DefaultDeleter, TemplateDeleter, EmptyDeleter, PntrDeleter, PntrDeleterIndexed,
+                            FunctionDeleter),
                            (Minimal, MinimalAlign, Static, StaticAlign, Polymorphic, PolymorphicAlign, Virtual,
                             VirtualAlign))
 {
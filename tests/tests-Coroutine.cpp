@@ -0,0 +1,197 @@
+#include "tests-common.hpp"
+
+#include <cstdlib>
+#include <utility>
+
+
+namespace
+{
+  unsigned g_frames = 0u;
+  unsigned g_locals = 0u;
+
+  // Deallocates by pointer, like 'AllocatorMalloc'.
+  struct FrameAllocator
+  {
+    using SupportsStatic = pntr::NoStaticSupport;
+    using PointerDeallocate = void;
+
+    void *
+    allocate(std::size_t const p_size, std::size_t) noexcept
+    {
+      ++g_frames;
+      return std::malloc(p_size);
+    }
+
+    void
+    deallocate(void * const p_pointer) noexcept
+    {
+      --g_frames;
+      std::free(p_pointer);
+    }
+  };
+
+  // Deallocates by size and alignment, like 'AllocatorMemoryResource'.
+  struct FrameAllocatorSized
+  {
+    using SupportsStatic = pntr::NoStaticSupport;
+    using TypeInfoDeallocate = void;
+
+    void *
+    allocate(std::size_t const p_size, std::size_t const p_alignment) noexcept
+    {
+      g_frames += static_cast<unsigned>(p_size + p_alignment);
+      return std::malloc(p_size);
+    }
+
+    void
+    deallocate(void * const p_pointer, std::size_t const p_size, std::size_t const p_alignment) noexcept
+    {
+      g_frames -= static_cast<unsigned>(p_size + p_alignment);
+      std::free(p_pointer);
+    }
+  };
+
+  struct Local
+  {
+    Local() noexcept
+    {
+      ++g_locals;
+    }
+
+    ~Local()
+    {
+      --g_locals;
+    }
+  };
+
+  template<class t_allocator>
+  struct Task
+  {
+    struct promise_type: pntr::CoroutinePromise<promise_type, t_allocator>
+    {
+      std::suspend_always
+      initial_suspend() const noexcept
+      {
+        return {};
+      }
+
+      std::suspend_always
+      yield_value(int const p_value) noexcept
+      {
+        m_value = p_value;
+        return {};
+      }
+
+      void
+      return_value(int const p_value) noexcept
+      {
+        m_value = p_value;
+      }
+
+      void
+      unhandled_exception() const noexcept
+      {
+        std::abort();
+      }
+
+      int m_value = 0;
+    };
+
+    Task(pntr::SharedPtr<promise_type> p_frame) noexcept
+    : m_frame(std::move(p_frame))
+    {}
+
+    int
+    resume() const
+    {
+      m_frame->handle().resume();
+      return m_frame->m_value;
+    }
+
+    pntr::SharedPtr<promise_type> m_frame;
+  };
+
+  template<class t_allocator>
+  Task<t_allocator>
+  count(int const p_last)
+  {
+    Local const local;
+    for (int i = 1; i < p_last; ++i)
+    {
+      co_yield i;
+    }
+    co_return p_last;
+  }
+} // namespace
+
+
+TEMPLATE_TEST_CASE(TEST_PREFIX "CoroutinePromise", "", FrameAllocator, FrameAllocatorSized)
+{
+  using Promise = typename Task<TestType>::promise_type;
+
+  static_assert(sizeof(Task<TestType>) == sizeof(void *));
+
+  REQUIRE(g_frames == 0u);
+  REQUIRE(g_locals == 0u);
+
+  SECTION("Frame owned by the task")
+  {
+    Task<TestType> task = count<TestType>(3);
+    REQUIRE(g_frames != 0u);
+    REQUIRE(task.m_frame.use_count() == 1u);
+    REQUIRE(g_locals == 0u);
+    REQUIRE(task.resume() == 1);
+    REQUIRE(g_locals == 1u);
+    REQUIRE(task.resume() == 2);
+    REQUIRE(task.resume() == 3);
+    REQUIRE(task.m_frame->handle().done());
+    REQUIRE(g_locals == 0u);
+    REQUIRE(g_frames != 0u);
+  }
+
+  SECTION("Frame destroyed while suspended")
+  {
+    Task<TestType> task = count<TestType>(3);
+    REQUIRE(task.resume() == 1);
+    REQUIRE(g_locals == 1u);
+    Task<TestType> copy = task;
+    REQUIRE(task.m_frame.use_count() == 2u);
+    task.m_frame.reset();
+    REQUIRE(g_locals == 1u);
+    REQUIRE(copy.resume() == 2);
+    copy.m_frame.reset();
+    REQUIRE(g_locals == 0u);
+    REQUIRE(g_frames == 0u);
+  }
+
+  SECTION("Cancellation with weak pointers")
+  {
+    Task<TestType> task = count<TestType>(3);
+    pntr::WeakPtr<Promise> const weak = task.m_frame;
+    REQUIRE_FALSE(weak.expired());
+    REQUIRE(weak.lock() == task.m_frame);
+    REQUIRE(task.resume() == 1);
+    task.m_frame.reset();
+    REQUIRE(g_frames == 0u);
+    REQUIRE(weak.expired());
+    REQUIRE(weak.lock() == nullptr);
+  }
+
+  REQUIRE(g_frames == 0u);
+  REQUIRE(g_locals == 0u);
+}
+
+
+TEST_CASE(TEST_PREFIX "CoroutinePromise with AllocatorArena")
+{
+  pntr::ArenaPool pool;
+  {
+    pntr::ArenaPool::Scope const scope(pool);
+    Task<pntr::AllocatorArena<>> task = count<pntr::AllocatorArena<>>(2);
+    REQUIRE(pool.live_count() == 1u);
+    REQUIRE(task.resume() == 1);
+    REQUIRE(task.resume() == 2);
+  }
+  REQUIRE(pool.live_count() == 0u);
+  REQUIRE(g_locals == 0u);
+}
@@ -1,7 +1,8 @@
 #include "tests-common.hpp"
 
 
-TEMPLATE_PRODUCT_TEST_CASE(TEST_PREFIX "Counter", "", (pntr::CounterThreadSafe, pntr::CounterThreadUnsafe),
+TEMPLATE_PRODUCT_TEST_CASE(TEST_PREFIX "Counter", "",
+                           (pntr::CounterThreadSafe, pntr::CounterThreadUnsafe, pntr::CounterDeferred),
                            (std::uint8_t, std::uint16_t, std::uint32_t, std::uint64_t, std::int8_t, std::int16_t,
                             std::int32_t, std::int64_t))
 {
@@ -0,0 +1,126 @@
+#include "tests-common.hpp"
+
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+  struct DeferredBase
+  : pntr::IntruderNewDeferred<DeferredBase>
+  , LiveCounted<DeferredBase>
+  {
+    virtual ~DeferredBase() = default;
+  };
+
+  struct DeferredNode: DeferredBase
+  {
+    std::vector<pntr::SharedPtr<DeferredNode>> m_children;
+  };
+
+  static_assert(pntr::detail::is_deferred<DeferredNode>);
+  static_assert(pntr::detail::is_deferred<DeferredNode const>);
+  static_assert(!pntr::detail::is_deferred<pntr::IntruderNew<DeferredNode>>);
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "CounterDeferred")
+{
+  pntr::flush_deferred();
+  pntr::detail::DeferredLog & log = pntr::detail::DeferredLog::local();
+  REQUIRE(log.pending() == 0u);
+  REQUIRE(DeferredBase::live_count() == 0u);
+
+  SECTION("Releases are applied on flush")
+  {
+    pntr::SharedPtr<DeferredNode> a = pntr::make_shared<DeferredNode>();
+    a.reset();
+    REQUIRE(DeferredBase::live_count() == 1u);
+    REQUIRE(log.pending() == 1u);
+    pntr::flush_deferred();
+    REQUIRE(DeferredBase::live_count() == 0u);
+    REQUIRE(log.pending() == 0u);
+  }
+
+  SECTION("Copies cancel pending releases")
+  {
+    pntr::SharedPtr<DeferredNode> const a = pntr::make_shared<DeferredNode>();
+    for (unsigned i = 0u; i < 10u; ++i)
+    {
+      pntr::SharedPtr<DeferredNode> const b = a;
+      pntr::SharedPtr<DeferredBase const> const c = b;
+      REQUIRE(a.use_count() <= 3u);
+    }
+    REQUIRE(a.use_count() == 3u);
+    REQUIRE(log.pending() == 1u);
+    {
+      pntr::SharedPtr<DeferredNode> const b = a;
+      pntr::SharedPtr<DeferredNode> const c = a;
+      REQUIRE(a.use_count() == 3u);
+      REQUIRE(log.pending() == 0u);
+    }
+    pntr::flush_deferred();
+    REQUIRE(a.use_count() == 1u);
+    REQUIRE(DeferredBase::live_count() == 1u);
+  }
+
+  SECTION("The releases of an object are applied at once")
+  {
+    pntr::SharedPtr<DeferredNode> a = pntr::make_shared<DeferredNode>();
+    std::vector<pntr::SharedPtr<DeferredNode>> copies(10u, a);
+    REQUIRE(a.use_count() == 11u);
+    copies.clear();
+    a.reset();
+    REQUIRE(log.pending() == 1u);
+    REQUIRE(DeferredBase::live_count() == 1u);
+    pntr::flush_deferred();
+    REQUIRE(log.pending() == 0u);
+    REQUIRE(DeferredBase::live_count() == 0u);
+  }
+
+  SECTION("Full log and releases while flushing")
+  {
+    {
+      std::vector<pntr::SharedPtr<DeferredNode>> nodes;
+      for (unsigned i = 0u; i < 100u; ++i)
+      {
+        nodes.push_back(pntr::make_shared<DeferredNode>());
+        for (unsigned j = 0u; j < 20u; ++j)
+        {
+          nodes.back()->m_children.push_back(pntr::make_shared<DeferredNode>());
+        }
+      }
+    }
+    REQUIRE(log.pending() <= pntr::detail::DeferredLog::s_capacity);
+    REQUIRE(DeferredBase::live_count() < 2100u);
+    pntr::flush_deferred();
+    REQUIRE(DeferredBase::live_count() == 0u);
+  }
+
+  SECTION("Sharing with other threads and flush at thread exit")
+  {
+    pntr::SharedPtr<DeferredNode> a = pntr::make_shared<DeferredNode>();
+    std::vector<std::thread> threads;
+    for (unsigned i = 0u; i < 4u; ++i)
+    {
+      threads.emplace_back(
+        [a]() noexcept
+        {
+          for (unsigned j = 0u; j < 10000u; ++j)
+          {
+            pntr::SharedPtr<DeferredNode> const b = a;
+          }
+        });
+    }
+    for (std::thread & thread: threads)
+    {
+      thread.join();
+    }
+    REQUIRE(log.pending() == 0u);
+    REQUIRE(a.use_count() == 1u);
+    REQUIRE(DeferredBase::live_count() == 1u);
+  }
+
+  pntr::flush_deferred();
+  REQUIRE(DeferredBase::live_count() == 0u);
+}
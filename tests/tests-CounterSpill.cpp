@@ -0,0 +1,94 @@
+#include "tests-common.hpp"
+
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+  struct SpillTag;
+
+  // Both thread safeties are counted together.
+  template<class t_thread_safety>
+  struct SpillObject
+  : pntr::IntruderAllocSpill<SpillObject<t_thread_safety>, t_thread_safety>
+  , LiveCounted<SpillTag>
+  {};
+
+  using SafeObject = SpillObject<pntr::ThreadSafe>;
+  using UnsafeObject = SpillObject<pntr::ThreadUnsafe>;
+
+  static_assert(sizeof(pntr::IntruderAllocSpill<SafeObject>) == sizeof(std::uint8_t));
+  static_assert(SafeObject::pntr_get_max_usage_count() == 62u);
+  static_assert(SafeObject::pntr_get_max_weak_count() == 3u);
+
+
+  template<class t_object>
+  void
+  test_spill()
+  {
+    pntr::SharedPtr<t_object> object = pntr::make_shared<t_object>();
+    std::vector<pntr::SharedPtr<t_object>> shared(200u, object);
+    REQUIRE(object.use_count() == 201u);
+    std::vector<pntr::WeakPtr<t_object>> weak(20u, pntr::WeakPtr<t_object>(object));
+    REQUIRE(object->pntr_weak_count() == 21u);
+    REQUIRE(weak.front().lock() == object);
+
+    weak.resize(1u);
+    REQUIRE(object->pntr_weak_count() == 2u);
+    shared.resize(100u);
+    REQUIRE(object.use_count() == 101u);
+    shared.clear();
+    REQUIRE(object.use_count() == 1u);
+    REQUIRE(LiveCounted<SpillTag>::live_count() == 1u);
+    object.reset();
+    REQUIRE(LiveCounted<SpillTag>::live_count() == 0u);
+    REQUIRE(weak.front().expired());
+  }
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "CounterSpill")
+{
+  SECTION("ThreadUnsafe")
+  {
+    test_spill<UnsafeObject>();
+  }
+
+  SECTION("ThreadSafe")
+  {
+    test_spill<SafeObject>();
+  }
+
+  SECTION("Concurrent copies and releases around the maximum")
+  {
+    pntr::SharedPtr<SafeObject> object = pntr::make_shared<SafeObject>();
+    pntr::WeakPtr<SafeObject> const weak(object);
+    std::vector<std::thread> threads;
+    for (unsigned thread = 0u; thread < 4u; ++thread)
+    {
+      threads.emplace_back(
+        [&object, &weak]()
+        {
+          for (unsigned round = 0u; round < 200u; ++round)
+          {
+            std::vector<pntr::SharedPtr<SafeObject>> shared(40u, object);
+            std::vector<pntr::SharedPtr<SafeObject>> locked;
+            for (unsigned copy = 0u; copy < 10u; ++copy)
+            {
+              locked.push_back(weak.lock());
+            }
+          }
+        });
+    }
+    for (std::thread & thread : threads)
+    {
+      thread.join();
+    }
+    REQUIRE(object.use_count() == 1u);
+    REQUIRE(object->pntr_weak_count() == 2u);
+    object.reset();
+    REQUIRE(weak.expired());
+    REQUIRE(LiveCounted<SpillTag>::live_count() == 0u);
+  }
+}
@@ -0,0 +1,217 @@
+#include "tests-common.hpp"
+
+#include <vector>
+
+
+namespace
+{
+  unsigned g_acyclic_leaves = 0u;
+
+  struct AcyclicLeaf: pntr::IntruderNew<AcyclicLeaf>
+  {
+    AcyclicLeaf() noexcept
+    {
+      ++g_acyclic_leaves;
+    }
+
+    ~AcyclicLeaf()
+    {
+      --g_acyclic_leaves;
+    }
+  };
+
+  unsigned g_cycle_nodes = 0u;
+
+  struct CycleNode: pntr::IntruderCycle<CycleNode>
+  {
+    CycleNode() noexcept
+    {
+      ++g_cycle_nodes;
+    }
+
+    ~CycleNode()
+    {
+      --g_cycle_nodes;
+    }
+
+    template<class t_visitor>
+    void
+    pntr_visit_children(t_visitor && p_visit)
+    {
+      for (pntr::SharedPtr<CycleNode> & child: m_children)
+      {
+        p_visit(child);
+      }
+      p_visit(m_leaf);
+    }
+
+    std::vector<pntr::SharedPtr<CycleNode>> m_children;
+    pntr::SharedPtr<AcyclicLeaf> m_leaf;
+  };
+
+  static_assert(pntr::detail::is_cycle_collected<CycleNode>);
+  static_assert(!pntr::detail::is_cycle_collected<AcyclicLeaf>);
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "CycleCollector")
+{
+  pntr::CycleCollector & collector = pntr::CycleCollector::local();
+  collector.collect();
+  REQUIRE(collector.pending() == 0u);
+  REQUIRE(g_cycle_nodes == 0u);
+
+  SECTION("Acyclic objects are released immediately")
+  {
+    pntr::SharedPtr<CycleNode> a = pntr::make_shared<CycleNode>();
+    a->m_children.push_back(pntr::make_shared<CycleNode>());
+    a.reset();
+    REQUIRE(g_cycle_nodes == 0u);
+    REQUIRE(collector.pending() == 0u);
+  }
+
+  SECTION("Self reference")
+  {
+    pntr::SharedPtr<CycleNode> a = pntr::make_shared<CycleNode>();
+    a->m_children.push_back(a);
+    a->m_leaf = pntr::make_shared<AcyclicLeaf>();
+    a.reset();
+    REQUIRE(g_cycle_nodes == 1u);
+    REQUIRE(collector.pending() == 1u);
+    REQUIRE(collector.collect() == 1u);
+    REQUIRE(g_cycle_nodes == 0u);
+    REQUIRE(g_acyclic_leaves == 0u);
+  }
+
+  SECTION("Live cycles are kept")
+  {
+    pntr::SharedPtr<CycleNode> a = pntr::make_shared<CycleNode>();
+    pntr::SharedPtr<CycleNode> b = pntr::make_shared<CycleNode>();
+    a->m_children.push_back(b);
+    b->m_children.push_back(a);
+    pntr::SharedPtr<CycleNode> c = b;
+    b.reset();
+    REQUIRE(collector.pending() == 1u);
+    REQUIRE(collector.collect() == 0u);
+    REQUIRE(g_cycle_nodes == 2u);
+    REQUIRE(a.use_count() == 2u);
+    REQUIRE(c.use_count() == 2u);
+    REQUIRE(a->pntr_get_user() == 0u);
+
+    // Releasing the buffered object again is possible after it has been collected.
+    a.reset();
+    c.reset();
+    REQUIRE(collector.pending() == 2u);
+    REQUIRE(collector.collect() == 2u);
+    REQUIRE(g_cycle_nodes == 0u);
+  }
+
+  SECTION("Garbage cycle referencing a live object")
+  {
+    pntr::SharedPtr<CycleNode> live = pntr::make_shared<CycleNode>();
+    {
+      pntr::SharedPtr<CycleNode> a = pntr::make_shared<CycleNode>();
+      pntr::SharedPtr<CycleNode> b = pntr::make_shared<CycleNode>();
+      a->m_children.push_back(b);
+      b->m_children.push_back(a);
+      b->m_children.push_back(live);
+    }
+    REQUIRE(g_cycle_nodes == 3u);
+    REQUIRE(collector.collect() == 2u);
+    REQUIRE(g_cycle_nodes == 1u);
+    REQUIRE(live.use_count() == 1u);
+    REQUIRE(collector.pending() == 0u);
+  }
+
+  SECTION("Incremental collection of many cycles")
+  {
+    for (unsigned i = 0u; i < 100u; ++i)
+    {
+      std::vector<pntr::SharedPtr<CycleNode>> ring;
+      for (unsigned j = 0u; j < 10u; ++j)
+      {
+        ring.push_back(pntr::make_shared<CycleNode>());
+      }
+      for (unsigned j = 0u; j < 10u; ++j)
+      {
+        ring[j]->m_children.push_back(ring[(j + 1u) % 10u]);
+        ring[j]->m_children.push_back(ring[(j + 3u) % 10u]);
+      }
+    }
+    REQUIRE(g_cycle_nodes == 1000u);
+    std::size_t released = 0u;
+    unsigned calls = 0u;
+    while (collector.pending() > 0u)
+    {
+      released += collector.collect(50u);
+      ++calls;
+    }
+    REQUIRE(released == 1000u);
+    REQUIRE(calls > 10u);
+    REQUIRE(g_cycle_nodes == 0u);
+  }
+
+  SECTION("Batch exceeding the budget is abandoned")
+  {
+    pntr::SharedPtr<CycleNode> live = pntr::make_shared<CycleNode>();
+    pntr::SharedPtr<CycleNode> head = pntr::make_shared<CycleNode>();
+    pntr::SharedPtr<CycleNode> node = head;
+    for (unsigned i = 0u; i < 99u; ++i)
+    {
+      node->m_children.push_back(pntr::make_shared<CycleNode>());
+      node = node->m_children.back();
+    }
+    node->m_children.push_back(head);
+    node->m_children.push_back(live);
+    node.reset();
+    REQUIRE(collector.collect() == 0u);
+
+    // The only root reaches the whole cycle.
+    head.reset();
+    REQUIRE(collector.pending() == 1u);
+    REQUIRE(collector.collect(10u) == 0u);
+    REQUIRE(collector.pending() == 1u);
+    REQUIRE(g_cycle_nodes == 101u);
+    REQUIRE(live.use_count() == 2u);
+    REQUIRE(collector.collect() == 100u);
+    REQUIRE(collector.pending() == 0u);
+    REQUIRE(live.use_count() == 1u);
+  }
+
+  SECTION("The collector bits are reserved")
+  {
+    static_assert(CycleNode::pntr_get_max_user() == 0u);
+    pntr::SharedPtr<CycleNode> a = pntr::make_shared<CycleNode>();
+    a->m_children.push_back(a);
+    pntr::SharedPtr<CycleNode> b = a;
+    a.reset();
+    REQUIRE(collector.pending() == 1u);
+    REQUIRE(b->pntr_get_user() == 0u);
+    REQUIRE(!b->pntr_try_set_user(1u));
+    REQUIRE(b->pntr_try_set_user(0u));
+
+    // The buffered flag is kept, so the object isn't buffered twice.
+    b.reset();
+    REQUIRE(collector.pending() == 1u);
+    REQUIRE(collector.collect() == 1u);
+    REQUIRE(g_cycle_nodes == 0u);
+  }
+
+  SECTION("Long chain")
+  {
+    pntr::SharedPtr<CycleNode> head = pntr::make_shared<CycleNode>();
+    pntr::SharedPtr<CycleNode> node = head;
+    for (unsigned i = 0u; i < 100000u; ++i)
+    {
+      node->m_children.push_back(pntr::make_shared<CycleNode>());
+      node = node->m_children.back();
+    }
+    node->m_children.push_back(head);
+    node.reset();
+    head.reset();
+    REQUIRE(collector.collect() == 100001u);
+    REQUIRE(g_cycle_nodes == 0u);
+  }
+
+  collector.collect();
+}
@@ -0,0 +1,106 @@
+#include "tests-common.hpp"
+
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+  unsigned g_local_objects = 0u;
+
+  struct LocalBase: pntr::IntruderNew<LocalBase>
+  {
+    LocalBase() noexcept
+    {
+      ++g_local_objects;
+    }
+
+    virtual ~LocalBase()
+    {
+      --g_local_objects;
+    }
+  };
+
+  struct LocalDerived: LocalBase
+  {
+    int m_value = 42;
+  };
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "LocalSharedPtr")
+{
+  REQUIRE(g_local_objects == 0u);
+
+  SECTION("Empty")
+  {
+    pntr::LocalSharedPtr<LocalBase> const a;
+    pntr::LocalSharedPtr<LocalBase> const b(pntr::SharedPtr<LocalBase>{});
+    REQUIRE(!a);
+    REQUIRE(a == nullptr);
+    REQUIRE(b == a);
+    REQUIRE(a.local_use_count() == 0u);
+    REQUIRE(a.use_count() == 0u);
+    REQUIRE(!a.get_shared());
+  }
+
+  SECTION("Copies share one reference")
+  {
+    pntr::SharedPtr<LocalDerived> shared = pntr::make_shared<LocalDerived>();
+    pntr::LocalSharedPtr<LocalDerived> a(shared);
+    REQUIRE(shared.use_count() == 2u);
+    {
+      std::vector<pntr::LocalSharedPtr<LocalDerived>> copies(10u, a);
+      pntr::LocalSharedPtr<LocalBase const> base = a;
+      REQUIRE(base == a);
+      REQUIRE(a.local_use_count() == 12u);
+      REQUIRE(shared.use_count() == 2u);
+      REQUIRE(a->m_value == 42);
+    }
+    REQUIRE(a.local_use_count() == 1u);
+    shared.reset();
+    REQUIRE(a.use_count() == 1u);
+
+    pntr::LocalSharedPtr<LocalBase> b = std::move(a);
+    REQUIRE(!a);
+    REQUIRE(b != nullptr);
+    b.reset();
+    REQUIRE(g_local_objects == 0u);
+  }
+
+  SECTION("Each construction has its own counter")
+  {
+    pntr::SharedPtr<LocalDerived> const shared = pntr::make_shared<LocalDerived>();
+    static_assert(std::is_nothrow_constructible_v<pntr::LocalSharedPtr<LocalDerived>, pntr::SharedPtr<LocalDerived>>);
+    pntr::LocalSharedPtr<LocalDerived> const a(shared);
+    pntr::LocalSharedPtr<LocalDerived> const b(shared);
+    REQUIRE(a == b);
+    REQUIRE(a.local_use_count() == 1u);
+    REQUIRE(b.local_use_count() == 1u);
+    REQUIRE(shared.use_count() == 3u);
+  }
+
+  SECTION("Conversion to SharedPtr for other threads")
+  {
+    pntr::LocalSharedPtr<LocalDerived> a(pntr::make_shared<LocalDerived>());
+    pntr::LocalSharedPtr<LocalBase> const b = a;
+    REQUIRE(a.use_count() == 1u);
+    pntr::SharedPtr<LocalBase> shared = b.get_shared();
+    REQUIRE(shared.get() == b.get());
+    REQUIRE(shared.use_count() == 2u);
+    a.reset();
+    std::size_t local_use_count = 0u;
+    std::thread thread(
+      [moved = std::move(shared), &local_use_count]() noexcept
+      {
+        pntr::LocalSharedPtr<LocalBase> const c(moved);
+        pntr::LocalSharedPtr<LocalBase> const d = c;
+        local_use_count = d.local_use_count();
+      });
+    thread.join();
+    REQUIRE(local_use_count == 2u);
+    REQUIRE(b.use_count() == 1u);
+  }
+
+  REQUIRE(g_local_objects == 0u);
+}
@@ -0,0 +1,148 @@
+#include "tests-common.hpp"
+
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+  std::atomic<unsigned> g_other_thread_destructions{0u};
+
+  struct ResetObject
+  : pntr::IntruderNew<ResetObject>
+  , LiveCounted<ResetObject>
+  {
+    explicit ResetObject(bool const p_affine = false) noexcept
+    : m_affine(p_affine)
+    , m_thread(std::this_thread::get_id())
+    {}
+
+    ~ResetObject()
+    {
+      if (std::this_thread::get_id() != m_thread)
+      {
+        ++g_other_thread_destructions;
+        m_affine_violated = m_affine;
+      }
+    }
+
+    bool m_affine;
+    std::thread::id m_thread;
+    static inline std::atomic<bool> m_affine_violated{false};
+  };
+
+  // Counted with the reset objects.
+  struct DeferredObject
+  : pntr::IntruderNewDeferred<DeferredObject>
+  , LiveCounted<ResetObject>
+  {};
+
+  // Runs the tasks immediately, and counts them.
+  struct InlineExecutor
+  {
+    std::size_t
+    concurrency() const noexcept
+    {
+      return 4u;
+    }
+
+    template<class t_task>
+    void
+    operator()(t_task && p_task)
+    {
+      ++m_tasks;
+      p_task();
+    }
+
+    std::size_t m_tasks = 0u;
+  };
+
+  // Refuses all tasks, so the calling thread has to run them.
+  struct FailingExecutor
+  {
+    std::size_t
+    concurrency() const noexcept
+    {
+      return 4u;
+    }
+
+    template<class t_task>
+    void
+    operator()(t_task &&)
+    {
+      throw std::runtime_error("No threads");
+    }
+  };
+
+  std::vector<pntr::SharedPtr<ResetObject>>
+  make_objects(std::size_t const p_count)
+  {
+    std::vector<pntr::SharedPtr<ResetObject>> objects;
+    for (std::size_t i = 0u; i < p_count; ++i)
+    {
+      // Every third pointer shares the object of its predecessor.
+      objects.push_back(i % 3u == 2u ? objects.back() : pntr::make_shared<ResetObject>(i % 100u == 0u));
+    }
+    return objects;
+  }
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "ParallelReset")
+{
+  std::size_t const count = 4u * pntr::s_parallel_reset_chunk + 7u;
+  g_other_thread_destructions = 0u;
+
+  SECTION("Small ranges are reset by the calling thread")
+  {
+    std::vector<pntr::SharedPtr<ResetObject>> objects = make_objects(100u);
+    InlineExecutor executor;
+    pntr::parallel_reset(objects.begin(), objects.end(), executor);
+    REQUIRE(executor.m_tasks == 0u);
+    REQUIRE(ResetObject::live_count() == 0u);
+    REQUIRE(objects.size() == 100u);
+    REQUIRE(objects.front() == nullptr);
+  }
+
+  SECTION("Partitioned by the concurrency of the executor")
+  {
+    std::vector<pntr::SharedPtr<ResetObject>> objects = make_objects(count);
+    InlineExecutor executor;
+    pntr::parallel_reset(objects.begin(), objects.end(), executor);
+    REQUIRE(executor.m_tasks == 3u);
+    REQUIRE(ResetObject::live_count() == 0u);
+  }
+
+  SECTION("Tasks refused by the executor")
+  {
+    std::vector<pntr::SharedPtr<ResetObject>> objects = make_objects(count);
+    pntr::parallel_reset(objects.begin(), objects.end(), FailingExecutor());
+    REQUIRE(ResetObject::live_count() == 0u);
+  }
+
+  SECTION("Worker threads with objects kept for the calling thread")
+  {
+    std::vector<pntr::SharedPtr<ResetObject>> objects = make_objects(count);
+    {
+      pntr::ThreadExecutor executor(4u);
+      pntr::parallel_reset(objects.begin(), objects.end(), executor,
+                           [](ResetObject const & p_object) noexcept { return p_object.m_affine; });
+      REQUIRE(ResetObject::live_count() == 0u);
+    }
+    REQUIRE(!ResetObject::m_affine_violated);
+    REQUIRE(g_other_thread_destructions > 0u);
+  }
+
+  SECTION("Deferred releases are flushed by the workers")
+  {
+    std::vector<pntr::SharedPtr<DeferredObject>> objects(count);
+    for (pntr::SharedPtr<DeferredObject> & object : objects)
+    {
+      object = pntr::make_shared<DeferredObject>();
+    }
+    pntr::ThreadExecutor executor(4u);
+    pntr::parallel_reset(objects.begin(), objects.end(), executor);
+    pntr::flush_deferred();
+    REQUIRE(ResetObject::live_count() == 0u);
+  }
+}
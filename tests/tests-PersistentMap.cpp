@@ -0,0 +1,131 @@
+#include "tests-common.hpp"
+
+#include <map>
+#include <string>
+
+
+// A hash function with many collisions to test the collision nodes.
+struct BadHash
+{
+  std::size_t
+  operator()(std::size_t const p_key) const noexcept
+  {
+    return (p_key % 7u) * 0x0101010101010101u;
+  }
+};
+
+
+TEMPLATE_TEST_CASE(TEST_PREFIX "PersistentMap", "", pntr::ThreadSafe, pntr::ThreadUnsafe)
+{
+  using Map =
+    pntr::PersistentMap<std::size_t, std::string, std::hash<std::size_t>, std::equal_to<std::size_t>, TestType>;
+
+  SECTION("Empty map")
+  {
+    Map m;
+    REQUIRE(m.empty());
+    REQUIRE(m.find(0u) == nullptr);
+    REQUIRE(m.begin() == m.end());
+    REQUIRE(m.erase(0u).empty());
+    REQUIRE_THROWS_AS(m.at(0u), std::out_of_range);
+  }
+
+  SECTION("Set, find and erase")
+  {
+    std::size_t const count = 20000u;
+    Map m;
+    Map half;
+    for (std::size_t i = 0u; i < count; ++i)
+    {
+      if (i == count / 2u)
+      {
+        half = m;
+      }
+      m = m.set(i * 7919u, std::to_string(i));
+    }
+    REQUIRE(m.size() == count);
+    REQUIRE(half.size() == count / 2u);
+    for (std::size_t i = 0u; i < count; ++i)
+    {
+      REQUIRE(m.at(i * 7919u) == std::to_string(i));
+      REQUIRE(half.contains(i * 7919u) == (i < count / 2u));
+    }
+
+    std::map<std::size_t, std::string> visited;
+    for (auto const & entry: m)
+    {
+      REQUIRE(visited.emplace(entry.first, entry.second).second);
+    }
+    REQUIRE(visited.size() == count);
+
+    Map n = m.set(0u, "zero");
+    REQUIRE(n.size() == count);
+    REQUIRE(n.at(0u) == "zero");
+    REQUIRE(m.at(0u) == "0");
+
+    for (std::size_t i = 0u; i < count; i += 2u)
+    {
+      m = m.erase(i * 7919u);
+    }
+    REQUIRE(m.size() == count / 2u);
+    for (std::size_t i = 0u; i < count; ++i)
+    {
+      REQUIRE(m.contains(i * 7919u) == ((i & 1u) != 0u));
+    }
+    REQUIRE(n.size() == count);
+    REQUIRE(half.size() == count / 2u);
+  }
+
+  SECTION("Transient")
+  {
+    Map base{{1u, "one"}, {2u, "two"}};
+    typename Map::Transient t = base.transient();
+    for (std::size_t i = 0u; i < 3000u; ++i)
+    {
+      REQUIRE(t.set(i, std::to_string(i)) == (i != 1u && i != 2u));
+    }
+    REQUIRE(t.erase(5u));
+    REQUIRE_FALSE(t.erase(5u));
+    Map m = std::move(t).persistent();
+    REQUIRE(t.empty());
+    REQUIRE(m.size() == 2999u);
+    REQUIRE(m.at(1u) == "1");
+    REQUIRE(base.at(1u) == "one");
+    REQUIRE(base.size() == 2u);
+  }
+}
+
+
+TEMPLATE_TEST_CASE(TEST_PREFIX "PersistentMap with hash collisions", "", pntr::ThreadSafe, pntr::ThreadUnsafe)
+{
+  using Map = pntr::PersistentMap<std::size_t, std::size_t, BadHash, std::equal_to<std::size_t>, TestType>;
+
+  Map m;
+  for (std::size_t i = 0u; i < 700u; ++i)
+  {
+    m = m.set(i, i * 2u);
+  }
+  REQUIRE(m.size() == 700u);
+  Map n = m;
+  for (std::size_t i = 0u; i < 700u; ++i)
+  {
+    REQUIRE(*m.find(i) == i * 2u);
+    m = m.set(i, i);
+  }
+  for (std::size_t i = 0u; i < 700u; i += 3u)
+  {
+    m = m.erase(i);
+  }
+  for (std::size_t i = 0u; i < 700u; ++i)
+  {
+    REQUIRE(m.contains(i) == (i % 3u != 0u));
+    REQUIRE(n.at(i) == i * 2u);
+  }
+  std::size_t count = 0u;
+  for (auto const & entry: m)
+  {
+    REQUIRE(entry.first == entry.second);
+    ++count;
+  }
+  REQUIRE(count == m.size());
+}
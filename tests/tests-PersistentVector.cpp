@@ -0,0 +1,141 @@
+#include "tests-common.hpp"
+
+#include <string>
+#include <vector>
+
+
+TEMPLATE_TEST_CASE(TEST_PREFIX "PersistentVector", "", pntr::ThreadSafe, pntr::ThreadUnsafe)
+{
+  using Vector = pntr::PersistentVector<std::size_t, TestType>;
+
+  SECTION("Empty vector")
+  {
+    Vector v;
+    REQUIRE(v.empty());
+    REQUIRE(v.size() == 0u);
+    REQUIRE(v.begin() == v.end());
+    REQUIRE_THROWS_AS(v.at(0u), std::out_of_range);
+  }
+
+  SECTION("Push back, set and pop back across all tree levels")
+  {
+    std::size_t const count = 32u * 32u * 32u + 100u;
+    std::vector<Vector> versions;
+    Vector v;
+    for (std::size_t i = 0u; i < count; ++i)
+    {
+      if ((i & (i - 1u)) == 0u)
+      {
+        versions.push_back(v);
+      }
+      v = v.push_back(i);
+    }
+    REQUIRE(v.size() == count);
+    for (std::size_t i = 0u; i < count; ++i)
+    {
+      REQUIRE(v[i] == i);
+    }
+    std::size_t expected = 0u;
+    for (std::size_t value: v)
+    {
+      REQUIRE(value == expected++);
+    }
+    REQUIRE(expected == count);
+
+    // Older versions are unchanged.
+    for (Vector const & version: versions)
+    {
+      for (std::size_t i = 0u; i < version.size(); ++i)
+      {
+        REQUIRE(version[i] == i);
+      }
+    }
+
+    Vector w = v.set(1000u, 7u).set(count - 1u, 8u);
+    REQUIRE(w[1000u] == 7u);
+    REQUIRE(w[count - 1u] == 8u);
+    REQUIRE(v[1000u] == 1000u);
+    REQUIRE(v[count - 1u] == count - 1u);
+
+    for (std::size_t i = count; i > 0u; --i)
+    {
+      REQUIRE(v.back() == i - 1u);
+      v = v.pop_back();
+      REQUIRE(v.size() == i - 1u);
+      if ((i & 1023u) == 0u && i > 1u)
+      {
+        REQUIRE(v.front() == 0u);
+        REQUIRE(v[(i - 1u) / 2u] == (i - 1u) / 2u);
+      }
+    }
+    REQUIRE(v.empty());
+    REQUIRE(w.size() == count);
+  }
+
+  SECTION("Transient")
+  {
+    Vector base{1u, 2u, 3u};
+    typename Vector::Transient t = base.transient();
+    for (std::size_t i = 0u; i < 5000u; ++i)
+    {
+      t.push_back(i);
+    }
+    t.set(0u, 100u);
+    t.pop_back();
+    Vector v = std::move(t).persistent();
+    REQUIRE(t.empty());
+    REQUIRE(v.size() == 3u + 4999u);
+    REQUIRE(v[0u] == 100u);
+    REQUIRE(v[3u + 4998u] == 4998u);
+    REQUIRE(base.size() == 3u);
+    REQUIRE(base[0u] == 1u);
+
+    // Modifying a transient of a shared vector doesn't change the vector.
+    typename Vector::Transient u = v.transient();
+    for (std::size_t i = 0u; i < v.size(); ++i)
+    {
+      u.set(i, 0u);
+    }
+    REQUIRE(v[0u] == 100u);
+    REQUIRE(v[4000u] == 3997u);
+    REQUIRE(u[4000u] == 0u);
+  }
+
+  SECTION("Saturated usage counters")
+  {
+    // More copies than the 8 bit usage counters can count force copies of the nodes.
+    Vector v;
+    for (std::size_t i = 0u; i < 100u; ++i)
+    {
+      v = v.push_back(i);
+    }
+    std::vector<Vector> copies(1000u, v);
+    for (Vector const & copy: copies)
+    {
+      REQUIRE(copy.size() == 100u);
+      REQUIRE(copy[99u] == 99u);
+    }
+    copies.clear();
+    REQUIRE(v[50u] == 50u);
+  }
+}
+
+
+TEMPLATE_TEST_CASE(TEST_PREFIX "PersistentVector with non-trivial values", "", pntr::ThreadSafe, pntr::ThreadUnsafe)
+{
+  using Vector = pntr::PersistentVector<std::string, TestType>;
+
+  Vector v;
+  for (std::size_t i = 0u; i < 2000u; ++i)
+  {
+    v = v.push_back(std::to_string(i));
+  }
+  Vector w = v.set(1234u, "x");
+  REQUIRE(v.at(1234u) == "1234");
+  REQUIRE(w.at(1234u) == "x");
+  while (!w.empty())
+  {
+    w = w.pop_back();
+  }
+  REQUIRE(v.back() == "1999");
+}
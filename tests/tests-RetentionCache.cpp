@@ -0,0 +1,206 @@
+#include "tests-common.hpp"
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+  struct Cached;
+  using Cache = pntr::RetentionCache<int, Cached>;
+
+  struct Cached
+  : Cache::Entry
+  , LiveCounted<Cached>
+  {
+    explicit Cached(int const p_value) noexcept
+    : m_value(p_value)
+    {}
+
+    int m_value;
+    // Released by the destructor, which may retain it in the same cache.
+    pntr::SharedPtr<Cached> m_child;
+  };
+
+  struct Sized;
+  using SizedCache = pntr::RetentionCache<int, Sized>;
+
+  struct Sized: SizedCache::Entry
+  {
+    explicit Sized(std::size_t const p_bytes) noexcept
+    : m_bytes(p_bytes)
+    {}
+
+    std::size_t
+    retained_bytes() const noexcept
+    {
+      return m_bytes;
+    }
+
+    std::size_t m_bytes;
+  };
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "RetentionCache")
+{
+  REQUIRE(Cached::live_count() == 0u);
+
+  SECTION("Retain and revive")
+  {
+    Cache cache(10u * sizeof(Cached));
+    pntr::SharedPtr<Cached> object = cache.find_or_create(1, 10);
+    REQUIRE(object->m_value == 10);
+    REQUIRE(cache.find_or_create(1, 20) == object);
+    REQUIRE(cache.find(2) == nullptr);
+    Cached const * const address = object.get();
+    object.reset();
+    REQUIRE(Cached::live_count() == 1u);
+    REQUIRE(cache.size() == 1u);
+    REQUIRE(cache.retained_count() == 1u);
+    REQUIRE(cache.retained_bytes() == sizeof(Cached));
+
+    object = cache.find(1);
+    REQUIRE(object.get() == address);
+    REQUIRE(object.use_count() == 1u);
+    REQUIRE(cache.retained_count() == 0u);
+    REQUIRE(cache.retained_bytes() == 0u);
+    pntr::SharedPtr<Cached> const copy = cache.find(1);
+    REQUIRE(object.use_count() == 2u);
+  }
+
+  SECTION("Least recently used objects are evicted")
+  {
+    Cache cache(2u * sizeof(Cached));
+    for (int i = 0; i < 3; ++i)
+    {
+      cache.find_or_create(i, i);
+    }
+    REQUIRE(Cached::live_count() == 2u);
+    REQUIRE(cache.find(0) == nullptr);
+    REQUIRE(cache.find(1) != nullptr);
+    cache.find_or_create(3, 3);
+    REQUIRE(cache.find(2) == nullptr);
+    REQUIRE(cache.find(1) != nullptr);
+    REQUIRE(cache.find(3) != nullptr);
+  }
+
+  SECTION("Referenced objects are never evicted")
+  {
+    Cache cache(0u);
+    pntr::SharedPtr<Cached> const kept = cache.find_or_create(1, 1);
+    cache.find_or_create(2, 2);
+    REQUIRE(Cached::live_count() == 1u);
+    cache.trim(0u);
+    REQUIRE(cache.find(1) == kept);
+
+    cache.set_capacity(sizeof(Cached));
+    cache.find_or_create(2, 2);
+    REQUIRE(cache.retained_count() == 1u);
+    cache.set_capacity(0u);
+    REQUIRE(cache.retained_count() == 0u);
+    REQUIRE(cache.capacity() == 0u);
+    REQUIRE(Cached::live_count() == 1u);
+  }
+
+  SECTION("Erase")
+  {
+    Cache cache(10u * sizeof(Cached));
+    cache.find_or_create(1, 1);
+    pntr::SharedPtr<Cached> referenced = cache.find_or_create(2, 2);
+    REQUIRE(cache.erase(1));
+    REQUIRE_FALSE(cache.erase(1));
+    REQUIRE(Cached::live_count() == 1u);
+    REQUIRE(cache.erase(2));
+    REQUIRE(cache.find(2) == nullptr);
+    REQUIRE(cache.find_or_create(2, 3)->m_value == 3);
+    referenced.reset();
+    REQUIRE(Cached::live_count() == 1u);
+    REQUIRE(cache.size() == 1u);
+  }
+
+  SECTION("Destructors release objects of the same cache")
+  {
+    Cache cache(sizeof(Cached));
+    {
+      pntr::SharedPtr<Cached> const parent = cache.find_or_create(1, 1);
+      parent->m_child = cache.find_or_create(2, 2);
+      parent->m_child->m_child = cache.find_or_create(3, 3);
+    }
+    REQUIRE(cache.retained_count() == 1u);
+    REQUIRE(Cached::live_count() == 3u);
+    // Each eviction retains the child of the evicted object.
+    cache.trim(0u);
+    REQUIRE(Cached::live_count() == 2u);
+    REQUIRE(cache.find(2) != nullptr);
+    cache.trim(0u);
+    REQUIRE(Cached::live_count() == 1u);
+    REQUIRE(cache.retained_count() == 1u);
+    cache.trim(0u);
+    REQUIRE(Cached::live_count() == 0u);
+    REQUIRE(cache.size() == 0u);
+  }
+
+  SECTION("Referenced objects outlive the cache")
+  {
+    pntr::SharedPtr<Cached> object;
+    {
+      Cache cache(10u * sizeof(Cached));
+      object = cache.find_or_create(1, 1);
+      cache.find_or_create(2, 2);
+      REQUIRE(Cached::live_count() == 2u);
+    }
+    REQUIRE(Cached::live_count() == 1u);
+    object.reset();
+  }
+
+  SECTION("Retained bytes of the objects")
+  {
+    SizedCache cache(1000u);
+    cache.find_or_create(1, 600u);
+    REQUIRE(cache.retained_bytes() == 600u);
+    cache.find_or_create(2, 300u);
+    REQUIRE(cache.retained_bytes() == 900u);
+    cache.find_or_create(3, 200u);
+    REQUIRE(cache.retained_bytes() == 500u);
+    REQUIRE(cache.find(1) == nullptr);
+    // An object which exceeds the capacity on its own is evicted with all others.
+    cache.find_or_create(4, 2000u);
+    REQUIRE(cache.retained_bytes() == 0u);
+    REQUIRE(cache.size() == 0u);
+  }
+
+  SECTION("Concurrent lookups and releases")
+  {
+    Cache cache(8u * sizeof(Cached));
+    std::atomic<bool> mismatch = false;
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 4; ++t)
+    {
+      threads.emplace_back(
+        [&cache, &mismatch, t]() noexcept
+        {
+          for (int i = 0; i < 5000; ++i)
+          {
+            int const key = (i * 7 + t) % 16;
+            pntr::SharedPtr<Cached> const object = cache.find_or_create(key, key);
+            if (object->m_value != key || (i % 3 == 0 && cache.find(key) != object))
+            {
+              mismatch = true;
+            }
+          }
+        });
+    }
+    for (std::thread & thread : threads)
+    {
+      thread.join();
+    }
+    REQUIRE_FALSE(mismatch);
+    REQUIRE(cache.retained_count() == cache.size());
+    REQUIRE(cache.retained_bytes() <= 8u * sizeof(Cached));
+    REQUIRE(Cached::live_count() == cache.size());
+  }
+
+  REQUIRE(Cached::live_count() == 0u);
+}
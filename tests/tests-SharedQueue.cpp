@@ -0,0 +1,164 @@
+#include "tests-common.hpp"
+
+#include <thread>
+#include <vector>
+
+
+namespace
+{
+  struct QueueObject
+  : pntr::IntruderNew<QueueObject>
+  , LiveCounted<QueueObject>
+  {
+    explicit QueueObject(unsigned const p_value) noexcept
+    : m_value(p_value)
+    {}
+
+    unsigned m_value;
+  };
+
+  // Push the values of all producers and return the sum of the values popped by all consumers.
+  template<class t_queue>
+  unsigned
+  run_pipeline(t_queue & p_queue, unsigned const p_producers, unsigned const p_consumers, unsigned const p_count)
+  {
+    std::atomic<unsigned> popped{0u};
+    std::atomic<unsigned> sum{0u};
+    std::vector<std::thread> threads;
+    for (unsigned producer = 0u; producer < p_producers; ++producer)
+    {
+      threads.emplace_back(
+        [&p_queue, p_count]() noexcept
+        {
+          for (unsigned value = 1u; value <= p_count; ++value)
+          {
+            pntr::SharedPtr<QueueObject> object = pntr::make_shared<QueueObject>(value);
+            if constexpr (std::is_same_v<t_queue, pntr::SharedQueue<QueueObject>>)
+            {
+              while (!p_queue.try_push(object))
+              {
+                std::this_thread::yield();
+              }
+            }
+            else
+            {
+              p_queue.push(object);
+            }
+          }
+        });
+    }
+    for (unsigned consumer = 0u; consumer < p_consumers; ++consumer)
+    {
+      threads.emplace_back(
+        [&p_queue, &popped, &sum, total = p_producers * p_count]() noexcept
+        {
+          while (popped.load() < total)
+          {
+            pntr::SharedPtr<QueueObject> const object = p_queue.try_pop();
+            if (object != nullptr)
+            {
+              // Popped objects keep the single reference of their producer.
+              sum += (object.use_count() == 1u ? object->m_value : 0u);
+              ++popped;
+            }
+          }
+        });
+    }
+    for (std::thread & thread : threads)
+    {
+      thread.join();
+    }
+    return sum.load();
+  }
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "SharedQueue")
+{
+  REQUIRE(QueueObject::live_count() == 0u);
+
+  SECTION("release_raw and adopt transfer the reference")
+  {
+    pntr::SharedPtr<QueueObject> a = pntr::make_shared<QueueObject>(1u);
+    QueueObject * const raw = a.release_raw();
+    REQUIRE(a == nullptr);
+    REQUIRE(raw->pntr_use_count() == 1u);
+    pntr::SharedPtr<QueueObject> const b = pntr::SharedPtr<QueueObject>::adopt(raw);
+    REQUIRE(b.use_count() == 1u);
+    REQUIRE(b->m_value == 1u);
+  }
+
+  SECTION("Bounded queue")
+  {
+    pntr::SharedQueue<QueueObject> queue(3u);
+    REQUIRE(queue.capacity() == 4u);
+    REQUIRE(queue.try_pop() == nullptr);
+    for (unsigned value = 1u; value <= 4u; ++value)
+    {
+      REQUIRE(queue.try_push(pntr::make_shared<QueueObject>(value)));
+    }
+    pntr::SharedPtr<QueueObject> full = pntr::make_shared<QueueObject>(5u);
+    REQUIRE(!queue.try_push(full));
+    REQUIRE(full != nullptr);
+    pntr::SharedPtr<QueueObject> const first = queue.try_pop();
+    REQUIRE(first->m_value == 1u);
+    REQUIRE(first.use_count() == 1u);
+    REQUIRE(queue.try_push(full));
+    REQUIRE(full == nullptr);
+    REQUIRE(QueueObject::live_count() == 5u);
+  }
+
+  SECTION("Unbounded queue")
+  {
+    pntr::SharedQueueMpsc<QueueObject> queue;
+    REQUIRE(queue.try_pop() == nullptr);
+    for (unsigned value = 1u; value <= 100u; ++value)
+    {
+      queue.push(pntr::make_shared<QueueObject>(value));
+    }
+    for (unsigned value = 1u; value <= 50u; ++value)
+    {
+      REQUIRE(queue.try_pop()->m_value == value);
+    }
+    REQUIRE(QueueObject::live_count() == 50u);
+  }
+
+  SECTION("Empty pointers are rejected")
+  {
+    {
+      pntr::SharedQueue<QueueObject> queue(4u);
+      pntr::SharedPtr<QueueObject> empty;
+      REQUIRE(!queue.try_push(empty));
+      REQUIRE(queue.try_push(pntr::make_shared<QueueObject>(1u)));
+      REQUIRE(queue.try_push(pntr::make_shared<QueueObject>(2u)));
+      REQUIRE(queue.try_pop()->m_value == 1u);
+      REQUIRE(queue.try_push(pntr::make_shared<QueueObject>(3u)));
+      REQUIRE(QueueObject::live_count() == 2u);
+    }
+    REQUIRE(QueueObject::live_count() == 0u);
+    {
+      pntr::SharedQueueMpsc<QueueObject> queue;
+      queue.push(pntr::SharedPtr<QueueObject>());
+      queue.push(pntr::make_shared<QueueObject>(1u));
+      queue.push(pntr::make_shared<QueueObject>(2u));
+      REQUIRE(queue.try_pop()->m_value == 1u);
+      queue.push(pntr::make_shared<QueueObject>(3u));
+      REQUIRE(QueueObject::live_count() == 2u);
+    }
+    REQUIRE(QueueObject::live_count() == 0u);
+  }
+
+  SECTION("Many producers and consumers")
+  {
+    pntr::SharedQueue<QueueObject> queue(64u);
+    REQUIRE(run_pipeline(queue, 4u, 4u, 1000u) == 4u * 500500u);
+  }
+
+  SECTION("Many producers and one consumer")
+  {
+    pntr::SharedQueueMpsc<QueueObject> queue;
+    REQUIRE(run_pipeline(queue, 4u, 1u, 1000u) == 4u * 500500u);
+  }
+
+  REQUIRE(QueueObject::live_count() == 0u);
+}
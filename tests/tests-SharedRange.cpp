@@ -0,0 +1,223 @@
+#include "tests-common.hpp"
+
+#include <cstdint>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+  unsigned g_range_objects = 0u;
+
+  struct RangeObject: pntr::IntruderNew<RangeObject>
+  {
+    RangeObject() noexcept
+    {
+      ++g_range_objects;
+    }
+
+    ~RangeObject()
+    {
+      --g_range_objects;
+    }
+
+    // Released by the destructor while the range is released.
+    pntr::SharedPtr<RangeObject> m_child;
+  };
+
+  struct DeferredRangeObject: pntr::IntruderNewDeferred<DeferredRangeObject>
+  {
+    DeferredRangeObject() noexcept
+    {
+      ++g_range_objects;
+    }
+
+    ~DeferredRangeObject()
+    {
+      --g_range_objects;
+    }
+  };
+
+  template<template<class> class t_intruder>
+  struct RunObject: t_intruder<RunObject<t_intruder>>
+  {
+    RunObject() noexcept
+    {
+      ++g_range_objects;
+    }
+
+    ~RunObject()
+    {
+      --g_range_objects;
+    }
+  };
+
+  template<class t_shared>
+  using IntruderNew8 = pntr::IntruderNew<t_shared, pntr::ThreadSafe, std::uint8_t>;
+  template<class t_shared>
+  using IntruderAllocSpill = pntr::IntruderAllocSpill<t_shared>;
+
+  // Copy and release a run of one object, whose references might exceed the maximum of a spill counter.
+  template<template<class> class t_intruder>
+  void
+  test_run(std::size_t const p_length)
+  {
+    using Shared = RunObject<t_intruder>;
+    std::vector<pntr::SharedPtr<Shared>> range(p_length, pntr::make_shared<Shared>());
+    std::vector<pntr::SharedPtr<Shared>> copy(p_length);
+    pntr::copy_range(range.begin(), range.end(), copy.begin());
+    REQUIRE(range.front().use_count() == 2u * p_length);
+    pntr::release_range(copy.begin(), copy.end());
+    REQUIRE(range.front().use_count() == p_length);
+    pntr::release_range(range.begin(), range.end());
+    REQUIRE(g_range_objects == 0u);
+  }
+
+  // An output iterator whose assignments throw after the given number of assignments.
+  class ThrowingOutput
+  {
+  public:
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = void;
+
+    ThrowingOutput(std::vector<pntr::SharedPtr<RangeObject>> & p_output, std::size_t const p_limit) noexcept
+    : m_output(&p_output)
+    , m_limit(p_limit)
+    {}
+
+    ThrowingOutput &
+    operator=(pntr::SharedPtr<RangeObject> && p_shared)
+    {
+      if (m_output->size() == m_limit)
+      {
+        throw std::runtime_error("output is full");
+      }
+      m_output->push_back(std::move(p_shared));
+      return *this;
+    }
+
+    ThrowingOutput &
+    operator*() noexcept
+    {
+      return *this;
+    }
+
+    ThrowingOutput &
+    operator++() noexcept
+    {
+      return *this;
+    }
+
+  private:
+    std::vector<pntr::SharedPtr<RangeObject>> * m_output;
+    std::size_t m_limit;
+  };
+
+  // Runs of equal pointers, empty pointers, and objects which own other objects of the range.
+  std::vector<pntr::SharedPtr<RangeObject>>
+  make_range()
+  {
+    std::vector<pntr::SharedPtr<RangeObject>> range;
+    for (unsigned i = 0u; i < 1000u; ++i)
+    {
+      if (i % 10u == 0u)
+      {
+        range.emplace_back();
+      }
+      else if (i % 10u == 2u || i % 10u == 3u)
+      {
+        range.push_back(range.back());
+      }
+      else
+      {
+        range.push_back(pntr::make_shared<RangeObject>());
+        if (i % 10u == 9u)
+        {
+          range.back()->m_child = range[i - 1u];
+        }
+      }
+    }
+    return range;
+  }
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "SharedRange")
+{
+  REQUIRE(g_range_objects == 0u);
+
+  SECTION("release_range")
+  {
+    std::vector<pntr::SharedPtr<RangeObject>> range = make_range();
+    unsigned const objects = g_range_objects;
+    pntr::SharedPtr<RangeObject> const kept = range[5u];
+    pntr::release_range(range.begin(), range.end());
+    REQUIRE(g_range_objects == 1u);
+    REQUIRE(objects > 500u);
+    for (pntr::SharedPtr<RangeObject> const & element : range)
+    {
+      REQUIRE(element == nullptr);
+    }
+    REQUIRE(kept.use_count() == 1u);
+  }
+
+  SECTION("release_range with an empty range")
+  {
+    std::vector<pntr::SharedPtr<RangeObject>> range;
+    pntr::release_range(range.begin(), range.end());
+  }
+
+  SECTION("copy_range")
+  {
+    std::vector<pntr::SharedPtr<RangeObject>> const range = make_range();
+    std::vector<pntr::SharedPtr<RangeObject>> copy(range.size(), pntr::make_shared<RangeObject>());
+    REQUIRE(pntr::copy_range(range.begin(), range.end(), copy.begin()) == copy.end());
+    REQUIRE(copy == range);
+    REQUIRE(range[2u].use_count() == 6u);
+
+    std::vector<pntr::SharedPtr<RangeObject const>> appended;
+    pntr::copy_range(range.begin(), range.end(), std::back_inserter(appended));
+    REQUIRE(appended.size() == range.size());
+    REQUIRE(range[2u].use_count() == 9u);
+    pntr::release_range(copy.begin(), copy.end());
+    pntr::release_range(appended.begin(), appended.end());
+    REQUIRE(range[2u].use_count() == 3u);
+  }
+
+  SECTION("copy_range with a throwing output")
+  {
+    std::vector<pntr::SharedPtr<RangeObject>> const range(10u, pntr::make_shared<RangeObject>());
+    std::vector<pntr::SharedPtr<RangeObject>> output;
+    REQUIRE_THROWS_AS(pntr::copy_range(range.begin(), range.end(), ThrowingOutput(output, 4u)), std::runtime_error);
+    REQUIRE(output.size() == 4u);
+    REQUIRE(range.front().use_count() == 14u);
+  }
+
+  SECTION("Runs of a small counter")
+  {
+    test_run<IntruderNew8>(100u);
+  }
+
+  SECTION("Runs longer than the maximum of a spill counter")
+  {
+    test_run<IntruderAllocSpill>(100u);
+  }
+
+  SECTION("Deferred releases")
+  {
+    std::vector<pntr::SharedPtr<DeferredRangeObject>> range(100u);
+    for (pntr::SharedPtr<DeferredRangeObject> & element : range)
+    {
+      element = pntr::make_shared<DeferredRangeObject>();
+    }
+    pntr::release_range(range.begin(), range.end());
+    pntr::flush_deferred();
+  }
+
+  REQUIRE(g_range_objects == 0u);
+}
@@ -0,0 +1,185 @@
+#include "tests-common.hpp"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+namespace
+{
+  // The position of the root offset in the header of a snapshot.
+  constexpr std::size_t s_root_offset = offsetof(pntr::detail::SnapshotHeader, m_root);
+
+  struct SnapshotNode: pntr::IntruderNew<SnapshotNode>
+  {
+    struct Image
+    {
+      std::uint64_t m_value;
+      pntr::SnapshotPtr<Image> m_left;
+      pntr::SnapshotPtr<Image> m_right;
+    };
+
+    using PntrSnapshot = Image;
+
+    explicit SnapshotNode(std::uint64_t const p_value) noexcept
+    : m_value(p_value)
+    {}
+
+    void
+    pntr_snapshot(pntr::SnapshotWriter & p_writer, Image & p_image) const
+    {
+      p_image.m_value = m_value;
+      p_writer.link(p_image.m_left, m_left);
+      p_writer.link(p_image.m_right, m_right);
+    }
+
+    std::uint64_t m_value;
+    pntr::SharedPtr<SnapshotNode> m_left;
+    pntr::SharedPtr<SnapshotNode> m_right;
+  };
+
+  struct alignas(64) AlignedImage
+  {
+    std::uint8_t m_value;
+  };
+
+  struct AlignedNode: pntr::IntruderNew<AlignedNode>
+  {
+    using PntrSnapshot = AlignedImage;
+
+    void
+    pntr_snapshot(pntr::SnapshotWriter &, AlignedImage & p_image) const
+    {
+      p_image.m_value = 7u;
+    }
+  };
+} // namespace
+
+
+TEST_CASE(TEST_PREFIX "SnapshotWriter")
+{
+  // A chain of nodes which all share the same leaf, larger than one chunk of the writer.
+  std::size_t const count = 50000u;
+  pntr::SharedPtr<SnapshotNode> const leaf = pntr::make_shared<SnapshotNode>(std::uint64_t{1234u});
+  struct Nodes: std::vector<pntr::SharedPtr<SnapshotNode>>
+  {
+    // Unlink the nodes first, so the chain isn't destroyed recursively.
+    ~Nodes()
+    {
+      for (pntr::SharedPtr<SnapshotNode> const & node: *this)
+      {
+        node->m_left.reset();
+      }
+    }
+  } nodes;
+  for (std::size_t i = 0u; i < count; ++i)
+  {
+    nodes.push_back(pntr::make_shared<SnapshotNode>(std::uint64_t{i}));
+    nodes.back()->m_right = leaf;
+  }
+  for (std::size_t i = 1u; i < count; ++i)
+  {
+    nodes[i]->m_left = nodes[i - 1u];
+  }
+  // A cycle, which is broken below.
+  nodes[0u]->m_left = nodes[count - 1u];
+
+  pntr::SnapshotWriter writer;
+  writer.set_root(nodes[count / 2u]);
+  writer.set_root(nodes[count - 1u]);
+  nodes[0u]->m_left.reset();
+  REQUIRE(writer.size() > (std::size_t{1u} << 20u));
+
+  auto const check = [&](SnapshotNode::Image const * p_root)
+  {
+    REQUIRE(p_root != nullptr);
+    SnapshotNode::Image const * shared = p_root->m_right.get();
+    SnapshotNode::Image const * image = p_root;
+    for (std::size_t i = count; i-- > 0u;)
+    {
+      REQUIRE(image->m_value == i);
+      REQUIRE(image->m_right.get() == shared);
+      image = image->m_left.get();
+    }
+    REQUIRE(image == p_root);
+    REQUIRE(shared->m_value == 1234u);
+    REQUIRE(!shared->m_left);
+    REQUIRE(!shared->m_right);
+  };
+
+  SECTION("Copy")
+  {
+    std::vector<std::uint64_t> buffer(writer.size() / sizeof(std::uint64_t) + 1u);
+    writer.copy(buffer.data());
+    auto const * const bytes = reinterpret_cast<std::byte const *>(buffer.data());
+    std::uint64_t root = 0u;
+    std::memcpy(&root, bytes + s_root_offset, sizeof(root));
+    check(reinterpret_cast<SnapshotNode::Image const *>(bytes + root));
+  }
+
+#if defined(__linux__)
+  SECTION("Save and load")
+  {
+    std::string const path = (std::filesystem::temp_directory_path() / "pntr-tests-Snapshot.bin").string();
+    writer.save(path.c_str());
+    {
+      pntr::Snapshot const snapshot = pntr::Snapshot::load(path.c_str());
+      REQUIRE(snapshot.size() == writer.size());
+      check(snapshot.root<SnapshotNode>());
+    }
+    {
+      std::ofstream file(path, std::ofstream::binary | std::ofstream::trunc);
+      file << "not a snapshot, but long enough for the header";
+    }
+    REQUIRE_THROWS_AS(pntr::Snapshot::load(path.c_str()), std::system_error);
+    std::remove(path.c_str());
+    REQUIRE_THROWS_AS(pntr::Snapshot::load(path.c_str()), std::system_error);
+  }
+#endif
+}
+
+
+TEST_CASE(TEST_PREFIX "SnapshotWriter alignment")
+{
+  pntr::SnapshotWriter writer;
+  writer.set_root(pntr::make_shared<AlignedNode>());
+  std::vector<AlignedImage> buffer(writer.size() / sizeof(AlignedImage) + 1u);
+  writer.copy(buffer.data());
+  REQUIRE(writer.size() == 128u);
+  REQUIRE(buffer[1u].m_value == 7u);
+}
+
+
+#if defined(__linux__)
+TEST_CASE(TEST_PREFIX "Snapshot with an invalid root")
+{
+  pntr::SnapshotWriter writer;
+  writer.set_root(pntr::make_shared<AlignedNode>());
+  std::vector<AlignedImage> buffer(writer.size() / sizeof(AlignedImage));
+  writer.copy(buffer.data());
+  std::string const path = (std::filesystem::temp_directory_path() / "pntr-tests-Snapshot-root.bin").string();
+  auto const save_with_root = [&](std::uint64_t const p_root)
+  {
+    std::memcpy(reinterpret_cast<std::byte *>(buffer.data()) + s_root_offset, &p_root, sizeof(p_root));
+    std::ofstream file(path, std::ofstream::binary | std::ofstream::trunc);
+    file.write(reinterpret_cast<char const *>(buffer.data()), static_cast<std::streamsize>(writer.size()));
+  };
+
+  save_with_root(64u);
+  REQUIRE(pntr::Snapshot::load(path.c_str()).root<AlignedNode>()->m_value == 7u);
+  // Inside of the header.
+  save_with_root(8u);
+  REQUIRE_THROWS_AS(pntr::Snapshot::load(path.c_str()), std::system_error);
+  // Misaligned.
+  save_with_root(96u);
+  REQUIRE(pntr::Snapshot::load(path.c_str()).root<AlignedNode>() == nullptr);
+  // Doesn't fit into the mapping.
+  save_with_root(112u);
+  REQUIRE(pntr::Snapshot::load(path.c_str()).root<SnapshotNode>() == nullptr);
+  std::remove(path.c_str());
+}
+#endif
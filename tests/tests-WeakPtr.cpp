@@ -1,5 +1,11 @@
 #include "tests-common.hpp"
 
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
 
 struct IntruderAlloc
 {
@@ -7,8 +13,18 @@ struct IntruderAlloc
   using Intruder = pntr::IntruderAlloc<t_shared_base, pntr::ThreadUnsafe>;
 };
 
+struct IntruderNewWeak
+{
+  template<class t_shared_base>
+  using Intruder = pntr::IntruderNewWeak<t_shared_base, pntr::ThreadUnsafe>;
+};
+
+// Leaves seven user bits next to the flag of the side block.
+struct UserWeak: pntr::IntruderNewWeak<UserWeak, pntr::ThreadSafe, std::uint32_t, 24u>
+{};
+
 
-TEMPLATE_TEST_CASE(TEST_PREFIX "Empty WeakPtr", "", IntruderAlloc)
+TEMPLATE_TEST_CASE(TEST_PREFIX "Empty WeakPtr", "", IntruderAlloc, IntruderNewWeak)
 {
   using Minimal = MinimalSharedClass<TestType::template Intruder>;
   using Shared = StaticDerivedStaticClass<TestType::template Intruder>;
@@ -173,3 +189,162 @@ TEMPLATE_TEST_CASE(TEST_PREFIX "Valid WeakPtr", "", IntruderAlloc)
     REQUIRE(Shared::get_destroy_count() == 1u);
   }
 }
+
+
+TEST_CASE(TEST_PREFIX "WeakPtr with side blocks")
+{
+  using Minimal = MinimalSharedClass<IntruderNewWeak::template Intruder>;
+  using Shared = StaticDerivedStaticClass<IntruderNewWeak::template Intruder>;
+  using SharedBase = typename Shared::PntrSharedBase;
+
+  Minimal::get_construct_count() = 0u;
+  Minimal::get_destroy_count() = 0u;
+  Shared::get_construct_count() = 0u;
+  Shared::get_destroy_count() = 0u;
+
+  static_assert(sizeof(Minimal) == sizeof(pntr::IntruderNew<Minimal>));
+
+  SECTION("Objects without weak references have no side block")
+  {
+    pntr::SharedPtr<Minimal> m = pntr::make_shared<Minimal>();
+    REQUIRE(m.weak_count() == 1u);
+    REQUIRE(m->pntr_get_max_user() == 0u);
+    REQUIRE(m->pntr_get_user() == 0u);
+    m.reset();
+    REQUIRE(Minimal::get_destroy_count() == 1u);
+  }
+
+  SECTION("Member functions")
+  {
+    pntr::SharedPtr<Shared> s = pntr::make_shared<Shared>();
+    pntr::WeakPtr<Shared> ws(s);
+    REQUIRE(ws.weak_count() == 2u);
+    REQUIRE(s.weak_count() == 2u);
+    pntr::WeakPtr<SharedBase> wb(s);
+    REQUIRE(wb.weak_count() == 3u);
+    pntr::WeakPtr<SharedBase> wc(ws);
+    REQUIRE(wc.weak_count() == 4u);
+    REQUIRE(ws.use_count() == 1u);
+    REQUIRE_FALSE(ws.expired());
+    REQUIRE(ws.lock() == s);
+    REQUIRE(pntr::SharedPtr<Shared>(ws) == s);
+    REQUIRE_FALSE(ws.owner_before(s));
+    REQUIRE_FALSE(s.owner_before(ws));
+    REQUIRE_FALSE(wb.owner_before(ws));
+
+    pntr::WeakPtr<SharedBase> wt = s->weak_from_this();
+    REQUIRE(wt.weak_count() == 5u);
+    REQUIRE(wt.lock().get() == s.get());
+
+    s.reset();
+    REQUIRE(Shared::get_destroy_count() == 1u);
+    REQUIRE(ws.expired());
+    REQUIRE(ws.use_count() == 0u);
+    REQUIRE(ws.lock().get() == nullptr);
+    REQUIRE(ws.weak_count() == 4u);
+    REQUIRE_FALSE(wb.owner_before(ws));
+    REQUIRE_FALSE(ws.owner_before(wb));
+    ws.reset();
+    wb.reset();
+    wc.reset();
+    REQUIRE(wt.weak_count() == 1u);
+  }
+
+  SECTION("Copies don't access the side table")
+  {
+    pntr::SharedPtr<Shared> s = pntr::make_shared<Shared>();
+    pntr::WeakPtr<Shared> const w(s);
+    std::vector<std::unique_lock<std::mutex>> locks;
+    for (auto & shard : pntr::detail::WeakSideTable::instance())
+    {
+      locks.emplace_back(shard.m_mutex);
+    }
+    std::atomic<bool> copied = false;
+    std::thread copier(
+      [&w, &copied]() noexcept
+      {
+        pntr::WeakPtr<Shared> const copy = w;
+        pntr::WeakPtr<SharedBase> const base = copy;
+        copied = (base.lock() != nullptr);
+      });
+    auto const deadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+    while (!copied && std::chrono::steady_clock::now() < deadline)
+    {
+      std::this_thread::yield();
+    }
+    bool const copied_while_locked = copied;
+    locks.clear();
+    copier.join();
+    REQUIRE(copied_while_locked);
+    REQUIRE(w.weak_count() == 2u);
+  }
+
+  SECTION("Weak references from an uncontrolled object")
+  {
+    pntr::WeakPtr<Minimal const> w;
+    {
+      Minimal const m;
+      w = m.weak_from_this();
+      REQUIRE(w.weak_count() == 2u);
+    }
+    REQUIRE(w.weak_count() == 1u);
+    REQUIRE(w.lock().get() == nullptr);
+  }
+
+  REQUIRE(Minimal::get_construct_count() == Minimal::get_destroy_count());
+  REQUIRE(Shared::get_construct_count() == Shared::get_destroy_count());
+}
+
+
+TEST_CASE(TEST_PREFIX "WeakPtr with side blocks and user values")
+{
+  static_assert(UserWeak::pntr_get_max_user() == 127u);
+
+  SECTION("The user value keeps the flag of the side block")
+  {
+    pntr::SharedPtr<UserWeak> s = pntr::make_shared<UserWeak>();
+    REQUIRE(s->pntr_try_set_user(5u));
+    pntr::WeakPtr<UserWeak> w(s);
+    REQUIRE(s->pntr_get_user() == 5u);
+    REQUIRE(s->pntr_try_set_user(127u));
+    REQUIRE_FALSE(s->pntr_try_set_user(128u));
+    REQUIRE(s->pntr_get_user() == 127u);
+    REQUIRE(w.weak_count() == 2u);
+    s.reset();
+    REQUIRE(w.expired());
+    REQUIRE(w.weak_count() == 1u);
+  }
+
+  SECTION("Concurrent user values and side blocks")
+  {
+    std::vector<pntr::SharedPtr<UserWeak>> objects(1000u);
+    for (pntr::SharedPtr<UserWeak> & object : objects)
+    {
+      object = pntr::make_shared<UserWeak>();
+    }
+    std::vector<pntr::WeakPtr<UserWeak>> weak(objects.size());
+    std::thread users(
+      [&objects]() noexcept
+      {
+        for (std::size_t i = 0u; i < objects.size(); ++i)
+        {
+          objects[i]->pntr_try_set_user(static_cast<std::uint32_t>(i % 128u));
+        }
+      });
+    for (std::size_t i = 0u; i < objects.size(); ++i)
+    {
+      weak[i] = objects[i];
+    }
+    users.join();
+    for (std::size_t i = 0u; i < objects.size(); ++i)
+    {
+      REQUIRE(objects[i]->pntr_get_user() == i % 128u);
+      REQUIRE(weak[i].weak_count() == 2u);
+    }
+    objects.clear();
+    for (pntr::WeakPtr<UserWeak> const & object : weak)
+    {
+      REQUIRE(object.expired());
+    }
+  }
+}
@@ -0,0 +1,217 @@
+#include "tests-common.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <iterator>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+namespace
+{
+  struct RangeAlloc
+  {
+    template<class t_shared_base>
+    using Intruder = pntr::IntruderAlloc<t_shared_base>;
+  };
+
+  // The usage and weak counts share a word, so the usage count is masked.
+  struct RangeAllocShared32
+  {
+    template<class t_shared_base>
+    using Intruder = pntr::IntruderAlloc<t_shared_base, pntr::ThreadSafe, std::uint32_t, 20u, 12u, 0u>;
+  };
+
+  struct RangeAllocShared64
+  {
+    template<class t_shared_base>
+    using Intruder = pntr::IntruderAlloc<t_shared_base, pntr::ThreadSafe, std::uint64_t, 40u, 24u, 0u>;
+  };
+
+  struct RangeAllocSpill
+  {
+    template<class t_shared_base>
+    using Intruder = pntr::IntruderAllocSpill<t_shared_base>;
+  };
+
+  struct RangeNewWeak
+  {
+    template<class t_shared_base>
+    using Intruder = pntr::IntruderNewWeak<t_shared_base>;
+  };
+
+  template<template<class> class t_intruder>
+  struct RangeObject: t_intruder<RangeObject<t_intruder>>
+  {
+    explicit RangeObject(unsigned const p_value) noexcept
+    : m_value(p_value)
+    {}
+
+    unsigned m_value;
+  };
+
+  // An output iterator which appends to a vector, and throws when the vector has reached the limit.
+  template<class t_shared>
+  class ThrowingOutput
+  {
+  public:
+    using iterator_category = std::output_iterator_tag;
+    using value_type = void;
+    using difference_type = std::ptrdiff_t;
+    using pointer = void;
+    using reference = void;
+
+    ThrowingOutput(std::vector<pntr::SharedPtr<t_shared>> & p_output, std::size_t const p_limit) noexcept
+    : m_output(&p_output)
+    , m_limit(p_limit)
+    {}
+
+    ThrowingOutput &
+    operator=(pntr::SharedPtr<t_shared> && p_shared)
+    {
+      if (m_output->size() == m_limit)
+      {
+        throw std::runtime_error("output is full");
+      }
+      m_output->push_back(std::move(p_shared));
+      return *this;
+    }
+
+    ThrowingOutput &
+    operator*() noexcept
+    {
+      return *this;
+    }
+
+    ThrowingOutput &
+    operator++() noexcept
+    {
+      return *this;
+    }
+
+  private:
+    std::vector<pntr::SharedPtr<t_shared>> * m_output;
+    std::size_t m_limit;
+  };
+} // namespace
+
+
+TEMPLATE_TEST_CASE(TEST_PREFIX "WeakRange", "", RangeAlloc, RangeAllocShared32, RangeAllocShared64,
+                   RangeAllocSpill, RangeNewWeak)
+{
+  using Object = RangeObject<TestType::template Intruder>;
+
+  // Every third object stays alive, every tenth pointer is empty, and the rest expires.
+  std::vector<pntr::SharedPtr<Object>> alive;
+  std::vector<pntr::WeakPtr<Object>> range;
+  for (unsigned i = 0u; i < 203u; ++i)
+  {
+    if (i % 10u == 9u)
+    {
+      range.emplace_back();
+      continue;
+    }
+    pntr::SharedPtr<Object> const object = pntr::make_shared<Object>(i);
+    range.emplace_back(object);
+    if (i % 3u == 0u)
+    {
+      alive.push_back(object);
+    }
+  }
+
+  SECTION("sweep_expired")
+  {
+    auto const end = pntr::sweep_expired(range.begin(), range.end());
+    REQUIRE(static_cast<std::size_t>(end - range.begin()) == alive.size());
+    for (std::size_t i = 0u; i < alive.size(); ++i)
+    {
+      REQUIRE(range[i].lock() == alive[i]);
+    }
+    for (auto it = end; it != range.end(); ++it)
+    {
+      REQUIRE(it->is_empty());
+    }
+    range.erase(end, range.end());
+    REQUIRE(pntr::sweep_expired(range.begin(), range.end()) == range.end());
+
+    alive.clear();
+    REQUIRE(pntr::sweep_expired(range.begin(), range.end()) == range.begin());
+  }
+
+  SECTION("sweep_expired with an empty range")
+  {
+    std::vector<pntr::WeakPtr<Object>> empty;
+    REQUIRE(pntr::sweep_expired(empty.begin(), empty.end()) == empty.end());
+  }
+
+  SECTION("lock_all")
+  {
+    std::vector<pntr::SharedPtr<Object>> locked(range.size());
+    REQUIRE(pntr::lock_all(range.begin(), range.end(), locked.begin()) == locked.end());
+    std::size_t count = 0u;
+    for (std::size_t i = 0u; i < range.size(); ++i)
+    {
+      REQUIRE(locked[i] == range[i].lock());
+      if (locked[i] != nullptr)
+      {
+        REQUIRE(locked[i]->m_value % 3u == 0u);
+        ++count;
+      }
+    }
+    REQUIRE(count == alive.size());
+  }
+
+  SECTION("lock_all with a throwing output")
+  {
+    std::vector<pntr::SharedPtr<Object>> locked;
+    REQUIRE_THROWS_AS(pntr::lock_all(range.begin(), range.end(), ThrowingOutput<Object>(locked, 20u)),
+                      std::runtime_error);
+    REQUIRE(locked.size() == 20u);
+    for (std::size_t i = 0u; i < locked.size(); ++i)
+    {
+      REQUIRE(locked[i] == range[i].lock());
+    }
+    // No references are left behind by the interrupted block.
+    locked.clear();
+    range.erase(pntr::sweep_expired(range.begin(), range.end()), range.end());
+    REQUIRE(range.size() == alive.size());
+  }
+
+  SECTION("Concurrent expiry")
+  {
+    // Half of the live objects expire while the range is swept, so a sweep may keep some expired
+    // pointers, but never removes one of the kept objects.
+    std::vector<pntr::SharedPtr<Object>> const kept(alive.begin(), alive.begin() + alive.size() / 2u);
+    std::atomic<bool> done = false;
+    std::thread releaser(
+      [&alive, &kept, &done]() noexcept
+      {
+        while (alive.size() > kept.size())
+        {
+          alive.pop_back();
+          std::this_thread::yield();
+        }
+        done = true;
+      });
+    std::vector<pntr::SharedPtr<Object>> locked(range.size());
+    std::size_t fewest = range.size();
+    while (!done)
+    {
+      pntr::lock_all(range.begin(), range.end(), locked.begin());
+      range.erase(pntr::sweep_expired(range.begin(), range.end()), range.end());
+      fewest = std::min(fewest, range.size());
+    }
+    releaser.join();
+    locked.clear();
+    REQUIRE(fewest >= kept.size());
+    range.erase(pntr::sweep_expired(range.begin(), range.end()), range.end());
+    REQUIRE(range.size() == kept.size());
+    for (std::size_t i = 0u; i < kept.size(); ++i)
+    {
+      REQUIRE(range[i].lock() == kept[i]);
+    }
+  }
+}
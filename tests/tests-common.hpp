@@ -3,6 +3,8 @@
 #include <catch2/catch_test_macros.hpp>
 #include <catch2/catch_template_test_macros.hpp>
 
+#include <atomic>
+
 // Enables features for unit tests
 #define PNTR_UNITTESTS
 
@@ -23,6 +25,39 @@ inline static unsigned g_allocator_destroy = 0u;
 #endif
 
 
+// Counts the live objects of the classes which derive from it with the same tag, usually the class
+// itself, on any thread.
+template<class t_tag>
+struct LiveCounted
+{
+  static unsigned
+  live_count() noexcept
+  {
+    return s_live.load();
+  }
+
+  LiveCounted() noexcept
+  {
+    ++s_live;
+  }
+
+  LiveCounted(LiveCounted const &) noexcept
+  {
+    ++s_live;
+  }
+
+  ~LiveCounted()
+  {
+    --s_live;
+  }
+
+  LiveCounted & operator=(LiveCounted const &) = default;
+
+private:
+  static inline std::atomic<unsigned> s_live{0u};
+};
+
+
 template<template<class> class t_intruder>
 struct MinimalSharedClass: t_intruder<MinimalSharedClass<t_intruder>>
 {